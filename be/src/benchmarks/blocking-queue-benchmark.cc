@@ -0,0 +1,103 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+#include <sstream>
+#include <boost/thread.hpp>
+
+#include "util/benchmark.h"
+#include "util/blocking-queue.h"
+#include "util/cpu-info.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+// Benchmark for the mutex-based BlockingQueue vs the lock-free
+// LockFreeBlockingQueue across a contention curve: equal numbers of producers
+// and consumers pushing int64 elements through a queue sized like the scan
+// node's materialized batch queue. Each suite below fixes the total thread
+// count; within a suite the mutex queue is the baseline.
+
+struct TestData {
+  int num_producer_threads;
+  int num_consumer_threads;
+  // Number of elements each producer puts (and each consumer gets) per iteration.
+  int64_t num_elements;
+};
+
+const int QUEUE_CAPACITY = 1024;
+
+template <typename QueueType>
+void ProduceThread(QueueType* queue, int64_t n) {
+  for (int64_t i = 0; i < n; ++i) {
+    queue->BlockingPut(i);
+  }
+}
+
+template <typename QueueType>
+void ConsumeThread(QueueType* queue, int64_t n) {
+  int64_t v;
+  for (int64_t i = 0; i < n; ++i) {
+    queue->BlockingGet(&v);
+  }
+}
+
+template <typename QueueType>
+void TestQueue(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  int64_t num_per_thread = data->num_elements * batch_size;
+  QueueType queue(QUEUE_CAPACITY);
+  thread_group threads;
+  for (int i = 0; i < data->num_producer_threads; ++i) {
+    threads.add_thread(
+        new thread(ProduceThread<QueueType>, &queue, num_per_thread));
+  }
+  for (int i = 0; i < data->num_consumer_threads; ++i) {
+    threads.add_thread(
+        new thread(ConsumeThread<QueueType>, &queue, num_per_thread));
+  }
+  threads.join_all();
+  CHECK_EQ(queue.GetSize(), 0);
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  cout << Benchmark::GetMachineInfo() << endl;
+
+  int64_t N = 10000L;
+  const int num_producers[] = { 1, 2, 4, 8 };
+  const int num_points = sizeof(num_producers) / sizeof(num_producers[0]);
+
+  TestData data[num_points];
+  for (int i = 0; i < num_points; ++i) {
+    data[i].num_producer_threads = num_producers[i];
+    data[i].num_consumer_threads = num_producers[i];
+    data[i].num_elements = N;
+
+    stringstream suite_name;
+    suite_name << "queue " << num_producers[i] * 2 << "-Total Threads";
+    Benchmark suite(suite_name.str());
+
+    int baseline = suite.AddBenchmark("Mutex",
+        TestQueue<BlockingQueue<int64_t> >, &data[i], -1);
+    suite.AddBenchmark("Lock-Free",
+        TestQueue<LockFreeBlockingQueue<int64_t> >, &data[i], baseline);
+    cout << suite.Measure() << endl;
+  }
+
+  return 0;
+}
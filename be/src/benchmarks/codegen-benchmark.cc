@@ -0,0 +1,129 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
+#include "codegen/llvm-codegen.h"
+#include "common/object-pool.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/stopwatch.h"
+
+using namespace boost;
+using namespace impala;
+using namespace llvm;
+using namespace std;
+
+// Benchmark for codegen compilation time. Each workload creates a fresh LlvmCodeGen,
+// generates synthetic IR functions shaped like expression trees (a chain of arithmetic
+// ops, mirroring the deeply nested exprs the planner produces) and compiles them with
+// FinalizeModule(). The per-phase timings come from the codegen object's own profile
+// counters (LoadTime, PrepareTime, OptimizationTime, CompileTime), so a regression in
+// any phase is attributed directly. The workload matrix varies expression depth and
+// the number of functions in the module, which is what distinguishes a simple scan
+// from a wide aggregation, plus an unoptimized run to separate the optimizer from the
+// jit. Save the output at a baseline commit and diff after toolchain or codegen
+// changes; the single-function workloads are the codegen latency floor.
+
+// Generates a function computing a chain of 'depth' alternating add/multiply ops,
+// the IR shape an expr tree of that depth lowers to.
+static Function* CodegenExprTree(LlvmCodeGen* codegen, int depth, int id) {
+  stringstream name;
+  name << "ExprTreeDepth" << depth << "Fn" << id;
+  LlvmCodeGen::FnPrototype prototype(codegen, name.str(),
+      codegen->GetType(TYPE_BIGINT));
+  prototype.AddArgument(
+      LlvmCodeGen::NamedVariable("x", codegen->GetType(TYPE_BIGINT)));
+
+  LlvmCodeGen::LlvmBuilder builder(codegen->context());
+  Value* args[1];
+  Function* fn = prototype.GeneratePrototype(&builder, &args[0]);
+  Value* value = args[0];
+  for (int i = 0; i < depth; ++i) {
+    Value* constant = codegen->GetIntConstant(TYPE_BIGINT, i + 1);
+    if (i % 2 == 0) {
+      value = builder.CreateAdd(value, constant, "add");
+    } else {
+      value = builder.CreateMul(value, constant, "mul");
+    }
+  }
+  builder.CreateRet(value);
+  return codegen->FinalizeFunction(fn);
+}
+
+// Prints one line with the wall time and each codegen profile phase for the workload.
+static void RunWorkload(const string& name, int depth, int num_functions,
+    bool optimize) {
+  ObjectPool pool;
+  scoped_ptr<LlvmCodeGen> codegen;
+  MonotonicStopWatch total;
+  total.Start();
+  Status status = LlvmCodeGen::LoadImpalaIR(&pool, name, &codegen);
+  if (!status.ok()) {
+    cout << "Could not start codegen: " << status.GetDetail() << endl;
+    return;
+  }
+  codegen->EnableOptimizations(optimize);
+
+  vector<void*> fn_ptrs(num_functions);
+  for (int i = 0; i < num_functions; ++i) {
+    Function* fn = CodegenExprTree(codegen.get(), depth, i);
+    DCHECK(fn != NULL);
+    codegen->AddFunctionToJit(fn, &fn_ptrs[i]);
+  }
+  status = codegen->FinalizeModule();
+  total.Stop();
+  if (!status.ok()) {
+    cout << "Could not compile module: " << status.GetDetail() << endl;
+    return;
+  }
+
+  const char* phases[] = { "LoadTime", "PrepareTime", "CodegenTime",
+      "OptimizationTime", "CompileTime" };
+  cout << setw(28) << left << name << right
+       << " total " << setw(8) << total.ElapsedTime() / 1e6 << " ms";
+  for (int i = 0; i < sizeof(phases) / sizeof(phases[0]); ++i) {
+    RuntimeProfile::Counter* counter =
+        codegen->runtime_profile()->GetCounter(phases[i]);
+    double ms = counter == NULL ? 0 : counter->value() / 1e6;
+    cout << "  " << phases[i] << " " << setw(8) << ms << " ms";
+  }
+  cout << endl;
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  LlvmCodeGen::InitializeLlvm();
+  cout << endl << Benchmark::GetMachineInfo() << endl << endl;
+  cout << fixed << setprecision(2);
+
+  // Warm up: the first module load pays one-time llvm initialization costs that
+  // would otherwise be attributed to the first workload.
+  RunWorkload("warmup (discard)", 16, 1, true);
+  cout << endl;
+
+  RunWorkload("depth16-1fn", 16, 1, true);
+  RunWorkload("depth128-1fn", 128, 1, true);
+  RunWorkload("depth1024-1fn", 1024, 1, true);
+  RunWorkload("depth64-8fn", 64, 8, true);
+  RunWorkload("depth64-32fn", 64, 32, true);
+  RunWorkload("depth1024-1fn-noopt", 1024, 1, false);
+  RunWorkload("depth64-32fn-noopt", 64, 32, false);
+  return 0;
+}
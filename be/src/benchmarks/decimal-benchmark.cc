@@ -0,0 +1,95 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+
+#include "runtime/decimal-value.h"
+#include "runtime/types.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/decimal-util.h"
+
+using namespace impala;
+using namespace std;
+
+// Benchmark for comparing decimal values of different scales, the hot operation of
+// decimal predicates: one side must be rescaled per comparison, so the cost of
+// GetScaleMultiplier() and the final three-way compare dominates. The mixed-scale
+// cases exercise the SCALE_MULTIPLIERS lookup table; the same-scale cases measure the
+// floor the rescaling work is compared against.
+
+template<typename DECIMAL>
+struct TestData {
+  ColumnType x_type;
+  ColumnType y_type;
+  vector<DECIMAL> x_values;
+  vector<DECIMAL> y_values;
+  int result;
+};
+
+template<typename DECIMAL>
+TestData<DECIMAL> InitTestData(int num_values, int x_scale, int y_scale, int precision) {
+  TestData<DECIMAL> data;
+  data.x_type = ColumnType::CreateDecimalType(precision, x_scale);
+  data.y_type = ColumnType::CreateDecimalType(precision, y_scale);
+  for (int i = 0; i < num_values; ++i) {
+    data.x_values.push_back(DECIMAL(rand() % 1000000));
+    data.y_values.push_back(DECIMAL(rand() % 1000000));
+  }
+  data.result = 0;
+  return data;
+}
+
+template<typename DECIMAL>
+void TestCompare(int batch_size, void* d) {
+  TestData<DECIMAL>* data = reinterpret_cast<TestData<DECIMAL>*>(d);
+  int num_values = data->x_values.size();
+  for (int i = 0; i < batch_size; ++i) {
+    int result = 0;
+    for (int j = 0; j < num_values; ++j) {
+      result += data->x_values[j].Compare(
+          data->x_type, data->y_values[j], data->y_type);
+    }
+    data->result = result;
+  }
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  DecimalUtil::InitMaxUnscaledDecimal();
+
+  const int NUM_VALUES = 100;
+
+  TestData<Decimal4Value> d4_same = InitTestData<Decimal4Value>(NUM_VALUES, 2, 2, 9);
+  TestData<Decimal4Value> d4_mixed = InitTestData<Decimal4Value>(NUM_VALUES, 2, 4, 9);
+  TestData<Decimal8Value> d8_same = InitTestData<Decimal8Value>(NUM_VALUES, 2, 2, 18);
+  TestData<Decimal8Value> d8_mixed = InitTestData<Decimal8Value>(NUM_VALUES, 2, 8, 18);
+  TestData<Decimal16Value> d16_same =
+      InitTestData<Decimal16Value>(NUM_VALUES, 2, 2, 38);
+  TestData<Decimal16Value> d16_mixed =
+      InitTestData<Decimal16Value>(NUM_VALUES, 2, 12, 38);
+
+  Benchmark suite("Compare");
+  suite.AddBenchmark("Decimal4, same scale", TestCompare<Decimal4Value>, &d4_same);
+  suite.AddBenchmark("Decimal4, mixed scale", TestCompare<Decimal4Value>, &d4_mixed);
+  suite.AddBenchmark("Decimal8, same scale", TestCompare<Decimal8Value>, &d8_same);
+  suite.AddBenchmark("Decimal8, mixed scale", TestCompare<Decimal8Value>, &d8_mixed);
+  suite.AddBenchmark("Decimal16, same scale", TestCompare<Decimal16Value>, &d16_same);
+  suite.AddBenchmark("Decimal16, mixed scale", TestCompare<Decimal16Value>, &d16_mixed);
+  cout << suite.Measure();
+
+  return 0;
+}
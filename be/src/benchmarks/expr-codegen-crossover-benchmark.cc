@@ -0,0 +1,295 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "codegen/llvm-codegen.h"
+#include "common/object-pool.h"
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "gen-cpp/Exprs_types.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/runtime-state.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "udf/udf.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/stopwatch.h"
+
+using namespace boost;
+using namespace impala;
+using namespace impala_udf;
+using namespace llvm;
+using namespace std;
+
+// Measures where the interpreted and codegen'd expr paths cross over. For each expr
+// shape we build a real Expr tree (compound and/or predicates over boolean slot refs,
+// constructed from hand-built thrift nodes exactly as the frontend would send them),
+// then time the same rows through ExprContext::GetBooleanVal() and through the jitted
+// function from GetCodegendComputeFn(). The compile column is everything a fragment
+// pays before the first codegen'd row: creating the codegen object, generating IR for
+// the tree, optimization and jitting. The break-even column is compile time divided by
+// the per-row savings, i.e. the number of rows a fragment must process before codegen
+// pays for itself; "never" means the jitted function was not faster on this shape.
+//
+// Slot refs are used as leaves (rather than literals) so the optimizer cannot fold the
+// tree away. Short-circuit evaluation makes the per-row cost data dependent, so each
+// chain shape runs against data biased to keep it live: mostly-true rows for and-chains,
+// mostly-false rows for or-chains, 50/50 for the balanced alternating trees.
+//
+// The steady-state break-even counts from this table are what the default of
+// --codegen_rows_threshold (plan-fragment-executor.cc) should track; rerun this after
+// toolchain or codegen changes and adjust the default if the numbers move.
+
+static const int NUM_ROWS = 8192;
+static const int NUM_BOOL_SLOTS = 8;
+static const int NUM_PASSES = 50;
+
+typedef BooleanVal (*EvalFn)(ExprContext*, TupleRow*);
+
+// Returns a thrift expr node of boolean type with the remaining fields unset.
+static TExprNode BoolExprNode() {
+  TExprNode node;
+  node.type.types.push_back(TTypeNode());
+  node.type.types.back().__isset.scalar_type = true;
+  node.type.types.back().scalar_type.type = TPrimitiveType::BOOLEAN;
+  return node;
+}
+
+// Appends a compound predicate node ('op' is "and" or "or") expecting two children.
+static void AppendCompoundNode(const char* op, vector<TExprNode>* nodes) {
+  TExprNode node = BoolExprNode();
+  node.node_type = TExprNodeType::COMPOUND_PRED;
+  node.num_children = 2;
+  node.fn.name.__set_function_name(op);
+  node.__isset.fn = true;
+  nodes->push_back(node);
+}
+
+// Appends a slot ref leaf. The slots are cycled via 'next_leaf' so neighbouring leaves
+// read different slots, like a predicate over several columns would.
+static void AppendSlotRefNode(const vector<int>& slot_ids, int* next_leaf,
+    vector<TExprNode>* nodes) {
+  TExprNode node = BoolExprNode();
+  node.node_type = TExprNodeType::SLOT_REF;
+  node.num_children = 0;
+  TSlotRef slot_ref;
+  slot_ref.slot_id = slot_ids[(*next_leaf)++ % slot_ids.size()];
+  node.__set_slot_ref(slot_ref);
+  nodes->push_back(node);
+}
+
+// Appends, in the preorder layout Expr::CreateExprTree() expects, a left-deep chain of
+// 'depth' compound nodes over depth + 1 slot refs: op(op(...op(s, s)..., s), s).
+static void BuildChain(const char* op, int depth, const vector<int>& slot_ids,
+    int* next_leaf, vector<TExprNode>* nodes) {
+  if (depth == 0) {
+    AppendSlotRefNode(slot_ids, next_leaf, nodes);
+    return;
+  }
+  AppendCompoundNode(op, nodes);
+  BuildChain(op, depth - 1, slot_ids, next_leaf, nodes);
+  AppendSlotRefNode(slot_ids, next_leaf, nodes);
+}
+
+// Appends a balanced tree with 'depth' levels of compound nodes, alternating and/or
+// by level, over 2^depth slot refs.
+static void BuildBalanced(int depth, const vector<int>& slot_ids, int* next_leaf,
+    vector<TExprNode>* nodes) {
+  if (depth == 0) {
+    AppendSlotRefNode(slot_ids, next_leaf, nodes);
+    return;
+  }
+  AppendCompoundNode(depth % 2 == 0 ? "and" : "or", nodes);
+  BuildBalanced(depth - 1, slot_ids, next_leaf, nodes);
+  BuildBalanced(depth - 1, slot_ids, next_leaf, nodes);
+}
+
+// Creates NUM_ROWS single-tuple rows whose boolean slots are true with the given
+// probability. All slots are non-null.
+static TupleRow** CreateRows(const TupleDescriptor* tuple_desc, double true_probability,
+    MemPool* pool) {
+  TupleRow** rows =
+      reinterpret_cast<TupleRow**>(pool->Allocate(NUM_ROWS * sizeof(TupleRow*)));
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    TupleRow* row = reinterpret_cast<TupleRow*>(pool->Allocate(sizeof(Tuple*)));
+    Tuple* tuple = Tuple::Create(tuple_desc->byte_size(), pool);
+    for (int j = 0; j < tuple_desc->slots().size(); ++j) {
+      bool* slot = reinterpret_cast<bool*>(
+          tuple->GetSlot(tuple_desc->slots()[j]->tuple_offset()));
+      *slot = rand() / (RAND_MAX + 1.0) < true_probability;
+    }
+    row->SetTuple(0, tuple);
+    rows[i] = row;
+  }
+  return rows;
+}
+
+// Runs one shape through both paths and prints a row of the crossover table.
+static void RunShape(const string& name, const vector<TExprNode>& nodes,
+    DescriptorTbl* desc_tbl, const RowDescriptor& row_desc, TupleRow** rows) {
+  ObjectPool pool;
+  MemTracker tracker;
+  RuntimeState state(TPlanFragmentInstanceCtx(), "", NULL);
+  state.set_desc_tbl(desc_tbl);
+
+  TExpr texpr;
+  texpr.__set_nodes(nodes);
+  ExprContext* ctx;
+  Status status = Expr::CreateExprTree(&pool, texpr, &ctx);
+  if (status.ok()) status = ctx->Prepare(&state, row_desc, &tracker);
+  if (status.ok()) status = ctx->Open(&state);
+  if (!status.ok()) {
+    cout << name << ": could not create expr tree: " << status.GetDetail() << endl;
+    return;
+  }
+
+  // Interpreted path. The sink keeps the evaluation from being optimized away and
+  // doubles as a sanity check that both paths agree.
+  int64_t interp_sink = 0;
+  MonotonicStopWatch interp_sw;
+  interp_sw.Start();
+  for (int pass = 0; pass < NUM_PASSES; ++pass) {
+    for (int i = 0; i < NUM_ROWS; ++i) {
+      BooleanVal val = ctx->GetBooleanVal(rows[i]);
+      interp_sink += !val.is_null && val.val;
+    }
+  }
+  interp_sw.Stop();
+  double interp_ns = interp_sw.ElapsedTime() / (1.0 * NUM_PASSES * NUM_ROWS);
+
+  // Codegen path: everything up to a callable function pointer counts as compile time.
+  Function* fn = NULL;
+  void* jitted_fn = NULL;
+  MonotonicStopWatch compile_sw;
+  compile_sw.Start();
+  LlvmCodeGen* codegen = NULL;
+  status = state.GetCodegen(&codegen);
+  if (status.ok()) status = ctx->root()->GetCodegendComputeFn(&state, &fn);
+  if (status.ok()) {
+    codegen->AddFunctionToJit(fn, &jitted_fn);
+    status = codegen->FinalizeModule();
+  }
+  compile_sw.Stop();
+  if (!status.ok() || jitted_fn == NULL) {
+    cout << name << ": codegen unavailable: " << status.GetDetail() << endl;
+    ctx->Close(&state);
+    return;
+  }
+
+  EvalFn eval = reinterpret_cast<EvalFn>(jitted_fn);
+  int64_t codegen_sink = 0;
+  MonotonicStopWatch codegen_sw;
+  codegen_sw.Start();
+  for (int pass = 0; pass < NUM_PASSES; ++pass) {
+    for (int i = 0; i < NUM_ROWS; ++i) {
+      BooleanVal val = eval(ctx, rows[i]);
+      codegen_sink += !val.is_null && val.val;
+    }
+  }
+  codegen_sw.Stop();
+  double codegen_ns = codegen_sw.ElapsedTime() / (1.0 * NUM_PASSES * NUM_ROWS);
+  DCHECK_EQ(interp_sink, codegen_sink);
+
+  ctx->Close(&state);
+
+  cout << setw(22) << left << name << right
+       << "  interpreted " << setw(7) << interp_ns << " ns/row"
+       << "  codegen " << setw(7) << codegen_ns << " ns/row"
+       << "  compile " << setw(8) << compile_sw.ElapsedTime() / 1e6 << " ms"
+       << "  break-even ";
+  if (codegen_ns >= interp_ns) {
+    cout << "never";
+  } else {
+    cout << static_cast<int64_t>(compile_sw.ElapsedTime() / (interp_ns - codegen_ns))
+         << " rows";
+  }
+  cout << endl;
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  LlvmCodeGen::InitializeLlvm();
+  cout << endl << Benchmark::GetMachineInfo() << endl << endl;
+  cout << fixed << setprecision(2);
+
+  MemTracker tracker;
+  MemPool mem_pool(&tracker);
+  ObjectPool obj_pool;
+
+  DescriptorTblBuilder builder(&obj_pool);
+  TupleDescBuilder& tuple_builder = builder.DeclareTuple();
+  for (int i = 0; i < NUM_BOOL_SLOTS; ++i) tuple_builder << TYPE_BOOLEAN;
+  DescriptorTbl* desc_tbl = builder.Build();
+  const TupleDescriptor* tuple_desc = desc_tbl->GetTupleDescriptor(0);
+  RowDescriptor row_desc(*desc_tbl, vector<TTupleId>(1, (TTupleId)0),
+      vector<bool>(1, false));
+
+  vector<int> slot_ids;
+  for (int i = 0; i < tuple_desc->slots().size(); ++i) {
+    slot_ids.push_back(tuple_desc->slots()[i]->id());
+  }
+
+  srand(1234);
+  TupleRow** and_rows = CreateRows(tuple_desc, 0.95, &mem_pool);
+  TupleRow** or_rows = CreateRows(tuple_desc, 0.05, &mem_pool);
+  TupleRow** mixed_rows = CreateRows(tuple_desc, 0.5, &mem_pool);
+
+  // Warm up: the first codegen object pays one-time llvm and module-load costs that
+  // would otherwise be attributed to the first shape.
+  {
+    vector<TExprNode> nodes;
+    int next_leaf = 0;
+    BuildChain("and", 4, slot_ids, &next_leaf, &nodes);
+    RunShape("warmup (discard)", nodes, desc_tbl, row_desc, and_rows);
+  }
+  cout << endl;
+
+  static const int CHAIN_DEPTHS[] = { 1, 4, 16, 64 };
+  for (int i = 0; i < sizeof(CHAIN_DEPTHS) / sizeof(CHAIN_DEPTHS[0]); ++i) {
+    stringstream name;
+    name << "and-chain-" << CHAIN_DEPTHS[i];
+    vector<TExprNode> nodes;
+    int next_leaf = 0;
+    BuildChain("and", CHAIN_DEPTHS[i], slot_ids, &next_leaf, &nodes);
+    RunShape(name.str(), nodes, desc_tbl, row_desc, and_rows);
+  }
+  for (int i = 0; i < sizeof(CHAIN_DEPTHS) / sizeof(CHAIN_DEPTHS[0]); ++i) {
+    stringstream name;
+    name << "or-chain-" << CHAIN_DEPTHS[i];
+    vector<TExprNode> nodes;
+    int next_leaf = 0;
+    BuildChain("or", CHAIN_DEPTHS[i], slot_ids, &next_leaf, &nodes);
+    RunShape(name.str(), nodes, desc_tbl, row_desc, or_rows);
+  }
+  static const int BALANCED_DEPTHS[] = { 2, 4, 6 };
+  for (int i = 0; i < sizeof(BALANCED_DEPTHS) / sizeof(BALANCED_DEPTHS[0]); ++i) {
+    stringstream name;
+    name << "balanced-" << BALANCED_DEPTHS[i];
+    vector<TExprNode> nodes;
+    int next_leaf = 0;
+    BuildBalanced(BALANCED_DEPTHS[i], slot_ids, &next_leaf, &nodes);
+    RunShape(name.str(), nodes, desc_tbl, row_desc, mixed_rows);
+  }
+
+  mem_pool.FreeAll();
+  return 0;
+}
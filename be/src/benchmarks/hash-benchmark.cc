@@ -43,7 +43,9 @@ using namespace std;
 //   1. FNV Hash: Fowler-Noll-Vo hash function
 //   2. Boost Hash: boost hash function
 //   3. Crc: hash using sse4 crc hash instruction
-//   4. Codegen: hash using sse4 with the tuple types baked into the codegen function
+//   4. Crc64: 64-bit hash using two sse4 crc lanes (HashUtil::CrcHash64)
+//   5. Murmur: Murmur2 64-bit hash, the non-sse4 fallback for Hash64()
+//   6. Codegen: hash using sse4 with the tuple types baked into the codegen function
 //
 // n is the number of buckets, k is the number of items
 // Expected(collisions) = n - k + E(X)
@@ -112,6 +114,40 @@ void TestCrcIntHash(int batch, void* d) {
   }
 }
 
+void TestCrc64IntHash(int batch, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  int rows = data->num_rows;
+  int cols = data->num_cols;
+  for (int i = 0; i < batch; ++i) {
+    int32_t* values = reinterpret_cast<int32_t*>(data->data);
+    for (int j = 0; j < rows; ++j) {
+      uint64_t hash = HashUtil::FNV64_SEED;
+      for (int k = 0; k < cols; ++k) {
+        hash = HashUtil::CrcHash64(&values[k], sizeof(uint32_t), hash);
+      }
+      data->results[j] = hash;
+      values += cols;
+    }
+  }
+}
+
+void TestMurmurIntHash(int batch, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  int rows = data->num_rows;
+  int cols = data->num_cols;
+  for (int i = 0; i < batch; ++i) {
+    int32_t* values = reinterpret_cast<int32_t*>(data->data);
+    for (int j = 0; j < rows; ++j) {
+      uint64_t hash = HashUtil::FNV64_SEED;
+      for (int k = 0; k < cols; ++k) {
+        hash = HashUtil::MurmurHash2_64(&values[k], sizeof(uint32_t), hash);
+      }
+      data->results[j] = hash;
+      values += cols;
+    }
+  }
+}
+
 void TestBoostIntHash(int batch, void* d) {
   TestData* data = reinterpret_cast<TestData*>(d);
   int rows = data->num_rows;
@@ -192,6 +228,58 @@ void TestCrcMixedHash(int batch, void* d) {
   }
 }
 
+void TestCrc64MixedHash(int batch, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  int rows = data->num_rows;
+  for (int i = 0; i < batch; ++i) {
+    char* values = reinterpret_cast<char*>(data->data);
+    for (int j = 0; j < rows; ++j) {
+      uint64_t hash = HashUtil::FNV64_SEED;
+
+      hash = HashUtil::CrcHash64(values, sizeof(int8_t), hash);
+      values += sizeof(int8_t);
+
+      hash = HashUtil::CrcHash64(values, sizeof(int32_t), hash);
+      values += sizeof(int32_t);
+
+      hash = HashUtil::CrcHash64(values, sizeof(int64_t), hash);
+      values += sizeof(int64_t);
+
+      StringValue* str = reinterpret_cast<StringValue*>(values);
+      hash = HashUtil::CrcHash64(str->ptr, str->len, hash);
+      values += sizeof(StringValue);
+
+      data->results[j] = hash;
+    }
+  }
+}
+
+void TestMurmurMixedHash(int batch, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  int rows = data->num_rows;
+  for (int i = 0; i < batch; ++i) {
+    char* values = reinterpret_cast<char*>(data->data);
+    for (int j = 0; j < rows; ++j) {
+      uint64_t hash = HashUtil::FNV64_SEED;
+
+      hash = HashUtil::MurmurHash2_64(values, sizeof(int8_t), hash);
+      values += sizeof(int8_t);
+
+      hash = HashUtil::MurmurHash2_64(values, sizeof(int32_t), hash);
+      values += sizeof(int32_t);
+
+      hash = HashUtil::MurmurHash2_64(values, sizeof(int64_t), hash);
+      values += sizeof(int64_t);
+
+      StringValue* str = reinterpret_cast<StringValue*>(values);
+      hash = HashUtil::MurmurHash2_64(str->ptr, str->len, hash);
+      values += sizeof(StringValue);
+
+      data->results[j] = hash;
+    }
+  }
+}
+
 void TestCodegenMixedHash(int batch, void* d) {
   TestData* data = reinterpret_cast<TestData*>(d);
   CodegenHashFn fn = reinterpret_cast<CodegenHashFn>(data->jitted_fn);
@@ -425,6 +513,8 @@ int main(int argc, char **argv) {
   int_suite.AddBenchmark("Fnv", TestFnvIntHash, &int_data);
   int_suite.AddBenchmark("Boost", TestBoostIntHash, &int_data);
   int_suite.AddBenchmark("Crc", TestCrcIntHash, &int_data);
+  int_suite.AddBenchmark("Crc64", TestCrc64IntHash, &int_data);
+  int_suite.AddBenchmark("Murmur", TestMurmurIntHash, &int_data);
   int_suite.AddBenchmark("Codegen", TestCodegenIntHash, &int_data);
   cout << int_suite.Measure() << endl;
 
@@ -432,6 +522,8 @@ int main(int argc, char **argv) {
   mixed_suite.AddBenchmark("Fnv", TestFnvMixedHash, &mixed_data);
   mixed_suite.AddBenchmark("Boost", TestBoostMixedHash, &mixed_data);
   mixed_suite.AddBenchmark("Crc", TestCrcMixedHash, &mixed_data);
+  mixed_suite.AddBenchmark("Crc64", TestCrc64MixedHash, &mixed_data);
+  mixed_suite.AddBenchmark("Murmur", TestMurmurMixedHash, &mixed_data);
   mixed_suite.AddBenchmark("Codegen", TestCodegenMixedHash, &mixed_data);
   cout << mixed_suite.Measure();
 
@@ -0,0 +1,389 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+
+#include "common/compiler-util.h"
+#include "common/object-pool.h"
+#include "exec/hash-table.inline.h"
+#include "exec/old-hash-table.inline.h"
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/string-value.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/perf-counters.h"
+#include "util/stopwatch.h"
+
+using namespace impala;
+using namespace std;
+
+// Benchmark for HashTable and OldHashTable build and probe rates under realistic key
+// distributions. hash-table-test covers correctness and hash-benchmark only measures
+// the hash functions; this harness measures the tables themselves:
+//
+//  - key types: int64, 16 byte string and a multi-column (int64, string) key;
+//  - build cardinalities: 4K (L2 resident), 64K and 1M buckets (cache-busting) --
+//    raise MAX_CARDINALITY on machines with the memory and patience for larger runs;
+//  - distributions: uniform unique keys, a power-law approximation of a zipf draw,
+//    and a duplicate factor of 8 on the build side.
+//
+// Each suite compares OldHashTable (the baseline entry) against HashTable for one
+// configuration; each iteration probes (or builds) NUM_ROWS rows, so rows/sec =
+// rate * NUM_ROWS * 1000. After the suites, a separate pass over the int64 probe
+// configurations reports cycles/probe and hardware counters (cache misses, branch
+// misses) from PerfCounters for each cardinality.
+
+static const int NUM_ROWS = 64 * 1024;
+
+// Build-side cardinalities for the sweep.
+static const int64_t CARDINALITIES[] = { 4 * 1024, 64 * 1024, 1024 * 1024 };
+static const int64_t MAX_CARDINALITY = 1024 * 1024;
+
+// Duplicate factor for the duplicates configuration.
+static const int DUPLICATE_FACTOR = 8;
+
+enum Distribution {
+  UNIFORM,
+  ZIPF,
+};
+
+enum KeyType {
+  INT64_KEY,
+  STRING_KEY,
+  MULTI_COLUMN_KEY,
+};
+
+static int64_t GenerateKey(Distribution distribution, int64_t cardinality) {
+  if (distribution == ZIPF) {
+    // Power-law approximation of a zipf draw: heavily skewed towards low key values
+    // with a long tail across the whole key space.
+    double u = rand() / (RAND_MAX + 1.0);
+    return static_cast<int64_t>(cardinality * u * u * u * u);
+  }
+  return rand() % cardinality;
+}
+
+// All key types use a single tuple with an int64 key at offset 0; the string key
+// types append a StringValue slot at offset 8. The string payload is 16 bytes and is
+// shared between rows with the same key so string probes chase the pointer the same
+// way a real query would.
+struct KeySpace {
+  KeyType key_type;
+  // Backing store for the 16 byte string keys, one per key value.
+  vector<string>* string_keys;
+};
+
+static const int STRING_KEY_LEN = 16;
+
+static TupleRow* CreateRow(MemPool* pool, const KeySpace& keys, int64_t key) {
+  int tuple_size = keys.key_type == INT64_KEY ?
+      sizeof(int64_t) : sizeof(int64_t) + sizeof(StringValue);
+  uint8_t* tuple_row_mem = pool->Allocate(sizeof(Tuple*));
+  Tuple* tuple_mem = Tuple::Create(tuple_size, pool);
+  *reinterpret_cast<int64_t*>(tuple_mem) = key;
+  if (keys.key_type != INT64_KEY) {
+    const string& str = (*keys.string_keys)[key];
+    StringValue* sv = reinterpret_cast<StringValue*>(
+        reinterpret_cast<uint8_t*>(tuple_mem) + sizeof(int64_t));
+    *sv = StringValue(const_cast<char*>(str.data()), str.size());
+  }
+  TupleRow* row = reinterpret_cast<TupleRow*>(tuple_row_mem);
+  row->SetTuple(0, tuple_mem);
+  return row;
+}
+
+// Creates the key exprs for 'key_type' evaluated against the layout CreateRow()
+// produces: the int64 slot, the string slot, or both for the multi-column key.
+static void CreateKeyExprs(ObjectPool* pool, MemTracker* tracker, KeyType key_type,
+    vector<ExprContext*>* expr_ctxs) {
+  RowDescriptor empty_row_desc;
+  if (key_type == INT64_KEY || key_type == MULTI_COLUMN_KEY) {
+    expr_ctxs->push_back(pool->Add(new ExprContext(
+        pool->Add(new SlotRef(TYPE_BIGINT, 0)))));
+  }
+  if (key_type == STRING_KEY || key_type == MULTI_COLUMN_KEY) {
+    expr_ctxs->push_back(pool->Add(new ExprContext(
+        pool->Add(new SlotRef(TYPE_STRING, sizeof(int64_t))))));
+  }
+  Status status = Expr::Prepare(*expr_ctxs, NULL, empty_row_desc, tracker);
+  DCHECK(status.ok());
+  status = Expr::Open(*expr_ctxs, NULL);
+  DCHECK(status.ok());
+}
+
+struct TableData {
+  // Exactly one of table/old_table is set, matching the Test*Probe function used.
+  HashTable* table;
+  HashTableCtx* ctx;
+  OldHashTable* old_table;
+
+  vector<TupleRow*>* probe_rows;
+  // Accumulated so the probe loops cannot be optimized away.
+  int64_t num_matches;
+
+  TableData() : table(NULL), ctx(NULL), old_table(NULL), probe_rows(NULL),
+      num_matches(0) { }
+};
+
+void TestNewProbe(int batch_size, void* d) {
+  TableData* data = reinterpret_cast<TableData*>(d);
+  const vector<TupleRow*>& rows = *data->probe_rows;
+  for (int i = 0; i < batch_size; ++i) {
+    uint32_t hash = 0;
+    for (int j = 0; j < rows.size(); ++j) {
+      if (!data->ctx->EvalAndHashProbe(rows[j], &hash)) continue;
+      HashTable::Iterator iter = data->table->Find(data->ctx, hash);
+      while (iter != data->table->End()) {
+        ++data->num_matches;
+        iter.Next<true>(data->ctx);
+      }
+    }
+  }
+}
+
+void TestOldProbe(int batch_size, void* d) {
+  TableData* data = reinterpret_cast<TableData*>(d);
+  const vector<TupleRow*>& rows = *data->probe_rows;
+  for (int i = 0; i < batch_size; ++i) {
+    for (int j = 0; j < rows.size(); ++j) {
+      OldHashTable::Iterator iter = data->old_table->Find(rows[j]);
+      while (iter != data->old_table->End()) {
+        ++data->num_matches;
+        iter.Next<true>();
+      }
+    }
+  }
+}
+
+struct BuildData {
+  // Pool the tables allocate from; cleared before each build.
+  MemPool* table_pool;
+  MemTracker* tracker;
+  HashTableCtx* ctx;
+  const vector<ExprContext*>* build_expr_ctxs;
+  const vector<ExprContext*>* probe_expr_ctxs;
+  vector<TupleRow*>* rows;
+};
+
+void TestNewBuild(int batch_size, void* d) {
+  BuildData* data = reinterpret_cast<BuildData*>(d);
+  const vector<TupleRow*>& rows = *data->rows;
+  for (int i = 0; i < batch_size; ++i) {
+    data->table_pool->Clear();
+    HashTable table(data->table_pool);
+    uint32_t hash = 0;
+    for (int j = 0; j < rows.size(); ++j) {
+      if (!data->ctx->EvalAndHashBuild(rows[j], &hash)) continue;
+      table.Insert(data->ctx, rows[j]->GetTuple(0), hash);
+    }
+  }
+}
+
+void TestOldBuild(int batch_size, void* d) {
+  BuildData* data = reinterpret_cast<BuildData*>(d);
+  const vector<TupleRow*>& rows = *data->rows;
+  for (int i = 0; i < batch_size; ++i) {
+    OldHashTable table(NULL, *data->build_expr_ctxs, *data->probe_expr_ctxs, 1,
+        false, false, 0, data->tracker);
+    for (int j = 0; j < rows.size(); ++j) {
+      table.Insert(rows[j]);
+    }
+    table.Close();
+  }
+}
+
+// Sets up 'data' with a table of 'cardinality' distinct keys, 'duplicate_factor'
+// build rows per key, and NUM_ROWS probe rows drawn from 'distribution'.
+static void SetupTable(ObjectPool* pool, MemPool* mem_pool, const KeySpace& keys,
+    const vector<ExprContext*>& build_expr_ctxs,
+    const vector<ExprContext*>& probe_expr_ctxs, int64_t cardinality,
+    int duplicate_factor, Distribution distribution, TableData* data) {
+  data->ctx = pool->Add(
+      new HashTableCtx(build_expr_ctxs, probe_expr_ctxs, false, false, 1, 0, 1));
+  data->table = pool->Add(new HashTable(mem_pool));
+  uint32_t hash = 0;
+  for (int64_t key = 0; key < cardinality; ++key) {
+    for (int dup = 0; dup < duplicate_factor; ++dup) {
+      TupleRow* row = CreateRow(mem_pool, keys, key);
+      if (!data->ctx->EvalAndHashBuild(row, &hash)) continue;
+      data->table->Insert(data->ctx, row->GetTuple(0), hash);
+    }
+  }
+  data->probe_rows = pool->Add(new vector<TupleRow*>());
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    data->probe_rows->push_back(
+        CreateRow(mem_pool, keys, GenerateKey(distribution, cardinality)));
+  }
+}
+
+// Old-table variant of SetupTable() sharing the same probe rows.
+static void SetupOldTable(ObjectPool* pool, MemPool* mem_pool, const KeySpace& keys,
+    const vector<ExprContext*>& build_expr_ctxs,
+    const vector<ExprContext*>& probe_expr_ctxs, MemTracker* tracker,
+    int64_t cardinality, int duplicate_factor, const TableData& new_data,
+    TableData* data) {
+  data->old_table = pool->Add(new OldHashTable(NULL, build_expr_ctxs,
+      probe_expr_ctxs, 1, false, false, 0, tracker));
+  for (int64_t key = 0; key < cardinality; ++key) {
+    for (int dup = 0; dup < duplicate_factor; ++dup) {
+      data->old_table->Insert(CreateRow(mem_pool, keys, key));
+    }
+  }
+  data->probe_rows = new_data.probe_rows;
+}
+
+// Reports cycles/probe and hardware counters over a fixed number of probe passes.
+static void MeasureProbeCounters(const string& label, TableData* data) {
+  const int NUM_PASSES = 10;
+  PerfCounters counters;
+  counters.AddDefaultCounters();
+  counters.Snapshot("before");
+  uint64_t start_cycles = StopWatch::Rdtsc();
+  TestNewProbe(NUM_PASSES, data);
+  uint64_t cycles = StopWatch::Rdtsc() - start_cycles;
+  counters.Snapshot("after");
+  cout << label << ": "
+       << cycles / (NUM_PASSES * data->probe_rows->size()) << " cycles/probe" << endl;
+  counters.PrettyPrint(&cout);
+  cout << endl;
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  cout << endl << Benchmark::GetMachineInfo() << endl;
+  cout << "Each iteration processes " << NUM_ROWS << " rows: "
+       << "rows/sec = rate * " << NUM_ROWS << " * 1000" << endl << endl;
+
+  ObjectPool pool;
+  MemTracker tracker;
+  MemPool mem_pool(&tracker);
+
+  // The 16 byte string keys, shared by every row with the same key value.
+  vector<string> string_keys;
+  for (int64_t i = 0; i < MAX_CARDINALITY; ++i) {
+    char buffer[STRING_KEY_LEN + 1];
+    snprintf(buffer, sizeof(buffer), "key-%012ld", i);
+    string_keys.push_back(string(buffer, STRING_KEY_LEN));
+  }
+
+  KeySpace int64_keys = { INT64_KEY, NULL };
+  KeySpace str_keys = { STRING_KEY, &string_keys };
+  KeySpace multi_keys = { MULTI_COLUMN_KEY, &string_keys };
+
+  vector<ExprContext*> int64_build_exprs, int64_probe_exprs;
+  CreateKeyExprs(&pool, &tracker, INT64_KEY, &int64_build_exprs);
+  CreateKeyExprs(&pool, &tracker, INT64_KEY, &int64_probe_exprs);
+  vector<ExprContext*> str_build_exprs, str_probe_exprs;
+  CreateKeyExprs(&pool, &tracker, STRING_KEY, &str_build_exprs);
+  CreateKeyExprs(&pool, &tracker, STRING_KEY, &str_probe_exprs);
+  vector<ExprContext*> multi_build_exprs, multi_probe_exprs;
+  CreateKeyExprs(&pool, &tracker, MULTI_COLUMN_KEY, &multi_build_exprs);
+  CreateKeyExprs(&pool, &tracker, MULTI_COLUMN_KEY, &multi_probe_exprs);
+
+  const int num_cardinalities = sizeof(CARDINALITIES) / sizeof(CARDINALITIES[0]);
+  vector<TableData> int64_uniform(num_cardinalities);
+  vector<TableData> int64_uniform_old(num_cardinalities);
+  for (int i = 0; i < num_cardinalities; ++i) {
+    SetupTable(&pool, &mem_pool, int64_keys, int64_build_exprs, int64_probe_exprs,
+        CARDINALITIES[i], 1, UNIFORM, &int64_uniform[i]);
+    SetupOldTable(&pool, &mem_pool, int64_keys, int64_build_exprs, int64_probe_exprs,
+        &tracker, CARDINALITIES[i], 1, int64_uniform[i], &int64_uniform_old[i]);
+
+    stringstream name;
+    name << "Probe int64 uniform " << CARDINALITIES[i] << " keys";
+    Benchmark suite(name.str());
+    suite.AddBenchmark("old", TestOldProbe, &int64_uniform_old[i]);
+    suite.AddBenchmark("new", TestNewProbe, &int64_uniform[i]);
+    cout << suite.Measure() << endl;
+  }
+
+  TableData int64_zipf, int64_zipf_old, int64_dups, int64_dups_old;
+  SetupTable(&pool, &mem_pool, int64_keys, int64_build_exprs, int64_probe_exprs,
+      64 * 1024, 1, ZIPF, &int64_zipf);
+  SetupOldTable(&pool, &mem_pool, int64_keys, int64_build_exprs, int64_probe_exprs,
+      &tracker, 64 * 1024, 1, int64_zipf, &int64_zipf_old);
+  SetupTable(&pool, &mem_pool, int64_keys, int64_build_exprs, int64_probe_exprs,
+      8 * 1024, DUPLICATE_FACTOR, UNIFORM, &int64_dups);
+  SetupOldTable(&pool, &mem_pool, int64_keys, int64_build_exprs, int64_probe_exprs,
+      &tracker, 8 * 1024, DUPLICATE_FACTOR, int64_dups, &int64_dups_old);
+
+  Benchmark zipf_suite("Probe int64 zipf 64K keys");
+  zipf_suite.AddBenchmark("old", TestOldProbe, &int64_zipf_old);
+  zipf_suite.AddBenchmark("new", TestNewProbe, &int64_zipf);
+  cout << zipf_suite.Measure() << endl;
+
+  Benchmark dup_suite("Probe int64 8K keys x8 duplicates");
+  dup_suite.AddBenchmark("old", TestOldProbe, &int64_dups_old);
+  dup_suite.AddBenchmark("new", TestNewProbe, &int64_dups);
+  cout << dup_suite.Measure() << endl;
+
+  TableData str_uniform, str_uniform_old, multi_uniform, multi_uniform_old;
+  SetupTable(&pool, &mem_pool, str_keys, str_build_exprs, str_probe_exprs,
+      64 * 1024, 1, UNIFORM, &str_uniform);
+  SetupOldTable(&pool, &mem_pool, str_keys, str_build_exprs, str_probe_exprs,
+      &tracker, 64 * 1024, 1, str_uniform, &str_uniform_old);
+  SetupTable(&pool, &mem_pool, multi_keys, multi_build_exprs, multi_probe_exprs,
+      64 * 1024, 1, UNIFORM, &multi_uniform);
+  SetupOldTable(&pool, &mem_pool, multi_keys, multi_build_exprs, multi_probe_exprs,
+      &tracker, 64 * 1024, 1, multi_uniform, &multi_uniform_old);
+
+  Benchmark str_suite("Probe string16 uniform 64K keys");
+  str_suite.AddBenchmark("old", TestOldProbe, &str_uniform_old);
+  str_suite.AddBenchmark("new", TestNewProbe, &str_uniform);
+  cout << str_suite.Measure() << endl;
+
+  Benchmark multi_suite("Probe int64+string16 uniform 64K keys");
+  multi_suite.AddBenchmark("old", TestOldProbe, &multi_uniform_old);
+  multi_suite.AddBenchmark("new", TestNewProbe, &multi_uniform);
+  cout << multi_suite.Measure() << endl;
+
+  MemPool build_pool(&tracker);
+  HashTableCtx build_ctx(int64_build_exprs, int64_probe_exprs, false, false, 1, 0, 1);
+  BuildData build_data;
+  build_data.table_pool = &build_pool;
+  build_data.tracker = &tracker;
+  build_data.ctx = &build_ctx;
+  build_data.build_expr_ctxs = &int64_build_exprs;
+  build_data.probe_expr_ctxs = &int64_probe_exprs;
+  build_data.rows = int64_dups.probe_rows;
+
+  Benchmark build_suite("Build int64 8K keys x8 duplicates");
+  build_suite.AddBenchmark("old", TestOldBuild, &build_data);
+  build_suite.AddBenchmark("new", TestNewBuild, &build_data);
+  cout << build_suite.Measure() << endl;
+
+  for (int i = 0; i < num_cardinalities; ++i) {
+    stringstream label;
+    label << "Probe int64 uniform " << CARDINALITIES[i] << " keys";
+    MeasureProbeCounters(label.str(), &int64_uniform[i]);
+  }
+
+  Expr::Close(int64_build_exprs, NULL);
+  Expr::Close(int64_probe_exprs, NULL);
+  Expr::Close(str_build_exprs, NULL);
+  Expr::Close(str_probe_exprs, NULL);
+  Expr::Close(multi_build_exprs, NULL);
+  Expr::Close(multi_probe_exprs, NULL);
+  build_pool.FreeAll();
+  mem_pool.FreeAll();
+  return 0;
+}
@@ -172,11 +172,14 @@ int main(int argc, char **argv) {
   cout << Benchmark::GetMachineInfo() << endl;
 
   int64_t N = 10000L;
-  const int max_producers = 12;
-  
+  const int max_producers = 40;
+
   Benchmark suite("locking");
   TestData data[max_producers];
-  for (int i = 0; i < max_producers; i += 2) {
+  // Go well past the number of cores: oversubscription is the normal operating
+  // state (more fragment threads than cores) and is where parking waiters instead
+  // of spinning pays off.
+  for (int i = 0; i < max_producers; i += (i < 12 ? 2 : 8)) {
     data[i].num_producer_threads = i + 1;
     data[i].num_consumer_threads = i + 1;
     data[i].num_produces = N;
@@ -0,0 +1,331 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <iostream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+
+#include "common/object-pool.h"
+#include "exec/hash-table.inline.h"
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
+#include "gen-cpp/Results_types.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/raw-value.h"
+#include "runtime/row-batch.h"
+#include "runtime/string-value.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/tuple-row-compare.h"
+
+using namespace impala;
+using namespace std;
+
+// Benchmark for the row-processing cores of the exec nodes, exercised end to end over
+// synthetic row streams with controlled key distributions. The microbenchmarks in this
+// directory cover individual primitives (hashing, rle, atoi, ...) but none of them
+// catches a regression in how an operator processes a stream of rows; this harness is
+// meant to be run before and after any operator change so the change lands with
+// before/after numbers.
+//
+// Operators covered:
+//  - HashJoin probe: probe a prebuilt hash table with NUM_ROWS rows.
+//  - Aggregation build: group NUM_ROWS input rows into a hash table built from scratch.
+//  - Sort: order NUM_ROWS single-tuple rows with a TupleRowComparator.
+//  - Exchange serialize: serialize a RowBatch of int/bigint/string rows to thrift, the
+//    sender half of the exchange path.
+//
+// Each suite runs the same operator over several input distributions (the first is the
+// suite's baseline): 'unique' (every key distinct), 'lowcard' (1K distinct keys) and
+// 'skewed' (90% of the rows fall in 8 hot keys). Every benchmark iteration processes
+// NUM_ROWS rows, so rows/sec = Rate (iters/ms) * NUM_ROWS * 1000. To track a change,
+// save the output at a baseline commit and diff the rates per suite after the change.
+
+static const int NUM_ROWS = 64 * 1024;
+
+// Number of distinct keys in the 'lowcard' distribution.
+static const int LOW_CARDINALITY_KEYS = 1024;
+
+enum Distribution {
+  UNIQUE,
+  LOW_CARDINALITY,
+  SKEWED,
+};
+
+static int32_t GenerateKey(Distribution distribution, int idx) {
+  switch (distribution) {
+    case UNIQUE:
+      return idx;
+    case LOW_CARDINALITY:
+      return rand() % LOW_CARDINALITY_KEYS;
+    case SKEWED:
+      // 90% of the rows fall into 8 hot keys, the rest are spread uniformly.
+      if (rand() % 10 != 0) return rand() % 8;
+      return rand() % NUM_ROWS;
+    default:
+      DCHECK(false);
+      return 0;
+  }
+}
+
+// Creates a single-tuple row containing one non-nullable int slot, matching the
+// SlotRef(TYPE_INT, 0) exprs used to evaluate it.
+static TupleRow* CreateIntRow(MemPool* pool, int32_t val) {
+  uint8_t* tuple_row_mem = pool->Allocate(sizeof(Tuple*));
+  Tuple* tuple_mem = Tuple::Create(sizeof(int32_t), pool);
+  *reinterpret_cast<int32_t*>(tuple_mem) = val;
+  TupleRow* row = reinterpret_cast<TupleRow*>(tuple_row_mem);
+  row->SetTuple(0, tuple_mem);
+  return row;
+}
+
+static void CreateRows(MemPool* pool, Distribution distribution,
+    vector<TupleRow*>* rows) {
+  rows->resize(NUM_ROWS);
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    (*rows)[i] = CreateIntRow(pool, GenerateKey(distribution, i));
+  }
+  // The unique distribution would otherwise arrive in sorted order.
+  if (distribution == UNIQUE) random_shuffle(rows->begin(), rows->end());
+}
+
+struct JoinProbeData {
+  HashTable* table;
+  HashTableCtx* ctx;
+  vector<TupleRow*>* probe_rows;
+  // Accumulated so the probe loop cannot be optimized away.
+  int64_t num_matches;
+};
+
+void TestJoinProbe(int batch_size, void* d) {
+  JoinProbeData* data = reinterpret_cast<JoinProbeData*>(d);
+  const vector<TupleRow*>& rows = *data->probe_rows;
+  for (int i = 0; i < batch_size; ++i) {
+    uint32_t hash = 0;
+    for (int j = 0; j < rows.size(); ++j) {
+      if (!data->ctx->EvalAndHashProbe(rows[j], &hash)) continue;
+      HashTable::Iterator iter = data->table->Find(data->ctx, hash);
+      while (iter != data->table->End()) {
+        ++data->num_matches;
+        iter.Next<true>(data->ctx);
+      }
+    }
+  }
+}
+
+struct AggBuildData {
+  // Pool the hash table allocates from; cleared before each build.
+  MemPool* table_pool;
+  HashTableCtx* ctx;
+  vector<TupleRow*>* rows;
+  int64_t num_groups;
+};
+
+void TestAggBuild(int batch_size, void* d) {
+  AggBuildData* data = reinterpret_cast<AggBuildData*>(d);
+  const vector<TupleRow*>& rows = *data->rows;
+  for (int i = 0; i < batch_size; ++i) {
+    data->table_pool->Clear();
+    HashTable table(data->table_pool);
+    data->num_groups = 0;
+    uint32_t hash = 0;
+    for (int j = 0; j < rows.size(); ++j) {
+      if (!data->ctx->EvalAndHashProbe(rows[j], &hash)) continue;
+      HashTable::Iterator iter = table.Find(data->ctx, hash);
+      if (iter == table.End()) {
+        // New group: the aggregation node would construct the intermediate tuple
+        // here; we reuse the input tuple since the layouts match.
+        if (!data->ctx->EvalAndHashBuild(rows[j], &hash)) continue;
+        table.Insert(data->ctx, rows[j]->GetTuple(0), hash);
+        ++data->num_groups;
+      }
+    }
+  }
+}
+
+struct SortData {
+  vector<TupleRow*>* rows;
+  // Scratch copy sorted on each iteration so every iteration sees the same input.
+  vector<TupleRow*>* scratch;
+  TupleRowComparator* less_than;
+};
+
+void TestSort(int batch_size, void* d) {
+  SortData* data = reinterpret_cast<SortData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    *data->scratch = *data->rows;
+    sort(data->scratch->begin(), data->scratch->end(), *data->less_than);
+  }
+}
+
+struct SerializeData {
+  RowBatch* batch;
+};
+
+void TestSerialize(int batch_size, void* d) {
+  SerializeData* data = reinterpret_cast<SerializeData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    TRowBatch row_batch;
+    data->batch->Serialize(&row_batch);
+  }
+}
+
+// Sets up a hash table over NUM_ROWS build rows drawn from 'distribution' and the
+// probe data to look up the same key stream against it.
+static void SetupJoinProbe(ObjectPool* pool, MemPool* mem_pool,
+    const vector<ExprContext*>& build_expr_ctxs,
+    const vector<ExprContext*>& probe_expr_ctxs, Distribution distribution,
+    JoinProbeData* data) {
+  data->ctx = pool->Add(
+      new HashTableCtx(build_expr_ctxs, probe_expr_ctxs, false, false, 1, 0, 1));
+  data->table = pool->Add(new HashTable(mem_pool));
+  data->probe_rows = pool->Add(new vector<TupleRow*>());
+  CreateRows(mem_pool, distribution, data->probe_rows);
+  uint32_t hash = 0;
+  for (int i = 0; i < data->probe_rows->size(); ++i) {
+    TupleRow* row = CreateIntRow(mem_pool, GenerateKey(distribution, i));
+    if (!data->ctx->EvalAndHashBuild(row, &hash)) continue;
+    data->table->Insert(data->ctx, row->GetTuple(0), hash);
+  }
+  data->num_matches = 0;
+}
+
+// Builds a RowBatch of int/bigint/string rows for the serialization benchmark.
+static void SetupSerialize(ObjectPool* pool, MemTracker* tracker,
+    SerializeData* data) {
+  DescriptorTblBuilder builder(pool);
+  builder.DeclareTuple() << TYPE_INT << TYPE_BIGINT << TYPE_STRING;
+  DescriptorTbl* desc_tbl = builder.Build();
+
+  vector<TTupleId> tuple_ids(1, static_cast<TTupleId>(0));
+  vector<bool> nullable_tuples(1, false);
+  RowDescriptor* row_desc =
+      pool->Add(new RowDescriptor(*desc_tbl, tuple_ids, nullable_tuples));
+  const TupleDescriptor* tuple_desc = desc_tbl->GetTupleDescriptor(0);
+
+  data->batch = pool->Add(new RowBatch(*row_desc, NUM_ROWS, tracker));
+  MemPool* tuple_pool = data->batch->tuple_data_pool();
+  const vector<SlotDescriptor*>& slots = tuple_desc->slots();
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    Tuple* tuple = Tuple::Create(tuple_desc->byte_size(), tuple_pool);
+    RawValue::Write(&i, tuple, slots[0], NULL);
+    int64_t bigint_val = i * 10000000L;
+    RawValue::Write(&bigint_val, tuple, slots[1], NULL);
+    char buffer[32];
+    int len = snprintf(buffer, sizeof(buffer), "row-%d", GenerateKey(SKEWED, i));
+    StringValue string_val(buffer, len);
+    RawValue::Write(&string_val, tuple, slots[2], tuple_pool);
+
+    int idx = data->batch->AddRow();
+    data->batch->GetRow(idx)->SetTuple(0, tuple);
+    data->batch->CommitLastRow();
+  }
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  cout << endl << Benchmark::GetMachineInfo() << endl;
+  cout << "Each iteration processes " << NUM_ROWS << " rows: "
+       << "rows/sec = rate * " << NUM_ROWS << " * 1000" << endl << endl;
+
+  ObjectPool pool;
+  MemTracker tracker;
+  MemPool mem_pool(&tracker);
+
+  // Build and probe sides evaluate the int key at offset 0 of the only tuple.
+  RowDescriptor empty_row_desc;
+  vector<ExprContext*> build_expr_ctxs;
+  build_expr_ctxs.push_back(pool.Add(new ExprContext(
+      pool.Add(new SlotRef(TYPE_INT, 0)))));
+  Status status = Expr::Prepare(build_expr_ctxs, NULL, empty_row_desc, &tracker);
+  DCHECK(status.ok());
+  status = Expr::Open(build_expr_ctxs, NULL);
+  DCHECK(status.ok());
+
+  vector<ExprContext*> probe_expr_ctxs;
+  probe_expr_ctxs.push_back(pool.Add(new ExprContext(
+      pool.Add(new SlotRef(TYPE_INT, 0)))));
+  status = Expr::Prepare(probe_expr_ctxs, NULL, empty_row_desc, &tracker);
+  DCHECK(status.ok());
+  status = Expr::Open(probe_expr_ctxs, NULL);
+  DCHECK(status.ok());
+
+  JoinProbeData join_unique, join_lowcard, join_skewed;
+  SetupJoinProbe(&pool, &mem_pool, build_expr_ctxs, probe_expr_ctxs, UNIQUE,
+      &join_unique);
+  SetupJoinProbe(&pool, &mem_pool, build_expr_ctxs, probe_expr_ctxs, LOW_CARDINALITY,
+      &join_lowcard);
+  SetupJoinProbe(&pool, &mem_pool, build_expr_ctxs, probe_expr_ctxs, SKEWED,
+      &join_skewed);
+
+  Benchmark join_suite("HashJoin Probe");
+  join_suite.AddBenchmark("unique", TestJoinProbe, &join_unique);
+  join_suite.AddBenchmark("lowcard", TestJoinProbe, &join_lowcard);
+  join_suite.AddBenchmark("skewed", TestJoinProbe, &join_skewed);
+  cout << join_suite.Measure() << endl;
+
+  MemPool agg_table_pool(&tracker);
+  HashTableCtx agg_ctx(build_expr_ctxs, probe_expr_ctxs, false, false, 1, 0, 1);
+  AggBuildData agg_unique, agg_lowcard, agg_skewed;
+  agg_unique.table_pool = agg_lowcard.table_pool = agg_skewed.table_pool =
+      &agg_table_pool;
+  agg_unique.ctx = agg_lowcard.ctx = agg_skewed.ctx = &agg_ctx;
+  agg_unique.rows = pool.Add(new vector<TupleRow*>());
+  agg_lowcard.rows = pool.Add(new vector<TupleRow*>());
+  agg_skewed.rows = pool.Add(new vector<TupleRow*>());
+  CreateRows(&mem_pool, UNIQUE, agg_unique.rows);
+  CreateRows(&mem_pool, LOW_CARDINALITY, agg_lowcard.rows);
+  CreateRows(&mem_pool, SKEWED, agg_skewed.rows);
+
+  Benchmark agg_suite("Aggregation Build");
+  agg_suite.AddBenchmark("unique", TestAggBuild, &agg_unique);
+  agg_suite.AddBenchmark("lowcard", TestAggBuild, &agg_lowcard);
+  agg_suite.AddBenchmark("skewed", TestAggBuild, &agg_skewed);
+  cout << agg_suite.Measure() << endl;
+
+  TupleRowComparator less_than(build_expr_ctxs, probe_expr_ctxs, true, false);
+  vector<TupleRow*> sort_scratch;
+  SortData sort_unique, sort_lowcard, sort_skewed;
+  sort_unique.less_than = sort_lowcard.less_than = sort_skewed.less_than = &less_than;
+  sort_unique.scratch = sort_lowcard.scratch = sort_skewed.scratch = &sort_scratch;
+  sort_unique.rows = agg_unique.rows;
+  sort_lowcard.rows = agg_lowcard.rows;
+  sort_skewed.rows = agg_skewed.rows;
+
+  Benchmark sort_suite("Sort");
+  sort_suite.AddBenchmark("unique", TestSort, &sort_unique);
+  sort_suite.AddBenchmark("lowcard", TestSort, &sort_lowcard);
+  sort_suite.AddBenchmark("skewed", TestSort, &sort_skewed);
+  cout << sort_suite.Measure() << endl;
+
+  SerializeData serialize_data;
+  SetupSerialize(&pool, &tracker, &serialize_data);
+  Benchmark exchange_suite("Exchange Serialize");
+  exchange_suite.AddBenchmark("int/bigint/string", TestSerialize, &serialize_data);
+  cout << exchange_suite.Measure() << endl;
+
+  Expr::Close(build_expr_ctxs, NULL);
+  Expr::Close(probe_expr_ctxs, NULL);
+  mem_pool.FreeAll();
+  agg_table_pool.FreeAll();
+  return 0;
+}
@@ -167,6 +167,16 @@ void TestBitWriterDecode(int batch_size, void* d) {
   }
 }
 
+void TestBitWriterDecodeBatch(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  int64_t values[4096];
+  for (int i = 0; i < batch_size; ++i) {
+    BitReader reader(data->buffer, BUFFER_LEN);
+    int num_read = reader.GetValues(data->num_bits, data->num_values, values);
+    CHECK_EQ(num_read, data->num_values);
+  }
+}
+
 void TestBitWriter8ByteDecode(int batch_size, void* d) {
   TestData* data = reinterpret_cast<TestData*>(d);
   data->result = true;
@@ -233,6 +243,10 @@ int main(int argc, char** argv) {
     name.str("");
     name << "\"BitWriter" << suffix.str() << "\"";
     decode_suite.AddBenchmark(name.str(), TestBitWriterDecode, &data[i], baseline);
+
+    name.str("");
+    name << "\"BitWriter batch" << suffix.str() << "\"";
+    decode_suite.AddBenchmark(name.str(), TestBitWriterDecodeBatch, &data[i], baseline);
   }
   cout << decode_suite.Measure() << endl;
 
@@ -0,0 +1,346 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
+#include "exec/delimited-text-parser.h"
+#include "exec/parquet-common.h"
+#include "exec/read-write-util.h"
+#include "exec/write-stream.inline.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/string-value.h"
+#include "util/benchmark.h"
+#include "util/codec.h"
+#include "util/cpu-info.h"
+#include "util/dict-encoding.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+// Benchmark for the per-format decode cores of the scan path, driven over synthetic
+// in-memory payloads so format scan regressions are visible without loading a cluster.
+// The full scanner classes need an HdfsScanNode, the io mgr and a ScannerContext, so
+// this harness benchmarks the layer below, which is where the per-byte work happens:
+//
+//  - Text parse: DelimitedTextParser::ParseFieldLocations over generated delimited
+//    rows, for a narrow and a wide column layout and with escapes enabled.
+//  - Avro decode: zigzag varint and string decoding of rows generated with the same
+//    encoding the avro writer produces.
+//  - Parquet decode: ParquetPlainEncoder over int32 and string columns, and
+//    DictDecoder over a low-cardinality dictionary-encoded column.
+//  - Decompression: the codec layer shared by all compressed formats, over
+//    snappy-blocked and gzip payloads of the generated text.
+//
+// Every iteration decodes NUM_ROWS rows; the payload byte size is printed per suite so
+// MB/s = rate * payload_bytes / 1000 and rows/sec = rate * NUM_ROWS * 1000. To track a
+// change, save the output at a baseline commit and diff the rates after the change.
+
+static const int NUM_ROWS = 4096;
+
+// Number of distinct values in dictionary-encoded and string columns.
+static const int NUM_DISTINCT_VALUES = 64;
+
+// Generates NUM_ROWS rows of 'num_cols' comma separated int columns. If
+// 'add_escapes', a backslash-escaped delimiter is embedded in each row.
+static string GenerateTextPayload(int num_cols, bool add_escapes) {
+  stringstream ss;
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    for (int j = 0; j < num_cols; ++j) {
+      if (j != 0) ss << ",";
+      if (add_escapes && j == 0) ss << "a\\,b";
+      ss << (i * num_cols + j) % 100000;
+    }
+    ss << "\n";
+  }
+  return ss.str();
+}
+
+struct TextParseData {
+  string payload;
+  DelimitedTextParser* parser;
+  int num_cols;
+  vector<FieldLocation> field_locations;
+  vector<char*> row_end_locations;
+};
+
+void TestTextParse(int batch_size, void* d) {
+  TextParseData* data = reinterpret_cast<TextParseData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    data->parser->ParserReset();
+    char* byte_buffer_ptr = const_cast<char*>(data->payload.data());
+    char* next_column_start;
+    int num_tuples = 0;
+    int num_fields = 0;
+    Status status = data->parser->ParseFieldLocations(NUM_ROWS, data->payload.size(),
+        &byte_buffer_ptr, &data->row_end_locations[0], &data->field_locations[0],
+        &num_tuples, &num_fields, &next_column_start);
+    DCHECK(status.ok());
+    DCHECK_EQ(num_tuples, NUM_ROWS);
+  }
+}
+
+static void SetupTextParse(int num_cols, bool add_escapes, TextParseData* data) {
+  data->payload = GenerateTextPayload(num_cols, add_escapes);
+  data->num_cols = num_cols;
+  bool* is_materialized_col = new bool[num_cols];
+  for (int i = 0; i < num_cols; ++i) is_materialized_col[i] = true;
+  data->parser = new DelimitedTextParser(num_cols, 0, is_materialized_col, '\n', ',',
+      '^', add_escapes ? '\\' : '\0');
+  data->field_locations.resize(NUM_ROWS * num_cols);
+  data->row_end_locations.resize(NUM_ROWS);
+}
+
+struct AvroDecodeData {
+  string payload;
+  // Number of trailing string columns in each row, after an int and a bigint.
+  int num_string_cols;
+  // Accumulated so the decode loop cannot be optimized away.
+  int64_t sink;
+};
+
+void TestAvroDecode(int batch_size, void* d) {
+  AvroDecodeData* data = reinterpret_cast<AvroDecodeData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    uint8_t* buf =
+        reinterpret_cast<uint8_t*>(const_cast<char*>(data->payload.data()));
+    for (int row = 0; row < NUM_ROWS; ++row) {
+      data->sink += ReadWriteUtil::ReadZInt(&buf);
+      data->sink += ReadWriteUtil::ReadZLong(&buf);
+      for (int col = 0; col < data->num_string_cols; ++col) {
+        int64_t len = ReadWriteUtil::ReadZLong(&buf);
+        data->sink += len;
+        buf += len;
+      }
+    }
+  }
+}
+
+static void SetupAvroDecode(int num_string_cols, AvroDecodeData* data) {
+  WriteStream out;
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    out.WriteZInt(i % 100000);
+    out.WriteZLong(i * 10000000L);
+    for (int col = 0; col < num_string_cols; ++col) {
+      char buffer[32];
+      int len = snprintf(buffer, sizeof(buffer), "value-%d", i % NUM_DISTINCT_VALUES);
+      out.WriteZLong(len);
+      out.WriteBytes(len, buffer);
+    }
+  }
+  data->payload = out.String();
+  data->num_string_cols = num_string_cols;
+  data->sink = 0;
+}
+
+template<typename T>
+struct PlainDecodeData {
+  vector<uint8_t> buffer;
+  int64_t sink;
+};
+
+void TestParquetPlainInt(int batch_size, void* d) {
+  PlainDecodeData<int32_t>* data = reinterpret_cast<PlainDecodeData<int32_t>*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    uint8_t* buf = &data->buffer[0];
+    for (int row = 0; row < NUM_ROWS; ++row) {
+      int32_t val;
+      buf += ParquetPlainEncoder::Decode(buf, sizeof(int32_t), &val);
+      data->sink += val;
+    }
+  }
+}
+
+void TestParquetPlainString(int batch_size, void* d) {
+  PlainDecodeData<StringValue>* data =
+      reinterpret_cast<PlainDecodeData<StringValue>*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    uint8_t* buf = &data->buffer[0];
+    for (int row = 0; row < NUM_ROWS; ++row) {
+      StringValue val;
+      buf += ParquetPlainEncoder::Decode(buf, 0, &val);
+      data->sink += val.len;
+    }
+  }
+}
+
+struct DictDecodeData {
+  vector<uint8_t> dict_buffer;
+  vector<uint8_t> data_buffer;
+  int data_len;
+  DictDecoder<int32_t>* decoder;
+  int64_t sink;
+};
+
+void TestParquetDictInt(int batch_size, void* d) {
+  DictDecodeData* data = reinterpret_cast<DictDecodeData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    data->decoder->SetData(&data->data_buffer[0], data->data_len);
+    for (int row = 0; row < NUM_ROWS; ++row) {
+      int32_t val;
+      data->decoder->GetValue(&val);
+      data->sink += val;
+    }
+  }
+}
+
+struct DecompressData {
+  string compressed;
+  boost::scoped_ptr<Codec> decompressor;
+};
+
+void TestDecompress(int batch_size, void* d) {
+  DecompressData* data = reinterpret_cast<DecompressData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    int64_t output_len = 0;
+    uint8_t* output = NULL;
+    Status status = data->decompressor->ProcessBlock(false, data->compressed.size(),
+        reinterpret_cast<uint8_t*>(const_cast<char*>(data->compressed.data())),
+        &output_len, &output);
+    DCHECK(status.ok());
+  }
+}
+
+// Compresses 'payload' with 'format' and sets up a reusing decompressor for it.
+static void SetupDecompress(MemPool* pool, THdfsCompression::type format,
+    const string& payload, DecompressData* data) {
+  scoped_ptr<Codec> compressor;
+  Status status = Codec::CreateCompressor(pool, true, format, &compressor);
+  DCHECK(status.ok());
+  int64_t compressed_len = 0;
+  uint8_t* compressed = NULL;
+  status = compressor->ProcessBlock(false, payload.size(),
+      reinterpret_cast<uint8_t*>(const_cast<char*>(payload.data())),
+      &compressed_len, &compressed);
+  DCHECK(status.ok());
+  data->compressed = string(reinterpret_cast<char*>(compressed), compressed_len);
+  compressor->Close();
+
+  status = Codec::CreateDecompressor(pool, true, format, &data->decompressor);
+  DCHECK(status.ok());
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  cout << endl << Benchmark::GetMachineInfo() << endl;
+  cout << "Each iteration decodes " << NUM_ROWS << " rows: "
+       << "rows/sec = rate * " << NUM_ROWS << " * 1000" << endl << endl;
+
+  MemTracker tracker;
+  MemPool pool(&tracker);
+
+  TextParseData text_narrow, text_wide, text_escaped;
+  SetupTextParse(4, false, &text_narrow);
+  SetupTextParse(20, false, &text_wide);
+  SetupTextParse(4, true, &text_escaped);
+  cout << "Text payload bytes: narrow=" << text_narrow.payload.size()
+       << " wide=" << text_wide.payload.size()
+       << " escaped=" << text_escaped.payload.size() << endl;
+
+  Benchmark text_suite("Text Parse");
+  text_suite.AddBenchmark("narrow-4col", TestTextParse, &text_narrow);
+  text_suite.AddBenchmark("wide-20col", TestTextParse, &text_wide);
+  text_suite.AddBenchmark("escaped-4col", TestTextParse, &text_escaped);
+  cout << text_suite.Measure() << endl;
+
+  AvroDecodeData avro_numeric, avro_strings;
+  SetupAvroDecode(0, &avro_numeric);
+  SetupAvroDecode(2, &avro_strings);
+  cout << "Avro payload bytes: numeric=" << avro_numeric.payload.size()
+       << " strings=" << avro_strings.payload.size() << endl;
+
+  Benchmark avro_suite("Avro Decode");
+  avro_suite.AddBenchmark("int-bigint", TestAvroDecode, &avro_numeric);
+  avro_suite.AddBenchmark("int-bigint-2strings", TestAvroDecode, &avro_strings);
+  cout << avro_suite.Measure() << endl;
+
+  PlainDecodeData<int32_t> plain_ints;
+  plain_ints.sink = 0;
+  plain_ints.buffer.resize(NUM_ROWS * sizeof(int32_t));
+  uint8_t* buf = &plain_ints.buffer[0];
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    buf += ParquetPlainEncoder::Encode(buf, sizeof(int32_t), i);
+  }
+
+  PlainDecodeData<StringValue> plain_strings;
+  plain_strings.sink = 0;
+  vector<string> vocabulary;
+  for (int i = 0; i < NUM_DISTINCT_VALUES; ++i) {
+    stringstream ss;
+    ss << "value-" << i;
+    vocabulary.push_back(ss.str());
+  }
+  int64_t string_bytes = 0;
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    StringValue sv(vocabulary[i % NUM_DISTINCT_VALUES]);
+    string_bytes += ParquetPlainEncoder::ByteSize(sv);
+  }
+  plain_strings.buffer.resize(string_bytes);
+  buf = &plain_strings.buffer[0];
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    StringValue sv(vocabulary[i % NUM_DISTINCT_VALUES]);
+    buf += ParquetPlainEncoder::Encode(buf, ParquetPlainEncoder::ByteSize(sv), sv);
+  }
+
+  DictDecodeData dict_ints;
+  dict_ints.sink = 0;
+  {
+    DictEncoder<int32_t> encoder(&pool, sizeof(int32_t));
+    for (int i = 0; i < NUM_ROWS; ++i) encoder.Put(i % NUM_DISTINCT_VALUES);
+    dict_ints.dict_buffer.resize(encoder.dict_encoded_size());
+    encoder.WriteDict(&dict_ints.dict_buffer[0]);
+    dict_ints.data_buffer.resize(encoder.EstimatedDataEncodedSize());
+    dict_ints.data_len =
+        encoder.WriteData(&dict_ints.data_buffer[0], dict_ints.data_buffer.size());
+    DCHECK_GT(dict_ints.data_len, 0);
+    encoder.ClearIndices();
+  }
+  dict_ints.decoder = new DictDecoder<int32_t>(&dict_ints.dict_buffer[0],
+      dict_ints.dict_buffer.size(), sizeof(int32_t));
+
+  cout << "Parquet payload bytes: plain-int=" << plain_ints.buffer.size()
+       << " plain-string=" << plain_strings.buffer.size()
+       << " dict-int=" << dict_ints.data_len << endl;
+
+  Benchmark parquet_suite("Parquet Decode");
+  parquet_suite.AddBenchmark("plain-int", TestParquetPlainInt, &plain_ints);
+  parquet_suite.AddBenchmark("plain-string", TestParquetPlainString, &plain_strings);
+  parquet_suite.AddBenchmark("dict-int", TestParquetDictInt, &dict_ints);
+  cout << parquet_suite.Measure() << endl;
+
+  DecompressData snappy_data, gzip_data;
+  SetupDecompress(&pool, THdfsCompression::SNAPPY_BLOCKED, text_wide.payload,
+      &snappy_data);
+  SetupDecompress(&pool, THdfsCompression::GZIP, text_wide.payload, &gzip_data);
+  cout << "Compressed payload bytes (from " << text_wide.payload.size()
+       << " bytes of text): snappy-blocked=" << snappy_data.compressed.size()
+       << " gzip=" << gzip_data.compressed.size() << endl;
+
+  Benchmark decompress_suite("Decompress");
+  decompress_suite.AddBenchmark("snappy-blocked", TestDecompress, &snappy_data);
+  decompress_suite.AddBenchmark("gzip", TestDecompress, &gzip_data);
+  cout << decompress_suite.Measure() << endl;
+
+  snappy_data.decompressor->Close();
+  gzip_data.decompressor->Close();
+  pool.FreeAll();
+  return 0;
+}
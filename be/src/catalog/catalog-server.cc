@@ -229,13 +229,18 @@ void CatalogServer::UpdateCatalogTopicCallback(
     LOG_EVERY_N(INFO, 300) << "Catalog Version: " << catalog_objects_max_version_
                            << " Last Catalog Version: " << last_sent_catalog_version_;
 
-    BOOST_FOREACH(const TTopicItem& catalog_object, pending_topic_updates_) {
-      if (subscriber_topic_updates->size() == 0) {
-        subscriber_topic_updates->push_back(TTopicDelta());
-        subscriber_topic_updates->back().topic_name = IMPALA_CATALOG_TOPIC;
-      }
+    if (!pending_topic_updates_.empty()) {
+      subscriber_topic_updates->push_back(TTopicDelta());
       TTopicDelta& update = subscriber_topic_updates->back();
-      update.topic_entries.push_back(catalog_object);
+      update.topic_name = IMPALA_CATALOG_TOPIC;
+      update.topic_entries.reserve(pending_topic_updates_.size());
+      BOOST_FOREACH(TTopicItem& catalog_object, pending_topic_updates_) {
+        // Swap the item into the update rather than copying it: the serialized values
+        // can be very large (entire table objects) and pending_topic_updates_ is
+        // rebuilt from scratch by the gathering thread before it is read again.
+        update.topic_entries.push_back(TTopicItem());
+        swap(update.topic_entries.back(), catalog_object);
+      }
     }
 
     // Update the new catalog version and the set of known catalog objects.
@@ -63,6 +63,7 @@ ir_functions = [
   ["EXPR_GET_STRING_VAL", "4Expr12GetStringVal"],
   ["EXPR_GET_TIMESTAMP_VAL", "4Expr15GetTimestampVal"],
   ["EXPR_GET_DECIMAL_VAL", "4Expr13GetDecimalVal"],
+  ["FN_CTX_GET_CONST_FN_ATTR", "GetConstFnAttr"],
   ["HASH_CRC", "IrCrcHash"],
   ["HASH_FNV", "IrFnvHash"],
   ["HASH_MURMUR", "IrMurmurHash"],
@@ -61,6 +61,11 @@ DEFINE_bool(print_llvm_ir_instruction_count, false,
 
 DEFINE_bool(disable_optimization_passes, false,
     "if true, disables llvm optimization passes (used for testing)");
+DEFINE_bool(tiered_codegen, false, "(Experimental) If true, codegen'd functions are "
+    "jitted and published immediately, before the llvm optimization passes run; the "
+    "passes then run and each function is recompiled, with the optimized version "
+    "picked up at the next batch boundary. Trades briefly running less optimized code "
+    "for a shorter wait until execution can leave the interpreted paths.");
 DEFINE_bool(dump_ir, false, "if true, output IR after optimization passes");
 DEFINE_string(unopt_module_dir, "",
     "if set, saves unoptimized generated IR modules to the specified directory.");
@@ -73,6 +78,24 @@ namespace impala {
 static mutex llvm_initialization_lock;
 static bool llvm_initialized = false;
 
+// Process-wide cache of bitcode file contents, keyed by path. The cross-compiled
+// impala module is parsed once per fragment (each query has its own LLVMContext so
+// the parsed module cannot be shared), but there is no reason to read the same
+// multi-MB file from disk every time. Only used for files that never change during
+// the process lifetime (i.e. not for UDF libraries, which can be dropped and
+// re-created with new contents).
+static mutex bitcode_file_cache_lock;
+static map<string, string> bitcode_file_cache;
+
+// Process-wide cache of the mangled names resolved for each IRFunction enum value,
+// keyed by module path. The substring scan in LoadImpalaIR() that maps the enum to
+// the module's functions walks every function in the multi-thousand function module
+// for every mapping entry, and its result is the same for every fragment that loads
+// the same file. After the first load, fragments resolve the enum with exact name
+// lookups instead.
+static mutex ir_fn_names_cache_lock;
+static map<string, vector<string> > ir_fn_names_cache;
+
 void LlvmCodeGen::InitializeLlvm(bool load_backend) {
   mutex::scoped_lock initialization_lock(llvm_initialization_lock);
   if (llvm_initialized) return;
@@ -98,6 +121,8 @@ LlvmCodeGen::LlvmCodeGen(ObjectPool* pool, const string& id) :
   id_(id),
   profile_(pool, "CodeGen"),
   optimizations_enabled_(false),
+  fn_ptrs_required_before_exec_(false),
+  tiered_compilation_(false),
   is_corrupt_(false),
   is_compiled_(false),
   context_(new llvm::LLVMContext()),
@@ -118,28 +143,48 @@ LlvmCodeGen::LlvmCodeGen(ObjectPool* pool, const string& id) :
 }
 
 Status LlvmCodeGen::LoadFromFile(ObjectPool* pool,
-    const string& file, const string& id, scoped_ptr<LlvmCodeGen>* codegen) {
+    const string& file, const string& id, scoped_ptr<LlvmCodeGen>* codegen,
+    bool cache_file) {
   codegen->reset(new LlvmCodeGen(pool, id));
   SCOPED_TIMER((*codegen)->profile_.total_time_counter());
 
   Module* loaded_module;
-  RETURN_IF_ERROR(LoadModule(codegen->get(), file, &loaded_module));
+  RETURN_IF_ERROR(LoadModule(codegen->get(), file, &loaded_module, cache_file));
   (*codegen)->module_ = loaded_module;
 
   return (*codegen)->Init();
 }
 
 Status LlvmCodeGen::LoadModule(LlvmCodeGen* codegen, const string& file,
-                               Module** module) {
+                               Module** module, bool cache_file) {
   OwningPtr<MemoryBuffer> file_buffer;
   {
     SCOPED_TIMER(codegen->load_module_timer_);
 
-    llvm::error_code err = MemoryBuffer::getFile(file, file_buffer);
-    if (err.value() != 0) {
-      stringstream ss;
-      ss << "Could not load module " << file << ": " << err.message();
-      return Status(ss.str());
+    if (cache_file) {
+      lock_guard<mutex> l(bitcode_file_cache_lock);
+      map<string, string>::iterator it = bitcode_file_cache.find(file);
+      if (it == bitcode_file_cache.end()) {
+        OwningPtr<MemoryBuffer> tmp_buffer;
+        llvm::error_code err = MemoryBuffer::getFile(file, tmp_buffer);
+        if (err.value() != 0) {
+          stringstream ss;
+          ss << "Could not load module " << file << ": " << err.message();
+          return Status(ss.str());
+        }
+        it = bitcode_file_cache.insert(
+            make_pair(file, tmp_buffer->getBuffer().str())).first;
+      }
+      // ParseBitcodeFile() does not take ownership of the buffer and copies what it
+      // needs into the module, so a read-only view of the cached contents suffices.
+      file_buffer.reset(MemoryBuffer::getMemBuffer(it->second, file, false));
+    } else {
+      llvm::error_code err = MemoryBuffer::getFile(file, file_buffer);
+      if (err.value() != 0) {
+        stringstream ss;
+        ss << "Could not load module " << file << ": " << err.message();
+        return Status(ss.str());
+      }
     }
   }
 
@@ -156,11 +201,15 @@ Status LlvmCodeGen::LoadModule(LlvmCodeGen* codegen, const string& file,
   return Status::OK;
 }
 
-// TODO: Create separate counters/timers (file size, load time) for each module linked
+// TODO: Create a separate file size counter for each module linked
 Status LlvmCodeGen::LinkModule(const string& file) {
   if (linked_modules_.find(file) != linked_modules_.end()) return Status::OK;
 
   SCOPED_TIMER(profile_.total_time_counter());
+  // Track the load and link time of each library separately so a slow or oversized
+  // UDF library is attributable in the profile (LoadTime aggregates everything this
+  // fragment loads, including the main module).
+  SCOPED_TIMER(ADD_TIMER(&profile_, "ModuleLinkTime: " + file));
   Module* new_module;
   RETURN_IF_ERROR(LoadModule(this, file, &new_module));
   string error_msg;
@@ -186,7 +235,9 @@ Status LlvmCodeGen::LoadImpalaIR(
   } else {
     PathBuilder::GetFullPath("llvm-ir/impala-no-sse.ll", &module_file);
   }
-  RETURN_IF_ERROR(LoadFromFile(pool, module_file, id, codegen_ret));
+  // The cross-compiled module never changes while the process runs, so its file
+  // contents are cached process-wide and only read from disk once.
+  RETURN_IF_ERROR(LoadFromFile(pool, module_file, id, codegen_ret, true));
   LlvmCodeGen* codegen = codegen_ret->get();
 
   // Parse module for cross compiled functions and types
@@ -208,6 +259,28 @@ Status LlvmCodeGen::LoadImpalaIR(
     return Status("Could not create llvm struct type for StringVal");
   }
 
+  // Map the IRFunction enum to functions in the module. The mangled names resolved
+  // by the first load are cached process-wide (the file contents never change while
+  // the process runs), so subsequent loads can use exact name lookups instead of the
+  // substring scan over every function in the module.
+  {
+    lock_guard<mutex> l(ir_fn_names_cache_lock);
+    map<string, vector<string> >::iterator it = ir_fn_names_cache.find(module_file);
+    if (it != ir_fn_names_cache.end()) {
+      const vector<string>& fn_names = it->second;
+      DCHECK_EQ(fn_names.size(), IRFunction::FN_END);
+      for (int i = IRFunction::FN_START; i < IRFunction::FN_END; ++i) {
+        Function* fn = codegen->module_->getFunction(fn_names[i]);
+        if (fn == NULL) {
+          return Status("Unable to find precompiled function: " + fn_names[i]);
+        }
+        fn->addFnAttr(Attribute::AlwaysInline);
+        codegen->loaded_functions_[i] = fn;
+      }
+      return Status::OK;
+    }
+  }
+
   // Parse functions from module
   vector<Function*> functions;
   codegen->GetFunctions(&functions);
@@ -244,6 +317,17 @@ Status LlvmCodeGen::LoadImpalaIR(
     return Status(ss.str());
   }
 
+  // Publish the resolved names for subsequent loads. Another fragment may have
+  // raced here; the result is identical so first writer wins.
+  lock_guard<mutex> l(ir_fn_names_cache_lock);
+  vector<string>& fn_names = ir_fn_names_cache[module_file];
+  if (fn_names.empty()) {
+    fn_names.resize(IRFunction::FN_END);
+    for (int i = IRFunction::FN_START; i < IRFunction::FN_END; ++i) {
+      fn_names[i] = codegen->loaded_functions_[i]->getName().str();
+    }
+  }
+
   return Status::OK;
 }
 
@@ -574,15 +658,12 @@ int LlvmCodeGen::InlineCallSites(Function* fn, bool skip_registered_fns) {
 }
 
 Function* LlvmCodeGen::OptimizeFunctionWithExprs(Function* fn) {
-  int num_inlined;
-  do {
-    // This assumes that all redundant exprs have been registered.
-    num_inlined = InlineCallSites(fn, false);
-  } while (num_inlined > 0);
-
-  // TODO(skye): fix subexpression elimination
-  // SubExprElimination subexpr_elim(this);
-  // subexpr_elim.Run(fn);
+  // SubExprElimination handles all the inlining: it inlines everything but calls to
+  // registered expr functions first, removes the redundant expr calls (the same expr
+  // appearing in multiple of the node's expr trees, e.g. select list and group by)
+  // and then inlines the remaining unique calls.
+  SubExprElimination subexpr_elim(this);
+  subexpr_elim.Run(fn);
   return FinalizeFunction(fn);
 }
 
@@ -617,15 +698,52 @@ Status LlvmCodeGen::FinalizeModule() {
 
   // Don't waste time optimizing module if there are no functions to JIT. This can happen
   // if the codegen object is created but no functions are successfully codegen'd.
-  if (optimizations_enabled_ && !FLAGS_disable_optimization_passes &&
-      !fns_to_jit_compile_.empty()) {
-    OptimizeModule();
+  bool run_optimizations = optimizations_enabled_ &&
+      !FLAGS_disable_optimization_passes && !fns_to_jit_compile_.empty();
+
+  // Tiered compilation: emit machine code for the registered functions right away and
+  // publish the pointers so execution can leave the interpreted paths, then run the
+  // optimization passes and recompile below. Not used when user libraries were linked
+  // in, because tiered mode must keep every function's IR alive across the
+  // optimization passes (see OptimizeModule()) and a library's internal helper
+  // functions can't be exempted from DCE by name. Also pointless for fragments that
+  // must have all pointers filled in before execution starts.
+  tiered_compilation_ = FLAGS_tiered_codegen && run_optimizations &&
+      linked_modules_.empty() && !fn_ptrs_required_before_exec_;
+  if (tiered_compilation_) {
+    // The published machine code must be self-contained: a lazy compilation stub
+    // would compile its function on first call from IR that the optimization passes
+    // are rewriting concurrently.
+    execution_engine_->DisableLazyCompilation(true);
+    SCOPED_TIMER(compile_timer_);
+    for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
+      const FnToJitCompile& entry = fns_to_jit_compile_[i];
+      if (entry.compile_timer != NULL) {
+        SCOPED_TIMER(entry.compile_timer);
+        *entry.result_fn_ptr = JitFunction(entry.fn);
+      } else {
+        *entry.result_fn_ptr = JitFunction(entry.fn);
+      }
+    }
   }
 
+  if (run_optimizations) OptimizeModule();
+
   SCOPED_TIMER(compile_timer_);
-  // JIT compile all codegen'd functions
+  // JIT compile all codegen'd functions. Under tiered compilation this recompiles
+  // them from the now optimized IR; besides publishing the new pointer, the entry of
+  // the originally emitted code is patched to branch to the new version, so callers
+  // that already loaded the old pointer also switch over on their next call.
   for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
-    *fns_to_jit_compile_[i].second = JitFunction(fns_to_jit_compile_[i].first);
+    const FnToJitCompile& entry = fns_to_jit_compile_[i];
+    if (entry.compile_timer != NULL) {
+      SCOPED_TIMER(entry.compile_timer);
+      *entry.result_fn_ptr =
+          tiered_compilation_ ? RecompileFunction(entry.fn) : JitFunction(entry.fn);
+    } else {
+      *entry.result_fn_ptr =
+          tiered_compilation_ ? RecompileFunction(entry.fn) : JitFunction(entry.fn);
+    }
   }
 
   if (FLAGS_opt_module_dir.size() != 0) {
@@ -669,15 +787,24 @@ void LlvmCodeGen::OptimizeModule() {
   // global dead code elimination pass. This causes all functions not registered to be
   // JIT'd to be marked as internal, and any internal functions that are not used are
   // deleted by DCE pass. This greatly decreases compile time by removing unused code.
-  vector<const char*> exported_fn_names;
-  for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
-    exported_fn_names.push_back(fns_to_jit_compile_[i].first->getName().data());
+  //
+  // Skipped under tiered compilation: machine code emitted from the unoptimized
+  // module is already running, and the JIT frees a function's machine code when its
+  // IR is deleted. With nothing marked internal, the passes below only rewrite
+  // function bodies and never delete a function, at the cost of optimizing functions
+  // that would otherwise have been DCE'd.
+  scoped_ptr<PassManager> module_pass_manager;
+  if (!tiered_compilation_) {
+    vector<const char*> exported_fn_names;
+    for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
+      exported_fn_names.push_back(fns_to_jit_compile_[i].fn->getName().data());
+    }
+    module_pass_manager.reset(new PassManager());
+    module_pass_manager->add(new DataLayout(data_layout_str));
+    module_pass_manager->add(createInternalizePass(exported_fn_names));
+    module_pass_manager->add(createGlobalDCEPass());
+    module_pass_manager->run(*module_);
   }
-  scoped_ptr<PassManager> module_pass_manager(new PassManager());
-  module_pass_manager->add(new DataLayout(data_layout_str));
-  module_pass_manager->add(createInternalizePass(exported_fn_names));
-  module_pass_manager->add(createGlobalDCEPass());
-  module_pass_manager->run(*module_);
 
   // Create and run function pass manager
   scoped_ptr<FunctionPassManager> fn_pass_manager(new FunctionPassManager(module_));
@@ -697,14 +824,15 @@ void LlvmCodeGen::OptimizeModule() {
   if (FLAGS_print_llvm_ir_instruction_count) {
     for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
       InstructionCounter counter;
-      counter.visit(*fns_to_jit_compile_[i].first);
-      VLOG(1) << fns_to_jit_compile_[i].first->getName().str();
+      counter.visit(*fns_to_jit_compile_[i].fn);
+      VLOG(1) << fns_to_jit_compile_[i].fn->getName().str();
       VLOG(1) << counter.PrintCounters();
     }
   }
 }
 
-void LlvmCodeGen::AddFunctionToJit(Function* fn, void** fn_ptr) {
+void LlvmCodeGen::AddFunctionToJit(Function* fn, void** fn_ptr,
+    RuntimeProfile::Counter* compile_timer) {
   Type* decimal_val_type = GetType(CodegenAnyVal::LLVM_DECIMALVAL_NAME);
   if (fn->getReturnType() == decimal_val_type) {
     // Per the x86 calling convention ABI, DecimalVals should be returned via an extra
@@ -735,7 +863,7 @@ void LlvmCodeGen::AddFunctionToJit(Function* fn, void** fn_ptr) {
     fn = FinalizeFunction(fn_wrapper);
     DCHECK(fn != NULL);
   }
-  fns_to_jit_compile_.push_back(make_pair(fn, fn_ptr));
+  fns_to_jit_compile_.push_back(FnToJitCompile(fn, fn_ptr, compile_timer));
 }
 
 void* LlvmCodeGen::JitFunction(Function* function) {
@@ -750,6 +878,22 @@ void* LlvmCodeGen::JitFunction(Function* function) {
   return jitted_function;
 }
 
+void* LlvmCodeGen::RecompileFunction(Function* function) {
+  DCHECK(tiered_compilation_);
+  if (is_corrupt_) return NULL;
+
+  // getPointerToFunction() would return the machine code cached by the first tier, so
+  // explicitly regenerate it from the (since optimized) IR. This also patches the
+  // entry of the old machine code to branch to the new version, so callers that
+  // already loaded the old pointer run optimized code from their next call on.
+  void* jitted_function = execution_engine_->recompileAndRelinkFunction(function);
+  lock_guard<mutex> l(jitted_functions_lock_);
+  if (jitted_function != NULL) {
+    jitted_functions_[function] = true;
+  }
+  return jitted_function;
+}
+
 // Wrapper around printf to make it easier to call from IR
 extern "C" void DebugTrace(const char* str) {
   printf("LLVM Trace: %s\n", str);
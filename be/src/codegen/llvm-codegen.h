@@ -95,9 +95,18 @@ class SubExprElimination;
 // AddFunctionToJit() will be pointing to the appropriate JIT'd function.
 //
 // Currently, each query will create and initialize one of these
-// objects.  This requires loading and parsing the cross compiled modules.
+// objects.  This requires loading and parsing the cross compiled modules (the file
+// contents themselves are cached process-wide, so only the parse is repeated).
 // TODO: we should be able to do this once per process and let llvm compile
 // functions from across modules.
+// TODO: a per-process cache of jitted function pointers keyed by a hash of the
+// codegen'd IR would let repeated plan shapes skip OptimizeModule() and jitting
+// entirely. Two things stand in the way: CastPtrToLlvmPtr() bakes pointers to
+// query-lifetime objects (expr contexts, descriptors) into the IR as constants, so
+// identical IR across queries implies recycled heap addresses rather than reusable
+// code; and jitted code only stays valid while its ExecutionEngine lives, which is
+// owned per fragment. Making codegen'd functions position-independent (runtime
+// state passed as arguments instead of baked-in constants) is the prerequisite.
 //
 // LLVM has a nontrivial memory management scheme and objects will take
 // ownership of others.  The document is pretty good about being explicit with this
@@ -125,8 +134,11 @@ class LlvmCodeGen {
   // Load a pre-compiled IR module from 'file'.  This creates a top level
   // codegen object.
   // codegen will contain the created object on success.
+  // If cache_file is true, the file's contents are kept in a process-wide cache and
+  // subsequent loads of the same path skip the disk read; only pass true for files
+  // that cannot change while the process runs.
   static Status LoadFromFile(ObjectPool*, const std::string& file, const std::string& id,
-      boost::scoped_ptr<LlvmCodeGen>* codegen);
+      boost::scoped_ptr<LlvmCodeGen>* codegen, bool cache_file = false);
 
   // Removes all jit compiled dynamically linked functions from the process.
   ~LlvmCodeGen();
@@ -137,6 +149,14 @@ class LlvmCodeGen {
   // Turns on/off optimization passes
   void EnableOptimizations(bool enable);
 
+  // Called by consumers that register a function with AddFunctionToJit() but have no
+  // interpreted fallback while the result pointer is still NULL (e.g. codegen'd UDF
+  // wrappers). If set, the fragment must wait for FinalizeModule() before executing
+  // instead of starting on the interpreted paths while compilation runs in the
+  // background (see PlanFragmentExecutor::OptimizeLlvmModule()).
+  void RequireFnPtrsBeforeExec() { fn_ptrs_required_before_exec_ = true; }
+  bool fn_ptrs_required_before_exec() const { return fn_ptrs_required_before_exec_; }
+
   // For debugging. Returns the IR that was generated.  If full_module, the
   // entire module is dumped, including what was loaded from precompiled IR.
   // If false, only output IR for functions which were generated.
@@ -221,6 +241,13 @@ class LlvmCodeGen {
 
   // Register a expr function with unique id.  It can be subsequently retrieved via
   // GetRegisteredExprFn with that id.
+  // Registered functions must compute their result from the row argument alone and
+  // ignore their ExprContext argument: SubExprElimination treats two calls to the same
+  // registered function with the same row as interchangeable, regardless of which expr
+  // tree (and therefore which context) they came from. SlotRefs satisfy this.
+  // TODO: give other expr subtrees a stable identity (structural hashing) so larger
+  // shared subtrees (e.g. an expensive CASE repeated across the select list and group
+  // by) can be registered and eliminated too; today only SlotRefs are registered.
   void RegisterExprFn(int64_t id, llvm::Function* function) {
     DCHECK(registered_exprs_map_.find(id) == registered_exprs_map_.end());
     registered_exprs_map_[id] = function;
@@ -312,7 +339,13 @@ class LlvmCodeGen {
   // This will also wrap functions returning DecimalVals in an ABI-compliant wrapper (see
   // the comment in the .cc file for details). This is so we don't accidentally try to
   // call non-compliant code from native code.
-  void AddFunctionToJit(llvm::Function* fn, void** fn_ptr);
+  //
+  // If compile_timer is non-NULL, the time spent jitting this function is added to it.
+  // Plan nodes pass a timer from their own profile so compile time can be attributed
+  // per node (module-wide optimization time cannot be split up and stays in
+  // OptimizationTime).
+  void AddFunctionToJit(llvm::Function* fn, void** fn_ptr,
+      RuntimeProfile::Counter* compile_timer = NULL);
 
   // Verfies the function if the verfier is enabled.  Returns false if function
   // is invalid.
@@ -412,8 +445,10 @@ class LlvmCodeGen {
   // Loads an LLVM module. 'file' should be the local path to the LLVM bitcode (.ll)
   // file. If 'file_size' is not NULL, it will be set to the size of 'file'.
   // The caller is responsible for cleaning up module.
+  // If cache_file is true, the file contents are served from a process-wide cache
+  // (see LoadFromFile()).
   static Status LoadModule(LlvmCodeGen* codegen, const std::string& file,
-                           llvm::Module** module);
+                           llvm::Module** module, bool cache_file = false);
 
   // Loads a module at 'file' and links it to the module associated with
   // this LlvmCodeGen object. The module must be on the local filesystem.
@@ -444,7 +479,16 @@ class LlvmCodeGen {
   // function is mostly useful for tests that do not call FinalizeModule() at all.
   void* JitFunction(llvm::Function* function);
 
-  // Optimizes the module. This includes pruning the module of any unused functions.
+  // Recompiles function's machine code from its IR, which has been rewritten by
+  // OptimizeModule() since JitFunction() was first called on it. The entry point of
+  // the old machine code is patched to branch to the new version, so callers that
+  // already loaded the old pointer pick up the optimized code on their next call.
+  // Only used under tiered compilation (see --tiered_codegen in the .cc file).
+  void* RecompileFunction(llvm::Function* function);
+
+  // Optimizes the module. This includes pruning the module of any unused functions,
+  // except under tiered compilation where functions already have live machine code
+  // and must not be deleted.
   void OptimizeModule();
 
   // Clears generated hash fns.  This is only used for testing.
@@ -476,6 +520,15 @@ class LlvmCodeGen {
   // whether or not optimizations are enabled
   bool optimizations_enabled_;
 
+  // True if some registered function pointer must be filled in before execution
+  // starts. See RequireFnPtrsBeforeExec().
+  bool fn_ptrs_required_before_exec_;
+
+  // True if FinalizeModule() decided to compile in two tiers: jit and publish the
+  // registered functions before optimizing, then recompile them from the optimized
+  // IR. Set from --tiered_codegen; see FinalizeModule() for the conditions.
+  bool tiered_compilation_;
+
   // If true, the module is corrupt and we cannot codegen this query.
   // TODO: we could consider just removing the offending function and attempting to
   // codegen the rest of the query.  This requires more testing though to make sure
@@ -539,8 +592,20 @@ class LlvmCodeGen {
   // twice, which causes symbol collision errors.
   std::set<std::string> linked_modules_;
 
+  // A function registered with AddFunctionToJit(): the function itself, where to
+  // publish the jitted pointer, and an optional per-node timer for the compile time.
+  struct FnToJitCompile {
+    llvm::Function* fn;
+    void** result_fn_ptr;
+    RuntimeProfile::Counter* compile_timer;
+
+    FnToJitCompile(llvm::Function* fn = NULL, void** result_fn_ptr = NULL,
+        RuntimeProfile::Counter* compile_timer = NULL)
+      : fn(fn), result_fn_ptr(result_fn_ptr), compile_timer(compile_timer) {}
+  };
+
   // The vector of functions to automatically JIT compile after FinalizeModule().
-  std::vector<std::pair<llvm::Function*, void**> > fns_to_jit_compile_;
+  std::vector<FnToJitCompile> fns_to_jit_compile_;
 
   // Debug utility that will insert a printf-like function into the generated
   // IR.  Useful for debugging the IR.  This is lazily created.
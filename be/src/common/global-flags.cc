@@ -66,3 +66,11 @@ DEFINE_string(redaction_rules_file, "", "Absolute path to sensitive data redacti
     "rules. The rules will be applied to all log messages and query text shown in the "
     "Web UI and audit records. Query results will not be affected. Refer to the "
     "documentation for the rule file format.");
+
+// Defined here because it is read during common initialization but used by the
+// aggregate functions, which are cross-compiled and cannot reference flags directly.
+DEFINE_int32(hll_precision, 10, "(Advanced) Number of index bits used by the "
+    "HyperLogLog NDV estimate; the estimate uses 2^hll_precision byte-sized buckets "
+    "per grouping. Must be between 4 and 16 and identical on all impalads, since "
+    "they exchange and merge HLL intermediates. Larger values reduce the estimation "
+    "error at the cost of more memory and network traffic per distinct estimate.");
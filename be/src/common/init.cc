@@ -19,8 +19,11 @@
 
 #include "common/logging.h"
 #include "common/status.h"
+#include "exprs/aggregate-functions.h"
 #include "exprs/expr.h"
+#include "util/codec.h"
 #include "util/cpu-info.h"
+#include "util/cpu-sampler.h"
 #include "util/debug-util.h"
 #include "util/disk-info.h"
 #include "util/logging-support.h"
@@ -45,6 +48,8 @@ DECLARE_string(redaction_rules_file);
 DECLARE_int32(logbufsecs);
 DECLARE_string(heap_profile_dir);
 DECLARE_bool(enable_process_lifetime_heap_profiling);
+DECLARE_bool(enable_query_cpu_sampler);
+DECLARE_int32(hll_precision);
 
 DEFINE_int32(max_log_files, 10, "Maximum number of log files to retain per severity "
     "level. The most recent log files are retained. If set to 0, all log files are "
@@ -145,6 +150,10 @@ void impala::InitCommonRuntime(int argc, char** argv, bool init_jvm,
     const string& error_message = SetRedactionRulesFromFile(FLAGS_redaction_rules_file);
     if (!error_message.empty()) EXIT_WITH_ERROR(error_message);
   }
+  if (FLAGS_hll_precision < 4 || FLAGS_hll_precision > 16) {
+    EXIT_WITH_ERROR("--hll_precision must be between 4 and 16.");
+  }
+  impala::AggregateFunctions::SetHllPrecision(FLAGS_hll_precision);
   impala::InitGoogleLoggingSafe(argv[0]);
   impala::InitThreading();
   impala::TimestampParser::Init();
@@ -169,6 +178,7 @@ void impala::InitCommonRuntime(int argc, char** argv, bool init_jvm,
   // Required for the FE's Catalog
   impala::LibCache::Init();
   impala::HdfsFsCache::Init();
+  EXIT_IF_ERROR(impala::Codec::InitPlugins());
 
   if (init_jvm) {
     EXIT_IF_ERROR(JniUtil::Init());
@@ -188,4 +198,8 @@ void impala::InitCommonRuntime(int argc, char** argv, bool init_jvm,
     HeapProfilerStart(FLAGS_heap_profile_dir.c_str());
   }
 #endif
+
+  if (FLAGS_enable_query_cpu_sampler) {
+    EXIT_IF_ERROR(CpuSampler::GetInstance()->Start());
+  }
 }
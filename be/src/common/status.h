@@ -94,7 +94,9 @@ class Status {
     : msg_(status.msg_ != NULL ? new ErrorMsg(*status.msg_) : NULL) { }
 
   // Status using only the error code as a parameter. This can be used for error messages
-  // that don't take format parameters.
+  // that don't take format parameters. The message string is not formatted until it is
+  // first accessed (see ErrorMsg::msg()), so callers that only check the code, e.g. the
+  // bool + Status* out-param pattern in scanner inner loops, never pay for formatting.
   Status(TErrorCode::type code);
 
   // These constructors are used if the caller wants to indicate a non-successful
@@ -88,6 +88,10 @@ Status AggregationNode::Prepare(RuntimeState* state) {
 
   tuple_pool_.reset(new MemPool(mem_tracker()));
   agg_fn_pool_.reset(new MemPool(expr_mem_tracker()));
+#ifdef ALLOC_PROFILING
+  tuple_pool_->set_allocation_counters(allocation_counters());
+  agg_fn_pool_->set_allocation_counters(allocation_counters());
+#endif
   build_timer_ = ADD_TIMER(runtime_profile(), "BuildTime");
   get_results_timer_ = ADD_TIMER(runtime_profile(), "GetResultsTime");
   hash_table_buckets_counter_ =
@@ -163,7 +167,8 @@ Status AggregationNode::Prepare(RuntimeState* state) {
       if (codegen_process_row_batch_fn_ != NULL) {
         // Update to using codegen'd process row batch.
         codegen->AddFunctionToJit(codegen_process_row_batch_fn_,
-            reinterpret_cast<void**>(&process_row_batch_fn_));
+            reinterpret_cast<void**>(&process_row_batch_fn_),
+            ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
         AddRuntimeExecOption("Codegen Enabled");
       }
     }
@@ -173,6 +178,7 @@ Status AggregationNode::Prepare(RuntimeState* state) {
 
 Status AggregationNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
 
   RETURN_IF_ERROR(Expr::Open(probe_expr_ctxs_, state));
@@ -229,6 +235,7 @@ Status AggregationNode::Open(RuntimeState* state) {
 
 Status AggregationNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
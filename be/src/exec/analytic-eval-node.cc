@@ -165,6 +165,7 @@ Status AnalyticEvalNode::Prepare(RuntimeState* state) {
 
 Status AnalyticEvalNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -317,6 +318,10 @@ inline Status AnalyticEvalNode::AddRow(int64_t stream_idx, TupleRow* row) {
   }
 
   // Buffer the entire input row to be returned later with the analytic eval results.
+  return AddRowToStream(stream_idx, row);
+}
+
+inline Status AnalyticEvalNode::AddRowToStream(int64_t stream_idx, TupleRow* row) {
   if (UNLIKELY(!input_stream_->AddRow(row))) {
     // AddRow returns false if an error occurs (available via status()) or there is
     // not enough memory (status() is OK). If there isn't enough memory, we unpin
@@ -348,15 +353,15 @@ void AnalyticEvalNode::AddResultTuple(int64_t stream_idx) {
 }
 
 inline void AnalyticEvalNode::TryAddResultTupleForPrevRow(bool next_partition,
-    int64_t stream_idx, TupleRow* row) {
+    bool order_by_changed, int64_t stream_idx, TupleRow* row) {
   // The analytic fns are finalized after the previous row if we found a new partition
   // or the window is a RANGE and the order by exprs changed. For ROWS windows we do not
   // need to compare the current row to the previous row.
   VLOG_ROW << id() << " TryAddResultTupleForPrevRow partition=" << next_partition
            << " idx=" << stream_idx;
   if (fn_scope_ == ROWS) return;
-  if (next_partition || (fn_scope_ == RANGE && window_.__isset.window_end &&
-      !PrevRowCompare(order_by_eq_expr_ctx_))) {
+  if (next_partition ||
+      (fn_scope_ == RANGE && window_.__isset.window_end && order_by_changed)) {
     AddResultTuple(stream_idx - 1);
   }
 }
@@ -567,34 +572,75 @@ Status AnalyticEvalNode::ProcessChildBatch(RuntimeState* state) {
     ++stream_idx;
   }
 
-  for (; batch_idx < curr_child_batch_->num_rows(); ++batch_idx, ++stream_idx) {
-    TupleRow* row = curr_child_batch_->GetRow(batch_idx);
-    if (partition_by_eq_expr_ctx_ != NULL || order_by_eq_expr_ctx_ != NULL) {
-      // Only set the tuples in child_tuple_cmp_row_ if there are partition exprs or
-      // order by exprs that require comparing the current and previous rows. If there
-      // aren't partition or order by exprs (i.e. empty OVER() clause), there was no sort
-      // and there could be nullable tuples (whereas the sort node does not produce
-      // them), see IMPALA-1562.
-      child_tuple_cmp_row_->SetTuple(0, prev_input_row_->GetTuple(0));
+  // Every row is compared against the previous row to determine if (a) the row
+  // starts a new partition or (b) the row does not share the same values for the
+  // ordering exprs. Evaluate the comparison exprs for the whole batch in one pass up
+  // front so the row loop below is branch-light and boundary-free runs can take the
+  // per-function fast path. Only set the tuples in child_tuple_cmp_row_ if there are
+  // partition exprs or order by exprs that require comparing the current and previous
+  // rows. If there aren't partition or order by exprs (i.e. empty OVER() clause),
+  // there was no sort and there could be nullable tuples (whereas the sort node does
+  // not produce them), see IMPALA-1562.
+  const int num_rows = curr_child_batch_->num_rows();
+  const bool needs_order_by_cmp = fn_scope_ == RANGE && window_.__isset.window_end &&
+      order_by_eq_expr_ctx_ != NULL;
+  batch_next_partition_.assign(num_rows, false);
+  batch_order_by_changed_.assign(num_rows, false);
+  if (partition_by_eq_expr_ctx_ != NULL || needs_order_by_cmp) {
+    TupleRow* prev_row = prev_input_row_;
+    for (int i = batch_idx; i < num_rows; ++i) {
+      TupleRow* row = curr_child_batch_->GetRow(i);
+      child_tuple_cmp_row_->SetTuple(0, prev_row->GetTuple(0));
       child_tuple_cmp_row_->SetTuple(1, row->GetTuple(0));
+      if (partition_by_eq_expr_ctx_ != NULL) {
+        // partition_by_eq_expr_ctx_ checks equality over the predicate exprs
+        batch_next_partition_[i] = !PrevRowCompare(partition_by_eq_expr_ctx_);
+      }
+      if (needs_order_by_cmp) {
+        batch_order_by_changed_[i] = !PrevRowCompare(order_by_eq_expr_ctx_);
+      }
+      prev_row = row;
     }
-    TryRemoveRowsBeforeWindow(stream_idx);
+  }
 
-    // Every row is compared against the previous row to determine if (a) the row
-    // starts a new partition or (b) the row does not share the same values for the
-    // ordering exprs. When either of these occurs, the evaluators_ are finalized and
-    // the result tuple is added to result_tuples_ so that it may be added to output
-    // rows in GetNextOutputBatch(). When a new partition is found (a), a new, empty
-    // result tuple is created and initialized over the evaluators_. If the row has
-    // different values for the ordering exprs (b), then a new tuple is created but
-    // copied from curr_tuple_ because the original is used for one or more previous
-    // row(s) but the incremental state still applies to the current row.
-    bool next_partition = false;
-    if (partition_by_eq_expr_ctx_ != NULL) {
-      // partition_by_eq_expr_ctx_ checks equality over the predicate exprs
-      next_partition = !PrevRowCompare(partition_by_eq_expr_ctx_);
+  for (; batch_idx < num_rows; ++batch_idx, ++stream_idx) {
+    // Fast path for analytics without a window: a run of rows with no partition
+    // boundary needs no per-row boundary or window handling, so update the
+    // evaluators over the whole run in tight per-function loops and then just
+    // append the rows to the stream.
+    if (fn_scope_ == PARTITION && !batch_next_partition_[batch_idx]) {
+      int run_end = batch_idx + 1;
+      while (run_end < num_rows && !batch_next_partition_[run_end]) ++run_end;
+      for (int i = 0; i < evaluators_.size(); ++i) {
+        AggFnEvaluator* evaluator = evaluators_[i];
+        impala_udf::FunctionContext* fn_ctx = fn_ctxs_[i];
+        for (int j = batch_idx; j < run_end; ++j) {
+          evaluator->Add(fn_ctx, curr_child_batch_->GetRow(j), curr_tuple_);
+        }
+      }
+      for (int j = batch_idx; j < run_end; ++j) {
+        RETURN_IF_ERROR(AddRowToStream(
+            stream_idx + (j - batch_idx), curr_child_batch_->GetRow(j)));
+      }
+      stream_idx += run_end - 1 - batch_idx;
+      batch_idx = run_end - 1;
+      prev_input_row_ = curr_child_batch_->GetRow(batch_idx);
+      continue;
     }
-    TryAddResultTupleForPrevRow(next_partition, stream_idx, row);
+
+    TupleRow* row = curr_child_batch_->GetRow(batch_idx);
+    TryRemoveRowsBeforeWindow(stream_idx);
+
+    // When a new partition is found, the evaluators_ are finalized and the result
+    // tuple is added to result_tuples_ so that it may be added to output rows in
+    // GetNextOutputBatch(), then a new, empty result tuple is created and initialized
+    // over the evaluators_. If the row has different values for the ordering exprs,
+    // then a new tuple is created but copied from curr_tuple_ because the original is
+    // used for one or more previous row(s) but the incremental state still applies to
+    // the current row.
+    bool next_partition = batch_next_partition_[batch_idx];
+    TryAddResultTupleForPrevRow(next_partition, batch_order_by_changed_[batch_idx],
+        stream_idx, row);
     if (next_partition) InitNextPartition(stream_idx);
 
     // The evaluators_ are updated with the current row.
@@ -692,6 +738,7 @@ inline int64_t AnalyticEvalNode::NumOutputRowsReady() const {
 
 Status AnalyticEvalNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -770,11 +817,11 @@ void AnalyticEvalNode::DebugString(int indentation_level, stringstream* out) con
   *out << ")";
 }
 
-Status AnalyticEvalNode::QueryMaintenance(RuntimeState* state) {
+Status AnalyticEvalNode::QueryMaintenanceImpl(RuntimeState* state) {
   for (int i = 0; i < evaluators_.size(); ++i) {
     ExprContext::FreeLocalAllocations(evaluators_[i]->input_expr_ctxs());
   }
-  return ExecNode::QueryMaintenance(state);
+  return ExecNode::QueryMaintenanceImpl(state);
 }
 
 }
@@ -67,7 +67,7 @@ class AnalyticEvalNode : public ExecNode {
 
  protected:
   // Frees local allocations from evaluators_
-  virtual Status QueryMaintenance(RuntimeState* state);
+  virtual Status QueryMaintenanceImpl(RuntimeState* state);
 
   virtual void DebugString(int indentation_level, std::stringstream* out) const;
 
@@ -126,12 +126,18 @@ class AnalyticEvalNode : public ExecNode {
   // Adds the row to the evaluators and the tuple stream.
   Status AddRow(int64_t stream_idx, TupleRow* row);
 
+  // Buffers the entire input row in input_stream_ to be returned later with the
+  // analytic eval results, unpinning the stream if it runs out of memory.
+  Status AddRowToStream(int64_t stream_idx, TupleRow* row);
+
   // Determines if there is a window ending at the previous row, and if so, calls
   // AddResultTuple() with the index of the previous row in input_stream_. next_partition
-  // indicates if the current row is the start of a new partition. stream_idx is the
-  // index of the current input row from input_stream_.
-  void TryAddResultTupleForPrevRow(bool next_partition, int64_t stream_idx,
-      TupleRow* row);
+  // indicates if the current row is the start of a new partition, order_by_changed if
+  // it has different values for the ordering exprs than the previous row (only
+  // meaningful for RANGE windows with an end bound). stream_idx is the index of the
+  // current input row from input_stream_.
+  void TryAddResultTupleForPrevRow(bool next_partition, bool order_by_changed,
+      int64_t stream_idx, TupleRow* row);
 
   // Determines if there is a window ending at the current row, and if so, calls
   // AddResultTuple() with the index of the current row in input_stream_. stream_idx is
@@ -207,6 +213,12 @@ class AnalyticEvalNode : public ExecNode {
   // order by exprs.
   ExprContext* order_by_eq_expr_ctx_;
 
+  // Per-row partition boundary and order-by change flags for the batch currently
+  // being processed, computed in one pass at the start of ProcessChildBatch().
+  // Scratch space reused across batches.
+  std::vector<uint8_t> batch_next_partition_;
+  std::vector<uint8_t> batch_order_by_changed_;
+
   // The scope over which analytic functions are evaluated.
   // TODO: Consider adding additional state to capture whether different kinds of window
   // bounds need to be maintained, e.g. (fn_scope_ == ROWS && window_.__isset.end_bound).
@@ -21,6 +21,7 @@
 #include "runtime/runtime-state.h"
 #include "runtime/string-search.h"
 #include "util/codec.h"
+#include "util/thread.h"
 
 using namespace boost;
 using namespace impala;
@@ -65,7 +66,8 @@ BaseSequenceScanner::BaseSequenceScanner(HdfsScanNode* node, RuntimeState* state
     header_(NULL),
     block_start_(0),
     total_block_size_(0),
-    num_syncs_(0) {
+    num_syncs_(0),
+    blocks_in_flight_(0) {
 }
 
 BaseSequenceScanner::~BaseSequenceScanner() {
@@ -80,6 +82,7 @@ Status BaseSequenceScanner::Prepare(ScannerContext* context) {
 }
 
 void BaseSequenceScanner::Close() {
+  StopDecompressionPipeline();
   VLOG_FILE << "Bytes read past scan range: " << -stream_->bytes_left();
   VLOG_FILE << "Average block size: "
             << (num_syncs_ > 1 ? total_block_size_ / (num_syncs_ - 1) : 0);
@@ -281,6 +284,102 @@ void BaseSequenceScanner::CloseFileRanges(const char* filename) {
   }
 }
 
+Status BaseSequenceScanner::StartDecompressionPipeline() {
+  if (decompress_thread_.get() != NULL) return Status::OK;
+  DCHECK(header_ != NULL);
+  DCHECK(header_->is_compressed);
+  pipeline_decompressor_pool_.reset(new MemPool(scan_node_->mem_tracker()));
+  if (Codec::IsPluginCodec(header_->codec)) {
+    // Plugin codecs must be created by name; header_->compression_type is only a
+    // bookkeeping value for them.
+    RETURN_IF_ERROR(Codec::CreateDecompressor(pipeline_decompressor_pool_.get(), false,
+        header_->codec, &pipeline_decompressor_));
+  } else {
+    RETURN_IF_ERROR(Codec::CreateDecompressor(pipeline_decompressor_pool_.get(), false,
+        header_->compression_type, &pipeline_decompressor_));
+  }
+  compressed_block_queue_.reset(new BlockingQueue<CompressedBlock>(PIPELINE_DEPTH));
+  decompressed_block_queue_.reset(new BlockingQueue<DecompressedBlock>(PIPELINE_DEPTH));
+  decompress_thread_.reset(new Thread("base-sequence-scanner", "decompression-pipeline",
+      &BaseSequenceScanner::DecompressionThread, this));
+  return Status::OK;
+}
+
+void BaseSequenceScanner::DecompressionThread() {
+  CompressedBlock block;
+  while (compressed_block_queue_->BlockingGet(&block)) {
+    DecompressedBlock result;
+    result.pool = new MemPool(scan_node_->mem_tracker());
+    result.data = NULL;
+    result.len = 0;
+    {
+      SCOPED_TIMER(decompress_timer_);
+      result.status = pipeline_decompressor_->ProcessBlock(
+          false, block.len, block.data, &result.len, &result.data);
+    }
+    // Move the output buffer's memory out of the thread-local scratch pool so
+    // ownership can pass back to the scanner thread.
+    result.pool->AcquireData(pipeline_decompressor_pool_.get(), false);
+    block.pool->FreeAll();
+    delete block.pool;
+    if (!decompressed_block_queue_->BlockingPut(result)) {
+      result.pool->FreeAll();
+      delete result.pool;
+      return;
+    }
+  }
+}
+
+bool BaseSequenceScanner::QueueCompressedBlock(const CompressedBlock& block) {
+  DCHECK(decompress_thread_.get() != NULL);
+  if (!compressed_block_queue_->BlockingPut(block)) return false;
+  ++blocks_in_flight_;
+  return true;
+}
+
+Status BaseSequenceScanner::GetDecompressedBlock(MemPool** pool, uint8_t** data,
+    int64_t* len) {
+  DCHECK(decompress_thread_.get() != NULL);
+  DCHECK_GT(blocks_in_flight_, 0);
+  DecompressedBlock result;
+  if (!decompressed_block_queue_->BlockingGet(&result)) {
+    return Status("Decompression pipeline was shut down");
+  }
+  --blocks_in_flight_;
+  *pool = result.pool;
+  *data = result.data;
+  *len = result.len;
+  return result.status;
+}
+
+void BaseSequenceScanner::StopDecompressionPipeline() {
+  if (decompress_thread_.get() == NULL) return;
+  compressed_block_queue_->Shutdown();
+  decompressed_block_queue_->Shutdown();
+  decompress_thread_->Join();
+  decompress_thread_.reset();
+  // Free any blocks that were still in the queues.
+  CompressedBlock block;
+  while (compressed_block_queue_->BlockingGet(&block)) {
+    block.pool->FreeAll();
+    delete block.pool;
+  }
+  DecompressedBlock result;
+  while (decompressed_block_queue_->BlockingGet(&result)) {
+    result.pool->FreeAll();
+    delete result.pool;
+  }
+  blocks_in_flight_ = 0;
+  if (pipeline_decompressor_.get() != NULL) {
+    pipeline_decompressor_->Close();
+    pipeline_decompressor_.reset();
+  }
+  if (pipeline_decompressor_pool_.get() != NULL) {
+    pipeline_decompressor_pool_->FreeAll();
+    pipeline_decompressor_pool_.reset();
+  }
+}
+
 int BaseSequenceScanner::ReadPastSize(int64_t file_offset) {
   DCHECK_GE(total_block_size_, 0);
   if (total_block_size_ == 0) {
@@ -20,12 +20,16 @@
 #include <memory>
 #include <stdint.h>
 
+#include <boost/scoped_ptr.hpp>
+
 #include "exec/hdfs-scanner.h"
+#include "util/blocking-queue.h"
 
 namespace impala {
 
 struct HdfsFileDesc;
 class ScannerContext;
+class Thread;
 
 // Superclass for all sequence container based file formats:
 // e.g. SequenceFile, RCFile, Avro
@@ -116,6 +120,57 @@ class BaseSequenceScanner : public HdfsScanner {
 
   bool finished() { return finished_; }
 
+  // Optional pipelined decompression: subclasses can hand compressed blocks to a
+  // background thread and consume the decompressed blocks in queue order, overlapping
+  // decompression with materialization the way DiskIoMgr already overlaps disk reads.
+  // The compressed bytes are copied when queued so the subclass can keep advancing
+  // stream_ while blocks are in flight.
+
+  // Maximum number of compressed blocks in flight through the decompression
+  // pipeline. Bounds the read-ahead memory to roughly this many blocks (compressed
+  // plus decompressed).
+  static const int PIPELINE_DEPTH = 4;
+
+  // A compressed block in flight through the decompression pipeline. 'pool' owns
+  // 'data' and is freed by the pipeline thread after decompression.
+  struct CompressedBlock {
+    MemPool* pool;
+    uint8_t* data;
+    int64_t len;
+  };
+
+  // A decompressed block ready for the scanner thread. Ownership of 'pool' (which
+  // owns 'data') passes back to the scanner thread, which should acquire it into
+  // data_buffer_pool_ or free it.
+  struct DecompressedBlock {
+    MemPool* pool;
+    uint8_t* data;
+    int64_t len;
+    Status status;
+  };
+
+  // Starts the pipeline thread. header_ must be initialized (the thread's
+  // decompressor is created from header_->compression_type). Idempotent.
+  Status StartDecompressionPipeline();
+
+  // Queues 'block' for decompression. Blocks if PIPELINE_DEPTH blocks are already in
+  // flight. Returns false if the pipeline was shut down, in which case the caller
+  // retains ownership of the block.
+  bool QueueCompressedBlock(const CompressedBlock& block);
+
+  // Returns the next decompressed block, in the order the blocks were queued,
+  // blocking until one is ready. On success the caller owns *pool. Returns the
+  // decompression status; *pool must be freed by the caller even on error.
+  Status GetDecompressedBlock(MemPool** pool, uint8_t** data, int64_t* len);
+
+  // Number of blocks queued but not yet returned by GetDecompressedBlock(). Only
+  // valid on the scanner thread.
+  int blocks_in_flight() const { return blocks_in_flight_; }
+
+  // Shuts down the pipeline, freeing any unconsumed blocks, and joins the thread.
+  // Called from Close(); safe to call if the pipeline was never started.
+  void StopDecompressionPipeline();
+
   // Estimate of header size in bytes.  This is initial number of bytes to issue
   // per file.  If the estimate is too low, more bytes will be read as necessary.
   const static int HEADER_SIZE;
@@ -172,6 +227,27 @@ class BaseSequenceScanner : public HdfsScanner {
 
   // Number of bytes skipped when advancing to next sync on error.
   RuntimeProfile::Counter* bytes_skipped_counter_;
+
+  // Main loop of the decompression pipeline thread: takes blocks off
+  // compressed_block_queue_, decompresses them and puts the results on
+  // decompressed_block_queue_.
+  void DecompressionThread();
+
+  // Queues connecting the scanner thread to the decompression thread. NULL until
+  // StartDecompressionPipeline() is called.
+  boost::scoped_ptr<BlockingQueue<CompressedBlock> > compressed_block_queue_;
+  boost::scoped_ptr<BlockingQueue<DecompressedBlock> > decompressed_block_queue_;
+
+  // Decompression pipeline thread. NULL if the pipeline is not running.
+  boost::scoped_ptr<Thread> decompress_thread_;
+
+  // Decompressor and scratch pool used only by the pipeline thread. The pool's
+  // chunks are moved into each DecompressedBlock's pool after every block.
+  boost::scoped_ptr<Codec> pipeline_decompressor_;
+  boost::scoped_ptr<MemPool> pipeline_decompressor_pool_;
+
+  // Number of blocks in flight. Only updated on the scanner thread.
+  int blocks_in_flight_;
 };
 
 }
@@ -17,11 +17,14 @@
 #include <sstream>
 
 #include "exec/incr-stats-util.h"
+#include "common/atomic.h"
 #include "common/status.h"
 #include "runtime/lib-cache.h"
 #include "service/impala-server.h"
 #include "service/hs2-util.h"
+#include "util/promise.h"
 #include "util/string-parser.h"
+#include "util/thread-pool.h"
 #include "gen-cpp/CatalogService.h"
 #include "gen-cpp/CatalogService_types.h"
 #include "gen-cpp/CatalogObjects_types.h"
@@ -38,6 +41,11 @@ using namespace apache::thrift;
 DECLARE_int32(catalog_service_port);
 DECLARE_string(catalog_service_host);
 
+DEFINE_int32(catalog_bulk_op_max_threads, 8, "(Advanced) Maximum number of concurrent "
+    "catalog service round trips issued by a single bulk catalog operation (e.g. "
+    "registering many partitions via CatalogOpExecutor::ExecBatch()). Each thread uses "
+    "its own catalog connection.");
+
 Status CatalogOpExecutor::Exec(const TCatalogOpRequest& request) {
   Status status;
   DCHECK_NOTNULL(profile_);
@@ -91,6 +99,95 @@ Status CatalogOpExecutor::Exec(const TCatalogOpRequest& request) {
   }
 }
 
+// State shared between the threads executing the operations of one ExecBatch() call.
+// Indexes into 'responses' and 'statuses' parallel the batch's request vector; each
+// slot is written by exactly one thread, so no lock is needed.
+struct CatalogOpExecutor::BatchExecState {
+  BatchExecState() : requests(NULL), num_remaining(0L) {}
+
+  // The batch being executed. Not owned.
+  const std::vector<TCatalogOpRequest>* requests;
+
+  // Per-operation responses and statuses, valid once 'done' is signalled.
+  std::vector<TDdlExecResponse> responses;
+  std::vector<Status> statuses;
+
+  // The number of operations remaining. The thread that finishes the last operation
+  // signals 'done' so that ExecBatch() can return.
+  AtomicInt<int64_t> num_remaining;
+  Promise<bool> done;
+};
+
+Status CatalogOpExecutor::ExecBatch(const vector<TCatalogOpRequest>& requests) {
+  DCHECK_NOTNULL(profile_);
+  RuntimeProfile::Counter* exec_timer = ADD_TIMER(profile_, "CatalogOpExecTimer");
+  SCOPED_TIMER(exec_timer);
+  if (requests.empty()) return Status::OK;
+
+  BatchExecState state;
+  state.requests = &requests;
+  state.responses.resize(requests.size());
+  state.statuses.resize(requests.size());
+  state.num_remaining = requests.size();
+
+  int num_threads =
+      min(FLAGS_catalog_bulk_op_max_threads, static_cast<int>(requests.size()));
+  ThreadPool<pair<BatchExecState*, int> > pool("catalog-op-executor", "bulk-catalog-op",
+      num_threads, requests.size(),
+      bind<void>(&CatalogOpExecutor::ExecBatchOp, this, _1, _2));
+  for (int i = 0; i < requests.size(); ++i) {
+    DCHECK(requests[i].op_type == TCatalogOpType::DDL);
+    pool.Offer(make_pair(&state, i));
+  }
+  state.done.Get();
+
+  // Return the first error, and surface the highest catalog version of the batch so
+  // that the caller can wait for a single statestore broadcast that covers every
+  // operation in it.
+  Status result = Status::OK;
+  catalog_update_result_.reset(new TCatalogUpdateResult());
+  for (int i = 0; i < requests.size(); ++i) {
+    if (!state.statuses[i].ok()) {
+      if (result.ok()) result = state.statuses[i];
+      continue;
+    }
+    const TCatalogUpdateResult& update = state.responses[i].result;
+    if (update.version > catalog_update_result_->version) {
+      *catalog_update_result_ = update;
+    }
+  }
+  return result;
+}
+
+void CatalogOpExecutor::ExecBatchOp(uint32_t thread_id,
+    const pair<BatchExecState*, int>& op) {
+  BatchExecState* state = op.first;
+  int op_idx = op.second;
+  const TCatalogOpRequest& request = (*state->requests)[op_idx];
+  TDdlExecResponse* response = &state->responses[op_idx];
+  Status status;
+  const TNetworkAddress& address =
+      MakeNetworkAddress(FLAGS_catalog_service_host, FLAGS_catalog_service_port);
+  CatalogServiceConnection client(env_->catalogd_client_cache(), address, &status);
+  if (status.ok()) {
+    try {
+      client->ExecDdl(*response, request.ddl_params);
+    } catch (const TException& e) {
+      status = client.Reopen();
+      if (status.ok()) {
+        try {
+          client->ExecDdl(*response, request.ddl_params);
+        } catch (const TException& e) {
+          status = Status(e.what());
+        }
+      }
+    }
+    if (status.ok()) status = Status(response->result.status);
+  }
+  state->statuses[op_idx] = status;
+  if (state->num_remaining.UpdateAndFetch(-1) == 0) state->done.Set(true);
+}
+
 Status CatalogOpExecutor::ExecComputeStats(
     const TComputeStatsParams& compute_stats_params,
     const TTableSchema& tbl_stats_schema, const TRowSet& tbl_stats_data,
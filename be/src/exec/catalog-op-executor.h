@@ -16,6 +16,8 @@
 #ifndef IMPALA_EXEC_CATALOG_OP_EXECUTOR_H
 #define IMPALA_EXEC_CATALOG_OP_EXECUTOR_H
 
+#include <utility>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include "gen-cpp/TCLIService_types.h"
 #include "gen-cpp/Frontend_types.h"
@@ -39,6 +41,18 @@ class CatalogOpExecutor {
   // Executes the given catalog operation against the catalog server.
   Status Exec(const TCatalogOpRequest& catalog_op);
 
+  // Executes a batch of DDL catalog operations (e.g. the partition adds or drops of a
+  // bulk registration), issuing up to --catalog_bulk_op_max_threads concurrent round
+  // trips to the catalog server instead of one synchronous round trip per operation,
+  // analogous to how HdfsOperationSet parallelizes HDFS file operations. Blocks until
+  // all operations have completed; every operation is attempted even if some fail.
+  // Returns OK iff every operation succeeded, otherwise the first error encountered.
+  // Afterwards, update_catalog_result() holds the result with the highest catalog
+  // version in the batch, so the caller needs only a single wait for that version to
+  // be broadcast by the statestore to observe the effects of the entire batch.
+  // All requests must have op_type DDL. ddl_exec_response() is not set by this call.
+  Status ExecBatch(const std::vector<TCatalogOpRequest>& requests);
+
   // Fetches the metadata for the specific TCatalogObject descriptor from the catalog
   // server. If the catalog server does not have the object cached, its metadata will
   // be loaded.
@@ -79,6 +93,15 @@ class CatalogOpExecutor {
   }
 
  private:
+  // State shared between the threads executing the operations of one ExecBatch() call.
+  // Defined in the .cc file.
+  struct BatchExecState;
+
+  // Executes the batch operation at the given index of the running batch's request
+  // vector; invoked from the thread pool created by ExecBatch(). Signals
+  // BatchExecState::done once the last operation of the batch has completed.
+  void ExecBatchOp(uint32_t thread_id, const std::pair<BatchExecState*, int>& op);
+
   // Helper functions used in ExecComputeStats() for setting the thrift structs in params
   // for the table/column stats based on the results of the corresponding child query.
   static void SetTableStats(
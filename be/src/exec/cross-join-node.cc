@@ -32,7 +32,9 @@ using namespace std;
 
 CrossJoinNode::CrossJoinNode(
     ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs)
-  : BlockingJoinNode("CrossJoinNode", TJoinOp::CROSS_JOIN, pool, tnode, descs) {
+  : BlockingJoinNode("CrossJoinNode", TJoinOp::CROSS_JOIN, pool, tnode, descs),
+    build_batch_idx_(0),
+    build_row_idx_(0) {
 }
 
 Status CrossJoinNode::Prepare(RuntimeState* state) {
@@ -71,13 +73,18 @@ Status CrossJoinNode::ConstructBuildSide(RuntimeState* state) {
 }
 
 Status CrossJoinNode::InitGetNext(TupleRow* first_left_row) {
-  current_build_row_ = build_batches_.Iterator();
+  // BlockingJoinNode has already consumed the first probe row; the blocked join
+  // iterates the probe batch once per build block, so start over at row 0.
+  probe_batch_pos_ = 0;
+  build_batch_idx_ = 0;
+  build_row_idx_ = 0;
   return Status::OK;
 }
 
 Status CrossJoinNode::GetNext(RuntimeState* state, RowBatch* output_batch, bool* eos) {
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   if (ReachedLimit() || eos_) {
     *eos = true;
     return Status::OK;
@@ -103,8 +110,9 @@ Status CrossJoinNode::GetNext(RuntimeState* state, RowBatch* output_batch, bool*
       break;
     }
 
-    // Check to see if we're done processing the current left child batch
-    if (current_build_row_.AtEnd() && probe_batch_pos_ == probe_batch_->num_rows()) {
+    // Check to see if we're done processing the current left child batch, i.e. all
+    // build blocks have been joined against it.
+    if (build_batch_idx_ == build_batches_.num_batches()) {
       probe_batch_->TransferResourceOwnership(output_batch);
       probe_batch_pos_ = 0;
       if (output_batch->AtCapacity()) break;
@@ -116,6 +124,8 @@ Status CrossJoinNode::GetNext(RuntimeState* state, RowBatch* output_batch, bool*
         RETURN_IF_ERROR(child(0)->GetNext(state, probe_batch_.get(), &probe_side_eos_));
         timer.Start();
         COUNTER_ADD(probe_row_counter_, probe_batch_->num_rows());
+        build_batch_idx_ = 0;
+        DCHECK_EQ(build_row_idx_, 0);
       }
     }
   }
@@ -141,26 +151,37 @@ int CrossJoinNode::ProcessLeftChildBatch(RowBatch* output_batch, RowBatch* batch
 
   int rows_returned = 0;
   ExprContext* const* ctxs = &conjunct_ctxs_[0];
-
-  while (true) {
-    while (!current_build_row_.AtEnd()) {
-      CreateOutputRow(output_row, current_probe_row_, current_build_row_.GetRow());
-      current_build_row_.Next();
-
-      if (!EvalConjuncts(ctxs, conjunct_ctxs_.size(), output_row)) continue;
-      ++rows_returned;
-      // Filled up out batch or hit limit
-      if (UNLIKELY(rows_returned == max_added_rows)) goto end;
-      // Advance to next out row
-      output_row_mem += output_batch->row_byte_size();
-      output_row = reinterpret_cast<TupleRow*>(output_row_mem);
+  const int num_ctxs = conjunct_ctxs_.size();
+  const int row_byte_size = output_batch->row_byte_size();
+
+  // Join one build-block x probe-batch tile at a time. The build batches are compact
+  // (roughly cache-sized) blocks, so each block stays hot while every probe row of the
+  // batch is joined against it.
+  while (build_batch_idx_ < build_batches_.num_batches()) {
+    RowBatch* build_batch = build_batches_.GetBatch(build_batch_idx_);
+    const int num_build_rows = build_batch->num_rows();
+    while (probe_batch_pos_ < batch->num_rows()) {
+      current_probe_row_ = batch->GetRow(probe_batch_pos_);
+      // Tight innermost loop: evaluate the conjuncts over the block's rows for this
+      // probe row.
+      while (build_row_idx_ < num_build_rows) {
+        CreateOutputRow(output_row, current_probe_row_,
+            build_batch->GetRow(build_row_idx_));
+        ++build_row_idx_;
+
+        if (!EvalConjuncts(ctxs, num_ctxs, output_row)) continue;
+        ++rows_returned;
+        // Filled up out batch or hit limit
+        if (UNLIKELY(rows_returned == max_added_rows)) goto end;
+        // Advance to next out row
+        output_row_mem += row_byte_size;
+        output_row = reinterpret_cast<TupleRow*>(output_row_mem);
+      }
+      build_row_idx_ = 0;
+      ++probe_batch_pos_;
     }
-
-    DCHECK(current_build_row_.AtEnd());
-    // Advance to the next row in the left child batch
-    if (UNLIKELY(probe_batch_pos_ == batch->num_rows())) goto end;
-    current_probe_row_ = batch->GetRow(probe_batch_pos_++);
-    current_build_row_ = build_batches_.Iterator();
+    probe_batch_pos_ = 0;
+    ++build_batch_idx_;
   }
 
 end:
@@ -36,9 +36,11 @@ class RowBatch;
 class TupleRow;
 
 // Node for cross joins.
-// Iterates over the left child rows and then the right child rows and, for
-// each combination, writes the output row if the conjuncts are satisfied. The
-// build batches are kept in a list that is fully constructed from the right child in
+// Performs a blocked nested-loop join: for each build batch (block), all rows of the
+// current probe batch are joined against it before moving to the next block, with the
+// loop over the block's rows innermost. This way each build block is streamed through
+// the cache once per probe batch instead of once per probe row. The build batches are
+// kept in a list that is fully constructed from the right child in
 // ConstructBuildSide() (called by BlockingJoinNode::Open()) while rows are fetched from
 // the left child as necessary in GetNext().
 class CrossJoinNode : public BlockingJoinNode {
@@ -58,7 +60,14 @@ class CrossJoinNode : public BlockingJoinNode {
   boost::scoped_ptr<ObjectPool> build_batch_pool_;
   // List of build batches, constructed in Prepare()
   RowBatchList build_batches_;
-  RowBatchList::TupleRowIterator current_build_row_;
+
+  // Index of the build batch (block) currently joined against probe_batch_. Equal to
+  // build_batches_.num_batches() when all blocks have been joined against it.
+  int build_batch_idx_;
+
+  // Index of the next row within the current build batch to join against the probe
+  // row at probe_batch_pos_.
+  int build_row_idx_;
 
   // Processes a batch from the left child.
   //  output_batch: the batch for resulting tuple rows
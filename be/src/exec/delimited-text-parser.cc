@@ -212,13 +212,10 @@ restart:
       int tuple_mask = _mm_extract_epi16(xmm_tuple_mask, 0);
       if (tuple_mask != 0) {
         found = true;
-        for (int i = 0; i < SSEUtil::CHARS_PER_128_BIT_REGISTER; ++i) {
-          if ((tuple_mask & SSEUtil::SSE_BITMASK[i]) != 0) {
-            tuple_start += i + 1;
-            buffer += i + 1;
-            break;
-          }
-        }
+        // ffs is a libc function that returns the index of the first set bit (1-indexed)
+        int i = ffs(tuple_mask) - 1;
+        tuple_start += i + 1;
+        buffer += i + 1;
         break;
       }
       tuple_start += SSEUtil::CHARS_PER_128_BIT_REGISTER;
@@ -27,6 +27,11 @@ namespace impala {
 // characters) at n+1 don't count.
 inline void ProcessEscapeMask(uint16_t escape_mask, bool* last_char_is_escape,
                               uint16_t* delim_mask) {
+  // Fast path: this block contains no escape characters and the previous block did
+  // not end in one, so there is nothing to fix up in the delimiter mask. This is the
+  // common case even for tables that configure an escape character.
+  if (LIKELY(escape_mask == 0 && !*last_char_is_escape)) return;
+
   // Escape characters can escape escape characters.
   bool first_char_is_escape = *last_char_is_escape;
   bool escape_next = first_char_is_escape;
@@ -16,6 +16,7 @@
 
 #include <boost/scoped_ptr.hpp>
 
+#include "codegen/llvm-codegen.h"
 #include "runtime/data-stream-mgr.h"
 #include "runtime/data-stream-recvr.h"
 #include "runtime/runtime-state.h"
@@ -25,6 +26,7 @@
 #include "gen-cpp/PlanNodes_types.h"
 
 using namespace impala;
+using namespace llvm;
 using namespace std;
 using namespace boost;
 
@@ -66,6 +68,19 @@ Status ExchangeNode::Prepare(RuntimeState* state) {
   stream_recvr_ = ExecEnv::GetInstance()->stream_mgr()->CreateRecvr(state,
       input_row_desc_, state->fragment_instance_id(), id_, num_senders_,
       FLAGS_exchg_node_buffer_size_bytes, runtime_profile(), is_merging_);
+  if (state->codegen_enabled()) {
+    LlvmCodeGen* codegen;
+    RETURN_IF_ERROR(state->GetCodegen(&codegen));
+    Function* fixup_fn = RowBatch::CodegenDeserializeFixup(state, input_row_desc_);
+    if (fixup_fn != NULL) {
+      // The receiver deserializes incoming batches with the interpreted path until
+      // the jitted function pointer is filled in.
+      codegen->AddFunctionToJit(fixup_fn,
+          stream_recvr_->codegend_deserialize_fixup_fn(),
+          ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
+      AddRuntimeExecOption("Codegen Enabled");
+    }
+  }
   if (is_merging_) {
     RETURN_IF_ERROR(sort_exec_exprs_.Prepare(
         state, row_descriptor_, row_descriptor_, expr_mem_tracker()));
@@ -76,6 +91,7 @@ Status ExchangeNode::Prepare(RuntimeState* state) {
 
 Status ExchangeNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   if (is_merging_) {
     RETURN_IF_ERROR(sort_exec_exprs_.Open(state));
@@ -115,6 +131,7 @@ Status ExchangeNode::FillInputRowBatch(RuntimeState* state) {
 Status ExchangeNode::GetNext(RuntimeState* state, RowBatch* output_batch, bool* eos) {
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   if (ReachedLimit()) {
     stream_recvr_->TransferAllResources(output_batch);
     *eos = true;
@@ -54,6 +54,24 @@ using namespace boost;
 // TODO: remove when we remove hash-join-node.cc and aggregation-node.cc
 DEFINE_bool(enable_partitioned_hash_join, true, "Enable partitioned hash join");
 DEFINE_bool(enable_partitioned_aggregation, true, "Enable partitioned hash agg");
+DEFINE_bool(fuse_select_nodes, true, "(Advanced) If true, select nodes that only "
+    "apply conjuncts are fused into their child node when safe: the conjuncts are "
+    "evaluated inside the child's own output loop (codegen'd where the child supports "
+    "it) instead of copying surviving rows into a separate batch.");
+DEFINE_int32(query_maintenance_batch_period, 8, "(Advanced) Number of row batches an "
+    "exec node processes between runs of its periodic maintenance (freeing expr local "
+    "allocations and polling the query status and memory limits). A larger period "
+    "shrinks per-batch fixed overhead at the cost of local allocations accumulating "
+    "for longer and mem-limit violations being noticed later. Must be at least 1; "
+    "1 restores maintenance on every batch.");
+DEFINE_bool(enable_hw_perf_counters, false, "(Advanced) If true, sample hardware perf "
+    "counters (cpu cycles, instructions, last-level cache misses, branch misses) at the "
+    "Open()/GetNext()/Close() boundaries of each exec node and report them as "
+    "HWCpuCycles/HWInstructions/HWCacheMisses/HWBranchMisses in the runtime profile. "
+    "Like TotalTime, the values include child node work; subtract child values for "
+    "per-operator numbers. Only work done in the fragment execution thread is counted, "
+    "so e.g. scanner threads of a scan node are not included. Adds two counter reads "
+    "per row batch per node.");
 
 namespace impala {
 
@@ -64,7 +82,7 @@ int ExecNode::GetNodeIdFromProfile(RuntimeProfile* p) {
 }
 
 ExecNode::RowBatchQueue::RowBatchQueue(int max_batches) :
-    BlockingQueue<RowBatch*>(max_batches) {
+    LockFreeBlockingQueue<RowBatch*>(max_batches) {
 }
 
 ExecNode::RowBatchQueue::~RowBatchQueue() {
@@ -112,8 +130,11 @@ ExecNode::ExecNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl
     debug_action_(TDebugAction::WAIT),
     limit_(tnode.limit),
     num_rows_returned_(0),
+    batches_since_maintenance_(0),
+    maintenance_period_(std::max(1, FLAGS_query_maintenance_batch_period)),
     rows_returned_counter_(NULL),
     rows_returned_rate_(NULL),
+    hw_counters_(NULL),
     is_closed_(false) {
   InitRuntimeProfile(PrintPlanNodeType(tnode.node_type));
 }
@@ -142,6 +163,32 @@ Status ExecNode::Prepare(RuntimeState* state) {
       bind<int64_t>(&RuntimeProfile::UnitsPerSecond, rows_returned_counter_,
         runtime_profile()->total_time_counter()));
 
+  if (FLAGS_enable_hw_perf_counters) {
+    // Prepare() runs in the fragment execution thread, which is also the thread
+    // that will call Open()/GetNext()/Close(), so the thread-scoped perf events
+    // opened here count the right thread.
+    hw_counters_ = HwCounterProfile::Create(pool_, runtime_profile());
+    if (hw_counters_ == NULL) {
+      LOG(WARNING) << "Hardware perf counters requested via --enable_hw_perf_counters "
+                   << "but not available on this machine.";
+    }
+  }
+
+#ifdef ALLOC_PROFILING
+  // Allocation attribution counters; pools owned by the node are pointed at these
+  // via ProfileAllocations() in the subclasses' Prepare().
+  allocation_counters_.calls =
+      ADD_COUNTER(runtime_profile(), "AllocationCalls", TUnit::UNIT);
+  allocation_counters_.bytes =
+      ADD_COUNTER(runtime_profile(), "AllocationBytes", TUnit::BYTES);
+  allocation_counters_.small_calls =
+      ADD_COUNTER(runtime_profile(), "AllocationCallsSmall", TUnit::UNIT);
+  allocation_counters_.medium_calls =
+      ADD_COUNTER(runtime_profile(), "AllocationCallsMedium", TUnit::UNIT);
+  allocation_counters_.large_calls =
+      ADD_COUNTER(runtime_profile(), "AllocationCallsLarge", TUnit::UNIT);
+#endif
+
   RETURN_IF_ERROR(Expr::Prepare(conjunct_ctxs_, state, row_desc(), expr_mem_tracker()));
   AddExprCtxsToFree(conjunct_ctxs_);
 
@@ -208,6 +255,54 @@ Status ExecNode::CreateTree(ObjectPool* pool, const TPlan& plan,
   return status;
 }
 
+// Returns true if nodes of 'type' evaluate their conjunct list against every output
+// row in GetNext(), so that conjuncts appended before Prepare() take effect. Node
+// types that ignore their conjunct list (e.g. exchange, sort, top-n) must not be
+// listed here or fusing a select into them would drop its predicates.
+static bool EvaluatesConjuncts(TPlanNodeType::type type) {
+  switch (type) {
+    case TPlanNodeType::HDFS_SCAN_NODE:
+    case TPlanNodeType::HBASE_SCAN_NODE:
+    case TPlanNodeType::DATA_SOURCE_NODE:
+    case TPlanNodeType::AGGREGATION_NODE:
+    case TPlanNodeType::HASH_JOIN_NODE:
+    case TPlanNodeType::CROSS_JOIN_NODE:
+    case TPlanNodeType::ANALYTIC_EVAL_NODE:
+    case TPlanNodeType::UNION_NODE:
+    case TPlanNodeType::SELECT_NODE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void ExecNode::FuseSelectNodes(ExecNode** root) {
+  if (!FLAGS_fuse_select_nodes) return;
+  ExecNode* node = *root;
+  // Fuse bottom-up so that chains of select nodes collapse completely.
+  for (int i = 0; i < node->children_.size(); ++i) {
+    FuseSelectNodes(&node->children_[i]);
+  }
+  if (node->type_ != TPlanNodeType::SELECT_NODE) return;
+  if (node->limit_ != -1) return;
+  DCHECK_EQ(node->children_.size(), 1);
+  ExecNode* child = node->children_[0];
+  if (!EvaluatesConjuncts(child->type_)) return;
+  if (!node->row_descriptor_.Equals(child->row_descriptor_)) return;
+
+  // The conjunct contexts have not been prepared yet, so they can simply change
+  // owner; the child prepares, codegens, opens and closes them with its own.
+  child->conjunct_ctxs_.insert(child->conjunct_ctxs_.end(),
+      node->conjunct_ctxs_.begin(), node->conjunct_ctxs_.end());
+  node->conjunct_ctxs_.clear();
+  child->AddRuntimeExecOption("Fused Select Conjuncts");
+  // The spliced-out node keeps its (idle) spot in the profile tree; mark it so the
+  // all-zero counters are explicable.
+  node->AddRuntimeExecOption("Fused Into Child");
+  VLOG_QUERY << "Fused select node " << node->id_ << " into child " << child->id_;
+  *root = child;
+}
+
 Status ExecNode::CreateTreeHelper(
     ObjectPool* pool,
     const vector<TPlanNode>& tnodes,
@@ -368,9 +463,7 @@ void ExecNode::InitRuntimeProfile(const string& name) {
   runtime_profile_->set_metadata(id_);
 }
 
-Status ExecNode::ExecDebugAction(TExecNodePhase::type phase, RuntimeState* state) {
-  DCHECK(phase != TExecNodePhase::INVALID);
-  if (debug_phase_ != phase) return Status::OK;
+Status ExecNode::ExecDebugActionImpl(RuntimeState* state) {
   if (debug_action_ == TDebugAction::FAIL) {
     return Status(TErrorCode::INTERNAL_ERROR, "Debug Action: FAIL");
   }
@@ -391,7 +484,15 @@ bool ExecNode::EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow* r
   return true;
 }
 
-Status ExecNode::QueryMaintenance(RuntimeState* state) {
+void ExecNode::EvalConjunctsBatch(ExprContext* const* ctxs, int num_ctxs,
+    RowBatch* batch, uint8_t* selected) {
+  memset(selected, 1, batch->num_rows());
+  for (int i = 0; i < num_ctxs; ++i) {
+    ctxs[i]->root()->EvalBatch(ctxs[i], batch, selected);
+  }
+}
+
+Status ExecNode::QueryMaintenanceImpl(RuntimeState* state) {
   ExprContext::FreeLocalAllocations(expr_ctxs_to_free_);
   return state->CheckQueryState();
 }
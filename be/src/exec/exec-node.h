@@ -21,6 +21,10 @@
 
 #include "common/status.h"
 #include "runtime/descriptors.h"  // for RowDescriptor
+#ifdef ALLOC_PROFILING
+#include "runtime/mem-pool.h"  // for AllocationCounters
+#endif
+#include "util/perf-counters.h"  // for HwCounterProfile / SCOPED_HW_COUNTERS
 #include "util/runtime-profile.h"
 #include "util/blocking-queue.h"
 #include "gen-cpp/PlanNodes_types.h"
@@ -67,7 +71,7 @@ class ExecNode {
   // Performs any preparatory work prior to calling GetNext().
   // Caller must not be holding any io buffers. This will cause deadlock.
   // If overridden in subclass, must first call superclass's Open().
-  // If a parent exec node adds slot filters (see RuntimeState::AddBitmapFilter()),
+  // If a parent exec node adds slot filters (see RuntimeState::AddBloomFilter()),
   // they need to be added before calling Open() on the child that will consume them.
   virtual Status Open(RuntimeState* state);
 
@@ -107,6 +111,16 @@ class ExecNode {
   static Status CreateTree(ObjectPool* pool, const TPlan& plan,
                            const DescriptorTbl& descs, ExecNode** root);
 
+  // Fuses fusion-safe select nodes into their child. A select node that only
+  // applies conjuncts (no limit) and whose row layout matches its child's is
+  // spliced out of the tree and its conjuncts appended to the child's conjunct
+  // list, provided the child is a node type that evaluates its conjuncts against
+  // every output row. The child then filters inside its own (possibly codegen'd)
+  // output loop, eliminating the select's per-batch copy of every surviving row.
+  // Must be called after CreateTree() and before Prepare(); '*root' is updated in
+  // place if the root itself is fused. Disabled via --fuse_select_nodes=false.
+  static void FuseSelectNodes(ExecNode** root);
+
   // Set debug action for node with given id in 'tree'
   static void SetDebugOptions(int node_id, TExecNodePhase::type phase,
                               TDebugAction::type action, ExecNode* tree);
@@ -123,6 +137,14 @@ class ExecNode {
   // out how to deal with declaring a templated std:vector type in IR
   static bool EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow* row);
 
+  // Batch version of EvalConjuncts() for interpreted execution: evaluates the
+  // conjuncts over every row of 'batch' and sets selected[i] to non-zero iff all
+  // exprs returned true for row i. Looping each expr over the batch lets the hot
+  // expr types avoid a virtual call per row (see Expr::EvalBatch()). 'selected' must
+  // have at least batch->num_rows() entries.
+  static void EvalConjunctsBatch(ExprContext* const* ctxs, int num_ctxs,
+      RowBatch* batch, uint8_t* selected);
+
   // Returns a codegen'd version of EvalConjuncts(), or NULL if the function couldn't be
   // codegen'd. The codegen'd version uses inlined, codegen'd GetBooleanVal() functions.
   static llvm::Function* CodegenEvalConjuncts(
@@ -168,7 +190,9 @@ class ExecNode {
   // Row batches that are added after Shutdown() are queued in another queue, which can
   // be cleaned up during Close().
   // All functions are thread safe.
-  class RowBatchQueue : public BlockingQueue<RowBatch*> {
+  // Backed by the lock-free queue: this sits between the scanner threads and the
+  // scan node's GetNext() and is the hottest queue in a scan.
+  class RowBatchQueue : public LockFreeBlockingQueue<RowBatch*> {
    public:
     // max_batches is the maximum number of row batches that can be queued.
     // When the queue is full, producers will block.
@@ -212,10 +236,31 @@ class ExecNode {
   int64_t limit_;  // -1: no limit
   int64_t num_rows_returned_;
 
+  // QueryMaintenance() calls since QueryMaintenanceImpl() last ran, and the number
+  // of calls between runs (from --query_maintenance_batch_period, cached at
+  // construction so the inline fast path doesn't touch the flag).
+  int batches_since_maintenance_;
+  int maintenance_period_;
+
   boost::scoped_ptr<RuntimeProfile> runtime_profile_;
   RuntimeProfile::Counter* rows_returned_counter_;
   RuntimeProfile::Counter* rows_returned_rate_;
 
+  // Hardware counter capture for this node's Open()/GetNext()/Close(), bracketed
+  // by SCOPED_HW_COUNTERS(hw_counters_) alongside the TotalTime scoped timer in
+  // the subclasses. Created in Prepare() when --enable_hw_perf_counters is set;
+  // NULL otherwise (making the scoped brackets no-ops). Pool-owned. Like
+  // TotalTime, the resulting counters include work done in child nodes.
+  HwCounterProfile* hw_counters_;
+
+#ifdef ALLOC_PROFILING
+  // This node's allocation attribution counters, created in Prepare(). Subclasses
+  // attach them to pools they own with pool->set_allocation_counters(
+  // allocation_counters()).
+  AllocationCounters allocation_counters_;
+  AllocationCounters* allocation_counters() { return &allocation_counters_; }
+#endif
+
   // Account for peak memory used by this node
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
@@ -244,19 +289,36 @@ class ExecNode {
 
   // Executes debug_action_ if phase matches debug_phase_.
   // 'phase' must not be INVALID.
-  Status ExecDebugAction(TExecNodePhase::type phase, RuntimeState* state);
+  // Called at the top of every Open()/GetNext() so the no-action case is split out
+  // as an inline check; debug actions are only set by tests.
+  Status ExecDebugAction(TExecNodePhase::type phase, RuntimeState* state) {
+    DCHECK(phase != TExecNodePhase::INVALID);
+    if (LIKELY(debug_phase_ != phase)) return Status::OK;
+    return ExecDebugActionImpl(state);
+  }
 
   // Appends option to 'runtime_exec_options_'
   void AddRuntimeExecOption(const std::string& option);
 
+  // Periodic maintenance: frees local allocations made by expr_ctxs_to_free_ and
+  // checks the query state. Nodes should call this once per input row batch; this
+  // should not be called outside the main execution thread. To shrink per-batch
+  // fixed overhead, the work itself (QueryMaintenanceImpl()) only runs once every
+  // maintenance_period_ calls; the period bounds both how much local-allocation
+  // memory can accumulate and how stale the mem-limit/query-status check can get.
+  Status QueryMaintenance(RuntimeState* state) {
+    if (LIKELY(++batches_since_maintenance_ < maintenance_period_)) return Status::OK;
+    batches_since_maintenance_ = 0;
+    return QueryMaintenanceImpl(state);
+  }
+
   // Frees any local allocations made by expr_ctxs_to_free_ and returns the result of
-  // state->CheckQueryState(). Nodes should call this periodically, e.g. once per input
-  // row batch. This should not be called outside the main execution thread.
+  // state->CheckQueryState().
   //
   // Nodes may override this to add extra periodic cleanup, e.g. freeing other local
   // allocations. ExecNodes overriding this function should return
-  // ExecNode::QueryMaintenance().
-  virtual Status QueryMaintenance(RuntimeState* state);
+  // ExecNode::QueryMaintenanceImpl().
+  virtual Status QueryMaintenanceImpl(RuntimeState* state);
 
   // Add an ExprContext to have its local allocations freed by QueryMaintenance().
   // Exprs that are evaluated in the main execution thread should be added. Exprs
@@ -268,6 +330,10 @@ class ExecNode {
   void AddExprCtxsToFree(const SortExecExprs& sort_exec_exprs);
 
  private:
+  // Cold path of ExecDebugAction(): runs the configured debug action. Only called
+  // when debug_phase_ matches.
+  Status ExecDebugActionImpl(RuntimeState* state);
+
   // Set in ExecNode::Close(). Used to make Close() idempotent. This is not protected
   // by a lock, it assumes all calls to Close() are made by the same thread.
   bool is_closed_;
@@ -117,7 +117,8 @@ Status HashJoinNode::Prepare(RuntimeState* state) {
     codegen_process_build_batch_fn_ = CodegenProcessBuildBatch(state, hash_fn);
     if (codegen_process_build_batch_fn_ != NULL) {
       codegen->AddFunctionToJit(codegen_process_build_batch_fn_,
-          reinterpret_cast<void**>(&process_build_batch_fn_));
+          reinterpret_cast<void**>(&process_build_batch_fn_),
+          ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
       AddRuntimeExecOption("Build Side Codegen Enabled");
     }
 
@@ -126,7 +127,8 @@ Status HashJoinNode::Prepare(RuntimeState* state) {
       Function* codegen_process_probe_batch_fn = CodegenProcessProbeBatch(state, hash_fn);
       if (codegen_process_probe_batch_fn != NULL) {
         codegen->AddFunctionToJit(codegen_process_probe_batch_fn,
-            reinterpret_cast<void**>(&process_probe_batch_fn_));
+            reinterpret_cast<void**>(&process_probe_batch_fn_),
+            ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
         AddRuntimeExecOption("Probe Side Codegen Enabled");
       }
     }
@@ -181,15 +183,15 @@ Status HashJoinNode::ConstructBuildSide(RuntimeState* state) {
     if (eos) break;
   }
 
-  // We've finished constructing the build side. Set the bitmap of the build side values
-  // so that the probe side can use this as an additional predicate.
-  // We only do this if the build side is sufficiently small.
-  // TODO: Better heuristic? Currently we simply compare the size of the HT with a
-  // constant value.
+  // We've finished constructing the build side. Build bloom filters over the build
+  // side values so that the probe side can use them as an additional predicate.
+  // We only do this if the build side is small enough for the filters to stay
+  // selective (see BloomFilter::MIN_BITS_PER_ENTRY).
   if (can_add_probe_filters_) {
-    if (hash_tbl_->size() < state->slot_filter_bitmap_size()) {
+    if (hash_tbl_->size() * BloomFilter::MIN_BITS_PER_ENTRY <=
+        state->slot_filter_num_bits()) {
       AddRuntimeExecOption("Build-Side Filter Pushed Down");
-      hash_tbl_->AddBitmapFilters();
+      hash_tbl_->AddBloomFilters();
     } else {
       VLOG(2) << "Disabling probe filter push down because build table is too large: "
               << hash_tbl_->size();
@@ -210,6 +212,7 @@ Status HashJoinNode::InitGetNext(TupleRow* first_probe_row) {
 
 Status HashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -198,7 +198,9 @@ class HashTableTest : public testing::Test {
     EXPECT_EQ(hash_table.num_buckets(), target_size);
     ProbeTest(&hash_table, &ht_ctx, probe_rows, total_rows, true);
 
-    target_size = BitUtil::NextPowerOfTwo(total_rows / 2);
+    // Shrink as far as open addressing allows: one filled bucket per distinct key
+    // plus at least one empty bucket to terminate probe sequences.
+    target_size = BitUtil::NextPowerOfTwo(rows_to_insert + 1);
     ResizeTable(&hash_table, target_size);
     EXPECT_EQ(hash_table.num_buckets(), target_size);
     ProbeTest(&hash_table, &ht_ctx, probe_rows, total_rows, true);
@@ -273,17 +275,11 @@ TEST_F(HashTableTest, BasicTest) {
   FullScan(&hash_table, &ht_ctx, 0, 5, true, scan_rows, build_rows);
   ProbeTest(&hash_table, &ht_ctx, probe_rows, 10, false);
 
-  // Resize to two and cause some collisions
-  ResizeTable(&hash_table, 2);
-  EXPECT_EQ(hash_table.num_buckets(), 2);
-  EXPECT_EQ(hash_table.size(), 5);
-  memset(scan_rows, 0, sizeof(scan_rows));
-  FullScan(&hash_table, &ht_ctx, 0, 5, true, scan_rows, build_rows);
-  ProbeTest(&hash_table, &ht_ctx, probe_rows, 10, false);
-
-  // Resize to one and turn it into a linked list
-  ResizeTable(&hash_table, 1);
-  EXPECT_EQ(hash_table.num_buckets(), 1);
+  // Shrink to the smallest legal size and cause some collisions. With open
+  // addressing the table cannot shrink below the number of filled buckets, so
+  // 8 is as tight as it gets for 5 entries.
+  ResizeTable(&hash_table, 8);
+  EXPECT_EQ(hash_table.num_buckets(), 8);
   EXPECT_EQ(hash_table.size(), 5);
   memset(scan_rows, 0, sizeof(scan_rows));
   FullScan(&hash_table, &ht_ctx, 0, 5, true, scan_rows, build_rows);
@@ -314,17 +310,23 @@ TEST_F(HashTableTest, GrowTableTest) {
   // This inserts about 5M entries
   int build_row_val = 0;
   uint32_t hash = 0;
+  bool inserted_all = true;
   for (int i = 0; i < 20; ++i) {
     for (int j = 0; j < num_to_add; ++build_row_val, ++j) {
       TupleRow* row = CreateTupleRow(build_row_val);
       if (!ht_ctx.EvalAndHashBuild(row, &hash)) continue;
-      if (!hash_table.Insert(&ht_ctx, row->GetTuple(0), hash)) goto done_inserting;
+      if (!hash_table.Insert(&ht_ctx, row->GetTuple(0), hash)) {
+        inserted_all = false;
+        goto done_inserting;
+      }
     }
     expected_size += num_to_add;
     num_to_add *= 2;
   }
 done_inserting:
-  EXPECT_TRUE(tracker.LimitExceeded());
+  // The bucket array needed for all of the entries does not fit within the limit,
+  // so some insert must have failed while resizing.
+  EXPECT_FALSE(inserted_all);
 
   // Validate that we can find the entries before we went over the limit
   for (int i = 0; i < expected_size * 5; i += 100000) {
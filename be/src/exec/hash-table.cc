@@ -26,6 +26,7 @@
 #include "runtime/string-value.inline.h"
 #include "util/debug-util.h"
 #include "util/impalad-metrics.h"
+#include "util/mem-info.h"
 
 using namespace impala;
 using namespace llvm;
@@ -95,6 +96,43 @@ HashTableCtx::HashTableCtx(const vector<ExprContext*>& build_expr_ctxs,
   memset(expr_values_buffer_, 0, sizeof(uint8_t) * results_buffer_size_);
   expr_value_null_bits_ = new uint8_t[build_expr_ctxs.size()];
 
+  // Check if the key qualifies for the single integer key fast path: one key expr
+  // that is a non-nullable fixed-width integer slot on both sides. Exprs must have
+  // been prepared at this point for the slot offsets to be valid.
+  single_int_key_ = false;
+  build_key_tuple_idx_ = build_key_slot_offset_ = -1;
+  probe_key_tuple_idx_ = probe_key_slot_offset_ = -1;
+  key_byte_size_ = 0;
+  if (build_expr_ctxs_.size() == 1 && build_expr_ctxs_[0]->root()->is_slotref() &&
+      probe_expr_ctxs_[0]->root()->is_slotref()) {
+    const ColumnType& key_type = build_expr_ctxs_[0]->root()->type();
+    switch (key_type.type) {
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT: {
+        const SlotRef* build_ref =
+            static_cast<const SlotRef*>(build_expr_ctxs_[0]->root());
+        const SlotRef* probe_ref =
+            static_cast<const SlotRef*>(probe_expr_ctxs_[0]->root());
+        if (!build_ref->is_nullable() && !probe_ref->is_nullable()) {
+          single_int_key_ = true;
+          build_key_tuple_idx_ = build_ref->tuple_idx();
+          build_key_slot_offset_ = build_ref->slot_offset();
+          probe_key_tuple_idx_ = probe_ref->tuple_idx();
+          probe_key_slot_offset_ = probe_ref->slot_offset();
+          key_byte_size_ = key_type.GetByteSize();
+          // The key can never be NULL, so the null bit read by HashVariableLenRow()
+          // and the codegen'd equality functions is always false.
+          expr_value_null_bits_[0] = false;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
   // Populate the seeds to use for all the levels. TODO: revisit how we generate these.
   DCHECK_GE(max_levels, 0);
   DCHECK_LT(max_levels, sizeof(SEED_PRIMES) / sizeof(SEED_PRIMES[0]));
@@ -166,6 +204,21 @@ uint32_t HashTableCtx::HashVariableLenRow() {
 }
 
 bool HashTableCtx::Equals(TupleRow* build_row) {
+  if (single_int_key_) {
+    // Single non-nullable integer key: one load and compare, no expr evaluation.
+    const uint8_t* slot = reinterpret_cast<uint8_t*>(
+        build_row->GetTuple(build_key_tuple_idx_)) + build_key_slot_offset_;
+    switch (key_byte_size_) {
+      case 1: return *slot == *expr_values_buffer_;
+      case 2: return *reinterpret_cast<const uint16_t*>(slot) ==
+          *reinterpret_cast<uint16_t*>(expr_values_buffer_);
+      case 4: return *reinterpret_cast<const uint32_t*>(slot) ==
+          *reinterpret_cast<uint32_t*>(expr_values_buffer_);
+      case 8: return *reinterpret_cast<const uint64_t*>(slot) ==
+          *reinterpret_cast<uint64_t*>(expr_values_buffer_);
+      default: DCHECK(false) << key_byte_size_;
+    }
+  }
   for (int i = 0; i < build_expr_ctxs_.size(); ++i) {
     void* val = build_expr_ctxs_[i]->GetValue(build_row);
     if (val == NULL) {
@@ -204,6 +257,7 @@ HashTable::HashTable(RuntimeState* state, BufferedBlockMgr::Client* client,
     buckets_(NULL),
     num_buckets_(num_buckets),
     num_buckets_till_resize_(num_buckets_ * MAX_BUCKET_OCCUPANCY_FRACTION),
+    huge_page_bytes_(0),
     has_matches_(false) {
   DCHECK_EQ((num_buckets & (num_buckets-1)), 0) << "num_buckets must be a power of 2";
   DCHECK_GT(num_buckets, 0) << "num_buckets must be larger than 0";
@@ -226,6 +280,7 @@ HashTable::HashTable(MemPool* pool, int num_buckets)
     buckets_(NULL),
     num_buckets_(num_buckets),
     num_buckets_till_resize_(num_buckets_ * MAX_BUCKET_OCCUPANCY_FRACTION),
+    huge_page_bytes_(0),
     has_matches_(false) {
   DCHECK_EQ((num_buckets & (num_buckets-1)), 0) << "num_buckets must be a power of 2";
   DCHECK_GT(num_buckets, 0) << "num_buckets must be larger than 0";
@@ -235,16 +290,39 @@ HashTable::HashTable(MemPool* pool, int num_buckets)
 
 bool HashTable::Init() {
   int64_t buckets_byte_size = num_buckets_ * sizeof(Bucket);
-  if (block_mgr_client_ != NULL &&
-      !state_->block_mgr()->ConsumeMemory(block_mgr_client_, buckets_byte_size)) {
+  if (!ConsumeBucketMemory(buckets_byte_size)) {
     num_buckets_ = 0;
     return false;
   }
   buckets_ = reinterpret_cast<Bucket*>(malloc(buckets_byte_size));
   memset(buckets_, 0, buckets_byte_size);
+  huge_page_bytes_ += MemInfo::AdviseHugePages(buckets_, buckets_byte_size);
   return GrowNodeArray();
 }
 
+bool HashTable::ConsumeBucketMemory(int64_t bytes) {
+  if (block_mgr_client_ != NULL) {
+    return state_->block_mgr()->ConsumeMemory(block_mgr_client_, bytes);
+  }
+  // Only used for testing.
+  DCHECK_NOTNULL(data_page_pool_);
+  data_page_pool_->mem_tracker()->Consume(bytes);
+  if (data_page_pool_->mem_tracker()->LimitExceeded()) {
+    data_page_pool_->mem_tracker()->Release(bytes);
+    return false;
+  }
+  return true;
+}
+
+void HashTable::ReleaseBucketMemory(int64_t bytes) {
+  if (block_mgr_client_ != NULL) {
+    state_->block_mgr()->ReleaseMemory(block_mgr_client_, bytes);
+  } else {
+    DCHECK_NOTNULL(data_page_pool_);
+    data_page_pool_->mem_tracker()->Release(bytes);
+  }
+}
+
 void HashTable::Close() {
   for (int i = 0; i < data_pages_.size(); ++i) {
     data_pages_[i]->Delete();
@@ -254,14 +332,14 @@ void HashTable::Close() {
   }
   data_pages_.clear();
   if (buckets_ != NULL) free(buckets_);
-  if (block_mgr_client_ != NULL) {
-    state_->block_mgr()->ReleaseMemory(block_mgr_client_, num_buckets_ * sizeof(Bucket));
-  }
+  ReleaseBucketMemory(num_buckets_ * sizeof(Bucket));
 }
 
 bool HashTable::ResizeBuckets(int64_t num_buckets) {
   DCHECK_EQ((num_buckets & (num_buckets-1)), 0)
       << "num_buckets=" << num_buckets << " must be a power of 2";
+  DCHECK_GT(num_buckets, num_filled_buckets_) << "Cannot shrink below the number of "
+      << "filled buckets, an open-addressing table needs an empty bucket per probe.";
   VLOG(2) << "Resizing hash table from "
           << num_buckets_ << " to " << num_buckets << " buckets.";
 
@@ -271,51 +349,32 @@ bool HashTable::ResizeBuckets(int64_t num_buckets) {
   // All memory that can grow proportional to the input should come from the block mgrs
   // mem tracker.
   int64_t delta_size = (num_buckets - old_num_buckets) * sizeof(Bucket);
-  if (block_mgr_client_ != NULL &&
-      !state_->block_mgr()->ConsumeMemory(block_mgr_client_, delta_size)) {
+  if (!ConsumeBucketMemory(delta_size)) return false;
+
+  Bucket* new_buckets = reinterpret_cast<Bucket*>(malloc(num_buckets * sizeof(Bucket)));
+  if (new_buckets == NULL) {
+    ReleaseBucketMemory(delta_size);
     return false;
   }
-  if (num_buckets > old_num_buckets) {
-    buckets_ = reinterpret_cast<Bucket*>(realloc(buckets_, num_buckets * sizeof(Bucket)));
-    memset(&buckets_[old_num_buckets], 0, delta_size);
-  }
-
-  // If we're doubling the number of buckets, all nodes in a particular bucket
-  // either remain there, or move down to an analogous bucket in the other half.
-  // In order to efficiently check which of the two buckets a node belongs in, the number
-  // of buckets must be a power of 2.
-  bool doubled_buckets = (num_buckets == old_num_buckets * 2);
-  for (int i = 0; i < num_buckets_; ++i) {
+  memset(new_buckets, 0, num_buckets * sizeof(Bucket));
+  huge_page_bytes_ += MemInfo::AdviseHugePages(new_buckets, num_buckets * sizeof(Bucket));
+
+  // Walk the old table and copy all the filled buckets to the new (resized) table.
+  // Each key appears in exactly one bucket and its cached hash determines the new
+  // probe sequence; duplicate lists move with their bucket unchanged. No keys are
+  // evaluated, so no HashTableCtx is needed.
+  for (int64_t i = 0; i < old_num_buckets; ++i) {
     Bucket* bucket = &buckets_[i];
-    Bucket* sister_bucket = &buckets_[i + old_num_buckets];
-    Node* last_node = NULL;
-    Node* node = bucket->node;
-
-    while (node != NULL) {
-      Node* next = node->next;
-      uint32_t hash = node->hash;
-
-      bool node_must_move;
-      Bucket* move_to;
-      if (doubled_buckets) {
-        node_must_move = ((hash & old_num_buckets) != 0);
-        move_to = sister_bucket;
-      } else {
-        int64_t bucket_idx = hash & (num_buckets - 1);
-        node_must_move = (bucket_idx != i);
-        move_to = &buckets_[bucket_idx];
-      }
-
-      if (node_must_move) {
-        MoveNode(bucket, move_to, node, last_node);
-      } else {
-        last_node = node;
-      }
-
-      node = next;
-    }
+    if (!bucket->filled) continue;
+    bool found = false;
+    int64_t new_idx = Probe(new_buckets, num_buckets, NULL, bucket->hash, &found);
+    DCHECK(!found);
+    DCHECK_NE(new_idx, Iterator::BUCKET_NOT_FOUND);
+    new_buckets[new_idx] = *bucket;
   }
 
+  free(buckets_);
+  buckets_ = new_buckets;
   num_buckets_ = num_buckets;
   num_buckets_till_resize_ = MAX_BUCKET_OCCUPANCY_FRACTION * num_buckets_;
   return true;
@@ -334,51 +393,66 @@ bool HashTable::GrowNodeArray() {
     DCHECK(status.ok() || block == NULL);
     if (block == NULL) return false;
     data_pages_.push_back(block);
-    next_node_ = block->Allocate<Node>(page_size);
+    next_node_ = block->Allocate<DuplicateNode>(page_size);
     ImpaladMetrics::HASH_TABLE_TOTAL_BYTES->Increment(page_size);
   } else {
     // Only used for testing.
     DCHECK_NOTNULL(data_page_pool_);
     page_size = TEST_PAGE_SIZE;
-    next_node_ = reinterpret_cast<Node*>(data_page_pool_->Allocate(page_size));
+    next_node_ = reinterpret_cast<DuplicateNode*>(data_page_pool_->Allocate(page_size));
     if (data_page_pool_->mem_tracker()->LimitExceeded()) return false;
     DCHECK(next_node_ != NULL);
   }
-  node_remaining_current_page_ = page_size / sizeof(Node);
+  node_remaining_current_page_ = page_size / sizeof(DuplicateNode);
   total_data_page_size_ += page_size;
   return true;
 }
 
+// Helper for DebugString(): prints one entry's data (and optionally its row and
+// matched flag) to 'ss'.
+void HashTable::DebugStringEntry(HtData& htdata, bool matched, bool show_match,
+    const RowDescriptor* desc, TupleRow* row, stringstream* ss) {
+  if (stores_tuples_) {
+    *ss << "(" << htdata.tuple << ")";
+  } else {
+    *ss << "(" << htdata.idx.block() << ", " << htdata.idx.idx()
+       << ", " << htdata.idx.offset() << ")";
+  }
+  if (desc != NULL) {
+    *ss << " " << PrintRow(GetRow(htdata, row), *desc);
+  }
+  if (show_match) {
+    if (matched) {
+      *ss << " [M]";
+    } else {
+      *ss << " [U]";
+    }
+  }
+}
+
 string HashTable::DebugString(bool skip_empty, bool show_match,
     const RowDescriptor* desc) {
   Tuple* row[num_build_tuples_];
   stringstream ss;
   ss << endl;
-  for (int i = 0; i < num_buckets_; ++i) {
-    Node* node = buckets_[i].node;
-    bool first = true;
-    if (skip_empty && node == NULL) continue;
+  for (int64_t i = 0; i < num_buckets_; ++i) {
+    Bucket* bucket = &buckets_[i];
+    if (skip_empty && !bucket->filled) continue;
     ss << i << ": ";
-    while (node != NULL) {
-      if (!first) ss << ",";
-      if (stores_tuples_) {
-        ss << node << "(" << node->tuple << ")";
-      } else {
-        ss << node << "(" << node->idx.block() << ", " << node->idx.idx()
-           << ", " << node->idx.offset() << ")";
-      }
-      if (desc != NULL) {
-        ss << " " << PrintRow(GetRow(node, reinterpret_cast<TupleRow*>(row)), *desc);
-      }
-      if (show_match) {
-        if (node->matched) {
-          ss << " [M]";
-        } else {
-          ss << " [U]";
+    if (bucket->filled) {
+      if (bucket->has_duplicates) {
+        bool first = true;
+        for (DuplicateNode* node = bucket->bucket_data.duplicates; node != NULL;
+            node = node->next) {
+          if (!first) ss << ",";
+          DebugStringEntry(node->htdata, node->matched, show_match, desc,
+              reinterpret_cast<TupleRow*>(row), &ss);
+          first = false;
         }
+      } else {
+        DebugStringEntry(bucket->bucket_data.htdata, bucket->matched, show_match,
+            desc, reinterpret_cast<TupleRow*>(row), &ss);
       }
-      node = node->next;
-      first = false;
     }
     ss << endl;
   }
@@ -426,6 +500,38 @@ static void CodegenAssignNullValue(LlvmCodeGen* codegen,
         null_value = ConstantFP::get(codegen->context(), APFloat(fvn_seed_double));
         break;
       }
+      case TYPE_TIMESTAMP: {
+        // TimestampValue is hashed and compared as its raw 16 bytes, so write the
+        // seed pattern over the whole value, the same bytes the interpreted path
+        // copies from NULL_VALUE.
+        dst = builder->CreateBitCast(dst,
+            PointerType::get(Type::getIntNTy(codegen->context(), 128), 0));
+        uint64_t seed_words[] = { static_cast<uint64_t>(fvn_seed),
+                                  static_cast<uint64_t>(fvn_seed) };
+        null_value = ConstantInt::get(codegen->context(), APInt(128, seed_words));
+        break;
+      }
+      case TYPE_DECIMAL: {
+        // Decimals are stored in the results buffer as their unscaled integer of
+        // 4, 8 or 16 bytes.
+        switch (type.GetByteSize()) {
+          case 4:
+            null_value = codegen->GetIntConstant(TYPE_INT, fvn_seed);
+            break;
+          case 8:
+            null_value = codegen->GetIntConstant(TYPE_BIGINT, fvn_seed);
+            break;
+          case 16: {
+            uint64_t seed_words[] = { static_cast<uint64_t>(fvn_seed),
+                                      static_cast<uint64_t>(fvn_seed) };
+            null_value = ConstantInt::get(codegen->context(), APInt(128, seed_words));
+            break;
+          }
+          default:
+            DCHECK(false) << "Invalid decimal byte size: " << type.GetByteSize();
+        }
+        break;
+      }
       default:
         DCHECK(false);
     }
@@ -464,11 +570,10 @@ static void CodegenAssignNullValue(LlvmCodeGen* codegen,
 // becomes the start of the next block for codegen (either the next expr or just the
 // end of the function).
 Function* HashTableCtx::CodegenEvalRow(RuntimeState* state, bool build) {
-  // TODO: CodegenAssignNullValue() can't handle TYPE_TIMESTAMP or TYPE_DECIMAL yet
   const vector<ExprContext*>& ctxs = build ? build_expr_ctxs_ : probe_expr_ctxs_;
   for (int i = 0; i < ctxs.size(); ++i) {
-    PrimitiveType type = ctxs[i]->root()->type().type;
-    if (type == TYPE_TIMESTAMP || type == TYPE_DECIMAL || type == TYPE_CHAR) return NULL;
+    // Disable codegen for CHAR
+    if (ctxs[i]->root()->type().type == TYPE_CHAR) return NULL;
   }
 
   LlvmCodeGen* codegen;
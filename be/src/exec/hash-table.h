@@ -16,6 +16,7 @@
 #ifndef IMPALA_EXEC_HASH_TABLE_H
 #define IMPALA_EXEC_HASH_TABLE_H
 
+#include <sstream>
 #include <vector>
 #include <boost/cstdint.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -185,15 +186,50 @@ class HashTableCtx {
   // compiled because we need to be able to differentiate between EvalBuildRow and
   // EvalProbeRow by name and the build/probe exprs are baked into the codegen'd function.
   bool IR_NO_INLINE EvalBuildRow(TupleRow* row) {
+    if (single_int_key_) {
+      EvalIntKeyRow(row, build_key_tuple_idx_, build_key_slot_offset_);
+      return false;
+    }
     return EvalRow(row, build_expr_ctxs_);
   }
 
   // Evaluate 'row' over probe exprs caching the results in 'expr_values_buffer_'
   // This will be replaced by codegen.
   bool IR_NO_INLINE EvalProbeRow(TupleRow* row) {
+    if (single_int_key_) {
+      EvalIntKeyRow(row, probe_key_tuple_idx_, probe_key_slot_offset_);
+      return false;
+    }
     return EvalRow(row, probe_expr_ctxs_);
   }
 
+  // Fast path for the common single non-nullable integer key: copy the key slot
+  // directly into expr_values_buffer_, with no expr evaluation or null branches.
+  // Only called if single_int_key_ is true.
+  void EvalIntKeyRow(TupleRow* row, int tuple_idx, int slot_offset) {
+    const uint8_t* slot =
+        reinterpret_cast<uint8_t*>(row->GetTuple(tuple_idx)) + slot_offset;
+    switch (key_byte_size_) {
+      case 1:
+        *expr_values_buffer_ = *slot;
+        break;
+      case 2:
+        *reinterpret_cast<uint16_t*>(expr_values_buffer_) =
+            *reinterpret_cast<const uint16_t*>(slot);
+        break;
+      case 4:
+        *reinterpret_cast<uint32_t*>(expr_values_buffer_) =
+            *reinterpret_cast<const uint32_t*>(slot);
+        break;
+      case 8:
+        *reinterpret_cast<uint64_t*>(expr_values_buffer_) =
+            *reinterpret_cast<const uint64_t*>(slot);
+        break;
+      default:
+        DCHECK(false) << key_byte_size_;
+    }
+  }
+
   // Compute the hash of the values in expr_values_buffer_ for rows with variable length
   // fields (e.g. strings)
   uint32_t HashVariableLenRow();
@@ -246,15 +282,35 @@ class HashTableCtx {
   // Scratch buffer to generate rows on the fly.
   TupleRow* row_;
 
+  // True if the key is a single non-nullable fixed-width integer slot for both the
+  // build and probe side. In that case EvalBuildRow/EvalProbeRow/Equals bypass expr
+  // evaluation and compare the key with a single integer load. Set in the constructor.
+  bool single_int_key_;
+
+  // Tuple index and byte offset of the key slot on each side. Only valid if
+  // single_int_key_ is true.
+  int build_key_tuple_idx_;
+  int build_key_slot_offset_;
+  int probe_key_tuple_idx_;
+  int probe_key_slot_offset_;
+
+  // Byte size of the key type (1, 2, 4 or 8). Only valid if single_int_key_ is true.
+  int key_byte_size_;
+
   // Cross-compiled functions to access member variables used in CodegenHashCurrentRow().
   uint32_t GetHashSeed() const;
 };
 
-// The hash table data structure. Consists of a vector of buckets (of linked nodes).
-// The data allocated by the hash table comes from the BufferedBlockMgr.
+// The hash table data structure. The table is an open-addressing scheme with linear
+// probing over a single contiguous array of buckets; each distinct key occupies
+// exactly one bucket, which stores the key's hash and its row inline. Duplicate rows
+// for a key are kept in a linked list of DuplicateNodes allocated sequentially from
+// contiguous data pages, so both probing and full-table iteration are sequential in
+// memory. The data allocated by the hash table comes from the BufferedBlockMgr.
 class HashTable {
  private:
-  struct Node;
+  struct Bucket;
+  struct DuplicateNode;
 
  public:
   class Iterator;
@@ -310,21 +366,31 @@ class HashTable {
   // Returns HashTable::End() if there is no match.
   Iterator IR_ALWAYS_INLINE Find(HashTableCtx* ht_ctx, uint32_t hash);
 
+  // Prefetches the bucket that 'hash' maps to. Callers that know the hashes of
+  // upcoming rows can use this to overlap the memory latency of bucket loads with
+  // other work before calling Find().
+  void IR_ALWAYS_INLINE PrefetchBucket(uint32_t hash);
+
   // Returns number of elements in the hash table
   int64_t size() const { return num_nodes_; }
 
   // Returns the number of buckets
   int64_t num_buckets() const { return num_buckets_; }
 
+  // Returns the number of bucket array bytes the kernel was advised to back with
+  // transparent huge pages (see MemInfo::AdviseHugePages()).
+  int64_t huge_page_bytes() const { return huge_page_bytes_; }
+
   // Returns the load factor (the number of non-empty buckets)
   float load_factor() const {
     return num_filled_buckets_ / static_cast<float>(num_buckets_);
   }
 
   // Returns an estimate of the number of bytes needed to build the hash table
-  // structure for 'num_rows'.
+  // structure for 'num_rows'. Does not include memory for duplicate rows, which is
+  // data dependent.
   static int64_t EstimateSize(int64_t num_rows) {
-    return EstimatedNumBuckets(num_rows) * sizeof(Bucket) + num_rows * sizeof(Node);
+    return EstimatedNumBuckets(num_rows) * sizeof(Bucket);
   }
 
   // Returns the estimated number of buckets (rounded up to a power of two) to
@@ -361,7 +427,11 @@ class HashTable {
   // stl-like iterator interface.
   class Iterator {
    public:
-    Iterator() : table_(NULL), bucket_idx_(-1), node_(NULL) {
+    // Bucket index value when the iterator is at the end, or a probe found no
+    // bucket for its hash.
+    static const int64_t BUCKET_NOT_FOUND = -1;
+
+    Iterator() : table_(NULL), bucket_idx_(BUCKET_NOT_FOUND), node_(NULL) {
     }
 
     // Iterates to the next element.  In the case where the iterator was
@@ -380,35 +450,52 @@ class HashTable {
     // the next call to GetRow(). It is safe to advance the iterator.
     TupleRow* GetRow() {
       DCHECK(!AtEnd());
-      return table_->GetRow(node_, ctx_->row_);
+      Bucket* bucket = &table_->buckets_[bucket_idx_];
+      if (bucket->has_duplicates) {
+        DCHECK(node_ != NULL);
+        return table_->GetRow(node_->htdata, ctx_->row_);
+      }
+      return table_->GetRow(bucket->bucket_data.htdata, ctx_->row_);
     }
 
     Tuple* GetTuple() {
       DCHECK(!AtEnd());
       DCHECK(table_->stores_tuples_);
-      return reinterpret_cast<Tuple*>(node_->tuple);
+      Bucket* bucket = &table_->buckets_[bucket_idx_];
+      if (bucket->has_duplicates) {
+        DCHECK(node_ != NULL);
+        return node_->htdata.tuple;
+      }
+      return bucket->bucket_data.htdata.tuple;
     }
 
-    // Sets as matched the node currently pointed by the iterator. The iterator
+    // Sets as matched the entry currently pointed by the iterator. The iterator
     // cannot be AtEnd().
     void set_matched() {
       DCHECK(!AtEnd());
-      node_->matched = true;
+      Bucket* bucket = &table_->buckets_[bucket_idx_];
+      if (bucket->has_duplicates) {
+        node_->matched = true;
+      } else {
+        bucket->matched = true;
+      }
       table_->has_matches_ = true;
     }
 
     bool matched() const {
       DCHECK(!AtEnd());
-      return node_->matched;
+      Bucket* bucket = &table_->buckets_[bucket_idx_];
+      if (bucket->has_duplicates) return node_->matched;
+      return bucket->matched;
     }
 
     void reset() {
-      bucket_idx_ = -1;
+      bucket_idx_ = BUCKET_NOT_FOUND;
       node_ = NULL;
     }
 
     // Returns true if this iterator is at the end, i.e. GetRow() cannot be called.
-    bool AtEnd() const { return node_ == NULL; }
+    bool AtEnd() const { return bucket_idx_ == BUCKET_NOT_FOUND; }
     bool operator!=(const Iterator& rhs) { return !(*this == rhs); }
 
     bool operator==(const Iterator& rhs) {
@@ -419,7 +506,7 @@ class HashTable {
     friend class HashTable;
 
     Iterator(HashTable* table, HashTableCtx* ctx,
-        int bucket_idx, Node* node, uint32_t hash)
+        int64_t bucket_idx, DuplicateNode* node, uint32_t hash)
       : table_(table),
         ctx_(ctx),
         bucket_idx_(bucket_idx),
@@ -430,11 +517,12 @@ class HashTable {
     HashTable* table_;
     HashTableCtx* ctx_;
 
-    // Current bucket idx
+    // Current bucket idx. BUCKET_NOT_FOUND if at the end.
     int64_t bucket_idx_;
 
-    // Current node idx (within current bucket)
-    Node* node_;
+    // Current duplicate node within the bucket. NULL if the bucket does not have
+    // duplicates.
+    DuplicateNode* node_;
 
     // Cached hash value for the row passed to Find()
     uint32_t scan_hash_;
@@ -444,62 +532,106 @@ class HashTable {
   friend class Iterator;
   friend class HashTableTest;
 
-  // TODO: bit pack this struct. The default alignment makes this struct have a lot
-  // of wasted bytes.
-  struct Node {
+  // Either the row's index in the tuple stream or, if the row is a single tuple, a
+  // pointer to that tuple.
+  union HtData {
+    BufferedTupleStream::RowIdx idx;
+    Tuple* tuple;
+  };
+
+  // Duplicate rows for a key are kept in a linked list of these nodes, allocated
+  // sequentially from the contiguous data pages.
+  struct DuplicateNode {
     // Only used for full/right outer hash join to indicate if this row has been
     // matched.
-    // From an abstraction point of view, this is an awkward place to store this
-    // information but it is very efficient here. This space is otherwise unused
-    // (and we can bitpack this more in the future).
     bool matched;
 
-    // TODO: Do we even have to cache the hash value?
-    uint32_t hash;   // Cache of the hash for data_
-    Node* next;      // Chain to next node for collisions
-    union {
-      BufferedTupleStream::RowIdx idx;
-      Tuple* tuple;
-    };
+    DuplicateNode* next;
+    HtData htdata;
   };
 
   struct Bucket {
-    Node* node;
-    Bucket() : node(NULL) { }
+    // Whether the bucket contains an entry.
+    bool filled;
+
+    // Only used for full/right outer hash join to indicate if the bucket's row has
+    // been matched. Only valid if has_duplicates is false; otherwise the matched
+    // flags of the DuplicateNodes are used.
+    bool matched;
+
+    // Whether this bucket's key has more than one row. If true, bucket_data contains
+    // the head of the duplicate list instead of the row itself.
+    bool has_duplicates;
+
+    // Cache of the hash of the bucket's key. Used to avoid evaluating rows during
+    // probing and when resizing.
+    uint32_t hash;
+
+    union {
+      HtData htdata;
+      DuplicateNode* duplicates;
+    } bucket_data;
   };
 
-  // Returns the next non-empty bucket and updates idx to be the index of that bucket.
-  // If there are no more buckets, returns NULL and sets idx to -1
+  // Returns the next filled bucket and updates idx to be the index of that bucket.
+  // If there are no more buckets, returns NULL and sets idx to BUCKET_NOT_FOUND.
   Bucket* NextBucket(int64_t* bucket_idx);
 
   // Resize the hash table to 'num_buckets'. Returns false on OOM.
   bool ResizeBuckets(int64_t num_buckets);
 
-  // Insert row into the hash table. Returns the node that was inserted. Returns NULL
-  // if there was not enough memory.
-  Node* IR_ALWAYS_INLINE InsertImpl(HashTableCtx* ht_ctx, uint32_t hash);
+  // Performs the linear probe over 'buckets': returns the index of the bucket
+  // containing the key cached in 'ht_ctx' (setting *found to true), or of the first
+  // empty bucket in the probe sequence (*found stays false). Returns
+  // Iterator::BUCKET_NOT_FOUND if the table is full. 'ht_ctx' can be NULL, in which
+  // case only empty buckets are looked for (used when resizing, where all keys are
+  // known to be distinct).
+  int64_t IR_ALWAYS_INLINE Probe(Bucket* buckets, int64_t num_buckets,
+      HashTableCtx* ht_ctx, uint32_t hash, bool* found);
+
+  // Insert the row with 'hash' into the table. Returns a pointer to the entry's
+  // data slot to be filled in by the caller, or NULL if there was not enough memory.
+  HtData* IR_ALWAYS_INLINE InsertInternal(HashTableCtx* ht_ctx, uint32_t hash);
 
-  // Chains the node at 'node_idx' to 'bucket'.  Nodes in a bucket are chained
-  // as a linked list; this places the new node at the beginning of the list.
-  void AddToBucket(Bucket* bucket, Node* node);
+  // Appends a new duplicate node to 'bucket', converting the bucket to a duplicate
+  // bucket first if needed. Returns NULL if there was not enough memory.
+  DuplicateNode* IR_ALWAYS_INLINE InsertDuplicateNode(Bucket* bucket);
 
-  // Moves a node from one bucket to another. 'previous_node' refers to the
-  // node (if any) that's chained before this node in from_bucket's linked list.
-  void MoveNode(Bucket* from_bucket, Bucket* to_bucket, Node* node,
-     Node* previous_node);
+  // Returns the next node from the duplicate node arena, growing it if necessary.
+  // Returns NULL if there was not enough memory.
+  DuplicateNode* IR_ALWAYS_INLINE AllocDuplicateNode();
 
-  TupleRow* GetRow(Node* node, TupleRow* row) const {
+  TupleRow* GetRow(HtData& htdata, TupleRow* row) const {
     if (stores_tuples_) {
-      return reinterpret_cast<TupleRow*>(&node->tuple);
+      return reinterpret_cast<TupleRow*>(&htdata.tuple);
     } else {
-      tuple_stream_->GetTupleRow(node->idx, row);
+      tuple_stream_->GetTupleRow(htdata.idx, row);
       return row;
     }
   }
 
-  // Grow the node array. Returns false on OOM.
+  // Returns the row of the bucket's entry. For buckets with duplicates this is the
+  // first duplicate's row; all duplicates of a bucket have equal keys.
+  TupleRow* GetRow(Bucket* bucket, TupleRow* row) const {
+    if (bucket->has_duplicates) {
+      return GetRow(bucket->bucket_data.duplicates->htdata, row);
+    }
+    return GetRow(bucket->bucket_data.htdata, row);
+  }
+
+  // Grow the duplicate node arena. Returns false on OOM.
   bool GrowNodeArray();
 
+  // Account for 'bytes' of bucket memory against the block mgr (or, for the
+  // testing-only MemPool variant, the pool's tracker). Consume returns false and
+  // consumes nothing if the limit would be exceeded.
+  bool ConsumeBucketMemory(int64_t bytes);
+  void ReleaseBucketMemory(int64_t bytes);
+
+  // Helper for DebugString(): prints one entry to 'ss'.
+  void DebugStringEntry(HtData& htdata, bool matched, bool show_match,
+      const RowDescriptor* desc, TupleRow* row, std::stringstream* ss);
+
   // Load factor that will trigger growing the hash table on insert.  This is
   // defined as the number of non-empty buckets / total_buckets
   static const float MAX_BUCKET_OCCUPANCY_FRACTION;
@@ -528,22 +660,22 @@ class HashTable {
 
   const int64_t max_num_buckets_;
 
-  // Number of non-empty buckets.  Used to determine when to grow and rehash
+  // Number of filled buckets.  Used to determine when to grow and rehash
   int64_t num_filled_buckets_;
 
-  // number of nodes stored (i.e. size of hash table)
+  // Number of entries stored (i.e. size of hash table), including duplicates.
   int64_t num_nodes_;
 
-  // Data pages for all nodes. These are always pinned.
+  // Data pages for the duplicate node arena. These are always pinned.
   std::vector<BufferedBlockMgr::Block*> data_pages_;
 
   // Byte size of all buffers in data_pages_.
   int64_t total_data_page_size_;
 
-  // Next node to insert.
-  Node* next_node_;
+  // Next duplicate node to insert.
+  DuplicateNode* next_node_;
 
-  // Number of nodes left in the current page.
+  // Number of duplicate nodes left in the current page.
   int node_remaining_current_page_;
 
   // Array of all buckets. Owned by this node. Using c-style array to control
@@ -556,6 +688,9 @@ class HashTable {
   // The number of filled buckets to trigger a resize.  This is cached for efficiency
   int64_t num_buckets_till_resize_;
 
+  // Number of bucket array bytes advised to be backed by transparent huge pages.
+  int64_t huge_page_bytes_;
+
   // Flag used to disable spilling hash tables that already had matches in case of
   // right joins (IMPALA-1488).
   // TODO: Not fail when spilling hash tables with matches in right joins
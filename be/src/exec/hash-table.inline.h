@@ -34,179 +34,194 @@ inline bool HashTableCtx::EvalAndHashProbe(TupleRow* row, uint32_t* hash) {
   return true;
 }
 
+inline int64_t HashTable::Probe(Bucket* buckets, int64_t num_buckets,
+    HashTableCtx* ht_ctx, uint32_t hash, bool* found) {
+  DCHECK(buckets != NULL);
+  DCHECK_GT(num_buckets, 0);
+  *found = false;
+  int64_t bucket_idx = hash & (num_buckets - 1);
+
+  // Linear probing: scan forward from the hash bucket until either an empty bucket
+  // or the key's bucket is found. Rows that share the hash but have different keys
+  // occupy later buckets in the sequence, so probing must continue past hash matches
+  // that fail the key comparison.
+  for (int64_t step = 0; step < num_buckets; ++step) {
+    Bucket* bucket = &buckets[bucket_idx];
+    if (!bucket->filled) return bucket_idx;
+    if (bucket->hash == hash && ht_ctx != NULL &&
+        ht_ctx->Equals(GetRow(bucket, ht_ctx->row_))) {
+      *found = true;
+      return bucket_idx;
+    }
+    bucket_idx = (bucket_idx + 1) & (num_buckets - 1);
+  }
+  // The table is full and does not contain the key.
+  return Iterator::BUCKET_NOT_FOUND;
+}
+
 inline HashTable::Iterator HashTable::Find(HashTableCtx* ht_ctx, uint32_t hash) {
   DCHECK_NOTNULL(ht_ctx);
   DCHECK_NE(num_buckets_, 0);
   DCHECK_EQ(hash, ht_ctx->HashCurrentRow());
-  int64_t bucket_idx = hash & (num_buckets_ - 1);
+  bool found = false;
+  int64_t bucket_idx = Probe(buckets_, num_buckets_, ht_ctx, hash, &found);
+  if (!found) return End();
   Bucket* bucket = &buckets_[bucket_idx];
-  Node* node = bucket->node;
-  while (node != NULL) {
-    if (node->hash == hash && ht_ctx->Equals(GetRow(node, ht_ctx->row_))) {
-      return Iterator(this, ht_ctx, bucket_idx, node, hash);
-    }
-    node = node->next;
-  }
-  return End();
+  DuplicateNode* duplicates =
+      bucket->has_duplicates ? bucket->bucket_data.duplicates : NULL;
+  return Iterator(this, ht_ctx, bucket_idx, duplicates, hash);
+}
+
+inline void HashTable::PrefetchBucket(uint32_t hash) {
+  DCHECK_NE(num_buckets_, 0);
+  int64_t bucket_idx = hash & (num_buckets_ - 1);
+  // Read prefetch with low temporal locality: each bucket is only touched once when
+  // its row comes up for resolution.
+  __builtin_prefetch(&buckets_[bucket_idx], 0, 1);
 }
 
 inline HashTable::Iterator HashTable::Begin(HashTableCtx* ctx) {
-  int64_t bucket_idx = -1;
+  int64_t bucket_idx = Iterator::BUCKET_NOT_FOUND;
   Bucket* bucket = NextBucket(&bucket_idx);
-  if (bucket != NULL) return Iterator(this, ctx, bucket_idx, bucket->node, 0);
-  return End();
+  if (bucket == NULL) return End();
+  DuplicateNode* duplicates =
+      bucket->has_duplicates ? bucket->bucket_data.duplicates : NULL;
+  return Iterator(this, ctx, bucket_idx, duplicates, 0);
 }
 
 inline HashTable::Iterator HashTable::FirstUnmatched(HashTableCtx* ctx) {
-  int64_t bucket_idx = -1;
-  Bucket* bucket = NextBucket(&bucket_idx);
-  while (bucket != NULL) {
-    Node* node = bucket->node;
-    while (node != NULL && node->matched) {
-      node = node->next;
-    }
-    if (node == NULL) {
-      bucket = NextBucket(&bucket_idx);
-    } else {
-      DCHECK(!node->matched);
-      return Iterator(this, ctx, bucket_idx, node, 0);
-    }
-  }
-  return End();
+  Iterator it = Begin(ctx);
+  if (!it.AtEnd() && it.matched()) it.NextUnmatched();
+  return it;
 }
 
 inline HashTable::Bucket* HashTable::NextBucket(int64_t* bucket_idx) {
   ++*bucket_idx;
   for (; *bucket_idx < num_buckets_; ++*bucket_idx) {
-    if (buckets_[*bucket_idx].node != NULL) return &buckets_[*bucket_idx];
+    if (buckets_[*bucket_idx].filled) return &buckets_[*bucket_idx];
   }
-  *bucket_idx = -1;
+  *bucket_idx = Iterator::BUCKET_NOT_FOUND;
   return NULL;
 }
 
 inline bool HashTable::Insert(HashTableCtx* ht_ctx,
     const BufferedTupleStream::RowIdx& idx, TupleRow* row, uint32_t hash) {
-  Node* node = InsertImpl(ht_ctx, hash);
-  if (node == NULL) return false;
+  HtData* htdata = InsertInternal(ht_ctx, hash);
+  if (htdata == NULL) return false;
   if (stores_tuples_) {
     DCHECK_EQ(num_build_tuples_, 1);
     // Optimization: if this row is just a single tuple, just store the tuple*.
-    node->tuple = row->GetTuple(0);
+    htdata->tuple = row->GetTuple(0);
   } else {
-    node->idx = idx;
+    htdata->idx = idx;
   }
   return true;
 }
 
 inline bool HashTable::Insert(HashTableCtx* ht_ctx, Tuple* tuple, uint32_t hash) {
   DCHECK(stores_tuples_);
-  Node* node = InsertImpl(ht_ctx, hash);
-  if (node == NULL) return false;
-  node->tuple = tuple;
+  HtData* htdata = InsertInternal(ht_ctx, hash);
+  if (htdata == NULL) return false;
+  htdata->tuple = tuple;
   return true;
 }
 
-inline HashTable::Node* HashTable::InsertImpl(HashTableCtx* ht_ctx, uint32_t hash) {
+inline HashTable::HtData* HashTable::InsertInternal(HashTableCtx* ht_ctx,
+    uint32_t hash) {
   DCHECK_NOTNULL(ht_ctx);
   DCHECK_NE(num_buckets_, 0);
   if (UNLIKELY(num_filled_buckets_ > num_buckets_till_resize_)) {
     // TODO: next prime instead of double?
     if (!ResizeBuckets(num_buckets_ * 2)) return NULL;
   }
-  if (node_remaining_current_page_ == 0) {
-    if (!GrowNodeArray()) return NULL;
-  }
   DCHECK_EQ(hash, ht_ctx->HashCurrentRow());
-  int64_t bucket_idx = hash & (num_buckets_ - 1);
-  next_node_->hash = hash;
-  next_node_->matched = false;
-  AddToBucket(&buckets_[bucket_idx], next_node_);
-  DCHECK_GT(node_remaining_current_page_, 0);
-  --node_remaining_current_page_;
+  bool found = false;
+  int64_t bucket_idx = Probe(buckets_, num_buckets_, ht_ctx, hash, &found);
+  if (UNLIKELY(bucket_idx == Iterator::BUCKET_NOT_FOUND)) return NULL;
+  Bucket* bucket = &buckets_[bucket_idx];
+  if (found) {
+    // The key already has a bucket; add the row as a duplicate.
+    DuplicateNode* node = InsertDuplicateNode(bucket);
+    if (UNLIKELY(node == NULL)) return NULL;
+    ++num_nodes_;
+    return &node->htdata;
+  }
+  bucket->filled = true;
+  bucket->matched = false;
+  bucket->has_duplicates = false;
+  bucket->hash = hash;
+  ++num_filled_buckets_;
   ++num_nodes_;
-  return next_node_++;
+  return &bucket->bucket_data.htdata;
 }
 
-inline void HashTable::AddToBucket(Bucket* bucket, Node* node) {
-  num_filled_buckets_ += (bucket->node == NULL);
-  node->next = bucket->node;
-  bucket->node = node;
+inline HashTable::DuplicateNode* HashTable::InsertDuplicateNode(Bucket* bucket) {
+  DCHECK(bucket->filled);
+  if (!bucket->has_duplicates) {
+    // Convert the bucket: its entry moves into the first duplicate node so the
+    // bucket can hold the head of the list instead.
+    DuplicateNode* head = AllocDuplicateNode();
+    if (UNLIKELY(head == NULL)) return NULL;
+    head->matched = bucket->matched;
+    head->next = NULL;
+    head->htdata = bucket->bucket_data.htdata;
+    bucket->bucket_data.duplicates = head;
+    bucket->has_duplicates = true;
+    bucket->matched = false;
+  }
+  DuplicateNode* node = AllocDuplicateNode();
+  if (UNLIKELY(node == NULL)) return NULL;
+  node->matched = false;
+  node->next = bucket->bucket_data.duplicates;
+  bucket->bucket_data.duplicates = node;
+  return node;
 }
 
-inline void HashTable::MoveNode(Bucket* from_bucket, Bucket* to_bucket,
-    Node* node, Node* previous_node) {
-  if (previous_node != NULL) {
-    previous_node->next = node->next;
-  } else {
-    // Update bucket directly
-    from_bucket->node = node->next;
-    num_filled_buckets_ -= (node->next == NULL);
+inline HashTable::DuplicateNode* HashTable::AllocDuplicateNode() {
+  if (UNLIKELY(node_remaining_current_page_ == 0)) {
+    if (!GrowNodeArray()) return NULL;
   }
-  AddToBucket(to_bucket, node);
+  --node_remaining_current_page_;
+  return next_node_++;
 }
 
 template<bool check_match>
 inline void HashTable::Iterator::Next(HashTableCtx* ht_ctx) {
-  if (bucket_idx_ == -1) return;
-  DCHECK_NOTNULL(ht_ctx);
+  if (AtEnd()) return;
 
-  // TODO: this should prefetch the next tuplerow
-  // Iterator is not from a full table scan, evaluate equality now.  Only the current
-  // bucket needs to be scanned. 'expr_values_buffer_' contains the results
-  // for the current probe row.
   if (check_match) {
-    // TODO: this should prefetch the next node
-    Node* node = node_->next;
-    while (node != NULL) {
-      if (node->hash == scan_hash_ &&
-          ht_ctx->Equals(table_->GetRow(node, ht_ctx->row_))) {
-        node_ = node;
-        return;
-      }
-      node = node->next;
+    // Iterator came from a Find(). All rows with the key live in this bucket: a
+    // single-row bucket has no further matches, a duplicate bucket's matches are
+    // the remainder of its list. Rows that merely collide on the probe sequence
+    // occupy other buckets and never match.
+    if (node_ == NULL || node_->next == NULL) {
+      reset();
+    } else {
+      node_ = node_->next;
     }
-    *this = table_->End();
   } else {
-    // Move onto the next chained node
-    if (node_->next != NULL) {
+    // Full table scan: exhaust the current bucket's duplicates, then move on to the
+    // next filled bucket.
+    Bucket* bucket = &table_->buckets_[bucket_idx_];
+    if (bucket->has_duplicates && node_->next != NULL) {
       node_ = node_->next;
       return;
     }
-
-    // Move onto the next bucket
-    Bucket* bucket = table_->NextBucket(&bucket_idx_);
+    bucket = table_->NextBucket(&bucket_idx_);
     if (bucket == NULL) {
-      bucket_idx_ = -1;
       node_ = NULL;
     } else {
-      node_ = bucket->node;
+      node_ = bucket->has_duplicates ? bucket->bucket_data.duplicates : NULL;
     }
   }
 }
 
 inline bool HashTable::Iterator::NextUnmatched() {
-  if (bucket_idx_ == -1) return false;
-  while (true) {
-    while (node_->next != NULL && node_->next->matched) {
-      node_ = node_->next;
-    }
-    if (node_->next == NULL) {
-      // Move onto the next bucket.
-      Bucket* bucket = table_->NextBucket(&bucket_idx_);
-      if (bucket == NULL) {
-        bucket_idx_ = -1;
-        node_ = NULL;
-        return false;
-      } else {
-        node_ = bucket->node;
-        if (node_ != NULL && !node_->matched) return true;
-      }
-    } else {
-      DCHECK(!node_->next->matched);
-      node_ = node_->next;
-      return true;
-    }
-  }
+  if (AtEnd()) return false;
+  do {
+    Next<false>(NULL);
+  } while (!AtEnd() && matched());
+  return !AtEnd();
 }
 
 inline void HashTableCtx::set_level(int level) {
@@ -47,6 +47,7 @@ jmethodID HBaseTableScanner::scan_set_filter_id_ = NULL;
 jmethodID HBaseTableScanner::scan_set_start_row_id_ = NULL;
 jmethodID HBaseTableScanner::scan_set_stop_row_id_ = NULL;
 jmethodID HBaseTableScanner::resultscanner_next_id_ = NULL;
+jmethodID HBaseTableScanner::resultscanner_next_num_rows_id_ = NULL;
 jmethodID HBaseTableScanner::resultscanner_close_id_ = NULL;
 jmethodID HBaseTableScanner::result_isempty_id_ = NULL;
 jmethodID HBaseTableScanner::result_raw_cells_id_ = NULL;
@@ -90,6 +91,9 @@ HBaseTableScanner::HBaseTableScanner(
     resultscanner_(NULL),
     cells_(NULL),
     cell_index_(0),
+    result_batch_(NULL),
+    num_results_(0),
+    result_index_(0),
     num_requested_cells_(0),
     num_addl_requested_cols_(0),
     num_cells_(0),
@@ -191,6 +195,9 @@ Status HBaseTableScanner::Init() {
   resultscanner_next_id_ = env->GetMethodID(resultscanner_cl_, "next",
       "()Lorg/apache/hadoop/hbase/client/Result;");
   RETURN_ERROR_IF_EXC(env);
+  resultscanner_next_num_rows_id_ = env->GetMethodID(resultscanner_cl_, "next",
+      "(I)[Lorg/apache/hadoop/hbase/client/Result;");
+  RETURN_ERROR_IF_EXC(env);
   resultscanner_close_id_ = env->GetMethodID(resultscanner_cl_, "close", "()V");
   RETURN_ERROR_IF_EXC(env);
 
@@ -504,31 +511,53 @@ Status HBaseTableScanner::Next(JNIEnv* env, bool* has_next) {
   {
     SCOPED_TIMER(scan_node_->read_timer());
     while (true) {
-      DCHECK(resultscanner_ != NULL);
-      // result_ = resultscanner_.next();
-      result = env->CallObjectMethod(resultscanner_, resultscanner_next_id_);
-      // Normally we would check for a JNI exception via RETURN_ERROR_IF_EXC, but we
-      // need to also check for scanner timeouts and handle them specially, which is
-      // done by HandleResultScannerTimeout(). If a timeout occurred, then it will
-      // re-create the ResultScanner so we can try again.
-      bool timeout;
-      RETURN_IF_ERROR(HandleResultScannerTimeout(env, &timeout));
-      if (timeout) {
-        result = env->CallObjectMethod(resultscanner_, resultscanner_next_id_);
-        // There shouldn't be a timeout now, so we will just return any errors.
-        RETURN_ERROR_IF_EXC(env);
-      }
-      // jump to the next region when finished with the current region.
-      if (result == NULL && current_scan_range_idx_ + 1 < scan_range_vector_->size()) {
-        ++current_scan_range_idx_;
-        RETURN_IF_ERROR(InitScanRange(env,
-            (*scan_range_vector_)[current_scan_range_idx_]));
-        continue;
+      if (result_index_ >= num_results_) {
+        DCHECK(resultscanner_ != NULL);
+        // result_batch = resultscanner_.next(rows_cached_);
+        // Fetching a whole batch of results per call amortizes the JNI crossing
+        // overhead; the rows are served from the client-side cache filled by the
+        // scanner RPC, so this does not cause extra server round trips.
+        jobjectArray result_batch = reinterpret_cast<jobjectArray>(
+            env->CallObjectMethod(resultscanner_, resultscanner_next_num_rows_id_,
+                rows_cached_));
+        // Normally we would check for a JNI exception via RETURN_ERROR_IF_EXC, but we
+        // need to also check for scanner timeouts and handle them specially, which is
+        // done by HandleResultScannerTimeout(). If a timeout occurred, then it will
+        // re-create the ResultScanner so we can try again.
+        bool timeout;
+        RETURN_IF_ERROR(HandleResultScannerTimeout(env, &timeout));
+        if (timeout) {
+          result_batch = reinterpret_cast<jobjectArray>(
+              env->CallObjectMethod(resultscanner_, resultscanner_next_num_rows_id_,
+                  rows_cached_));
+          // There shouldn't be a timeout now, so we will just return any errors.
+          RETURN_ERROR_IF_EXC(env);
+        }
+        if (result_batch_ != NULL) {
+          env->DeleteGlobalRef(result_batch_);
+          result_batch_ = NULL;
+        }
+        num_results_ = result_batch == NULL ? 0 : env->GetArrayLength(result_batch);
+        result_index_ = 0;
+        if (num_results_ == 0) {
+          // jump to the next region when finished with the current region.
+          if (current_scan_range_idx_ + 1 < scan_range_vector_->size()) {
+            ++current_scan_range_idx_;
+            RETURN_IF_ERROR(InitScanRange(env,
+                (*scan_range_vector_)[current_scan_range_idx_]));
+            continue;
+          }
+          result = NULL;
+          break;
+        }
+        result_batch_ = reinterpret_cast<jobjectArray>(env->NewGlobalRef(result_batch));
       }
 
+      result = env->GetObjectArrayElement(result_batch_, result_index_);
+      ++result_index_;
+
       // Ignore empty rows
-      if (result != NULL &&
-          JNI_TRUE == env->CallBooleanMethod(result, result_isempty_id_)) {
+      if (JNI_TRUE == env->CallBooleanMethod(result, result_isempty_id_)) {
         continue;
       }
       break;
@@ -737,6 +766,7 @@ void HBaseTableScanner::Close(JNIEnv* env) {
     resultscanner_ = NULL;
   }
   if (scan_ != NULL) env->DeleteGlobalRef(scan_);
+  if (result_batch_ != NULL) env->DeleteGlobalRef(result_batch_);
   if (cells_ != NULL) env->DeleteGlobalRef(cells_);
 
   // Close the HTable so that the connections are not kept around.
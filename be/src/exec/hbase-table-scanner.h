@@ -169,6 +169,7 @@ class HBaseTableScanner {
   static jmethodID scan_set_start_row_id_;
   static jmethodID scan_set_stop_row_id_;
   static jmethodID resultscanner_next_id_;
+  static jmethodID resultscanner_next_num_rows_id_;
   static jmethodID resultscanner_close_id_;
   static jmethodID result_isempty_id_;
   static jmethodID result_raw_cells_id_;
@@ -215,6 +216,20 @@ class HBaseTableScanner {
   // Current position in cells_. Incremented in NextValue(). Reset in Next().
   int cell_index_;
 
+  // Result[] returned by the last resultscanner_.next(int) call, kept as a global
+  // reference so it survives across Next() calls. Fetching up to rows_cached_ results
+  // per call amortizes the JNI crossing overhead over the whole batch instead of
+  // paying it once per row; the rows are already sitting in the client-side cache
+  // filled by the scanner RPC (Scan.setCaching()), so no extra server round trips
+  // result. NULL until the first batch has been fetched.
+  jobjectArray result_batch_;
+
+  // Number of results in result_batch_.
+  int num_results_;
+
+  // Current position in result_batch_. Incremented in Next().
+  int result_index_;
+
   // Number of requested cells (i.e., the number of added family/qualifier pairs).
   // Set in StartScan().
   int num_requested_cells_;
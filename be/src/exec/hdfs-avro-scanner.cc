@@ -495,6 +495,7 @@ Status HdfsAvroScanner::InitNewRange() {
   only_parsing_header_ = false;
   avro_header_ = reinterpret_cast<AvroFileHeader*>(header_);
   template_tuple_ = avro_header_->template_tuple;
+  BuildDecodePlan();
   if (header_->is_compressed) {
     RETURN_IF_ERROR(UpdateDecompressor(header_->compression_type));
   }
@@ -582,65 +583,111 @@ Status HdfsAvroScanner::ProcessRange() {
   return Status::OK;
 }
 
-void HdfsAvroScanner::MaterializeTuple(MemPool* pool, uint8_t** data, Tuple* tuple) {
+void HdfsAvroScanner::BuildDecodePlan() {
+  decode_plan_.clear();
+  decode_plan_.reserve(avro_header_->schema.size());
   BOOST_FOREACH(const SchemaElement& element, avro_header_->schema) {
-    const SlotDescriptor* slot_desc = element.slot_desc;
-    bool write_slot = false;
-    void* slot = NULL;
-    PrimitiveType slot_type = INVALID_TYPE;
-    if (slot_desc != NULL) {
-      write_slot = true;
-      slot = tuple->GetSlot(slot_desc->tuple_offset());
-      slot_type = slot_desc->type().type;
-    }
+    AvroDecodeElement e;
+    e.null_union_position = element.null_union_position;
+    e.slot_desc = element.slot_desc;
+    e.tuple_offset = element.slot_desc != NULL ? element.slot_desc->tuple_offset() : -1;
+    e.slot_type =
+        element.slot_desc != NULL ? element.slot_desc->type().type : INVALID_TYPE;
+    e.len = 0;
 
     avro_type_t type = element.schema->type;
-    if (element.null_union_position != -1
-        && !ReadUnionType(element.null_union_position, data)) {
-      type = AVRO_NULL;
-    }
-
     switch (type) {
       case AVRO_NULL:
-        if (slot_desc != NULL) tuple->SetNull(slot_desc->null_indicator_offset());
+        e.action = AvroDecodeElement::NULL_FIELD;
         break;
       case AVRO_BOOLEAN:
-        ReadAvroBoolean(slot_type, data, write_slot, slot, pool);
+        e.action = AvroDecodeElement::READ_BOOLEAN;
         break;
       case AVRO_INT32:
-        ReadAvroInt32(slot_type, data, write_slot, slot, pool);
+        e.action = AvroDecodeElement::READ_INT32;
         break;
       case AVRO_INT64:
-        ReadAvroInt64(slot_type, data, write_slot, slot, pool);
+        e.action = AvroDecodeElement::READ_INT64;
         break;
       case AVRO_FLOAT:
-        ReadAvroFloat(slot_type, data, write_slot, slot, pool);
+        e.action = AvroDecodeElement::READ_FLOAT;
         break;
       case AVRO_DOUBLE:
-        ReadAvroDouble(slot_type, data, write_slot, slot, pool);
+        e.action = AvroDecodeElement::READ_DOUBLE;
         break;
       case AVRO_STRING:
       case AVRO_BYTES:
-        if (slot_desc != NULL && slot_desc->type().type == TYPE_VARCHAR) {
-          ReadAvroVarchar(slot_type, slot_desc->type().len, data, write_slot, slot, pool);
-        } else if (slot_desc != NULL && slot_desc->type().type == TYPE_CHAR) {
-          ReadAvroChar(slot_type, slot_desc->type().len, data, write_slot, slot, pool);
+        if (e.slot_type == TYPE_VARCHAR) {
+          e.action = AvroDecodeElement::READ_VARCHAR;
+          e.len = element.slot_desc->type().len;
+        } else if (e.slot_type == TYPE_CHAR) {
+          e.action = AvroDecodeElement::READ_CHAR;
+          e.len = element.slot_desc->type().len;
         } else {
-          ReadAvroString(slot_type, data, write_slot, slot, pool);
+          e.action = AvroDecodeElement::READ_STRING;
         }
         break;
-      case AVRO_DECIMAL: {
-        int slot_byte_size = 0;
-        if (slot_desc != NULL) {
-          DCHECK_EQ(slot_type, TYPE_DECIMAL);
-          slot_byte_size = slot_desc->type().GetByteSize();
+      case AVRO_DECIMAL:
+        e.action = AvroDecodeElement::READ_DECIMAL;
+        if (element.slot_desc != NULL) {
+          DCHECK_EQ(e.slot_type, TYPE_DECIMAL);
+          e.len = element.slot_desc->type().GetByteSize();
         }
-        ReadAvroDecimal(slot_byte_size, data, write_slot, slot, pool);
         break;
-      }
       default:
         DCHECK(false) << "Unsupported SchemaElement: " << type;
     }
+    decode_plan_.push_back(e);
+  }
+}
+
+void HdfsAvroScanner::MaterializeTuple(MemPool* pool, uint8_t** data, Tuple* tuple) {
+  DCHECK_EQ(decode_plan_.size(), avro_header_->schema.size());
+  for (int i = 0; i < decode_plan_.size(); ++i) {
+    const AvroDecodeElement& e = decode_plan_[i];
+    bool write_slot = e.slot_desc != NULL;
+    void* slot = write_slot ? tuple->GetSlot(e.tuple_offset) : NULL;
+
+    AvroDecodeElement::Action action = e.action;
+    if (e.null_union_position != -1
+        && !ReadUnionType(e.null_union_position, data)) {
+      action = AvroDecodeElement::NULL_FIELD;
+    }
+
+    switch (action) {
+      case AvroDecodeElement::NULL_FIELD:
+        if (write_slot) tuple->SetNull(e.slot_desc->null_indicator_offset());
+        break;
+      case AvroDecodeElement::READ_BOOLEAN:
+        ReadAvroBoolean(e.slot_type, data, write_slot, slot, pool);
+        break;
+      case AvroDecodeElement::READ_INT32:
+        ReadAvroInt32(e.slot_type, data, write_slot, slot, pool);
+        break;
+      case AvroDecodeElement::READ_INT64:
+        ReadAvroInt64(e.slot_type, data, write_slot, slot, pool);
+        break;
+      case AvroDecodeElement::READ_FLOAT:
+        ReadAvroFloat(e.slot_type, data, write_slot, slot, pool);
+        break;
+      case AvroDecodeElement::READ_DOUBLE:
+        ReadAvroDouble(e.slot_type, data, write_slot, slot, pool);
+        break;
+      case AvroDecodeElement::READ_VARCHAR:
+        ReadAvroVarchar(e.slot_type, e.len, data, write_slot, slot, pool);
+        break;
+      case AvroDecodeElement::READ_CHAR:
+        ReadAvroChar(e.slot_type, e.len, data, write_slot, slot, pool);
+        break;
+      case AvroDecodeElement::READ_STRING:
+        ReadAvroString(e.slot_type, data, write_slot, slot, pool);
+        break;
+      case AvroDecodeElement::READ_DECIMAL:
+        ReadAvroDecimal(e.len, data, write_slot, slot, pool);
+        break;
+      default:
+        DCHECK(false) << "Unsupported decode action: " << action;
+    }
   }
 }
 
@@ -203,6 +203,53 @@ class HdfsAvroScanner : public BaseSequenceScanner {
   // Materializes a single tuple from serialized record data.
   void MaterializeTuple(MemPool* pool, uint8_t** data, Tuple* tuple);
 
+  // A field of the file schema flattened into a pre-resolved decode instruction.
+  // Built by BuildDecodePlan() and consumed by MaterializeTuple().
+  struct AvroDecodeElement {
+    // Which Read function to invoke for this field. Strings are pre-resolved to the
+    // VARCHAR/CHAR/STRING variants so the per-record loop is a single dispatch.
+    enum Action {
+      READ_BOOLEAN,
+      READ_INT32,
+      READ_INT64,
+      READ_FLOAT,
+      READ_DOUBLE,
+      READ_VARCHAR,
+      READ_CHAR,
+      READ_STRING,
+      READ_DECIMAL,
+      NULL_FIELD
+    };
+
+    Action action;
+
+    // Copied from SchemaElement::null_union_position.
+    int null_union_position;
+
+    // NULL if this field is not materialized.
+    const SlotDescriptor* slot_desc;
+
+    // slot_desc->tuple_offset(), or -1 if slot_desc is NULL.
+    int tuple_offset;
+
+    // slot_desc->type().type, or INVALID_TYPE if slot_desc is NULL.
+    PrimitiveType slot_type;
+
+    // Length for READ_VARCHAR/READ_CHAR, the slot byte size for READ_DECIMAL,
+    // 0 otherwise.
+    int len;
+  };
+
+  // Decode instructions for the fields of the file schema, pre-resolved from
+  // avro_header_->schema so the schema-resolution branches (slot lookup, string and
+  // decimal type dispatch) are hoisted out of the per-record loop on the interpreted
+  // path. The codegen'd MaterializeTuple() bakes the same decisions into the
+  // generated code instead. Rebuilt in InitNewRange() for each file.
+  std::vector<AvroDecodeElement> decode_plan_;
+
+  // Populates decode_plan_ from avro_header_->schema.
+  void BuildDecodePlan();
+
   // Produces a version of DecodeAvroData that uses codegen'd instead of interpreted
   // functions.
   static llvm::Function* CodegenDecodeAvroData(
@@ -24,6 +24,7 @@
 #include "exec/exec-node.h"
 #include "util/compress.h"
 #include "util/hdfs-util.h"
+#include "util/parallel-compress.h"
 #include "util/uid-util.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
@@ -45,6 +46,10 @@ const THdfsCompression::type AVRO_DEFAULT_CODEC = THdfsCompression::SNAPPY;
 // Desired size of each Avro block (bytes); actual block size will vary +/- the
 // size of a row. This is approximate size of the block before compression.
 const int DEFAULT_AVRO_BLOCK_SIZE = 64 * 1024;
+// Number of encoded blocks to accumulate before compressing them as one parallel
+// batch. Bounds the extra memory held in pending_blocks_ to roughly this many
+// uncompressed Avro blocks.
+const int MAX_PENDING_COMPRESSION_BLOCKS = 8;
 
 HdfsAvroTableWriter::HdfsAvroTableWriter(HdfsTableSink* parent,
     RuntimeState* state, OutputPartition* output,
@@ -59,6 +64,11 @@ void HdfsAvroTableWriter::ConsumeRow(TupleRow* row) {
   ++unflushed_rows_;
   int num_non_partition_cols =
       table_desc_->num_cols() - table_desc_->num_clustering_cols();
+  // Reserve the fixed-size part of the row up front so the per-field reservations in
+  // AppendField() almost always hit their fast path. Per field: a union tag plus at
+  // most a zig-zag long or 16 decimal bytes.
+  out_.Reserve(
+      num_non_partition_cols * (2 * ReadWriteUtil::MAX_ZLONG_LEN + 16));
   for (int j = 0; j < num_non_partition_cols; ++j) {
     void* value = output_expr_ctxs_[j]->GetValue(row);
     AppendField(output_expr_ctxs_[j]->root()->type(), value);
@@ -71,53 +81,59 @@ inline void HdfsAvroTableWriter::AppendField(const ColumnType& type, const void*
   // a union of [ColumnType, NULL].
   // TODO check if we want to support [NULL, ColumnType] union
 
+  // Covers the union tag plus the largest fixed-size encoding; string data reserves
+  // its own space below. A no-op unless an earlier string field ate into the row's
+  // up-front reservation.
+  out_.Reserve(2 * ReadWriteUtil::MAX_ZLONG_LEN + 16);
+
   if (value == NULL) {
     // indicate the second field of the union
-    out_.WriteZLong(1);
+    out_.WriteZLongUnchecked(1);
     // No bytes are written for a null value.
     return;
   }
 
   // indicate that we are using the first field of the union
-  out_.WriteZLong(0);
+  out_.WriteZLongUnchecked(0);
 
   switch (type.type) {
     case TYPE_BOOLEAN:
-      out_.WriteByte(*reinterpret_cast<const char*>(value));
+      out_.WriteByteUnchecked(*reinterpret_cast<const char*>(value));
       break;
     case TYPE_TINYINT:
-      out_.WriteZInt(*reinterpret_cast<const int8_t*>(value));
+      out_.WriteZIntUnchecked(*reinterpret_cast<const int8_t*>(value));
       break;
     case TYPE_SMALLINT:
-      out_.WriteZInt(*reinterpret_cast<const int16_t*>(value));
+      out_.WriteZIntUnchecked(*reinterpret_cast<const int16_t*>(value));
       break;
     case TYPE_INT:
-      out_.WriteZInt(*reinterpret_cast<const int32_t*>(value));
+      out_.WriteZIntUnchecked(*reinterpret_cast<const int32_t*>(value));
       break;
     case TYPE_BIGINT:
-      out_.WriteZLong(*reinterpret_cast<const int64_t*>(value));
+      out_.WriteZLongUnchecked(*reinterpret_cast<const int64_t*>(value));
       break;
     case TYPE_FLOAT:
-      out_.WriteBytes(4, reinterpret_cast<const char*>(value));
+      out_.WriteBytesUnchecked(4, reinterpret_cast<const char*>(value));
       break;
     case TYPE_DOUBLE:
-      out_.WriteBytes(8, reinterpret_cast<const char*>(value));
+      out_.WriteBytesUnchecked(8, reinterpret_cast<const char*>(value));
       break;
     case TYPE_STRING: {
       const StringValue& sv = *reinterpret_cast<const StringValue*>(value);
-      out_.WriteZLong(sv.len);
-      out_.WriteBytes(sv.len, sv.ptr);
+      out_.WriteZLongUnchecked(sv.len);
+      out_.Reserve(sv.len);
+      out_.WriteBytesUnchecked(sv.len, sv.ptr);
       break;
     }
     case TYPE_DECIMAL: {
       int byte_size = ColumnType::GetDecimalByteSize(type.precision);
-      out_.WriteZLong(byte_size);
+      out_.WriteZLongUnchecked(byte_size);
 #if __BYTE_ORDER == __LITTLE_ENDIAN
       char tmp[16];
       BitUtil::ByteSwap(tmp, value, byte_size);
-      out_.WriteBytes(byte_size, tmp);
+      out_.WriteBytesUnchecked(byte_size, tmp);
 #else
-      out_.WriteBytes(byte_size, reinterpret_cast<const char*>(value));
+      out_.WriteBytesUnchecked(byte_size, reinterpret_cast<const char*>(value));
 #endif
       break;
     }
@@ -141,7 +157,7 @@ Status HdfsAvroTableWriter::Init() {
     codec = state_->query_options().compression_codec;
   }
 
-  // sets codec_name_ and compressor_
+  // sets codec_name_ and codec_type_
   codec_type_ = codec;
   switch (codec) {
     case THdfsCompression::SNAPPY:
@@ -159,8 +175,12 @@ Status HdfsAvroTableWriter::Init() {
           "Avro only supports NONE, DEFLATE, and SNAPPY codecs; unsupported codec $0",
           name));
   }
-  RETURN_IF_ERROR(Codec::CreateCompressor(mem_pool_.get(), true, codec, &compressor_));
-  DCHECK(compressor_.get() != NULL);
+  // Validate the codec here so an unsupported codec fails at Init() time. The
+  // compression itself is done by ParallelCompressor, which creates one codec per
+  // worker thread.
+  scoped_ptr<Codec> compressor;
+  RETURN_IF_ERROR(Codec::CreateCompressor(mem_pool_.get(), true, codec, &compressor));
+  DCHECK(compressor.get() != NULL);
 
   return Status::OK;
 }
@@ -185,7 +205,7 @@ Status HdfsAvroTableWriter::AppendRowBatch(RowBatch* batch,
     }
   }
 
-  if (out_.Size() > DEFAULT_AVRO_BLOCK_SIZE) Flush();
+  if (out_.Size() > DEFAULT_AVRO_BLOCK_SIZE) RETURN_IF_ERROR(Flush(false));
   *new_file = false;
   return Status::OK;
 }
@@ -223,62 +243,86 @@ Status HdfsAvroTableWriter::WriteFileHeader() {
   return Status::OK;
 }
 
-Status HdfsAvroTableWriter::Flush() {
-  if (unflushed_rows_ == 0) return Status::OK;
-
-  WriteStream header;
-  // 1. Count of objects in this block
-  header.WriteZLong(unflushed_rows_);
+Status HdfsAvroTableWriter::Flush(bool write_all_blocks) {
+  if (unflushed_rows_ > 0) {
+    // Seal the current block and queue it behind any earlier pending blocks.
+    pending_blocks_.push_back(PendingBlock());
+    pending_blocks_.back().data = out_.String();
+    pending_blocks_.back().num_rows = unflushed_rows_;
+    out_.Clear();
+    unflushed_rows_ = 0;
+  }
+  if (pending_blocks_.empty()) return Status::OK;
 
-  const uint8_t* output;
-  int64_t output_length;
-  // Snappy format requires a CRC after the compressed data
-  uint32_t crc;
-  const string& text = out_.String();
+  // With compression enabled, defer the (comparatively expensive) compression step
+  // until several blocks have accumulated so that they can be compressed in parallel.
+  if (codec_type_ != THdfsCompression::NONE && !write_all_blocks &&
+      pending_blocks_.size() < MAX_PENDING_COMPRESSION_BLOCKS) {
+    return Status::OK;
+  }
 
+  vector<ParallelCompressor::Block> blocks(pending_blocks_.size());
   if (codec_type_ != THdfsCompression::NONE) {
-    SCOPED_TIMER(parent_->compress_timer());
-    uint8_t* temp;
-    RETURN_IF_ERROR(compressor_->ProcessBlock(false, text.size(),
-        reinterpret_cast<const uint8_t*>(text.data()), &output_length, &temp));
-    output = temp;
-    if (codec_type_ == THdfsCompression::SNAPPY) {
-      crc = SnappyCompressor::ComputeChecksum(
-          text.size(), reinterpret_cast<const uint8_t*>(text.data()));
+    for (int i = 0; i < pending_blocks_.size(); ++i) {
+      blocks[i].input = reinterpret_cast<const uint8_t*>(pending_blocks_[i].data.data());
+      blocks[i].input_len = pending_blocks_[i].data.size();
     }
-  } else {
-    output = reinterpret_cast<const uint8_t*>(text.data());
-    output_length = out_.Size();
+    SCOPED_TIMER(parent_->compress_timer());
+    RETURN_IF_ERROR(ParallelCompressor::CompressBlocks(
+        state_->resource_pool(), codec_type_, mem_pool_.get(), &blocks));
   }
 
-  // 2. length of serialized objects
-  if (codec_type_ == THdfsCompression::SNAPPY) {
-    // + 4 for the CRC checksum at the end of the compressed block
-    header.WriteZLong(output_length + 4);
-  } else {
-    header.WriteZLong(output_length);
-  }
+  for (int i = 0; i < pending_blocks_.size(); ++i) {
+    const string& text = pending_blocks_[i].data;
+    const uint8_t* output;
+    int64_t output_length;
+    // Snappy format requires a CRC after the compressed data
+    uint32_t crc;
+    if (codec_type_ != THdfsCompression::NONE) {
+      output = blocks[i].output;
+      output_length = blocks[i].output_len;
+      if (codec_type_ == THdfsCompression::SNAPPY) {
+        crc = SnappyCompressor::ComputeChecksum(
+            text.size(), reinterpret_cast<const uint8_t*>(text.data()));
+      }
+    } else {
+      output = reinterpret_cast<const uint8_t*>(text.data());
+      output_length = text.size();
+    }
 
-  const string& head = header.String();
-  {
-    SCOPED_TIMER(parent_->hdfs_write_timer());
-    // Flush (1) and (2) to HDFS
-    RETURN_IF_ERROR(
-        Write(reinterpret_cast<const uint8_t*>(head.data()), head.size()));
-    // 3. serialized objects
-    RETURN_IF_ERROR(Write(output, output_length));
-
-    // Write CRC checksum
+    WriteStream header;
+    // 1. Count of objects in this block
+    header.WriteZLong(pending_blocks_[i].num_rows);
+    // 2. length of serialized objects
     if (codec_type_ == THdfsCompression::SNAPPY) {
-      RETURN_IF_ERROR(Write(reinterpret_cast<const uint8_t*>(&crc), sizeof(uint32_t)));
+      // + 4 for the CRC checksum at the end of the compressed block
+      header.WriteZLong(output_length + 4);
+    } else {
+      header.WriteZLong(output_length);
     }
-  }
 
-  // 4. sync marker
-  RETURN_IF_ERROR(
-      Write(reinterpret_cast<const uint8_t*>(sync_marker_.data()), sync_marker_.size()));
+    const string& head = header.String();
+    {
+      SCOPED_TIMER(parent_->hdfs_write_timer());
+      // Flush (1) and (2) to HDFS
+      RETURN_IF_ERROR(
+          Write(reinterpret_cast<const uint8_t*>(head.data()), head.size()));
+      // 3. serialized objects
+      RETURN_IF_ERROR(Write(output, output_length));
+
+      // Write CRC checksum
+      if (codec_type_ == THdfsCompression::SNAPPY) {
+        RETURN_IF_ERROR(Write(reinterpret_cast<const uint8_t*>(&crc), sizeof(uint32_t)));
+      }
+    }
 
-  out_.Clear();
-  unflushed_rows_ = 0;
+    // 4. sync marker
+    RETURN_IF_ERROR(Write(
+        reinterpret_cast<const uint8_t*>(sync_marker_.data()), sync_marker_.size()));
+  }
+
+  pending_blocks_.clear();
+  // Keep the compressed-output chunks around for reuse by the next batch.
+  mem_pool_->Clear();
   return Status::OK;
 }
@@ -64,7 +64,7 @@ class HdfsAvroTableWriter : public HdfsTableWriter {
   virtual ~HdfsAvroTableWriter() { }
 
   virtual Status Init();
-  virtual Status Finalize() { return Flush(); }
+  virtual Status Finalize() { return Flush(true); }
   virtual Status InitNewFile() { return WriteFileHeader(); }
   virtual void Close() { mem_pool_->FreeAll(); }
   virtual uint64_t default_block_size() const { return 0; }
@@ -86,13 +86,29 @@ class HdfsAvroTableWriter : public HdfsTableWriter {
   // Writes the Avro file header to HDFS
   Status WriteFileHeader();
 
-  // Writes the contents of out_ to HDFS as a single Avro file block.
+  // Seals the contents of out_ into a pending Avro file block. Pending blocks are
+  // buffered so that several of them can be compressed in parallel, then written to
+  // HDFS in order. If 'write_all_blocks' is true (or no compression is in use), all
+  // pending blocks are written out before returning; otherwise writing may be
+  // deferred until enough blocks have accumulated.
   // Returns an error if write to HDFS fails.
-  Status Flush();
+  Status Flush(bool write_all_blocks);
+
+  // An avro file block that has been encoded but not yet compressed or written.
+  struct PendingBlock {
+    // Uncompressed block contents.
+    std::string data;
+
+    // Number of rows encoded in 'data'.
+    uint64_t num_rows;
+  };
 
   // Buffer which holds accumulated output
   WriteStream out_;
 
+  // Encoded blocks waiting to be compressed and written, in row order.
+  std::vector<PendingBlock> pending_blocks_;
+
   // Memory pool used by codec to allocate output buffer.
   // Owned by this class. Initialized using parent's memtracker.
   boost::scoped_ptr<MemPool> mem_pool_;
@@ -106,9 +122,6 @@ class HdfsAvroTableWriter : public HdfsTableWriter {
   // Type of the codec, will be NONE if no compression is used
   THdfsCompression::type codec_type_;
 
-  // The codec for compressing, only set if codec_type_ != NONE
-  boost::scoped_ptr<Codec> compressor_;
-
   // 16 byte sync marker (a uuid)
   std::string sync_marker_;
 };
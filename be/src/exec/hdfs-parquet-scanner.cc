@@ -14,9 +14,11 @@
 
 #include "exec/hdfs-parquet-scanner.h"
 
+#include <math.h>
 #include <limits> // for std::numeric_limits
 
 #include <boost/algorithm/string.hpp>
+#include <boost/scoped_array.hpp>
 #include <gflags/gflags.h>
 #include <gutil/strings/substitute.h>
 
@@ -26,15 +28,18 @@
 #include "exec/scanner-context.inline.h"
 #include "exec/read-write-util.h"
 #include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
 #include "runtime/descriptors.h"
 #include "runtime/runtime-state.h"
+#include "runtime/thread-resource-mgr.h"
 #include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
 #include "runtime/tuple-row.h"
 #include "runtime/tuple.h"
 #include "runtime/string-value.h"
-#include "util/bitmap.h"
+#include "util/bloom-filter.h"
 #include "util/bit-util.h"
 #include "util/decompress.h"
 #include "util/debug-util.h"
@@ -42,6 +47,7 @@
 #include "util/dict-encoding.h"
 #include "util/rle-encoding.h"
 #include "util/runtime-profile.h"
+#include "util/thread.h"
 #include "rpc/thrift-util.h"
 
 using namespace std;
@@ -55,6 +61,25 @@ DEFINE_bool(convert_legacy_hive_parquet_utc_timestamps, false,
     "When true, TIMESTAMPs read from files written by Parquet-MR (used by Hive) will "
     "be converted from UTC to local time. Writes are unaffected.");
 
+DEFINE_bool(parquet_read_statistics, true,
+    "When true, the parquet scanner skips whole row groups based on the min/max "
+    "statistics in the file metadata when they prove that no row can satisfy the "
+    "scan conjuncts.");
+
+DEFINE_bool(parquet_parallel_column_reads, true,
+    "When true, the parquet scanner reads and decompresses the first pages of the "
+    "columns in a row group in parallel using any optional thread tokens available "
+    "from the scan node.");
+
+DEFINE_bool(parquet_dictionary_filtering, true,
+    "When true, conjuncts bound to a single string column are evaluated once against "
+    "the dictionary page of a column chunk, and rows are filtered by dictionary code "
+    "before the string value is materialized.");
+
+DEFINE_bool(parquet_batch_decode, true,
+    "When true, parquet column readers decode definition levels and values in batches "
+    "directly into tuple memory instead of one value per column per row.");
+
 // Max data page header size in bytes. This is an estimate and only needs to be an upper
 // bound. It is theoretically possible to have a page header of any size due to string
 // value statistics, but in practice we'll have trouble reading string values this large.
@@ -123,8 +148,8 @@ namespace impala {
 HdfsParquetScanner::HdfsParquetScanner(HdfsScanNode* scan_node, RuntimeState* state)
     : HdfsScanner(scan_node, state),
       metadata_range_(NULL),
-      dictionary_pool_(new MemPool(scan_node->mem_tracker())),
-      assemble_rows_timer_(scan_node_->materialize_tuple_timer()) {
+      assemble_rows_timer_(scan_node_->materialize_tuple_timer()),
+      dict_filter_tuple_(NULL) {
   assemble_rows_timer_.Stop();
 }
 
@@ -185,6 +210,24 @@ class HdfsParquetScanner::BaseColumnReader {
   // are currently dense so we'll need to figure out something there.
   bool ReadValue(MemPool* pool, Tuple* tuple, bool* conjuncts_failed);
 
+  // Batched version of ReadValue(). Decodes up to 'max_values' definition levels into
+  // a contiguous scratch buffer in a tight loop, then materializes the corresponding
+  // values into tuple memory starting at 'tuple_mem' with a stride of 'tuple_size'
+  // bytes. 'conjuncts_failed' points to an array of 'max_values' flags with the same
+  // semantics as in ReadValue(). Does not read across data page boundaries; returns
+  // the number of values materialized, or 0 if this column has no more values or an
+  // error occurred (in which case parent_->parse_status_ is set).
+  int ReadValueBatch(MemPool* pool, int max_values, int tuple_size, uint8_t* tuple_mem,
+      bool* conjuncts_failed);
+
+  // Decodes the plain-encoded statistics value 'encoded' (e.g. the min or max of a
+  // column chunk from the file metadata) into 'slot', which must have room for a value
+  // of this column's type. Returns false if the value could not be decoded, in which
+  // case the statistics must be ignored.
+  virtual bool DecodeStatsValue(const std::string& encoded, void* slot) {
+    return false;
+  }
+
   // TODO: Some encodings might benefit a lot from a SkipValues(int num_rows) if
   // we know this row can be skipped. This could be very useful with stats and big
   // sections can be skipped. Implement that when we can benefit from it.
@@ -202,6 +245,11 @@ class HdfsParquetScanner::BaseColumnReader {
   // Pool to allocate decompression buffers from.
   boost::scoped_ptr<MemPool> decompressed_data_pool_;
 
+  // Pool to copy the dictionary page buffer into. Per column (rather than per
+  // scanner) so columns can read their pages concurrently. Shared across all the
+  // pages in a column chunk; attached to the final row batch in Close().
+  boost::scoped_ptr<MemPool> dictionary_pool_;
+
   // Header for current data page.
   parquet::PageHeader current_page_header_;
 
@@ -222,18 +270,18 @@ class HdfsParquetScanner::BaseColumnReader {
   // The number of values seen so far. Updated per data page.
   int64_t num_values_read_;
 
-  // Cache of the bitmap_filter_ (if any) for this slot.
-  const Bitmap* bitmap_filter_;
-  // Cache of hash_seed_ to use with bitmap_filter_.
+  // Cache of the bloom_filter_ (if any) for this slot.
+  const BloomFilter* bloom_filter_;
+  // Cache of hash_seed_ to use with bloom_filter_.
   uint32_t hash_seed_;
 
-  // Bitmap filters are optional (i.e. they can be ignored and the results will be
+  // Bloom filters are optional (i.e. they can be ignored and the results will be
   // correct). Keep track of stats to determine if the filter is not effective. If
   // the number of rows filtered out is too low, this is not worth the cost.
   // TODO: this should be cost based taking into account how much we save when we
   // filter a row.
   int64_t rows_returned_;
-  int64_t bitmap_filter_rows_rejected_;
+  int64_t bloom_filter_rows_rejected_;
 
   BaseColumnReader(HdfsParquetScanner* parent, const SchemaNode& node)
     : parent_(parent),
@@ -241,6 +289,7 @@ class HdfsParquetScanner::BaseColumnReader {
       metadata_(NULL),
       stream_(NULL),
       decompressed_data_pool_(new MemPool(parent->scan_node_->mem_tracker())),
+      dictionary_pool_(new MemPool(parent->scan_node_->mem_tracker())),
       num_buffered_values_(0),
       num_values_read_(0) {
     DCHECK_NOTNULL(node.slot_desc);
@@ -248,16 +297,27 @@ class HdfsParquetScanner::BaseColumnReader {
     DCHECK_GE(node.max_def_level, 0);
 
     RuntimeState* state = parent_->scan_node_->runtime_state();
-    bitmap_filter_ = state->GetBitmapFilter(slot_desc()->id());
+    bloom_filter_ = state->GetBloomFilter(slot_desc()->id());
     hash_seed_ = state->fragment_hash_seed();
     rows_returned_ = 0;
-    bitmap_filter_rows_rejected_ = 0;
+    bloom_filter_rows_rejected_ = 0;
   }
 
   // Read the next data page.  If a dictionary page is encountered, that will
   // be read and this function will continue reading for the next data page.
+  // Only touches per-column state, so different columns can read pages
+  // concurrently; the caller is responsible for attaching the memory of completed
+  // pages (decompressed_data_pool_) to the current row batch beforehand.
   Status ReadDataPage();
 
+  // Reads (and decompresses) the dictionary page and first data page of this column
+  // chunk if no page is buffered yet. Called from the warm-up threads in
+  // ReadFirstPagesParallel().
+  Status ReadFirstPage() {
+    if (num_buffered_values_ > 0 || num_values_read_ > 0) return Status::OK;
+    return ReadDataPage();
+  }
+
   // Returns the definition level for the next value
   // Returns -1 if there was a error parsing it.
   int ReadDefinitionLevel();
@@ -276,6 +336,18 @@ class HdfsParquetScanner::BaseColumnReader {
   // Subclass must implement this.
   // TODO: we need to remove this with codegen.
   virtual bool ReadSlot(void* slot, MemPool* pool, bool* conjuncts_failed) = 0;
+
+  // Materializes 'num_values' values whose definition levels have already been decoded
+  // into 'def_levels' (see ReadValueBatch()). 'def_levels' may be NULL, indicating
+  // every value in the batch is present (non-NULL); subclasses skip the per-value
+  // null test entirely in that case. Implemented by the subclass so the inner loop
+  // runs without virtual dispatch per value. Returns false on error.
+  virtual bool MaterializeValueBatch(MemPool* pool, int num_values,
+      const uint8_t* def_levels, int tuple_size, uint8_t* tuple_mem,
+      bool* conjuncts_failed) = 0;
+
+  // Scratch buffer for batch-decoded definition levels (ReadValueBatch()).
+  std::vector<uint8_t> def_level_buffer_;
 };
 
 // Per column type reader.
@@ -292,6 +364,9 @@ class HdfsParquetScanner::ColumnReader : public HdfsParquetScanner::BaseColumnRe
     } else {
       fixed_len_size_ = -1;
     }
+    dict_filter_enabled_ = false;
+    dict_code_matches_any_ = true;
+    dict_filter_rejects_page_ = false;
     needs_conversion_ = slot_desc()->type().type == TYPE_CHAR ||
         // TODO: Add logic to detect file versions that have unconverted TIMESTAMP
         // values. Currently all versions have converted values.
@@ -304,23 +379,26 @@ class HdfsParquetScanner::ColumnReader : public HdfsParquetScanner::BaseColumnRe
   virtual void CreateDictionaryDecoder(uint8_t* values, int size) {
     dict_decoder_.reset(new DictDecoder<T>(values, size, fixed_len_size_));
     dict_decoder_base_ = dict_decoder_.get();
+    InitDictionaryFilter();
   }
 
   virtual Status InitDataPage(uint8_t* data, int size) {
+    dict_filter_rejects_page_ = false;
     if (current_page_header_.data_page_header.encoding ==
           parquet::Encoding::PLAIN_DICTIONARY) {
       if (dict_decoder_.get() == NULL) {
         return Status("File corrupt. Missing dictionary page.");
       }
       dict_decoder_->SetData(data, size);
+      dict_filter_rejects_page_ = dict_filter_enabled_ && !dict_code_matches_any_;
     }
 
-    // Check if we should disable the bitmap filter. We'll do this if the filter
+    // Check if we should disable the bloom filter. We'll do this if the filter
     // is not removing a lot of rows.
     // TODO: how to pick the selectivity?
-    if (bitmap_filter_ != NULL && rows_returned_ > 10000 &&
-        bitmap_filter_rows_rejected_ < rows_returned_ * .1) {
-      bitmap_filter_ = NULL;
+    if (bloom_filter_ != NULL && rows_returned_ > 10000 &&
+        bloom_filter_rows_rejected_ < rows_returned_ * .1) {
+      bloom_filter_ = NULL;
     }
     return Status::OK;
   }
@@ -332,26 +410,114 @@ class HdfsParquetScanner::ColumnReader : public HdfsParquetScanner::BaseColumnRe
     T val;
     T* val_ptr = needs_conversion_ ? &val : reinterpret_cast<T*>(slot);
     if (page_encoding == parquet::Encoding::PLAIN_DICTIONARY) {
-      result = dict_decoder_->GetValue(val_ptr);
+      if (dict_filter_enabled_) {
+        if (dict_filter_rejects_page_) {
+          // No dictionary entry in this page can satisfy the conjuncts, so reject
+          // the row without decoding its code. This is safe because every non-NULL
+          // value in the page takes this path, leaving the index stream untouched
+          // until the next page resets the decoder.
+          *conjuncts_failed = true;
+          ++rows_returned_;
+          return true;
+        }
+        int index;
+        result = dict_decoder_->GetNextIndex(&index);
+        if (result && !dict_code_matches_[index]) {
+          // No value with this code can satisfy the conjuncts on this slot; filter
+          // the row on the code alone without materializing the value.
+          *conjuncts_failed = true;
+          ++rows_returned_;
+          return true;
+        }
+        if (result) *val_ptr = dict_decoder_->value(index);
+      } else {
+        result = dict_decoder_->GetValue(val_ptr);
+      }
     } else {
       DCHECK(page_encoding == parquet::Encoding::PLAIN);
       data_ += ParquetPlainEncoder::Decode<T>(data_, fixed_len_size_, val_ptr);
     }
     if (needs_conversion_) ConvertSlot(&val, reinterpret_cast<T*>(slot), pool);
     ++rows_returned_;
-    if (!*conjuncts_failed && bitmap_filter_ != NULL) {
+    if (!*conjuncts_failed && bloom_filter_ != NULL) {
       uint32_t h = RawValue::GetHashValue(slot, slot_desc()->type(), hash_seed_);
-      *conjuncts_failed = !bitmap_filter_->Get<true>(h);
-      ++bitmap_filter_rows_rejected_;
+      *conjuncts_failed = !bloom_filter_->Find(h);
+      ++bloom_filter_rows_rejected_;
     }
     return result;
   }
 
+  virtual bool DecodeStatsValue(const std::string& encoded, void* slot) {
+    int byte_size = ParquetPlainEncoder::ByteSize(slot_desc()->type());
+    if (byte_size < 0 || static_cast<int>(encoded.size()) < byte_size) return false;
+    ParquetPlainEncoder::Decode<T>(
+        reinterpret_cast<uint8_t*>(const_cast<char*>(encoded.data())),
+        fixed_len_size_, reinterpret_cast<T*>(slot));
+    return true;
+  }
+
+  virtual bool MaterializeValueBatch(MemPool* pool, int num_values,
+      const uint8_t* def_levels, int tuple_size, uint8_t* tuple_mem,
+      bool* conjuncts_failed) {
+    if (def_levels == NULL) {
+      // The entire batch is non-null: no per-value level test needed.
+      for (int i = 0; i < num_values; ++i) {
+        Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size);
+        if (!ColumnReader<T>::ReadSlot(tuple->GetSlot(slot_desc()->tuple_offset()),
+            pool, &conjuncts_failed[i])) {
+          return false;
+        }
+      }
+      return true;
+    }
+    for (int i = 0; i < num_values; ++i) {
+      Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size);
+      if (def_levels[i] != max_def_level()) {
+        DCHECK_LT(def_levels[i], max_def_level());
+        tuple->SetNull(slot_desc()->null_indicator_offset());
+        continue;
+      }
+      // Qualified call to avoid the per-value virtual dispatch of the row-at-a-time
+      // path.
+      if (!ColumnReader<T>::ReadSlot(tuple->GetSlot(slot_desc()->tuple_offset()), pool,
+          &conjuncts_failed[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
  private:
   void CopySlot(T* slot, MemPool* pool) {
     // no-op for non-string columns.
   }
 
+  // Evaluates the conjuncts bound to this column's slot against each dictionary entry
+  // and builds the bitmap of matching codes (dict_code_matches_). Called when the
+  // dictionary page is decoded; a no-op unless this slot has eligible conjuncts.
+  void InitDictionaryFilter() {
+    dict_filter_enabled_ = false;
+    if (needs_conversion_) return;
+    const vector<ExprContext*>* ctxs = parent_->DictFilterConjuncts(slot_desc()->id());
+    if (ctxs == NULL) return;
+    int num_entries = dict_decoder_->num_entries();
+    if (num_entries == 0) return;
+
+    dict_code_matches_.assign(num_entries, false);
+    dict_code_matches_any_ = false;
+    Tuple* tuple = parent_->dict_filter_tuple_;
+    DCHECK_NOTNULL(tuple);
+    TupleRow* row = reinterpret_cast<TupleRow*>(parent_->dict_filter_row_.get());
+    row->SetTuple(parent_->scan_node_->tuple_idx(), tuple);
+    for (int i = 0; i < num_entries; ++i) {
+      RawValue::Write(&dict_decoder_->value(i), tuple, slot_desc(), NULL);
+      dict_code_matches_[i] =
+          ExecNode::EvalConjuncts(&(*ctxs)[0], ctxs->size(), row);
+      dict_code_matches_any_ |= dict_code_matches_[i];
+    }
+    dict_filter_enabled_ = true;
+  }
+
   // Converts and writes src into dst based on desc_->type()
   void ConvertSlot(const T* src, T* dst, MemPool* pool) {
     DCHECK(false);
@@ -359,6 +525,23 @@ class HdfsParquetScanner::ColumnReader : public HdfsParquetScanner::BaseColumnRe
 
   scoped_ptr<DictDecoder<T> > dict_decoder_;
 
+  // If true, dict_code_matches_ is valid for the current dictionary and rows can be
+  // filtered by dictionary code in ReadSlot().
+  bool dict_filter_enabled_;
+
+  // dict_code_matches_[i] is true iff dictionary entry i can satisfy the conjuncts
+  // bound to this slot. Only valid when dict_filter_enabled_ is true.
+  std::vector<bool> dict_code_matches_;
+
+  // True if any entry of dict_code_matches_ is set. Only valid when
+  // dict_filter_enabled_ is true.
+  bool dict_code_matches_any_;
+
+  // True if the current data page is dictionary-encoded and no dictionary entry
+  // satisfies the conjuncts bound to this slot, i.e. every non-NULL value in the
+  // page can be rejected without decoding its code. Reset per page.
+  bool dict_filter_rejects_page_;
+
   // true decoded values must be converted before being written to an output tuple
   bool needs_conversion_;
 
@@ -395,6 +578,18 @@ void HdfsParquetScanner::ColumnReader<StringValue>::ConvertSlot(
   if (slot_desc()->type().IsVarLen()) *dst = sv;
 }
 
+template<>
+bool HdfsParquetScanner::ColumnReader<StringValue>::DecodeStatsValue(
+    const string& encoded, void* slot) {
+  // For BYTE_ARRAY columns the statistics are stored as the raw bytes without a
+  // length prefix. The StringValue can reference the metadata directly since the
+  // metadata outlives the row group.
+  StringValue* val = reinterpret_cast<StringValue*>(slot);
+  val->ptr = const_cast<char*>(encoded.data());
+  val->len = encoded.size();
+  return true;
+}
+
 template<>
 void HdfsParquetScanner::ColumnReader<TimestampValue>::ConvertSlot(
     const TimestampValue* src, TimestampValue* dst, MemPool* pool) {
@@ -429,6 +624,35 @@ class HdfsParquetScanner::BoolColumnReader : public HdfsParquetScanner::BaseColu
     return valid;
   }
 
+  virtual bool MaterializeValueBatch(MemPool* pool, int num_values,
+      const uint8_t* def_levels, int tuple_size, uint8_t* tuple_mem,
+      bool* conjuncts_failed) {
+    if (def_levels == NULL) {
+      // The entire batch is non-null: no per-value level test needed.
+      for (int i = 0; i < num_values; ++i) {
+        Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size);
+        if (!BoolColumnReader::ReadSlot(tuple->GetSlot(slot_desc()->tuple_offset()),
+            pool, &conjuncts_failed[i])) {
+          return false;
+        }
+      }
+      return true;
+    }
+    for (int i = 0; i < num_values; ++i) {
+      Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size);
+      if (def_levels[i] != max_def_level()) {
+        DCHECK_LT(def_levels[i], max_def_level());
+        tuple->SetNull(slot_desc()->null_indicator_offset());
+        continue;
+      }
+      if (!BoolColumnReader::ReadSlot(tuple->GetSlot(slot_desc()->tuple_offset()), pool,
+          &conjuncts_failed[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
  private:
   BitReader bool_values_;
 };
@@ -439,11 +663,113 @@ Status HdfsParquetScanner::Prepare(ScannerContext* context) {
   RETURN_IF_ERROR(HdfsScanner::Prepare(context));
   num_cols_counter_ =
       ADD_COUNTER(scan_node_->runtime_profile(), "NumColumns", TUnit::UNIT);
+  num_stats_filtered_row_groups_counter_ = ADD_COUNTER(
+      scan_node_->runtime_profile(), "NumStatsFilteredRowGroups", TUnit::UNIT);
+  if (FLAGS_parquet_read_statistics) CollectStatsConjuncts();
+  if (FLAGS_parquet_dictionary_filtering) CollectDictFilterConjuncts();
 
   scan_node_->IncNumScannersCodegenDisabled();
   return Status::OK;
 }
 
+void HdfsParquetScanner::CollectDictFilterConjuncts() {
+  DCHECK(dict_filter_conjuncts_map_.empty());
+  for (int i = 0; i < conjunct_ctxs_.size(); ++i) {
+    vector<SlotId> slot_ids;
+    if (conjunct_ctxs_[i]->root()->GetSlotIds(&slot_ids) != 1) continue;
+
+    // Only filter on string slots: the dictionary values for other types either go
+    // through a conversion on materialization (e.g. CHAR) or are cheap to compare
+    // anyway.
+    SlotDescriptor* slot_desc = NULL;
+    for (int j = 0; j < scan_node_->materialized_slots().size(); ++j) {
+      if (scan_node_->materialized_slots()[j]->id() == slot_ids[0]) {
+        slot_desc = scan_node_->materialized_slots()[j];
+        break;
+      }
+    }
+    if (slot_desc == NULL) continue;
+    if (slot_desc->type().type != TYPE_STRING &&
+        slot_desc->type().type != TYPE_VARCHAR) {
+      continue;
+    }
+    dict_filter_conjuncts_map_[slot_ids[0]].push_back(conjunct_ctxs_[i]);
+  }
+
+  if (!dict_filter_conjuncts_map_.empty()) {
+    dict_filter_tuple_ = scan_node_->InitEmptyTemplateTuple();
+    dict_filter_row_.reset(new Tuple*[scan_node_->tuple_idx() + 1]);
+  }
+}
+
+void HdfsParquetScanner::CollectStatsConjuncts() {
+  DCHECK(stats_conjuncts_.empty());
+  for (int i = 0; i < conjunct_ctxs_.size(); ++i) {
+    Expr* conjunct = conjunct_ctxs_[i]->root();
+    if (conjunct->GetNumChildren() != 2) continue;
+    Expr* slot = conjunct->GetChild(0);
+    Expr* constant = conjunct->GetChild(1);
+    bool flipped = false;
+    if (!slot->is_slotref()) {
+      std::swap(slot, constant);
+      flipped = true;
+    }
+    if (!slot->is_slotref() || !constant->IsConstant()) continue;
+
+    const string& fn_name = conjunct->fn().name.function_name;
+    StatsConjunct::Op op;
+    if (fn_name == "lt") {
+      op = StatsConjunct::LT;
+    } else if (fn_name == "le") {
+      op = StatsConjunct::LE;
+    } else if (fn_name == "gt") {
+      op = StatsConjunct::GT;
+    } else if (fn_name == "ge") {
+      op = StatsConjunct::GE;
+    } else if (fn_name == "eq") {
+      op = StatsConjunct::EQ;
+    } else {
+      continue;
+    }
+    if (flipped) {
+      // '<constant> <op> <slot>' is equivalent to '<slot> <flipped op> <constant>'.
+      switch (op) {
+        case StatsConjunct::LT: op = StatsConjunct::GT; break;
+        case StatsConjunct::LE: op = StatsConjunct::GE; break;
+        case StatsConjunct::GT: op = StatsConjunct::LT; break;
+        case StatsConjunct::GE: op = StatsConjunct::LE; break;
+        case StatsConjunct::EQ: break;
+      }
+    }
+
+    // Restrict pruning to the types whose plain-encoded statistics we can decode and
+    // compare with RawValue::Compare(). Timestamps are excluded because INT96
+    // statistics have no well-defined ordering, bools and chars because they are not
+    // plain encoded in the same representation as the slot.
+    switch (slot->type().type) {
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT:
+      case TYPE_FLOAT:
+      case TYPE_DOUBLE:
+      case TYPE_STRING:
+      case TYPE_DECIMAL:
+        break;
+      default:
+        continue;
+    }
+    if (!(slot->type() == constant->type())) continue;
+
+    StatsConjunct stats_conjunct;
+    stats_conjunct.slot_id = static_cast<const SlotRef*>(slot)->slot_id();
+    stats_conjunct.op = op;
+    stats_conjunct.ctx = conjunct_ctxs_[i];
+    stats_conjunct.constant_expr = constant;
+    stats_conjuncts_.push_back(stats_conjunct);
+  }
+}
+
 void HdfsParquetScanner::Close() {
   vector<THdfsCompression::type> compression_types;
   for (int i = 0; i < column_readers_.size(); ++i) {
@@ -452,10 +778,10 @@ void HdfsParquetScanner::Close() {
       // since AddFinalRowBatch() already does below.
       AttachPool(column_readers_[i]->decompressed_data_pool_.get(), false);
     }
+    AttachPool(column_readers_[i]->dictionary_pool_.get(), false);
     column_readers_[i]->Close();
     compression_types.push_back(column_readers_[i]->codec());
   }
-  AttachPool(dictionary_pool_.get(), false);
   AddFinalRowBatch();
 
   // If this was a metadata only read (i.e. count(*)), there are no columns.
@@ -531,10 +857,6 @@ Status HdfsParquetScanner::BaseColumnReader::ReadDataPage() {
   Status status;
   uint8_t* buffer;
 
-  // We're about to move to the next data page.  The previous data page is
-  // now complete, pass along the memory allocated for it.
-  parent_->AttachPool(decompressed_data_pool_.get(), false);
-
   // Read the next data page, skipping page types we don't care about.
   // We break out of this loop on the non-error case (a data page was found or we read all
   // the pages).
@@ -627,7 +949,7 @@ Status HdfsParquetScanner::BaseColumnReader::ReadDataPage() {
 
       uint8_t* dict_values = NULL;
       if (decompressor_.get() != NULL) {
-        dict_values = parent_->dictionary_pool_->Allocate(uncompressed_size);
+        dict_values = dictionary_pool_->Allocate(uncompressed_size);
         RETURN_IF_ERROR(decompressor_->ProcessBlock32(true, data_size, data_,
             &uncompressed_size, &dict_values));
         VLOG_FILE << "Decompressed " << data_size << " to " << uncompressed_size;
@@ -636,7 +958,7 @@ Status HdfsParquetScanner::BaseColumnReader::ReadDataPage() {
         DCHECK_EQ(data_size, current_page_header_.uncompressed_page_size);
         // Copy dictionary from io buffer (which will be recycled as we read
         // more data) to a new buffer
-        dict_values = parent_->dictionary_pool_->Allocate(data_size);
+        dict_values = dictionary_pool_->Allocate(data_size);
         memcpy(dict_values, data_, data_size);
       }
 
@@ -743,6 +1065,8 @@ inline bool HdfsParquetScanner::BaseColumnReader::ReadValue(
     MemPool* pool, Tuple* tuple, bool* conjuncts_failed) {
   if (num_buffered_values_ == 0) {
     parent_->assemble_rows_timer_.Stop();
+    // The previous data page is complete; pass along the memory allocated for it.
+    parent_->AttachPool(decompressed_data_pool_.get(), false);
     parent_->parse_status_ = ReadDataPage();
     // We don't return Status objects as parameters because they are too
     // expensive for per row/per col calls.  If ReadDataPage failed,
@@ -764,6 +1088,176 @@ inline bool HdfsParquetScanner::BaseColumnReader::ReadValue(
   return ReadSlot(tuple->GetSlot(slot_desc()->tuple_offset()), pool, conjuncts_failed);
 }
 
+int HdfsParquetScanner::BaseColumnReader::ReadValueBatch(MemPool* pool, int max_values,
+    int tuple_size, uint8_t* tuple_mem, bool* conjuncts_failed) {
+  if (num_buffered_values_ == 0) {
+    parent_->assemble_rows_timer_.Stop();
+    // The previous data page is complete; pass along the memory allocated for it.
+    parent_->AttachPool(decompressed_data_pool_.get(), false);
+    parent_->parse_status_ = ReadDataPage();
+    if (num_buffered_values_ == 0 || !parent_->parse_status_.ok()) return 0;
+    parent_->assemble_rows_timer_.Start();
+  }
+
+  int num_values = ::min(num_buffered_values_, max_values);
+  if (def_level_buffer_.size() < num_values) def_level_buffer_.resize(num_values);
+  uint8_t* def_levels = &def_level_buffer_[0];
+
+  // Decode the definition levels for the whole batch before materializing any values
+  // so the level decode loop runs tight.
+  if (max_def_level() == 0) {
+    // This column and any containing structs are required so there is nothing encoded
+    // for the definition levels: every value is present.
+    def_levels = NULL;
+  } else {
+    bool valid = true;
+    switch (current_page_header_.data_page_header.definition_level_encoding) {
+      case parquet::Encoding::RLE:
+        valid = rle_def_levels_.GetValues(num_values, def_levels) == num_values;
+        break;
+      case parquet::Encoding::BIT_PACKED:
+        valid = bit_packed_def_levels_.GetValues(1, num_values, def_levels) == num_values;
+        break;
+      default:
+        DCHECK(false);
+        valid = false;
+    }
+    if (!valid) {
+      parent_->parse_status_ = Status("Could not decode definition levels.");
+      return 0;
+    }
+    // Mostly non-null columns decode to one long run of max_def_level(). Detect that
+    // here (this loop vectorizes to word-at-a-time compares) and drop the levels so
+    // MaterializeValueBatch() skips the per-value null test for the whole batch.
+    bool all_non_null = true;
+    for (int i = 0; i < num_values; ++i) {
+      all_non_null &= (def_levels[i] == max_def_level());
+    }
+    if (all_non_null) def_levels = NULL;
+  }
+
+  if (!MaterializeValueBatch(pool, num_values, def_levels, tuple_size, tuple_mem,
+      conjuncts_failed)) {
+    return 0;
+  }
+  num_buffered_values_ -= num_values;
+  return num_values;
+}
+
+// Returns a pointer to the native (in-memory row format) representation of the
+// constant value 'val' of type 'type', using 'storage' (at least 16 bytes) as
+// backing memory where a conversion is needed. Returns NULL for unsupported types.
+static const void* ConstantValToNative(const ColumnType& type, impala_udf::AnyVal* val,
+    uint8_t* storage) {
+  switch (type.type) {
+    case TYPE_TINYINT:
+      return &static_cast<impala_udf::TinyIntVal*>(val)->val;
+    case TYPE_SMALLINT:
+      return &static_cast<impala_udf::SmallIntVal*>(val)->val;
+    case TYPE_INT:
+      return &static_cast<impala_udf::IntVal*>(val)->val;
+    case TYPE_BIGINT:
+      return &static_cast<impala_udf::BigIntVal*>(val)->val;
+    case TYPE_FLOAT:
+      return &static_cast<impala_udf::FloatVal*>(val)->val;
+    case TYPE_DOUBLE:
+      return &static_cast<impala_udf::DoubleVal*>(val)->val;
+    case TYPE_STRING: {
+      impala_udf::StringVal* string_val = static_cast<impala_udf::StringVal*>(val);
+      StringValue* native = reinterpret_cast<StringValue*>(storage);
+      native->ptr = reinterpret_cast<char*>(string_val->ptr);
+      native->len = string_val->len;
+      return native;
+    }
+    case TYPE_DECIMAL: {
+      impala_udf::DecimalVal* decimal_val = static_cast<impala_udf::DecimalVal*>(val);
+      switch (type.GetByteSize()) {
+        case 4:
+          *reinterpret_cast<Decimal4Value*>(storage) = Decimal4Value(decimal_val->val4);
+          return storage;
+        case 8:
+          *reinterpret_cast<Decimal8Value*>(storage) = Decimal8Value(decimal_val->val8);
+          return storage;
+        case 16:
+          *reinterpret_cast<Decimal16Value*>(storage) =
+              Decimal16Value(decimal_val->val16);
+          return storage;
+      }
+      return NULL;
+    }
+    default:
+      return NULL;
+  }
+}
+
+bool HdfsParquetScanner::EvalRowGroupStats(int row_group_idx) {
+  if (stats_conjuncts_.empty()) return false;
+  const parquet::RowGroup& row_group = file_metadata_.row_groups[row_group_idx];
+
+  for (int i = 0; i < column_readers_.size(); ++i) {
+    BaseColumnReader* reader = column_readers_[i];
+    const parquet::ColumnChunk& col_chunk = row_group.columns[reader->col_idx()];
+    if (!col_chunk.meta_data.__isset.statistics) continue;
+    const parquet::Statistics& stats = col_chunk.meta_data.statistics;
+    if (!stats.__isset.min || !stats.__isset.max) continue;
+
+    const ColumnType& col_type = reader->slot_desc()->type();
+    // Old versions of parquet-mr wrote incorrect statistics (based on unsigned/lexical
+    // comparison) for byte arrays and decimals, so only trust those written by Impala.
+    if ((col_type.IsStringType() || col_type.type == TYPE_DECIMAL) &&
+        file_version_.application != "impala") {
+      continue;
+    }
+
+    for (int j = 0; j < stats_conjuncts_.size(); ++j) {
+      const StatsConjunct& conjunct = stats_conjuncts_[j];
+      if (conjunct.slot_id != reader->slot_desc()->id()) continue;
+
+      impala_udf::AnyVal* constant_val =
+          conjunct.constant_expr->GetConstVal(conjunct.ctx);
+      if (constant_val == NULL || constant_val->is_null) continue;
+      uint8_t val_storage[16];
+      const void* val = ConstantValToNative(col_type, constant_val, val_storage);
+      if (val == NULL) continue;
+
+      uint8_t min_buffer[16];
+      uint8_t max_buffer[16];
+      if (!reader->DecodeStatsValue(stats.min, min_buffer)) continue;
+      if (!reader->DecodeStatsValue(stats.max, max_buffer)) continue;
+      // Old versions of parquet-mr propagate NaN into float/double min/max, so the
+      // range says nothing about the group's other values. NaN also sorts below
+      // everything in RawValue::Compare(), so pruning on it would skip row groups
+      // that contain matching rows.
+      if (col_type.type == TYPE_FLOAT &&
+          (isnan(*reinterpret_cast<float*>(min_buffer)) ||
+           isnan(*reinterpret_cast<float*>(max_buffer)))) {
+        continue;
+      }
+      if (col_type.type == TYPE_DOUBLE &&
+          (isnan(*reinterpret_cast<double*>(min_buffer)) ||
+           isnan(*reinterpret_cast<double*>(max_buffer)))) {
+        continue;
+      }
+      int cmp_min = RawValue::Compare(min_buffer, val, col_type);
+      int cmp_max = RawValue::Compare(max_buffer, val, col_type);
+
+      bool prune = false;
+      switch (conjunct.op) {
+        case StatsConjunct::LT: prune = cmp_min >= 0; break;
+        case StatsConjunct::LE: prune = cmp_min > 0; break;
+        case StatsConjunct::GT: prune = cmp_max <= 0; break;
+        case StatsConjunct::GE: prune = cmp_max < 0; break;
+        case StatsConjunct::EQ: prune = cmp_min > 0 || cmp_max < 0; break;
+      }
+      if (prune) {
+        COUNTER_ADD(num_stats_filtered_row_groups_counter_, 1);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 Status HdfsParquetScanner::ProcessSplit() {
   // First process the file metadata in the footer
   bool eosr;
@@ -791,13 +1285,55 @@ Status HdfsParquetScanner::ProcessSplit() {
     // Commit the rows to flush the row batch from the previous row group
     CommitRows(0);
 
+    // Skip the row group entirely (no column reads are issued) if the row group
+    // statistics prove that no row can satisfy the conjuncts.
+    if (FLAGS_parquet_read_statistics && EvalRowGroupStats(i)) continue;
+
     RETURN_IF_ERROR(InitColumns(i));
-    RETURN_IF_ERROR(AssembleRows(i));
+    if (FLAGS_parquet_parallel_column_reads) RETURN_IF_ERROR(ReadFirstPagesParallel());
+    if (FLAGS_parquet_batch_decode && !column_readers_.empty()) {
+      RETURN_IF_ERROR(AssembleRowsBatched(i));
+    } else {
+      RETURN_IF_ERROR(AssembleRows(i));
+    }
+  }
+
+  return Status::OK;
+}
+
+Status HdfsParquetScanner::ReadFirstPagesParallel() {
+  int num_readers = column_readers_.size();
+  if (num_readers <= 1) return Status::OK;
+
+  ThreadResourceMgr::ResourcePool* pool = state_->resource_pool();
+  vector<Status> statuses(num_readers);
+  ThreadGroup warmup_threads;
+  int num_tokens = 0;
+
+  // Hand off as many columns as we can get optional tokens for; the remaining
+  // columns are read lazily by AssembleRows() as before.
+  for (int i = 1; i < num_readers; ++i) {
+    if (!pool->TryAcquireThreadToken()) break;
+    ++num_tokens;
+    stringstream ss;
+    ss << "parquet-column-warmup(" << i << ")";
+    warmup_threads.AddThread(new Thread("hdfs-parquet-scanner", ss.str(),
+        &HdfsParquetScanner::WarmUpColumn, this, column_readers_[i], &statuses[i]));
   }
 
+  // Read the first column's pages on this thread while the helpers run.
+  statuses[0] = column_readers_[0]->ReadFirstPage();
+  warmup_threads.JoinAll();
+  for (int i = 0; i < num_tokens; ++i) pool->ReleaseThreadToken(false);
+
+  for (int i = 0; i < num_readers; ++i) RETURN_IF_ERROR(statuses[i]);
   return Status::OK;
 }
 
+void HdfsParquetScanner::WarmUpColumn(BaseColumnReader* reader, Status* status) {
+  *status = reader->ReadFirstPage();
+}
+
 // TODO: this needs to be codegen'd.  The ReadValue function needs to be codegen'd,
 // specific to type and encoding and then inlined into AssembleRows().
 Status HdfsParquetScanner::AssembleRows(int row_group_idx) {
@@ -911,6 +1447,107 @@ Status HdfsParquetScanner::AssembleRows(int row_group_idx) {
   return parse_status_;
 }
 
+Status HdfsParquetScanner::AssembleRowsBatched(int row_group_idx) {
+  assemble_rows_timer_.Start();
+  int64_t expected_rows_in_group = file_metadata_.row_groups[row_group_idx].num_rows;
+  int64_t rows_read = 0;
+  int num_column_readers = column_readers_.size();
+  DCHECK_GT(num_column_readers, 0);
+  MemPool* pool;
+
+  scoped_array<bool> conjuncts_failed(new bool[BATCH_DECODE_SIZE]);
+
+  while (!scan_node_->ReachedLimit() && !context_->cancelled() &&
+      rows_read < expected_rows_in_group) {
+    Tuple* tuple;
+    TupleRow* row;
+    int64_t max_tuples = static_cast<int64_t>(GetMemory(&pool, &tuple, &row));
+    int64_t num_rows = ::min(expected_rows_in_group - rows_read,
+        ::min(max_tuples, static_cast<int64_t>(BATCH_DECODE_SIZE)));
+    DCHECK_GT(num_rows, 0);
+
+    uint8_t* tuple_mem = reinterpret_cast<uint8_t*>(tuple);
+    for (int i = 0; i < num_rows; ++i) {
+      InitTuple(template_tuple_,
+          reinterpret_cast<Tuple*>(tuple_mem + i * tuple_byte_size_));
+    }
+    memset(conjuncts_failed.get(), 0, num_rows * sizeof(bool));
+
+    // Materialize the batch column by column. A column may cross a data page boundary
+    // within the batch, so loop until this column has produced all 'num_rows' values.
+    for (int c = 0; c < num_column_readers; ++c) {
+      BaseColumnReader* reader = column_readers_[c];
+      int num_materialized = 0;
+      while (num_materialized < num_rows) {
+        int n = reader->ReadValueBatch(pool, num_rows - num_materialized,
+            tuple_byte_size_, tuple_mem + num_materialized * tuple_byte_size_,
+            conjuncts_failed.get() + num_materialized);
+        if (n == 0) {
+          // This column is complete and has no more data. For correctly formed files,
+          // this should be the first column we are reading.
+          assemble_rows_timer_.Stop();
+          DCHECK(c == 0 || !parse_status_.ok())
+            << "c=" << c << " " << parse_status_.GetDetail();
+          COUNTER_ADD(scan_node_->rows_read_counter(), num_materialized);
+          rows_read += num_materialized;
+          if (rows_read != expected_rows_in_group) {
+            DCHECK_NOTNULL(reader->stream_);
+            ErrorMsg msg(TErrorCode::PARQUET_GROUP_ROW_COUNT_ERROR,
+                reader->stream_->filename(), row_group_idx,
+                expected_rows_in_group, rows_read);
+            LOG_OR_RETURN_ON_ERROR(msg, scan_node_->runtime_state());
+          }
+          return parse_status_;
+        }
+        num_materialized += n;
+      }
+    }
+
+    // Evaluate conjuncts over the batch, compacting surviving tuples so CommitRows()
+    // sees a dense batch.
+    int num_to_commit = 0;
+    for (int i = 0; i < num_rows; ++i) {
+      if (conjuncts_failed[i]) continue;
+      Tuple* src = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_byte_size_);
+      row->SetTuple(scan_node_->tuple_idx(), src);
+      if (!EvalConjuncts(row)) continue;
+      if (num_to_commit != i) {
+        Tuple* dst =
+            reinterpret_cast<Tuple*>(tuple_mem + num_to_commit * tuple_byte_size_);
+        memcpy(dst, src, tuple_byte_size_);
+        row->SetTuple(scan_node_->tuple_idx(), dst);
+      }
+      row = next_row(row);
+      ++num_to_commit;
+    }
+
+    rows_read += num_rows;
+    COUNTER_ADD(scan_node_->rows_read_counter(), num_rows);
+    RETURN_IF_ERROR(CommitRows(num_to_commit));
+  }
+
+  if (!scan_node_->ReachedLimit() && !context_->cancelled() &&
+      rows_read == expected_rows_in_group) {
+    // We have read as many rows as the metadata told us we should read. Attempt to
+    // read one more row and if that succeeds report the error.
+    uint8_t dummy_tuple_mem[tuple_byte_size_];
+    Tuple* dummy_tuple = reinterpret_cast<Tuple*>(&dummy_tuple_mem);
+    InitTuple(template_tuple_, dummy_tuple);
+    bool conjuncts_failed_value = false;
+    if (column_readers_[0]->ReadValue(pool, dummy_tuple, &conjuncts_failed_value)) {
+      HdfsParquetScanner::BaseColumnReader* reader = column_readers_[0];
+      DCHECK_NOTNULL(reader->stream_);
+      ErrorMsg msg(TErrorCode::PARQUET_GROUP_ROW_COUNT_OVERFLOW,
+          reader->stream_->filename(), row_group_idx,
+          expected_rows_in_group);
+      LOG_OR_RETURN_ON_ERROR(msg, scan_node_->runtime_state());
+    }
+  }
+
+  assemble_rows_timer_.Stop();
+  return parse_status_;
+}
+
 Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
   *eosr = false;
   uint8_t* buffer;
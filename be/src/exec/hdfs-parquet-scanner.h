@@ -16,6 +16,10 @@
 #ifndef IMPALA_EXEC_HDFS_PARQUET_SCANNER_H
 #define IMPALA_EXEC_HDFS_PARQUET_SCANNER_H
 
+#include <map>
+
+#include <boost/scoped_array.hpp>
+
 #include "exec/hdfs-scanner.h"
 #include "exec/parquet-common.h"
 
@@ -86,6 +90,23 @@ class HdfsParquetScanner : public HdfsScanner {
   };
 
  private:
+  // A conjunct of the form '<slot> <op> <constant>' that can be evaluated against the
+  // min/max statistics in the parquet row group metadata (see EvalRowGroupStats()).
+  struct StatsConjunct {
+    enum Op { LT, LE, GT, GE, EQ };
+
+    // Id of the slot the conjunct is bound against.
+    SlotId slot_id;
+
+    Op op;
+
+    // Context of the conjunct. Not owned.
+    ExprContext* ctx;
+
+    // The constant child of the conjunct. Not owned.
+    Expr* constant_expr;
+  };
+
   // Internal representation of a column schema (including nested-type columns).
   struct SchemaNode {
     // The corresponding schema element defined in the file metadata
@@ -112,6 +133,10 @@ class HdfsParquetScanner : public HdfsScanner {
   // need to issue another read.
   static const int FOOTER_SIZE = 100 * 1024;
 
+  // Number of values each column reader decodes per call in the batched decode path
+  // (AssembleRowsBatched()). Bounded by the row batch capacity in practice.
+  static const int BATCH_DECODE_SIZE = 1024;
+
   // Per column reader.
   class BaseColumnReader;
   friend class BaseColumnReader;
@@ -139,20 +164,68 @@ class HdfsParquetScanner : public HdfsScanner {
   // Returned in ProcessSplit
   Status parse_status_;
 
-  // Pool to copy dictionary page buffer into. This pool is shared across all the
-  // pages in a column chunk.
-  boost::scoped_ptr<MemPool> dictionary_pool_;
-
   // Timer for materializing rows.  This ignores time getting the next buffer.
   ScopedTimer<MonotonicStopWatch> assemble_rows_timer_;
 
   // Number of cols that need to be read.
   RuntimeProfile::Counter* num_cols_counter_;
 
+  // Number of row groups that were skipped based on row group statistics.
+  RuntimeProfile::Counter* num_stats_filtered_row_groups_counter_;
+
+  // Conjuncts that can be evaluated against row group statistics. Populated in
+  // Prepare() from conjunct_ctxs_.
+  std::vector<StatsConjunct> stats_conjuncts_;
+
+  // Conjuncts bound to a single string slot, keyed by slot id. These are evaluated
+  // once per column chunk against the dictionary entries to build a bitmap of
+  // matching codes, so rows can be filtered on the code alone before the string value
+  // is materialized. Populated in Prepare() from conjunct_ctxs_; the contexts are not
+  // owned.
+  std::map<SlotId, std::vector<ExprContext*> > dict_filter_conjuncts_map_;
+
+  // Scratch tuple and row used to evaluate dict_filter_conjuncts_map_ against
+  // dictionary entries. NULL if the map is empty.
+  Tuple* dict_filter_tuple_;
+  boost::scoped_array<Tuple*> dict_filter_row_;
+
   // Reads data from all the columns (in parallel) and assembles rows into the context
   // object. Returns when the entire row group is complete or an error occurred.
   Status AssembleRows(int row_group_idx);
 
+  // Batched variant of AssembleRows(): each column reader decodes up to
+  // BATCH_DECODE_SIZE definition levels and values at a time directly into tuple
+  // memory, so the RLE/dictionary decode loops run tight instead of being interleaved
+  // with per-row virtual dispatch. Conjuncts are evaluated per batch and surviving
+  // tuples are compacted before being committed. Enabled via --parquet_batch_decode.
+  // Requires at least one materialized column.
+  Status AssembleRowsBatched(int row_group_idx);
+
+  // Walks conjunct_ctxs_ and collects the conjuncts of the form
+  // '<slot> <op> <constant>' that can be evaluated against row group statistics into
+  // stats_conjuncts_. Conjuncts on types whose statistics we cannot decode or compare
+  // are skipped.
+  void CollectStatsConjuncts();
+
+  // Walks conjunct_ctxs_ and collects the conjuncts that are bound to a single
+  // materialized string slot into dict_filter_conjuncts_map_, and sets up the scratch
+  // tuple/row used to evaluate them against dictionary entries.
+  void CollectDictFilterConjuncts();
+
+  // Returns the conjuncts to evaluate against the dictionary of the column for
+  // 'slot_id', or NULL if there are none.
+  const std::vector<ExprContext*>* DictFilterConjuncts(SlotId slot_id) const {
+    std::map<SlotId, std::vector<ExprContext*> >::const_iterator it =
+        dict_filter_conjuncts_map_.find(slot_id);
+    return it == dict_filter_conjuncts_map_.end() ? NULL : &it->second;
+  }
+
+  // Returns true if the min/max statistics in the metadata of row group
+  // 'row_group_idx' prove that no row in the group can satisfy stats_conjuncts_,
+  // i.e. the whole row group can be skipped without reading any column data.
+  // Columns with missing or untrustworthy statistics are ignored.
+  bool EvalRowGroupStats(int row_group_idx);
+
   // Process the file footer and parse file_metadata_.  This should be called with the
   // last FOOTER_SIZE bytes in context_.
   // *eosr is a return value.  If true, the scan range is complete (e.g. select count(*))
@@ -173,6 +246,17 @@ class HdfsParquetScanner : public HdfsScanner {
   // initializes column_readers_ and issues the reads for the columns.
   Status InitColumns(int row_group_idx);
 
+  // Reads (and decompresses) the dictionary page and first data page of every column
+  // in the current row group, processing columns in parallel on any optional thread
+  // tokens available from the scan node's resource pool. Without this, a single
+  // scanner thread decompresses one column at a time. Columns for which no token is
+  // available are read lazily as before. Enabled via --parquet_parallel_column_reads.
+  Status ReadFirstPagesParallel();
+
+  // Thread function for ReadFirstPagesParallel(): reads the first pages of 'reader'
+  // and stores the result in *status.
+  void WarmUpColumn(BaseColumnReader* reader, Status* status);
+
   // Validates the file metadata
   Status ValidateFileMetadata();
 
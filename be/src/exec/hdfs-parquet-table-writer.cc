@@ -14,6 +14,8 @@
 
 #include "exec/hdfs-parquet-table-writer.h"
 
+#include <gflags/gflags.h>
+
 #include "common/version.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
@@ -42,6 +44,13 @@ using namespace impala;
 using namespace parquet;
 using namespace apache::thrift;
 
+DEFINE_int64(parquet_writer_max_buffered_bytes, 128 * 1024 * 1024, "(Advanced) Maximum "
+    "number of bytes of finalized data pages the Parquet writer buffers per output "
+    "partition before closing out the current row group early and flushing the pages "
+    "to the file. This bounds the writer's memory consumption for wide tables and "
+    "large inserts at the cost of writing more row groups per file. Set to 0 to "
+    "always buffer complete row groups.");
+
 // Managing file sizes: We need to estimate how big the files being buffered
 // are in order to split them correctly in HDFS. Having a file that is too big
 // will cause remote reads (parquet files are non-splittable).
@@ -57,15 +66,24 @@ using namespace apache::thrift;
 // TODO: more complicated heuristic?
 static const int MAX_DICTIONARY_ENTRIES = (1 << 16) - 1;
 
+// The period, in # of rows, to check the total size of the finalized pages buffered
+// for the current row group against --parquet_writer_max_buffered_bytes. Summing the
+// buffered sizes over all the columns is cheap but there is no reason to do it on
+// every row; the error from checking periodically is at most a page per column.
+static const int ROW_GROUP_BUFFER_CHECK_PERIOD = 256;
+
 // Class that encapsulates all the state for writing a single column.  This contains
 // all the buffered pages as well as the metadata (e.g. byte sizes, num values, etc).
 // This is intended to be created once per writer per column and reused across
 // row groups.
-// We currently accumulate all the data pages for an entire row group per column
-// before flushing them.  This can be pretty large (hundreds of MB) but we can't
-// fix this without collocated files in HDFS.  With collocated files, the minimum
-// we'd need to buffer is 1 page per column so on the order of 1MB (although we might
-// decide to buffer a few pages for better HDFS write performance).
+// We accumulate all the data pages for a row group per column before flushing them,
+// since the format requires all the pages of a column chunk to be contiguous in the
+// file.  To keep this from getting pretty large (hundreds of MB), the parent writer
+// closes out the row group early once the buffered pages across all columns exceed
+// --parquet_writer_max_buffered_bytes, trading more row groups per file for a bound
+// on memory.  With collocated files in HDFS, the minimum we'd need to buffer is
+// 1 page per column so on the order of 1MB (although we might decide to buffer a
+// few pages for better HDFS write performance).
 // Pages are reused between flushes.  They are created on demand as necessary and
 // recycled after a flush.
 // As rows come in, we accumulate the encoded values into the values_ and def_levels_
@@ -251,7 +269,7 @@ class HdfsParquetTableWriter::ColumnWriter :
     // it will fall back to plain.
     current_encoding_ = Encoding::PLAIN_DICTIONARY;
     dict_encoder_.reset(
-        new DictEncoder<T>(parent_->per_file_mem_pool_.get(), encoded_value_size_));
+        new DictEncoder<T>(parent_->per_group_mem_pool_.get(), encoded_value_size_));
     dict_encoder_base_ = dict_encoder_.get();
   }
 
@@ -456,7 +474,7 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
     header.__set_dictionary_page_header(dict_header);
 
     // Write the dictionary page data, compressing it if necessary.
-    uint8_t* dict_buffer = parent_->per_file_mem_pool_->Allocate(
+    uint8_t* dict_buffer = parent_->per_group_mem_pool_->Allocate(
         header.uncompressed_page_size);
     dict_encoder_base_->WriteDict(dict_buffer);
     if (compressor_.get() != NULL) {
@@ -465,14 +483,14 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
           compressor_->MaxOutputLen(header.uncompressed_page_size);
       DCHECK_GT(max_compressed_size, 0);
       uint8_t* compressed_data =
-          parent_->per_file_mem_pool_->Allocate(max_compressed_size);
+          parent_->per_group_mem_pool_->Allocate(max_compressed_size);
       header.compressed_page_size = max_compressed_size;
       compressor_->ProcessBlock32(true, header.uncompressed_page_size, dict_buffer,
           &header.compressed_page_size, &compressed_data);
       dict_buffer = compressed_data;
       // We allocated the output based on the guessed size, return the extra allocated
       // bytes back to the mem pool.
-      parent_->per_file_mem_pool_->ReturnPartialAllocation(
+      parent_->per_group_mem_pool_->ReturnPartialAllocation(
           max_compressed_size - header.compressed_page_size);
     } else {
       header.compressed_page_size = header.uncompressed_page_size;
@@ -543,7 +561,7 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   uint8_t* uncompressed_data = NULL;
   if (compressor_.get() == NULL) {
     uncompressed_data =
-        parent_->per_file_mem_pool_->Allocate(header.uncompressed_page_size);
+        parent_->per_group_mem_pool_->Allocate(header.uncompressed_page_size);
   } else {
     // We have compression.  Combine into the staging buffer.
     parent_->compression_staging_buffer_.resize(
@@ -570,7 +588,7 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
     int64_t max_compressed_size =
         compressor_->MaxOutputLen(header.uncompressed_page_size);
     DCHECK_GT(max_compressed_size, 0);
-    uint8_t* compressed_data = parent_->per_file_mem_pool_->Allocate(max_compressed_size);
+    uint8_t* compressed_data = parent_->per_group_mem_pool_->Allocate(max_compressed_size);
     header.compressed_page_size = max_compressed_size;
     compressor_->ProcessBlock32(true, header.uncompressed_page_size, uncompressed_data,
         &header.compressed_page_size, &compressed_data);
@@ -578,7 +596,7 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
 
     // We allocated the output based on the guessed size, return the extra allocated
     // bytes back to the mem pool.
-    parent_->per_file_mem_pool_->ReturnPartialAllocation(
+    parent_->per_group_mem_pool_->ReturnPartialAllocation(
         max_compressed_size - header.compressed_page_size);
   }
 
@@ -626,8 +644,9 @@ HdfsParquetTableWriter::HdfsParquetTableWriter(HdfsTableSink* parent, RuntimeSta
       row_count_(0),
       file_size_limit_(0),
       reusable_col_mem_pool_(new MemPool(parent_->mem_tracker())),
-      per_file_mem_pool_(new MemPool(parent_->mem_tracker())),
-      row_idx_(0) {
+      per_group_mem_pool_(new MemPool(parent_->mem_tracker())),
+      row_idx_(0),
+      rows_since_buffer_check_(0) {
 }
 
 HdfsParquetTableWriter::~HdfsParquetTableWriter() {
@@ -815,7 +834,7 @@ uint64_t HdfsParquetTableWriter::default_block_size() const {
 Status HdfsParquetTableWriter::InitNewFile() {
   DCHECK(current_row_group_ == NULL);
 
-  per_file_mem_pool_->Clear();
+  per_group_mem_pool_->Clear();
 
   // Get the file limit
   RETURN_IF_ERROR(HdfsTableSink::GetFileBlockSize(output_, &file_size_limit_));
@@ -887,6 +906,21 @@ Status HdfsParquetTableWriter::AppendRowBatch(RowBatch* batch,
       *new_file = true;
       return Status::OK;
     }
+
+    if (FLAGS_parquet_writer_max_buffered_bytes > 0 &&
+        UNLIKELY(++rows_since_buffer_check_ >= ROW_GROUP_BUFFER_CHECK_PERIOD)) {
+      rows_since_buffer_check_ = 0;
+      int64_t buffered_bytes = 0;
+      for (int j = 0; j < columns_.size(); ++j) {
+        buffered_bytes += columns_[j]->total_compressed_size();
+      }
+      if (buffered_bytes > FLAGS_parquet_writer_max_buffered_bytes) {
+        // The finalized pages buffered for the current row group are over the limit.
+        // Close out the row group early so the pages can be written to the file and
+        // their memory released, rather than buffering until the file is full.
+        RETURN_IF_ERROR(AddRowGroup());
+      }
+    }
   }
 
   // Reset the row_idx_ when we exhaust the batch.  We can exit before exhausting
@@ -914,7 +948,7 @@ void HdfsParquetTableWriter::Close() {
     columns_[i]->Close();
   }
   reusable_col_mem_pool_->FreeAll();
-  per_file_mem_pool_->FreeAll();
+  per_group_mem_pool_->FreeAll();
   compression_staging_buffer_.clear();
 }
 
@@ -971,6 +1005,10 @@ Status HdfsParquetTableWriter::FlushCurrentRowGroup() {
     columns_[i]->Reset();
   }
 
+  // All the pages and dictionaries for this row group have been written out, so their
+  // backing memory can be released before the next row group starts buffering.
+  per_group_mem_pool_->Clear();
+
   current_row_group_ = NULL;
   return Status::OK;
 }
@@ -37,10 +37,11 @@ class TupleRow;
 
 // The writer consumes all rows passed to it and writes the evaluated output_exprs
 // as a parquet file in hdfs.
+// Files with more rows than fit under --parquet_writer_max_buffered_bytes of
+// buffered pages are written as multiple row groups to bound the writer's memory.
 // TODO: (parts of the format that are not implemented)
 // - group var encoding
 // - compression
-// - multiple row groups per file
 // TODO: we need a mechanism to pass the equivalent of serde params to this class
 // from the FE.  This includes:
 // - compression & codec
@@ -164,15 +165,20 @@ class HdfsParquetTableWriter : public HdfsTableWriter {
   // writer (i.e. reused across files).
   boost::scoped_ptr<MemPool> reusable_col_mem_pool_;
 
-  // Memory for column/block buffers that is allocated per file.  We need to
-  // reset this pool after flushing a file.
-  boost::scoped_ptr<MemPool> per_file_mem_pool_;
+  // Memory for the finalized (compressed) pages and dictionaries of the current
+  // row group.  This pool is cleared after each row group is flushed so the writer's
+  // memory consumption is bounded by a single row group rather than a whole file.
+  boost::scoped_ptr<MemPool> per_group_mem_pool_;
 
   // Current position in the batch being written.  This must be persistent across
   // calls since the writer may stop in the middle of a row batch and ask for a new
   // file.
   int row_idx_;
 
+  // Number of rows appended since the size of the buffered pages was last checked
+  // against --parquet_writer_max_buffered_bytes (see AppendRowBatch()).
+  int rows_since_buffer_check_;
+
   // Staging buffer to use to compress data.  This is used only if compression is
   // enabled and is reused between all data pages.
   std::vector<uint8_t> compression_staging_buffer_;
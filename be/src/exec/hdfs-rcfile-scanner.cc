@@ -175,8 +175,17 @@ Status HdfsRCFileScanner::ReadFileHeader() {
     RETURN_IF_FALSE(stream_->ReadText(&codec_ptr, &len, &parse_status_));
     header_->codec = string(reinterpret_cast<char*>(codec_ptr), len);
     Codec::CodecMap::const_iterator it = Codec::CODEC_MAP.find(header_->codec);
-    DCHECK(it != Codec::CODEC_MAP.end());
-    header_->compression_type = it->second;
+    if (it != Codec::CODEC_MAP.end()) {
+      header_->compression_type = it->second;
+    } else if (Codec::IsPluginCodec(header_->codec)) {
+      // Plugin codecs have no THdfsCompression enum value; DEFAULT is only used for
+      // bookkeeping here. The decompressor is created by codec name.
+      header_->compression_type = THdfsCompression::DEFAULT;
+    } else {
+      stringstream ss;
+      ss << Codec::UNKNOWN_CODEC_ERROR << header_->codec;
+      return Status(ss.str());
+    }
   } else {
     header_->compression_type = THdfsCompression::NONE;
   }
@@ -21,6 +21,7 @@
 #include "exec/hdfs-avro-scanner.h"
 #include "exec/hdfs-parquet-scanner.h"
 
+#include <algorithm>
 #include <sstream>
 #include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
@@ -41,9 +42,11 @@
 #include "runtime/row-batch.h"
 #include "util/bit-util.h"
 #include "util/container-util.h"
+#include "util/cpu-sampler.h"
 #include "util/debug-util.h"
 #include "util/disk-info.h"
 #include "util/error-util.h"
+#include "util/hash-util.h"
 #include "util/hdfs-util.h"
 #include "util/impalad-metrics.h"
 #include "util/periodic-counter-updater.h"
@@ -52,6 +55,22 @@
 #include "gen-cpp/PlanNodes_types.h"
 
 DEFINE_int32(max_row_batches, 0, "the maximum size of materialized_row_batches_");
+DEFINE_int64(max_coalesced_scan_range_length, 0, "If positive, adjacent scan ranges of "
+    "the same file are merged into single ranges of up to this many bytes before being "
+    "issued to the io mgr. This reduces per-range overhead for tables with many small "
+    "files or small blocks. 0 disables coalescing.");
+DEFINE_int64(scan_codegen_min_bytes, 16 * 1024 * 1024, "(Advanced) Minimum number of "
+    "bytes a scan node must be assigned before its scanner functions are codegen'd. "
+    "For smaller scans the fixed compile cost exceeds what the jitted code saves.");
+DEFINE_int32(parallel_scan_range_prepare_threshold, 128, "(Advanced) Minimum number "
+    "of scan ranges assigned to an HDFS scan node before its scan-range setup is "
+    "prepared on a separate thread, overlapping it with conjunct preparation and "
+    "codegen setup. 0 or negative always prepares scan ranges inline.");
+DEFINE_int32(scan_range_sample_percent, 100, "(Experimental) If less than 100, HDFS "
+    "scan nodes process approximately this percentage of their scan ranges and skip "
+    "the rest (block sampling). Ranges are selected by a deterministic hash of file "
+    "name and offset, so repeated queries over unchanged data see the same sample. "
+    "Results are approximate and aggregates are not scaled up.");
 DECLARE_string(cgroup_hierarchy_path);
 DECLARE_bool(enable_rm);
 
@@ -88,6 +107,7 @@ HdfsScanNode::HdfsScanNode(ObjectPool* pool, const TPlanNode& tnode,
       unknown_disk_id_warned_(false),
       initial_ranges_issued_(false),
       scanner_thread_bytes_required_(0),
+      total_split_bytes_(0),
       disks_accessed_bitmap_(TUnit::UNIT, 0),
       done_(false),
       all_ranges_started_(false),
@@ -109,6 +129,7 @@ HdfsScanNode::~HdfsScanNode() {
 
 Status HdfsScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
 
   if (!initial_ranges_issued_) {
     // We do this in GetNext() to ensure that all execution time predicates have
@@ -148,10 +169,14 @@ Status HdfsScanNode::GetNextInternal(
     return Status::OK;
   }
   *eos = false;
+  MonotonicStopWatch batch_wait_timer;
+  batch_wait_timer.Start();
   RowBatch* materialized_batch = materialized_row_batches_->GetBatch();
+  batch_wait_time_distribution_->Record(batch_wait_timer.ElapsedTime());
   if (materialized_batch != NULL) {
     num_owned_io_buffers_ -= materialized_batch->num_io_buffers();
     row_batch->AcquireState(materialized_batch);
+    rows_per_batch_distribution_->Record(row_batch->num_rows());
     // Update the number of materialized rows now instead of when they are materialized.
     // This means that scanners might process and queue up more rows than are necessary
     // for the limit case but we want to avoid the synchronized writes to
@@ -201,6 +226,60 @@ DiskIoMgr::ScanRange* HdfsScanNode::AllocateScanRange(
   return range;
 }
 
+static bool ScanRangeOffsetLessThan(
+    const DiskIoMgr::ScanRange* a, const DiskIoMgr::ScanRange* b) {
+  return a->offset() < b->offset();
+}
+
+void HdfsScanNode::CoalesceScanRanges() {
+  DCHECK_GT(FLAGS_max_coalesced_scan_range_length, 0);
+  int num_merged = 0;
+  BOOST_FOREACH(FileDescMap::value_type& entry, file_descs_) {
+    HdfsFileDesc* file_desc = entry.second;
+    vector<DiskIoMgr::ScanRange*>& splits = file_desc->splits;
+    if (splits.size() < 2) continue;
+    sort(splits.begin(), splits.end(), ScanRangeOffsetLessThan);
+    vector<DiskIoMgr::ScanRange*> coalesced;
+    int i = 0;
+    while (i < splits.size()) {
+      DiskIoMgr::ScanRange* first = splits[i];
+      int64_t len = first->len();
+      int j = i + 1;
+      while (j < splits.size()) {
+        DiskIoMgr::ScanRange* next = splits[j];
+        // Only byte-adjacent ranges on the same disk queue with the same locality can
+        // be merged; merging a cached range would lose the cached read.
+        if (next->offset() != first->offset() + len) break;
+        if (len + next->len() > FLAGS_max_coalesced_scan_range_length) break;
+        if (next->disk_id() != first->disk_id()) break;
+        if (first->try_cache() || next->try_cache()) break;
+        if (next->expected_local() != first->expected_local()) break;
+        len += next->len();
+        ++j;
+      }
+      if (j == i + 1) {
+        coalesced.push_back(first);
+      } else {
+        DiskIoMgr::ScanRange* range =
+            runtime_state_->obj_pool()->Add(new DiskIoMgr::ScanRange());
+        // The merged range reuses the first range's disk queue assignment and metadata
+        // (all splits of a file belong to the same partition).
+        range->Reset(file_desc->fs, file_desc->filename.c_str(), len, first->offset(),
+            first->disk_id(), false, first->expected_local(), first->meta_data());
+        coalesced.push_back(range);
+        num_merged += j - i - 1;
+      }
+      i = j;
+    }
+    splits.swap(coalesced);
+  }
+  if (num_merged > 0) {
+    VLOG_QUERY << "Coalesced " << num_merged << " adjacent scan range(s) in scan node "
+               << id();
+    AddRuntimeExecOption("Scan Range Coalescing");
+  }
+}
+
 HdfsFileDesc* HdfsScanNode::GetFileDesc(const string& filename) {
   DCHECK(file_descs_.find(filename) != file_descs_.end());
   return file_descs_[filename];
@@ -299,61 +378,30 @@ void HdfsScanNode::TransferToScanNodePool(MemPool* pool) {
   scan_node_pool_->AcquireData(pool, false);
 }
 
-Status HdfsScanNode::Prepare(RuntimeState* state) {
-  SCOPED_TIMER(runtime_profile_->total_time_counter());
-  runtime_state_ = state;
-  RETURN_IF_ERROR(ScanNode::Prepare(state));
-
-  tuple_desc_ = state->desc_tbl().GetTupleDescriptor(tuple_id_);
-  DCHECK(tuple_desc_ != NULL);
-
-  if (!state->cgroup().empty()) {
-    scanner_threads_.SetCgroupsMgr(state->exec_env()->cgroups_mgr());
-    scanner_threads_.SetCgroup(state->cgroup());
-  }
-
-  // One-time initialisation of state that is constant across scan ranges
-  DCHECK(tuple_desc_->table_desc() != NULL);
-  hdfs_table_ = static_cast<const HdfsTableDescriptor*>(tuple_desc_->table_desc());
-  scan_node_pool_.reset(new MemPool(mem_tracker()));
-
-  // Gather materialized partition-key slots and non-partition slots.
-  const vector<SlotDescriptor*>& slots = tuple_desc_->slots();
-  for (size_t i = 0; i < slots.size(); ++i) {
-    if (!slots[i]->is_materialized()) continue;
-    if (hdfs_table_->IsClusteringCol(slots[i])) {
-      partition_key_slots_.push_back(slots[i]);
-    } else {
-      materialized_slots_.push_back(slots[i]);
-    }
-  }
-
-  // Order the materialized slots such that for schemaless file formats (e.g. text) the
-  // order corresponds to the physical order in files. For formats where the file schema
-  // is independent of the table schema (e.g. Avro, Parquet), this step is not necessary.
-  sort(materialized_slots_.begin(), materialized_slots_.end(),
-      SlotDescriptor::ColPathLessThan);
-
-  // Populate mapping from slot path to index into materialized_slots_.
-  for (int i = 0; i < materialized_slots_.size(); ++i) {
-    path_to_materialized_slot_idx_[materialized_slots_[i]->col_path()] = i;
-  }
-
-  // Initialize is_materialized_col_
-  is_materialized_col_.resize(hdfs_table_->num_cols());
-  for (int i = 0; i < hdfs_table_->num_cols(); ++i) {
-    is_materialized_col_[i] = GetMaterializedSlotIdx(vector<int>(1, i)) != SKIP_COLUMN;
-  }
+// Returns true if 'split' should be processed when block sampling
+// (--scan_range_sample_percent) is enabled. The decision hashes the file name and
+// split offset, so it is deterministic across executions and nodes, and is made per
+// range rather than per file so that large files are sampled evenly.
+static bool KeepSampledSplit(const THdfsFileSplit& split) {
+  uint32_t hash = HashUtil::Hash(&split.offset, sizeof(split.offset), 0);
+  hash = HashUtil::Hash(split.file_name.data(), split.file_name.size(), hash);
+  return hash % 100 < FLAGS_scan_range_sample_percent;
+}
 
+Status HdfsScanNode::PrepareScanRanges() {
   HdfsFsCache::HdfsFsMap fs_cache;
   // Convert the TScanRangeParams into per-file DiskIO::ScanRange objects and populate
   // partition_ids_, file_descs_, and per_type_files_.
-  DCHECK(scan_range_params_ != NULL)
-      << "Must call SetScanRanges() before calling Prepare()";
   int num_ranges_missing_volume_id = 0;
+  int num_sampled_out_ranges = 0;
   for (int i = 0; i < scan_range_params_->size(); ++i) {
     DCHECK((*scan_range_params_)[i].scan_range.__isset.hdfs_file_split);
     const THdfsFileSplit& split = (*scan_range_params_)[i].scan_range.hdfs_file_split;
+    if (FLAGS_scan_range_sample_percent < 100 && !KeepSampledSplit(split)) {
+      ++num_sampled_out_ranges;
+      continue;
+    }
+    total_split_bytes_ += split.length;
     partition_ids_.insert(split.partition_id);
     HdfsPartitionDescriptor* partition_desc =
         hdfs_table_->GetPartition(split.partition_id);
@@ -405,6 +453,16 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
             try_cache, expected_local));
   }
 
+  if (FLAGS_scan_range_sample_percent < 100) {
+    // Make the sampling visible in the profile; the row counts of a sampled scan are
+    // not meaningful without it.
+    stringstream ss;
+    ss << "processed " << (scan_range_params_->size() - num_sampled_out_ranges)
+       << " of " << scan_range_params_->size() << " scan ranges "
+       << "(--scan_range_sample_percent=" << FLAGS_scan_range_sample_percent << ")";
+    runtime_profile()->AddInfoString("Block Sampling", ss.str());
+  }
+
   // Compute the minimum bytes required to start a new thread. This is based on the
   // file format.
   // The higher the estimate, the less likely it is the query will fail but more likely
@@ -439,7 +497,7 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
   BOOST_FOREACH(const int64_t& partition_id, partition_ids_) {
     HdfsPartitionDescriptor* partition_desc = hdfs_table_->GetPartition(partition_id);
     DCHECK(partition_desc != NULL);
-    RETURN_IF_ERROR(partition_desc->PrepareExprs(state));
+    RETURN_IF_ERROR(partition_desc->PrepareExprs(runtime_state_));
   }
 
   // Update server wide metrics for number of scan ranges and ranges that have
@@ -454,12 +512,112 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
   PrintHdfsSplitStats(per_volume_stats, &str);
   runtime_profile()->AddInfoString(HDFS_SPLIT_STATS_DESC, str.str());
 
-  // Initialize conjunct exprs
-  RETURN_IF_ERROR(Expr::CreateExprTrees(
-      runtime_state_->obj_pool(), thrift_plan_node_->conjuncts, &conjunct_ctxs_));
-  RETURN_IF_ERROR(
-      Expr::Prepare(conjunct_ctxs_, runtime_state_, row_desc(), expr_mem_tracker()));
-  AddExprCtxsToFree(conjunct_ctxs_);
+  return Status::OK;
+}
+
+void HdfsScanNode::PrepareScanRangesThread(Promise<Status>* status) {
+  status->Set(PrepareScanRanges());
+}
+
+Status HdfsScanNode::Prepare(RuntimeState* state) {
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  runtime_state_ = state;
+  RETURN_IF_ERROR(ScanNode::Prepare(state));
+
+  tuple_desc_ = state->desc_tbl().GetTupleDescriptor(tuple_id_);
+  DCHECK(tuple_desc_ != NULL);
+
+  if (!state->cgroup().empty()) {
+    scanner_threads_.SetCgroupsMgr(state->exec_env()->cgroups_mgr());
+    scanner_threads_.SetCgroup(state->cgroup());
+  }
+
+  // One-time initialisation of state that is constant across scan ranges
+  DCHECK(tuple_desc_->table_desc() != NULL);
+  hdfs_table_ = static_cast<const HdfsTableDescriptor*>(tuple_desc_->table_desc());
+  scan_node_pool_.reset(new MemPool(mem_tracker()));
+#ifdef ALLOC_PROFILING
+  scan_node_pool_->set_allocation_counters(allocation_counters());
+#endif
+
+  // Gather materialized partition-key slots and non-partition slots.
+  const vector<SlotDescriptor*>& slots = tuple_desc_->slots();
+  for (size_t i = 0; i < slots.size(); ++i) {
+    if (!slots[i]->is_materialized()) continue;
+    if (hdfs_table_->IsClusteringCol(slots[i])) {
+      partition_key_slots_.push_back(slots[i]);
+    } else {
+      materialized_slots_.push_back(slots[i]);
+    }
+  }
+
+  // Order the materialized slots such that for schemaless file formats (e.g. text) the
+  // order corresponds to the physical order in files. For formats where the file schema
+  // is independent of the table schema (e.g. Avro, Parquet), this step is not necessary.
+  sort(materialized_slots_.begin(), materialized_slots_.end(),
+      SlotDescriptor::ColPathLessThan);
+
+  // Populate mapping from slot path to index into materialized_slots_.
+  for (int i = 0; i < materialized_slots_.size(); ++i) {
+    path_to_materialized_slot_idx_[materialized_slots_[i]->col_path()] = i;
+  }
+
+  // Initialize is_materialized_col_
+  is_materialized_col_.resize(hdfs_table_->num_cols());
+  for (int i = 0; i < hdfs_table_->num_cols(); ++i) {
+    is_materialized_col_[i] = GetMaterializedSlotIdx(vector<int>(1, i)) != SKIP_COLUMN;
+  }
+
+  // Convert the scan ranges into io mgr ranges and prepare the state derived from
+  // them. For nodes with many ranges this is dispatched to its own thread so that it
+  // overlaps the conjunct preparation below; everything the two touch concurrently is
+  // thread-safe (see PrepareScanRanges()).
+  DCHECK(scan_range_params_ != NULL)
+      << "Must call SetScanRanges() before calling Prepare()";
+  Promise<Status> range_prepare_status;
+  if (FLAGS_parallel_scan_range_prepare_threshold > 0 &&
+      scan_range_params_->size() >= FLAGS_parallel_scan_range_prepare_threshold) {
+    Thread range_prepare_thread("hdfs-scan-node", "prepare-scan-ranges",
+        bind(&HdfsScanNode::PrepareScanRangesThread, this, &range_prepare_status));
+  } else {
+    range_prepare_status.Set(PrepareScanRanges());
+  }
+
+  // Initialize conjunct exprs. Independent of the scan ranges; errors are propagated
+  // only after joining the scan range preparation, which writes into this node.
+  Status conjunct_status = Expr::CreateExprTrees(
+      runtime_state_->obj_pool(), thrift_plan_node_->conjuncts, &conjunct_ctxs_);
+  if (conjunct_status.ok()) {
+    conjunct_status =
+        Expr::Prepare(conjunct_ctxs_, runtime_state_, row_desc(), expr_mem_tracker());
+  }
+  if (conjunct_status.ok()) AddExprCtxsToFree(conjunct_ctxs_);
+
+  // Wait for the scan range preparation before reading any state derived from it.
+  RETURN_IF_ERROR(range_prepare_status.Get());
+  RETURN_IF_ERROR(conjunct_status);
+
+  if (VLOG_IS_ON(2) && !conjunct_ctxs_.empty()) {
+    // Log how the conjunct slots sit in the tuple layout. On wide tables the
+    // frontend's size-ordered layout can push them onto the tuple's last cache
+    // lines, which is worth knowing when a selective scan is slower than expected.
+    vector<SlotId> conjunct_slot_ids;
+    for (int i = 0; i < conjunct_ctxs_.size(); ++i) {
+      conjunct_ctxs_[i]->root()->GetSlotIds(&conjunct_slot_ids);
+    }
+    VLOG(2) << tuple_desc_->LayoutDiagnostic(conjunct_slot_ids);
+  }
+
+  // Per-node codegen decision: a scan assigned only a few MB of data never gets hot
+  // enough to repay the compile time, so skip codegen for it even when the query has
+  // codegen enabled. The assigned split bytes are the backend's stand-in for the
+  // planner's cardinality estimate, which is not shipped to the backend.
+  // TODO: carry the planner's cardinality estimate in TPlanNode so other node types
+  // can make the same per-node decision.
+  if (total_split_bytes_ < FLAGS_scan_codegen_min_bytes) {
+    AddRuntimeExecOption("Codegen skipped: scan too small");
+    return Status::OK;
+  }
 
   for (int format = THdfsFileFormat::TEXT;
        format <= THdfsFileFormat::PARQUET; ++format) {
@@ -495,7 +653,8 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
       LlvmCodeGen* codegen;
       RETURN_IF_ERROR(runtime_state_->GetCodegen(&codegen));
       codegen->AddFunctionToJit(
-          fn, &codegend_fn_map_[static_cast<THdfsFileFormat::type>(format)]);
+          fn, &codegend_fn_map_[static_cast<THdfsFileFormat::type>(format)],
+          ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
     }
   }
 
@@ -530,6 +689,9 @@ Status HdfsScanNode::Open(RuntimeState* state) {
     return Status::OK;
   }
 
+  // Merge small adjacent scan ranges before any are issued to the io mgr.
+  if (FLAGS_max_coalesced_scan_range_length > 0) CoalesceScanRanges();
+
   // Open all the partition exprs used by the scan node
   BOOST_FOREACH(const int64_t& partition_id, partition_ids_) {
     HdfsPartitionDescriptor* partition_desc = hdfs_table_->GetPartition(partition_id);
@@ -543,6 +705,12 @@ Status HdfsScanNode::Open(RuntimeState* state) {
   RETURN_IF_ERROR(runtime_state_->io_mgr()->RegisterContext(
       &reader_context_, mem_tracker()));
 
+  // Wake scanner threads blocked in io mgr waits as soon as the fragment is
+  // cancelled, rather than when the fragment thread next polls is_cancelled().
+  // SetDone() is idempotent and safe to call at any point in the node's lifetime.
+  runtime_state_->AddCancellationCallback(
+      bind<void>(mem_fn(&HdfsScanNode::SetDone), this));
+
   // Initialize HdfsScanNode specific counters
   read_timer_ = ADD_TIMER(runtime_profile(), TOTAL_HDFS_READ_TIMER);
   per_read_thread_throughput_counter_ = runtime_profile()->AddDerivedCounter(
@@ -550,6 +718,10 @@ Status HdfsScanNode::Open(RuntimeState* state) {
       bind<int64_t>(&RuntimeProfile::UnitsPerSecond, bytes_read_counter_, read_timer_));
   scan_ranges_complete_counter_ =
       ADD_COUNTER(runtime_profile(), SCAN_RANGES_COMPLETE_COUNTER, TUnit::UNIT);
+  rows_per_batch_distribution_ = runtime_profile()->AddHistogramCounter(
+      "RowsPerBatchDistribution", TUnit::UNIT);
+  batch_wait_time_distribution_ = runtime_profile()->AddHistogramCounter(
+      "MaterializedBatchWaitTimeDistribution", TUnit::TIME_NS);
   if (DiskInfo::num_disks() < 64) {
     num_disks_accessed_counter_ =
         ADD_COUNTER(runtime_profile(), NUM_DISKS_ACCESSED_COUNTER, TUnit::UNIT);
@@ -581,6 +753,10 @@ Status HdfsScanNode::Open(RuntimeState* state) {
       TUnit::UNIT);
   unexpected_remote_bytes_ = ADD_COUNTER(runtime_profile(), "BytesReadRemoteUnexpected",
       TUnit::BYTES);
+  num_cached_ranges_ = ADD_COUNTER(runtime_profile(), "CachedScanRanges",
+      TUnit::UNIT);
+  cached_range_bytes_ = ADD_COUNTER(runtime_profile(), "BytesReadCachedRanges",
+      TUnit::BYTES);
 
   max_compressed_text_file_length_ = runtime_profile()->AddHighWaterMarkCounter(
       "MaxCompressedTextFileLength", TUnit::BYTES);
@@ -789,6 +965,8 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
 void HdfsScanNode::ScannerThread() {
   SCOPED_THREAD_COUNTER_MEASUREMENT(scanner_thread_counters());
   SCOPED_TIMER(runtime_state_->total_cpu_timer());
+  // Attribute this thread's CPU samples to this scan node.
+  ScopedThreadCpuSampleContext cpu_sample_context(runtime_state_->query_id(), id());
 
   while (!done_) {
     {
@@ -1027,6 +1205,10 @@ void HdfsScanNode::StopAndFinalizeCounters() {
         runtime_state_->io_mgr()->num_remote_ranges(reader_context_)));
     unexpected_remote_bytes_->Set(
         runtime_state_->io_mgr()->unexpected_remote_bytes(reader_context_));
+    num_cached_ranges_->Set(static_cast<int64_t>(
+        runtime_state_->io_mgr()->num_cached_ranges(reader_context_)));
+    cached_range_bytes_->Set(
+        runtime_state_->io_mgr()->cached_range_bytes(reader_context_));
 
     if (unexpected_remote_bytes_->value() >= UNEXPECTED_REMOTE_BYTES_WARN_THRESHOLD) {
       runtime_state_->LogError(ErrorMsg(TErrorCode::GENERAL, Substitute(
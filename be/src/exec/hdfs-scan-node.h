@@ -33,6 +33,7 @@
 #include "runtime/disk-io-mgr.h"
 #include "runtime/string-buffer.h"
 #include "util/progress-updater.h"
+#include "util/promise.h"
 #include "util/spinlock.h"
 #include "util/thread.h"
 
@@ -307,6 +308,10 @@ class HdfsScanNode : public ScanNode {
   // scanner threads.
   int64_t scanner_thread_bytes_required_;
 
+  // Total bytes across all splits assigned to this node, set by PrepareScanRanges().
+  // Used for the per-node codegen decision in Prepare().
+  int64_t total_split_bytes_;
+
   // Number of files that have not been issued from the scanners.
   AtomicInt<int> num_unqueued_files_;
 
@@ -361,6 +366,14 @@ class HdfsScanNode : public ScanNode {
   // Maximum size of materialized_row_batches_.
   int max_materialized_row_batches_;
 
+  // Distribution of the number of rows in batches handed to GetNext(). Short batches
+  // mean per-batch fixed costs dominate; the mean alone can't show that.
+  RuntimeProfile::HistogramCounter* rows_per_batch_distribution_;
+
+  // Distribution of the time GetNext() spends waiting for a materialized batch from
+  // the scanner threads.
+  RuntimeProfile::HistogramCounter* batch_wait_time_distribution_;
+
   // This is the number of io buffers that are owned by the scan node and the scanners.
   // This is used just to help debug leaked io buffers to determine if the leak is
   // happening in the scanners vs other parts of the execution.
@@ -397,6 +410,12 @@ class HdfsScanNode : public ScanNode {
   // Total number of bytes read remotely that were expected to be local
   RuntimeProfile::Counter* unexpected_remote_bytes_;
 
+  // Total number of scan ranges served entirely from the HDFS cache
+  RuntimeProfile::Counter* num_cached_ranges_;
+
+  // Total number of bytes of scan ranges served entirely from the HDFS cache
+  RuntimeProfile::Counter* cached_range_bytes_;
+
   // Lock protects access between scanner thread and main query thread (the one calling
   // GetNext()) for all fields below.  If this lock and any other locks needs to be taken
   // together, this lock must be taken first.
@@ -453,6 +472,26 @@ class HdfsScanNode : public ScanNode {
   // This thread terminates when all scan ranges are complete or an error occurred.
   void ScannerThread();
 
+  // Merges runs of adjacent scan ranges of the same file into single larger ranges,
+  // up to --max_coalesced_scan_range_length bytes each. This cuts per-range overhead
+  // (file opens, seeks, context setup) for tables with many small files or small
+  // blocks and lets the io mgr issue larger sequential reads. Called from Open(),
+  // before any ranges are issued. Only ranges with the same disk queue and locality
+  // are merged; cached ranges are never merged.
+  void CoalesceScanRanges();
+
+  // Converts the TScanRangeParams into per-file DiskIoMgr scan ranges and prepares all
+  // state derived from them: file_descs_, per_type_files_, partition_ids_,
+  // total_split_bytes_, the partition exprs, the scanner thread memory estimate and
+  // the per-volume split stats. Called from Prepare(), either inline or on a separate
+  // thread overlapping conjunct preparation when the node has at least
+  // --parallel_scan_range_prepare_threshold ranges. Only touches shared state that is
+  // thread-safe (object pool, mem trackers, profile info strings, metrics).
+  Status PrepareScanRanges();
+
+  // Thread target wrapping PrepareScanRanges(); sets its return status on 'status'.
+  void PrepareScanRangesThread(Promise<Status>* status);
+
   // Returns true if there is enough memory (against the mem tracker limits) to
   // have a scanner thread.
   // If new_thread is true, the calculation is for starting a new scanner thread.
@@ -106,10 +106,9 @@ Status HdfsScanner::InitializeWriteTuplesFn(HdfsPartitionDescriptor* partition,
 }
 
 void HdfsScanner::StartNewRowBatch() {
-  batch_ = new RowBatch(scan_node_->row_desc(), state_->batch_size(),
-      scan_node_->mem_tracker());
-  tuple_mem_ =
-      batch_->tuple_data_pool()->Allocate(state_->batch_size() * tuple_byte_size_);
+  int capacity = RowBatch::ComputeCapacity(scan_node_->row_desc(), state_->batch_size());
+  batch_ = new RowBatch(scan_node_->row_desc(), capacity, scan_node_->mem_tracker());
+  tuple_mem_ = batch_->tuple_data_pool()->Allocate(capacity * tuple_byte_size_);
 }
 
 int HdfsScanner::GetMemory(MemPool** pool, Tuple** tuple_mem, TupleRow** tuple_row_mem) {
@@ -535,9 +534,35 @@ Status HdfsScanner::UpdateDecompressor(const string& codec) {
     type = Codec::CODEC_MAP.find(codec);
 
   if (type == Codec::CODEC_MAP.end()) {
-    stringstream ss;
-    ss << Codec::UNKNOWN_CODEC_ERROR << codec;
-    return Status(ss.str());
+    if (!Codec::IsPluginCodec(codec)) {
+      stringstream ss;
+      ss << Codec::UNKNOWN_CODEC_ERROR << codec;
+      return Status(ss.str());
+    }
+    // Plugin codecs share THdfsCompression::DEFAULT as their type, so compare codec
+    // names to detect a change of compression between files.
+    if (codec != decompression_codec_) {
+      if (decompressor_.get() != NULL) {
+        decompressor_->Close();
+        decompressor_.reset(NULL);
+      }
+      RETURN_IF_ERROR(Codec::CreateDecompressor(data_buffer_pool_.get(),
+          scan_node_->tuple_desc()->string_slots().empty(), codec, &decompressor_));
+      decompression_type_ = THdfsCompression::DEFAULT;
+      decompression_codec_ = codec;
+    }
+    return Status::OK;
+  }
+
+  if (!decompression_codec_.empty()) {
+    // The previous file used a plugin codec that would be indistinguishable from the
+    // new codec by type alone; force the type-keyed path below to recreate the
+    // decompressor.
+    DCHECK(decompressor_.get() != NULL);
+    decompressor_->Close();
+    decompressor_.reset(NULL);
+    decompression_type_ = THdfsCompression::NONE;
+    decompression_codec_.clear();
   }
   RETURN_IF_ERROR(UpdateDecompressor(type->second));
   return Status::OK;
@@ -200,6 +200,12 @@ class HdfsScanner {
   // The most recently used decompression type.
   THdfsCompression::type decompression_type_;
 
+  // Name of the codec backing decompressor_ when it was created through a codec
+  // plugin. Plugin codecs have no THdfsCompression enum value of their own, so the
+  // name is needed to detect codec changes across files. Empty when decompressor_ is
+  // a built-in codec.
+  std::string decompression_codec_;
+
   // Pool to allocate per data block memory.  This should be used with the
   // decompressor and any other per data block allocations.
   boost::scoped_ptr<MemPool> data_buffer_pool_;
@@ -30,6 +30,11 @@ using namespace impala;
 using namespace llvm;
 using namespace std;
 
+DEFINE_bool(seq_pipelined_decompression, false, "If true, scans of block-compressed "
+    "SequenceFiles decompress blocks on a background thread per scanner, overlapping "
+    "decompression with tuple materialization at the cost of copying the compressed "
+    "bytes and a few blocks of extra memory.");
+
 const char* const HdfsSequenceScanner::SEQFILE_VALUE_CLASS_NAME =
     "org.apache.hadoop.io.Text";
 
@@ -161,6 +166,10 @@ inline Status HdfsSequenceScanner::GetRecord(uint8_t** record_ptr,
 Status HdfsSequenceScanner::ProcessBlockCompressedScanRange() {
   DCHECK(header_->is_compressed);
 
+  if (FLAGS_seq_pipelined_decompression) {
+    return ProcessBlockCompressedScanRangePipelined();
+  }
+
   while (!finished()) {
     if (scan_node_->ReachedLimit()) return Status::OK;
 
@@ -195,6 +204,137 @@ Status HdfsSequenceScanner::ProcessBlockCompressedScanRange() {
   return Status::OK;
 }
 
+Status HdfsSequenceScanner::ProcessBlockCompressedScanRangePipelined() {
+  DCHECK(header_->is_compressed);
+  RETURN_IF_ERROR(StartDecompressionPipeline());
+
+  // Discard results left in flight by a previous call that hit a parse error.
+  while (blocks_in_flight() > 0) {
+    MemPool* pool;
+    uint8_t* data;
+    int64_t len;
+    // The status is ignored; the block is being discarded anyway.
+    GetDecompressedBlock(&pool, &data, &len);
+    pool->FreeAll();
+    delete pool;
+  }
+  pending_record_counts_.clear();
+
+  // Set once the last block of the range has been queued; after that we only
+  // consume what is still in flight.
+  bool draining = false;
+  while (true) {
+    if (scan_node_->ReachedLimit()) return Status::OK;
+
+    // Keep the pipeline full.
+    while (!draining && !finished() && blocks_in_flight() < PIPELINE_DEPTH) {
+      RETURN_IF_ERROR(ReadAndQueueCompressedBlock());
+
+      // SequenceFiles don't end with syncs
+      if (stream_->eof()) {
+        draining = true;
+        break;
+      }
+
+      // Read the sync indicator and check the sync block before the next block
+      // header can be read.
+      int sync_indicator;
+      RETURN_IF_FALSE(stream_->ReadInt(&sync_indicator, &parse_status_));
+      if (sync_indicator != -1) {
+        if (state_->LogHasSpace()) {
+          stringstream ss;
+          ss << "Expecting sync indicator (-1) at file offset "
+             << (stream_->file_offset() - sizeof(int)) << ".  "
+             << "Sync indicator found " << sync_indicator << ".";
+          state_->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
+        }
+        return Status("Bad sync hash");
+      }
+      RETURN_IF_ERROR(ReadSync());
+    }
+
+    if (blocks_in_flight() == 0) return Status::OK;
+
+    // Consume the oldest block in flight.
+    MemPool* pool;
+    uint8_t* data;
+    int64_t len;
+    Status status = GetDecompressedBlock(&pool, &data, &len);
+    DCHECK(!pending_record_counts_.empty());
+    int64_t num_records = pending_record_counts_.front();
+    pending_record_counts_.pop_front();
+    if (!status.ok()) {
+      pool->FreeAll();
+      delete pool;
+      return status;
+    }
+
+    // Pass the previous blocks' buffers to the row batch and take ownership of this
+    // block's memory; tuples may reference it until the batch is finalized.
+    AttachPool(data_buffer_pool_.get(), true);
+    data_buffer_pool_->AcquireData(pool, false);
+    delete pool;
+
+    unparsed_data_buffer_ = data;
+    next_record_in_compressed_block_ = data;
+    num_buffered_records_in_compressed_block_ = num_records;
+    while (num_buffered_records_in_compressed_block_ > 0) {
+      RETURN_IF_ERROR(ProcessDecompressedBlock());
+    }
+  }
+
+  return Status::OK;
+}
+
+Status HdfsSequenceScanner::ReadAndQueueCompressedBlock() {
+  int64_t num_records;
+  RETURN_IF_FALSE(stream_->ReadVLong(&num_records, &parse_status_));
+  if (num_records < 0) {
+    if (state_->LogHasSpace()) {
+      stringstream ss;
+      ss << "Bad compressed block record count: " << num_records;
+      state_->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
+    }
+    return Status("bad record count");
+  }
+
+  // Skip the compressed key length and key buffers, we don't need them.
+  RETURN_IF_FALSE(stream_->SkipText(&parse_status_));
+  RETURN_IF_FALSE(stream_->SkipText(&parse_status_));
+
+  // Skip the compressed value length buffer. We don't need these either since the
+  // records are in Text format with length included.
+  RETURN_IF_FALSE(stream_->SkipText(&parse_status_));
+
+  // Read the compressed value buffer from the unbuffered stream.
+  int64_t block_size = 0;
+  RETURN_IF_FALSE(stream_->ReadVLong(&block_size, &parse_status_));
+  // Check for a reasonable size
+  if (block_size > MAX_BLOCK_SIZE || block_size < 0) {
+    stringstream ss;
+    ss << "Compressed block size is: " << block_size;
+    return Status(ss.str());
+  }
+
+  uint8_t* compressed_data = NULL;
+  RETURN_IF_FALSE(stream_->ReadBytes(block_size, &compressed_data, &parse_status_));
+
+  // Copy the compressed bytes so the stream can keep advancing while the block is
+  // in flight; the stream's buffers are recycled as it is read past them.
+  CompressedBlock block;
+  block.pool = new MemPool(scan_node_->mem_tracker());
+  block.data = block.pool->Allocate(block_size);
+  block.len = block_size;
+  memcpy(block.data, compressed_data, block_size);
+  if (!QueueCompressedBlock(block)) {
+    block.pool->FreeAll();
+    delete block.pool;
+    return Status("Decompression pipeline was shut down");
+  }
+  pending_record_counts_.push_back(num_records);
+  return Status::OK;
+}
+
 Status HdfsSequenceScanner::ProcessDecompressedBlock() {
   MemPool* pool;
   TupleRow* tuple_row;
@@ -381,8 +521,17 @@ Status HdfsSequenceScanner::ReadFileHeader() {
     RETURN_IF_FALSE(stream_->ReadText(&codec_ptr, &len, &parse_status_));
     header_->codec = string(reinterpret_cast<char*>(codec_ptr), len);
     Codec::CodecMap::const_iterator it = Codec::CODEC_MAP.find(header_->codec);
-    DCHECK(it != Codec::CODEC_MAP.end());
-    header_->compression_type = it->second;
+    if (it != Codec::CODEC_MAP.end()) {
+      header_->compression_type = it->second;
+    } else if (Codec::IsPluginCodec(header_->codec)) {
+      // Plugin codecs have no THdfsCompression enum value; DEFAULT is only used for
+      // bookkeeping here. The decompressor is created by codec name.
+      header_->compression_type = THdfsCompression::DEFAULT;
+    } else {
+      stringstream ss;
+      ss << Codec::UNKNOWN_CODEC_ERROR << header_->codec;
+      return Status(ss.str());
+    }
   } else {
     header_->compression_type = THdfsCompression::NONE;
   }
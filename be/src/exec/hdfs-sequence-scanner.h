@@ -147,6 +147,8 @@
 //
 // Text ::= VInt, Chars (Length prefixed UTF-8 characters)
 
+#include <deque>
+
 #include "exec/base-sequence-scanner.h"
 
 namespace impala {
@@ -207,6 +209,18 @@ class HdfsSequenceScanner : public BaseSequenceScanner {
   // ProcessBlockCompressedScanRange.
   Status ProcessDecompressedBlock();
 
+  // Variant of ProcessBlockCompressedScanRange() used when
+  // --seq_pipelined_decompression is enabled: reads ahead up to PIPELINE_DEPTH
+  // compressed blocks, handing them to the decompression pipeline thread, and
+  // materializes decompressed blocks as they become ready.
+  Status ProcessBlockCompressedScanRangePipelined();
+
+  // Reads the next compressed block like ReadCompressedBlock(), but instead of
+  // decompressing inline, copies the compressed bytes and queues them on the
+  // decompression pipeline. The block's record count is appended to
+  // pending_record_counts_.
+  Status ReadAndQueueCompressedBlock();
+
   // Read compressed or uncompressed records from the byte stream into memory
   // in unparsed_data_buffer_pool_.  Not used for block compressed files.
   // Output:
@@ -253,6 +267,10 @@ class HdfsSequenceScanner : public BaseSequenceScanner {
 
   // Next record from block compressed data.
   uint8_t* next_record_in_compressed_block_;
+
+  // Record counts of the compressed blocks currently in flight through the
+  // decompression pipeline, in queue order.
+  std::deque<int64_t> pending_record_counts_;
 };
 
 } // namespace impala
@@ -195,11 +195,13 @@ Status HdfsSequenceTableWriter::WriteCompressedBlock() {
 
 inline void HdfsSequenceTableWriter::WriteEscapedString(const StringValue* str_val,
                                                        WriteStream* buf) {
+  // Worst case every byte needs escaping, so reserve once and append unchecked.
+  buf->Reserve(str_val->len * 2);
   for (int i = 0; i < str_val->len; ++i) {
     if (str_val->ptr[i] == field_delim_ || str_val->ptr[i] == escape_char_) {
-      buf->WriteByte(escape_char_);
+      buf->WriteByteUnchecked(escape_char_);
     }
-    buf->WriteByte(str_val->ptr[i]);
+    buf->WriteByteUnchecked(str_val->ptr[i]);
   }
 }
 
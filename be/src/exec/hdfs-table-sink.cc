@@ -27,8 +27,10 @@
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/string-value.inline.h"
+#include "common/atomic.h"
 #include "util/impalad-metrics.h"
 #include "runtime/mem-tracker.h"
+#include "util/promise.h"
 #include "util/url-coding.h"
 
 #include <vector>
@@ -42,9 +44,15 @@
 #include "gen-cpp/ImpalaInternalService_constants.h"
 
 using namespace std;
+using namespace boost;
 using namespace strings;
 using namespace boost::posix_time;
 
+DEFINE_int32(insert_writer_threads, 1, "(Advanced) Number of threads each HDFS table "
+    "sink instance uses to encode, compress and write the output of different "
+    "partitions concurrently during dynamically partitioned inserts. 1 (the default) "
+    "keeps the single-threaded sink behavior.");
+
 namespace impala {
 
 const static string& ROOT_PARTITION_KEY =
@@ -152,6 +160,15 @@ Status HdfsTableSink::Prepare(RuntimeState* state) {
   hdfs_write_timer_ = ADD_TIMER(profile(), "HdfsWriteTimer");
   compress_timer_ = ADD_TIMER(profile(), "CompressTimer");
 
+  if (FLAGS_insert_writer_threads > 1) {
+    // The queue length only throttles how far ahead Send() can enqueue work for a
+    // single batch; Offer() blocking on a full queue is harmless since the workers are
+    // busy draining it.
+    writer_thread_pool_.reset(new ThreadPool<PartitionWriteTask>("hdfs-table-sink",
+        "insert-writer", FLAGS_insert_writer_threads, 1024,
+        bind<void>(&HdfsTableSink::WritePartitionFromThreadPool, this, _1, _2)));
+  }
+
   return Status::OK;
 }
 
@@ -308,7 +325,12 @@ Status HdfsTableSink::CreateNewTmpFile(RuntimeState* state,
   dest << output_partition->final_hdfs_file_name_prefix
        << "." << output_partition->num_files
        << "." << output_partition->writer->file_extension();
-  (*state->hdfs_files_to_move())[output_partition->current_file_name] = dest.str();
+  {
+    // Writer pool threads rolling over files for different partitions update this map
+    // concurrently.
+    boost::lock_guard<boost::mutex> l(runtime_state_maps_lock_);
+    (*state->hdfs_files_to_move())[output_partition->current_file_name] = dest.str();
+  }
 
   ++output_partition->num_files;
   output_partition->num_rows = 0;
@@ -387,30 +409,41 @@ Status HdfsTableSink::InitOutputPartition(RuntimeState* state,
   // could incorrectly create an empty file or empty partition.
   if (has_empty_input_batch_) return Status::OK;
 
+  // Writers run concurrently on pool threads and ExprContexts are single-threaded, so
+  // give each partition writer its own clone of the output exprs. The writers copy the
+  // vector passed to their constructors.
+  const vector<ExprContext*>* writer_output_expr_ctxs = &output_expr_ctxs_;
+  if (writer_thread_pool_.get() != NULL) {
+    cloned_output_expr_ctxs_.push_back(vector<ExprContext*>());
+    RETURN_IF_ERROR(
+        Expr::Clone(output_expr_ctxs_, state, &cloned_output_expr_ctxs_.back()));
+    writer_output_expr_ctxs = &cloned_output_expr_ctxs_.back();
+  }
+
   switch (partition_descriptor.file_format()) {
     case THdfsFileFormat::TEXT:
       output_partition->writer.reset(
           new HdfsTextTableWriter(
               this, state, output_partition, &partition_descriptor, table_desc_,
-              output_expr_ctxs_));
+              *writer_output_expr_ctxs));
       break;
     case THdfsFileFormat::PARQUET:
       output_partition->writer.reset(
           new HdfsParquetTableWriter(
               this, state, output_partition, &partition_descriptor, table_desc_,
-              output_expr_ctxs_));
+              *writer_output_expr_ctxs));
       break;
     case THdfsFileFormat::SEQUENCE_FILE:
       output_partition->writer.reset(
           new HdfsSequenceTableWriter(
               this, state, output_partition, &partition_descriptor, table_desc_,
-              output_expr_ctxs_));
+              *writer_output_expr_ctxs));
       break;
     case THdfsFileFormat::AVRO:
       output_partition->writer.reset(
           new HdfsAvroTableWriter(
               this, state, output_partition, &partition_descriptor, table_desc_,
-              output_expr_ctxs_));
+              *writer_output_expr_ctxs));
       break;
     default:
       stringstream error_msg;
@@ -490,10 +523,58 @@ inline Status HdfsTableSink::GetOutputPartition(
   return Status::OK;
 }
 
+// State shared by the parallel partition writes of one Send() call. Each task reads
+// 'state' and 'batch'; 'status' records the first error and is protected by
+// 'status_lock'. The task that finishes last signals 'done'.
+struct HdfsTableSink::BatchWriteState {
+  BatchWriteState() : state(NULL), batch(NULL), num_remaining(0L) {}
+
+  RuntimeState* state;
+  RowBatch* batch;
+  boost::mutex status_lock;
+  Status status;
+  AtomicInt<int64_t> num_remaining;
+  Promise<bool> done;
+};
+
+Status HdfsTableSink::WritePartitionRows(RuntimeState* state, RowBatch* batch,
+    PartitionPair* partition_pair) {
+  // Pass the rows to the writer. If new_file is returned true then the current file is
+  // finalized and a new file is opened. The writer tracks where it is in the batch when
+  // it returns with new_file set.
+  OutputPartition* output_partition = partition_pair->first;
+  bool new_file;
+  do {
+    RETURN_IF_ERROR(output_partition->writer->AppendRowBatch(
+        batch, partition_pair->second, &new_file));
+    if (new_file) {
+      RETURN_IF_ERROR(FinalizePartitionFile(state, output_partition));
+      RETURN_IF_ERROR(CreateNewTmpFile(state, output_partition));
+    }
+  } while (new_file);
+  partition_pair->second.clear();
+  return Status::OK;
+}
+
+void HdfsTableSink::WritePartitionFromThreadPool(uint32_t thread_id,
+    const PartitionWriteTask& task) {
+  BatchWriteState* batch_state = task.first;
+  Status status =
+      WritePartitionRows(batch_state->state, batch_state->batch, task.second);
+  if (!status.ok()) {
+    lock_guard<mutex> l(batch_state->status_lock);
+    if (batch_state->status.ok()) batch_state->status = status;
+  }
+  if (batch_state->num_remaining.UpdateAndFetch(-1) == 0) batch_state->done.Set(true);
+}
+
 Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
   ExprContext::FreeLocalAllocations(output_expr_ctxs_);
   ExprContext::FreeLocalAllocations(partition_key_expr_ctxs_);
+  for (int i = 0; i < cloned_output_expr_ctxs_.size(); ++i) {
+    ExprContext::FreeLocalAllocations(cloned_output_expr_ctxs_[i]);
+  }
   RETURN_IF_ERROR(state->CheckQueryState());
   DCHECK(eos || batch->num_rows() > 0);
   has_empty_input_batch_ = batch->num_rows() == 0 && eos;
@@ -506,19 +587,7 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
     // delete the existing data for 'insert overwrite'.
     RETURN_IF_ERROR(GetOutputPartition(state, ROOT_PARTITION_KEY, &partition_pair));
     if (!has_empty_input_batch_) {
-      // Pass the row batch to the writer. If new_file is returned true then the current
-      // file is finalized and a new file is opened.
-      // The writer tracks where it is in the batch when it returns with new_file set.
-      OutputPartition* output_partition = partition_pair->first;
-      bool new_file;
-      do {
-        RETURN_IF_ERROR(output_partition->writer->AppendRowBatch(
-            batch, partition_pair->second, &new_file));
-        if (new_file) {
-          RETURN_IF_ERROR(FinalizePartitionFile(state, output_partition));
-          RETURN_IF_ERROR(CreateNewTmpFile(state, output_partition));
-        }
-      } while (new_file);
+      RETURN_IF_ERROR(WritePartitionRows(state, batch, partition_pair));
     }
   } else {
     for (int i = 0; i < batch->num_rows(); ++i) {
@@ -530,21 +599,37 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
       RETURN_IF_ERROR(GetOutputPartition(state, key, &partition_pair));
       partition_pair->second.push_back(i);
     }
-    for (PartitionMap::iterator partition = partition_keys_to_output_partitions_.begin();
-         partition != partition_keys_to_output_partitions_.end(); ++partition) {
-      OutputPartition* output_partition = partition->second.first;
-      if (partition->second.second.empty()) continue;
-
-      bool new_file;
-      do {
-        RETURN_IF_ERROR(output_partition->writer->AppendRowBatch(
-            batch, partition->second.second, &new_file));
-        if (new_file) {
-          RETURN_IF_ERROR(FinalizePartitionFile(state, output_partition));
-          RETURN_IF_ERROR(CreateNewTmpFile(state, output_partition));
+    if (writer_thread_pool_.get() == NULL) {
+      for (PartitionMap::iterator partition =
+              partition_keys_to_output_partitions_.begin();
+           partition != partition_keys_to_output_partitions_.end(); ++partition) {
+        if (partition->second.second.empty()) continue;
+        RETURN_IF_ERROR(WritePartitionRows(state, batch, &partition->second));
+      }
+    } else {
+      // Hand each partition's pending rows to the writer pool so that encoding and
+      // compression of different partitions proceed concurrently. Count the tasks
+      // first so the countdown cannot reach zero before the last task is offered.
+      int num_tasks = 0;
+      for (PartitionMap::iterator partition =
+              partition_keys_to_output_partitions_.begin();
+           partition != partition_keys_to_output_partitions_.end(); ++partition) {
+        if (!partition->second.second.empty()) ++num_tasks;
+      }
+      if (num_tasks > 0) {
+        BatchWriteState batch_state;
+        batch_state.state = state;
+        batch_state.batch = batch;
+        batch_state.num_remaining = num_tasks;
+        for (PartitionMap::iterator partition =
+                partition_keys_to_output_partitions_.begin();
+             partition != partition_keys_to_output_partitions_.end(); ++partition) {
+          if (partition->second.second.empty()) continue;
+          writer_thread_pool_->Offer(make_pair(&batch_state, &partition->second));
         }
-      } while (new_file);
-      partition->second.second.clear();
+        batch_state.done.Get();
+        RETURN_IF_ERROR(batch_state.status);
+      }
     }
   }
 
@@ -571,6 +656,9 @@ Status HdfsTableSink::FinalizePartitionFile(RuntimeState* state,
 
     // Track total number of appended rows per partition in runtime
     // state. partition->num_rows counts number of rows appended is per-file.
+    // Writer pool threads finalizing files for different partitions update the map
+    // concurrently.
+    boost::lock_guard<boost::mutex> l(runtime_state_maps_lock_);
     PartitionStatusMap::iterator it =
         state->per_partition_status()->find(partition->partition_name);
 
@@ -618,6 +706,12 @@ void HdfsTableSink::Close(RuntimeState* state) {
     HdfsPartitionDescriptor* partition = id_to_desc.second;
     partition->CloseExprs(state);
   }
+  // All writes have completed by this point; stop the writer pool before closing the
+  // expr clones its writers were evaluating.
+  if (writer_thread_pool_.get() != NULL) writer_thread_pool_->DrainAndShutdown();
+  for (int i = 0; i < cloned_output_expr_ctxs_.size(); ++i) {
+    Expr::Close(cloned_output_expr_ctxs_[i], state);
+  }
   Expr::Close(output_expr_ctxs_, state);
   Expr::Close(partition_key_expr_ctxs_, state);
   closed_ = true;
@@ -19,12 +19,14 @@
 #include <hdfs.h>
 #include <boost/unordered_map.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 // needed for scoped_ptr to work on ObjectPool
 #include "common/object-pool.h"
 #include "exec/data-sink.h"
 #include "runtime/descriptors.h"
 #include "util/runtime-profile.h"
+#include "util/thread-pool.h"
 
 namespace impala {
 
@@ -176,6 +178,27 @@ class HdfsTableSink : public DataSink {
   typedef std::pair<OutputPartition*, std::vector<int32_t> > PartitionPair;
   typedef boost::unordered_map<std::string, PartitionPair> PartitionMap;
 
+  // State shared by the parallel partition writes of one Send() call. Defined in the
+  // .cc file.
+  struct BatchWriteState;
+
+  // Work item for writer_thread_pool_: one partition with pending rows from the batch
+  // currently being processed by Send().
+  typedef std::pair<BatchWriteState*, PartitionPair*> PartitionWriteTask;
+
+  // Appends the pending rows of 'partition_pair' from 'batch' to the partition's
+  // writer, finalizing the current file and rolling over to a new one whenever the
+  // writer asks for it, then clears the pending row vector. An empty pending vector
+  // means the entire batch belongs to this partition. Called directly on the
+  // single-threaded path and from writer_thread_pool_ otherwise.
+  Status WritePartitionRows(RuntimeState* state, RowBatch* batch,
+      PartitionPair* partition_pair);
+
+  // Runs WritePartitionRows() for one task of the current batch, records the first
+  // error in the shared BatchWriteState and signals it when the batch's last task has
+  // completed. Invoked from writer_thread_pool_.
+  void WritePartitionFromThreadPool(uint32_t thread_id, const PartitionWriteTask& task);
+
 
   // Generates string key for hash_tbl_ as a concatenation
   // of all evaluated exprs, evaluated against current_row_.
@@ -213,6 +236,11 @@ class HdfsTableSink : public DataSink {
   // Exprs that materialize output values
   std::vector<ExprContext*> output_expr_ctxs_;
 
+  // When the writer pool is enabled, each partition writer evaluates its own clone of
+  // the output exprs, since ExprContexts are single-threaded. One entry per created
+  // partition; closed in Close().
+  std::vector<std::vector<ExprContext*> > cloned_output_expr_ctxs_;
+
   // Current row from the current RowBatch to output
   TupleRow* current_row_;
 
@@ -285,6 +313,16 @@ class HdfsTableSink : public DataSink {
   // Flag to indicate the current input batch passed in Send() is empty. It implies that
   // we must not initialize the OutputPartition writer of a static partition insert.
   bool has_empty_input_batch_;
+
+  // Thread pool that encodes, compresses and writes the output of several partitions
+  // concurrently during dynamically partitioned inserts. NULL if
+  // --insert_writer_threads <= 1 (the single-threaded path). Created in Prepare().
+  boost::scoped_ptr<ThreadPool<PartitionWriteTask> > writer_thread_pool_;
+
+  // Protects the per-partition status and files-to-move maps of the RuntimeState
+  // against concurrent updates from writer_thread_pool_ threads. Taken in
+  // CreateNewTmpFile() and FinalizePartitionFile().
+  boost::mutex runtime_state_maps_lock_;
 };
 }
 #endif
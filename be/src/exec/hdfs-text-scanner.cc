@@ -14,6 +14,8 @@
 
 #include "exec/hdfs-text-scanner.h"
 
+#include <set>
+
 #include "codegen/llvm-codegen.h"
 #include "exec/delimited-text-parser.h"
 #include "exec/delimited-text-parser.inline.h"
@@ -22,6 +24,8 @@
 #include "exec/scanner-context.inline.h"
 #include "exec/text-converter.h"
 #include "exec/text-converter.inline.h"
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "util/codec.h"
@@ -38,6 +42,12 @@ using namespace std;
 DEFINE_bool(debug_disable_streaming_gzip, false, "Debug flag, will be removed. Disables "
     "streaming gzip decompression.");
 
+DEFINE_bool(text_lazy_materialization, false, "If true, text scans convert only the "
+    "columns referenced by predicates before evaluating them, and convert the "
+    "remaining columns only for rows that pass. This speeds up selective scans over "
+    "wide tables but bypasses the codegen'd materialization path, and parse errors in "
+    "deferred columns of filtered-out rows are not reported.");
+
 const char* HdfsTextScanner::LLVM_CLASS_NAME = "class.impala::HdfsTextScanner";
 
 // Suffix for lzo index file: hdfs-filename.index
@@ -45,7 +55,7 @@ const string HdfsTextScanner::LZO_INDEX_SUFFIX = ".index";
 
 // Number of bytes to read when the previous attempt to streaming decompress did not make
 // progress.
-const int64_t GZIP_FIXED_READ_SIZE = 1 * 1024 * 1024;
+const int64_t COMPRESSED_STREAM_FIXED_READ_SIZE = 1 * 1024 * 1024;
 
 HdfsTextScanner::HdfsTextScanner(HdfsScanNode* scan_node, RuntimeState* state)
     : HdfsScanner(scan_node, state),
@@ -57,7 +67,8 @@ HdfsTextScanner::HdfsTextScanner(HdfsScanNode* scan_node, RuntimeState* state)
       boundary_row_(boundary_pool_.get()),
       boundary_column_(boundary_pool_.get()),
       slot_idx_(0),
-      error_in_row_(false) {
+      error_in_row_(false),
+      lazy_materialization_(false) {
 }
 
 HdfsTextScanner::~HdfsTextScanner() {
@@ -408,10 +419,11 @@ Status HdfsTextScanner::FillByteBuffer(bool* eosr, int num_bytes) {
                                   &byte_buffer_read_size_);
     }
     *eosr = stream_->eosr();
-  } else if (!FLAGS_debug_disable_streaming_gzip &&
-      decompression_type_ == THdfsCompression::GZIP) {
+  } else if ((decompression_type_ == THdfsCompression::GZIP &&
+        !FLAGS_debug_disable_streaming_gzip) ||
+      decompression_type_ == THdfsCompression::BZIP2) {
     DCHECK_EQ(num_bytes, 0);
-    RETURN_IF_ERROR(FillByteBufferGzip(eosr));
+    RETURN_IF_ERROR(FillByteBufferCompressedStream(eosr));
   } else {
     DCHECK_EQ(num_bytes, 0);
     RETURN_IF_ERROR(FillByteBufferCompressedFile(eosr));
@@ -421,58 +433,59 @@ Status HdfsTextScanner::FillByteBuffer(bool* eosr, int num_bytes) {
   return status;
 }
 
-Status HdfsTextScanner::FillByteBufferGzip(bool* eosr) {
+Status HdfsTextScanner::FillByteBufferCompressedStream(bool* eosr) {
   // Attach any previously decompressed buffers to the row batch before decompressing
   // any more data.
   if (!decompressor_->reuse_output_buffer()) {
     AttachPool(data_buffer_pool_.get(), false);
   }
 
-  // Gzip compressed text is decompressed as buffers are read from stream_ (unlike
-  // other codecs which decompress the entire file in a single call). A compressed
-  // buffer is passed to ProcessBlockStreaming but it may not consume all of the input.
-  // In the unlikely case that decompressed output is not produced, we attempt to try
-  // again with a reasonably large fixed size input buffer (explicitly calling
-  // GetBytes()) before failing.
+  // Streamable compressed text (gzip and bzip2) is decompressed as buffers are read
+  // from stream_ (unlike other codecs which decompress the entire file in a single
+  // call). A compressed buffer is passed to ProcessBlockStreaming but it may not
+  // consume all of the input. In the unlikely case that decompressed output is not
+  // produced, we attempt to try again with a reasonably large fixed size input buffer
+  // (explicitly calling GetBytes()) before failing.
   bool try_read_fixed_size = false;
   uint8_t* decompressed_buffer = NULL;
   int64_t decompressed_len = 0;
   do {
-    uint8_t* gzip_buffer_ptr = NULL;
-    int64_t gzip_buffer_size = 0;
+    uint8_t* compressed_buffer_ptr = NULL;
+    int64_t compressed_buffer_size = 0;
     // We don't know how many bytes ProcessBlockStreaming() will consume so we set
     // peak=true and then later advance the stream using SkipBytes().
     if (!try_read_fixed_size) {
-      RETURN_IF_ERROR(stream_->GetBuffer(true, &gzip_buffer_ptr, &gzip_buffer_size));
+      RETURN_IF_ERROR(
+          stream_->GetBuffer(true, &compressed_buffer_ptr, &compressed_buffer_size));
     } else {
       Status status;
-      stream_->GetBytes(GZIP_FIXED_READ_SIZE, &gzip_buffer_ptr, &gzip_buffer_size,
-          &status, true);
+      stream_->GetBytes(COMPRESSED_STREAM_FIXED_READ_SIZE, &compressed_buffer_ptr,
+          &compressed_buffer_size, &status, true);
       RETURN_IF_ERROR(status);
       try_read_fixed_size = false;
     }
-    if (gzip_buffer_size == 0) {
+    if (compressed_buffer_size == 0) {
       // If the compressed file was not properly ended, the decoder will not know that
       // the last buffer should have been eos.
       stringstream ss;
-      ss << "Unexpected end of file decompressing gzip. File may be malformed. ";
+      ss << "Unexpected end of compressed text file. File may be malformed. ";
       ss << "file: " << stream_->filename();
       return Status(ss.str());
     }
 
-    int64_t gzip_buffer_bytes_read = 0;
+    int64_t compressed_buffer_bytes_read = 0;
     {
       SCOPED_TIMER(decompress_timer_);
-      RETURN_IF_ERROR(decompressor_->ProcessBlockStreaming(gzip_buffer_size,
-            gzip_buffer_ptr, &gzip_buffer_bytes_read, &decompressed_len,
+      RETURN_IF_ERROR(decompressor_->ProcessBlockStreaming(compressed_buffer_size,
+            compressed_buffer_ptr, &compressed_buffer_bytes_read, &decompressed_len,
             &decompressed_buffer, eosr));
-      DCHECK_GE(gzip_buffer_size, gzip_buffer_bytes_read);
+      DCHECK_GE(compressed_buffer_size, compressed_buffer_bytes_read);
       DCHECK_GE(decompressed_len, 0);
     }
 
     // Skip the bytes in stream_ that were decompressed.
     Status status;
-    stream_->SkipBytes(gzip_buffer_bytes_read, &status);
+    stream_->SkipBytes(compressed_buffer_bytes_read, &status);
     RETURN_IF_ERROR(status);
 
     if (!*eosr && decompressed_len == 0) {
@@ -484,11 +497,11 @@ Status HdfsTextScanner::FillByteBufferGzip(bool* eosr) {
       // make progress, then return an error.
       if (try_read_fixed_size) {
         stringstream ss;
-        ss << "Unable to make progress decoding gzip text. ";
+        ss << "Unable to make progress decoding compressed text. ";
         ss << "file: " << stream_->filename();
         return Status(ss.str());
       }
-      VLOG_FILE << "Unable to make progress decompressing gzip, trying again";
+      VLOG_FILE << "Unable to make progress decompressing stream, trying again";
       try_read_fixed_size = true;
     }
   } while (try_read_fixed_size);
@@ -500,7 +513,7 @@ Status HdfsTextScanner::FillByteBufferGzip(bool* eosr) {
     if (!stream_->eosr()) {
       // TODO: Add a test case that exercises this path.
       stringstream ss;
-      ss << "Unexpected end of gzip stream before end of file: ";
+      ss << "Unexpected end of compressed stream before end of file: ";
       ss << stream_->filename();
       if (state_->LogHasSpace()) {
         state_->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
@@ -616,6 +629,26 @@ Status HdfsTextScanner::Prepare(ScannerContext* context) {
   field_locations_.resize(state_->batch_size() * scan_node_->materialized_slots().size());
   row_end_locations_.resize(state_->batch_size());
 
+  if (FLAGS_text_lazy_materialization && !conjunct_ctxs_.empty()) {
+    // Split the materialized slots into the ones the conjuncts read and the ones
+    // whose conversion can be deferred until the conjuncts have passed.
+    set<SlotId> conjunct_slot_ids;
+    for (int i = 0; i < conjunct_ctxs_.size(); ++i) {
+      vector<SlotId> slot_ids;
+      conjunct_ctxs_[i]->root()->GetSlotIds(&slot_ids);
+      conjunct_slot_ids.insert(slot_ids.begin(), slot_ids.end());
+    }
+    for (int i = 0; i < scan_node_->materialized_slots().size(); ++i) {
+      if (conjunct_slot_ids.count(scan_node_->materialized_slots()[i]->id()) > 0) {
+        conjunct_slot_idxs_.push_back(i);
+      } else {
+        lazy_slot_idxs_.push_back(i);
+      }
+    }
+    // There is no point in two passes if the conjuncts read every slot.
+    lazy_materialization_ = !lazy_slot_idxs_.empty();
+  }
+
   return Status::OK;
 }
 
@@ -707,7 +740,11 @@ int HdfsTextScanner::WriteFields(MemPool* pool, TupleRow* tuple_row,
           num_tuples : scan_node_->limit() - scan_node_->rows_returned();
     int tuples_returned = 0;
     // Call jitted function if possible
-    if (write_tuples_fn_ != NULL) {
+    if (lazy_materialization_) {
+      tuples_returned = WriteAlignedTuplesLazy(pool, tuple_row,
+          batch_->row_byte_size(), fields, num_tuples, max_added_tuples,
+          num_tuples_processed);
+    } else if (write_tuples_fn_ != NULL) {
       tuples_returned = write_tuples_fn_(this, pool, tuple_row,
           batch_->row_byte_size(), fields, num_tuples, max_added_tuples,
           scan_node_->materialized_slots().size(), num_tuples_processed);
@@ -741,6 +778,84 @@ int HdfsTextScanner::WriteFields(MemPool* pool, TupleRow* tuple_row,
   return num_tuples_materialized;
 }
 
+int HdfsTextScanner::WriteAlignedTuplesLazy(MemPool* pool, TupleRow* tuple_row,
+    int row_size, FieldLocation* fields, int num_tuples, int max_added_tuples,
+    int row_idx_start) {
+  DCHECK(tuple_ != NULL);
+  DCHECK(lazy_materialization_);
+  int slots_per_tuple = scan_node_->materialized_slots().size();
+  uint8_t* tuple_row_mem = reinterpret_cast<uint8_t*>(tuple_row);
+  uint8_t* tuple_mem = reinterpret_cast<uint8_t*>(tuple_);
+  Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem);
+
+  uint8_t error[slots_per_tuple];
+
+  int tuples_returned = 0;
+
+  for (int i = 0; i < num_tuples; ++i) {
+    uint8_t error_in_row = false;
+    memset(error, 0, sizeof(error));
+    InitTuple(template_tuple_, tuple);
+
+    // First pass: convert only the slots the conjuncts read.
+    for (int j = 0; j < conjunct_slot_idxs_.size(); ++j) {
+      int slot = conjunct_slot_idxs_[j];
+      int need_escape = false;
+      int len = fields[slot].len;
+      if (UNLIKELY(len < 0)) {
+        len = -len;
+        need_escape = true;
+      }
+      SlotDescriptor* desc = scan_node_->materialized_slots()[slot];
+      bool err = !text_converter_->WriteSlot(desc, tuple,
+          fields[slot].start, len, false, need_escape, pool);
+      error[slot] = err;
+      error_in_row |= err;
+    }
+
+    tuple_row->SetTuple(scan_node_->tuple_idx(), tuple);
+    if (EvalConjuncts(tuple_row)) {
+      // Second pass: the row survived, convert the deferred slots.
+      for (int j = 0; j < lazy_slot_idxs_.size(); ++j) {
+        int slot = lazy_slot_idxs_[j];
+        int need_escape = false;
+        int len = fields[slot].len;
+        if (UNLIKELY(len < 0)) {
+          len = -len;
+          need_escape = true;
+        }
+        SlotDescriptor* desc = scan_node_->materialized_slots()[slot];
+        bool err = !text_converter_->WriteSlot(desc, tuple,
+            fields[slot].start, len, false, need_escape, pool);
+        error[slot] = err;
+        error_in_row |= err;
+      }
+      ++tuples_returned;
+      tuple_mem += tuple_byte_size_;
+      tuple_row_mem += row_size;
+      tuple = reinterpret_cast<Tuple*>(tuple_mem);
+      tuple_row = reinterpret_cast<TupleRow*>(tuple_row_mem);
+    }
+
+    // Report parse errors. Errors in deferred slots of rows that failed the
+    // conjuncts are never seen.
+    if (UNLIKELY(error_in_row)) {
+      if (!ReportTupleParseError(fields, error, i + row_idx_start)) {
+        return -1;
+      }
+    }
+
+    // Advance to the start of the next tuple
+    fields += slots_per_tuple;
+
+    if (tuples_returned == max_added_tuples) {
+      break;
+    }
+  }
+
+  return tuples_returned;
+}
+
 void HdfsTextScanner::CopyBoundaryField(FieldLocation* data, MemPool* pool) {
   bool needs_escape = data->len < 0;
   int copy_len = needs_escape ? -data->len : data->len;
@@ -101,11 +101,12 @@ class HdfsTextScanner : public HdfsScanner {
   // file, decompressing it, and setting the byte_buffer_ptr_ to the decompressed buffer.
   Status FillByteBufferCompressedFile(bool* eosr);
 
-  // Fills the next byte buffer from the gzip compressed data in stream_. Unlike
+  // Fills the next byte buffer from compressed data in stream_ using a decompressor
+  // that supports ProcessBlockStreaming() (gzip and bzip2). Unlike
   // FillByteBufferCompressedFile(), the entire file does not need to be read at once.
   // Buffers from stream_ are decompressed as they are read and byte_buffer_ptr_ is set
   // to available decompressed data.
-  Status FillByteBufferGzip(bool* eosr);
+  Status FillByteBufferCompressedStream(bool* eosr);
 
   // Prepends field data that was from the previous file buffer (This field straddled two
   // file buffers).  'data' already contains the pointer/len from the current file buffer,
@@ -124,6 +125,14 @@ class HdfsTextScanner : public HdfsScanner {
   // Returns the number of tuples added to the row batch.
   int WriteFields(MemPool*, TupleRow* tuple_row_mem, int num_fields, int num_tuples);
 
+  // Variant of HdfsScanner::WriteAlignedTuples() used when lazy materialization is
+  // enabled (see --text_lazy_materialization): converts only the slots referenced by
+  // the conjuncts, evaluates the conjuncts, and converts the remaining slots only for
+  // rows that passed. Arguments and return value are the same as for
+  // WriteAlignedTuples().
+  int WriteAlignedTuplesLazy(MemPool* pool, TupleRow* tuple_row_mem, int row_size,
+      FieldLocation* fields, int num_tuples, int max_added_tuples, int row_idx_start);
+
   // Utility function to write out 'num_fields' to 'tuple_'.  This is used to parse
   // partial tuples.  Returns bytes processed.  If copy_strings is true, strings
   // from fields will be copied into the boundary pool.
@@ -178,6 +187,17 @@ class HdfsTextScanner : public HdfsScanner {
 
   // Time parsing text files
   RuntimeProfile::Counter* parse_delimiter_timer_;
+
+  // If true, WriteFields() converts the slots referenced by the conjuncts first and
+  // the remaining slots only for rows that pass the conjuncts. Set in Prepare() if
+  // --text_lazy_materialization is enabled and there are slots to defer.
+  bool lazy_materialization_;
+
+  // Indices into materialized_slots() of the slots referenced by the conjuncts, and
+  // of the remaining slots whose conversion can be deferred. Only populated if
+  // lazy_materialization_ is true.
+  std::vector<int> conjunct_slot_idxs_;
+  std::vector<int> lazy_slot_idxs_;
 };
 
 }
@@ -23,6 +23,7 @@
 #include "util/codec.h"
 #include "util/compress.h"
 #include "util/hdfs-util.h"
+#include "util/parallel-compress.h"
 
 #include <hdfs.h>
 #include <stdlib.h>
@@ -37,6 +38,12 @@ static const int64_t COMPRESSED_BLOCK_SIZE = 64 * 1024 * 1024;
 // (compressed text is not splittable).
 static const int64_t COMPRESSED_BUFFERED_SIZE = 60 * 1024 * 1024;
 
+// Target chunk size for parallel compression. Each chunk of the buffered data is
+// compressed independently (and concurrently) and the compressed chunks are
+// concatenated in the output file, so the chunk size trades off parallelism against
+// compression ratio.
+static const int64_t COMPRESSION_CHUNK_SIZE = 8 * 1024 * 1024;
+
 namespace impala {
 
 HdfsTextTableWriter::HdfsTextTableWriter(HdfsTableSink* parent,
@@ -173,6 +180,40 @@ Status HdfsTextTableWriter::Flush() {
   const uint8_t* data = uncompressed_data;
   int64_t len = uncompressed_len;
 
+  if (compressor_.get() != NULL &&
+      ParallelCompressor::SupportsStreamConcatenation(codec_) &&
+      uncompressed_len > 2 * COMPRESSION_CHUNK_SIZE) {
+    // Compress the buffered data as a series of independent chunks so that the chunks
+    // can be compressed concurrently. A file made of concatenated gzip (or bzip2, or
+    // hadoop-snappy) streams decompresses to the concatenation of the streams, so the
+    // compressed chunks are simply written out in order.
+    vector<ParallelCompressor::Block> blocks;
+    for (int64_t offset = 0; offset < uncompressed_len;
+         offset += COMPRESSION_CHUNK_SIZE) {
+      ParallelCompressor::Block block;
+      block.input = uncompressed_data + offset;
+      block.input_len = min(COMPRESSION_CHUNK_SIZE, uncompressed_len - offset);
+      blocks.push_back(block);
+    }
+
+    MemPool compress_pool(parent_->mem_tracker());
+    Status status;
+    {
+      SCOPED_TIMER(parent_->compress_timer());
+      status = ParallelCompressor::CompressBlocks(
+          state_->resource_pool(), codec_, &compress_pool, &blocks);
+    }
+    if (status.ok()) {
+      SCOPED_TIMER(parent_->hdfs_write_timer());
+      for (int i = 0; i < blocks.size(); ++i) {
+        status = Write(blocks[i].output, blocks[i].output_len);
+        if (!status.ok()) break;
+      }
+    }
+    compress_pool.FreeAll();
+    return status;
+  }
+
   if (compressor_.get() != NULL) {
     SCOPED_TIMER(parent_->compress_timer());
     uint8_t* compressed_data;
@@ -38,7 +38,7 @@ using namespace apache::hive::service::cli::thrift;
 // of the NDV computation into its output StringVal.
 StringVal IncrementNdvFinalize(FunctionContext* ctx, const StringVal& src) {
   DCHECK(!src.is_null);
-  DCHECK_EQ(src.len, AggregateFunctions::HLL_LEN);
+  DCHECK_EQ(src.len, AggregateFunctions::HllLen());
   StringVal result_str(ctx, src.len);
   memcpy(result_str.ptr, src.ptr, src.len);
   ctx->Free(src.ptr);
@@ -56,8 +56,8 @@ StringVal IncrementNdvFinalize(FunctionContext* ctx, const StringVal& src) {
 // shorter than the input. Otherwise it is set to false, and the input is returned
 // unencoded.
 string EncodeNdv(const string& ndv, bool* is_encoded) {
-  DCHECK_EQ(ndv.size(), AggregateFunctions::HLL_LEN);
-  string encoded_ndv(AggregateFunctions::HLL_LEN, 0);
+  const int ndv_len = ndv.size();
+  string encoded_ndv(ndv_len, 0);
   int idx = 0;
   char last = ndv[0];
 
@@ -65,9 +65,9 @@ string EncodeNdv(const string& ndv, bool* is_encoded) {
   // a byte 0-255, but the actual count is always one more than the encoded value
   // (i.e. in the range 1-256 inclusive).
   uint8_t count = 0;
-  for (int i = 1; i < AggregateFunctions::HLL_LEN; ++i) {
+  for (int i = 1; i < ndv_len; ++i) {
     if (ndv[i] != last || count == numeric_limits<uint8_t>::max()) {
-      if (idx + 2 > AggregateFunctions::HLL_LEN) break;
+      if (idx + 2 > ndv_len) break;
       // Write a (count, value) pair to two successive bytes
       encoded_ndv[idx++] = count;
       count = 0;
@@ -79,7 +79,7 @@ string EncodeNdv(const string& ndv, bool* is_encoded) {
   }
 
   // +2 for the remaining two bytes written below
-  if (idx + 2 > AggregateFunctions::HLL_LEN) {
+  if (idx + 2 > ndv_len) {
     *is_encoded = false;
     return ndv;
   }
@@ -90,21 +90,19 @@ string EncodeNdv(const string& ndv, bool* is_encoded) {
   *is_encoded = true;
   encoded_ndv.resize(idx);
   DCHECK_GT(encoded_ndv.size(), 0);
-  DCHECK_LE(encoded_ndv.size(), AggregateFunctions::HLL_LEN);
+  DCHECK_LE(encoded_ndv.size(), ndv_len);
   return encoded_ndv;
 }
 
 string DecodeNdv(const string& ndv, bool is_encoded) {
   if (!is_encoded) return ndv;
   DCHECK_EQ(ndv.size() % 2, 0);
-  string decoded_ndv(AggregateFunctions::HLL_LEN, 0);
-  int idx = 0;
+  string decoded_ndv;
+  decoded_ndv.reserve(AggregateFunctions::HllLen());
   for (int i = 0; i < ndv.size(); i += 2) {
-    for (int j = 0; j < (static_cast<uint8_t>(ndv[i])) + 1; ++j) {
-      decoded_ndv[idx++] = ndv[i+1];
-    }
+    decoded_ndv.append(static_cast<uint8_t>(ndv[i]) + 1, ndv[i+1]);
   }
-  DCHECK_EQ(idx, AggregateFunctions::HLL_LEN);
+  DCHECK_EQ(decoded_ndv.size(), AggregateFunctions::HllLen());
   return decoded_ndv;
 }
 
@@ -112,7 +110,7 @@ string DecodeNdv(const string& ndv, bool is_encoded) {
 // partition during the incremental computation of column stats. The aggregations are
 // updated during Update(), and the final statistics are computed by Finalize().
 struct PerColumnStats {
-  // Should have length AggregateFunctions::HLL_PRECISION. Intermediate buckets for the
+  // Should have length AggregateFunctions::HllLen(). Intermediate buckets for the
   // HLL calculation.
   string intermediate_ndv;
 
@@ -136,7 +134,7 @@ struct PerColumnStats {
   double avg_width;
 
   PerColumnStats()
-      : intermediate_ndv(AggregateFunctions::HLL_LEN, 0), num_nulls(-1),
+      : intermediate_ndv(AggregateFunctions::HllLen(), 0), num_nulls(-1),
         max_width(0), num_rows(0), avg_width(0) { }
 
   // Updates all aggregate statistics with a new set of measurements.
@@ -147,13 +145,18 @@ struct PerColumnStats {
     DCHECK_GE(max_new_width, 0);
     DCHECK_GE(new_avg_width, 0);
     DCHECK_GE(num_new_nulls, -1);
-    for (int j = 0; j < ndv.size(); ++j) {
-      intermediate_ndv[j] = ::max(intermediate_ndv[j], ndv[j]);
+    // An empty partition updates no HLL buckets, so its intermediate NDV is all
+    // zeroes and merging it is a no-op. Time-partitioned tables often carry many
+    // empty partitions, so skip the bucket loop for them.
+    if (num_new_rows > 0) {
+      for (int j = 0; j < ndv.size(); ++j) {
+        intermediate_ndv[j] = ::max(intermediate_ndv[j], ndv[j]);
+      }
+      max_width = ::max(max_width, max_new_width);
+      avg_width += (new_avg_width * num_new_rows);
+      num_rows += num_new_rows;
     }
     if (num_new_nulls >= 0) num_nulls += num_new_nulls;
-    max_width = ::max(max_width, max_new_width);
-    avg_width += (new_avg_width * num_new_rows);
-    num_rows += num_new_rows;
   }
 
   // Performs any stats computations that are not distributive, that is they may not be
@@ -248,7 +251,7 @@ void FinalizePartitionedColumnStats(const TTableSchema& col_stats_schema,
   TIntermediateColumnStats empty_column_stats;
   bool is_encoded;
   empty_column_stats.__set_intermediate_ndv(
-      EncodeNdv(string(AggregateFunctions::HLL_LEN, 0), &is_encoded));
+      EncodeNdv(string(AggregateFunctions::HllLen(), 0), &is_encoded));
   empty_column_stats.__set_is_ndv_encoded(is_encoded);
   empty_column_stats.__set_num_nulls(0);
   empty_column_stats.__set_max_width(0);
@@ -285,6 +288,10 @@ void FinalizePartitionedColumnStats(const TTableSchema& col_stats_schema,
       }
 
       const TIntermediateColumnStats& int_stats = it->second;
+      // Empty partitions contribute nothing to the merged result; skipping them
+      // avoids decoding a zeroed NDV intermediate (an HllLen() allocation per
+      // column per partition) for every empty partition in the table.
+      if (int_stats.num_rows == 0 && int_stats.num_nulls <= 0) continue;
       stats[i].Update(DecodeNdv(int_stats.intermediate_ndv, int_stats.is_ndv_encoded),
           int_stats.num_rows, int_stats.avg_width, int_stats.max_width,
           int_stats.num_nulls);
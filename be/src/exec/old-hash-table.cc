@@ -116,41 +116,41 @@ bool OldHashTable::EvalRow(
   return has_null;
 }
 
-void OldHashTable::AddBitmapFilters() {
+void OldHashTable::AddBloomFilters() {
   DCHECK_EQ(build_expr_ctxs_.size(), probe_expr_ctxs_.size());
-  vector<pair<SlotId, Bitmap*> > bitmaps;
-  bitmaps.resize(probe_expr_ctxs_.size());
+  vector<pair<SlotId, BloomFilter*> > filters;
+  filters.resize(probe_expr_ctxs_.size());
   for (int i = 0; i < build_expr_ctxs_.size(); ++i) {
     if (probe_expr_ctxs_[i]->root()->is_slotref()) {
-      bitmaps[i].first =
+      filters[i].first =
           reinterpret_cast<SlotRef*>(probe_expr_ctxs_[i]->root())->slot_id();
-      bitmaps[i].second = new Bitmap(state_->slot_filter_bitmap_size());
+      filters[i].second = new BloomFilter(state_->slot_filter_num_bits());
     } else {
-      bitmaps[i].second = NULL;
+      filters[i].second = NULL;
     }
   }
 
-  // Walk the build table and generate a bitmap for each probe side slot.
+  // Walk the build table and generate a bloom filter for each probe side slot.
   OldHashTable::Iterator iter = Begin();
   while (iter != End()) {
     TupleRow* row = iter.GetRow();
     for (int i = 0; i < build_expr_ctxs_.size(); ++i) {
-      if (bitmaps[i].second == NULL) continue;
+      if (filters[i].second == NULL) continue;
       void* e = build_expr_ctxs_[i]->GetValue(row);
       uint32_t h =
           RawValue::GetHashValue(e, build_expr_ctxs_[i]->root()->type(), initial_seed_);
-      bitmaps[i].second->Set<true>(h, true);
+      filters[i].second->Insert(h);
     }
     iter.Next<false>();
   }
 
-  // Add all the bitmaps to the runtime state.
+  // Add all the bloom filters to the runtime state.
   bool acquired_ownership = false;
-  for (int i = 0; i < bitmaps.size(); ++i) {
-    if (bitmaps[i].second == NULL) continue;
-    state_->AddBitmapFilter(bitmaps[i].first, bitmaps[i].second, &acquired_ownership);
-    VLOG(2) << "Bitmap filter added on slot: " << bitmaps[i].first;
-    if (!acquired_ownership) delete bitmaps[i].second;
+  for (int i = 0; i < filters.size(); ++i) {
+    if (filters[i].second == NULL) continue;
+    state_->AddBloomFilter(filters[i].first, filters[i].second, &acquired_ownership);
+    VLOG(2) << "Bloom filter added on slot: " << filters[i].first;
+    if (!acquired_ownership) delete filters[i].second;
   }
 }
 
@@ -196,6 +196,38 @@ static void CodegenAssignNullValue(LlvmCodeGen* codegen,
         null_value = ConstantFP::get(codegen->context(), APFloat(fvn_seed_double));
         break;
       }
+      case TYPE_TIMESTAMP: {
+        // TimestampValue is hashed and compared as its raw 16 bytes, so write the
+        // seed pattern over the whole value, the same bytes the interpreted path
+        // copies from NULL_VALUE.
+        dst = builder->CreateBitCast(dst,
+            PointerType::get(Type::getIntNTy(codegen->context(), 128), 0));
+        uint64_t seed_words[] = { static_cast<uint64_t>(fvn_seed),
+                                  static_cast<uint64_t>(fvn_seed) };
+        null_value = ConstantInt::get(codegen->context(), APInt(128, seed_words));
+        break;
+      }
+      case TYPE_DECIMAL: {
+        // Decimals are stored in the results buffer as their unscaled integer of
+        // 4, 8 or 16 bytes.
+        switch (type.GetByteSize()) {
+          case 4:
+            null_value = codegen->GetIntConstant(TYPE_INT, fvn_seed);
+            break;
+          case 8:
+            null_value = codegen->GetIntConstant(TYPE_BIGINT, fvn_seed);
+            break;
+          case 16: {
+            uint64_t seed_words[] = { static_cast<uint64_t>(fvn_seed),
+                                      static_cast<uint64_t>(fvn_seed) };
+            null_value = ConstantInt::get(codegen->context(), APInt(128, seed_words));
+            break;
+          }
+          default:
+            DCHECK(false) << "Invalid decimal byte size: " << type.GetByteSize();
+        }
+        break;
+      }
       default:
         DCHECK(false);
     }
@@ -231,11 +263,10 @@ static void CodegenAssignNullValue(LlvmCodeGen* codegen,
 // becomes the start of the next block for codegen (either the next expr or just the
 // end of the function).
 Function* OldHashTable::CodegenEvalTupleRow(RuntimeState* state, bool build) {
-  // TODO: CodegenAssignNullValue() can't handle TYPE_TIMESTAMP or TYPE_DECIMAL yet
+  // Disable codegen for CHAR
   const vector<ExprContext*>& ctxs = build ? build_expr_ctxs_ : probe_expr_ctxs_;
   for (int i = 0; i < ctxs.size(); ++i) {
-    PrimitiveType type = ctxs[i]->root()->type().type;
-    if (type == TYPE_TIMESTAMP || type == TYPE_DECIMAL) return NULL;
+    if (ctxs[i]->root()->type().type == TYPE_CHAR) return NULL;
   }
 
   LlvmCodeGen* codegen;
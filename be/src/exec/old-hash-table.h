@@ -21,7 +21,7 @@
 #include "codegen/impala-ir.h"
 #include "common/logging.h"
 #include "runtime/mem-pool.h"
-#include "util/bitmap.h"
+#include "util/bloom-filter.h"
 #include "util/hash-util.h"
 #include "util/runtime-profile.h"
 
@@ -203,13 +203,12 @@ class OldHashTable {
     return expr_value_null_bits_[expr_idx];
   }
 
-  // Can be called after all insert calls to add bitmap filters for the probe
+  // Can be called after all insert calls to add bloom filters for the probe
   // side values.
-  // For each probe_expr_ that is a slot ref, generate a bitmap filter on that slot.
-  // These filters are added to the runtime state.
-  // The bitmap filter is similar to a Bloom filter in that has no false negatives
-  // but will have false positives.
-  void AddBitmapFilters();
+  // For each probe_expr_ that is a slot ref, generate a bloom filter on that slot.
+  // These filters are added to the runtime state. They have no false negatives but
+  // will have false positives.
+  void AddBloomFilters();
 
   // Returns an iterator at the beginning of the hash table.  Advancing this iterator
   // will traverse all elements.
@@ -29,6 +29,106 @@ Status PartitionedAggregationNode::ProcessBatchNoGrouping(
   return Status::OK;
 }
 
+template<typename SRC, typename DST>
+void PartitionedAggregationNode::ApplySumLoop(const SimpleAggUpdate& agg) {
+  const int num_updates = pending_updates_.size();
+  for (int i = 0; i < num_updates; ++i) {
+    Tuple* input_tuple = pending_updates_[i].second->GetTuple(agg.input_tuple_idx);
+    if (agg.input_tuple_is_nullable && input_tuple == NULL) continue;
+    if (input_tuple->IsNull(agg.input_null_indicator)) continue;
+    SRC src = *reinterpret_cast<const SRC*>(input_tuple->GetSlot(agg.input_slot_offset));
+    Tuple* dst_tuple = pending_updates_[i].first;
+    DST* dst = reinterpret_cast<DST*>(dst_tuple->GetSlot(agg.dst_slot_offset));
+    if (UNLIKELY(dst_tuple->IsNull(agg.dst_null_indicator))) {
+      dst_tuple->SetNotNull(agg.dst_null_indicator);
+      *dst = src;
+    } else {
+      *dst += src;
+    }
+  }
+}
+
+template<typename T, bool IS_MIN>
+void PartitionedAggregationNode::ApplyMinMaxLoop(const SimpleAggUpdate& agg) {
+  const int num_updates = pending_updates_.size();
+  for (int i = 0; i < num_updates; ++i) {
+    Tuple* input_tuple = pending_updates_[i].second->GetTuple(agg.input_tuple_idx);
+    if (agg.input_tuple_is_nullable && input_tuple == NULL) continue;
+    if (input_tuple->IsNull(agg.input_null_indicator)) continue;
+    T src = *reinterpret_cast<const T*>(input_tuple->GetSlot(agg.input_slot_offset));
+    Tuple* dst_tuple = pending_updates_[i].first;
+    T* dst = reinterpret_cast<T*>(dst_tuple->GetSlot(agg.dst_slot_offset));
+    if (UNLIKELY(dst_tuple->IsNull(agg.dst_null_indicator))) {
+      dst_tuple->SetNotNull(agg.dst_null_indicator);
+      *dst = src;
+    } else if (IS_MIN ? src < *dst : src > *dst) {
+      *dst = src;
+    }
+  }
+}
+
+void PartitionedAggregationNode::ApplyCountLoop(const SimpleAggUpdate& agg) {
+  const int num_updates = pending_updates_.size();
+  for (int i = 0; i < num_updates; ++i) {
+    if (agg.has_input) {
+      Tuple* input_tuple = pending_updates_[i].second->GetTuple(agg.input_tuple_idx);
+      if (agg.input_tuple_is_nullable && input_tuple == NULL) continue;
+      if (input_tuple->IsNull(agg.input_null_indicator)) continue;
+    }
+    // The count accumulator is initialized to 0 and is never NULL.
+    ++*reinterpret_cast<int64_t*>(
+        pending_updates_[i].first->GetSlot(agg.dst_slot_offset));
+  }
+}
+
+void PartitionedAggregationNode::ApplySimpleAggUpdates() {
+  DCHECK(use_simple_agg_updates_);
+  for (int a = 0; a < simple_agg_updates_.size(); ++a) {
+    const SimpleAggUpdate& agg = simple_agg_updates_[a];
+    switch (agg.op) {
+      case SimpleAggUpdate::SIMPLE_COUNT:
+        ApplyCountLoop(agg);
+        break;
+      case SimpleAggUpdate::SIMPLE_SUM:
+        switch (agg.input_type) {
+          case TYPE_TINYINT: ApplySumLoop<int8_t, int64_t>(agg); break;
+          case TYPE_SMALLINT: ApplySumLoop<int16_t, int64_t>(agg); break;
+          case TYPE_INT: ApplySumLoop<int32_t, int64_t>(agg); break;
+          case TYPE_BIGINT: ApplySumLoop<int64_t, int64_t>(agg); break;
+          case TYPE_FLOAT: ApplySumLoop<float, double>(agg); break;
+          case TYPE_DOUBLE: ApplySumLoop<double, double>(agg); break;
+          default: DCHECK(false) << agg.input_type;
+        }
+        break;
+      case SimpleAggUpdate::SIMPLE_MIN:
+        switch (agg.input_type) {
+          case TYPE_TINYINT: ApplyMinMaxLoop<int8_t, true>(agg); break;
+          case TYPE_SMALLINT: ApplyMinMaxLoop<int16_t, true>(agg); break;
+          case TYPE_INT: ApplyMinMaxLoop<int32_t, true>(agg); break;
+          case TYPE_BIGINT: ApplyMinMaxLoop<int64_t, true>(agg); break;
+          case TYPE_FLOAT: ApplyMinMaxLoop<float, true>(agg); break;
+          case TYPE_DOUBLE: ApplyMinMaxLoop<double, true>(agg); break;
+          default: DCHECK(false) << agg.input_type;
+        }
+        break;
+      case SimpleAggUpdate::SIMPLE_MAX:
+        switch (agg.input_type) {
+          case TYPE_TINYINT: ApplyMinMaxLoop<int8_t, false>(agg); break;
+          case TYPE_SMALLINT: ApplyMinMaxLoop<int16_t, false>(agg); break;
+          case TYPE_INT: ApplyMinMaxLoop<int32_t, false>(agg); break;
+          case TYPE_BIGINT: ApplyMinMaxLoop<int64_t, false>(agg); break;
+          case TYPE_FLOAT: ApplyMinMaxLoop<float, false>(agg); break;
+          case TYPE_DOUBLE: ApplyMinMaxLoop<double, false>(agg); break;
+          default: DCHECK(false) << agg.input_type;
+        }
+        break;
+      default:
+        DCHECK(false) << agg.op;
+    }
+  }
+  pending_updates_.clear();
+}
+
 template<bool AGGREGATED_ROWS>
 Status PartitionedAggregationNode::ProcessBatch(RowBatch* batch, HashTableCtx* ht_ctx) {
   DCHECK(!hash_partitions_.empty());
@@ -46,7 +146,7 @@ Status PartitionedAggregationNode::ProcessBatch(RowBatch* batch, HashTableCtx* h
     // partition's hash table. If we need to insert it and that fails, due to OOM, we
     // spill the partition. The partition to spill is not necessarily dst_partition,
     // so we can try again to insert the row.
-    Partition* dst_partition = hash_partitions_[hash >> (32 - NUM_PARTITIONING_BITS)];
+    Partition* dst_partition = hash_partitions_[hash >> (32 - num_partitioning_bits_)];
     if (!dst_partition->is_spilled()) {
       DCHECK_NOTNULL(dst_partition->hash_tbl.get());
       DCHECK(dst_partition->aggregated_row_stream->is_pinned());
@@ -59,8 +159,14 @@ Status PartitionedAggregationNode::ProcessBatch(RowBatch* batch, HashTableCtx* h
         // TODO: change HT interface to have FindOrInsert()
         HashTable::Iterator it = ht->Find(ht_ctx, hash);
         if (!it.AtEnd()) {
-          // Row is already in hash table. Do the aggregation and we're done.
-          UpdateTuple(&dst_partition->agg_fn_ctxs[0], it.GetTuple(), row);
+          // Row is already in hash table. Do the aggregation and we're done. If all
+          // the aggregates are simple updates, defer the row so the whole batch's
+          // hits can be applied with the per-aggregate accumulation loops.
+          if (use_simple_agg_updates_) {
+            pending_updates_.push_back(std::make_pair(it.GetTuple(), row));
+          } else {
+            UpdateTuple(&dst_partition->agg_fn_ctxs[0], it.GetTuple(), row);
+          }
           continue;
         }
       } else {
@@ -101,6 +207,11 @@ allocate_tuple:
       // to the stream or we didn't have enough memory to insert it into the hash table.
       // We need to spill until there is enough memory to insert this tuple or
       // dst_partition is spilled.
+      // Spilling unpins a partition's aggregated stream, which would invalidate any
+      // deferred updates into its tuples, so flush them first.
+      if (!AGGREGATED_ROWS && use_simple_agg_updates_ && !pending_updates_.empty()) {
+        ApplySimpleAggUpdates();
+      }
       while (true) {
         RETURN_IF_ERROR(SpillPartition(dst_partition, intermediate_tuple));
         if (!dst_partition->is_spilled()) {
@@ -131,6 +242,81 @@ allocate_tuple:
     return status;
   }
 
+  if (!AGGREGATED_ROWS && use_simple_agg_updates_ && !pending_updates_.empty()) {
+    ApplySimpleAggUpdates();
+  }
+  return Status::OK;
+}
+
+Status PartitionedAggregationNode::ProcessBatchStreaming(RowBatch* batch,
+    RowBatch* out_batch, HashTableCtx* ht_ctx) {
+  DCHECK(is_streaming_preagg_);
+  DCHECK(!hash_partitions_.empty());
+  DCHECK_LE(batch->num_rows(), out_batch->capacity() - out_batch->num_rows());
+
+  int num_passthrough = 0;
+  for (int i = 0; i < batch->num_rows(); ++i) {
+    TupleRow* row = batch->GetRow(i);
+    uint32_t hash = 0;
+    if (!ht_ctx->EvalAndHashProbe(row, &hash)) continue;
+
+    // Streaming mode never spills, so every partition still has its hash table.
+    Partition* dst_partition = hash_partitions_[hash >> (32 - num_partitioning_bits_)];
+    DCHECK(!dst_partition->is_spilled());
+    HashTable* ht = dst_partition->hash_tbl.get();
+    DCHECK(ht != NULL);
+
+    HashTable::Iterator it = ht->Find(ht_ctx, hash);
+    if (!it.AtEnd()) {
+      // The group is already in the hash table; aggregate the row. Streaming mode
+      // never spills, so deferred updates only need to be flushed at batch end.
+      if (use_simple_agg_updates_) {
+        pending_updates_.push_back(std::make_pair(it.GetTuple(), row));
+      } else {
+        UpdateTuple(&dst_partition->agg_fn_ctxs[0], it.GetTuple(), row);
+      }
+      continue;
+    }
+
+    // New group. Absorb it while the partition's stream and hash table have room.
+    Tuple* intermediate_tuple = ConstructIntermediateTuple(dst_partition->agg_fn_ctxs,
+        NULL, dst_partition->aggregated_row_stream.get());
+    if (intermediate_tuple == NULL && using_small_buffers_) {
+      // The streams are still on small buffers; upgrade to io-sized buffers before
+      // giving up on this group.
+      bool got_buffers;
+      RETURN_IF_ERROR(TrySwitchToIoBuffers(&got_buffers));
+      if (got_buffers) {
+        intermediate_tuple = ConstructIntermediateTuple(dst_partition->agg_fn_ctxs,
+            NULL, dst_partition->aggregated_row_stream.get());
+      }
+    }
+    if (intermediate_tuple != NULL && ht->Insert(ht_ctx, intermediate_tuple, hash)) {
+      UpdateTuple(&dst_partition->agg_fn_ctxs[0], intermediate_tuple, row);
+      continue;
+    }
+
+    // The hash tables have stopped absorbing new groups. Instead of spilling, pass
+    // the row through in intermediate form and let the merge aggregation downstream
+    // combine the duplicates. If the tuple made it into the stream but not the hash
+    // table, it was never updated and is ignored when the partition is output.
+    Tuple* passthrough_tuple =
+        ConstructIntermediateTuple(agg_fn_ctxs_, out_batch->tuple_data_pool(), NULL);
+    if (UNLIKELY(passthrough_tuple == NULL)) {
+      Status status = Status::MEM_LIMIT_EXCEEDED;
+      status.AddDetail("Could not allocate memory for a passthrough row in a "
+          "streaming pre-aggregation.");
+      return status;
+    }
+    UpdateTuple(&agg_fn_ctxs_[0], passthrough_tuple, row);
+    TupleRow* out_row = out_batch->GetRow(out_batch->AddRow());
+    out_row->SetTuple(0, passthrough_tuple);
+    out_batch->CommitLastRow();
+    ++num_passthrough;
+  }
+
+  if (use_simple_agg_updates_ && !pending_updates_.empty()) ApplySimpleAggUpdates();
+  COUNTER_ADD(num_passthrough_rows_, num_passthrough);
   return Status::OK;
 }
 
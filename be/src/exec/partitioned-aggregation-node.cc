@@ -33,15 +33,29 @@
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/string-value.inline.h"
+#include "util/bit-util.h"
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
 #include "udf/udf-internal.h"
 #include "util/debug-util.h"
 #include "util/runtime-profile.h"
+#include "util/thread.h"
 
 #include "gen-cpp/Exprs_types.h"
 #include "gen-cpp/PlanNodes_types.h"
 
+// The planner does not yet distinguish pre-aggregations when estimating memory, so
+// streaming mode is opt-in for now.
+DEFINE_bool(enable_streaming_preagg, false, "If true, non-finalizing grouping "
+    "aggregations pass rows through to the output unaggregated when their hash tables "
+    "stop fitting in memory, instead of spilling. The merge aggregation downstream "
+    "combines the passed-through rows.");
+
+DEFINE_int32(agg_pipelined_input_batches, 0, "(Experimental) If > 0, non-streaming "
+    "aggregations read their input on a separate thread, buffering up to this many row "
+    "batches, so that executing the child plan overlaps with updating the hash tables. "
+    "0 reads the input inline.");
+
 using namespace boost;
 using namespace impala;
 using namespace llvm;
@@ -62,19 +76,25 @@ PartitionedAggregationNode::PartitionedAggregationNode(
     output_tuple_desc_(NULL),
     needs_finalize_(tnode.agg_node.need_finalize),
     needs_serialize_(false),
+    is_streaming_preagg_(false),
+    use_simple_agg_updates_(false),
     block_mgr_client_(NULL),
     using_small_buffers_(true),
+    child_eos_(false),
     singleton_output_tuple_(NULL),
     singleton_output_tuple_returned_(true),
     output_partition_(NULL),
     process_row_batch_fn_(NULL),
     build_timer_(NULL),
     get_results_timer_(NULL),
+    num_passthrough_rows_(NULL),
     num_hash_buckets_(NULL),
     partitions_created_(NULL),
     max_partition_level_(NULL),
     num_row_repartitioned_(NULL),
-    num_repartitions_(NULL) {
+    num_repartitions_(NULL),
+    partition_fanout_(PARTITION_FANOUT),
+    num_partitioning_bits_(NUM_PARTITIONING_BITS) {
   DCHECK_EQ(PARTITION_FANOUT, 1 << NUM_PARTITIONING_BITS);
 }
 
@@ -107,9 +127,15 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
 
   mem_pool_.reset(new MemPool(mem_tracker()));
   agg_fn_pool_.reset(new MemPool(expr_mem_tracker()));
+#ifdef ALLOC_PROFILING
+  mem_pool_->set_allocation_counters(allocation_counters());
+  agg_fn_pool_->set_allocation_counters(allocation_counters());
+#endif
 
   build_timer_ = ADD_TIMER(runtime_profile(), "BuildTime");
   get_results_timer_ = ADD_TIMER(runtime_profile(), "GetResultsTime");
+  num_passthrough_rows_ =
+      ADD_COUNTER(runtime_profile(), "RowsPassedThrough", TUnit::UNIT);
   num_hash_buckets_ =
       ADD_COUNTER(runtime_profile(), "HashBuckets", TUnit::UNIT);
   partitions_created_ =
@@ -148,7 +174,10 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     state->obj_pool()->Add(expr);
     build_expr_ctxs_.push_back(new ExprContext(expr));
     state->obj_pool()->Add(build_expr_ctxs_.back());
-    contains_var_len_grouping_exprs_ |= expr->type().IsVarLen();
+    if (expr->type().IsVarLen()) {
+      contains_var_len_grouping_exprs_ = true;
+      var_len_grouping_expr_idxs_.push_back(i);
+    }
   }
   // Construct a new row desc for preparing the build exprs because neither the child's
   // nor this node's output row desc may contain the intermediate tuple, e.g.,
@@ -175,6 +204,41 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     agg_fn_ctxs_.push_back(agg_fn_ctx);
     state->obj_pool()->Add(agg_fn_ctx);
     needs_serialize_ |= aggregate_evaluators_[i]->SupportsSerialize();
+
+    SimpleAggUpdate simple_update;
+    if (IsSimpleAggUpdate(aggregate_evaluators_[i], intermediate_slot_desc,
+        &simple_update)) {
+      simple_agg_updates_.push_back(simple_update);
+    }
+  }
+
+  // The batched accumulation loops are only used if every aggregate supports them.
+  // The merge side of the aggregation cannot use them (e.g. merging a COUNT is a
+  // sum, not an increment), but the hash tables only see unaggregated rows there,
+  // so ProcessBatch<true>() simply never defers updates.
+  use_simple_agg_updates_ = !aggregate_evaluators_.empty() &&
+      simple_agg_updates_.size() == aggregate_evaluators_.size();
+  if (use_simple_agg_updates_) {
+    pending_updates_.reserve(state->batch_size());
+  } else {
+    simple_agg_updates_.clear();
+  }
+
+  // Decide whether to run as a streaming pre-aggregation. Rows can only be passed
+  // through if a merge aggregation runs downstream (!needs_finalize_) and the
+  // conjuncts are evaluated there (so they must be empty here). Var-len or
+  // serialized aggregate intermediates would reference memory owned by this node,
+  // so those disqualify streaming.
+  if (FLAGS_enable_streaming_preagg && !needs_finalize_ && !probe_expr_ctxs_.empty() &&
+      conjunct_ctxs_.empty() && !needs_serialize_) {
+    bool has_var_len_agg_intermediate = false;
+    for (int i = probe_expr_ctxs_.size(); i < intermediate_tuple_desc_->slots().size();
+        ++i) {
+      has_var_len_agg_intermediate |=
+          intermediate_tuple_desc_->slots()[i]->type().IsVarLen();
+    }
+    is_streaming_preagg_ = !has_var_len_agg_intermediate;
+    if (is_streaming_preagg_) AddRuntimeExecOption("Streaming Preaggregation");
   }
 
   if (probe_expr_ctxs_.empty()) {
@@ -191,21 +255,92 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     RETURN_IF_ERROR(CreateHashPartitions(0));
   }
 
-  if (state->codegen_enabled()) {
+  // The codegen'd ProcessBatch() is only used by the Open() consumption loop;
+  // streaming pre-aggregations process their input with ProcessBatchStreaming().
+  if (state->codegen_enabled() && !is_streaming_preagg_) {
     LlvmCodeGen* codegen;
     RETURN_IF_ERROR(state->GetCodegen(&codegen));
     Function* codegen_process_row_batch_fn = CodegenProcessBatch();
     if (codegen_process_row_batch_fn != NULL) {
       codegen->AddFunctionToJit(codegen_process_row_batch_fn,
-          reinterpret_cast<void**>(&process_row_batch_fn_));
+          reinterpret_cast<void**>(&process_row_batch_fn_),
+          ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
       AddRuntimeExecOption("Codegen Enabled");
     }
   }
   return Status::OK;
 }
 
+bool PartitionedAggregationNode::IsSimpleAggUpdate(AggFnEvaluator* evaluator,
+    const SlotDescriptor* intermediate_slot_desc, SimpleAggUpdate* agg) const {
+  if (evaluator->is_merge() || !evaluator->is_builtin()) return false;
+
+  switch (evaluator->agg_op()) {
+    case AggFnEvaluator::COUNT: agg->op = SimpleAggUpdate::SIMPLE_COUNT; break;
+    case AggFnEvaluator::SUM: agg->op = SimpleAggUpdate::SIMPLE_SUM; break;
+    case AggFnEvaluator::MIN: agg->op = SimpleAggUpdate::SIMPLE_MIN; break;
+    case AggFnEvaluator::MAX: agg->op = SimpleAggUpdate::SIMPLE_MAX; break;
+    default: return false;
+  }
+
+  const ColumnType& dst_type = intermediate_slot_desc->type();
+  if (evaluator->is_count_star()) {
+    DCHECK_EQ(dst_type.type, TYPE_BIGINT);
+    agg->has_input = false;
+  } else {
+    // The input must be a direct slot reference so the loop can read it without
+    // evaluating an expr tree per row.
+    if (evaluator->input_expr_ctxs().size() != 1) return false;
+    Expr* input = evaluator->input_expr_ctxs()[0]->root();
+    if (!input->is_slotref()) return false;
+
+    const ColumnType& input_type = input->type();
+    switch (agg->op) {
+      case SimpleAggUpdate::SIMPLE_COUNT:
+        // Counting only needs the null check; the input type does not matter.
+        if (dst_type.type != TYPE_BIGINT) return false;
+        break;
+      case SimpleAggUpdate::SIMPLE_SUM:
+        // Integer sums accumulate into a BIGINT, floating point ones into a DOUBLE.
+        // Anything else (e.g. DECIMAL) goes through the evaluator.
+        if (input_type.type >= TYPE_TINYINT && input_type.type <= TYPE_BIGINT) {
+          if (dst_type.type != TYPE_BIGINT) return false;
+        } else if (input_type.type == TYPE_FLOAT || input_type.type == TYPE_DOUBLE) {
+          if (dst_type.type != TYPE_DOUBLE) return false;
+        } else {
+          return false;
+        }
+        break;
+      case SimpleAggUpdate::SIMPLE_MIN:
+      case SimpleAggUpdate::SIMPLE_MAX:
+        // Only fixed-width numeric types; the accumulator has the input's type.
+        if (input_type.type < TYPE_TINYINT || input_type.type > TYPE_DOUBLE) {
+          return false;
+        }
+        if (dst_type.type != input_type.type) return false;
+        break;
+      default:
+        DCHECK(false);
+        return false;
+    }
+
+    const SlotRef* slot_ref = static_cast<const SlotRef*>(input);
+    agg->has_input = true;
+    agg->input_tuple_idx = slot_ref->tuple_idx();
+    agg->input_slot_offset = slot_ref->slot_offset();
+    agg->input_null_indicator = slot_ref->null_indicator_offset();
+    agg->input_tuple_is_nullable = slot_ref->tuple_is_nullable();
+    agg->input_type = input_type.type;
+  }
+
+  agg->dst_slot_offset = intermediate_slot_desc->tuple_offset();
+  agg->dst_null_indicator = intermediate_slot_desc->null_indicator_offset();
+  return true;
+}
+
 Status PartitionedAggregationNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
 
   RETURN_IF_ERROR(Expr::Open(probe_expr_ctxs_, state));
@@ -225,32 +360,53 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
     DCHECK(serialize_stream_->has_write_block());
   }
 
-  // Read all the rows from the child and process them.
   RETURN_IF_ERROR(children_[0]->Open(state));
-  RowBatch batch(children_[0]->row_desc(), state->batch_size(), mem_tracker());
-  bool eos = false;
-  while (!eos) {
-    RETURN_IF_CANCELLED(state);
-    RETURN_IF_ERROR(QueryMaintenance(state));
-    RETURN_IF_ERROR(children_[0]->GetNext(state, &batch, &eos));
 
-    if (VLOG_ROW_IS_ON) {
-      for (int i = 0; i < batch.num_rows(); ++i) {
-        TupleRow* row = batch.GetRow(i);
-        VLOG_ROW << "input row: " << PrintRow(row, children_[0]->row_desc());
-      }
-    }
+  if (is_streaming_preagg_) {
+    // Streaming mode: the input is consumed in GetNext(), interleaved with producing
+    // output, so rows the hash tables cannot absorb are passed through instead of
+    // spilled.
+    child_batch_.reset(
+        new RowBatch(children_[0]->row_desc(), state->batch_size(), mem_tracker()));
+    return Status::OK;
+  }
 
-    SCOPED_TIMER(build_timer_);
-    if (process_row_batch_fn_ != NULL) {
-      RETURN_IF_ERROR(process_row_batch_fn_(this, &batch, ht_ctx_.get()));
-    } else if (probe_expr_ctxs_.empty()) {
-      RETURN_IF_ERROR(ProcessBatchNoGrouping(&batch));
-    } else {
-      // There is grouping, so we will do partitioned aggregation.
-      RETURN_IF_ERROR(ProcessBatch<false>(&batch, ht_ctx_.get()));
+  if (FLAGS_agg_pipelined_input_batches > 0) {
+    // Pipelined input: a reader thread drives the child plan while this thread
+    // updates the hash tables, overlapping the two. The aggregation itself stays on
+    // this thread because its state - the agg fn FunctionContexts, the codegen'd
+    // process function and the block mgr client - is bound to this node.
+    child_batch_queue_.reset(
+        new BlockingQueue<RowBatch*>(FLAGS_agg_pipelined_input_batches));
+    Thread child_reader("partitioned-aggregation-node", "input-reader",
+        &PartitionedAggregationNode::ChildReaderThread, this, state);
+    Status status;
+    RowBatch* batch;
+    while (child_batch_queue_->BlockingGet(&batch)) {
+      status = QueryMaintenance(state);
+      if (status.ok()) status = ProcessChildBatch(batch);
+      delete batch;
+      if (!status.ok()) break;
+    }
+    // Wakes the reader if we stopped early; harmless if the reader already shut the
+    // queue down itself. It must have exited before we free the batches it queued.
+    child_batch_queue_->Shutdown();
+    child_reader.Join();
+    RowBatch* unconsumed;
+    while (child_batch_queue_->BlockingGet(&unconsumed)) delete unconsumed;
+    RETURN_IF_ERROR(status);
+    RETURN_IF_ERROR(child_reader_status_.Get());
+  } else {
+    // Read all the rows from the child and process them.
+    RowBatch batch(children_[0]->row_desc(), state->batch_size(), mem_tracker());
+    bool eos = false;
+    while (!eos) {
+      RETURN_IF_CANCELLED(state);
+      RETURN_IF_ERROR(QueryMaintenance(state));
+      RETURN_IF_ERROR(children_[0]->GetNext(state, &batch, &eos));
+      RETURN_IF_ERROR(ProcessChildBatch(&batch));
+      batch.Reset();
     }
-    batch.Reset();
   }
 
   // We have consumed all of the input from the child and transfered ownership of the
@@ -267,9 +423,49 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
   return Status::OK;
 }
 
+Status PartitionedAggregationNode::ProcessChildBatch(RowBatch* batch) {
+  if (VLOG_ROW_IS_ON) {
+    for (int i = 0; i < batch->num_rows(); ++i) {
+      TupleRow* row = batch->GetRow(i);
+      VLOG_ROW << "input row: " << PrintRow(row, children_[0]->row_desc());
+    }
+  }
+
+  SCOPED_TIMER(build_timer_);
+  if (process_row_batch_fn_ != NULL) {
+    return process_row_batch_fn_(this, batch, ht_ctx_.get());
+  } else if (probe_expr_ctxs_.empty()) {
+    return ProcessBatchNoGrouping(batch);
+  }
+  // There is grouping, so we will do partitioned aggregation.
+  return ProcessBatch<false>(batch, ht_ctx_.get());
+}
+
+void PartitionedAggregationNode::ChildReaderThread(RuntimeState* state) {
+  Status status;
+  bool eos = false;
+  while (!eos) {
+    if (state->is_cancelled()) {
+      status = Status::CANCELLED;
+      break;
+    }
+    RowBatch* batch =
+        new RowBatch(children_[0]->row_desc(), state->batch_size(), mem_tracker());
+    status = children_[0]->GetNext(state, batch, &eos);
+    if (!status.ok() || !child_batch_queue_->BlockingPut(batch)) {
+      // A failed put means Open() hit an error and shut the queue down.
+      delete batch;
+      break;
+    }
+  }
+  child_batch_queue_->Shutdown();
+  child_reader_status_.Set(status);
+}
+
 Status PartitionedAggregationNode::GetNext(RuntimeState* state,
     RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -301,6 +497,16 @@ Status PartitionedAggregationNode::GetNext(RuntimeState* state,
     return Status::OK;
   }
 
+  if (is_streaming_preagg_ && !child_eos_) {
+    RETURN_IF_ERROR(GetNextStreaming(state, row_batch));
+    if (row_batch->num_rows() > 0 || !child_eos_) {
+      *eos = ReachedLimit();
+      return Status::OK;
+    }
+    // The input is fully consumed and this batch is empty; fall through to start
+    // returning the aggregated partitions.
+  }
+
   if (output_iterator_.AtEnd()) {
     // Done with this partition, move onto the next one.
     if (output_partition_ != NULL) {
@@ -348,6 +554,36 @@ Status PartitionedAggregationNode::GetNext(RuntimeState* state,
   return Status::OK;
 }
 
+Status PartitionedAggregationNode::GetNextStreaming(RuntimeState* state,
+    RowBatch* out_batch) {
+  DCHECK(is_streaming_preagg_);
+  DCHECK(!child_eos_);
+  DCHECK(child_batch_.get() != NULL);
+
+  do {
+    RETURN_IF_CANCELLED(state);
+    RETURN_IF_ERROR(QueryMaintenance(state));
+    RETURN_IF_ERROR(children_[0]->GetNext(state, child_batch_.get(), &child_eos_));
+    SCOPED_TIMER(build_timer_);
+    RETURN_IF_ERROR(
+        ProcessBatchStreaming(child_batch_.get(), out_batch, ht_ctx_.get()));
+    child_batch_->Reset();
+  } while (out_batch->num_rows() == 0 && !child_eos_);
+
+  if (child_eos_) {
+    // We have consumed all of the input and can close the child to release its
+    // resources. Everything the hash tables absorbed stays in memory (nothing
+    // spilled), ready to be returned by the regular output path.
+    child(0)->Close(state);
+    child_batch_.reset();
+    RETURN_IF_ERROR(MoveHashPartitions(child(0)->rows_returned()));
+  }
+
+  num_rows_returned_ += out_batch->num_rows();
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  return Status::OK;
+}
+
 void PartitionedAggregationNode::CleanupHashTbl(const vector<FunctionContext*>& ctxs,
     HashTable::Iterator it) {
   if (!needs_finalize_ && !needs_serialize_) return;
@@ -367,6 +603,8 @@ void PartitionedAggregationNode::Close(RuntimeState* state) {
     FinalizeTuple(agg_fn_ctxs_, singleton_output_tuple_, mem_pool_.get());
   }
 
+  child_batch_.reset();
+
   // Iterate through the remaining rows in the hash table and call Serialize/Finalize on
   // them in order to free any memory allocated by UDAs
   if (output_partition_ != NULL) {
@@ -442,7 +680,7 @@ bool PartitionedAggregationNode::Partition::InitHashTable() {
   // It might be reasonable to limit individual hash table size for other reasons
   // though. Always start with small buffers.
   hash_tbl.reset(new HashTable(parent->state_, parent->block_mgr_client_, 1, NULL,
-      1 << (32 - NUM_PARTITIONING_BITS)));
+      1 << (32 - parent->num_partitioning_bits_)));
   return hash_tbl->Init();
 }
 
@@ -580,8 +818,7 @@ Tuple* PartitionedAggregationNode::ConstructIntermediateTuple(
   Tuple* intermediate_tuple = NULL;
   uint8_t* buffer = NULL;
   if (pool != NULL) {
-    intermediate_tuple = Tuple::Create(
-        intermediate_tuple_desc_->byte_size(), mem_pool_.get());
+    intermediate_tuple = Tuple::Create(intermediate_tuple_desc_->byte_size(), pool);
   } else {
     // Figure out how big it will be to copy the entire tuple. We need the tuple to end
     // up on one block in the stream.
@@ -589,10 +826,11 @@ Tuple* PartitionedAggregationNode::ConstructIntermediateTuple(
     if (contains_var_len_grouping_exprs_) {
       // TODO: This is likely to be too slow. The hash table could maintain this as
       // it hashes.
-      for (int i = 0; i < probe_expr_ctxs_.size(); ++i) {
-        if (!probe_expr_ctxs_[i]->root()->type().IsVarLen()) continue;
-        if (ht_ctx_->last_expr_value_null(i)) continue;
-        StringValue* sv = reinterpret_cast<StringValue*>(ht_ctx_->last_expr_value(i));
+      for (int i = 0; i < var_len_grouping_expr_idxs_.size(); ++i) {
+        int expr_idx = var_len_grouping_expr_idxs_[i];
+        if (ht_ctx_->last_expr_value_null(expr_idx)) continue;
+        StringValue* sv =
+            reinterpret_cast<StringValue*>(ht_ctx_->last_expr_value(expr_idx));
         size += sv->len;
       }
     }
@@ -710,7 +948,7 @@ void PartitionedAggregationNode::DebugString(int indentation_level,
   *out << ")";
 }
 
-Status PartitionedAggregationNode::CreateHashPartitions(int level) {
+Status PartitionedAggregationNode::CreateHashPartitions(int level, int64_t input_bytes) {
   if (level >= MAX_PARTITION_DEPTH) {
     Status status = Status::MEM_LIMIT_EXCEEDED;
     status.SetErrorMsg(ErrorMsg(TErrorCode::PARTITIONED_AGG_MAX_PARTITION_DEPTH,
@@ -720,8 +958,32 @@ Status PartitionedAggregationNode::CreateHashPartitions(int level) {
   }
   ht_ctx_->set_level(level);
 
+  // Pick the fanout for this pass. If the input size is unknown use the default
+  // fanout. Repartitioning passes pass the size of the spilled input partition, so
+  // we widen the fanout so that each output partition should fit in the memory still
+  // available to this node, letting very large inputs be split in one wide pass
+  // instead of several narrow ones. The fanout is bounded by the buffers the block
+  // mgr can still hand out; each partition needs two stream buffers.
+  partition_fanout_ = PARTITION_FANOUT;
+  if (input_bytes > 0) {
+    const int64_t available_buffers =
+        state_->block_mgr()->available_buffers(block_mgr_client_);
+    const int64_t mem_available =
+        available_buffers * state_->block_mgr()->max_block_size();
+    if (mem_available > 0) {
+      int64_t fanout = BitUtil::NextPowerOfTwo(input_bytes / mem_available + 1);
+      fanout = ::min<int64_t>(fanout, MAX_PARTITION_FANOUT);
+      while (fanout > PARTITION_FANOUT && fanout * 2 + 1 > available_buffers) {
+        fanout /= 2;
+      }
+      partition_fanout_ = ::max<int64_t>(fanout, PARTITION_FANOUT);
+    }
+  }
+  num_partitioning_bits_ = BitUtil::Log2(partition_fanout_);
+  DCHECK_EQ(partition_fanout_, 1 << num_partitioning_bits_);
+
   DCHECK(hash_partitions_.empty());
-  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+  for (int i = 0; i < partition_fanout_; ++i) {
     hash_partitions_.push_back(state_->obj_pool()->Add(new Partition(this, level)));
     RETURN_IF_ERROR(hash_partitions_[i]->InitStreams());
   }
@@ -729,12 +991,12 @@ Status PartitionedAggregationNode::CreateHashPartitions(int level) {
 
   // Now that all the streams are reserved (meaning we have enough memory to execute
   // the algorithm), allocate the hash tables. These can fail and we can still continue.
-  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+  for (int i = 0; i < partition_fanout_; ++i) {
     if (!hash_partitions_[i]->InitHashTable()) {
       RETURN_IF_ERROR(hash_partitions_[i]->Spill());
     }
   }
-  COUNTER_ADD(partitions_created_, PARTITION_FANOUT);
+  COUNTER_ADD(partitions_created_, partition_fanout_);
   COUNTER_SET(max_partition_level_, level);
   return Status::OK;
 }
@@ -781,7 +1043,9 @@ Status PartitionedAggregationNode::NextPartition() {
       // TODO: we don't need to repartition here. We are now working on 1 / FANOUT
       // of the input so it's reasonably likely it can fit. We should look at this
       // partitions size and just do the aggregation if it fits in memory.
-      RETURN_IF_ERROR(CreateHashPartitions(partition->level + 1));
+      RETURN_IF_ERROR(CreateHashPartitions(partition->level + 1,
+          partition->aggregated_row_stream->byte_size() +
+          partition->unaggregated_row_stream->byte_size()));
       COUNTER_ADD(num_repartitions_, 1);
 
       // Rows in this partition could have been spilled into two streams, depending
@@ -853,31 +1117,43 @@ Status PartitionedAggregationNode::ProcessStream(BufferedTupleStream* input_stre
   return Status::OK;
 }
 
+Status PartitionedAggregationNode::TrySwitchToIoBuffers(bool* got_buffers) {
+  DCHECK(using_small_buffers_);
+  *got_buffers = true;
+  for (int i = 0; i < hash_partitions_.size(); ++i) {
+    if (hash_partitions_[i]->is_closed) continue;
+    BufferedTupleStream* streams[] = {
+        hash_partitions_[i]->aggregated_row_stream.get(),
+        hash_partitions_[i]->unaggregated_row_stream.get() };
+    for (int j = 0; j < 2; ++j) {
+      // Skip streams that switched on an earlier (partially successful) attempt.
+      if (!streams[j]->using_small_buffers()) continue;
+      bool got_buffer;
+      RETURN_IF_ERROR(streams[j]->SwitchToIoBuffers(&got_buffer));
+      if (!got_buffer) {
+        *got_buffers = false;
+        return Status::OK;
+      }
+    }
+  }
+  using_small_buffers_ = false;
+  return Status::OK;
+}
+
 Status PartitionedAggregationNode::SpillPartition(Partition* curr_partition,
     Tuple* intermediate_tuple) {
   int64_t max_freed_mem = 0;
   int partition_idx = -1;
 
   if (using_small_buffers_) {
-    for (int i = 0; i < hash_partitions_.size(); ++i) {
-      if (hash_partitions_[i]->is_closed) continue;
-      DCHECK(hash_partitions_[i]->aggregated_row_stream->using_small_buffers());
-      DCHECK(hash_partitions_[i]->unaggregated_row_stream->using_small_buffers());
-      bool got_buffer;
-      RETURN_IF_ERROR(
-          hash_partitions_[i]->aggregated_row_stream->SwitchToIoBuffers(&got_buffer));
-      if (got_buffer) {
-        RETURN_IF_ERROR(
-            hash_partitions_[i]->unaggregated_row_stream->SwitchToIoBuffers(&got_buffer));
-      }
-      if (!got_buffer) {
-        Status status = Status::MEM_LIMIT_EXCEEDED;
-        status.AddDetail("Not enough memory to get the minimum required buffers for "
-            "aggregation.");
-        return status;
-      }
+    bool got_buffers;
+    RETURN_IF_ERROR(TrySwitchToIoBuffers(&got_buffers));
+    if (!got_buffers) {
+      Status status = Status::MEM_LIMIT_EXCEEDED;
+      status.AddDetail("Not enough memory to get the minimum required buffers for "
+          "aggregation.");
+      return status;
     }
-    using_small_buffers_ = false;
   }
 
   // Iterate over the partitions and pick the largest partition that is not spilled.
@@ -949,7 +1225,7 @@ Status PartitionedAggregationNode::MoveHashPartitions(int64_t num_input_rows) {
   return Status::OK;
 }
 
-Status PartitionedAggregationNode::QueryMaintenance(RuntimeState* state) {
+Status PartitionedAggregationNode::QueryMaintenanceImpl(RuntimeState* state) {
   for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
     ExprContext::FreeLocalAllocations(aggregate_evaluators_[i]->input_expr_ctxs());
   }
@@ -957,7 +1233,7 @@ Status PartitionedAggregationNode::QueryMaintenance(RuntimeState* state) {
   for (int i = 0; i < hash_partitions_.size(); ++i) {
     ExprContext::FreeLocalAllocations(hash_partitions_[i]->agg_fn_ctxs);
   }
-  return ExecNode::QueryMaintenance(state);
+  return ExecNode::QueryMaintenanceImpl(state);
 }
 
 // IR Generation for updating a single aggregation slot. Signature is:
@@ -1381,7 +1657,8 @@ Function* PartitionedAggregationNode::CodegenProcessBatch() {
 
     process_batch_fn = codegen->ReplaceCallSites(process_batch_fn, true,
         equals_fn, "Equals", &replaced);
-    DCHECK_EQ(replaced, 1);
+    // Find() and the probes inside Insert() all compare keys.
+    DCHECK_GE(replaced, 1);
   }
 
   process_batch_fn = codegen->ReplaceCallSites(process_batch_fn, false,
@@ -17,6 +17,7 @@
 #define IMPALA_EXEC_PARTITIONED_AGGREGATION_NODE_H
 
 #include <functional>
+#include <utility>
 #include <boost/scoped_ptr.hpp>
 
 #include "exec/exec-node.h"
@@ -26,6 +27,8 @@
 #include "runtime/descriptors.h"  // for TupleId
 #include "runtime/mem-pool.h"
 #include "runtime/string-value.h"
+#include "util/blocking-queue.h"
+#include "util/promise.h"
 
 namespace llvm {
   class Function;
@@ -77,7 +80,27 @@ class SlotDescriptor;
 // hash tables will use smaller (less than io-sized) buffers. Once we spill, the streams
 // and hash table will use io-sized buffers only.
 //
+// Streaming pre-aggregation: when --enable_streaming_preagg is set and this node is a
+// non-finalizing grouping aggregation (i.e. a merge aggregation runs downstream), the
+// input is consumed in GetNext() instead of Open(). Rows whose group is already in a
+// hash table are aggregated as usual; rows that would force a spill are instead
+// converted to intermediate form and passed through to the output batch unaggregated,
+// leaving the deduplication to the merge aggregation. This turns high-cardinality
+// pre-aggregations that would spill heavily into pure streaming. This mode is
+// restricted to fixed-length aggregate intermediates that don't require Serialize(),
+// since passed-through tuples cannot reference memory owned by this node.
+//
+// TODO: support evaluating multiple grouping-expr sets (ROLLUP/grouping sets) in one
+// pass over the child. Rollup pipelines are currently planned as a UNION ALL of
+// GROUP BYs, re-scanning the same input once per grouping. The execution side would
+// key a single hash table with (grouping id, grouping exprs), with the grouping id
+// selecting which exprs evaluate to NULL, and update every grouping per input row.
+// This is blocked on the planner and on TAggregationNode carrying a list of
+// grouping-expr sets instead of a single one.
 // TODO: Buffer rows before probing into the hash table?
+// TODO: codegen ProcessBatchStreaming().
+// TODO: pass through based on the observed reduction as well, not only on memory
+// pressure.
 // TODO: after spilling, we can still maintain a very small hash table just to remove
 // some number of rows (from likely going to disk).
 // TODO: consider allowing to spill the hash table structure in addition to the rows.
@@ -103,7 +126,7 @@ class PartitionedAggregationNode : public ExecNode {
 
  protected:
   // Frees local allocations from aggregate_evaluators_ and agg_fn_ctxs
-  virtual Status QueryMaintenance(RuntimeState* state);
+  virtual Status QueryMaintenanceImpl(RuntimeState* state);
 
   virtual void DebugString(int indentation_level, std::stringstream* out) const;
 
@@ -119,6 +142,13 @@ class PartitionedAggregationNode : public ExecNode {
   // the partition so this might be okay.
   static const int NUM_PARTITIONING_BITS = 4;
 
+  // Maximum fanout of a repartitioning pass. Repartitioning passes know the size of
+  // the spilled input partition, so CreateHashPartitions() widens the fanout up to
+  // this (bounded by the buffers the block mgr can still hand out) to split very
+  // large inputs in one wide pass instead of several narrow ones. Must be a power
+  // of two.
+  static const int MAX_PARTITION_FANOUT = 64;
+
   // Maximum number of times we will repartition. The maximum build table we can process
   // (if we have enough scratch disk space) in case there is no skew is:
   //  MEM_LIMIT * (PARTITION_FANOUT ^ MAX_PARTITION_DEPTH).
@@ -149,6 +179,11 @@ class PartitionedAggregationNode : public ExecNode {
   // Contains any evaluators that require the serialize step.
   bool needs_serialize_;
 
+  // True if this is a streaming pre-aggregation: rows that cannot be absorbed by the
+  // in-memory hash tables are passed through to the output unaggregated instead of
+  // spilled. Set in Prepare(). See the class comment.
+  bool is_streaming_preagg_;
+
   std::vector<AggFnEvaluator*> aggregate_evaluators_;
 
   // FunctionContext for each aggregate function and backing MemPool. String data returned
@@ -160,6 +195,54 @@ class PartitionedAggregationNode : public ExecNode {
   std::vector<impala_udf::FunctionContext*> agg_fn_ctxs_;
   boost::scoped_ptr<MemPool> agg_fn_pool_;
 
+  // Aggregate update that can be applied with a tight inline loop instead of a
+  // per-row AggFnEvaluator call: a built-in SUM/COUNT/MIN/MAX over a numeric input
+  // slot (or no input, for COUNT(*)). All offsets are resolved in Prepare().
+  struct SimpleAggUpdate {
+    enum Op { SIMPLE_COUNT, SIMPLE_SUM, SIMPLE_MIN, SIMPLE_MAX };
+
+    Op op;
+
+    // Input slot in the child's row. has_input is false only for COUNT(*).
+    bool has_input;
+    int input_tuple_idx;
+    int input_slot_offset;
+    NullIndicatorOffset input_null_indicator;
+    bool input_tuple_is_nullable;
+    PrimitiveType input_type;
+
+    // Accumulator slot in the intermediate tuple.
+    int dst_slot_offset;
+    NullIndicatorOffset dst_null_indicator;
+
+    SimpleAggUpdate()
+      : op(SIMPLE_COUNT),
+        has_input(false),
+        input_tuple_idx(-1),
+        input_slot_offset(-1),
+        input_null_indicator(0, -1),
+        input_tuple_is_nullable(false),
+        input_type(INVALID_TYPE),
+        dst_slot_offset(-1),
+        dst_null_indicator(0, -1) {
+    }
+  };
+
+  // One entry per aggregate evaluator iff use_simple_agg_updates_ is true.
+  std::vector<SimpleAggUpdate> simple_agg_updates_;
+
+  // True if every aggregate of this node is expressible as a SimpleAggUpdate.
+  // ProcessBatch() then batches rows that hit an existing hash table entry in
+  // pending_updates_ and applies them with per-aggregate accumulation loops instead
+  // of dispatching through the evaluators row at a time.
+  bool use_simple_agg_updates_;
+
+  // Deferred (intermediate tuple, input row) pairs for rows that hit an existing
+  // hash table entry in the current batch. Must be flushed with
+  // ApplySimpleAggUpdates() before any partition can spill, since spilling unpins
+  // the memory the tuples live in.
+  std::vector<std::pair<Tuple*, TupleRow*> > pending_updates_;
+
   // Exprs used to evaluate input rows
   std::vector<ExprContext*> probe_expr_ctxs_;
 
@@ -171,12 +254,33 @@ class PartitionedAggregationNode : public ExecNode {
   // means we need to do more work when allocating and spilling these rows.
   bool contains_var_len_grouping_exprs_;
 
+  // Indices into probe_expr_ctxs_ of the var-len grouping exprs, so that sizing a
+  // stream row in ConstructIntermediateTuple() only touches the var-len exprs.
+  std::vector<int> var_len_grouping_expr_idxs_;
+
   RuntimeState* state_;
   BufferedBlockMgr::Client* block_mgr_client_;
 
   // If true, the partitions in hash_partitions_ are using small buffers.
   bool using_small_buffers_;
 
+  // True once child(0) has been fully consumed. Only maintained for streaming
+  // pre-aggregations, which read the child from GetNext().
+  bool child_eos_;
+
+  // Batch used to read from child(0) in GetNextStreaming(). NULL if this is not a
+  // streaming pre-aggregation (the input is then consumed in Open()).
+  boost::scoped_ptr<RowBatch> child_batch_;
+
+  // Queue of input batches filled by ChildReaderThread(). NULL unless
+  // --agg_pipelined_input_batches > 0 and the input is consumed in Open(). Batches
+  // are heap-allocated; ownership passes to Open() as they are dequeued.
+  boost::scoped_ptr<BlockingQueue<RowBatch*> > child_batch_queue_;
+
+  // Status the input reader thread exited with. Set exactly once, after the thread
+  // has queued its last batch and shut down child_batch_queue_.
+  Promise<Status> child_reader_status_;
+
   // Result of aggregation w/o GROUP BY.
   // Note: can be NULL even if there is no grouping if the result tuple is 0 width
   // e.g. select 1 from table group by col.
@@ -208,6 +312,9 @@ class PartitionedAggregationNode : public ExecNode {
   // Time spent returning the aggregated rows
   RuntimeProfile::Counter* get_results_timer_;
 
+  // Number of rows passed through unaggregated in streaming mode.
+  RuntimeProfile::Counter* num_passthrough_rows_;
+
   // Total number of hash buckets across all partitions.
   RuntimeProfile::Counter* num_hash_buckets_;
 
@@ -288,6 +395,12 @@ class PartitionedAggregationNode : public ExecNode {
   // Current partitions we are partitioning into.
   std::vector<Partition*> hash_partitions_;
 
+  // Fanout of the current partitioning pass and its log. Set by
+  // CreateHashPartitions(): PARTITION_FANOUT for the first pass, up to
+  // MAX_PARTITION_FANOUT for repartitioning passes.
+  int partition_fanout_;
+  int num_partitioning_bits_;
+
   // All partitions that have been spilled and need further processing.
   std::list<Partition*> spilled_partitions_;
 
@@ -348,13 +461,65 @@ class PartitionedAggregationNode : public ExecNode {
   template<bool AGGREGATED_ROWS>
   Status IR_ALWAYS_INLINE ProcessBatch(RowBatch* batch, HashTableCtx* ht_ctx);
 
+  // Aggregates one batch read from child(0), dispatching to the codegen'd process
+  // function or the interpreted ProcessBatch()/ProcessBatchNoGrouping(). Shared by
+  // the inline and pipelined input paths of Open().
+  Status ProcessChildBatch(RowBatch* batch);
+
+  // Main loop of the input reader thread: reads batches from child(0) into
+  // child_batch_queue_ until eos, an error or cancellation, then shuts the queue
+  // down and publishes its status in child_reader_status_.
+  void ChildReaderThread(RuntimeState* state);
+
+  // Streaming pre-aggregation path of GetNext(). Reads batches from child(0) and
+  // processes them with ProcessBatchStreaming() until a batch produces output rows or
+  // the input is consumed. Once the child hits eos, it is closed and the in-memory
+  // partitions are moved to aggregated_partitions_ so subsequent GetNext() calls
+  // return their contents.
+  Status GetNextStreaming(RuntimeState* state, RowBatch* out_batch);
+
+  // Processes a batch of rows in streaming mode. Rows whose group already has an
+  // entry in a hash table are aggregated into it. New groups are inserted while the
+  // hash tables keep fitting in memory; when they stop absorbing rows, the row is
+  // converted to intermediate form and appended to 'out_batch' unaggregated instead
+  // of spilling a partition. 'out_batch' must have capacity for all rows of 'batch'.
+  Status ProcessBatchStreaming(RowBatch* batch, RowBatch* out_batch,
+      HashTableCtx* ht_ctx);
+
+  // Returns true and fills '*agg' if 'evaluator', whose accumulator lives in
+  // 'intermediate_slot_desc', can be applied with the SimpleAggUpdate loops.
+  bool IsSimpleAggUpdate(AggFnEvaluator* evaluator,
+      const SlotDescriptor* intermediate_slot_desc, SimpleAggUpdate* agg) const;
+
+  // Applies the updates deferred in pending_updates_ one aggregate at a time and
+  // clears the list. The per-aggregate loops accumulate directly into the
+  // intermediate tuples' slots, skipping the per-row evaluator dispatch.
+  void ApplySimpleAggUpdates();
+
+  // Accumulation loops used by ApplySimpleAggUpdates(), one per aggregate op.
+  // SRC/T is the input slot's type; sums widen to DST (BIGINT or DOUBLE).
+  template<typename SRC, typename DST>
+  void ApplySumLoop(const SimpleAggUpdate& agg);
+  template<typename T, bool IS_MIN>
+  void ApplyMinMaxLoop(const SimpleAggUpdate& agg);
+  void ApplyCountLoop(const SimpleAggUpdate& agg);
+
+  // Tries to switch all in-memory partition streams from small buffers to io-sized
+  // buffers, setting '*got_buffers' to whether every stream succeeded. Safe to call
+  // again after a failed attempt; already-switched streams are skipped. Sets
+  // using_small_buffers_ to false once all streams have switched.
+  Status TrySwitchToIoBuffers(bool* got_buffers);
+
   // Reads all the rows from input_stream and process them by calling ProcessBatch().
   template<bool AGGREGATED_ROWS>
   Status ProcessStream(BufferedTupleStream* input_stream);
 
   // Initializes hash_partitions_. 'level' is the level for the partitions to create.
-  // Also sets ht_ctx_'s level to 'level'.
-  Status CreateHashPartitions(int level);
+  // Also sets ht_ctx_'s level to 'level' and picks the fanout for this pass:
+  // PARTITION_FANOUT if 'input_bytes' is 0 (i.e. the input size is unknown), up to
+  // MAX_PARTITION_FANOUT otherwise so that each partition of an 'input_bytes' sized
+  // input should fit in the memory available to this node.
+  Status CreateHashPartitions(int level, int64_t input_bytes = 0);
 
   // Iterates over all the partitions in hash_partitions_ and returns the number of rows
   // of the largest spilled partition (in terms of number of aggregated and unaggregated
@@ -172,6 +172,24 @@ next_row:
       goto end;
     }
 
+    // Hash a window of upcoming probe rows and prefetch the hash table buckets they
+    // map to, so the bucket loads overlap the resolution of earlier rows instead of
+    // being serialized. This must happen before the current row is established below
+    // because hashing goes through ht_ctx's expr values buffer.
+    if (probe_prefetch_distance_ > 0) {
+      if (probe_prefetch_pos_ < probe_batch_pos_) probe_prefetch_pos_ = probe_batch_pos_;
+      const int prefetch_end = min(probe_batch_->num_rows(),
+          probe_batch_pos_ + probe_prefetch_distance_);
+      while (probe_prefetch_pos_ < prefetch_end) {
+        TupleRow* prefetch_row = probe_batch_->GetRow(probe_prefetch_pos_++);
+        uint32_t prefetch_hash;
+        if (!ht_ctx->EvalAndHashProbe(prefetch_row, &prefetch_hash)) continue;
+        HashTable* prefetch_tbl =
+            hash_tbls_[prefetch_hash >> (32 - num_partitioning_bits_)];
+        if (prefetch_tbl != NULL) prefetch_tbl->PrefetchBucket(prefetch_hash);
+      }
+    }
+
     // Establish current_probe_row_ and find its corresponding partition.
     current_probe_row_ = probe_batch_->GetRow(probe_batch_pos_++);
     matched_probe_ = false;
@@ -196,7 +214,7 @@ next_row:
       }
       continue;
     }
-    const uint32_t partition_idx = hash >> (32 - NUM_PARTITIONING_BITS);
+    const uint32_t partition_idx = hash >> (32 - num_partitioning_bits_);
     if (LIKELY(hash_tbls_[partition_idx] != NULL)) {
       hash_tbl_iterator_= hash_tbls_[partition_idx]->Find(ht_ctx, hash);
     } else {
@@ -264,7 +282,7 @@ Status PartitionedHashJoinNode::ProcessBuildBatch(RowBatch* build_batch) {
       }
       continue;
     }
-    const uint32_t partition_idx = hash >> (32 - NUM_PARTITIONING_BITS);
+    const uint32_t partition_idx = hash >> (32 - num_partitioning_bits_);
     Partition* partition = hash_partitions_[partition_idx];
     const bool result = AppendRow(partition->build_rows(), build_row);
     if (UNLIKELY(!result)) return status_;
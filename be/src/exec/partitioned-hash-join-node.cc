@@ -14,6 +14,7 @@
 
 #include "exec/partitioned-hash-join-node.inline.h"
 
+#include <algorithm>
 #include <sstream>
 #include <gutil/strings/substitute.h>
 
@@ -26,6 +27,8 @@
 #include "runtime/buffered-tuple-stream.inline.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
+#include "util/bit-util.h"
+#include "util/bloom-filter.h"
 #include "util/debug-util.h"
 #include "util/runtime-profile.h"
 
@@ -34,6 +37,12 @@
 DEFINE_bool(enable_phj_probe_side_filtering, true,
     "Enables pushing PHJ build side filters to probe side");
 
+DEFINE_int32(hash_join_probe_prefetch_distance, 0, "Number of probe rows ahead of the "
+    "current row whose hash table buckets are prefetched during a partitioned hash "
+    "join probe, overlapping bucket cache misses with match resolution. Values of "
+    "16-32 help cache-miss-bound probes; the join exprs of prefetched rows are "
+    "evaluated twice. 0 disables probe-side prefetching.");
+
 using namespace boost;
 using namespace impala;
 using namespace llvm;
@@ -47,10 +56,14 @@ PartitionedHashJoinNode::PartitionedHashJoinNode(
     using_small_buffers_(true),
     state_(PARTITIONING_BUILD),
     block_mgr_client_(NULL),
+    probe_prefetch_distance_(FLAGS_hash_join_probe_prefetch_distance),
+    probe_prefetch_pos_(0),
     process_build_batch_fn_(NULL),
     process_build_batch_fn_level0_(NULL),
     process_probe_batch_fn_(NULL),
     process_probe_batch_fn_level0_(NULL),
+    partition_fanout_(PARTITION_FANOUT),
+    num_partitioning_bits_(NUM_PARTITIONING_BITS),
     input_partition_(NULL),
     null_aware_partition_(NULL),
     non_empty_build_(false),
@@ -149,6 +162,8 @@ Status PartitionedHashJoinNode::Prepare(RuntimeState* state) {
   partition_build_timer_ = ADD_TIMER(runtime_profile(), "BuildPartitionTime");
   num_hash_buckets_ =
       ADD_COUNTER(runtime_profile(), "HashBuckets", TUnit::UNIT);
+  huge_page_bytes_ =
+      ADD_COUNTER(runtime_profile(), "HashTableHugePageBytesAdvised", TUnit::BYTES);
   partitions_created_ =
       ADD_COUNTER(runtime_profile(), "PartitionsCreated", TUnit::UNIT);
   max_partition_level_ = runtime_profile()->AddHighWaterMarkCounter(
@@ -324,7 +339,7 @@ Status PartitionedHashJoinNode::Partition::BuildHashTableInternal(
       HashTable::EstimatedNumBuckets(build_rows()->num_rows());
   hash_tbl_.reset(new HashTable(state, parent_->block_mgr_client_,
       parent_->child(1)->row_desc().tuple_descriptors().size(), build_rows(),
-      1 << (32 - NUM_PARTITIONING_BITS), estimated_num_buckets));
+      1 << (32 - parent_->num_partitioning_bits_), estimated_num_buckets));
   if (!hash_tbl_->Init()) goto not_built;
 
   if (AddProbeFilters) DCHECK_EQ(level_, 0) << "Should not add filters if repartitioning";
@@ -344,7 +359,7 @@ Status PartitionedHashJoinNode::Partition::BuildHashTableInternal(
           void* e = parent_->build_expr_ctxs_[j]->GetValue(row);
           uint32_t h = RawValue::GetHashValue(e,
               parent_->build_expr_ctxs_[j]->root()->type(), seed0);
-          parent_->probe_filters_[j].second->Set<true>(h, true);
+          parent_->probe_filters_[j].second->Insert(h);
         }
       }
     }
@@ -355,6 +370,7 @@ Status PartitionedHashJoinNode::Partition::BuildHashTableInternal(
   DCHECK_NOTNULL(hash_tbl_.get());
   is_spilled_ = false;
   COUNTER_ADD(parent_->num_hash_buckets_, hash_tbl_->num_buckets());
+  COUNTER_ADD(parent_->huge_page_bytes_, hash_tbl_->huge_page_bytes());
   return Status::OK;
 
 not_built:
@@ -382,7 +398,7 @@ bool PartitionedHashJoinNode::AllocateProbeFilters(RuntimeState* state) {
       // TODO: Enable probe filters not only for "naked" slotrefs.
       probe_filters_[i].first =
           reinterpret_cast<SlotRef*>(probe_expr_ctxs_[i]->root())->slot_id();
-      probe_filters_[i].second = new Bitmap(state->slot_filter_bitmap_size());
+      probe_filters_[i].second = new BloomFilter(state->slot_filter_num_bits());
     } else {
       probe_filters_[i].second = NULL;
     }
@@ -392,14 +408,14 @@ bool PartitionedHashJoinNode::AllocateProbeFilters(RuntimeState* state) {
 
 bool PartitionedHashJoinNode::AttachProbeFilters(RuntimeState* state) {
   if (can_add_probe_filters_) {
-    // Add all the bitmaps to the runtime state.
+    // Add all the bloom filters to the runtime state.
     AddRuntimeExecOption("Build-Side Filter Pushed Down");
     bool acquired_ownership = false;
     for (int i = 0; i < probe_filters_.size(); ++i) {
       if (probe_filters_[i].second == NULL) continue;
-      state->AddBitmapFilter(probe_filters_[i].first, probe_filters_[i].second,
-                             &acquired_ownership);
-      VLOG(2) << "Bitmap filter added on slot: " << probe_filters_[i].first;
+      state->AddBloomFilter(probe_filters_[i].first, probe_filters_[i].second,
+                            &acquired_ownership);
+      VLOG(2) << "Bloom filter added on slot: " << probe_filters_[i].first;
       if (!acquired_ownership) {
         delete probe_filters_[i].second;
         probe_filters_[i].second = NULL;
@@ -501,13 +517,39 @@ Status PartitionedHashJoinNode::ProcessBuildInput(RuntimeState* state, int level
   }
 
   DCHECK(hash_partitions_.empty());
+  // Pick the fanout for this pass. The first pass uses PARTITION_FANOUT since the
+  // build size is unknown. Repartitioning passes know the size of the spilled input
+  // partition, so we widen the fanout so that each output partition should fit in
+  // the memory still available to this node, letting very large inputs be split in
+  // one wide pass instead of several narrow ones. The fanout is bounded by the
+  // buffers the block mgr can still hand out; each partition needs a build and a
+  // probe buffer.
+  partition_fanout_ = PARTITION_FANOUT;
+  if (input_partition_ != NULL) {
+    const int64_t available_buffers =
+        state->block_mgr()->available_buffers(block_mgr_client_);
+    const int64_t mem_available =
+        available_buffers * state->block_mgr()->max_block_size();
+    if (mem_available > 0) {
+      int64_t fanout = BitUtil::NextPowerOfTwo(
+          input_partition_->build_rows()->byte_size() / mem_available + 1);
+      fanout = ::min<int64_t>(fanout, MAX_PARTITION_FANOUT);
+      while (fanout > PARTITION_FANOUT && fanout * 2 + 2 > available_buffers) {
+        fanout /= 2;
+      }
+      partition_fanout_ = ::max<int64_t>(fanout, PARTITION_FANOUT);
+    }
+  }
+  num_partitioning_bits_ = BitUtil::Log2(partition_fanout_);
+  DCHECK_EQ(partition_fanout_, 1 << num_partitioning_bits_);
+
   if (input_partition_ != NULL) {
     DCHECK_NOTNULL(input_partition_->build_rows());
     DCHECK_EQ(input_partition_->build_rows()->blocks_pinned(), 0) << NodeDebugString();
     RETURN_IF_ERROR(input_partition_->build_rows()->PrepareForRead());
   }
 
-  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+  for (int i = 0; i < partition_fanout_; ++i) {
     hash_partitions_.push_back(pool_->Add(
         new Partition(state, this, level, using_small_buffers_)));
     RETURN_IF_ERROR(hash_partitions_[i]->build_rows()->Init(runtime_profile()));
@@ -521,7 +563,7 @@ Status PartitionedHashJoinNode::ProcessBuildInput(RuntimeState* state, int level
     // optimization.
     RETURN_IF_ERROR(hash_partitions_[i]->probe_rows()->Init(runtime_profile(), false));
   }
-  COUNTER_ADD(partitions_created_, PARTITION_FANOUT);
+  COUNTER_ADD(partitions_created_, partition_fanout_);
   COUNTER_SET(max_partition_level_, level);
 
   RowBatch build_batch(child(1)->row_desc(), state->batch_size(), mem_tracker());
@@ -701,7 +743,9 @@ Status PartitionedHashJoinNode::PrepareNextPartition(RuntimeState* state) {
     DCHECK_NOTNULL(input_partition_->hash_tbl());
     // In this case, we did not have to partition the build again, we just built
     // a hash table. This means the probe does not have to be partitioned either.
-    for (int i = 0; i < PARTITION_FANOUT; ++i) {
+    // Fill the whole cache array since num_partitioning_bits_ may still reflect a
+    // wider earlier pass.
+    for (int i = 0; i < MAX_PARTITION_FANOUT; ++i) {
       hash_tbls_[i] = input_partition_->hash_tbl();
     }
     UpdateState(PROBING_SPILLED_PARTITION);
@@ -727,6 +771,7 @@ int64_t PartitionedHashJoinNode::LargestSpilledPartition() const {
 Status PartitionedHashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch,
     bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   DCHECK(!out_batch->AtCapacity());
 
@@ -977,6 +1022,16 @@ Status PartitionedHashJoinNode::PrepareNullAwarePartition() {
     return Status::OK;
   }
 
+  if (probe_stream->num_rows() == 0) {
+    // Every probe row was resolved against the hash tables, so no row needs to
+    // consult the NULL build rows. Skip materializing them; EvaluateNullProbe()
+    // reads the build stream itself for the NULL probe rows (if any).
+    RETURN_IF_ERROR(EvaluateNullProbe(build_stream));
+    nulls_build_batch_.reset();
+    RETURN_IF_ERROR(PrepareNullAwareNullProbe());
+    return Status::OK;
+  }
+
   // Bring the entire spilled build stream into memory and read into a single batch.
   bool got_rows;
   RETURN_IF_ERROR(build_stream->GetRows(&nulls_build_batch_, &got_rows));
@@ -1056,7 +1111,7 @@ Status PartitionedHashJoinNode::OutputNullAwareProbeRows(RuntimeState* state,
 //
 // TODO: implement the knapsack solution.
 Status PartitionedHashJoinNode::BuildHashTables(RuntimeState* state) {
-  DCHECK_EQ(hash_partitions_.size(), PARTITION_FANOUT);
+  DCHECK_EQ(hash_partitions_.size(), partition_fanout_);
 
   // Decide whether probe filters will be built.
   if (input_partition_ == NULL && can_add_probe_filters_) {
@@ -1065,10 +1120,11 @@ Status PartitionedHashJoinNode::BuildHashTables(RuntimeState* state) {
       const uint64_t partition_num_rows = partition->build_rows()->num_rows();
       num_build_rows += partition_num_rows;
     }
-    // TODO: Using this simple heuristic where we compare the number of build rows
-    // to the size of the slot filter bitmap. This is essentially not a Bloom filter
-    // but a 1-1 filter, and probably it is missing oportunities. Should revisit.
-    if (num_build_rows >= state->slot_filter_bitmap_size()) {
+    // The bloom filters stay selective as long as each build row gets at least
+    // MIN_BITS_PER_ENTRY bits; past that the false positive rate makes the
+    // probe-side checks pure overhead.
+    if (num_build_rows * BloomFilter::MIN_BITS_PER_ENTRY >
+        state->slot_filter_num_bits()) {
       can_add_probe_filters_ = false;
       VLOG(2) << "Disabling probe filter push down because build side is too large: "
               << num_build_rows;
@@ -1147,7 +1203,7 @@ Status PartitionedHashJoinNode::BuildHashTables(RuntimeState* state) {
   // Investigate if this is worthwhile.
 
   // Initialize the hash_tbl_ caching array.
-  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+  for (int i = 0; i < partition_fanout_; ++i) {
     hash_tbls_[i] = hash_partitions_[i]->hash_tbl();
   }
   return Status::OK;
@@ -1159,6 +1215,16 @@ Status PartitionedHashJoinNode::EvaluateNullProbe(BufferedTupleStream* build) {
   }
   DCHECK_EQ(null_probe_rows_->num_rows(), matched_null_probe_.size());
 
+  // Nothing to evaluate against; the NULL probe rows stay unmatched.
+  if (build->num_rows() == 0) return Status::OK;
+
+  // This is called once per partition's build rows. If every NULL probe row has
+  // already matched against an earlier partition, don't re-read the streams.
+  if (find(matched_null_probe_.begin(), matched_null_probe_.end(), false) ==
+      matched_null_probe_.end()) {
+    return Status::OK;
+  }
+
   // Bring both the build and probe side into memory and do a pairwise evaluation.
   bool got_rows;
   scoped_ptr<RowBatch> build_rows;
@@ -1457,12 +1523,20 @@ bool PartitionedHashJoinNode::CodegenProcessBuildBatch(
   Function* eval_row_fn = ht_ctx_->CodegenEvalRow(state, true);
   if (eval_row_fn == NULL) return false;
 
+  // Codegen for the key comparison in the insert probe.
+  Function* equals_fn = ht_ctx_->CodegenEquals(state);
+  if (equals_fn == NULL) return false;
+
   int replaced = 0;
   // Replace call sites
   process_build_batch_fn = codegen->ReplaceCallSites(process_build_batch_fn, false,
       eval_row_fn, "EvalBuildRow", &replaced);
   DCHECK_EQ(replaced, 1);
 
+  process_build_batch_fn = codegen->ReplaceCallSites(process_build_batch_fn, true,
+      equals_fn, "Equals", &replaced);
+  DCHECK_GE(replaced, 1);
+
   // process_build_batch_fn_level0 uses CRC hash if available,
   // process_build_batch_fn uses murmur
   Function* process_build_batch_fn_level0 = codegen->ReplaceCallSites(
@@ -1480,11 +1554,16 @@ bool PartitionedHashJoinNode::CodegenProcessBuildBatch(
       codegen->OptimizeFunctionWithExprs(process_build_batch_fn_level0);
   if (process_build_batch_fn_level0 == NULL) return false;
 
-  // Register native function pointers
-  codegen->AddFunctionToJit(process_build_batch_fn,
-                            reinterpret_cast<void**>(&process_build_batch_fn_));
+  // Register native function pointers. The level0 variant must be registered (and
+  // therefore filled in) first: ProcessBuildBatch() checks process_build_batch_fn_ and
+  // then expects process_build_batch_fn_level0_ to be set, and with asynchronous
+  // codegen the pointers become non-NULL one at a time, mid-execution.
   codegen->AddFunctionToJit(process_build_batch_fn_level0,
-                            reinterpret_cast<void**>(&process_build_batch_fn_level0_));
+                            reinterpret_cast<void**>(&process_build_batch_fn_level0_),
+                            ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
+  codegen->AddFunctionToJit(process_build_batch_fn,
+                            reinterpret_cast<void**>(&process_build_batch_fn_),
+                            ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
   return true;
 }
 
@@ -1603,8 +1682,8 @@ bool PartitionedHashJoinNode::CodegenProcessProbeBatch(
 
   process_probe_batch_fn = codegen->ReplaceCallSites(process_probe_batch_fn, true,
       equals_fn, "Equals", &replaced);
-  // Depends on join_op_
-  DCHECK(replaced == 2 || replaced == 3 || replaced == 4) << replaced;
+  // Depends on join_op_ and how many Probe() calls the optimizer kept inline.
+  DCHECK_GE(replaced, 1) << replaced;
 
   // process_probe_batch_fn_level0 uses CRC hash if available,
   // process_probe_batch_fn uses murmur
@@ -1623,10 +1702,14 @@ bool PartitionedHashJoinNode::CodegenProcessProbeBatch(
       codegen->OptimizeFunctionWithExprs(process_probe_batch_fn_level0);
   if (process_probe_batch_fn_level0 == NULL) return false;
 
-  // Register native function pointers
-  codegen->AddFunctionToJit(process_probe_batch_fn,
-                            reinterpret_cast<void**>(&process_probe_batch_fn_));
+  // Register native function pointers. As with the build side, the level0 variant
+  // must be filled in before process_probe_batch_fn_ becomes visible (see
+  // ProcessProbeBatch()).
   codegen->AddFunctionToJit(process_probe_batch_fn_level0,
-                            reinterpret_cast<void**>(&process_probe_batch_fn_level0_));
+                            reinterpret_cast<void**>(&process_probe_batch_fn_level0_),
+                            ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
+  codegen->AddFunctionToJit(process_probe_batch_fn,
+                            reinterpret_cast<void**>(&process_probe_batch_fn_),
+                            ADD_TIMER(runtime_profile(), "CodegenCompileTime"));
   return true;
 }
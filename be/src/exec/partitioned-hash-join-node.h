@@ -30,6 +30,7 @@
 
 namespace impala {
 
+class BloomFilter;
 class BufferedBlockMgr;
 class MemPool;
 class RowBatch;
@@ -54,6 +55,10 @@ class BufferedTupleStream;
 // TODO: think about details about multithreading. Multiple partitions in parallel?
 // Multiple threads against a single partition? How to build hash tables in parallel?
 // TODO: BuildHashTables() should start with the partitions that are already pinned.
+// TODO: if a query ever runs multiple instances of the same fragment on a node, the
+// build side of a broadcast join should be built once per node and shared read-only
+// between the instances (keyed by query id and plan node id, the way BufferedBlockMgr
+// is shared per query) instead of building identical tables in every instance.
 class PartitionedHashJoinNode : public BlockingJoinNode {
  public:
   PartitionedHashJoinNode(ObjectPool* pool, const TPlanNode& tnode,
@@ -110,13 +115,20 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
     REPARTITIONING,
   };
 
-  // Number of initial partitions to create. Must be a power of two.
+  // Number of partitions to create on the first partitioning pass, where the build
+  // size is not yet known. Must be a power of two.
   // TODO: this is set to a lower than actual value for testing.
   static const int PARTITION_FANOUT = 16;
 
   // Needs to be the log(PARTITION_FANOUT)
   static const int NUM_PARTITIONING_BITS = 4;
 
+  // Maximum fanout of a repartitioning pass. Repartitioning passes know the size of
+  // the spilled input partition, so ProcessBuildInput() widens the fanout up to this
+  // (bounded by the buffers the block mgr can still hand out) to split very large
+  // inputs in one wide pass instead of several narrow ones. Must be a power of two.
+  static const int MAX_PARTITION_FANOUT = 64;
+
   // Maximum number of times we will repartition. The maximum build table we
   // can process is:
   // MEM_LIMIT * (PARTITION_FANOUT ^ MAX_PARTITION_DEPTH). With a (low) 1GB
@@ -200,6 +212,8 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   // rows in build. This updates matched_null_probe_, short-circuiting if one of the
   // conjuncts pass (i.e. there is a match).
   // This is used for NAAJ, when there are NULL probe rows.
+  // Does not read the streams if 'build' is empty or if every NULL probe row has
+  // already matched.
   Status EvaluateNullProbe(BufferedTupleStream* build);
 
   // Prepares to output NULLs on the probe side for NAAJ. Before calling this,
@@ -312,12 +326,26 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   // The iterator that corresponds to the look up of current_probe_row_.
   HashTable::Iterator hash_tbl_iterator_;
 
+  // Number of probe rows ahead of the current row whose hash table buckets are
+  // prefetched in ProcessProbeBatch(), so bucket loads overlap the resolution of
+  // earlier rows. Set from --hash_join_probe_prefetch_distance; 0 disables
+  // probe-side prefetching.
+  int probe_prefetch_distance_;
+
+  // Index of the first row in probe_batch_ whose bucket has not been prefetched
+  // yet. Kept >= probe_batch_pos_ while probing; reset in ResetForProbe().
+  int probe_prefetch_pos_;
+
   // Total time spent partitioning build.
   RuntimeProfile::Counter* partition_build_timer_;
 
   // Total number of hash buckets across all partitions.
   RuntimeProfile::Counter* num_hash_buckets_;
 
+  // Total bucket array bytes advised to be backed by transparent huge pages, across
+  // all partitions. 0 unless --madvise_huge_pages is enabled.
+  RuntimeProfile::Counter* huge_page_bytes_;
+
   // Total number of partitions created.
   RuntimeProfile::Counter* partitions_created_;
 
@@ -442,12 +470,19 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   // This is not used when processing a single partition.
   std::vector<Partition*> hash_partitions_;
 
+  // Fanout of the current partitioning pass and its log. Set by ProcessBuildInput():
+  // PARTITION_FANOUT for the first pass, up to MAX_PARTITION_FANOUT for
+  // repartitioning passes. The probe side of a pass always uses the same fanout as
+  // its build side.
+  int partition_fanout_;
+  int num_partitioning_bits_;
+
   // Cache of the per partition hash table to speed up ProcessProbeBatch.
   // In the case where we need to partition the probe:
   //  hash_tbls_[i] = hash_partitions_[i]->hash_tbl();
   // In the case where we don't need to partition the probe:
   //  hash_tbls_[i] = input_partition_->hash_tbl();
-  HashTable* hash_tbls_[PARTITION_FANOUT];
+  HashTable* hash_tbls_[MAX_PARTITION_FANOUT];
 
   // The current input partition to be processed (not in spilled_partitions_).
   // This partition can either serve as the source for a repartitioning step, or
@@ -461,7 +496,7 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
 
   // Used for concentrating the existence bits from all the partitions, used by the
   // probe-side filter optimization.
-  std::vector<std::pair<SlotId, Bitmap*> > probe_filters_;
+  std::vector<std::pair<SlotId, BloomFilter*> > probe_filters_;
 
   // Partition used if null_aware_ is set. This partition is always processed at the end
   // after all build and probe rows are processed. Rows are added to this partition along
@@ -24,6 +24,7 @@ namespace impala {
 inline void PartitionedHashJoinNode::ResetForProbe() {
   current_probe_row_ = NULL;
   probe_batch_pos_ = 0;
+  probe_prefetch_pos_ = 0;
   matched_probe_ = true;
   hash_tbl_iterator_.reset();
 }
@@ -19,6 +19,7 @@
 #include "runtime/mem-pool.h"
 #include "runtime/runtime-state.h"
 #include "runtime/string-buffer.h"
+#include "runtime/thread-resource-mgr.h"
 #include "util/debug-util.h"
 
 using namespace boost;
@@ -81,6 +82,13 @@ void ScannerContext::Stream::ReleaseCompletedResources(RowBatch* batch, bool don
       ++parent_->num_completed_io_buffers_;
       completed_io_buffers_.push_back(io_buffer_);
     }
+    // Return batched buffers that were never consumed. These were not counted in
+    // num_owned_io_buffers_ yet and never contain referenced tuple data.
+    for (list<DiskIoMgr::BufferDescriptor*>::iterator it = ready_io_buffers_.begin();
+         it != ready_io_buffers_.end(); ++it) {
+      (*it)->Return();
+    }
+    ready_io_buffers_.clear();
     // Set variables to NULL to make sure streams are not used again
     io_buffer_ = NULL;
     io_buffer_pos_ = NULL;
@@ -130,8 +138,23 @@ Status ScannerContext::Stream::GetNextBuffer(int64_t read_past_size) {
   }
 
   if (!eosr) {
-    SCOPED_TIMER(parent_->state_->total_storage_wait_timer());
-    RETURN_IF_ERROR(scan_range_->GetNext(&io_buffer_));
+    if (ready_io_buffers_.empty()) {
+      SCOPED_TIMER(parent_->state_->total_storage_wait_timer());
+      // This thread may block waiting for the disk read. Yield its share of the
+      // thread quota so another scanner thread can run in the meantime; the pool
+      // transiently oversubscribes when the read completes and sheds the surplus at
+      // the next scan range boundary.
+      ThreadResourceMgr::ResourcePool* pool = parent_->state_->resource_pool();
+      pool->MarkThreadBlocked();
+      vector<DiskIoMgr::BufferDescriptor*> buffers;
+      Status status = scan_range_->GetNextBatch(&buffers);
+      pool->MarkThreadUnblocked();
+      RETURN_IF_ERROR(status);
+      ready_io_buffers_.insert(ready_io_buffers_.end(), buffers.begin(), buffers.end());
+    }
+    DCHECK(!ready_io_buffers_.empty());
+    io_buffer_ = ready_io_buffers_.front();
+    ready_io_buffers_.pop_front();
   } else {
     SCOPED_TIMER(parent_->state_->total_storage_wait_timer());
     int64_t offset = file_offset() + boundary_buffer_bytes_left_;
@@ -150,8 +173,14 @@ Status ScannerContext::Stream::GetNextBuffer(int64_t read_past_size) {
     DiskIoMgr::ScanRange* range = parent_->scan_node_->AllocateScanRange(
         scan_range_->fs(), filename(), read_past_buffer_size, offset, -1,
         scan_range_->disk_id(), false, false);
-    RETURN_IF_ERROR(parent_->state_->io_mgr()->Read(
-        parent_->scan_node_->reader_context(), range, &io_buffer_));
+    // Same as above: the synchronous read-past blocks on the disk, so don't hold a
+    // share of the thread quota while it is in flight.
+    ThreadResourceMgr::ResourcePool* pool = parent_->state_->resource_pool();
+    pool->MarkThreadBlocked();
+    Status status = parent_->state_->io_mgr()->Read(
+        parent_->scan_node_->reader_context(), range, &io_buffer_);
+    pool->MarkThreadUnblocked();
+    RETURN_IF_ERROR(status);
   }
 
   DCHECK(io_buffer_ != NULL);
@@ -213,6 +213,12 @@ class ScannerContext {
     // buffers are either returned to the io mgr or attached to the current row batch.
     std::list<DiskIoMgr::BufferDescriptor*> completed_io_buffers_;
 
+    // Buffers dequeued from scan_range_ in a batch (ScanRange::GetNextBatch()) but
+    // not yet consumed. Fetching all ready buffers at once avoids a lock acquire and
+    // condition variable wakeup per buffer. Returned to the io mgr in
+    // ReleaseCompletedResources() if the scanner finishes before consuming them.
+    std::list<DiskIoMgr::BufferDescriptor*> ready_io_buffers_;
+
     Stream(ScannerContext* parent);
 
     // GetBytes helper to handle the slow path.
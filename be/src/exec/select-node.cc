@@ -14,6 +14,8 @@
 
 #include "exec/select-node.h"
 #include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/raw-value.h"
@@ -21,6 +23,12 @@
 
 using namespace std;
 
+// Computing a batch's zone stats costs two value compares per row, so it only pays
+// off when batches are frequently skippable; keep it opt-in.
+DEFINE_bool(batch_zone_stats, false, "If true, select nodes compute per-batch min/max "
+    "stats for numeric slots compared against constants in their conjuncts and skip "
+    "whole batches that cannot contain a passing row.");
+
 namespace impala {
 
 SelectNode::SelectNode(
@@ -28,7 +36,8 @@ SelectNode::SelectNode(
     : ExecNode(pool, tnode, descs),
       child_row_batch_(NULL),
       child_row_idx_(0),
-      child_eos_(false) {
+      child_eos_(false),
+      num_zone_skipped_batches_(NULL) {
 }
 
 Status SelectNode::Prepare(RuntimeState* state) {
@@ -36,11 +45,141 @@ Status SelectNode::Prepare(RuntimeState* state) {
   RETURN_IF_ERROR(ExecNode::Prepare(state));
   child_row_batch_.reset(
       new RowBatch(child(0)->row_desc(), state->batch_size(), mem_tracker()));
+  selected_rows_.reset(new uint8_t[state->batch_size()]);
+  if (FLAGS_batch_zone_stats) {
+    CollectZoneConjuncts(state);
+    if (!zone_conjuncts_.empty()) {
+      num_zone_skipped_batches_ =
+          ADD_COUNTER(runtime_profile(), "ZoneSkippedBatches", TUnit::UNIT);
+    }
+  }
   return Status::OK;
 }
 
+void SelectNode::CollectZoneConjuncts(RuntimeState* state) {
+  DCHECK(zone_conjuncts_.empty());
+  for (int i = 0; i < conjunct_ctxs_.size(); ++i) {
+    Expr* conjunct = conjunct_ctxs_[i]->root();
+    if (conjunct->GetNumChildren() != 2) continue;
+    Expr* slot = conjunct->GetChild(0);
+    Expr* constant = conjunct->GetChild(1);
+    bool flipped = false;
+    if (!slot->is_slotref()) {
+      std::swap(slot, constant);
+      flipped = true;
+    }
+    if (!slot->is_slotref() || !constant->IsConstant()) continue;
+
+    const string& fn_name = conjunct->fn().name.function_name;
+    ZoneConjunct::Op op;
+    if (fn_name == "lt") {
+      op = ZoneConjunct::LT;
+    } else if (fn_name == "le") {
+      op = ZoneConjunct::LE;
+    } else if (fn_name == "gt") {
+      op = ZoneConjunct::GT;
+    } else if (fn_name == "ge") {
+      op = ZoneConjunct::GE;
+    } else if (fn_name == "eq") {
+      op = ZoneConjunct::EQ;
+    } else {
+      continue;
+    }
+    if (flipped) {
+      // '<constant> <op> <slot>' is equivalent to '<slot> <flipped op> <constant>'.
+      switch (op) {
+        case ZoneConjunct::LT: op = ZoneConjunct::GT; break;
+        case ZoneConjunct::LE: op = ZoneConjunct::GE; break;
+        case ZoneConjunct::GT: op = ZoneConjunct::LT; break;
+        case ZoneConjunct::GE: op = ZoneConjunct::LE; break;
+        case ZoneConjunct::EQ: break;
+      }
+    }
+
+    // Zone stats are kept to numeric slots: fixed-width min/max values are cheap to
+    // maintain and compare in one pass over the batch.
+    switch (slot->type().type) {
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT:
+      case TYPE_FLOAT:
+      case TYPE_DOUBLE:
+        break;
+      default:
+        continue;
+    }
+    if (!(slot->type() == constant->type())) continue;
+
+    const SlotRef* slot_ref = static_cast<const SlotRef*>(slot);
+    ZoneConjunct zc;
+    zc.slot_desc = state->desc_tbl().GetSlotDescriptor(slot_ref->slot_id());
+    if (zc.slot_desc == NULL) continue;
+    zc.tuple_idx = slot_ref->tuple_idx();
+    zc.op = op;
+    zc.ctx = conjunct_ctxs_[i];
+    zc.constant_expr = constant;
+    zone_conjuncts_.push_back(zc);
+  }
+}
+
+// Returns a pointer to the native (in-memory row format) representation of the
+// numeric constant 'val' of type 'type'. Only the types accepted by
+// CollectZoneConjuncts() are handled.
+static const void* NumericValToNative(const ColumnType& type, impala_udf::AnyVal* val) {
+  switch (type.type) {
+    case TYPE_TINYINT:
+      return &static_cast<impala_udf::TinyIntVal*>(val)->val;
+    case TYPE_SMALLINT:
+      return &static_cast<impala_udf::SmallIntVal*>(val)->val;
+    case TYPE_INT:
+      return &static_cast<impala_udf::IntVal*>(val)->val;
+    case TYPE_BIGINT:
+      return &static_cast<impala_udf::BigIntVal*>(val)->val;
+    case TYPE_FLOAT:
+      return &static_cast<impala_udf::FloatVal*>(val)->val;
+    case TYPE_DOUBLE:
+      return &static_cast<impala_udf::DoubleVal*>(val)->val;
+    default:
+      DCHECK(false) << type;
+      return NULL;
+  }
+}
+
+bool SelectNode::CanSkipChildBatch() {
+  for (int i = 0; i < zone_conjuncts_.size(); ++i) {
+    const ZoneConjunct& zc = zone_conjuncts_[i];
+    const RowBatch::SlotStats* stats =
+        child_row_batch_->GetSlotStats(zc.slot_desc->id());
+    if (stats == NULL) {
+      stats = &child_row_batch_->ComputeSlotStats(*zc.slot_desc, zc.tuple_idx);
+    }
+    // No non-NULL value in the whole batch: a comparison is false for every row.
+    if (stats->min_value == NULL) return true;
+
+    impala_udf::AnyVal* constant_val = zc.constant_expr->GetConstVal(zc.ctx);
+    if (constant_val == NULL || constant_val->is_null) continue;
+    const void* val = NumericValToNative(zc.slot_desc->type(), constant_val);
+    if (val == NULL) continue;
+
+    int cmp_min = RawValue::Compare(stats->min_value, val, zc.slot_desc->type());
+    int cmp_max = RawValue::Compare(stats->max_value, val, zc.slot_desc->type());
+    bool skip = false;
+    switch (zc.op) {
+      case ZoneConjunct::LT: skip = cmp_min >= 0; break;
+      case ZoneConjunct::LE: skip = cmp_min > 0; break;
+      case ZoneConjunct::GT: skip = cmp_max <= 0; break;
+      case ZoneConjunct::GE: skip = cmp_max < 0; break;
+      case ZoneConjunct::EQ: skip = cmp_min > 0 || cmp_max < 0; break;
+    }
+    if (skip) return true;
+  }
+  return false;
+}
+
 Status SelectNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_ERROR(child(0)->Open(state));
   return Status::OK;
@@ -48,9 +187,11 @@ Status SelectNode::Open(RuntimeState* state) {
 
 Status SelectNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
 
-  if (ReachedLimit() || (child_row_idx_ == child_row_batch_->num_rows() && child_eos_)) {
+  if (ReachedLimit()
+      || (child_row_idx_ == child_row_batch_->num_selected() && child_eos_)) {
     // we're already done or we exhausted the last child batch and there won't be any
     // new ones
     *eos = true;
@@ -62,18 +203,32 @@ Status SelectNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos)
   while (true) {
     RETURN_IF_CANCELLED(state);
     RETURN_IF_ERROR(QueryMaintenance(state));
-    if (child_row_idx_ == child_row_batch_->num_rows()) {
+    if (child_row_idx_ == child_row_batch_->num_selected()) {
       child_row_idx_ = 0;
       // fetch next batch
       child_row_batch_->TransferResourceOwnership(row_batch);
       child_row_batch_->Reset();
       if (row_batch->AtCapacity()) return Status::OK;
       RETURN_IF_ERROR(child(0)->GetNext(state, child_row_batch_.get(), &child_eos_));
+      if (!zone_conjuncts_.empty() && child_row_batch_->num_rows() > 0 &&
+          CanSkipChildBatch()) {
+        // The zone stats prove no row can pass; present an empty selection instead
+        // of evaluating the conjuncts row by row.
+        memset(selected_rows_.get(), 0, child_row_batch_->num_rows());
+        COUNTER_ADD(num_zone_skipped_batches_, 1);
+      } else {
+        // Evaluate the conjuncts over the whole batch up front; CopyRows() may be
+        // re-entered for the same child batch when the output batch fills up.
+        EvalConjunctsBatch(&conjunct_ctxs_[0], conjunct_ctxs_.size(),
+            child_row_batch_.get(), selected_rows_.get());
+      }
+      // Turn the flags into a selection vector so CopyRows() only visits survivors.
+      child_row_batch_->SetSelection(selected_rows_.get());
     }
 
     if (CopyRows(row_batch)) {
       *eos = ReachedLimit()
-          || (child_row_idx_ == child_row_batch_->num_rows() && child_eos_);
+          || (child_row_idx_ == child_row_batch_->num_selected() && child_eos_);
       return Status::OK;
     }
     if (child_eos_) {
@@ -86,23 +241,20 @@ Status SelectNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos)
 }
 
 bool SelectNode::CopyRows(RowBatch* output_batch) {
-  ExprContext** conjunct_ctxs = &conjunct_ctxs_[0];
-  int num_conjunct_ctxs = conjunct_ctxs_.size();
-
-  for (; child_row_idx_ < child_row_batch_->num_rows(); ++child_row_idx_) {
+  // Conjuncts were already evaluated over the whole child batch; iterate over the
+  // selection vector so rejected rows aren't even touched here.
+  for (; child_row_idx_ < child_row_batch_->num_selected(); ++child_row_idx_) {
     // Add a new row to output_batch
     int dst_row_idx = output_batch->AddRow();
     if (dst_row_idx == RowBatch::INVALID_ROW_INDEX) return true;
     TupleRow* dst_row = output_batch->GetRow(dst_row_idx);
-    TupleRow* src_row = child_row_batch_->GetRow(child_row_idx_);
-
-    if (EvalConjuncts(conjunct_ctxs, num_conjunct_ctxs, src_row)) {
-      output_batch->CopyRow(src_row, dst_row);
-      output_batch->CommitLastRow();
-      ++num_rows_returned_;
-      COUNTER_SET(rows_returned_counter_, num_rows_returned_);
-      if (ReachedLimit()) return true;
-    }
+    TupleRow* src_row = child_row_batch_->GetSelectedRow(child_row_idx_);
+
+    output_batch->CopyRow(src_row, dst_row);
+    output_batch->CommitLastRow();
+    ++num_rows_returned_;
+    COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+    if (ReachedLimit()) return true;
   }
   return output_batch->AtCapacity();
 }
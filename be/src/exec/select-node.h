@@ -16,6 +16,7 @@
 #ifndef IMPALA_EXEC_SELECT_NODE_H
 #define IMPALA_EXEC_SELECT_NODE_H
 
+#include <boost/scoped_array.hpp>
 #include <boost/scoped_ptr.hpp>
 
 #include "exec/exec-node.h"
@@ -24,6 +25,7 @@
 
 namespace impala {
 
+class SlotDescriptor;
 class Tuple;
 class TupleRow;
 
@@ -42,12 +44,53 @@ class SelectNode : public ExecNode {
   // current row batch of child
   boost::scoped_ptr<RowBatch> child_row_batch_;
 
-  // index of current row in child_row_batch_
+  // index into the selected rows of child_row_batch_ (see RowBatch::GetSelectedRow())
   int child_row_idx_;
 
+  // One entry per row of child_row_batch_; non-zero iff the row passed the
+  // conjuncts. Filled once per child batch by EvalConjunctsBatch() so CopyRows()
+  // only copies. Sized to the batch capacity in Prepare().
+  boost::scoped_array<uint8_t> selected_rows_;
+
   // true if last GetNext() call on child signalled eos
   bool child_eos_;
 
+  // A conjunct of the form '<slot> <op> <constant>' on a numeric slot that can be
+  // evaluated against per-batch zone stats (see CanSkipChildBatch()).
+  struct ZoneConjunct {
+    enum Op { LT, LE, GT, GE, EQ };
+
+    // Descriptor of the slot the conjunct is bound against. Not owned.
+    const SlotDescriptor* slot_desc;
+
+    // Index of the slot's tuple within the child row.
+    int tuple_idx;
+
+    Op op;
+
+    // Context of the conjunct. Not owned.
+    ExprContext* ctx;
+
+    // The constant child of the conjunct. Not owned.
+    Expr* constant_expr;
+  };
+
+  // Conjuncts usable for whole-batch skipping. Only populated when
+  // --batch_zone_stats is set.
+  std::vector<ZoneConjunct> zone_conjuncts_;
+
+  // Number of child batches skipped wholesale based on zone stats.
+  RuntimeProfile::Counter* num_zone_skipped_batches_;
+
+  // Populates zone_conjuncts_ with the conjuncts of the form '<slot> <op> <constant>'
+  // bound against a numeric slot. Called from Prepare().
+  void CollectZoneConjuncts(RuntimeState* state);
+
+  // Returns true if the zone stats of child_row_batch_ prove that no row can pass
+  // the conjuncts in zone_conjuncts_, computing and attaching stats to the batch for
+  // any slot that doesn't have them yet.
+  bool CanSkipChildBatch();
+
   // Copy rows from child_row_batch_ for which conjuncts_ evaluate to true to
   // output_batch, up to limit_.
   // Return true if limit was hit or output_batch should be returned, otherwise false.
@@ -31,6 +31,13 @@ namespace impala {
 // in Open() to fill it with sorted rows.
 // If a merge phase was performed in the sort, sorted rows are deep copied into
 // the output batch. Otherwise, the sorter instance owns the sorted data.
+//
+// TODO: group-sort mode for input already clustered on a prefix of the ordering
+// exprs (e.g. data sorted by day feeding ORDER BY day, user): detect the prefix
+// group boundaries while consuming the input, sort each group independently and
+// stream it out as soon as the next group starts. This bounds memory to the largest
+// group and avoids spilling for time-ordered inputs. Blocked on TSortNode carrying
+// the length of the sorted prefix from the planner.
 class SortNode : public ExecNode {
  public:
   SortNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -17,6 +17,7 @@
 #include <sstream>
 
 #include "exprs/expr.h"
+#include "exprs/slot-ref.h"
 #include "runtime/descriptors.h"
 #include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
@@ -67,6 +68,7 @@ Status TopNNode::Prepare(RuntimeState* state) {
 
 Status TopNNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -79,6 +81,41 @@ Status TopNNode::Open(RuntimeState* state) {
       new priority_queue<Tuple*, vector<Tuple*>, TupleRowComparator>(
           *tuple_row_less_than_));
 
+  // Map each ordering expr back to the materialization expr that produces its value,
+  // so input rows can be compared against the heap root before being materialized.
+  // This is possible when every ordering expr is a direct reference to a sort tuple
+  // slot, which is how the planner normally materializes the ordering exprs.
+  const vector<ExprContext*>& lhs_ordering_ctxs =
+      sort_exec_exprs_.lhs_ordering_expr_ctxs();
+  vector<ExprContext*> input_ordering_ctxs;
+  for (int i = 0; i < lhs_ordering_ctxs.size(); ++i) {
+    Expr* root = lhs_ordering_ctxs[i]->root();
+    if (!root->is_slotref()) break;
+    const SlotRef* slot_ref = static_cast<const SlotRef*>(root);
+    // Find the position of the referenced slot among the materialized slots; the
+    // materialization exprs are in that order.
+    const vector<SlotDescriptor*>& slots = materialized_tuple_desc_->slots();
+    int materialized_idx = -1;
+    int num_materialized = 0;
+    for (int j = 0; j < slots.size(); ++j) {
+      if (!slots[j]->is_materialized()) continue;
+      if (slots[j]->id() == slot_ref->slot_id()) {
+        materialized_idx = num_materialized;
+        break;
+      }
+      ++num_materialized;
+    }
+    if (materialized_idx == -1) break;
+    DCHECK_LT(materialized_idx, sort_exec_exprs_.sort_tuple_slot_expr_ctxs().size());
+    input_ordering_ctxs.push_back(
+        sort_exec_exprs_.sort_tuple_slot_expr_ctxs()[materialized_idx]);
+  }
+  if (!input_ordering_ctxs.empty() &&
+      input_ordering_ctxs.size() == lhs_ordering_ctxs.size()) {
+    input_vs_heap_less_than_.reset(new TupleRowComparator(input_ordering_ctxs,
+        sort_exec_exprs_.rhs_ordering_expr_ctxs(), is_asc_order_, nulls_first_));
+  }
+
   RETURN_IF_ERROR(child(0)->Open(state));
 
   // Limit of 0, no need to fetch anything from children.
@@ -103,6 +140,7 @@ Status TopNNode::Open(RuntimeState* state) {
 
 Status TopNNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_HW_COUNTERS(hw_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -145,15 +183,23 @@ void TopNNode::InsertTupleRow(TupleRow* input_row) {
   } else {
     DCHECK(!priority_queue_->empty());
     Tuple* top_tuple = priority_queue_->top();
-    tmp_tuple_->MaterializeExprs<false>(input_row, *materialized_tuple_desc_,
-            sort_exec_exprs_.sort_tuple_slot_expr_ctxs(), NULL);
-    if ((*tuple_row_less_than_)(tmp_tuple_, top_tuple)) {
-      // TODO: DeepCopy() will allocate new buffers for the string data. This needs
-      // to be fixed to use a freelist
-      tmp_tuple_->DeepCopy(top_tuple, *materialized_tuple_desc_, tuple_pool_.get());
-      insert_tuple = top_tuple;
-      priority_queue_->pop();
+    if (input_vs_heap_less_than_.get() != NULL) {
+      // Compare the input row against the heap root first: rows that cannot displace
+      // the root are rejected without evaluating the materialization exprs.
+      TupleRow* top_row = reinterpret_cast<TupleRow*>(&top_tuple);
+      if (!(*input_vs_heap_less_than_)(input_row, top_row)) return;
+      tmp_tuple_->MaterializeExprs<false>(input_row, *materialized_tuple_desc_,
+          sort_exec_exprs_.sort_tuple_slot_expr_ctxs(), NULL);
+    } else {
+      tmp_tuple_->MaterializeExprs<false>(input_row, *materialized_tuple_desc_,
+          sort_exec_exprs_.sort_tuple_slot_expr_ctxs(), NULL);
+      if (!(*tuple_row_less_than_)(tmp_tuple_, top_tuple)) return;
     }
+    // TODO: DeepCopy() will allocate new buffers for the string data. This needs
+    // to be fixed to use a freelist
+    tmp_tuple_->DeepCopy(top_tuple, *materialized_tuple_desc_, tuple_pool_.get());
+    insert_tuple = top_tuple;
+    priority_queue_->pop();
   }
 
   if (insert_tuple != NULL) priority_queue_->push(insert_tuple);
@@ -73,6 +73,12 @@ class TopNNode : public ExecNode {
 
   boost::scoped_ptr<TupleRowComparator> tuple_row_less_than_;
 
+  // Compares an input row directly against the heap root by evaluating the ordering
+  // values through the corresponding materialization exprs, so that rows which cannot
+  // displace the root are rejected before being materialized. NULL if some ordering
+  // expr is not a direct reference to a sort tuple slot. Assigned in Open().
+  boost::scoped_ptr<TupleRowComparator> input_vs_heap_less_than_;
+
   // The priority queue will never have more elements in it than the LIMIT + OFFSET.
   // The stl priority queue doesn't support a max size, so to get that functionality,
   // the order of the queue is the opposite of what the ORDER BY clause specifies, such
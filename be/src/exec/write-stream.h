@@ -22,10 +22,15 @@
 
 namespace impala {
 
-// An append-only buffer to stage output from file writers. The buffer is backed
-// by a stringstream and uses the ReadWriteUtil to encode data. Append
-// operations will never fail, and will grow the backing buffer using
-// stringstream semantics. Each write function returns the number of bytes written
+// An append-only buffer to stage output from file writers. The buffer is backed by a
+// contiguous, doubling byte array and uses the ReadWriteUtil to encode data. Append
+// operations will never fail, and will grow the backing buffer as needed. Each write
+// function returns the number of bytes written.
+//
+// Writers on hot row paths should call Reserve() once per row with an upper bound on
+// the row's serialized size (computable from the TupleDescriptor for fixed-size
+// fields), then append the individual fields with the *Unchecked() variants, which
+// skip the capacity check and encode varints directly into the buffer.
 class WriteStream {
  public:
 
@@ -49,6 +54,21 @@ class WriteStream {
   // Writes an empty string to the buffer (encoded as 1 byte)
   inline int WriteEmptyText();
 
+  // Ensures that at least 'length' more bytes can be appended with the *Unchecked()
+  // methods without a bounds check or reallocation.
+  inline void Reserve(int64_t length);
+
+  // Append variants that skip the capacity check. The caller must have Reserve()'d
+  // space for every byte written since the last checked write. Varints are encoded
+  // directly into the buffer instead of into a temporary that is then copied, so
+  // reserve their MAX_*_LEN.
+  inline int WriteBytesUnchecked(int length, const uint8_t* buf);
+  inline int WriteBytesUnchecked(int length, const char* buf);
+  inline int WriteByteUnchecked(char val);
+  inline int WriteVLongUnchecked(int64_t val);
+  inline int WriteZIntUnchecked(int32_t val);
+  inline int WriteZLongUnchecked(int64_t val);
+
   inline void Clear();
   inline size_t Size();
 
@@ -56,8 +76,10 @@ class WriteStream {
   inline std::string String();
 
  private:
-  // TODO consider making this like the parquet writer to avoid extra copy
-  std::stringstream buffer_;
+  // Backing buffer. buffer_.size() is the capacity; len_ is the number of bytes
+  // written so far. The capacity is retained across Clear() calls so steady-state
+  // appends never allocate.
+  std::string buffer_;
   uint64_t len_;
 };
 
@@ -20,11 +20,25 @@
 #include "exec/read-write-util.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#include "common/compiler-util.h"
 
 using namespace std;
 
 namespace impala {
 
+// Initial capacity of the backing buffer on the first write.
+static const int64_t WRITE_STREAM_INITIAL_CAPACITY = 1024;
+
+inline void WriteStream::Reserve(int64_t length) {
+  uint64_t required = len_ + length;
+  if (LIKELY(required <= buffer_.size())) return;
+  uint64_t capacity = max<uint64_t>(buffer_.size() * 2, WRITE_STREAM_INITIAL_CAPACITY);
+  while (capacity < required) capacity *= 2;
+  buffer_.resize(capacity);
+}
+
 inline int WriteStream::WriteByte(uint8_t val) {
   return WriteByte(static_cast<char>(val));
 }
@@ -34,33 +48,30 @@ inline int WriteStream::WriteByte(char val) {
 }
 
 inline int WriteStream::WriteVLong(int64_t val) {
-  uint8_t buf[ReadWriteUtil::MAX_VINT_LEN];
-  int size = ReadWriteUtil::PutVLong(val, buf);
-  return WriteBytes(size, buf);
+  Reserve(ReadWriteUtil::MAX_VINT_LEN);
+  return WriteVLongUnchecked(val);
 }
 
 inline int WriteStream::WriteVInt(int32_t val) {
-  uint8_t buf[ReadWriteUtil::MAX_VINT_LEN];
-  int size = ReadWriteUtil::PutVInt(val, buf);
-  return WriteBytes(size, buf);
+  Reserve(ReadWriteUtil::MAX_VINT_LEN);
+  return WriteVLongUnchecked(val);
 }
 
 inline int WriteStream::WriteInt(uint32_t val) {
-  uint8_t buf[sizeof(int32_t)];
-  ReadWriteUtil::PutInt(static_cast<uint8_t*>(buf), val);
-  return WriteBytes(sizeof(int32_t), buf);
+  Reserve(sizeof(int32_t));
+  ReadWriteUtil::PutInt(reinterpret_cast<uint8_t*>(&buffer_[len_]), val);
+  len_ += sizeof(int32_t);
+  return sizeof(int32_t);
 }
 
 inline int WriteStream::WriteZInt(int32_t val) {
-  uint8_t buf[ReadWriteUtil::MAX_ZINT_LEN];
-  int len = ReadWriteUtil::PutZInt(val, buf);
-  return WriteBytes(len, buf);
+  Reserve(ReadWriteUtil::MAX_ZINT_LEN);
+  return WriteZIntUnchecked(val);
 }
 
 inline int WriteStream::WriteZLong(int64_t val) {
-  uint8_t buf[ReadWriteUtil::MAX_ZLONG_LEN];
-  int len = ReadWriteUtil::PutZLong(val, buf);
-  return WriteBytes(len, buf);
+  Reserve(ReadWriteUtil::MAX_ZLONG_LEN);
+  return WriteZLongUnchecked(val);
 }
 
 inline int WriteStream::WriteBytes(int length, const uint8_t* buf) {
@@ -68,11 +79,50 @@ inline int WriteStream::WriteBytes(int length, const uint8_t* buf) {
 }
 
 inline int WriteStream::WriteBytes(int length, const char* buf) {
+  Reserve(length);
+  return WriteBytesUnchecked(length, buf);
+}
+
+inline int WriteStream::WriteBytesUnchecked(int length, const uint8_t* buf) {
+  return WriteBytesUnchecked(length, reinterpret_cast<const char*>(buf));
+}
+
+inline int WriteStream::WriteBytesUnchecked(int length, const char* buf) {
+  if (UNLIKELY(length == 0)) return 0;
+  DCHECK_LE(len_ + length, buffer_.size());
+  memcpy(&buffer_[len_], buf, length);
   len_ += length;
-  buffer_.write(buf, length);
   return length;
 }
 
+inline int WriteStream::WriteByteUnchecked(char val) {
+  DCHECK_LT(len_, buffer_.size());
+  buffer_[len_++] = val;
+  return 1;
+}
+
+inline int WriteStream::WriteVLongUnchecked(int64_t val) {
+  DCHECK_LE(len_ + ReadWriteUtil::MAX_VINT_LEN, buffer_.size());
+  int64_t size =
+      ReadWriteUtil::PutVLong(val, reinterpret_cast<uint8_t*>(&buffer_[len_]));
+  len_ += size;
+  return size;
+}
+
+inline int WriteStream::WriteZIntUnchecked(int32_t val) {
+  DCHECK_LE(len_ + ReadWriteUtil::MAX_ZINT_LEN, buffer_.size());
+  int size = ReadWriteUtil::PutZInt(val, reinterpret_cast<uint8_t*>(&buffer_[len_]));
+  len_ += size;
+  return size;
+}
+
+inline int WriteStream::WriteZLongUnchecked(int64_t val) {
+  DCHECK_LE(len_ + ReadWriteUtil::MAX_ZLONG_LEN, buffer_.size());
+  int size = ReadWriteUtil::PutZLong(val, reinterpret_cast<uint8_t*>(&buffer_[len_]));
+  len_ += size;
+  return size;
+}
+
 inline int WriteStream::WriteText(int length, const uint8_t* buf) {
   int l = length;
   l += WriteVInt(length);
@@ -90,7 +140,7 @@ inline int WriteStream::WriteBoolean(bool b) {
 }
 
 inline string WriteStream::String() {
-  return buffer_.str();
+  return string(buffer_.data(), len_);
 }
 
 inline size_t WriteStream::Size() {
@@ -98,8 +148,8 @@ inline size_t WriteStream::Size() {
 }
 
 inline void WriteStream::Clear() {
+  // Keep the backing buffer so steady-state appends never allocate.
   len_ = 0;
-  buffer_.str("");
 }
 
 } // namespace impala
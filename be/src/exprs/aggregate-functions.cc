@@ -55,6 +55,21 @@ static const StringVal DEFAULT_STRING_CONCAT_DELIM((uint8_t*)", ", 2);
 const int AggregateFunctions::HLL_PRECISION = 10;
 const int AggregateFunctions::HLL_LEN = 1024; // 2^HLL_PRECISION
 
+// Effective HLL precision. This file is cross-compiled to IR, so it cannot read
+// --hll_precision directly; SetHllPrecision() is called from InitCommonRuntime()
+// before any queries run. Only HllInit() reads it, which always executes natively.
+static int hll_precision = AggregateFunctions::HLL_PRECISION;
+
+void AggregateFunctions::SetHllPrecision(int precision) {
+  DCHECK_GE(precision, 4);
+  DCHECK_LE(precision, 16);
+  hll_precision = precision;
+}
+
+int AggregateFunctions::HllPrecision() { return hll_precision; }
+
+int AggregateFunctions::HllLen() { return 1 << hll_precision; }
+
 void AggregateFunctions::InitNull(FunctionContext*, AnyVal* dst) {
   dst->is_null = true;
 }
@@ -71,6 +86,15 @@ void AggregateFunctions::InitZero(FunctionContext*, DecimalVal* dst) {
   dst->val16 = 0;
 }
 
+// Returns true if the UDA's intermediate value lives inline in a fixed-width
+// (CHAR(N), i.e. TYPE_FIXED_BUFFER) slot of the intermediate tuple. In that case
+// AggFnEvaluator::Init() points the intermediate StringVal at the slot, so Init()
+// functions must not allocate and Serialize()/Finalize() have nothing to free: the
+// raw struct flows between the aggregation phases without a copy.
+static bool HasFixedIntermediate(FunctionContext* ctx) {
+  return ctx->impl()->intermediate_type().type == FunctionContext::TYPE_FIXED_BUFFER;
+}
+
 StringVal AggregateFunctions::StringValGetValue(
     FunctionContext* ctx, const StringVal& src) {
   if (src.is_null) return src;
@@ -81,6 +105,11 @@ StringVal AggregateFunctions::StringValGetValue(
 
 StringVal AggregateFunctions::StringValSerializeOrFinalize(
     FunctionContext* ctx, const StringVal& src) {
+  if (HasFixedIntermediate(ctx)) {
+    // The intermediate is stored inline in the tuple, which is already the layout the
+    // rest of the plan sees; there is nothing to copy or free.
+    return src;
+  }
   StringVal result = StringValGetValue(ctx, src);
   if (!src.is_null) ctx->Free(src.ptr);
   return result;
@@ -126,8 +155,13 @@ struct AvgState {
 
 void AggregateFunctions::AvgInit(FunctionContext* ctx, StringVal* dst) {
   dst->is_null = false;
-  dst->len = sizeof(AvgState);
-  dst->ptr = ctx->Allocate(dst->len);
+  if (HasFixedIntermediate(ctx)) {
+    // 'dst' already points at CHAR(sizeof(AvgState)) storage inline in the tuple.
+    DCHECK_EQ(dst->len, sizeof(AvgState));
+  } else {
+    dst->len = sizeof(AvgState);
+    dst->ptr = ctx->Allocate(dst->len);
+  }
   memset(dst->ptr, 0, sizeof(AvgState));
 }
 
@@ -172,7 +206,7 @@ DoubleVal AggregateFunctions::AvgGetValue(FunctionContext* ctx, const StringVal&
 
 DoubleVal AggregateFunctions::AvgFinalize(FunctionContext* ctx, const StringVal& src) {
   DoubleVal result = AvgGetValue(ctx, src);
-  ctx->Free(src.ptr);
+  if (!HasFixedIntermediate(ctx)) ctx->Free(src.ptr);
   return result;
 }
 
@@ -212,7 +246,7 @@ TimestampVal AggregateFunctions::TimestampAvgGetValue(FunctionContext* ctx,
 TimestampVal AggregateFunctions::TimestampAvgFinalize(FunctionContext* ctx,
     const StringVal& src) {
   TimestampVal result = TimestampAvgGetValue(ctx, src);
-  ctx->Free(src.ptr);
+  if (!HasFixedIntermediate(ctx)) ctx->Free(src.ptr);
   return result;
 }
 
@@ -223,8 +257,14 @@ struct DecimalAvgState {
 
 void AggregateFunctions::DecimalAvgInit(FunctionContext* ctx, StringVal* dst) {
   dst->is_null = false;
-  dst->len = sizeof(DecimalAvgState);
-  dst->ptr = ctx->Allocate(dst->len);
+  if (HasFixedIntermediate(ctx)) {
+    // 'dst' already points at CHAR(sizeof(DecimalAvgState)) storage inline in the
+    // tuple.
+    DCHECK_EQ(dst->len, sizeof(DecimalAvgState));
+  } else {
+    dst->len = sizeof(DecimalAvgState);
+    dst->ptr = ctx->Allocate(dst->len);
+  }
   memset(dst->ptr, 0, sizeof(DecimalAvgState));
 }
 
@@ -311,7 +351,7 @@ DecimalVal AggregateFunctions::DecimalAvgGetValue(FunctionContext* ctx,
 DecimalVal AggregateFunctions::DecimalAvgFinalize(FunctionContext* ctx,
     const StringVal& src) {
   DecimalVal result = DecimalAvgGetValue(ctx, src);
-  ctx->Free(src.ptr);
+  if (!HasFixedIntermediate(ctx)) ctx->Free(src.ptr);
   return result;
 }
 
@@ -992,7 +1032,7 @@ T AggregateFunctions::AppxMedianFinalize(FunctionContext* ctx,
 }
 
 void AggregateFunctions::HllInit(FunctionContext* ctx, StringVal* dst) {
-  int str_len = HLL_LEN;
+  int str_len = HllLen();
   dst->is_null = false;
   dst->ptr = ctx->Allocate(str_len);
   dst->len = str_len;
@@ -1003,14 +1043,18 @@ template <typename T>
 void AggregateFunctions::HllUpdate(FunctionContext* ctx, const T& src, StringVal* dst) {
   if (src.is_null) return;
   DCHECK(!dst->is_null);
-  DCHECK_EQ(dst->len, HLL_LEN);
+  // The number of buckets is derived from the intermediate allocated by HllInit()
+  // rather than the constants, so this code does not depend on --hll_precision.
+  DCHECK_GT(dst->len, 0);
+  DCHECK_EQ(dst->len & (dst->len - 1), 0) << dst->len;
   uint64_t hash_value =
       AnyValUtil::Hash64(src, *ctx->GetArgType(0), HashUtil::FNV64_SEED);
   if (hash_value != 0) {
     // Use the lower bits to index into the number of streams and then
     // find the first 1 bit after the index bits.
-    int idx = hash_value & (HLL_LEN - 1);
-    uint8_t first_one_bit = __builtin_ctzl(hash_value >> HLL_PRECISION) + 1;
+    int precision = __builtin_ctz(dst->len);
+    int idx = hash_value & (dst->len - 1);
+    uint8_t first_one_bit = __builtin_ctzl(hash_value >> precision) + 1;
     dst->ptr[idx] = ::max(dst->ptr[idx], first_one_bit);
   }
 }
@@ -1019,8 +1063,7 @@ void AggregateFunctions::HllMerge(FunctionContext* ctx, const StringVal& src,
     StringVal* dst) {
   DCHECK(!dst->is_null);
   DCHECK(!src.is_null);
-  DCHECK_EQ(dst->len, HLL_LEN);
-  DCHECK_EQ(src.len, HLL_LEN);
+  DCHECK_EQ(dst->len, src.len);
   for (int i = 0; i < src.len; ++i) {
     dst->ptr[i] = ::max(dst->ptr[i], src.ptr[i]);
   }
@@ -1029,18 +1072,19 @@ void AggregateFunctions::HllMerge(FunctionContext* ctx, const StringVal& src,
 uint64_t AggregateFunctions::HllFinalEstimate(const uint8_t* buckets,
     int32_t num_buckets) {
   DCHECK_NOTNULL(buckets);
-  DCHECK_EQ(num_buckets, HLL_LEN);
+  DCHECK_GT(num_buckets, 0);
+  DCHECK_EQ(num_buckets & (num_buckets - 1), 0) << num_buckets;
 
   // Empirical constants for the algorithm.
   float alpha = 0;
-  if (HLL_LEN == 16) {
+  if (num_buckets == 16) {
     alpha = 0.673f;
-  } else if (HLL_LEN == 32) {
+  } else if (num_buckets == 32) {
     alpha = 0.697f;
-  } else if (HLL_LEN == 64) {
+  } else if (num_buckets == 64) {
     alpha = 0.709f;
   } else {
-    alpha = 0.7213f / (1 + 1.079f / HLL_LEN);
+    alpha = 0.7213f / (1 + 1.079f / num_buckets);
   }
 
   float harmonic_mean = 0;
@@ -1051,12 +1095,13 @@ uint64_t AggregateFunctions::HllFinalEstimate(const uint8_t* buckets,
     if (buckets[i] == 0) ++num_zero_registers;
   }
   harmonic_mean = 1.0f / harmonic_mean;
-  int64_t estimate = alpha * HLL_LEN * HLL_LEN * harmonic_mean;
+  int64_t estimate = alpha * num_buckets * num_buckets * harmonic_mean;
 
   if (num_zero_registers != 0) {
     // Estimated cardinality is too low. Hll is too inaccurate here, instead use
     // linear counting.
-    estimate = HLL_LEN * log(static_cast<float>(HLL_LEN) / num_zero_registers);
+    estimate = num_buckets *
+        log(static_cast<float>(num_buckets) / num_zero_registers);
   }
 
   return estimate;
@@ -52,8 +52,10 @@ class AggregateFunctions {
   static void CountStarRemove(FunctionContext*, BigIntVal* dst);
   static void CountMerge(FunctionContext*, const BigIntVal& src, BigIntVal* dst);
 
-  // Implementation of Avg.
-  // TODO: Change this to use a fixed-sized BufferVal as intermediate type.
+  // Implementation of Avg. The intermediate is an AvgState struct. With a fixed-width
+  // CHAR intermediate type (as for KnuthVar*) the struct lives inline in the
+  // intermediate tuple and there is no Serialize() copy between phases; with a STRING
+  // intermediate type it is allocated from the FunctionContext as before.
   static void AvgInit(FunctionContext* ctx, StringVal* dst);
   template <typename T>
   static void AvgUpdate(FunctionContext* ctx, const T& src, StringVal* dst);
@@ -171,8 +173,20 @@ class AggregateFunctions {
   // 1) Hyperloglog: The analysis of a near-optimal cardinality estimation
   // algorithm (2007)
   // 2) HyperLogLog in Practice (paper from google with some improvements)
+  // Default precision; the effective precision is configurable via --hll_precision
+  // and is returned by HllPrecision().
   static const int HLL_PRECISION;
   static const int HLL_LEN;
+
+  // Sets the effective HLL precision. Called once at daemon startup, before any
+  // queries run; the value must be identical on all impalads since they exchange
+  // and merge HLL intermediates.
+  static void SetHllPrecision(int precision);
+
+  // Effective precision and number of HLL buckets (2^precision).
+  static int HllPrecision();
+  static int HllLen();
+
   static void HllInit(FunctionContext*, StringVal* slot);
   template <typename T>
   static void HllUpdate(FunctionContext*, const T& src, StringVal* dst);
@@ -36,19 +36,125 @@ struct CaseExprState {
   AnyVal* when_val;
 };
 
+// Maximum number of entries in a CASE jump table. Chains whose WHEN values span a
+// wider range fall back to sequential evaluation.
+static const int MAX_JUMP_TABLE_SIZE = 1024;
+
 CaseExpr::CaseExpr(const TExprNode& node)
   : Expr(node),
     has_case_expr_(node.case_expr.has_case_expr),
-    has_else_expr_(node.case_expr.has_else_expr) {
+    has_else_expr_(node.case_expr.has_else_expr),
+    jump_table_min_(0),
+    jump_table_checked_(false) {
 }
 
 Status CaseExpr::Prepare(RuntimeState* state, const RowDescriptor& desc,
                          ExprContext* ctx) {
   RETURN_IF_ERROR(Expr::Prepare(state, desc, ctx));
   RegisterFunctionContext(ctx, state);
+  if (!jump_table_checked_) {
+    jump_table_checked_ = true;
+    BuildJumpTable();
+  }
   return Status::OK;
 }
 
+void CaseExpr::BuildJumpTable() {
+  if (!has_case_expr()) return;
+  const ColumnType& case_type = children_[0]->type();
+  if (case_type.type != TYPE_TINYINT && case_type.type != TYPE_SMALLINT &&
+      case_type.type != TYPE_INT && case_type.type != TYPE_BIGINT) {
+    return;
+  }
+  const int loop_end = has_else_expr() ? GetNumChildren() - 1 : GetNumChildren();
+  // (when value, index of the corresponding then child). NULL literals are dropped
+  // since they can never match a non-NULL case value.
+  vector<pair<int64_t, int> > whens;
+  int64_t min_val = 0;
+  int64_t max_val = 0;
+  for (int i = 1; i < loop_end; i += 2) {
+    if (!children_[i]->IsLiteral()) return;
+    // Literals don't reference the context or row, so they can be evaluated here.
+    int64_t val;
+    switch (case_type.type) {
+      case TYPE_TINYINT: {
+        TinyIntVal v = children_[i]->GetTinyIntVal(NULL, NULL);
+        if (v.is_null) continue;
+        val = v.val;
+        break;
+      }
+      case TYPE_SMALLINT: {
+        SmallIntVal v = children_[i]->GetSmallIntVal(NULL, NULL);
+        if (v.is_null) continue;
+        val = v.val;
+        break;
+      }
+      case TYPE_INT: {
+        IntVal v = children_[i]->GetIntVal(NULL, NULL);
+        if (v.is_null) continue;
+        val = v.val;
+        break;
+      }
+      case TYPE_BIGINT: {
+        BigIntVal v = children_[i]->GetBigIntVal(NULL, NULL);
+        if (v.is_null) continue;
+        val = v.val;
+        break;
+      }
+      default:
+        DCHECK(false) << case_type;
+        return;
+    }
+    if (whens.empty()) {
+      min_val = max_val = val;
+    } else {
+      if (val < min_val) min_val = val;
+      if (val > max_val) max_val = val;
+    }
+    whens.push_back(make_pair(val, i + 1));
+  }
+  if (whens.empty()) return;
+  // Require the value range to be small and reasonably dense so the table stays
+  // cache-resident and doesn't dwarf the chain it replaces. The unsigned subtraction
+  // also catches ranges that overflow int64_t.
+  uint64_t range = static_cast<uint64_t>(max_val) - static_cast<uint64_t>(min_val);
+  if (range >= MAX_JUMP_TABLE_SIZE || range + 1 > 4 * whens.size()) return;
+  jump_table_min_ = min_val;
+  jump_table_.assign(range + 1, -1);
+  for (int i = 0; i < whens.size(); ++i) {
+    int offset = whens[i].first - min_val;
+    // The first WHEN wins if the same value appears more than once.
+    if (jump_table_[offset] == -1) jump_table_[offset] = whens[i].second;
+  }
+}
+
+int CaseExpr::LookupJumpTable(const AnyVal* case_val) {
+  DCHECK(!jump_table_.empty());
+  DCHECK(!case_val->is_null);
+  int64_t val;
+  switch (children_[0]->type().type) {
+    case TYPE_TINYINT:
+      val = reinterpret_cast<const TinyIntVal*>(case_val)->val;
+      break;
+    case TYPE_SMALLINT:
+      val = reinterpret_cast<const SmallIntVal*>(case_val)->val;
+      break;
+    case TYPE_INT:
+      val = reinterpret_cast<const IntVal*>(case_val)->val;
+      break;
+    case TYPE_BIGINT:
+      val = reinterpret_cast<const BigIntVal*>(case_val)->val;
+      break;
+    default:
+      DCHECK(false) << children_[0]->type();
+      return -1;
+  }
+  uint64_t offset = static_cast<uint64_t>(val) - static_cast<uint64_t>(jump_table_min_);
+  int idx = offset < jump_table_.size() ? jump_table_[offset] : -1;
+  if (idx == -1 && has_else_expr()) idx = GetNumChildren() - 1;
+  return idx;
+}
+
 Status CaseExpr::Open(RuntimeState* state, ExprContext* ctx,
                       FunctionContext::FunctionStateScope scope) {
   RETURN_IF_ERROR(Expr::Open(state, ctx, scope));
@@ -222,53 +328,81 @@ Status CaseExpr::GetCodegendComputeFn(RuntimeState* state, Function** fn) {
     DCHECK_GE(num_children, (has_else_expr()) ? 3 : 2);
   }
 
-  const int loop_end = (has_else_expr()) ? num_children - 1 : num_children;
-  const int last_loop_iter = loop_end - 2;
-  // The loop increments by two each time, because each iteration handles one when/then
-  // pair. Both when and then subexpressions are single children. If there is a case expr
-  // start loop at index 1. (case expr is children()[0] and has already be evaluated.
-  for (int i = (has_case_expr()) ? 1 : 0; i < loop_end; i += 2) {
-    BasicBlock* check_when_expr_block = BasicBlock::Create(
-        context, "check_when_expr_block", function, default_value_block);
-    BasicBlock* return_then_expr_block =
-        BasicBlock::Create(context, "return_then_expr", function, default_value_block);
-
-    // continue_or_exit_block either points to the next eval_next_when_expr block,
-    // or points to the defaut_value_block if there are no more when/then expressions.
-    BasicBlock* continue_or_exit_block = NULL;
-    if (i == last_loop_iter) {
-      continue_or_exit_block = default_value_block;
-    } else {
-      continue_or_exit_block = BasicBlock::Create(
-          context, "eval_next_when_expr", function, default_value_block);
+  if (!jump_table_.empty()) {
+    // Dense all-literal chain: switch directly on the case value instead of testing
+    // each WHEN expr in turn. LLVM lowers this to a jump or lookup table.
+    DCHECK(has_case_expr());
+    builder.SetInsertPoint(eval_first_when_expr_block);
+    IntegerType* case_llvm_type = cast<IntegerType>(case_val.GetVal()->getType());
+    SwitchInst* switch_inst = builder.CreateSwitch(
+        case_val.GetVal(), default_value_block, jump_table_.size());
+    // One block per distinct THEN child; duplicate WHEN values share it.
+    vector<BasicBlock*> then_blocks(num_children, NULL);
+    for (int i = 0; i < jump_table_.size(); ++i) {
+      const int then_idx = jump_table_[i];
+      if (then_idx == -1) continue;
+      if (then_blocks[then_idx] == NULL) {
+        then_blocks[then_idx] = BasicBlock::Create(
+            context, "return_then_expr", function, default_value_block);
+        builder.SetInsertPoint(then_blocks[then_idx]);
+        Value* then_val = CodegenAnyVal::CreateCall(
+            codegen, &builder, child_fns[then_idx], args, "then_val");
+        builder.CreateRet(then_val);
+      }
+      switch_inst->addCase(
+          ConstantInt::get(case_llvm_type, jump_table_min_ + i, true),
+          then_blocks[then_idx]);
     }
+  } else {
+    const int loop_end = (has_else_expr()) ? num_children - 1 : num_children;
+    const int last_loop_iter = loop_end - 2;
+    // The loop increments by two each time, because each iteration handles one when/then
+    // pair. Both when and then subexpressions are single children. If there is a case
+    // expr start loop at index 1. (case expr is children()[0] and has already be
+    // evaluated.
+    for (int i = (has_case_expr()) ? 1 : 0; i < loop_end; i += 2) {
+      BasicBlock* check_when_expr_block = BasicBlock::Create(
+          context, "check_when_expr_block", function, default_value_block);
+      BasicBlock* return_then_expr_block =
+          BasicBlock::Create(context, "return_then_expr", function, default_value_block);
 
-    // Get the child value of the when statement. If NULL simply continue to next when
-    // statement
-    builder.SetInsertPoint(current_when_expr_block);
-    CodegenAnyVal when_val = CodegenAnyVal::CreateCallWrapped(
-        codegen, &builder, children()[i]->type(), child_fns[i], args, "when_val");
-    builder.CreateCondBr(
-        when_val.GetIsNull(), continue_or_exit_block, check_when_expr_block);
+      // continue_or_exit_block either points to the next eval_next_when_expr block,
+      // or points to the defaut_value_block if there are no more when/then expressions.
+      BasicBlock* continue_or_exit_block = NULL;
+      if (i == last_loop_iter) {
+        continue_or_exit_block = default_value_block;
+      } else {
+        continue_or_exit_block = BasicBlock::Create(
+            context, "eval_next_when_expr", function, default_value_block);
+      }
 
-    builder.SetInsertPoint(check_when_expr_block);
-    if (has_case_expr()) {
-      // Compare for equality
-      Value* is_equal = case_val.Eq(&when_val);
-      builder.CreateCondBr(is_equal, return_then_expr_block, continue_or_exit_block);
-    } else {
+      // Get the child value of the when statement. If NULL simply continue to next when
+      // statement
+      builder.SetInsertPoint(current_when_expr_block);
+      CodegenAnyVal when_val = CodegenAnyVal::CreateCallWrapped(
+          codegen, &builder, children()[i]->type(), child_fns[i], args, "when_val");
       builder.CreateCondBr(
-          when_val.GetVal(), return_then_expr_block, continue_or_exit_block);
-    }
+          when_val.GetIsNull(), continue_or_exit_block, check_when_expr_block);
 
-    builder.SetInsertPoint(return_then_expr_block);
+      builder.SetInsertPoint(check_when_expr_block);
+      if (has_case_expr()) {
+        // Compare for equality
+        Value* is_equal = case_val.Eq(&when_val);
+        builder.CreateCondBr(is_equal, return_then_expr_block, continue_or_exit_block);
+      } else {
+        builder.CreateCondBr(
+            when_val.GetVal(), return_then_expr_block, continue_or_exit_block);
+      }
 
-    // Eval and return then value
-    Value* then_val = CodegenAnyVal::CreateCall(
-        codegen, &builder, child_fns[i+1], args, "then_val");
-    builder.CreateRet(then_val);
+      builder.SetInsertPoint(return_then_expr_block);
 
-    current_when_expr_block = continue_or_exit_block;
+      // Eval and return then value
+      Value* then_val = CodegenAnyVal::CreateCall(
+          codegen, &builder, child_fns[i+1], args, "then_val");
+      builder.CreateRet(then_val);
+
+      current_when_expr_block = continue_or_exit_block;
+    }
   }
 
   builder.SetInsertPoint(default_value_block);
@@ -387,6 +521,12 @@ bool CaseExpr::AnyValEq(const ColumnType& type, const AnyVal* v1, const AnyVal*
         return THEN_TYPE::null(); \
       } \
     } \
+    if (!jump_table_.empty()) { \
+      /* Dense all-literal chain: pick the then/else child directly. */ \
+      int child_idx = LookupJumpTable(state->case_val); \
+      if (child_idx == -1) return THEN_TYPE::null(); \
+      return children()[child_idx]->Get##THEN_TYPE(ctx, row); \
+    } \
     int loop_start = has_case_expr() ? 1 : 0; \
     int loop_end = (has_else_expr()) ? num_children - 1 : num_children; \
     for (int i = loop_start; i < loop_end; i += 2) { \
@@ -17,6 +17,7 @@
 #define IMPALA_EXPRS_CASE_EXPR_H_
 
 #include <string>
+#include <vector>
 #include "expr.h"
 
 using namespace impala_udf;
@@ -63,6 +64,24 @@ class CaseExpr: public Expr {
   const bool has_case_expr_;
   const bool has_else_expr_;
 
+  // For CASE <int expr> chains whose WHEN values are all integer literals spanning a
+  // small dense range, maps (when value - jump_table_min_) to the index of the THEN
+  // child to evaluate; entries with no matching WHEN hold -1. Built by BuildJumpTable()
+  // on the first Prepare(). Left empty for sparse or non-literal chains, which fall
+  // back to evaluating the WHEN exprs sequentially.
+  std::vector<int> jump_table_;
+  int64_t jump_table_min_;
+  bool jump_table_checked_;
+
+  // Builds 'jump_table_' if this is a dense all-literal integer CASE, otherwise leaves
+  // it empty.
+  void BuildJumpTable();
+
+  // Returns the index of the THEN child selected by 'jump_table_' for 'case_val', the
+  // ELSE child if no WHEN value matches, or -1 if the result is NULL. Only called when
+  // 'jump_table_' is non-empty and 'case_val' is non-NULL.
+  int LookupJumpTable(const AnyVal* case_val);
+
   // Populates 'dst' with the result of calling the appropriate Get*Val() function on the
   // specified child expr.
   void GetChildVal(int child_idx, ExprContext* ctx, TupleRow* row, AnyVal* dst);
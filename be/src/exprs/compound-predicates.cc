@@ -33,6 +33,16 @@ BooleanVal AndPredicate::GetBooleanVal(ExprContext* context, TupleRow* row) {
   return BooleanVal(true);
 }
 
+void AndPredicate::EvalBatch(ExprContext* context, RowBatch* batch, uint8_t* selected) {
+  DCHECK_EQ(children_.size(), 2);
+  // As a filter, (x AND y) keeps a row iff both sides are non-NULL true, so the
+  // three-valued AND semantics collapse to masking with each child in sequence; the
+  // second child is only evaluated for rows still selected, preserving the
+  // short-circuit of the row-at-a-time path.
+  children_[0]->EvalBatch(context, batch, selected);
+  children_[1]->EvalBatch(context, batch, selected);
+}
+
 // (<> || true) is true, (false || NULL) is NULL
 BooleanVal OrPredicate::GetBooleanVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(children_.size(), 2);
@@ -38,6 +38,7 @@ class CompoundPredicate: public Predicate {
 class AndPredicate: public CompoundPredicate {
  public:
   virtual impala_udf::BooleanVal GetBooleanVal(ExprContext* context, TupleRow*);
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, uint8_t* selected);
 
   virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn) {
     return CompoundPredicate::CodegenComputeFn(true, state, fn);
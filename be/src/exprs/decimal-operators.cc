@@ -22,6 +22,7 @@
 #include "exprs/case-expr.h"
 #include "exprs/expr.h"
 #include "runtime/tuple-row.h"
+#include "udf/udf-internal.h"
 #include "util/decimal-util.h"
 #include "util/string-parser.h"
 
@@ -549,6 +550,11 @@ BooleanVal DecimalOperators::CastToBooleanVal(
   }
 }
 
+// The return type's byte width and scale are read via GetConstFnAttr() so that the
+// codegen path replaces them with plan-time constants (see
+// ScalarFnCall::InlineConstFnAttrs()): the width switch folds down to the one taken
+// branch (no int256 code unless the result is a Decimal16Value) and the scale becomes
+// a constant multiplier.
 #define DECIMAL_ARITHMETIC_OP(FN_NAME, OP_FN) \
   DecimalVal DecimalOperators::FN_NAME( \
       FunctionContext* context, const DecimalVal& x, const DecimalVal& y) { \
@@ -556,13 +562,14 @@ BooleanVal DecimalOperators::CastToBooleanVal(
     bool overflow = false; \
     ColumnType x_type = AnyValUtil::TypeDescToColumnType(*context->GetArgType(0)); \
     ColumnType y_type = AnyValUtil::TypeDescToColumnType(*context->GetArgType(1)); \
-    ColumnType return_type = AnyValUtil::TypeDescToColumnType(context->GetReturnType()); \
-    switch (return_type.GetByteSize()) { \
+    int return_scale = \
+        context->impl()->GetConstFnAttr(FunctionContextImpl::RETURN_TYPE_SCALE); \
+    switch (context->impl()->GetConstFnAttr(FunctionContextImpl::RETURN_TYPE_SIZE)) { \
       case 4: { \
         Decimal4Value x_val = GetDecimal4Value(x, x_type, &overflow); \
         Decimal4Value y_val = GetDecimal4Value(y, y_type, &overflow); \
         Decimal4Value result = x_val.OP_FN<int32_t>( \
-            x_type, y_val, y_type, return_type.scale, &overflow); \
+            x_type, y_val, y_type, return_scale, &overflow); \
         DCHECK(!overflow) << "Cannot overflow except with Decimal16Value"; \
         return DecimalVal(result.value()); \
       } \
@@ -570,7 +577,7 @@ BooleanVal DecimalOperators::CastToBooleanVal(
         Decimal8Value x_val = GetDecimal8Value(x, x_type, &overflow); \
         Decimal8Value y_val = GetDecimal8Value(y, y_type, &overflow); \
         Decimal8Value result = x_val.OP_FN<int64_t>( \
-            x_type, y_val, y_type, return_type.scale, &overflow); \
+            x_type, y_val, y_type, return_scale, &overflow); \
         DCHECK(!overflow) << "Cannot overflow except with Decimal16Value"; \
         return DecimalVal(result.value()); \
       } \
@@ -578,7 +585,7 @@ BooleanVal DecimalOperators::CastToBooleanVal(
         Decimal16Value x_val = GetDecimal16Value(x, x_type, &overflow); \
         Decimal16Value y_val = GetDecimal16Value(y, y_type, &overflow); \
         Decimal16Value result = x_val.OP_FN<int128_t>( \
-            x_type, y_val, y_type, return_type.scale, &overflow); \
+            x_type, y_val, y_type, return_scale, &overflow); \
         RETURN_IF_OVERFLOW(context, overflow); \
         return DecimalVal(result.value()); \
       } \
@@ -596,13 +603,14 @@ BooleanVal DecimalOperators::CastToBooleanVal(
     bool is_nan = false; \
     ColumnType x_type = AnyValUtil::TypeDescToColumnType(*context->GetArgType(0)); \
     ColumnType y_type = AnyValUtil::TypeDescToColumnType(*context->GetArgType(1)); \
-    ColumnType return_type = AnyValUtil::TypeDescToColumnType(context->GetReturnType()); \
-    switch (return_type.GetByteSize()) { \
+    int return_scale = \
+        context->impl()->GetConstFnAttr(FunctionContextImpl::RETURN_TYPE_SCALE); \
+    switch (context->impl()->GetConstFnAttr(FunctionContextImpl::RETURN_TYPE_SIZE)) { \
       case 4: { \
         Decimal4Value x_val = GetDecimal4Value(x, x_type, &overflow); \
         Decimal4Value y_val = GetDecimal4Value(y, y_type, &overflow); \
         Decimal4Value result = x_val.OP_FN<int32_t>( \
-            x_type, y_val, y_type, return_type.scale, &is_nan, &overflow);        \
+            x_type, y_val, y_type, return_scale, &is_nan, &overflow);        \
         DCHECK(!overflow) << "Cannot overflow except with Decimal16Value"; \
         if (is_nan) return DecimalVal::null(); \
         return DecimalVal(result.value()); \
@@ -611,7 +619,7 @@ BooleanVal DecimalOperators::CastToBooleanVal(
         Decimal8Value x_val = GetDecimal8Value(x, x_type, &overflow); \
         Decimal8Value y_val = GetDecimal8Value(y, y_type, &overflow); \
         Decimal8Value result = x_val.OP_FN<int64_t>( \
-            x_type, y_val, y_type, return_type.scale, &is_nan, &overflow);        \
+            x_type, y_val, y_type, return_scale, &is_nan, &overflow);        \
         DCHECK(!overflow) << "Cannot overflow except with Decimal16Value"; \
         if (is_nan) return DecimalVal::null(); \
         return DecimalVal(result.value()); \
@@ -620,7 +628,7 @@ BooleanVal DecimalOperators::CastToBooleanVal(
         Decimal16Value x_val = GetDecimal16Value(x, x_type, &overflow); \
         Decimal16Value y_val = GetDecimal16Value(y, y_type, &overflow); \
         Decimal16Value result = x_val.OP_FN<int128_t>( \
-            x_type, y_val, y_type, return_type.scale, &is_nan, &overflow);  \
+            x_type, y_val, y_type, return_scale, &is_nan, &overflow);  \
         RETURN_IF_OVERFLOW(context, overflow); \
         if (is_nan) return DecimalVal::null(); \
         return DecimalVal(result.value()); \
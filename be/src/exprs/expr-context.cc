@@ -25,6 +25,8 @@ using namespace impala;
 using namespace impala_udf;
 using namespace std;
 
+DECLARE_bool(fold_constant_exprs);
+
 const char* ExprContext::LLVM_CLASS_NAME = "class.impala::ExprContext";
 
 ExprContext::ExprContext(Expr* root)
@@ -60,7 +62,12 @@ Status ExprContext::Open(RuntimeState* state) {
   // original's fragment state and only need to have thread-local state initialized.
   FunctionContext::FunctionStateScope scope =
       is_clone_? FunctionContext::THREAD_LOCAL : FunctionContext::FRAGMENT_LOCAL;
-  return root_->Open(state, this, scope);
+  RETURN_IF_ERROR(root_->Open(state, this, scope));
+  // Constant folding must wait until the tree is opened: evaluating a constant subtree
+  // can call into functions whose prepare functions run in Open(). Clones share the
+  // original's (already folded) expr tree.
+  if (!is_clone_ && FLAGS_fold_constant_exprs) Expr::FoldConstants(state, this, &root_);
+  return Status::OK;
 }
 
 void ExprContext::Close(RuntimeState* state) {
@@ -54,6 +54,7 @@
 #include "gen-cpp/Exprs_types.h"
 #include "gen-cpp/Data_types.h"
 #include "runtime/lib-cache.h"
+#include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/raw-value.h"
 #include "udf/udf.h"
@@ -67,6 +68,11 @@ using namespace impala_udf;
 using namespace std;
 using namespace llvm;
 
+DEFINE_bool(fold_constant_exprs, true, "If true, constant expr subtrees (e.g. "
+    "arithmetic on literals, CASE branches without slot references) are evaluated once "
+    "when the expr tree is opened and replaced with the precomputed literal, instead of "
+    "being re-evaluated for every row.");
+
 const char* Expr::LLVM_CLASS_NAME = "class.impala::Expr";
 
 template<class T>
@@ -362,6 +368,60 @@ Status Expr::Open(const vector<ExprContext*>& ctxs, RuntimeState* state) {
   return Status::OK;
 }
 
+void Expr::FoldConstants(RuntimeState* state, ExprContext* context, Expr** expr) {
+  Expr* e = *expr;
+  if (e->IsLiteral()) return;
+  Expr* replacement = NULL;
+  if (e->IsConstant()) replacement = CreateFoldedLiteral(state, context, e);
+  if (replacement == NULL) {
+    // Either this subtree references a slot or its type isn't foldable; constant
+    // subtrees below it may still be.
+    for (int i = 0; i < e->children_.size(); ++i) {
+      FoldConstants(state, context, &e->children_[i]);
+    }
+    return;
+  }
+  // Keep the folded subtree as a child of the replacement literal: Close() still
+  // reaches its FunctionContexts via the child list, and codegen'd functions compiled
+  // from the original tree remain valid. The literal's Get*Val() implementations
+  // never evaluate children.
+  replacement->AddChild(e);
+  *expr = replacement;
+}
+
+Expr* Expr::CreateFoldedLiteral(RuntimeState* state, ExprContext* context, Expr* e) {
+  AnyVal* val = e->GetConstVal(context);
+  DCHECK(val != NULL);
+  ObjectPool* pool = state->obj_pool();
+  if (val->is_null) return pool->Add(new NullLiteral(e->type_));
+  switch (e->type_.type) {
+    case TYPE_BOOLEAN:
+      return pool->Add(new Literal(e->type_, static_cast<BooleanVal*>(val)->val));
+    case TYPE_TINYINT:
+      return pool->Add(new Literal(e->type_, static_cast<TinyIntVal*>(val)->val));
+    case TYPE_SMALLINT:
+      return pool->Add(new Literal(e->type_, static_cast<SmallIntVal*>(val)->val));
+    case TYPE_INT:
+      return pool->Add(new Literal(e->type_, static_cast<IntVal*>(val)->val));
+    case TYPE_BIGINT:
+      return pool->Add(new Literal(e->type_, static_cast<BigIntVal*>(val)->val));
+    case TYPE_FLOAT:
+      return pool->Add(new Literal(e->type_, static_cast<FloatVal*>(val)->val));
+    case TYPE_DOUBLE:
+      return pool->Add(new Literal(e->type_, static_cast<DoubleVal*>(val)->val));
+    case TYPE_STRING: {
+      StringVal* string_val = static_cast<StringVal*>(val);
+      StringValue v(reinterpret_cast<char*>(string_val->ptr), string_val->len);
+      return pool->Add(new Literal(e->type_, v));
+    }
+    default:
+      // No suitable Literal ctor for the remaining types (TIMESTAMP, DECIMAL, CHAR,
+      // VARCHAR); leave the subtree in place. GetConstVal() has still cached the
+      // value for callers like ScalarFnCall::Open().
+      return NULL;
+  }
+}
+
 Status Expr::Open(RuntimeState* state, ExprContext* context,
                   FunctionContext::FunctionStateScope scope) {
   for (int i = 0; i < children_.size(); ++i) {
@@ -609,3 +669,13 @@ DecimalVal Expr::GetDecimalVal(ExprContext* context, TupleRow* row) {
   DCHECK(false) << DebugString();
   return DecimalVal::null();
 }
+
+void Expr::EvalBatch(ExprContext* context, RowBatch* batch, uint8_t* selected) {
+  DCHECK_EQ(type_.type, TYPE_BOOLEAN) << DebugString();
+  int num_rows = batch->num_rows();
+  for (int i = 0; i < num_rows; ++i) {
+    if (!selected[i]) continue;
+    BooleanVal v = GetBooleanVal(context, batch->GetRow(i));
+    if (v.is_null || !v.val) selected[i] = 0;
+  }
+}
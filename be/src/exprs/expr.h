@@ -106,6 +106,7 @@ class Expr;
 class IsNullExpr;
 class LlvmCodeGen;
 class ObjectPool;
+class RowBatch;
 class RowDescriptor;
 class RuntimeState;
 class TColumnValue;
@@ -132,6 +133,18 @@ class Expr {
   virtual TimestampVal GetTimestampVal(ExprContext* context, TupleRow*);
   virtual DecimalVal GetDecimalVal(ExprContext* context, TupleRow*);
 
+  // Batch-oriented evaluation for boolean exprs used as filters (i.e. conjuncts):
+  // evaluates this expr against every row of 'batch' whose byte in 'selected' is
+  // non-zero and clears the byte unless the expr returns a non-NULL true, so
+  // applying the conjuncts of a node in sequence leaves exactly the passing rows
+  // selected. 'selected' must have at least batch->num_rows() entries.
+  //
+  // The default implementation loops over GetBooleanVal(); hot filter shapes
+  // (SlotRef, Literal, AndPredicate) override it with loops that avoid the per-row
+  // virtual call. Must only be called on exprs of type BOOLEAN, in the interpreted
+  // path (the codegen'd EvalConjuncts() already inlines the expr trees).
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, uint8_t* selected);
+
   // Get the number of digits after the decimal that should be displayed for this
   // value. Returns -1 if no scale has been specified (currently the scale is only set for
   // doubles set by RoundUpTo). GetValue() must have already been called.
@@ -144,6 +157,7 @@ class Expr {
 
   const ColumnType& type() const { return type_; }
   bool is_slotref() const { return is_slotref_; }
+  const TFunction& fn() const { return fn_; }
 
   const std::vector<Expr*>& children() const { return children_; }
 
@@ -152,6 +166,10 @@ class Expr {
   // true if all children are constant.
   virtual bool IsConstant() const;
 
+  // Returns true if this expr is a Literal or NullLiteral. Used by FoldConstants() to
+  // avoid replacing exprs that are already literals.
+  virtual bool IsLiteral() const { return false; }
+
   // Returns the slots that are referenced by this expr tree in 'slot_ids'.
   // Returns the number of slots added to the vector
   virtual int GetSlotIds(std::vector<SlotId>* slot_ids) const;
@@ -175,6 +193,16 @@ class Expr {
   // Convenience function for opening multiple expr trees.
   static Status Open(const std::vector<ExprContext*>& ctxs, RuntimeState* state);
 
+  // Replaces constant subtrees of '*expr' (see IsConstant()) with Literal or
+  // NullLiteral exprs holding the precomputed result, so the interpreted path
+  // evaluates them once instead of once per row. Must be called after Open() since
+  // evaluating a constant subtree can call into functions whose prepare functions run
+  // in Open(). The folded subtree is kept as a child of the replacement literal so
+  // that Close() still reaches its FunctionContexts and any codegen'd functions
+  // compiled from it stay valid. Subtrees of types without a suitable Literal
+  // constructor (e.g. TIMESTAMP, DECIMAL) are left in place.
+  static void FoldConstants(RuntimeState* state, ExprContext* context, Expr** expr);
+
   // Clones each ExprContext for multiple expr trees. 'new_ctxs' should be an
   // empty vector, and a clone of each context in 'ctxs' will be added to it.
   // The new ExprContexts are created in state->obj_pool().
@@ -342,6 +370,11 @@ class Expr {
   // Create a new Expr based on texpr_node.node_type within 'pool'.
   static Status CreateExpr(ObjectPool* pool, const TExprNode& texpr_node, Expr** expr);
 
+  // Helper for FoldConstants(): evaluates constant expr 'e' once via GetConstVal() and
+  // returns a Literal or NullLiteral holding the result, allocated from the state's
+  // object pool. Returns NULL if 'e' has a type the Literal ctors don't cover.
+  static Expr* CreateFoldedLiteral(RuntimeState* state, ExprContext* context, Expr* e);
+
   // Creates an expr tree for the node rooted at 'node_idx' via depth-first traversal.
   // parameters
   //   nodes: vector of thrift expression nodes to be translated
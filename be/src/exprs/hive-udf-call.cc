@@ -44,6 +44,12 @@ struct JniContext {
   jmethodID evalute_id;
   jmethodID close_id;
 
+  // Cached JNIEnv for the thread this context belongs to. JniContext is
+  // THREAD_LOCAL state and Evaluate() always runs on the owning thread, so
+  // caching the env in Open() avoids a getJNIEnv() call (TLS lookup plus
+  // attach check in libhdfs) per row per function.
+  JNIEnv* env;
+
   uint8_t* input_values_buffer;
   uint8_t* input_nulls_buffer;
   uint8_t* output_value_buffer;
@@ -57,6 +63,7 @@ struct JniContext {
       executor(NULL),
       evalute_id(NULL),
       close_id(NULL),
+      env(NULL),
       input_values_buffer(NULL),
       input_nulls_buffer(NULL),
       output_value_buffer(NULL),
@@ -78,7 +85,7 @@ AnyVal* HiveUdfCall::Evaluate(ExprContext* ctx, TupleRow* row) {
       fn_ctx->GetFunctionState(FunctionContext::THREAD_LOCAL));
   DCHECK(jni_ctx != NULL);
 
-  JNIEnv* env = getJNIEnv();
+  JNIEnv* env = jni_ctx->env;
   if (env == NULL) {
     stringstream ss;
     ss << "Hive UDF path=" << fn_.hdfs_location << " class=" << fn_.scalar_fn.symbol
@@ -185,6 +192,7 @@ Status HiveUdfCall::Open(RuntimeState* state, ExprContext* ctx,
 
   JNIEnv* env = getJNIEnv();
   if (env == NULL) return Status("Failed to get/create JVM");
+  jni_ctx->env = env;
 
   RETURN_IF_ERROR(JniUtil::GetGlobalClassRef(env, EXECUTOR_CLASS, &jni_ctx->cl));
   jmethodID executor_ctor = env->GetMethodID(
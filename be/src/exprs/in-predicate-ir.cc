@@ -67,6 +67,17 @@ template<> int GetVal(const DecimalVal& x) { // TODO
   return 0;
 }
 
+// IN lists with at most this many distinct fixed-width values are evaluated with a
+// linear equality scan over SetLookupState::val_array instead of the std::set. Our
+// generated BI queries commonly produce lists in the tens of literals, where the
+// scan over one or two cache lines beats the tree walk.
+static const int SMALL_ARRAY_MAX_SIZE = 64;
+
+// Whether 'SetType' is eligible for the val_array scan. Strings are not: comparing
+// them is not a fixed-width operation the scan loop can vectorize.
+template<typename SetType> struct UseSmallArray { static const bool value = true; };
+template<> struct UseSmallArray<StringValue> { static const bool value = false; };
+
 template<typename T, typename SetType>
 void InPredicate::SetLookupPrepare(
     FunctionContext* ctx, FunctionContext::FunctionStateScope scope) {
@@ -83,6 +94,12 @@ void InPredicate::SetLookupPrepare(
       state->val_set.insert(GetVal<T, SetType>(*arg));
     }
   }
+  if (UseSmallArray<SetType>::value && state->val_set.size() <= SMALL_ARRAY_MAX_SIZE) {
+    // Move the (deduplicated) values into the contiguous array; SetLookup() picks
+    // the lookup strategy based on which container is populated.
+    state->val_array.assign(state->val_set.begin(), state->val_set.end());
+    state->val_set.clear();
+  }
   ctx->SetFunctionState(scope, state);
 }
 
@@ -117,7 +134,17 @@ template<typename T, typename SetType>
 BooleanVal InPredicate::SetLookup(
     SetLookupState<SetType>* state, const T& v) {
   DCHECK_NOTNULL(state);
-  bool found = state->val_set.find(GetVal<T, SetType>(v)) != state->val_set.end();
+  bool found = false;
+  if (!state->val_array.empty()) {
+    // Plain equality scan, no early exit: for the list sizes that populate
+    // val_array this compiles to a handful of vectorized compares.
+    SetType target = GetVal<T, SetType>(v);
+    int num_vals = state->val_array.size();
+    const SetType* vals = &state->val_array[0];
+    for (int i = 0; i < num_vals; ++i) found |= (vals[i] == target);
+  } else {
+    found = state->val_set.find(GetVal<T, SetType>(v)) != state->val_set.end();
+  }
   if (found) return BooleanVal(true);
   if (state->contains_null) return BooleanVal::null();
   return BooleanVal(false);
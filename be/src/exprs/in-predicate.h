@@ -17,6 +17,7 @@
 #define IMPALA_EXPRS_IN_PREDICATE_H_
 
 #include <string>
+#include <vector>
 #include "exprs/predicate.h"
 #include "udf/udf.h"
 
@@ -253,6 +254,13 @@ class InPredicate : public Predicate {
     // Note: boost::unordered_set and std::binary_search performed worse based on the
     // in-predicate-benchmark
     std::set<SetType> val_set;
+
+    // For fixed-width types with few distinct values (see SMALL_ARRAY_MAX_SIZE in the
+    // .cc file), the same values in a contiguous array and val_set left empty. A
+    // plain equality scan over the array has no per-node pointer chasing and is a
+    // form the compiler can vectorize in both the sse and no-sse cross-compiled
+    // variants of this code.
+    std::vector<SetType> val_array;
   };
 
   // The templated function that provides the implementation for all the In() and NotIn()
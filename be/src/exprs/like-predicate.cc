@@ -47,6 +47,33 @@ static const RE2 STARTS_WITH_RE(
 // A regex to match any regex pattern which is equivalent to a constant string match.
 static const RE2 EQUALS_RE("\\^([^\\.\\^\\{\\[\\(\\|\\)\\]\\}\\+\\*\\?\\$\\\\]*)\\$");
 
+// Tries to decompose a LIKE pattern into literal runs separated by '%' wildcards
+// (e.g. "abc%def%ghi" -> {"abc", "def", "ghi"}). Returns false if the pattern
+// contains '_' or the escape character, or has fewer than two runs; single-run
+// patterns are served by the equals/starts-with/ends-with/substring fast paths.
+// *anchored_start/*anchored_end are set iff the pattern does not begin/end with '%'.
+static bool ParseSegmentedPattern(const StringValue& pattern, char escape_char,
+    vector<string>* segments, bool* anchored_start, bool* anchored_end) {
+  segments->clear();
+  string current;
+  for (int i = 0; i < pattern.len; ++i) {
+    char c = pattern.ptr[i];
+    if (c == '_' || c == escape_char) return false;
+    if (c == '%') {
+      if (!current.empty()) {
+        segments->push_back(current);
+        current.clear();
+      }
+    } else {
+      current.append(1, c);
+    }
+  }
+  if (!current.empty()) segments->push_back(current);
+  *anchored_start = pattern.len > 0 && pattern.ptr[0] != '%';
+  *anchored_end = pattern.len > 0 && pattern.ptr[pattern.len - 1] != '%';
+  return segments->size() >= 2;
+}
+
 LikePredicate::LikePredicate(const TExprNode& node)
   : Predicate(node) {
 }
@@ -83,13 +110,23 @@ void LikePredicate::LikePrepare(FunctionContext* context,
       state->SetSearchString(search_string);
       state->function_ = ConstantEqualsFn;
     } else {
-      string re_pattern;
-      ConvertLikePattern(context,
-          *reinterpret_cast<StringVal*>(context->GetConstantArg(1)), &re_pattern);
-      state->regex_.reset(new RE2(re_pattern));
-      if (!state->regex_->ok()) {
-        context->SetError(
-            strings::Substitute("Invalid regex: $0", pattern_val.ptr).c_str());
+      // Multi-segment patterns like "abc%def%ghi" can still be evaluated with
+      // string searches; only patterns with '_' or escapes need the regex.
+      vector<string> segments;
+      bool anchored_start, anchored_end;
+      if (ParseSegmentedPattern(pattern, state->escape_char_, &segments,
+          &anchored_start, &anchored_end)) {
+        state->SetSegments(segments, anchored_start, anchored_end);
+        state->function_ = ConstantSegmentedFn;
+      } else {
+        string re_pattern;
+        ConvertLikePattern(context,
+            *reinterpret_cast<StringVal*>(context->GetConstantArg(1)), &re_pattern);
+        state->regex_.reset(new RE2(re_pattern));
+        if (!state->regex_->ok()) {
+          context->SetError(
+              strings::Substitute("Invalid regex: $0", pattern_val.ptr).c_str());
+        }
       }
     }
   }
@@ -229,6 +266,45 @@ BooleanVal LikePredicate::ConstantEqualsFn(FunctionContext* context, const Strin
   return BooleanVal(state->search_string_sv_.Eq(StringValue::FromStringVal(val)));
 }
 
+BooleanVal LikePredicate::ConstantSegmentedFn(FunctionContext* context,
+    const StringVal& val, const StringVal& pattern) {
+  if (val.is_null) return BooleanVal::null();
+  LikePredicateState* state = reinterpret_cast<LikePredicateState*>(
+      context->GetFunctionState(FunctionContext::THREAD_LOCAL));
+  const vector<StringValue>& segments = state->segment_svs_;
+  DCHECK_GE(segments.size(), 2);
+  char* ptr = reinterpret_cast<char*>(val.ptr);
+  int pos = 0;       // Start of the still unmatched part of 'val'.
+  int end = val.len; // End (exclusive) of the still unmatched part.
+  int first = 0;
+  int last = segments.size() - 1;
+  if (state->anchored_start_) {
+    const StringValue& segment = segments[first];
+    if (end - pos < segment.len) return BooleanVal(false);
+    StringValue v = StringValue(ptr + pos, segment.len);
+    if (!segment.Eq(v)) return BooleanVal(false);
+    pos += segment.len;
+    ++first;
+  }
+  if (state->anchored_end_) {
+    const StringValue& segment = segments[last];
+    if (end - pos < segment.len) return BooleanVal(false);
+    StringValue v = StringValue(ptr + end - segment.len, segment.len);
+    if (!segment.Eq(v)) return BooleanVal(false);
+    end -= segment.len;
+    --last;
+  }
+  // Locate the remaining segments in order. Taking the leftmost occurrence each
+  // time is exhaustive: any match can be rearranged to use leftmost occurrences.
+  for (int i = first; i <= last; ++i) {
+    StringValue window = StringValue(ptr + pos, end - pos);
+    int offset = state->segment_searches_[i].Search(&window);
+    if (offset == -1) return BooleanVal(false);
+    pos += offset + segments[i].len;
+  }
+  return BooleanVal(true);
+}
+
 BooleanVal LikePredicate::ConstantRegexFnPartial(FunctionContext* context,
     const StringVal& val, const StringVal& pattern) {
   if (val.is_null) return BooleanVal::null();
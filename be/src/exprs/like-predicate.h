@@ -19,6 +19,7 @@
 #include <boost/scoped_ptr.hpp>
 #include <re2/re2.h>
 #include <string>
+#include <vector>
 
 #include "exprs/predicate.h"
 #include "gen-cpp/Exprs_types.h"
@@ -73,7 +74,24 @@ class LikePredicate: public Predicate {
     // Used for RLIKE and REGEXP predicates if the pattern is a constant aruement.
     boost::scoped_ptr<re2::RE2> regex_;
 
-    LikePredicateState() : escape_char_('\\') {
+    // Used for constant LIKE patterns that consist only of literal runs and '%'
+    // wildcards with at least two literal runs (e.g. "abc%def%ghi"); patterns with
+    // a single run use the search_string_sv_ fast paths instead. The runs are kept
+    // in pattern order; segment_svs_[i]/segment_searches_[i] point into
+    // segments_[i], so segments_ must not be resized after SetSegments().
+    std::vector<std::string> segments_;
+    std::vector<StringValue> segment_svs_;
+    std::vector<StringSearch> segment_searches_;
+
+    // True if the pattern does not begin (resp. end) with '%', i.e. the first
+    // (resp. last) segment must match exactly at that boundary of the value.
+    bool anchored_start_;
+    bool anchored_end_;
+
+    LikePredicateState()
+      : escape_char_('\\'),
+        anchored_start_(false),
+        anchored_end_(false) {
     }
 
     void SetSearchString(const std::string& search_string) {
@@ -81,6 +99,20 @@ class LikePredicate: public Predicate {
       search_string_sv_ = StringValue(search_string);
       substring_pattern_ = StringSearch(&search_string_sv_);
     }
+
+    void SetSegments(const std::vector<std::string>& segments, bool anchored_start,
+        bool anchored_end) {
+      segments_ = segments;
+      anchored_start_ = anchored_start;
+      anchored_end_ = anchored_end;
+      segment_svs_.resize(segments_.size());
+      for (int i = 0; i < segments_.size(); ++i) {
+        segment_svs_[i] = StringValue(segments_[i]);
+      }
+      for (int i = 0; i < segment_svs_.size(); ++i) {
+        segment_searches_.push_back(StringSearch(&segment_svs_[i]));
+      }
+    }
   };
 
   friend class OpcodeRegistry;
@@ -125,6 +157,13 @@ class LikePredicate: public Predicate {
   static impala_udf::BooleanVal ConstantEqualsFn(impala_udf::FunctionContext* context,
       const impala_udf::StringVal& val, const impala_udf::StringVal& pattern);
 
+  // Handling of like predicates decomposed into a sequence of literal segments
+  // (LikePredicateState::segments_): the anchored first/last segments are compared
+  // at the value's boundaries and the remaining segments located in order with
+  // StringSearch, greedily left to right.
+  static impala_udf::BooleanVal ConstantSegmentedFn(impala_udf::FunctionContext* context,
+      const impala_udf::StringVal& val, const impala_udf::StringVal& pattern);
+
   static impala_udf::BooleanVal ConstantRegexFnPartial(
       impala_udf::FunctionContext* context, const impala_udf::StringVal& val,
       const impala_udf::StringVal& pattern);
@@ -18,6 +18,7 @@
 
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
+#include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "gen-cpp/Exprs_types.h"
 
@@ -243,6 +244,11 @@ BooleanVal Literal::GetBooleanVal(ExprContext* context, TupleRow* row) {
   return BooleanVal(value_.bool_val);
 }
 
+void Literal::EvalBatch(ExprContext* context, RowBatch* batch, uint8_t* selected) {
+  DCHECK_EQ(type_.type, TYPE_BOOLEAN) << type_;
+  if (!value_.bool_val) memset(selected, 0, batch->num_rows());
+}
+
 TinyIntVal Literal::GetTinyIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_TINYINT) << type_;
   return TinyIntVal(value_.tinyint_val);
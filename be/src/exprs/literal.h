@@ -44,6 +44,8 @@ class Literal: public Expr {
 
   virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
 
+  virtual bool IsLiteral() const { return true; }
+
   virtual impala_udf::BooleanVal GetBooleanVal(ExprContext*, TupleRow*);
   virtual impala_udf::TinyIntVal GetTinyIntVal(ExprContext*, TupleRow*);
   virtual impala_udf::SmallIntVal GetSmallIntVal(ExprContext*, TupleRow*);
@@ -54,6 +56,8 @@ class Literal: public Expr {
   virtual impala_udf::StringVal GetStringVal(ExprContext*, TupleRow*);
   virtual impala_udf::DecimalVal GetDecimalVal(ExprContext*, TupleRow*);
 
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, uint8_t* selected);
+
  protected:
   friend class Expr;
 
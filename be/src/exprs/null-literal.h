@@ -25,8 +25,11 @@ class TExprNode;
 class NullLiteral: public Expr {
  public:
   NullLiteral(PrimitiveType type) : Expr(type) { }
+  NullLiteral(const ColumnType& type) : Expr(type) { }
   virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
 
+  virtual bool IsLiteral() const { return true; }
+
   virtual impala_udf::BooleanVal GetBooleanVal(ExprContext*, TupleRow*);
   virtual impala_udf::TinyIntVal GetTinyIntVal(ExprContext*, TupleRow*);
   virtual impala_udf::SmallIntVal GetSmallIntVal(ExprContext*, TupleRow*);
@@ -18,6 +18,8 @@
 #include <gutil/strings/substitute.h>
 #include <llvm/IR/Attributes.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/Support/InstIterator.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
@@ -130,6 +132,9 @@ Status ScalarFnCall::Prepare(RuntimeState* state, const RowDescriptor& desc,
     RETURN_IF_ERROR(GetCodegendComputeFn(state, &ir_udf_wrapper));
     // TODO: don't do this for child exprs
     codegen->AddFunctionToJit(ir_udf_wrapper, &scalar_fn_wrapper_);
+    // There is no interpreted path once we've decided to codegen the wrapper, so the
+    // fragment cannot start executing before scalar_fn_wrapper_ is filled in.
+    codegen->RequireFnPtrsBeforeExec();
   }
 
   if (fn_.scalar_fn.__isset.prepare_fn_symbol) {
@@ -255,6 +260,7 @@ Status ScalarFnCall::GetCodegendComputeFn(RuntimeState* state, llvm::Function**
   RETURN_IF_ERROR(state->GetCodegen(&codegen));
   llvm::Function* udf;
   RETURN_IF_ERROR(GetUdf(state, &udf));
+  udf = InlineConstFnAttrs(codegen, udf);
 
   // Create wrapper that computes args and calls UDF
   stringstream fn_name;
@@ -454,7 +460,10 @@ Status ScalarFnCall::GetUdf(RuntimeState* state, llvm::Function** udf) {
       return Status(ss.str());
     }
   } else {
-    // We're running a IR UDF.
+    // We're running a IR UDF. The UDF's module was linked into the fragment's module
+    // in Prepare(), so with the AlwaysInline attribute added below the UDF is inlined
+    // into the codegen'd expr tree like a builtin and optimized together with its
+    // callers instead of being invoked through a call.
     DCHECK_EQ(fn_.binary_type, TFunctionBinaryType::IR);
     *udf = codegen->module()->getFunction(fn_.scalar_fn.symbol);
     if (*udf == NULL) {
@@ -468,6 +477,66 @@ Status ScalarFnCall::GetUdf(RuntimeState* state, llvm::Function** udf) {
   return Status::OK;
 }
 
+llvm::Function* ScalarFnCall::InlineConstFnAttrs(
+    LlvmCodeGen* codegen, llvm::Function* fn) {
+  llvm::Function* attr_fn = codegen->GetFunction(IRFunction::FN_CTX_GET_CONST_FN_ATTR);
+  DCHECK(attr_fn != NULL);
+
+  // Check whether fn's body references GetConstFnAttr() at all before paying for a
+  // clone. Native UDFs are declarations without a body and fall out here immediately.
+  bool has_attr_calls = false;
+  for (llvm::inst_iterator it = llvm::inst_begin(fn), end = llvm::inst_end(fn);
+       it != end; ++it) {
+    llvm::CallInst* call = llvm::dyn_cast<llvm::CallInst>(&*it);
+    if (call != NULL && call->getCalledFunction() == attr_fn) {
+      has_attr_calls = true;
+      break;
+    }
+  }
+  if (!has_attr_calls) return fn;
+
+  llvm::ValueToValueMapTy vmap;
+  llvm::Function* cloned = llvm::CloneFunction(fn, vmap, false);
+  cloned->setName(fn->getName().str() + ".specialized");
+  codegen->module()->getFunctionList().push_back(cloned);
+
+  llvm::inst_iterator instr_iter = llvm::inst_begin(cloned);
+  llvm::inst_iterator instr_end = llvm::inst_end(cloned);
+  while (instr_iter != instr_end) {
+    llvm::Instruction* instr = &*instr_iter;
+    ++instr_iter;
+    llvm::CallInst* call = llvm::dyn_cast<llvm::CallInst>(instr);
+    if (call == NULL || call->getCalledFunction() != attr_fn) continue;
+    // Arguments are (FunctionContextImpl* this, ConstFnAttr t)
+    DCHECK_EQ(call->getNumArgOperands(), 2);
+    llvm::ConstantInt* t_arg =
+        llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(1));
+    if (t_arg == NULL) continue;  // not a constant; leave the runtime call in place
+    // Must return the same values as FunctionContextImpl::GetConstFnAttr().
+    int value;
+    switch (t_arg->getSExtValue()) {
+      case FunctionContextImpl::RETURN_TYPE_SIZE:
+        DCHECK_EQ(type().type, TYPE_DECIMAL);
+        value = type().GetByteSize();
+        break;
+      case FunctionContextImpl::RETURN_TYPE_PRECISION:
+        DCHECK_EQ(type().type, TYPE_DECIMAL);
+        value = type().precision;
+        break;
+      case FunctionContextImpl::RETURN_TYPE_SCALE:
+        DCHECK_EQ(type().type, TYPE_DECIMAL);
+        value = type().scale;
+        break;
+      default:
+        DCHECK(false) << "Unknown ConstFnAttr: " << t_arg->getSExtValue();
+        continue;
+    }
+    call->replaceAllUsesWith(codegen->GetIntConstant(TYPE_INT, value));
+    call->eraseFromParent();
+  }
+  return cloned;
+}
+
 Status ScalarFnCall::GetFunction(RuntimeState* state, const string& symbol, void** fn) {
   if (fn_.binary_type == TFunctionBinaryType::NATIVE ||
       fn_.binary_type == TFunctionBinaryType::BUILTIN) {
@@ -485,6 +554,9 @@ Status ScalarFnCall::GetFunction(RuntimeState* state, const string& symbol, void
       return Status(ss.str());
     }
     codegen->AddFunctionToJit(ir_fn, fn);
+    // IR prepare/close functions are called through 'fn' with no fallback, so the
+    // pointer must be filled in before execution starts.
+    codegen->RequireFnPtrsBeforeExec();
     return Status::OK;
   }
 }
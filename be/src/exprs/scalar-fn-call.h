@@ -25,6 +25,7 @@ using namespace impala_udf;
 
 namespace impala {
 
+class LlvmCodeGen;
 class TExprNode;
 
 // Expr for evaluating a pre-compiled native or LLVM IR function that uses the UDF
@@ -106,6 +107,14 @@ class ScalarFnCall: public Expr {
   // Loads the native or IR function from HDFS and puts the result in *udf.
   Status GetUdf(RuntimeState* state, llvm::Function** udf);
 
+  // Replaces calls to FunctionContextImpl::GetConstFnAttr() in fn's body with the
+  // attribute values, which are fixed at plan time, so the optimizer can fold away
+  // runtime dispatch on them (e.g. the decimal byte-width switches in
+  // DecimalOperators). Since the module's copy of a builtin is shared by all calls to
+  // it, fn is cloned before substituting; returns the clone, or fn itself if its body
+  // contains no such calls.
+  llvm::Function* InlineConstFnAttrs(LlvmCodeGen* codegen, llvm::Function* fn);
+
   // Loads the native or IR function 'symbol' from HDFS and puts the result in *fn.
   // If the function is loaded from an IR module, it cannot be called until the module
   // has been JIT'd (i.e. after Prepare() has completed).
@@ -19,6 +19,7 @@
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
 #include "gen-cpp/Exprs_types.h"
+#include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 
 using namespace impala_udf;
@@ -374,6 +375,19 @@ BooleanVal SlotRef::GetBooleanVal(ExprContext* context, TupleRow* row) {
   return BooleanVal(*reinterpret_cast<bool*>(t->GetSlot(slot_offset_)));
 }
 
+void SlotRef::EvalBatch(ExprContext* context, RowBatch* batch, uint8_t* selected) {
+  DCHECK_EQ(type_.type, TYPE_BOOLEAN);
+  int num_rows = batch->num_rows();
+  for (int i = 0; i < num_rows; ++i) {
+    if (!selected[i]) continue;
+    Tuple* t = batch->GetRow(i)->GetTuple(tuple_idx_);
+    if (t == NULL || t->IsNull(null_indicator_offset_) ||
+        !*reinterpret_cast<bool*>(t->GetSlot(slot_offset_))) {
+      selected[i] = 0;
+    }
+  }
+}
+
 TinyIntVal SlotRef::GetTinyIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_TINYINT);
   Tuple* t = row->GetTuple(tuple_idx_);
@@ -39,6 +39,20 @@ class SlotRef : public Expr {
   virtual int GetSlotIds(std::vector<SlotId>* slot_ids) const;
   const SlotId& slot_id() const { return slot_id_; }
 
+  // The accessors below are only valid after Prepare().
+  int tuple_idx() const { return tuple_idx_; }
+  int slot_offset() const { return slot_offset_; }
+  const NullIndicatorOffset& null_indicator_offset() const {
+    return null_indicator_offset_;
+  }
+  bool tuple_is_nullable() const { return tuple_is_nullable_; }
+
+  // Returns true if this slot can evaluate to NULL, either because the slot itself is
+  // nullable or because the containing tuple can be NULL in the row.
+  bool is_nullable() const {
+    return tuple_is_nullable_ || null_indicator_offset_.bit_mask != 0;
+  }
+
   virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
 
   virtual impala_udf::BooleanVal GetBooleanVal(ExprContext* context, TupleRow*);
@@ -52,6 +66,8 @@ class SlotRef : public Expr {
   virtual impala_udf::TimestampVal GetTimestampVal(ExprContext* context, TupleRow*);
   virtual impala_udf::DecimalVal GetDecimalVal(ExprContext* context, TupleRow*);
 
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, uint8_t* selected);
+
  protected:
   int tuple_idx_;  // within row
   int slot_offset_;  // within tuple
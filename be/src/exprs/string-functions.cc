@@ -15,6 +15,7 @@
 #include "exprs/string-functions.h"
 
 #include <cctype>
+#include <emmintrin.h>
 #include <stdint.h>
 #include <re2/re2.h>
 #include <re2/stringpiece.h>
@@ -152,21 +153,48 @@ IntVal StringFunctions::CharLength(FunctionContext* context, const StringVal& st
   return StringValue::UnpaddedCharLength(reinterpret_cast<char*>(str.ptr), t->len);
 }
 
+// Converts the case of the ASCII letters in 'src', writing the result into 'dst'.
+// Only bytes in ['A','Z'] (to_lower) resp. ['a','z'] (!to_lower) are modified; all
+// other bytes, including bytes >= 0x80 inside multi-byte UTF-8 sequences, are copied
+// through unchanged. This matches what ::tolower()/::toupper() compute in the C
+// locale. Upper- and lower-case ASCII letters differ only in bit 0x20, so the
+// conversion is a masked XOR over 16 bytes at a time. SSE2 is part of the x86-64
+// baseline, so unlike the SSE4.2 string instructions wrapped in util/sse-util.h this
+// needs no runtime CpuInfo check.
+static inline void SimdCaseConvert(
+    const uint8_t* src, uint8_t* dst, int len, bool to_lower) {
+  const uint8_t range_begin = to_lower ? 'A' : 'a';
+  const uint8_t range_end = to_lower ? 'Z' : 'z';
+  const __m128i below = _mm_set1_epi8(range_begin - 1);
+  const __m128i above = _mm_set1_epi8(range_end + 1);
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+  int i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    // The compares are signed, so bytes >= 0x80 are negative and never satisfy
+    // v > range_begin - 1.
+    __m128i is_letter =
+        _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmpgt_epi8(above, v));
+    v = _mm_xor_si128(v, _mm_and_si128(is_letter, case_bit));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+  }
+  for (; i < len; ++i) {
+    uint8_t c = src[i];
+    dst[i] = (c >= range_begin && c <= range_end) ? c ^ 0x20 : c;
+  }
+}
+
 StringVal StringFunctions::Lower(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
   StringVal result(context, str.len);
-  for (int i = 0; i < str.len; ++i) {
-    result.ptr[i] = ::tolower(str.ptr[i]);
-  }
+  SimdCaseConvert(str.ptr, result.ptr, str.len, true);
   return result;
 }
 
 StringVal StringFunctions::Upper(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
   StringVal result(context, str.len);
-  for (int i = 0; i < str.len; ++i) {
-    result.ptr[i] = ::toupper(str.ptr[i]);
-  }
+  SimdCaseConvert(str.ptr, result.ptr, str.len, false);
   return result;
 }
 
@@ -225,41 +253,54 @@ StringVal StringFunctions::Translate(FunctionContext* context, const StringVal&
   return result;
 }
 
-StringVal StringFunctions::Trim(FunctionContext* context, const StringVal& str) {
-  if (str.is_null) return StringVal::null();
-  // Find new starting position.
-  int32_t begin = 0;
-  while (begin < str.len && str.ptr[begin] == ' ') {
-    ++begin;
+// Returns the index of the first byte in [ptr, ptr + len) that is not ' ', or 'len' if
+// the string consists entirely of spaces. Compares 16 bytes per iteration and locates
+// the first non-space lane with a movemask + count-trailing-zeros.
+static inline int32_t FindFirstNonSpace(const uint8_t* ptr, int32_t len) {
+  const __m128i spaces = _mm_set1_epi8(' ');
+  int32_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, spaces)) ^ 0xffff;
+    if (mask != 0) return i + __builtin_ctz(mask);
   }
-  // Find new ending position.
-  int32_t end = str.len - 1;
-  while (end > begin && str.ptr[end] == ' ') {
-    --end;
+  while (i < len && ptr[i] == ' ') ++i;
+  return i;
+}
+
+// Returns the index of the last byte in [ptr, ptr + len) that is not ' ', or -1 if the
+// string consists entirely of spaces.
+static inline int32_t FindLastNonSpace(const uint8_t* ptr, int32_t len) {
+  const __m128i spaces = _mm_set1_epi8(' ');
+  int32_t i = len;
+  for (; i >= 16; i -= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + i - 16));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, spaces)) ^ 0xffff;
+    if (mask != 0) return i - 16 + 31 - __builtin_clz(mask);
   }
+  while (i > 0 && ptr[i - 1] == ' ') --i;
+  return i - 1;
+}
+
+StringVal StringFunctions::Trim(FunctionContext* context, const StringVal& str) {
+  if (str.is_null) return StringVal::null();
+  int32_t begin = FindFirstNonSpace(str.ptr, str.len);
+  if (begin == str.len) return StringVal(str.ptr, 0);
+  int32_t end = FindLastNonSpace(str.ptr, str.len);
+  DCHECK_GE(end, begin);
   return StringVal(str.ptr + begin, end - begin + 1);
 }
 
 StringVal StringFunctions::Ltrim(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
-  // Find new starting position.
-  int32_t begin = 0;
-  while (begin < str.len && str.ptr[begin] == ' ') {
-    ++begin;
-  }
+  int32_t begin = FindFirstNonSpace(str.ptr, str.len);
   return StringVal(str.ptr + begin, str.len - begin);
 }
 
 StringVal StringFunctions::Rtrim(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
   if (str.len == 0) return str;
-  // Find new ending position.
-  int32_t end = str.len - 1;
-  while (end > 0 && str.ptr[end] == ' ') {
-    --end;
-  }
-  DCHECK_GE(end, 0);
-  return StringVal(str.ptr, (str.ptr[end] == ' ') ? end : end + 1);
+  return StringVal(str.ptr, FindLastNonSpace(str.ptr, str.len) + 1);
 }
 
 IntVal StringFunctions::Ascii(FunctionContext* context, const StringVal& str) {
@@ -14,6 +14,8 @@
 
 #include "rpc/thrift-client.h"
 
+#include <poll.h>
+#include <sys/socket.h>
 #include <boost/assign.hpp>
 #include <boost/lexical_cast.hpp>
 #include <ostream>
@@ -66,6 +68,25 @@ Status ThriftClientImpl::OpenWithRetry(uint32_t num_tries, uint64_t wait_ms) {
   }
 }
 
+bool ThriftClientImpl::IsConnected() {
+  if (socket_.get() == NULL || !socket_->isOpen()) return false;
+  // Poll the socket for readability without blocking: a healthy idle connection has
+  // nothing to read, whereas a connection whose peer has gone away reports a hangup,
+  // an error, or a pending EOF.
+  struct pollfd fd;
+  fd.fd = socket_->getSocketFD();
+  fd.events = POLLIN;
+  fd.revents = 0;
+  int rc = poll(&fd, 1, 0);
+  if (rc < 0) return false;
+  if (rc == 0) return true;
+  if ((fd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0) return false;
+  // The socket is readable: distinguish buffered data from EOF with a non-blocking
+  // peek (an idle cached connection should have nothing to read either way).
+  char buf;
+  return recv(fd.fd, &buf, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
+
 void ThriftClientImpl::Close() {
   try {
     if (transport_.get() != NULL && transport_->isOpen()) transport_->close();
@@ -64,6 +64,12 @@ class ThriftClientImpl {
   // Set send timeout on the underlying TSocket.
   void setSendTimeout(int32_t ms) { socket_->setSendTimeout(ms); }
 
+  // Returns true if the underlying socket still appears to be connected: the transport
+  // is open and the peer has not closed or reset the connection. Does not block. A
+  // peer that died without closing its end (e.g. machine failure) is not detectable
+  // this way and will only surface as an RPC error.
+  bool IsConnected();
+
  protected:
   ThriftClientImpl(const std::string& ipaddress, int port, bool ssl)
       : address_(MakeNetworkAddress(ipaddress, port)), ssl_(ssl) {
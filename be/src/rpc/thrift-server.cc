@@ -21,6 +21,7 @@
 #include <thrift/concurrency/Thread.h>
 #include <thrift/concurrency/ThreadManager.h>
 #include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/server/TNonblockingServer.h>
 #include <thrift/server/TThreadPoolServer.h>
 #include <thrift/server/TThreadedServer.h>
 #include <thrift/transport/TSocket.h>
@@ -205,23 +206,31 @@ void* ThriftServer::ThriftServerEventProcessor::createContext(shared_ptr<TProtoc
   TTransport* transport = input->getTransport().get();
   shared_ptr<ConnectionContext> connection_ptr =
       shared_ptr<ConnectionContext>(new ConnectionContext);
-  TTransport* underlying_transport =
-      (static_cast<TBufferedTransport*>(transport))->getUnderlyingTransport().get();
-  if (!thrift_server_->auth_provider_->is_sasl()) {
-    socket = static_cast<TSocket*>(underlying_transport);
+  if (thrift_server_->server_type_ == Nonblocking) {
+    // The nonblocking server hands us protocols over a TMemoryBuffer and doesn't
+    // expose the underlying socket, so the peer address cannot be determined here.
+    // SASL is rejected in Start(), so there is also no username to extract.
   } else {
-    TSaslServerTransport* sasl_transport = static_cast<TSaslServerTransport*>(
-        underlying_transport);
-
-    // Get the username from the transport.
-    connection_ptr->username = sasl_transport->getUsername();
-    socket = static_cast<TSocket*>(sasl_transport->getUnderlyingTransport().get());
+    TTransport* underlying_transport =
+        (static_cast<TBufferedTransport*>(transport))->getUnderlyingTransport().get();
+    if (!thrift_server_->auth_provider_->is_sasl()) {
+      socket = static_cast<TSocket*>(underlying_transport);
+    } else {
+      TSaslServerTransport* sasl_transport = static_cast<TSaslServerTransport*>(
+          underlying_transport);
+
+      // Get the username from the transport.
+      connection_ptr->username = sasl_transport->getUsername();
+      socket = static_cast<TSocket*>(sasl_transport->getUnderlyingTransport().get());
+    }
   }
 
   {
     connection_ptr->server_name = thrift_server_->name_;
-    connection_ptr->network_address =
-        MakeNetworkAddress(socket->getPeerAddress(), socket->getPeerPort());
+    if (socket != NULL) {
+      connection_ptr->network_address =
+          MakeNetworkAddress(socket->getPeerAddress(), socket->getPeerPort());
+    }
 
     lock_guard<mutex> l(thrift_server_->connection_contexts_lock_);
     uuid connection_uuid = thrift_server_->uuid_generator_();
@@ -355,9 +364,31 @@ Status ThriftServer::Start() {
   // logic in createContext is still accurate.
   shared_ptr<TServerTransport> server_socket;
   shared_ptr<TTransportFactory> transport_factory;
-  RETURN_IF_ERROR(CreateSocket(&server_socket));
-  RETURN_IF_ERROR(auth_provider_->GetServerTransportFactory(&transport_factory));
+  if (server_type_ != Nonblocking) {
+    // The nonblocking server creates its own listening socket and frames requests
+    // itself, so it takes neither a server transport nor a transport factory.
+    RETURN_IF_ERROR(CreateSocket(&server_socket));
+    RETURN_IF_ERROR(auth_provider_->GetServerTransportFactory(&transport_factory));
+  }
   switch (server_type_) {
+    case Nonblocking:
+      {
+        if (ssl_enabled() || auth_provider_->is_sasl()) {
+          stringstream error_msg;
+          error_msg << "ThriftServer '" << name_ << "': "
+                    << (ssl_enabled() ? "SSL" : "SASL")
+                    << " is not supported by nonblocking servers";
+          LOG(ERROR) << error_msg.str();
+          return Status(error_msg.str());
+        }
+        shared_ptr<ThreadManager> thread_mgr(
+            ThreadManager::newSimpleThreadManager(num_worker_threads_));
+        thread_mgr->threadFactory(thread_factory);
+        thread_mgr->start();
+        server_.reset(new TNonblockingServer(processor_, protocol_factory, port_,
+            thread_mgr));
+      }
+      break;
     case ThreadPool:
       {
         shared_ptr<ThreadManager> thread_mgr(
@@ -63,11 +63,16 @@ class ThriftServer {
 
   static const int DEFAULT_WORKER_THREADS = 2;
 
-  // There are 2 servers supported by Thrift with different threading models.
+  // There are 3 servers supported by Thrift with different threading models.
   // ThreadPool  -- Allocates a fixed number of threads. A thread is used by a
   //                connection until it closes.
   // Threaded    -- Allocates 1 thread per connection, as needed.
-  enum ServerType { ThreadPool = 0, Threaded };
+  // Nonblocking -- Keeps all connections on a libevent (epoll) IO loop and dispatches
+  //                complete requests to a fixed pool of worker threads, so idle
+  //                connections don't hold a thread and its stack. Clients must use
+  //                TFramedTransport. Incompatible with SSL and SASL (Kerberos/LDAP);
+  //                Start() fails if either is enabled.
+  enum ServerType { ThreadPool = 0, Threaded, Nonblocking };
 
   // Creates, but does not start, a new server on the specified port
   // that exports the supplied interface.
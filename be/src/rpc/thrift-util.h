@@ -36,6 +36,16 @@ class ThriftServer;
 // should be reused if possible to reuse the underlying memory.
 // Note: thrift will encode NULLs into the serialized buffer so it is not valid
 // to treat it as a string.
+// TODO: bulk row data still travels as a thrift string (TRowBatch.tuple_data), which
+// costs a memcpy into the TMemoryBuffer (with reallocation growth) on the way out and
+// another out of the transport on the way in. A sidecar convention - a small thrift
+// header describing N raw binary frames that follow the message on the wire, written
+// straight from RowBatch tuple buffers and sliced out without a copy in
+// DataStreamMgr::AddData() - would take thrift off the bulk-data path entirely while
+// keeping it for control messages. This can't be retrofitted under the generated
+// TransmitData stubs, which fully own the transport and message framing on both ends;
+// it needs a custom exchange protocol (plus version negotiation between demons).
+// See also the gather-write TODO in RowBatch::Serialize().
 class ThriftSerializer {
  public:
   // If compact, the objects will be serialized using the Compact Protocol.  Otherwise,
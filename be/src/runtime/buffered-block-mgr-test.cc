@@ -77,6 +77,20 @@ class BufferedBlockMgrTest : public ::testing::Test {
     promise->Set(true);
   }
 
+  // Yield callback for the YieldBuffers test: unpins up to 'num_buffers' pinned blocks
+  // from 'blocks' and returns how many were unpinned.
+  static int YieldBlocks(vector<BufferedBlockMgr::Block*>* blocks, int* num_yield_calls,
+      int num_buffers) {
+    ++(*num_yield_calls);
+    int num_unpinned = 0;
+    for (int i = 0; i < blocks->size() && num_unpinned < num_buffers; ++i) {
+      if (!(*blocks)[i]->is_pinned()) continue;
+      EXPECT_TRUE((*blocks)[i]->Unpin().ok());
+      ++num_unpinned;
+    }
+    return num_unpinned;
+  }
+
   static void ValidateBlock(BufferedBlockMgr::Block* block, int32_t data) {
     EXPECT_TRUE(block->valid_data_len() == sizeof(int32_t));
     EXPECT_TRUE(*reinterpret_cast<int32_t*>(block->buffer()) == data);
@@ -474,6 +488,38 @@ TEST_F(BufferedBlockMgrTest, Eviction) {
   EXPECT_TRUE(block_mgr_parent_tracker_->consumption() == 0);
 }
 
+// Test that a client registered via SetYieldBuffersFn() is asked to give back pinned
+// buffers when another client needs one and nothing is free or evictable.
+TEST_F(BufferedBlockMgrTest, YieldBuffers) {
+  int max_num_buffers = 5;
+  shared_ptr<BufferedBlockMgr> block_mgr = CreateMgr(max_num_buffers);
+  BufferedBlockMgr::Client* client_a;
+  BufferedBlockMgr::Client* client_b;
+  Status status = block_mgr->RegisterClient(0, NULL, runtime_state_.get(), &client_a);
+  EXPECT_TRUE(status.ok());
+  status = block_mgr->RegisterClient(0, NULL, runtime_state_.get(), &client_b);
+  EXPECT_TRUE(status.ok());
+
+  // Client A takes all the buffers and registers a callback to give them back.
+  vector<BufferedBlockMgr::Block*> blocks;
+  AllocateBlocks(block_mgr.get(), client_a, max_num_buffers, &blocks);
+  int num_yield_calls = 0;
+  block_mgr->SetYieldBuffersFn(client_a,
+      bind(&BufferedBlockMgrTest::YieldBlocks, &blocks, &num_yield_calls, _1));
+
+  // Without arbitration this request could not get a buffer: nothing is free,
+  // unpinned or in flight. With it, client A is asked to yield and the request
+  // succeeds once a yielded block is written out.
+  BufferedBlockMgr::Block* new_block;
+  status = block_mgr->GetNewBlock(client_b, NULL, &new_block);
+  EXPECT_TRUE(status.ok());
+  EXPECT_TRUE(new_block != NULL);
+  EXPECT_EQ(num_yield_calls, 1);
+
+  block_mgr.reset();
+  EXPECT_TRUE(block_mgr_parent_tracker_->consumption() == 0);
+}
+
 // Test deletion and reuse of blocks.
 TEST_F(BufferedBlockMgrTest, Deletion) {
   int max_num_buffers = 5;
@@ -21,6 +21,7 @@
 #include "util/disk-info.h"
 #include "util/filesystem-util.h"
 #include "util/impalad-metrics.h"
+#include "util/mem-info.h"
 #include "util/uid-util.h"
 
 #include <openssl/rand.h>
@@ -36,6 +37,14 @@ using namespace strings;   // for Substitute
 DEFINE_bool(disk_spill_encryption, false, "Set this to encrypt and perform an integrity "
     "check on all data spilled to disk during a query");
 
+// Spill writes are already issued asynchronously, so preparing (hashing/encrypting)
+// one block overlaps the write of the previous one; batching additionally turns many
+// discrete block-sized writes into fewer large sequential ones.
+DEFINE_int32(spill_write_batch_blocks, 1, "Number of consecutive unpinned blocks the "
+    "block manager coalesces into a single scratch file write. Values > 1 restore "
+    "sequential disk access under heavy spilling at the cost of one extra copy of the "
+    "batched data. 1 issues one write per block.");
+
 using namespace std;
 using namespace strings;
 
@@ -53,7 +62,8 @@ struct BufferedBlockMgr::Client {
       query_tracker_(mgr_->mem_tracker_->parent()),
       num_reserved_buffers_(num_reserved_buffers),
       num_tmp_reserved_buffers_(0),
-      num_pinned_buffers_(0) {
+      num_pinned_buffers_(0),
+      max_pinned_buffers_(0) {
   }
 
   // Unowned.
@@ -84,10 +94,20 @@ struct BufferedBlockMgr::Client {
   // Number of buffers pinned by this client.
   int num_pinned_buffers_;
 
+  // High water mark of num_pinned_buffers_, i.e. the client's working set so far.
+  int max_pinned_buffers_;
+
+  // Callback to ask this client's operator to unpin cheaply re-spillable blocks.
+  // Empty unless the operator called SetYieldBuffersFn().
+  YieldBuffersFn yield_fn_;
+
   void PinBuffer(BufferDescriptor* buffer) {
     DCHECK_NOTNULL(buffer);
     if (buffer->len == mgr_->max_block_size()) {
       ++num_pinned_buffers_;
+      if (num_pinned_buffers_ > max_pinned_buffers_) {
+        max_pinned_buffers_ = num_pinned_buffers_;
+      }
       if (tracker_ != NULL) tracker_->ConsumeLocal(buffer->len, query_tracker_);
     }
   }
@@ -106,7 +126,8 @@ struct BufferedBlockMgr::Client {
     ss << "Client " << this << endl
        << "  num_reserved_buffers=" << num_reserved_buffers_ << endl
        << "  num_tmp_reserved_buffers=" << num_tmp_reserved_buffers_ << endl
-       << "  num_pinned_buffers=" << num_pinned_buffers_;
+       << "  num_pinned_buffers=" << num_pinned_buffers_ << endl
+       << "  max_pinned_buffers=" << max_pinned_buffers_;
     return ss.str();
   }
 };
@@ -117,6 +138,7 @@ BufferedBlockMgr::Block::Block(BufferedBlockMgr* block_mgr)
     block_mgr_(block_mgr),
     client_(NULL),
     write_range_(NULL),
+    read_range_(NULL),
     valid_data_len_(0),
     num_rows_(0) {
 }
@@ -125,6 +147,10 @@ Status BufferedBlockMgr::Block::Pin(bool* pinned, Block* release_block, bool unp
   return block_mgr_->PinBlock(this, pinned, release_block, unpin);
 }
 
+Status BufferedBlockMgr::Block::BeginPin(bool* started) {
+  return block_mgr_->BeginPin(this, started);
+}
+
 Status BufferedBlockMgr::Block::Unpin() {
   return block_mgr_->UnpinBlock(this);
 }
@@ -141,6 +167,7 @@ void BufferedBlockMgr::Block::Init() {
   valid_data_len_ = 0;
   client_ = NULL;
   num_rows_ = 0;
+  read_range_ = NULL;
 }
 
 bool BufferedBlockMgr::Block::Validate() const {
@@ -243,6 +270,14 @@ Status BufferedBlockMgr::RegisterClient(int num_reserved_buffers, MemTracker* tr
   return Status::OK;
 }
 
+void BufferedBlockMgr::SetYieldBuffersFn(Client* client, const YieldBuffersFn& fn) {
+  DCHECK(!fn.empty());
+  lock_guard<mutex> lock(lock_);
+  DCHECK(client->yield_fn_.empty());
+  client->yield_fn_ = fn;
+  yieldable_clients_.push_back(client);
+}
+
 void BufferedBlockMgr::ClearReservations(Client* client) {
   // TODO: The modifications to the client's mem variables can be made w/o the lock.
   lock_guard<mutex> lock(lock_);
@@ -314,7 +349,7 @@ bool BufferedBlockMgr::ConsumeMemory(Client* client, int64_t size) {
   int buffers_acquired = 0;
   do {
     BufferDescriptor* buffer_desc = NULL;
-    FindBuffer(lock, &buffer_desc); // This waits on the lock.
+    FindBuffer(lock, client, &buffer_desc); // This waits on the lock.
     if (buffer_desc == NULL) {
       // We couldn't get a buffer. This can happen if another query came and
       // allocated memory. Undo the reservation.
@@ -523,6 +558,9 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
   DCHECK(!block->is_deleted_);
   *pinned = false;
   if (block->is_pinned_) {
+    // The block may have been pinned by BeginPin() with its disk read still in
+    // flight; the data must be in the buffer before the caller can use it.
+    if (block->read_range_ != NULL) RETURN_IF_ERROR(WaitForBlockRead(block));
     *pinned = true;
     return DeleteOrUnpinBlock(release_block, unpin);
   }
@@ -567,9 +605,35 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
     *pinned = true;
   }
 
-  // Read the block from disk if it was not in memory.
-  DCHECK(block->write_range_ != NULL) << block->DebugString() << endl << release_block;
-  SCOPED_TIMER(disk_read_timer_);
+  // Read the block back from disk if it was not in memory.
+  RETURN_IF_ERROR(IssueBlockRead(block));
+  RETURN_IF_ERROR(WaitForBlockRead(block));
+  return DeleteOrUnpinBlock(release_block, unpin);
+}
+
+Status BufferedBlockMgr::BeginPin(Block* block, bool* started) {
+  DCHECK_NOTNULL(block);
+  DCHECK(!block->is_deleted_);
+  *started = false;
+  if (block->is_pinned_) {
+    *started = true;
+    return Status::OK;
+  }
+
+  bool in_mem = false;
+  RETURN_IF_ERROR(FindBufferForBlock(block, &in_mem));
+  // If no buffer could be found without displacing a pinned block, skip the
+  // read-ahead; the block is untouched and a later Pin() will do the work.
+  if (!block->is_pinned_) return Status::OK;
+  if (!in_mem && block->valid_data_len_ > 0) RETURN_IF_ERROR(IssueBlockRead(block));
+  *started = true;
+  return Status::OK;
+}
+
+Status BufferedBlockMgr::IssueBlockRead(Block* block) {
+  DCHECK(block->is_pinned_);
+  DCHECK(block->read_range_ == NULL);
+  DCHECK(block->write_range_ != NULL) << block->DebugString();
   // Create a ScanRange to perform the read.
   DiskIoMgr::ScanRange* scan_range =
       obj_pool_.Add(new DiskIoMgr::ScanRange());
@@ -577,17 +641,30 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
       block->write_range_->offset(), block->write_range_->disk_id(), false, block);
   vector<DiskIoMgr::ScanRange*> ranges(1, scan_range);
   RETURN_IF_ERROR(io_mgr_->AddScanRanges(io_request_context_, ranges, true));
+  block->read_range_ = scan_range;
+  return Status::OK;
+}
+
+Status BufferedBlockMgr::WaitForBlockRead(Block* block) {
+  DCHECK(block->is_pinned_);
+  DCHECK(block->read_range_ != NULL);
+  SCOPED_TIMER(disk_read_timer_);
 
   // Read from the io mgr buffer into the block's assigned buffer.
   int64_t offset = 0;
   DiskIoMgr::BufferDescriptor* io_mgr_buffer;
   do {
-    RETURN_IF_ERROR(scan_range->GetNext(&io_mgr_buffer));
+    Status status = block->read_range_->GetNext(&io_mgr_buffer);
+    if (!status.ok()) {
+      block->read_range_ = NULL;
+      return status;
+    }
     memcpy(block->buffer() + offset, io_mgr_buffer->buffer(), io_mgr_buffer->len());
     offset += io_mgr_buffer->len();
     io_mgr_buffer->Return();
   } while (!io_mgr_buffer->eosr());
   DCHECK_EQ(offset, block->write_range_->len());
+  block->read_range_ = NULL;
 
   // Verify integrity first, because the hash was generated from encrypted data
   if (check_integrity_) RETURN_IF_ERROR(VerifyHash(block));
@@ -595,11 +672,14 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
   // Decryption is done in-place, since the buffer can't be accessed by anyone else
   if (encryption_) RETURN_IF_ERROR(Decrypt(block));
 
-  return DeleteOrUnpinBlock(release_block, unpin);
+  return Status::OK;
 }
 
 Status BufferedBlockMgr::UnpinBlock(Block* block) {
   DCHECK(!block->is_deleted_) << "Unpin for deleted block.";
+  // Finish any read-ahead still in flight before the buffer can be handed to the
+  // writer path.
+  if (block->read_range_ != NULL) RETURN_IF_ERROR(WaitForBlockRead(block));
 
   lock_guard<mutex> unpinned_lock(lock_);
   if (is_cancelled_) return Status::CANCELLED;
@@ -627,14 +707,30 @@ Status BufferedBlockMgr::WriteUnpinnedBlocks() {
   if (disable_spill_) return Status::OK;
 
   // Assumes block manager lock is already taken.
+  vector<Block*> batch;
   while (num_outstanding_writes_ + free_io_buffers_.size() < block_write_threshold_ &&
          !unpinned_blocks_.empty()) {
     // Pop a block from the back of the list (LIFO).
     Block* write_block = unpinned_blocks_.PopBack();
     write_block->client_local_ = false;
-    RETURN_IF_ERROR(WriteUnpinnedBlock(write_block));
+    // Only full blocks that have not been assigned a scratch location yet can be
+    // batched; everything else takes the single-write path.
+    if (FLAGS_spill_write_batch_blocks > 1 && write_block->write_range_ == NULL &&
+        write_block->valid_data_len_ == max_block_size_) {
+      batch.push_back(write_block);
+      if (batch.size() >= FLAGS_spill_write_batch_blocks) {
+        RETURN_IF_ERROR(WriteUnpinnedBlockBatch(&batch));
+      }
+    } else {
+      RETURN_IF_ERROR(WriteUnpinnedBlock(write_block));
+    }
     ++num_outstanding_writes_;
   }
+  if (batch.size() == 1) {
+    RETURN_IF_ERROR(WriteUnpinnedBlock(batch[0]));
+  } else if (!batch.empty()) {
+    RETURN_IF_ERROR(WriteUnpinnedBlockBatch(&batch));
+  }
   DCHECK(Validate()) << endl << DebugInternal();
   return Status::OK;
 }
@@ -694,6 +790,110 @@ Status BufferedBlockMgr::WriteUnpinnedBlock(Block* block) {
   return Status::OK;
 }
 
+Status BufferedBlockMgr::WriteUnpinnedBlockBatch(vector<Block*>* blocks) {
+  // Assumes block manager lock is already taken.
+  DCHECK_GT(blocks->size(), 1);
+  if (tmp_files_.empty()) RETURN_IF_ERROR(InitTmpFiles());
+
+  // Allocate space for the whole batch in a single scratch file so the blocks are
+  // contiguous on disk and can be covered by one write.
+  TmpFileMgr::File& tmp_file = tmp_files_[next_block_index_];
+  next_block_index_ = (next_block_index_ + 1) % tmp_files_.size();
+  int disk_id = tmp_file.disk_id();
+  if (disk_id < 0) {
+    // Assign a valid disk id to the write range if the tmp file was not assigned one.
+    static unsigned int next_disk_id = 0;
+    disk_id = ++next_disk_id;
+  }
+  disk_id %= io_mgr_->num_local_disks();
+
+  int64_t first_offset = -1;
+  int64_t batch_len = 0;
+  for (int i = 0; i < blocks->size(); ++i) {
+    Block* block = (*blocks)[i];
+    DCHECK(!block->is_pinned_) << block->DebugString();
+    DCHECK(!block->in_write_) << block->DebugString();
+    DCHECK(block->write_range_ == NULL) << block->DebugString();
+    DCHECK_EQ(block->valid_data_len_, max_block_size_);
+    int64_t file_offset;
+    RETURN_IF_ERROR(tmp_file.AllocateSpace(max_block_size_, &file_offset));
+    if (first_offset == -1) first_offset = file_offset;
+    // All AllocateSpace() calls on this file happen under lock_, so the batch's
+    // offsets are contiguous.
+    DCHECK_EQ(file_offset, first_offset + batch_len);
+    // The per-block write range describes the block's location for ReadBlock() and
+    // later re-spills; it is not issued for this write.
+    DiskIoMgr::WriteRange::WriteDoneCallback callback =
+        bind(mem_fn(&BufferedBlockMgr::WriteComplete), this, block, _1);
+    block->write_range_ = obj_pool_.Add(new DiskIoMgr::WriteRange(
+        tmp_file.path(), file_offset, disk_id, callback));
+    batch_len += max_block_size_;
+  }
+
+  // Copy the blocks' data into a staging buffer backing the combined write. The copy
+  // is needed because the blocks' buffers can be handed out again once the write is
+  // issued.
+  uint8_t* batch_buffer = new uint8_t[batch_len];
+  int64_t pos = 0;
+  for (int i = 0; i < blocks->size(); ++i) {
+    Block* block = (*blocks)[i];
+    uint8_t* outbuf = NULL;
+    if (encryption_) {
+      Status status = Encrypt(block, &outbuf);
+      if (!status.ok()) {
+        delete[] batch_buffer;
+        return status;
+      }
+    } else {
+      outbuf = block->buffer();
+    }
+    if (check_integrity_) SetHash(block);
+    block->write_range_->SetData(outbuf, block->valid_data_len_);
+    memcpy(batch_buffer + pos, outbuf, block->valid_data_len_);
+    pos += max_block_size_;
+  }
+
+  vector<Block*>* batch_blocks = new vector<Block*>(*blocks);
+  DiskIoMgr::WriteRange::WriteDoneCallback batch_callback = bind(
+      mem_fn(&BufferedBlockMgr::WriteBatchComplete), this, batch_blocks,
+      batch_buffer, _1);
+  DiskIoMgr::WriteRange* batch_range = obj_pool_.Add(new DiskIoMgr::WriteRange(
+      tmp_file.path(), first_offset, disk_id, batch_callback));
+  batch_range->SetData(batch_buffer, batch_len);
+  Status status = io_mgr_->AddWriteRange(io_request_context_, batch_range);
+  if (!status.ok()) {
+    delete batch_blocks;
+    delete[] batch_buffer;
+    return status;
+  }
+  // The callback cannot run until lock_ is released, so it is safe to finish updating
+  // the blocks' state after the write was issued.
+  for (int i = 0; i < blocks->size(); ++i) {
+    Block* block = (*blocks)[i];
+    block->in_write_ = true;
+    DCHECK(block->Validate()) << endl << block->DebugString();
+    outstanding_writes_counter_->Add(1);
+    bytes_written_counter_->Add(block->valid_data_len_);
+  }
+  ++writes_issued_;
+  if (writes_issued_ == 1) {
+    if (ImpaladMetrics::NUM_QUERIES_SPILLED != NULL) {
+      ImpaladMetrics::NUM_QUERIES_SPILLED->Increment(1);
+    }
+  }
+  blocks->clear();
+  return Status::OK;
+}
+
+void BufferedBlockMgr::WriteBatchComplete(vector<Block*>* blocks,
+    const uint8_t* batch_buffer, const Status& write_status) {
+  delete[] batch_buffer;
+  for (int i = 0; i < blocks->size(); ++i) {
+    WriteComplete((*blocks)[i], write_status);
+  }
+  delete blocks;
+}
+
 void BufferedBlockMgr::WriteComplete(Block* block, const Status& write_status) {
   outstanding_writes_counter_->Add(-1);
   lock_guard<mutex> lock(lock_);
@@ -755,6 +955,13 @@ void BufferedBlockMgr::WriteComplete(Block* block, const Status& write_status) {
 
 Status BufferedBlockMgr::DeleteBlock(Block* block) {
   DCHECK(!block->is_deleted_);
+  // Finish any read-ahead still in flight before the buffer can be reused.
+  if (block->read_range_ != NULL) {
+    Status status = WaitForBlockRead(block);
+    // The block is being deleted, so a failed read (e.g. on cancellation) only needs
+    // to be surfaced, not recovered from.
+    if (!status.ok()) VLOG_QUERY << "Read-ahead failed for deleted block: " << status;
+  }
 
   lock_guard<mutex> lock(lock_);
   if (is_cancelled_) return Status::CANCELLED;
@@ -828,8 +1035,11 @@ Status BufferedBlockMgr::FindBufferForBlock(Block* block, bool* in_mem) {
   DCHECK(Validate()) << endl << DebugInternal();
   if (is_reserved_request) --unfullfilled_reserved_buffers_;
 
-  if (!is_reserved_request && remaining_unreserved_buffers() < 1) {
+  if (!is_reserved_request && remaining_unreserved_buffers() < 1 &&
+      !HasYieldableBuffers(client)) {
     // The client already has its quota and there are no unreserved blocks left.
+    // If another client could yield pinned buffers we fall through instead and let
+    // FindBuffer() arbitrate.
     // Note that even if this passes, it is still possible for the path below to
     // see OOM because another query consumed memory from the process tracker. This
     // only happens if the buffer has not already been allocated by the block mgr.
@@ -858,7 +1068,7 @@ Status BufferedBlockMgr::FindBufferForBlock(Block* block, bool* in_mem) {
     *in_mem = true;
   } else {
     BufferDescriptor* buffer_desc = NULL;
-    RETURN_IF_ERROR(FindBuffer(l, &buffer_desc));
+    RETURN_IF_ERROR(FindBuffer(l, client, &buffer_desc));
 
     if (buffer_desc == NULL) {
       // There are no free buffers or blocks we can evict. We need to fail this request.
@@ -905,7 +1115,7 @@ Status BufferedBlockMgr::FindBufferForBlock(Block* block, bool* in_mem) {
 //     threshold, until we run out of memory.
 //  2. Pick a buffer from the free list.
 //  3. Wait and evict an unpinned buffer.
-Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock,
+Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock, Client* requestor,
     BufferDescriptor** buffer_desc) {
   *buffer_desc = NULL;
 
@@ -913,6 +1123,8 @@ Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock,
   if (free_io_buffers_.size() < block_write_threshold_ &&
       mem_tracker_->TryConsume(max_block_size_)) {
     uint8_t* new_buffer = new uint8_t[max_block_size_];
+    COUNTER_ADD(huge_page_bytes_counter_,
+        MemInfo::AdviseHugePages(new_buffer, max_block_size_));
     *buffer_desc = obj_pool_.Add(new BufferDescriptor(new_buffer, max_block_size_));
     (*buffer_desc)->all_buffers_it = all_io_buffers_.insert(
         all_io_buffers_.end(), *buffer_desc);
@@ -929,22 +1141,66 @@ Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock,
           "resources. Compute stats on these tables, hint the plan or disable this "
           "behavior via query options to enable spilling.");
     }
-    if (unpinned_blocks_.empty() && num_outstanding_writes_ == 0) return Status::OK;
+    if (unpinned_blocks_.empty() && num_outstanding_writes_ == 0) {
+      // Nothing to evict. Before giving up, ask the query's other operators to yield
+      // pinned blocks they can cheaply re-spill. Yielded blocks land on the unpinned
+      // list and become evictable below. The lock is dropped during the callback, so
+      // re-check the state it protects.
+      if (AskClientsToYield(&lock, requestor) == 0) return Status::OK;
+      if (is_cancelled_) return Status::CANCELLED;
+      if (free_io_buffers_.empty() && unpinned_blocks_.empty() &&
+          num_outstanding_writes_ == 0) {
+        return Status::OK;
+      }
+    }
 
     // Third, this block needs to use a buffer that was unpinned from another block.
     // Get a free buffer from the front of the queue and assign it to the block.
-    do {
+    while (free_io_buffers_.empty()) {
       SCOPED_TIMER(buffer_wait_timer_);
       // Try to evict unpinned blocks before waiting.
       RETURN_IF_ERROR(WriteUnpinnedBlocks());
       buffer_available_cv_.wait(lock);
       if (is_cancelled_) return Status::CANCELLED;
-    } while (free_io_buffers_.empty());
+    }
   }
   *buffer_desc = free_io_buffers_.Dequeue();
   return Status::OK;
 }
 
+bool BufferedBlockMgr::HasYieldableBuffers(Client* requestor) const {
+  for (int i = 0; i < yieldable_clients_.size(); ++i) {
+    Client* client = yieldable_clients_[i];
+    if (client == requestor) continue;
+    if (client->num_pinned_buffers_ > client->num_reserved_buffers_) return true;
+  }
+  return false;
+}
+
+int BufferedBlockMgr::AskClientsToYield(unique_lock<mutex>* lock, Client* requestor) {
+  // Pick the client with the largest working set beyond its reservation; those are
+  // the buffers it only got because no one else had claimed them yet.
+  Client* victim = NULL;
+  int victim_surplus = 0;
+  for (int i = 0; i < yieldable_clients_.size(); ++i) {
+    Client* client = yieldable_clients_[i];
+    if (client == requestor) continue;
+    int surplus = client->num_pinned_buffers_ - client->num_reserved_buffers_;
+    if (surplus > victim_surplus) {
+      victim = client;
+      victim_surplus = surplus;
+    }
+  }
+  if (victim == NULL) return 0;
+  // Copy the callback so it stays valid while the lock is dropped. The callback will
+  // re-enter the block mgr via Unpin().
+  YieldBuffersFn yield_fn = victim->yield_fn_;
+  lock->unlock();
+  int num_yielded = yield_fn(victim_surplus);
+  lock->lock();
+  return num_yielded;
+}
+
 BufferedBlockMgr::Block* BufferedBlockMgr::GetUnusedBlock(Client* client) {
   DCHECK_NOTNULL(client);
   Block* new_block = NULL;
@@ -1098,6 +1354,8 @@ void BufferedBlockMgr::Init(DiskIoMgr* io_mgr, RuntimeProfile* parent_profile,
       profile_.get(), "BlocksCreated", TUnit::UNIT);
   recycled_blocks_counter_ = ADD_COUNTER(
       profile_.get(), "BlocksRecycled", TUnit::UNIT);
+  huge_page_bytes_counter_ = ADD_COUNTER(
+      profile_.get(), "HugePageBytesAdvised", TUnit::BYTES);
   bytes_written_counter_ = ADD_COUNTER(
       profile_.get(), "BytesWritten", TUnit::BYTES);
   outstanding_writes_counter_ =
@@ -15,6 +15,7 @@
 #ifndef IMPALA_RUNTIME_BUFFERED_BLOCK_MGR
 #define IMPALA_RUNTIME_BUFFERED_BLOCK_MGR
 
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "runtime/disk-io-mgr.h"
@@ -143,6 +144,14 @@ class BufferedBlockMgr {
     // If unpin is false, release_block is deleted. release_block must be pinned.
     Status Pin(bool* pinned, Block* release_block = NULL, bool unpin = true);
 
+    // Starts pinning a block without waiting for its data: assigns a free buffer (if
+    // one is available without displacing a pinned block) and issues the disk read
+    // asynchronously. *started is set to false and the block is left untouched if no
+    // buffer was available. If *started is true the block is pinned but its contents
+    // must not be read until a subsequent Pin() has returned, which waits for any
+    // in-flight read. Used for read-ahead of unpinned streams.
+    Status BeginPin(bool* started);
+
     // Unpin a block - add it to the list of unpinned blocks maintained by the block
     // manager. Is non-blocking.
     Status Unpin();
@@ -233,6 +242,11 @@ class BufferedBlockMgr {
     // write_range_ instance is owned by the block manager.
     DiskIoMgr::WriteRange* write_range_;
 
+    // Non-NULL while a disk read issued for this block is still in flight, i.e.
+    // between IssueBlockRead() and WaitForBlockRead(). Owned by the block manager's
+    // object pool.
+    DiskIoMgr::ScanRange* read_range_;
+
     // Length of valid (i.e. allocated) data within the block.
     int64_t valid_data_len_;
 
@@ -305,6 +319,19 @@ class BufferedBlockMgr {
   Status RegisterClient(int num_reserved_buffers, MemTracker* tracker,
       RuntimeState* state, Client** client);
 
+  // Callback the block mgr invokes to ask a client's operator to give back pinned
+  // buffers when another client needs a buffer and none are free or evictable. The
+  // operator should unpin up to 'num_buffers' blocks that it can cheaply re-spill
+  // (e.g. aggregation partitions whose blocks have already been written) and return
+  // the number of blocks it unpinned. Invoked without the block mgr lock held, so the
+  // implementation is free to call Unpin().
+  typedef boost::function<int (int num_buffers)> YieldBuffersFn;
+
+  // Registers 'fn' as 'client's yield callback, making the client's pinned buffers
+  // beyond its reservation eligible for arbitration between the query's operators.
+  // Without a callback a client is never asked to yield. See YieldBuffersFn.
+  void SetYieldBuffersFn(Client* client, const YieldBuffersFn& fn);
+
   // Clears all reservations for this client.
   void ClearReservations(Client* client);
 
@@ -420,6 +447,20 @@ class BufferedBlockMgr {
   Status UnpinBlock(Block* block);
   Status DeleteBlock(Block* block);
 
+  // Performs the work of Block::BeginPin(). Finds and pins a buffer for 'block' and,
+  // if the block's data was evicted to disk, issues (but does not wait for) the read
+  // to bring it back. *started is false and the block remains unpinned if no buffer
+  // could be obtained. The lock_ must not be taken by the caller.
+  Status BeginPin(Block* block, bool* started);
+
+  // Issues the disk read to restore 'block's data into its (pinned) buffer and sets
+  // block->read_range_. Does not wait for the read to complete.
+  Status IssueBlockRead(Block* block);
+
+  // Waits for the read issued by IssueBlockRead() to complete, copies the data into
+  // the block's buffer and verifies/decrypts it if needed. Clears block->read_range_.
+  Status WaitForBlockRead(Block* block);
+
   // If the 'block' is NULL, checks if cancelled and returns. Otherwise, depending on
   // 'unpin' calls either  DeleteBlock() or UnpinBlock(), which both first check for
   // cancellation. It should be called without the lock_ acquired.
@@ -453,10 +494,25 @@ class BufferedBlockMgr {
   //   1. Allocating a new buffer if possible
   //   2. Using a buffer from the free list (which is populated by moving blocks from
   //      the unpinned list by writing them out).
+  //   3. Asking other clients to yield pinned buffers on behalf of 'requestor' if
+  //      there is otherwise nothing to evict (see AskClientsToYield()).
   // Must be called with the lock_ already taken. This function can block.
-  Status FindBuffer(boost::unique_lock<boost::mutex>& lock,
+  Status FindBuffer(boost::unique_lock<boost::mutex>& lock, Client* requestor,
       BufferDescriptor** buffer);
 
+  // Asks the yieldable client holding the most pinned buffers beyond its reservation
+  // (excluding 'requestor') to unpin blocks it can cheaply re-spill. Returns the
+  // number of buffers the client reported unpinning; the unpinned blocks become
+  // evictable via the usual write-out path. 'lock' (on lock_) is released while the
+  // yield callback runs because the yielding operator re-enters the block mgr to
+  // unpin, so callers must re-check any state the lock protects.
+  int AskClientsToYield(boost::unique_lock<boost::mutex>* lock, Client* requestor);
+
+  // Returns true if any yieldable client other than 'requestor' holds pinned buffers
+  // beyond its reservation, i.e. AskClientsToYield() could reclaim something.
+  // Must be called with the lock_ already taken.
+  bool HasYieldableBuffers(Client* requestor) const;
+
   // Writes unpinned blocks via DiskIoMgr until one of the following is true:
   // 1) The number of outstanding writes >= (block_write_threshold_ - num free buffers)
   // 2) There are no more unpinned blocks
@@ -466,6 +522,22 @@ class BufferedBlockMgr {
   // Issues the write for this block to the io mgr.
   Status WriteUnpinnedBlock(Block* block);
 
+  // Issues a single large write covering all blocks in 'blocks'. The blocks are
+  // allocated contiguously in one scratch file and their data is copied into a
+  // staging buffer that backs one combined WriteRange, so the disk sees one
+  // sequential write instead of one write per block. Each block still gets its own
+  // write_range_ describing its location for later reads and re-spills.
+  // 'blocks' is cleared before returning. Only called when
+  // --spill_write_batch_blocks > 1 and must be called with the lock_ already taken.
+  Status WriteUnpinnedBlockBatch(std::vector<Block*>* blocks);
+
+  // Callback used by DiskIoMgr when a combined write issued by
+  // WriteUnpinnedBlockBatch() finishes. Frees the staging buffer and invokes
+  // WriteComplete() for every block covered by the write. Takes ownership of
+  // 'blocks' and 'batch_buffer'.
+  void WriteBatchComplete(std::vector<Block*>* blocks, const uint8_t* batch_buffer,
+      const Status& write_status);
+
   // Callback used by DiskIoMgr to indicate a block write has completed.
   // write_status is the status of the write. is_cancelled_ is set to true if
   // write_status is not Status::OK. Returns the block's buffer to the free buffers
@@ -520,6 +592,10 @@ class BufferedBlockMgr {
   // The total number of pinned buffers across all clients.
   int total_pinned_buffers_;
 
+  // Clients that registered a yield callback via SetYieldBuffersFn(). Protected by
+  // lock_. The Client objects are owned by obj_pool_.
+  std::vector<Client*> yieldable_clients_;
+
   // Number of outstanding writes (Writes issued but not completed).
   // This does not include client-local writes.
   int num_outstanding_writes_;
@@ -578,6 +654,10 @@ class BufferedBlockMgr {
   // Number of deleted blocks reused.
   RuntimeProfile::Counter* recycled_blocks_counter_;
 
+  // Number of buffer bytes the kernel was advised to back with transparent huge pages.
+  // 0 unless --madvise_huge_pages is enabled and the kernel supports it.
+  RuntimeProfile::Counter* huge_page_bytes_counter_;
+
   // Number of Pin() calls that did not require a disk read.
   RuntimeProfile::Counter* buffered_pin_counter_;
 
@@ -28,10 +28,24 @@ using namespace impala;
 using namespace std;
 using namespace strings;
 
+// Reading an unpinned stream back from disk is synchronous: each block's read only
+// starts when the reader needs it. With read-ahead the read for the next block is
+// issued while the current block's rows are consumed, overlapping the disk time with
+// useful work (e.g. repartitioning spilled hash join build partitions).
+// The depth is configurable since each read-ahead block holds a buffer while its
+// read is in flight: one block hides most of the latency, a second helps when
+// per-block processing is faster than a disk read.
+DEFINE_int32(stream_read_ahead_blocks, 0, "Number of blocks of an unpinned buffered "
+    "tuple stream whose disk reads are issued while the current block is being "
+    "consumed. 0 disables read-ahead.");
+
 // The first NUM_SMALL_BLOCKS of the tuple stream are made of blocks less than the
-// IO size. These blocks never spill.
+// IO size. These blocks never spill. The sizes grow geometrically so a stream holds
+// up to ~1.3MB before it needs its first IO-sized block; with many streams per
+// operator (e.g. one per partition of a partitioned aggregation) this cuts the
+// minimum memory footprint of mostly-small partitions several-fold.
 static const int64_t INITIAL_BLOCK_SIZES[] =
-    { 64 * 1024, 512 * 1024 };
+    { 64 * 1024, 256 * 1024, 1024 * 1024 };
 static const int NUM_SMALL_BLOCKS = sizeof(INITIAL_BLOCK_SIZES) / sizeof(int64_t);
 
 string BufferedTupleStream::RowIdx::DebugString() const {
@@ -64,6 +78,7 @@ BufferedTupleStream::BufferedTupleStream(RuntimeState* state,
     closed_(false),
     num_rows_(0),
     pinned_(true),
+    read_ahead_blocks_(FLAGS_stream_read_ahead_blocks),
     pin_timer_(NULL),
     unpin_timer_(NULL),
     get_new_block_timer_(NULL) {
@@ -280,6 +295,14 @@ Status BufferedTupleStream::NextBlockForRead() {
 
   bool pinned = false;
   if (read_block_ == blocks_.end() || (*read_block_)->is_pinned()) {
+    if (read_ahead_blocks_ > 0 && read_block_ != blocks_.end()) {
+      // The block may have been pinned by ReadAheadBlocks() with its disk read
+      // still in flight. Pin() on a pinned block waits for the read to complete.
+      SCOPED_TIMER(pin_timer_);
+      bool already_pinned;
+      RETURN_IF_ERROR((*read_block_)->Pin(&already_pinned));
+      DCHECK(already_pinned);
+    }
     // End of the blocks or already pinned, just handle block_to_free
     if (block_to_free != NULL) {
       SCOPED_TIMER(unpin_timer_);
@@ -306,11 +329,30 @@ Status BufferedTupleStream::NextBlockForRead() {
     null_indicators_read_block_ =
         ComputeNumNullIndicatorBytes((*read_block_)->buffer_len());
     read_ptr_ = (*read_block_)->buffer() + null_indicators_read_block_;
+    RETURN_IF_ERROR(ReadAheadBlocks());
   }
   DCHECK_EQ(num_pinned_, NumPinned(blocks_)) << DebugString();
   return Status::OK;
 }
 
+Status BufferedTupleStream::ReadAheadBlocks() {
+  if (read_ahead_blocks_ <= 0 || read_block_ == blocks_.end()) return Status::OK;
+  list<BufferedBlockMgr::Block*>::iterator next_block = read_block_;
+  for (int i = 0; i < read_ahead_blocks_; ++i) {
+    ++next_block;
+    if (next_block == blocks_.end()) return Status::OK;
+    if ((*next_block)->is_pinned()) continue;
+    bool started;
+    RETURN_IF_ERROR((*next_block)->BeginPin(&started));
+    // Don't go deeper if no buffer was available for this block; a later call will
+    // retry once buffers free up.
+    if (!started) return Status::OK;
+    // An unpinned block is always an io sized block, so it counts towards num_pinned_.
+    ++num_pinned_;
+  }
+  return Status::OK;
+}
+
 Status BufferedTupleStream::PrepareForRead(bool* got_buffer) {
   DCHECK(!closed_);
   if (blocks_.empty()) return Status::OK;
@@ -337,6 +379,12 @@ Status BufferedTupleStream::PrepareForRead(bool* got_buffer) {
       }
       ++num_pinned_;
       DCHECK_EQ(num_pinned_, NumPinned(blocks_));
+    } else if (read_ahead_blocks_ > 0) {
+      // Wait for any in-flight read-ahead before the block's data is used.
+      SCOPED_TIMER(pin_timer_);
+      bool already_pinned;
+      RETURN_IF_ERROR((*it)->Pin(&already_pinned));
+      DCHECK(already_pinned);
     }
     if ((*it)->is_max_size()) break;
   }
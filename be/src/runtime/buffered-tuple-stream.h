@@ -344,6 +344,10 @@ class BufferedTupleStream {
   // (both are if read_write_ is true).
   bool pinned_;
 
+  // Number of blocks past read_block_ whose disk reads are issued while the current
+  // block is consumed (0 disables read-ahead). From --stream_read_ahead_blocks.
+  int read_ahead_blocks_;
+
   // Counters added by this object to the parent runtime profile.
   RuntimeProfile::Counter* pin_timer_;
   RuntimeProfile::Counter* unpin_timer_;
@@ -369,6 +373,12 @@ class BufferedTupleStream {
   // Updates read_block_, read_ptr_, read_tuple_idx_ and read_bytes_.
   Status NextBlockForRead();
 
+  // If read-ahead is enabled, starts pinning up to read_ahead_blocks_ blocks
+  // following read_block_ so their disk reads overlap with consuming the current
+  // block. Blocks that are already pinned (e.g. by an earlier read-ahead) are
+  // skipped; stops early if no buffer is available for a deeper block.
+  Status ReadAheadBlocks();
+
   // Returns the byte size of this row when encoded in a block.
   int ComputeRowSize(TupleRow* row) const;
 
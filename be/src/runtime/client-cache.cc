@@ -36,6 +36,12 @@ using namespace apache::thrift::server;
 using namespace apache::thrift::transport;
 using namespace apache::thrift::protocol;
 
+DEFINE_int32(client_connection_validation_interval_ms, 60000, "(Advanced) Interval, in "
+    "milliseconds, between background health checks of idle cached backend "
+    "connections. Connections whose peer has gone away (e.g. after a backend restart) "
+    "are closed and re-opened in the background instead of failing the first RPC that "
+    "picks them up. Set to 0 or less to disable validation.");
+
 namespace impala {
 
 Status ClientCacheHelper::GetClient(const TNetworkAddress& address,
@@ -146,6 +152,126 @@ void ClientCacheHelper::ReleaseClient(ClientKey* client_key) {
   *client_key = NULL;
 }
 
+ClientCacheHelper::~ClientCacheHelper() {
+  {
+    lock_guard<mutex> lock(shutdown_lock_);
+    shutting_down_ = true;
+  }
+  shutdown_cv_.notify_all();
+  if (validation_thread_.get() != NULL) validation_thread_->Join();
+}
+
+void ClientCacheHelper::StartConnectionValidation(ClientFactory factory_method) {
+  DCHECK(validation_thread_.get() == NULL);
+  if (FLAGS_client_connection_validation_interval_ms <= 0) return;
+  validation_thread_.reset(new Thread("client-cache", "connection-validator",
+      &ClientCacheHelper::ConnectionValidationLoop, this, factory_method));
+}
+
+void ClientCacheHelper::ConnectionValidationLoop(ClientFactory factory_method) {
+  while (true) {
+    {
+      unique_lock<mutex> lock(shutdown_lock_);
+      if (!shutting_down_) {
+        shutdown_cv_.timed_wait(lock, posix_time::milliseconds(
+            FLAGS_client_connection_validation_interval_ms));
+      }
+      if (shutting_down_) return;
+    }
+    ValidateConnections(factory_method);
+  }
+}
+
+void ClientCacheHelper::ValidateConnections(ClientFactory factory_method) {
+  // Snapshot the per-host caches so cache_lock_ is not held while sockets are polled.
+  vector<PerHostCacheMap::value_type> host_caches;
+  {
+    lock_guard<mutex> lock(cache_lock_);
+    BOOST_FOREACH(const PerHostCacheMap::value_type& entry, per_host_caches_) {
+      host_caches.push_back(entry);
+    }
+  }
+
+  BOOST_FOREACH(const PerHostCacheMap::value_type& entry, host_caches) {
+    // Take all idle clients out of the host cache so that its lock is not held while
+    // each one is checked. Concurrent GetClient() calls will create new clients in the
+    // meantime, which is no worse than finding a cold cache.
+    list<ClientKey> idle_clients;
+    {
+      lock_guard<mutex> entry_lock(entry.second->lock);
+      idle_clients.swap(entry.second->clients);
+    }
+
+    list<ClientKey> healthy_clients;
+    int num_dead = 0;
+    BOOST_FOREACH(ClientKey client_key, idle_clients) {
+      shared_ptr<ThriftClientImpl> client_impl;
+      {
+        lock_guard<mutex> lock(client_map_lock_);
+        ClientMap::iterator client = client_map_.find(client_key);
+        DCHECK(client != client_map_.end());
+        client_impl = client->second;
+      }
+      if (client_impl->IsConnected()) {
+        healthy_clients.push_back(client_key);
+        continue;
+      }
+      VLOG(1) << "Dropping dead cached connection to " << client_impl->address();
+      client_impl->Close();
+      {
+        lock_guard<mutex> lock(client_map_lock_);
+        client_map_.erase(client_key);
+      }
+      if (metrics_enabled_) total_clients_metric_->Increment(-1);
+      ++num_dead;
+    }
+
+    // Replace the dead connections so the pool stays warm. A failure here just means
+    // the host is still down; the next validation pass (or RPC) will retry.
+    for (int i = 0; i < num_dead; ++i) {
+      ClientKey client_key;
+      Status status = CreateClient(entry.first, factory_method, &client_key);
+      if (!status.ok()) {
+        VLOG(1) << "Failed to re-open connection to " << entry.first << ": "
+                << status.GetDetail();
+        break;
+      }
+      healthy_clients.push_back(client_key);
+    }
+
+    {
+      lock_guard<mutex> entry_lock(entry.second->lock);
+      entry.second->clients.splice(entry.second->clients.end(), healthy_clients);
+    }
+  }
+}
+
+Status ClientCacheHelper::PreconnectToHost(const TNetworkAddress& address,
+    ClientFactory factory_method) {
+  shared_ptr<PerHostCache> host_cache;
+  {
+    lock_guard<mutex> lock(cache_lock_);
+    shared_ptr<PerHostCache>* ptr = &per_host_caches_[address];
+    if (ptr->get() == NULL) ptr->reset(new PerHostCache());
+    host_cache = *ptr;
+  }
+
+  {
+    lock_guard<mutex> lock(host_cache->lock);
+    if (!host_cache->clients.empty()) return Status::OK;
+  }
+
+  ClientKey client_key;
+  RETURN_IF_ERROR(CreateClient(address, factory_method, &client_key));
+  VLOG(1) << "PreconnectToHost(): cached new connection to " << address;
+  // The new client starts life 'checked out'; make it available in the host cache.
+  {
+    lock_guard<mutex> lock(host_cache->lock);
+    host_cache->clients.push_back(client_key);
+  }
+  return Status::OK;
+}
+
 void ClientCacheHelper::CloseConnections(const TNetworkAddress& address) {
   PerHostCache* cache;
   {
@@ -19,10 +19,13 @@
 #include <list>
 #include <string>
 #include <boost/unordered_map.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/bind.hpp>
 
 #include "util/metrics.h"
+#include "util/thread.h"
 #include "rpc/thrift-client.h"
 
 #include "common/status.h"
@@ -75,6 +78,19 @@ class ClientCacheHelper {
   Status GetClient(const TNetworkAddress& address, ClientFactory factory_method,
       ClientKey* client_key);
 
+  // Starts a background thread that periodically checks the health of all idle cached
+  // connections, closing those whose remote end has gone away (e.g. after a backend
+  // restart) and opening replacements with 'factory_method'. This keeps
+  // dead-connection discovery and reconnection off the RPC path, where they would
+  // otherwise stall the first queries after a node restart. No-op if
+  // --client_connection_validation_interval_ms is <= 0.
+  void StartConnectionValidation(ClientFactory factory_method);
+
+  // Ensures that at least one open connection to 'address' is cached, creating one
+  // with 'factory_method' if there is none. Used to warm the cache up front rather
+  // than paying connection setup on the first RPC to a host.
+  Status PreconnectToHost(const TNetworkAddress& address, ClientFactory factory_method);
+
   // Returns a newly-opened client in client_key. May reopen the existing client, or may
   // replace it with a new one (created using 'factory_method').
   //
@@ -100,6 +116,9 @@ class ClientCacheHelper {
   // and the total number in the cache.
   void InitMetrics(MetricGroup* metrics, const std::string& key_prefix);
 
+  // Stops the connection validation thread, if one was started.
+  ~ClientCacheHelper();
+
  private:
   template <class T> friend class ClientCache;
   // Private constructor so that only ClientCache can instantiate this class.
@@ -109,7 +128,8 @@ class ClientCacheHelper {
         wait_ms_(wait_ms),
         send_timeout_ms_(send_timeout_ms),
         recv_timeout_ms_(recv_timeout_ms),
-        metrics_enabled_(false) { }
+        metrics_enabled_(false),
+        shutting_down_(false) { }
 
   // There are three lock categories - the cache-wide lock (cache_lock_), the locks for a
   // specific cache (PerHostCache::lock) and the lock for the set of all clients
@@ -177,9 +197,26 @@ class ClientCacheHelper {
   // Total clients in the cache, including those in use
   IntGauge* total_clients_metric_;
 
+  // Background connection validation thread; NULL unless StartConnectionValidation()
+  // was called. shutdown_cv_ (with shutdown_lock_/shutting_down_) wakes the thread up
+  // early when the cache is destroyed.
+  boost::scoped_ptr<Thread> validation_thread_;
+  boost::mutex shutdown_lock_;
+  boost::condition_variable shutdown_cv_;
+  bool shutting_down_;
+
   // Create a new client for specific address in 'client' and put it in client_map_
   Status CreateClient(const TNetworkAddress& address, ClientFactory factory_method,
       ClientKey* client_key);
+
+  // Body of the connection validation thread: sleeps for the validation interval
+  // (waking early on shutdown), then checks every idle connection once. See
+  // StartConnectionValidation().
+  void ConnectionValidationLoop(ClientFactory factory_method);
+
+  // Performs one validation pass over all idle cached clients, closing dead ones and
+  // opening replacements with 'factory_method'.
+  void ValidateConnections(ClientFactory factory_method);
 };
 
 template<class T>
@@ -258,6 +295,19 @@ class ClientCache {
     return client_cache_helper_.CloseConnections(address);
   }
 
+  // Starts periodic background health-checking and replacement of idle cached
+  // connections. See ClientCacheHelper::StartConnectionValidation().
+  void StartConnectionValidation() {
+    client_cache_helper_.StartConnectionValidation(client_factory_);
+  }
+
+  // Opens and caches a connection to 'address' if none is cached yet, so the first
+  // RPC to that host doesn't pay connection setup. Blocks while connecting; callers
+  // on latency-sensitive paths should invoke this from a worker thread.
+  Status PreconnectToHost(const TNetworkAddress& address) {
+    return client_cache_helper_.PreconnectToHost(address, client_factory_);
+  }
+
   // Helper method which returns a debug string
   std::string DebugString() {
     return client_cache_helper_.DebugString();
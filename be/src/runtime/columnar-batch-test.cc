@@ -0,0 +1,108 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "runtime/columnar-batch.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/cpu-info.h"
+
+using namespace std;
+
+namespace impala {
+
+class ColumnarBatchTest : public testing::Test {
+ protected:
+  MemTracker tracker_;
+  ObjectPool obj_pool_;
+};
+
+// Gather a row batch with nulls into columns and scatter it back, verifying the
+// values survive the round trip in both representations.
+TEST_F(ColumnarBatchTest, RoundTrip) {
+  DescriptorTblBuilder builder(&obj_pool_);
+  builder.DeclareTuple() << TYPE_INT << TYPE_BIGINT;
+  DescriptorTbl* desc_tbl = builder.Build();
+  TupleDescriptor* tuple_desc = desc_tbl->GetTupleDescriptor(0);
+  vector<bool> nullable_tuples(1, false);
+  vector<TTupleId> tuple_ids(1, (TTupleId) 0);
+  RowDescriptor row_desc(*desc_tbl, tuple_ids, nullable_tuples);
+
+  const int num_rows = 10;
+  const SlotDescriptor* int_slot = tuple_desc->slots()[0];
+  const SlotDescriptor* bigint_slot = tuple_desc->slots()[1];
+  RowBatch batch(row_desc, num_rows, &tracker_);
+  for (int i = 0; i < num_rows; ++i) {
+    Tuple* tuple = Tuple::Create(tuple_desc->byte_size(), batch.tuple_data_pool());
+    if (i % 3 == 0) {
+      tuple->SetNull(int_slot->null_indicator_offset());
+    } else {
+      *reinterpret_cast<int32_t*>(tuple->GetSlot(int_slot->tuple_offset())) = i;
+    }
+    *reinterpret_cast<int64_t*>(tuple->GetSlot(bigint_slot->tuple_offset())) = i * 10L;
+    int idx = batch.AddRow();
+    batch.GetRow(idx)->SetTuple(0, tuple);
+    batch.CommitLastRow();
+  }
+
+  MemPool pool(&tracker_);
+  ColumnarBatch columns(*tuple_desc, num_rows, &pool);
+  columns.FromRowBatch(&batch, 0);
+  EXPECT_EQ(columns.num_columns(), 2);
+  EXPECT_EQ(columns.num_rows(), num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    if (i % 3 == 0) {
+      EXPECT_TRUE(columns.IsNull(0, i));
+    } else {
+      EXPECT_FALSE(columns.IsNull(0, i));
+      EXPECT_EQ(*reinterpret_cast<int32_t*>(columns.value(0, i)), i);
+    }
+    EXPECT_FALSE(columns.IsNull(1, i));
+    EXPECT_EQ(*reinterpret_cast<int64_t*>(columns.value(1, i)), i * 10L);
+  }
+
+  // Scatter back into a row batch, as an operator that only supports rows would.
+  RowBatch out_batch(row_desc, num_rows, &tracker_);
+  columns.ToRowBatch(&out_batch, 0, out_batch.tuple_data_pool());
+  EXPECT_EQ(out_batch.num_rows(), num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    Tuple* tuple = out_batch.GetRow(i)->GetTuple(0);
+    if (i % 3 == 0) {
+      EXPECT_TRUE(tuple->IsNull(int_slot->null_indicator_offset()));
+    } else {
+      EXPECT_FALSE(tuple->IsNull(int_slot->null_indicator_offset()));
+      EXPECT_EQ(
+          *reinterpret_cast<int32_t*>(tuple->GetSlot(int_slot->tuple_offset())), i);
+    }
+    EXPECT_EQ(*reinterpret_cast<int64_t*>(tuple->GetSlot(bigint_slot->tuple_offset())),
+        i * 10L);
+  }
+  pool.FreeAll();
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,84 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/columnar-batch.h"
+
+#include <string.h>
+
+#include "runtime/mem-pool.h"
+#include "runtime/row-batch.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+
+using namespace std;
+
+namespace impala {
+
+ColumnarBatch::ColumnarBatch(const TupleDescriptor& tuple_desc, int capacity,
+    MemPool* pool)
+  : tuple_desc_(tuple_desc),
+    capacity_(capacity),
+    num_rows_(0) {
+  DCHECK_GT(capacity, 0);
+  const vector<SlotDescriptor*>& slots = tuple_desc.slots();
+  for (int i = 0; i < slots.size(); ++i) {
+    if (!slots[i]->is_materialized()) continue;
+    column_slots_.push_back(slots[i]);
+    columns_.push_back(pool->Allocate(capacity * slots[i]->slot_size()));
+    null_indicators_.push_back(pool->Allocate(capacity));
+  }
+}
+
+void ColumnarBatch::FromRowBatch(RowBatch* batch, int tuple_idx) {
+  DCHECK_LE(batch->num_rows(), capacity_);
+  num_rows_ = batch->num_rows();
+  // Gather one column at a time rather than one row at a time: the writes are then
+  // sequential and each column's offset/null-indicator computation is loop-invariant.
+  for (int col = 0; col < column_slots_.size(); ++col) {
+    const SlotDescriptor* slot_desc = column_slots_[col];
+    const int slot_size = slot_desc->slot_size();
+    uint8_t* values = columns_[col];
+    uint8_t* nulls = null_indicators_[col];
+    for (int row = 0; row < num_rows_; ++row) {
+      Tuple* tuple = batch->GetRow(row)->GetTuple(tuple_idx);
+      if (tuple == NULL || tuple->IsNull(slot_desc->null_indicator_offset())) {
+        nulls[row] = 1;
+        continue;
+      }
+      nulls[row] = 0;
+      memcpy(values + row * slot_size, tuple->GetSlot(slot_desc->tuple_offset()),
+          slot_size);
+    }
+  }
+}
+
+void ColumnarBatch::ToRowBatch(RowBatch* batch, int tuple_idx, MemPool* pool) const {
+  for (int row = 0; row < num_rows_; ++row) {
+    Tuple* tuple = Tuple::Create(tuple_desc_.byte_size(), pool);
+    for (int col = 0; col < column_slots_.size(); ++col) {
+      const SlotDescriptor* slot_desc = column_slots_[col];
+      if (null_indicators_[col][row] != 0) {
+        tuple->SetNull(slot_desc->null_indicator_offset());
+        continue;
+      }
+      memcpy(tuple->GetSlot(slot_desc->tuple_offset()),
+          columns_[col] + row * slot_desc->slot_size(), slot_desc->slot_size());
+    }
+    int row_idx = batch->AddRow();
+    batch->GetRow(row_idx)->SetTuple(tuple_idx, tuple);
+    batch->CommitLastRow();
+  }
+}
+
+}
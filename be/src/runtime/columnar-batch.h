@@ -0,0 +1,100 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_RUNTIME_COLUMNAR_BATCH_H
+#define IMPALA_RUNTIME_COLUMNAR_BATCH_H
+
+#include <vector>
+
+#include "common/logging.h"
+#include "runtime/descriptors.h"
+
+namespace impala {
+
+class MemPool;
+class RowBatch;
+
+// Columnar representation of one tuple of a RowBatch. Each materialized slot is
+// gathered into a contiguous array so downstream loops (conjunct evaluation, hash
+// computation, aggregation input) touch one column at a time instead of striding
+// across tuple layouts, which is what the compiler needs to vectorize them.
+//
+// The conversions are TupleDescriptor-driven, so adjacent operators can negotiate
+// the representation: a producer that supports columns fills a ColumnarBatch with
+// FromRowBatch() and a consumer that only supports rows scatters it back with
+// ToRowBatch(). Values are copied slot-wise, so variable-length slots are gathered
+// as StringValue entries that still point into the source batch's memory; the
+// source batch's buffers must outlive any use of this object's columns.
+class ColumnarBatch {
+ public:
+  // Creates a batch for the materialized slots of 'tuple_desc' holding up to
+  // 'capacity' rows. The column and null-indicator arrays are allocated from 'pool'.
+  ColumnarBatch(const TupleDescriptor& tuple_desc, int capacity, MemPool* pool);
+
+  // Gathers the tuple at 'tuple_idx' of every row in 'batch' into the column arrays,
+  // replacing this object's contents. Rows whose tuple is NULL are gathered with all
+  // slots null. 'batch' must have at most capacity() rows.
+  void FromRowBatch(RowBatch* batch, int tuple_idx);
+
+  // Scatters rows [0, num_rows()) into new tuples allocated from 'pool' and appends
+  // them to 'batch' at 'tuple_idx'. This is the boundary converter for an operator
+  // that only supports the row layout. 'batch' must have room for num_rows() rows.
+  void ToRowBatch(RowBatch* batch, int tuple_idx, MemPool* pool) const;
+
+  // Returns the start of the value array for column 'col'. Values are slot_size()
+  // bytes apart and byte-identical to the slot contents in the row layout.
+  uint8_t* column(int col) const {
+    DCHECK_LT(col, columns_.size());
+    return columns_[col];
+  }
+
+  // Returns the value of column 'col' in row 'row'.
+  void* value(int col, int row) const {
+    DCHECK_LT(row, num_rows_);
+    return columns_[col] + row * column_slots_[col]->slot_size();
+  }
+
+  bool IsNull(int col, int row) const {
+    DCHECK_LT(row, num_rows_);
+    return null_indicators_[col][row] != 0;
+  }
+
+  // The slot backing column 'col'.
+  const SlotDescriptor* column_desc(int col) const { return column_slots_[col]; }
+
+  int num_columns() const { return column_slots_.size(); }
+  int num_rows() const { return num_rows_; }
+  int capacity() const { return capacity_; }
+
+ private:
+  const TupleDescriptor& tuple_desc_;
+
+  // Materialized slots of tuple_desc_, in slots() order. Non-materialized slots have
+  // no storage in the row layout and get no column.
+  std::vector<SlotDescriptor*> column_slots_;
+
+  // Per-column value arrays, each capacity_ * slot_size() bytes. Backed by the pool
+  // passed to the constructor.
+  std::vector<uint8_t*> columns_;
+
+  // Per-column null indicators, one byte per row (non-zero means null).
+  std::vector<uint8_t*> null_indicators_;
+
+  int capacity_;
+  int num_rows_;
+};
+
+}
+
+#endif
@@ -414,11 +414,33 @@ Status Coordinator::Exec(QuerySchedule& schedule,
     }
     fragment_profiles_[fragment_idx].num_instances = num_hosts;
 
-    // Issue all rpcs in parallel
+    // Group this fragment's instances by destination impalad so that one worker
+    // thread issues all of a host's ExecPlanFragment() rpcs over a single cached
+    // connection, rather than creating a thread (and checking out a connection) per
+    // instance.
+    vector<BackendExecStateGroup> exec_state_groups;
+    exec_state_groups.reserve(num_hosts);
+    unordered_map<TNetworkAddress, int> group_idx_map;
+    for (int i = backend_num - num_hosts; i < backend_num; ++i) {
+      BackendExecState* exec_state = backend_exec_states_[i];
+      int* group_idx = FindOrInsert(&group_idx_map, exec_state->backend_address,
+          static_cast<int>(exec_state_groups.size()));
+      if (*group_idx == static_cast<int>(exec_state_groups.size())) {
+        exec_state_groups.push_back(BackendExecStateGroup());
+        exec_state_groups.back().backend_address = exec_state->backend_address;
+      }
+      exec_state_groups[*group_idx].exec_states.push_back(exec_state);
+    }
+    vector<void*> group_args;
+    group_args.reserve(exec_state_groups.size());
+    BOOST_FOREACH(BackendExecStateGroup& group, exec_state_groups) {
+      group_args.push_back(&group);
+    }
+
+    // Issue the rpcs for all hosts in parallel
     Status fragments_exec_status = ParallelExecutor::Exec(
-        bind<Status>(mem_fn(&Coordinator::ExecRemoteFragment), this, _1),
-        reinterpret_cast<void**>(&backend_exec_states_[backend_num - num_hosts]),
-        num_hosts, &latencies);
+        bind<Status>(mem_fn(&Coordinator::ExecRemoteFragments), this, _1),
+        &group_args[0], group_args.size(), &latencies);
 
     if (!fragments_exec_status.ok()) {
       DCHECK(query_status_.ok());  // nobody should have been able to cancel
@@ -755,6 +777,30 @@ Status Coordinator::WaitForAllBackends() {
   return query_status_;
 }
 
+void Coordinator::SetCompletionCallback(const boost::function<void ()>& callback) {
+  {
+    lock_guard<mutex> l(lock_);
+    if (num_remaining_backends_ > 0 && query_status_.ok()) {
+      lock_guard<mutex> l2(completion_callback_lock_);
+      DCHECK(completion_callback_.empty());
+      completion_callback_ = callback;
+      return;
+    }
+  }
+  // Execution already completed (or failed); the transition that would have fired the
+  // callback has come and gone, so run it from here.
+  callback();
+}
+
+void Coordinator::InvokeCompletionCallback() {
+  boost::function<void ()> callback;
+  {
+    lock_guard<mutex> l(completion_callback_lock_);
+    callback.swap(completion_callback_);
+  }
+  if (!callback.empty()) callback();
+}
+
 Status Coordinator::Wait() {
   lock_guard<mutex> l(wait_lock_);
   SCOPED_TIMER(query_profile_->total_time_counter());
@@ -1056,51 +1102,53 @@ int64_t Coordinator::ComputeTotalScanRangesComplete(int node_id) {
   return value;
 }
 
-Status Coordinator::ExecRemoteFragment(void* exec_state_arg) {
-  BackendExecState* exec_state = reinterpret_cast<BackendExecState*>(exec_state_arg);
-  VLOG_FILE << "making rpc: ExecPlanFragment query_id=" << query_id_
-            << " instance_id=" << exec_state->fragment_instance_id
-            << " host=" << exec_state->backend_address;
-  lock_guard<mutex> l(exec_state->lock);
-
+Status Coordinator::ExecRemoteFragments(void* exec_state_group_arg) {
+  BackendExecStateGroup* group =
+      reinterpret_cast<BackendExecStateGroup*>(exec_state_group_arg);
   Status status;
   ImpalaInternalServiceConnection backend_client(
-      exec_env_->impalad_client_cache(), exec_state->backend_address, &status);
+      exec_env_->impalad_client_cache(), group->backend_address, &status);
   RETURN_IF_ERROR(status);
 
-  TExecPlanFragmentResult thrift_result;
-  try {
+  BOOST_FOREACH(BackendExecState* exec_state, group->exec_states) {
+    VLOG_FILE << "making rpc: ExecPlanFragment query_id=" << query_id_
+              << " instance_id=" << exec_state->fragment_instance_id
+              << " host=" << exec_state->backend_address;
+    lock_guard<mutex> l(exec_state->lock);
+
+    TExecPlanFragmentResult thrift_result;
     try {
-      backend_client->ExecPlanFragment(thrift_result, exec_state->rpc_params);
-    } catch (const TException& e) {
-      // If a backend has stopped and restarted (without the failure detector
-      // picking it up) an existing backend client may still think it is
-      // connected. To avoid failing the first query after every failure, catch
-      // the first failure and force a reopen of the transport.
-      // TODO: Improve client-cache so that we don't need to do this.
-      VLOG_RPC << "Retrying ExecPlanFragment: " << e.what();
-      Status status = backend_client.Reopen();
-      if (!status.ok()) {
-        exec_state->status = status;
-        return status;
+      try {
+        backend_client->ExecPlanFragment(thrift_result, exec_state->rpc_params);
+      } catch (const TException& e) {
+        // If a backend has stopped and restarted (without the failure detector
+        // picking it up) an existing backend client may still think it is
+        // connected. To avoid failing the first query after every failure, catch
+        // the first failure and force a reopen of the transport.
+        // TODO: Improve client-cache so that we don't need to do this.
+        VLOG_RPC << "Retrying ExecPlanFragment: " << e.what();
+        Status status = backend_client.Reopen();
+        if (!status.ok()) {
+          exec_state->status = status;
+          return status;
+        }
+        backend_client->ExecPlanFragment(thrift_result, exec_state->rpc_params);
       }
-      backend_client->ExecPlanFragment(thrift_result, exec_state->rpc_params);
+    } catch (const TException& e) {
+      stringstream msg;
+      msg << "ExecPlanRequest rpc query_id=" << query_id_
+          << " instance_id=" << exec_state->fragment_instance_id
+          << " failed: " << e.what();
+      VLOG_QUERY << msg.str();
+      exec_state->status = Status(msg.str());
+      return exec_state->status;
     }
-  } catch (const TException& e) {
-    stringstream msg;
-    msg << "ExecPlanRequest rpc query_id=" << query_id_
-        << " instance_id=" << exec_state->fragment_instance_id
-        << " failed: " << e.what();
-    VLOG_QUERY << msg.str();
-    exec_state->status = Status(msg.str());
-    return exec_state->status;
-  }
-  exec_state->status = thrift_result.status;
-  if (exec_state->status.ok()) {
+    exec_state->status = thrift_result.status;
+    if (!exec_state->status.ok()) return exec_state->status;
     exec_state->initiated = true;
     exec_state->stopwatch.Start();
   }
-  return exec_state->status;
+  return Status::OK;
 }
 
 void Coordinator::Cancel(const Status* cause) {
@@ -1195,6 +1243,7 @@ void Coordinator::CancelRemoteFragments() {
 
   // notify that we completed with an error
   backend_completion_cv_.notify_all();
+  InvokeCompletionCallback();
 }
 
 Status Coordinator::UpdateFragmentExecStatus(const TReportExecStatusParams& params) {
@@ -1294,6 +1343,7 @@ Status Coordinator::UpdateFragmentExecStatus(const TReportExecStatusParams& para
     return Status::OK;
   }
 
+  bool all_backends_done = false;
   if (params.done) {
     lock_guard<mutex> l(lock_);
     exec_state->stopwatch.Stop();
@@ -1315,8 +1365,10 @@ Status Coordinator::UpdateFragmentExecStatus(const TReportExecStatusParams& para
     }
     if (--num_remaining_backends_ == 0) {
       backend_completion_cv_.notify_all();
+      all_backends_done = true;
     }
   }
+  if (all_backends_done) InvokeCompletionCallback();
 
   return Status::OK;
 }
@@ -1417,6 +1469,24 @@ void Coordinator::UpdateExecSummary(int fragment_idx, int instance_idx,
   VLOG(2) << PrintExecSummary(exec_summary_);
 }
 
+int64_t Coordinator::GetMaxPerHostPeakMemUsage() {
+  int64_t max_peak = -1;
+  if (executor_.get() != NULL) {
+    RuntimeProfile::Counter* mem_usage_counter = executor_->profile()->GetCounter(
+        PlanFragmentExecutor::PER_HOST_PEAK_MEM_COUNTER);
+    if (mem_usage_counter != NULL) max_peak = mem_usage_counter->value();
+  }
+  for (int i = 0; i < backend_exec_states_.size(); ++i) {
+    RuntimeProfile::Counter* mem_usage_counter =
+        backend_exec_states_[i]->profile->GetCounter(
+            PlanFragmentExecutor::PER_HOST_PEAK_MEM_COUNTER);
+    if (mem_usage_counter != NULL && mem_usage_counter->value() > max_peak) {
+      max_peak = mem_usage_counter->value();
+    }
+  }
+  return max_peak;
+}
+
 // This function appends summary information to the query_profile_ before
 // outputting it to VLOG.  It adds:
 //   1. Averaged remote fragment profiles (TODO: add outliers)
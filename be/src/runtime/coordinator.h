@@ -26,6 +26,7 @@
 #include <boost/accumulators/statistics/median.hpp>
 #include <boost/accumulators/statistics/max.hpp>
 #include <boost/accumulators/statistics/variance.hpp>
+#include <boost/function.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/thread/thread.hpp>
@@ -136,6 +137,26 @@ class Coordinator {
   // to CancelInternal().
   Status UpdateFragmentExecStatus(const TReportExecStatusParams& params);
 
+  // Registers a callback that is invoked exactly once when execution has completed,
+  // i.e. when WaitForAllBackends() would return without blocking: either all backends
+  // have reported completion or query_status_ has become an error. The callback is run
+  // from the thread that observes the transition (the final fragment status report or
+  // the cancelling thread), possibly while internal locks are held, so it must not
+  // block and must not call back into this coordinator; queueing work elsewhere is the
+  // intended use. If execution has already completed, the callback is invoked from this
+  // thread before the call returns. May be called at most once, after Exec().
+  void SetCompletionCallback(const boost::function<void ()>& callback);
+
+  // True if this query has a plan fragment executing on the coordinator itself.
+  // Only valid after Exec().
+  bool has_coordinator_fragment() const { return executor_.get() != NULL; }
+
+  // Returns the highest peak memory consumption reported by any single backend
+  // (including the coordinator fragment), taken from the per-host peak memory
+  // counters of the fragment profiles, or -1 if no backend has reported one. Only
+  // meaningful once the query has finished, i.e. after Wait() has returned.
+  int64_t GetMaxPerHostPeakMemUsage();
+
   // only valid *after* calling Exec(), and may return NULL if there is no executor
   RuntimeState* runtime_state();
   const RowDescriptor& row_desc() const;
@@ -277,6 +298,15 @@ class Coordinator {
   // hits 0, any Wait()'ing thread is notified
   int num_remaining_backends_;
 
+  // Protects completion_callback_. Taken after lock_ (if both are needed), and no
+  // other locks may be acquired while holding it.
+  boost::mutex completion_callback_lock_;
+
+  // Callback registered via SetCompletionCallback(), invoked (and cleared) by
+  // InvokeCompletionCallback(). Empty if no callback was registered or if it has
+  // already run.
+  boost::function<void ()> completion_callback_;
+
   // The following two structures, partition_row_counts_ and files_to_move_ are filled in
   // as the query completes, and track the results of INSERT queries that alter the
   // structure of tables. They are either the union of the reports from all backends, or
@@ -353,14 +383,21 @@ class Coordinator {
       int fragment_idx, const FragmentExecParams& params, int instance_idx,
       const TNetworkAddress& coord, TExecPlanFragmentParams* rpc_params);
 
-  // Wrapper for ExecPlanFragment() rpc.  This function will be called in parallel
-  // from multiple threads.
-  // Obtains exec_state->lock prior to making rpc, so that it serializes
-  // correctly with UpdateFragmentExecStatus().
-  // exec_state contains all information needed to issue the rpc.
-  // 'coordinator' will always be an instance to this class and 'exec_state' will
-  // always be an instance of BackendExecState.
-  Status ExecRemoteFragment(void* exec_state);
+  // Fragment instances of a single plan fragment that are executed by the same
+  // impalad. Exec() starts each group with a single worker thread that issues all
+  // ExecPlanFragment() rpcs for that host over one cached connection.
+  struct BackendExecStateGroup {
+    TNetworkAddress backend_address;
+    std::vector<BackendExecState*> exec_states;
+  };
+
+  // Wrapper for the ExecPlanFragment() rpcs to a single host. This function will be
+  // called in parallel from multiple threads, one per destination impalad.
+  // Obtains each exec_state->lock prior to making its rpc, so that it serializes
+  // correctly with UpdateFragmentExecStatus(). Returns on the first rpc that fails;
+  // the caller cancels any instances that were already initiated.
+  // 'exec_state_group' will always be an instance of BackendExecStateGroup.
+  Status ExecRemoteFragments(void* exec_state_group);
 
   // Determine fragment number, given fragment id.
   int GetFragmentNum(const TUniqueId& fragment_id);
@@ -392,6 +429,11 @@ class Coordinator {
   // reached.
   void CancelRemoteFragments();
 
+  // Runs and clears completion_callback_ if one is registered. Called from every path
+  // that notifies backend_completion_cv_, i.e. whenever WaitForAllBackends() would stop
+  // blocking. Safe to call multiple times; the callback runs at most once.
+  void InvokeCompletionCallback();
+
   // Acquires lock_ and updates query_status_ with 'status' if it's not already
   // an error status, and returns the current query_status_.
   // Calls CancelInternal() when switching to an error status.
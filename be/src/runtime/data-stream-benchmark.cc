@@ -0,0 +1,341 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "common/logging.h"
+#include "common/object-pool.h"
+#include "runtime/client-cache.h"
+#include "runtime/data-stream-mgr.h"
+#include "runtime/data-stream-recvr.h"
+#include "runtime/data-stream-sender.h"
+#include "runtime/descriptors.h"
+#include "runtime/exec-env.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
+#include "runtime/string-value.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+#include "rpc/thrift-server.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/cpu-info.h"
+#include "util/pretty-printer.h"
+#include "util/stopwatch.h"
+#include "util/thread.h"
+#include "gen-cpp/ImpalaInternalService.h"
+#include "gen-cpp/ImpalaInternalService_types.h"
+#include "gen-cpp/Types_types.h"
+
+using namespace apache::thrift;
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+// Loopback throughput benchmark for the exchange path: DataStreamSender ->
+// thrift RPC -> DataStreamMgr -> DataStreamRecvr, all in one process against
+// 127.0.0.1, the same wiring data-stream-test.cc uses but driven for throughput
+// instead of correctness. Senders and receivers run on their own threads; the
+// senders push --num_batches batches of --rows_per_batch rows each.
+//
+// Row width is parameterized with --bigint_cols and --string_col_len, the
+// partition count with --num_receivers and --partition_type (broadcast or hash).
+// Row batch compression adapts to the data (see DataStreamSender::SerializeBatch),
+// so --compressible_data toggles between repetitive and random payloads to
+// exercise the compressed and uncompressed paths.
+//
+// Output is total rows/s and bytes/s plus the first sender's and receiver's
+// runtime profiles, whose SerializeBatchTime / ThriftTransmitTime(*) /
+// DeserializeRowBatchTimer counters give the per-stage CPU split. Run with a
+// large --num_batches and several senders to soak flow control
+// (SendersBlockedTimer shows backpressure).
+
+DEFINE_int32(stream_port, 20221, "port for the in-process test backend");
+DEFINE_int32(num_senders, 1, "number of concurrent sender threads");
+DEFINE_int32(num_receivers, 1, "number of receivers (exchange partitions)");
+DEFINE_string(partition_type, "broadcast", "'broadcast' or 'hash'");
+DEFINE_int32(bigint_cols, 8, "number of bigint columns per row");
+DEFINE_int32(string_col_len, 0, "adds a string column of this many bytes; 0 for none");
+DEFINE_int32(num_batches, 1000, "number of row batches each sender transmits");
+DEFINE_int32(rows_per_batch, 1024, "rows per row batch");
+DEFINE_int32(channel_buffer_size, 1024 * 1024, "per-channel send buffer in bytes");
+DEFINE_int32(recvr_buffer_size, 10 * 1024 * 1024, "receiver buffer in bytes");
+DEFINE_bool(compressible_data, false, "if true, fill rows with repetitive values so "
+    "row batch compression stays enabled; random (incompressible) data otherwise");
+
+static const PlanNodeId DEST_NODE_ID = 1;
+
+// Minimal backend: loops TransmitData straight back into the stream mgr, like a
+// remote impalad would.
+class LoopbackBackend : public ImpalaInternalServiceIf {
+ public:
+  LoopbackBackend(DataStreamMgr* stream_mgr) : mgr_(stream_mgr) {}
+  virtual ~LoopbackBackend() {}
+
+  virtual void ExecPlanFragment(
+      TExecPlanFragmentResult& return_val, const TExecPlanFragmentParams& params) {}
+
+  virtual void ReportExecStatus(
+      TReportExecStatusResult& return_val, const TReportExecStatusParams& params) {}
+
+  virtual void CancelPlanFragment(
+      TCancelPlanFragmentResult& return_val, const TCancelPlanFragmentParams& params) {}
+
+  virtual void TransmitData(
+      TTransmitDataResult& return_val, const TTransmitDataParams& params) {
+    if (!params.eos) {
+      mgr_->AddData(params.dest_fragment_instance_id, params.dest_node_id,
+                    params.row_batch, params.sender_id).SetTStatus(&return_val);
+    } else {
+      mgr_->CloseSender(params.dest_fragment_instance_id, params.dest_node_id,
+          params.sender_id).SetTStatus(&return_val);
+    }
+  }
+
+ private:
+  DataStreamMgr* mgr_;
+};
+
+struct ReceiverStats {
+  shared_ptr<DataStreamRecvr> recvr;
+  RuntimeProfile* profile;
+  thread* thread_handle;
+  int64_t rows_received;
+
+  ReceiverStats() : profile(NULL), thread_handle(NULL), rows_received(0) {}
+};
+
+struct SenderStats {
+  thread* thread_handle;
+  Status status;
+  int64_t bytes_sent;
+  string profile_str;
+
+  SenderStats() : thread_handle(NULL), bytes_sent(0) {}
+};
+
+// Creates a row batch of FLAGS_rows_per_batch rows. Bigint slots count up (modulo a
+// small range when the data should compress); the optional string slot points at a
+// buffer of repeated or random bytes.
+static RowBatch* CreateRowBatch(const RowDescriptor& row_desc,
+    const TupleDescriptor* tuple_desc, MemTracker* tracker) {
+  RowBatch* batch = new RowBatch(row_desc, FLAGS_rows_per_batch, tracker);
+  char* string_data = NULL;
+  if (FLAGS_string_col_len > 0) {
+    string_data = reinterpret_cast<char*>(
+        batch->tuple_data_pool()->Allocate(FLAGS_string_col_len));
+    for (int i = 0; i < FLAGS_string_col_len; ++i) {
+      string_data[i] = FLAGS_compressible_data ? 'a' : 'a' + rand() % 26;
+    }
+  }
+  int64_t next_val = 0;
+  for (int i = 0; i < FLAGS_rows_per_batch; ++i) {
+    int idx = batch->AddRow();
+    TupleRow* row = batch->GetRow(idx);
+    Tuple* tuple = Tuple::Create(tuple_desc->byte_size(), batch->tuple_data_pool());
+    for (int j = 0; j < tuple_desc->slots().size(); ++j) {
+      const SlotDescriptor* slot_desc = tuple_desc->slots()[j];
+      void* slot = tuple->GetSlot(slot_desc->tuple_offset());
+      if (slot_desc->type().type == TYPE_STRING) {
+        StringValue* sv = reinterpret_cast<StringValue*>(slot);
+        sv->ptr = string_data;
+        sv->len = FLAGS_string_col_len;
+      } else {
+        *reinterpret_cast<int64_t*>(slot) =
+            FLAGS_compressible_data ? next_val % 10 : rand();
+        ++next_val;
+      }
+    }
+    row->SetTuple(0, tuple);
+    batch->CommitLastRow();
+  }
+  return batch;
+}
+
+static void ReceiverThread(ReceiverStats* stats) {
+  RowBatch* batch;
+  while (stats->recvr->GetBatch(&batch).ok() && batch != NULL) {
+    stats->rows_received += batch->num_rows();
+  }
+}
+
+static void SenderThread(int sender_num, ExecEnv* exec_env, DescriptorTbl* desc_tbl,
+    const RowDescriptor* row_desc, const TupleDescriptor* tuple_desc,
+    const TDataStreamSink* sink, const vector<TPlanFragmentDestination>* dest,
+    SenderStats* stats) {
+  RuntimeState state(TPlanFragmentInstanceCtx(), "", exec_env);
+  state.set_desc_tbl(desc_tbl);
+  state.InitMemTrackers(TUniqueId(), NULL, -1);
+  MemTracker tracker;
+  ObjectPool pool;
+  DataStreamSender sender(
+      &pool, sender_num, *row_desc, *sink, *dest, FLAGS_channel_buffer_size);
+  stats->status = sender.Prepare(&state);
+  if (stats->status.ok()) stats->status = sender.Open(&state);
+  if (stats->status.ok()) {
+    scoped_ptr<RowBatch> batch(CreateRowBatch(*row_desc, tuple_desc, &tracker));
+    for (int i = 0; i < FLAGS_num_batches; ++i) {
+      stats->status = sender.Send(&state, batch.get(), false);
+      if (!stats->status.ok()) break;
+    }
+    batch->Reset();
+  }
+  sender.Close(&state);
+  stats->bytes_sent = sender.GetNumDataBytesSent();
+  stringstream ss;
+  sender.profile()->PrettyPrint(&ss);
+  stats->profile_str = ss.str();
+}
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  CpuInfo::Init();
+  impala::InitThreading();
+
+  if (FLAGS_partition_type != "broadcast" && FLAGS_partition_type != "hash") {
+    cout << "--partition_type must be 'broadcast' or 'hash'" << endl;
+    return 1;
+  }
+
+  ObjectPool obj_pool;
+  MemTracker tracker;
+  ExecEnv exec_env;
+  exec_env.InitForFeTests();
+  RuntimeState runtime_state(TPlanFragmentInstanceCtx(), "", &exec_env);
+  runtime_state.InitMemTrackers(TUniqueId(), NULL, -1);
+
+  // Row descriptor: FLAGS_bigint_cols bigints plus an optional string column.
+  DescriptorTblBuilder builder(&obj_pool);
+  TupleDescBuilder& tuple_builder = builder.DeclareTuple();
+  for (int i = 0; i < FLAGS_bigint_cols; ++i) tuple_builder << TYPE_BIGINT;
+  if (FLAGS_string_col_len > 0) tuple_builder << TYPE_STRING;
+  DescriptorTbl* desc_tbl = builder.Build();
+  runtime_state.set_desc_tbl(desc_tbl);
+  const TupleDescriptor* tuple_desc = desc_tbl->GetTupleDescriptor(0);
+  RowDescriptor row_desc(*desc_tbl, vector<TTupleId>(1, (TTupleId)0),
+      vector<bool>(1, false));
+
+  DataStreamMgr* stream_mgr = exec_env.stream_mgr();
+
+  // Start the loopback backend the sender channels connect to.
+  shared_ptr<LoopbackBackend> handler(new LoopbackBackend(stream_mgr));
+  shared_ptr<TProcessor> processor(new ImpalaInternalServiceProcessor(handler));
+  ThriftServer* server = new ThriftServer(
+      "DataStreamBenchmark backend", processor, FLAGS_stream_port, NULL);
+  Status status = server->Start();
+  if (!status.ok()) {
+    cout << "Could not start backend: " << status.GetDetail() << endl;
+    return 1;
+  }
+
+  // Sink description shared by all senders.
+  TDataStreamSink sink;
+  sink.dest_node_id = DEST_NODE_ID;
+  if (FLAGS_partition_type == "broadcast") {
+    sink.output_partition.type = TPartitionType::UNPARTITIONED;
+  } else {
+    sink.output_partition.type = TPartitionType::HASH_PARTITIONED;
+    // Partition on the first bigint column.
+    TExprNode expr_node;
+    expr_node.node_type = TExprNodeType::SLOT_REF;
+    expr_node.type.types.push_back(TTypeNode());
+    expr_node.type.types.back().__isset.scalar_type = true;
+    expr_node.type.types.back().scalar_type.type = TPrimitiveType::BIGINT;
+    expr_node.num_children = 0;
+    TSlotRef slot_ref;
+    slot_ref.slot_id = tuple_desc->slots()[0]->id();
+    expr_node.__set_slot_ref(slot_ref);
+    TExpr expr;
+    expr.nodes.push_back(expr_node);
+    sink.output_partition.__isset.partition_exprs = true;
+    sink.output_partition.partition_exprs.push_back(expr);
+  }
+
+  // One receiver per partition, each on its own thread.
+  vector<TPlanFragmentDestination> dest;
+  vector<ReceiverStats> receivers(FLAGS_num_receivers);
+  TUniqueId next_instance_id;
+  for (int i = 0; i < FLAGS_num_receivers; ++i) {
+    dest.push_back(TPlanFragmentDestination());
+    dest.back().fragment_instance_id = next_instance_id;
+    dest.back().server.hostname = "127.0.0.1";
+    dest.back().server.port = FLAGS_stream_port;
+    receivers[i].profile =
+        obj_pool.Add(new RuntimeProfile(&obj_pool, "BenchmarkReceiver"));
+    receivers[i].recvr = stream_mgr->CreateRecvr(&runtime_state, row_desc,
+        next_instance_id, DEST_NODE_ID, FLAGS_num_senders, FLAGS_recvr_buffer_size,
+        receivers[i].profile, false);
+    receivers[i].thread_handle = new thread(ReceiverThread, &receivers[i]);
+    ++next_instance_id.lo;
+  }
+
+  srand(1234);
+  vector<SenderStats> senders(FLAGS_num_senders);
+  MonotonicStopWatch total_time;
+  total_time.Start();
+  for (int i = 0; i < FLAGS_num_senders; ++i) {
+    senders[i].thread_handle = new thread(SenderThread, i, &exec_env, desc_tbl,
+        &row_desc, tuple_desc, &sink, &dest, &senders[i]);
+  }
+  for (int i = 0; i < FLAGS_num_senders; ++i) senders[i].thread_handle->join();
+  for (int i = 0; i < FLAGS_num_receivers; ++i) {
+    receivers[i].thread_handle->join();
+    receivers[i].recvr->Close();
+  }
+  total_time.Stop();
+
+  int64_t total_rows = 0;
+  int64_t total_bytes = 0;
+  for (int i = 0; i < FLAGS_num_receivers; ++i) {
+    total_rows += receivers[i].rows_received;
+  }
+  for (int i = 0; i < FLAGS_num_senders; ++i) {
+    if (!senders[i].status.ok()) {
+      cout << "Sender " << i << " failed: " << senders[i].status.GetDetail() << endl;
+    }
+    total_bytes += senders[i].bytes_sent;
+  }
+
+  double secs = total_time.ElapsedTime() / (1000.0 * 1000.0 * 1000.0);
+  cout << endl
+       << "Senders: " << FLAGS_num_senders
+       << "  Receivers: " << FLAGS_num_receivers
+       << "  Partitioning: " << FLAGS_partition_type
+       << "  Row: " << FLAGS_bigint_cols << "x bigint"
+       << (FLAGS_string_col_len > 0
+           ? " + string[" + lexical_cast<string>(FLAGS_string_col_len) + "]" : "")
+       << (FLAGS_compressible_data ? " (compressible)" : " (random)") << endl;
+  cout << "Rows received: " << total_rows << " in " << secs << "s  ("
+       << PrettyPrinter::Print(static_cast<int64_t>(total_rows / secs),
+              TUnit::UNIT_PER_SECOND) << ")" << endl;
+  cout << "Bytes on wire: "
+       << PrettyPrinter::Print(total_bytes, TUnit::BYTES) << "  ("
+       << PrettyPrinter::Print(static_cast<int64_t>(total_bytes / secs),
+              TUnit::BYTES_PER_SECOND) << ")" << endl;
+
+  cout << endl << "Sender 0 profile (SerializeBatchTime / ThriftTransmitTime):" << endl
+       << senders[0].profile_str << endl;
+  cout << "Receiver 0 profile (DeserializeRowBatchTimer / SendersBlockedTimer):" << endl;
+  receivers[0].profile->PrettyPrint(&cout);
+
+  server->StopForTesting();
+  delete server;
+  return 0;
+}
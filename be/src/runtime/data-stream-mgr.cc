@@ -104,6 +104,21 @@ Status DataStreamMgr::AddData(
   return Status::OK;
 }
 
+Status DataStreamMgr::AddLocalData(
+    const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
+    RowBatch* batch, int sender_id) {
+  VLOG_ROW << "AddLocalData(): fragment_instance_id=" << fragment_instance_id
+           << " node=" << dest_node_id
+           << " #rows=" << batch->num_rows();
+  shared_ptr<DataStreamRecvr> recvr =
+      FindRecvr(fragment_instance_id, dest_node_id);
+  // As in AddData(), a NULL recvr is an innocuous race with DeregisterRecvr()
+  // and the batch is simply dropped.
+  if (recvr != NULL) recvr->AddLocalBatch(batch, sender_id);
+  batch->Reset();
+  return Status::OK;
+}
+
 Status DataStreamMgr::CloseSender(const TUniqueId& fragment_instance_id,
     PlanNodeId dest_node_id, int sender_id) {
   VLOG_FILE << "CloseSender(): fragment_instance_id=" << fragment_instance_id
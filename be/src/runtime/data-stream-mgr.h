@@ -81,6 +81,14 @@ class DataStreamMgr {
   Status AddData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
                  const TRowBatch& thrift_batch, int sender_id);
 
+  // Same as AddData(), but for a sender running in this process: hands the rows of
+  // 'batch' directly to the recvr without serializing them to a TRowBatch. The recvr
+  // takes over the batch's tuple data; 'batch' is reset and may be reused by the
+  // caller on return (also if the recvr was cancelled or already torn down).
+  // Blocks like AddData() does if the stream is over its buffering limit.
+  Status AddLocalData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
+                      RowBatch* batch, int sender_id);
+
   // Notifies the recvr associated with the fragment/node id that the specified
   // sender has closed.
   // Returns OK if successful, error status otherwise.
@@ -48,6 +48,12 @@ class DataStreamRecvr::SenderQueue {
   // the queue is considered full and the call blocks until a batch is dequeued.
   void AddBatch(const TRowBatch& batch);
 
+  // Same as AddBatch(), but for a batch produced by a sender running in this process.
+  // Takes over 'batch's tuple data and auxiliary resources instead of
+  // serializing/deserializing them; 'batch' is reset and may be reused by the caller
+  // on return.
+  void AddLocalBatch(RowBatch* batch);
+
   // Decrement the number of remaining senders for this queue and signal eos ("new data")
   // if the count drops to 0. The number of senders will be 1 for a merging
   // DataStreamRecvr.
@@ -64,6 +70,11 @@ class DataStreamRecvr::SenderQueue {
   RowBatch* current_batch() const { return current_batch_.get(); }
 
  private:
+  // Blocks until adding 'batch_size' more bytes would no longer exceed the receiver's
+  // buffer limit (or the queue is empty or the stream is cancelled), maintaining the
+  // buffer-full timers. 'l' must hold lock_.
+  void WaitForBufferSpace(boost::unique_lock<boost::mutex>* l, int batch_size);
+
   // Receiver of which this queue is a member.
   DataStreamRecvr* recvr_;
 
@@ -140,17 +151,11 @@ Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
   return Status::OK;
 }
 
-void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
-  unique_lock<mutex> l(lock_);
-  if (is_cancelled_) return;
-
-  int batch_size = RowBatch::GetBatchSize(thrift_batch);
-  COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
-  DCHECK_GT(num_remaining_senders_, 0);
-
+void DataStreamRecvr::SenderQueue::WaitForBufferSpace(unique_lock<mutex>* l,
+    int batch_size) {
   // if there's something in the queue and this batch will push us over the
   // buffer limit we need to wait until the batch gets drained.
-  // Note: It's important that we enqueue thrift_batch regardless of buffer limit if
+  // Note: It's important that we enqueue the batch regardless of buffer limit if
   // the queue is currently empty. In the case of a merging receiver, batches are
   // received from a specific queue based on data order, and the pipeline will stall
   // if the merger is waiting for data from an empty queue that cannot be filled because
@@ -169,10 +174,10 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
       try_mutex::scoped_try_lock timer_lock(recvr_->buffer_wall_timer_lock_);
       if (timer_lock) {
         SCOPED_TIMER(recvr_->buffer_full_wall_timer_);
-        data_removal__cv_.wait(l);
+        data_removal__cv_.wait(*l);
         got_timer_lock = true;
       } else {
-        data_removal__cv_.wait(l);
+        data_removal__cv_.wait(*l);
         got_timer_lock = false;
       }
     }
@@ -193,6 +198,16 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
     // practice, this time is small relative to the total wait time.
     if (got_timer_lock) data_removal__cv_.notify_one();
   }
+}
+
+void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
+  unique_lock<mutex> l(lock_);
+  if (is_cancelled_) return;
+
+  int batch_size = RowBatch::GetBatchSize(thrift_batch);
+  COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
+  DCHECK_GT(num_remaining_senders_, 0);
+  WaitForBufferSpace(&l, batch_size);
 
   if (!is_cancelled_) {
     RowBatch* batch = NULL;
@@ -201,7 +216,9 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
       // Note: if this function makes a row batch, the batch *must* be added
       // to batch_queue_. It is not valid to create the row batch and destroy
       // it in this thread.
-      batch = new RowBatch(recvr_->row_desc(), thrift_batch, recvr_->mem_tracker());
+      batch = new RowBatch(recvr_->row_desc(), thrift_batch, recvr_->mem_tracker(),
+          reinterpret_cast<RowBatch::DeserializeFixupFn>(
+              recvr_->deserialize_fixup_fn_));
     }
     VLOG_ROW << "added #rows=" << batch->num_rows()
              << " batch_size=" << batch_size << "\n";
@@ -211,6 +228,38 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
   }
 }
 
+void DataStreamRecvr::SenderQueue::AddLocalBatch(RowBatch* src) {
+  unique_lock<mutex> l(lock_);
+  if (is_cancelled_) return;
+
+  int batch_size = src->TotalByteSize();
+  COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
+  DCHECK_GT(num_remaining_senders_, 0);
+  WaitForBufferSpace(&l, batch_size);
+
+  if (!is_cancelled_) {
+    // Copy the tuple pointers and take over the tuple data instead of going through
+    // serialization. The queue-owned batch is constructed with the receiver's row
+    // descriptor; the sender's descriptor describes the same layout but belongs to a
+    // different fragment, so AcquireState()'s descriptor check cannot be used here.
+    RowBatch* batch =
+        new RowBatch(recvr_->row_desc(), src->capacity(), recvr_->mem_tracker());
+    int num_rows = src->num_rows();
+    int first_row = batch->AddRows(num_rows);
+    DCHECK_NE(first_row, RowBatch::INVALID_ROW_INDEX);
+    batch->CommitRows(num_rows);
+    for (int i = 0; i < num_rows; ++i) {
+      batch->CopyRow(src->GetRow(i), batch->GetRow(first_row + i));
+    }
+    src->TransferResourceOwnership(batch);
+    VLOG_ROW << "added local #rows=" << batch->num_rows()
+             << " batch_size=" << batch_size << "\n";
+    batch_queue_.push_back(make_pair(batch_size, batch));
+    recvr_->num_buffered_bytes_ += batch_size;
+    data_arrival_cv_.notify_one();
+  }
+}
+
 void DataStreamRecvr::SenderQueue::DecrementSenders() {
   lock_guard<mutex> l(lock_);
   DCHECK_GT(num_remaining_senders_, 0);
@@ -284,6 +333,7 @@ DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_t
     row_desc_(row_desc),
     is_merging_(is_merging),
     num_buffered_bytes_(0),
+    deserialize_fixup_fn_(NULL),
     profile_(profile) {
   mem_tracker_.reset(new MemTracker(-1, -1, "DataStreamRecvr", parent_tracker));
   // Create one queue per sender if is_merging is true.
@@ -320,6 +370,11 @@ void DataStreamRecvr::AddBatch(const TRowBatch& thrift_batch, int sender_id) {
   sender_queues_[use_sender_id]->AddBatch(thrift_batch);
 }
 
+void DataStreamRecvr::AddLocalBatch(RowBatch* batch, int sender_id) {
+  int use_sender_id = is_merging_ ? sender_id : 0;
+  sender_queues_[use_sender_id]->AddLocalBatch(batch);
+}
+
 void DataStreamRecvr::RemoveSender(int sender_id) {
   int use_sender_id = is_merging_ ? sender_id : 0;
   sender_queues_[use_sender_id]->DecrementSenders();
@@ -90,6 +90,13 @@ class DataStreamRecvr {
   const RowDescriptor& row_desc() const { return row_desc_; }
   MemTracker* mem_tracker() const { return mem_tracker_.get(); }
 
+  // Location where the exchange node registers the codegen'd deserialization fix-up
+  // function for this receiver's row layout (with LlvmCodeGen::AddFunctionToJit(), see
+  // RowBatch::CodegenDeserializeFixup()). The pointer is filled in when the fragment's
+  // module is jitted and stays NULL until then (and permanently if codegen is
+  // disabled), in which case deserialization takes the interpreted path.
+  void** codegend_deserialize_fixup_fn() { return &deserialize_fixup_fn_; }
+
  private:
   friend class DataStreamMgr;
   class SenderQueue;
@@ -103,6 +110,13 @@ class DataStreamRecvr {
   // full. Called from DataStreamMgr.
   void AddBatch(const TRowBatch& thrift_batch, int sender_id);
 
+  // Add a batch of rows produced by a sender in the same process to the appropriate
+  // sender queue, blocking if the queue is full. The queue takes over the batch's
+  // tuple data and auxiliary resources without a serialize/deserialize round trip;
+  // 'batch' is reset and may be reused by the caller on return. Called from
+  // DataStreamMgr::AddLocalData().
+  void AddLocalBatch(RowBatch* batch, int sender_id);
+
   // Indicate that a particular sender is done. Delegated to the appropriate
   // sender queue. Called from DataStreamMgr.
   void RemoveSender(int sender_id);
@@ -153,6 +167,11 @@ class DataStreamRecvr {
   // Pool of sender queues.
   ObjectPool sender_queue_pool_;
 
+  // Codegen'd deserialization fix-up function, or NULL to use the interpreted path.
+  // See codegend_deserialize_fixup_fn(). Written by the fragment's jit compilation
+  // (possibly on another thread) and read by AddBatch().
+  void* deserialize_fixup_fn_;
+
   // Runtime profile storing the counters below.
   RuntimeProfile* profile_;
 
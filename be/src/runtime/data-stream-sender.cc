@@ -15,13 +15,16 @@
 #include "runtime/data-stream-sender.h"
 
 #include <iostream>
+#include <limits>
 #include <boost/shared_ptr.hpp>
 #include <thrift/protocol/TDebugProtocol.h>
 
 #include "common/logging.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "runtime/data-stream-mgr.h"
 #include "runtime/descriptors.h"
+#include "runtime/exec-env.h"
 #include "runtime/tuple-row.h"
 #include "runtime/row-batch.h"
 #include "runtime/raw-value.h"
@@ -43,15 +46,45 @@ using namespace apache::thrift;
 using namespace apache::thrift::protocol;
 using namespace apache::thrift::transport;
 
+DEFINE_int32(datastream_sender_queue_depth, 4, "(Advanced) Maximum number of "
+    "serialized row batches buffered or in flight per data stream sender channel. "
+    "The fragment thread only blocks once all of a channel's buffers are in use, so "
+    "deeper queues hide transient receiver slowness at a memory cost of one "
+    "serialized batch per entry.");
+
 namespace impala {
 
+// Number of serialized batches whose compression ratio is sampled before deciding
+// whether to keep compressing, and the minimum fraction of tuple data bytes that
+// compression must have saved over those batches to stay enabled.
+const int COMPRESSION_SAMPLE_BATCHES = 8;
+const double COMPRESSION_MIN_SAVINGS = 0.1;
+
+// Minimum number of hash-partitioned rows before the row distribution across channels
+// is checked for skew, and the max-to-average ratio beyond which it is reported.
+const int64_t SKEW_WARNING_MIN_ROWS = 100 * 1024;
+const double SKEW_WARNING_RATIO = 4.0;
+
 // A channel sends data asynchronously via calls to TransmitData
 // to a single destination ipaddress/node.
 // It has a fixed-capacity buffer and allows the caller either to add rows to
 // that buffer individually (AddRow()), or circumvent the buffer altogether and send
-// TRowBatches directly (SendBatch()). Either way, there can only be one in-flight RPC
-// at any one time (ie, sending will block if the most recent rpc hasn't finished,
-// which allows the receiver node to throttle the sender by withholding acks).
+// TRowBatches directly (SendBatch()).
+// Rows added via AddRow() are serialized into a bounded pool of channel-owned
+// buffers (--datastream_sender_queue_depth) and queued on the rpc thread, so the
+// fragment thread only blocks once every buffer of the channel is queued or in
+// flight and a slow receiver does not stall the sender after a single batch.
+// Batches sent directly via SendBatch() are owned by the caller and at most one may
+// be pending at a time. In both cases the receiver node can throttle the sender by
+// withholding acks.
+// If the destination fragment runs in this impalad, rows added via AddRow() bypass
+// serialization entirely: the accumulated batch is handed to the receiver's queue
+// through DataStreamMgr::AddLocalData(), which takes over its tuple data.
+// TODO: also bypass serialization for local channels of a broadcast sender; that
+// needs a copy of the shared batch since the receiver consumes its tuple data.
+// TODO: coalesce queued small batches when the queue backs up. Explicit credit-based
+// flow control against DataStreamRecvr's buffer limit needs the ack to carry a
+// credit grant, i.e. a protocol change.
 // *Not* thread-safe.
 class DataStreamSender::Channel {
  public:
@@ -70,9 +103,13 @@ class DataStreamSender::Channel {
       fragment_instance_id_(fragment_instance_id),
       dest_node_id_(dest_node_id),
       num_data_bytes_sent_(0),
-      rpc_thread_("DataStreamSender", "SenderThread", 1, 1,
+      num_rows_sent_(0),
+      rpc_thread_("DataStreamSender", "SenderThread", 1,
+          FLAGS_datastream_sender_queue_depth,
           bind<void>(mem_fn(&Channel::TransmitData), this, _1, _2)),
-      rpc_in_flight_(false) {
+      num_pending_rpcs_(0),
+      is_local_(false),
+      local_stream_mgr_(NULL) {
   }
 
   // Initialize channel.
@@ -84,16 +121,23 @@ class DataStreamSender::Channel {
   // Returns error status if any of the preceding rpcs failed, OK otherwise.
   Status AddRow(TupleRow* row);
 
-  // Asynchronously sends a row batch.
+  // Asynchronously sends a row batch owned by the caller. Waits for all previously
+  // queued rpcs to finish first, so the caller may reuse 'batch' once one further
+  // batch has been passed in.
   // Returns the status of the most recently finished TransmitData
   // rpc (or OK if there wasn't one that hasn't been reported yet).
   Status SendBatch(TRowBatch* batch);
 
+  // Serializes 'batch' into a channel-owned buffer and queues it for transmission,
+  // blocking only while all owned buffers are queued or in flight.
+  // Returns the status of the most recently finished TransmitData rpc.
+  Status SerializeAndSendBatch(RowBatch* batch);
+
   // Return status of last TransmitData rpc (initiated by the most recent call
   // to either SendBatch() or SendCurrentBatch()).
   Status GetSendStatus();
 
-  // Waits for the rpc thread pool to finish the current rpc.
+  // Waits for the rpc thread pool to finish all queued and in-flight rpcs.
   void WaitForRpc();
 
   // Flush buffered rows and close channel.
@@ -101,7 +145,7 @@ class DataStreamSender::Channel {
   void Close(RuntimeState* state);
 
   int64_t num_data_bytes_sent() const { return num_data_bytes_sent_; }
-  TRowBatch* thrift_batch() { return &thrift_batch_; }
+  int64_t num_rows_sent() const { return num_rows_sent_; }
 
  private:
   DataStreamSender* parent_;
@@ -117,9 +161,21 @@ class DataStreamSender::Channel {
   // the number of TRowBatch.data bytes sent successfully
   int64_t num_data_bytes_sent_;
 
+  // the number of rows copied into this channel via AddRow(). Batches passed in
+  // whole via SendBatch()/SerializeAndSendBatch() are not counted; only
+  // hash-partitioned senders, which route row by row, use this to detect
+  // partition skew.
+  int64_t num_rows_sent_;
+
   // we're accumulating rows into this batch
   scoped_ptr<RowBatch> batch_;
-  TRowBatch thrift_batch_;
+
+  // Pool of serialized batch buffers owned by this channel and used by
+  // SerializeAndSendBatch(). A buffer cycles from free_batches_ through the
+  // rpc_thread_ queue and back to free_batches_ once its rpc finishes. Allocated
+  // from the parent's object pool in Init().
+  std::vector<TRowBatch*> owned_batches_;
+  std::vector<TRowBatch*> free_batches_; // guarded by rpc_thread_lock_
 
   // We want to reuse the rpc thread to prevent creating a thread per rowbatch.
   // TODO: currently we only have one batch in flight, but we should buffer more
@@ -128,16 +184,36 @@ class DataStreamSender::Channel {
   // TODO: if the order of row batches does not matter, we can consider increasing
   // the number of threads.
   ThreadPool<TRowBatch*> rpc_thread_; // sender thread.
-  condition_variable rpc_done_cv_;   // signaled when rpc_in_flight_ is set to true.
-  mutex rpc_thread_lock_; // Lock with rpc_done_cv_ protecting rpc_in_flight_
-  bool rpc_in_flight_;  // true if the rpc_thread_ is busy sending.
+  condition_variable rpc_done_cv_;   // signaled when an rpc finishes.
+  mutex rpc_thread_lock_; // Lock with rpc_done_cv_ protecting num_pending_rpcs_
+  int num_pending_rpcs_;  // number of rpcs queued on rpc_thread_ or executing.
 
   Status rpc_status_;  // status of most recently finished TransmitData rpc
 
-  // Serialize batch_ into thrift_batch_ and send via SendBatch().
-  // Returns SendBatch() status.
+  // True if the destination fragment instance runs in this impalad, in which case
+  // rows accumulated via AddRow() are handed to the receiver through
+  // local_stream_mgr_ instead of being serialized and sent via TransmitData.
+  bool is_local_;
+  DataStreamMgr* local_stream_mgr_;  // this process' DataStreamMgr; set in Init()
+
+  // Serialize batch_ into a channel-owned buffer and queue it for transmission via
+  // SerializeAndSendBatch(), then reset batch_. Hands batch_ to the local receiver
+  // via SendLocalBatch() instead if the destination is in this process.
   Status SendCurrentBatch();
 
+  // Passes batch_'s rows straight to the local receiver's queue without serializing
+  // them, blocking if the receiver is over its buffer limit, then resets batch_.
+  Status SendLocalBatch();
+
+  // Returns true if 'batch' is one of the channel-owned serialized buffers (as
+  // opposed to a caller-owned batch passed to SendBatch()).
+  bool IsOwnedBatch(const TRowBatch* batch) const {
+    for (int i = 0; i < owned_batches_.size(); ++i) {
+      if (owned_batches_[i] == batch) return true;
+    }
+    return false;
+  }
+
   // Synchronously call TransmitData() on a client from client_cache_ and update
   // rpc_status_ based on return value (or set to error if RPC failed).
   // Called from a thread from the rpc_thread_ pool.
@@ -149,35 +225,73 @@ class DataStreamSender::Channel {
 
 Status DataStreamSender::Channel::Init(RuntimeState* state) {
   client_cache_ = state->impalad_client_cache();
+  is_local_ = address_ == state->exec_env()->backend_address();
+  local_stream_mgr_ = state->stream_mgr();
+  if (is_local_) {
+    VLOG_RPC << "local channel: instance_id=" << fragment_instance_id_
+             << " dest_node=" << dest_node_id_;
+  }
   // TODO: figure out how to size batch_
   int capacity = max(1, buffer_size_ / max(row_desc_.GetRowSize(), 1));
   batch_.reset(new RowBatch(row_desc_, capacity, parent_->mem_tracker_.get()));
+  DCHECK_GT(FLAGS_datastream_sender_queue_depth, 0);
+  for (int i = 0; i < FLAGS_datastream_sender_queue_depth; ++i) {
+    owned_batches_.push_back(parent_->pool_->Add(new TRowBatch()));
+  }
+  free_batches_ = owned_batches_;
   return Status::OK;
 }
 
 Status DataStreamSender::Channel::SendBatch(TRowBatch* batch) {
   VLOG_ROW << "Channel::SendBatch() instance_id=" << fragment_instance_id_
            << " dest_node=" << dest_node_id_ << " #rows=" << batch->num_rows;
-  // return if the previous batch saw an error
+  // Wait for all queued rpcs (the caller may reuse earlier batches once this one is
+  // queued) and return if any of them saw an error.
   RETURN_IF_ERROR(GetSendStatus());
   {
     unique_lock<mutex> l(rpc_thread_lock_);
-    rpc_in_flight_ = true;
+    ++num_pending_rpcs_;
   }
   if (!rpc_thread_.Offer(batch)) {
     unique_lock<mutex> l(rpc_thread_lock_);
-    rpc_in_flight_ = false;
+    --num_pending_rpcs_;
+  }
+  return Status::OK;
+}
+
+Status DataStreamSender::Channel::SerializeAndSendBatch(RowBatch* batch) {
+  TRowBatch* thrift_batch = NULL;
+  {
+    SCOPED_TIMER(parent_->state_->total_network_send_timer());
+    unique_lock<mutex> l(rpc_thread_lock_);
+    while (free_batches_.empty()) rpc_done_cv_.wait(l);
+    if (!rpc_status_.ok()) {
+      LOG(ERROR) << "channel send status: " << rpc_status_.GetDetail();
+      return rpc_status_;
+    }
+    thrift_batch = free_batches_.back();
+    free_batches_.pop_back();
+    ++num_pending_rpcs_;
+  }
+  parent_->SerializeBatch(batch, thrift_batch);
+  if (!rpc_thread_.Offer(thrift_batch)) {
+    unique_lock<mutex> l(rpc_thread_lock_);
+    free_batches_.push_back(thrift_batch);
+    --num_pending_rpcs_;
   }
   return Status::OK;
 }
 
 void DataStreamSender::Channel::TransmitData(int thread_id, const TRowBatch* batch) {
-  DCHECK(rpc_in_flight_);
+  DCHECK_GT(num_pending_rpcs_, 0);
   TransmitDataHelper(batch);
 
   {
     unique_lock<mutex> l(rpc_thread_lock_);
-    rpc_in_flight_ = false;
+    // Return channel-owned buffers to the pool; caller-owned batches (SendBatch())
+    // stay with the caller.
+    if (IsOwnedBatch(batch)) free_batches_.push_back(const_cast<TRowBatch*>(batch));
+    --num_pending_rpcs_;
   }
   rpc_done_cv_.notify_one();
 }
@@ -232,7 +346,7 @@ void DataStreamSender::Channel::TransmitDataHelper(const TRowBatch* batch) {
 void DataStreamSender::Channel::WaitForRpc() {
   SCOPED_TIMER(parent_->state_->total_network_send_timer());
   unique_lock<mutex> l(rpc_thread_lock_);
-  while (rpc_in_flight_) {
+  while (num_pending_rpcs_ > 0) {
     rpc_done_cv_.wait(l);
   }
 }
@@ -240,8 +354,8 @@ void DataStreamSender::Channel::WaitForRpc() {
 Status DataStreamSender::Channel::AddRow(TupleRow* row) {
   int row_num = batch_->AddRow();
   if (row_num == RowBatch::INVALID_ROW_INDEX) {
-    // batch_ is full, let's send it; but first wait for an ongoing
-    // transmission to finish before modifying thrift_batch_
+    // batch_ is full, let's send it. This only blocks while all of the channel's
+    // serialized buffers are queued or in flight.
     RETURN_IF_ERROR(SendCurrentBatch());
     row_num = batch_->AddRow();
     DCHECK_NE(row_num, RowBatch::INVALID_ROW_INDEX);
@@ -259,16 +373,32 @@ Status DataStreamSender::Channel::AddRow(TupleRow* row) {
     }
   }
   batch_->CommitLastRow();
+  ++num_rows_sent_;
   return Status::OK;
 }
 
 Status DataStreamSender::Channel::SendCurrentBatch() {
-  // make sure there's no in-flight TransmitData() call that might still want to
-  // access thrift_batch_
-  WaitForRpc();
-  parent_->SerializeBatch(batch_.get(), &thrift_batch_);
+  if (is_local_) return SendLocalBatch();
+  // SerializeAndSendBatch() copies batch_ into an owned serialized buffer, so batch_
+  // can be reused as soon as it returns.
+  RETURN_IF_ERROR(SerializeAndSendBatch(batch_.get()));
   batch_->Reset();
-  RETURN_IF_ERROR(SendBatch(&thrift_batch_));
+  return Status::OK;
+}
+
+Status DataStreamSender::Channel::SendLocalBatch() {
+  VLOG_ROW << "Channel::SendLocalBatch() instance_id=" << fragment_instance_id_
+           << " dest_node=" << dest_node_id_ << " #rows=" << batch_->num_rows();
+  int64_t batch_size = batch_->TotalByteSize();
+  {
+    // Blocking on a full receiver buffer takes the place of a slow TransmitData rpc,
+    // so count it against the same timer as the remote path.
+    SCOPED_TIMER(parent_->state_->total_network_send_timer());
+    RETURN_IF_ERROR(local_stream_mgr_->AddLocalData(
+        fragment_instance_id_, dest_node_id_, batch_.get(), parent_->sender_id_));
+  }
+  num_data_bytes_sent_ += batch_size;
+  VLOG_ROW << "incremented #data_bytes_sent=" << num_data_bytes_sent_;
   return Status::OK;
 }
 
@@ -291,6 +421,12 @@ Status DataStreamSender::Channel::CloseInternal() {
   }
   // if the last transmitted batch resulted in a error, return that error
   RETURN_IF_ERROR(GetSendStatus());
+  if (is_local_) {
+    // Signal eos directly instead of looping an empty TransmitData rpc back to
+    // this process.
+    return local_stream_mgr_->CloseSender(
+        fragment_instance_id_, dest_node_id_, parent_->sender_id_);
+  }
   Status status;
   ImpalaInternalServiceConnection client(client_cache_, address_, &status);
   if (!status.ok()) {
@@ -341,10 +477,16 @@ DataStreamSender::DataStreamSender(ObjectPool* pool, int sender_id,
     current_channel_idx_(0),
     closed_(false),
     current_thrift_batch_(&thrift_batch1_),
+    compress_batches_(true),
+    num_compression_samples_(0),
+    sampled_uncompressed_bytes_(0),
+    sampled_compressed_bytes_(0),
     profile_(NULL),
     serialize_batch_timer_(NULL),
     thrift_transmit_timer_(NULL),
     bytes_sent_counter_(NULL),
+    max_rows_sent_counter_(NULL),
+    min_rows_sent_counter_(NULL),
     dest_node_id_(sink.dest_node_id) {
   DCHECK_GT(destinations.size(), 0);
   DCHECK(sink.output_partition.type == TPartitionType::UNPARTITIONED
@@ -411,6 +553,12 @@ Status DataStreamSender::Prepare(RuntimeState* state) {
       profile()->AddDerivedCounter("OverallThroughput", TUnit::BYTES_PER_SECOND,
            bind<int64_t>(&RuntimeProfile::UnitsPerSecond, bytes_sent_counter_,
                          profile()->total_time_counter()));
+  if (!broadcast_ && !random_ && channels_.size() > 1) {
+    max_rows_sent_counter_ =
+        ADD_COUNTER(profile(), "MaxRowsSentPerChannel", TUnit::UNIT);
+    min_rows_sent_counter_ =
+        ADD_COUNTER(profile(), "MinRowsSentPerChannel", TUnit::UNIT);
+  }
 
   for (int i = 0; i < channels_.size(); ++i) {
     RETURN_IF_ERROR(channels_[i]->Init(state));
@@ -441,12 +589,10 @@ Status DataStreamSender::Send(RuntimeState* state, RowBatch* batch, bool eos) {
     current_thrift_batch_ =
         (current_thrift_batch_ == &thrift_batch1_ ? &thrift_batch2_ : &thrift_batch1_);
   } else if (random_) {
-    // Round-robin batches among channels. Wait for the current channel to finish its
-    // rpc before overwriting its batch.
+    // Round-robin batches among channels. The channel serializes into one of its
+    // owned buffers and only blocks while all of them are in flight.
     Channel* current_channel = channels_[current_channel_idx_];
-    current_channel->WaitForRpc();
-    SerializeBatch(batch, current_channel->thrift_batch());
-    current_channel->SendBatch(current_channel->thrift_batch());
+    RETURN_IF_ERROR(current_channel->SerializeAndSendBatch(batch));
     current_channel_idx_ = (current_channel_idx_ + 1) % channels_.size();
   } else {
     // hash-partition batch's rows across channels
@@ -473,6 +619,30 @@ Status DataStreamSender::Send(RuntimeState* state, RowBatch* batch, bool eos) {
 
 void DataStreamSender::Close(RuntimeState* state) {
   if (closed_) return;
+  if (max_rows_sent_counter_ != NULL) {
+    // Report the row distribution across channels so partition skew is visible in
+    // the profile rather than just as a slow receiving fragment.
+    int64_t total_rows = 0;
+    int64_t max_rows = 0;
+    int64_t min_rows = numeric_limits<int64_t>::max();
+    for (int i = 0; i < channels_.size(); ++i) {
+      int64_t rows = channels_[i]->num_rows_sent();
+      total_rows += rows;
+      max_rows = max(max_rows, rows);
+      min_rows = min(min_rows, rows);
+    }
+    COUNTER_SET(max_rows_sent_counter_, max_rows);
+    COUNTER_SET(min_rows_sent_counter_, min_rows);
+    int64_t avg_rows = total_rows / channels_.size();
+    if (total_rows >= SKEW_WARNING_MIN_ROWS && max_rows > SKEW_WARNING_RATIO * avg_rows) {
+      stringstream ss;
+      ss << "max rows sent to one channel: " << max_rows << ", avg: " << avg_rows
+         << ", min: " << min_rows << " (" << channels_.size() << " channels)";
+      LOG(WARNING) << "Skewed row distribution in data stream sender, dest_node="
+                   << dest_node_id_ << ": " << ss.str();
+      profile_->AddInfoString("RowsSentSkew", ss.str());
+    }
+  }
   for (int i = 0; i < channels_.size(); ++i) {
     channels_[i]->Close(state);
   }
@@ -484,7 +654,21 @@ void DataStreamSender::SerializeBatch(RowBatch* src, TRowBatch* dest, int num_re
   VLOG_ROW << "serializing " << src->num_rows() << " rows";
   {
     SCOPED_TIMER(serialize_batch_timer_);
-    int uncompressed_bytes = src->Serialize(dest);
+    int uncompressed_bytes = src->Serialize(dest, compress_batches_);
+    if (compress_batches_ && num_compression_samples_ < COMPRESSION_SAMPLE_BATCHES) {
+      ++num_compression_samples_;
+      sampled_uncompressed_bytes_ += dest->uncompressed_size;
+      sampled_compressed_bytes_ += dest->tuple_data.size();
+      if (num_compression_samples_ == COMPRESSION_SAMPLE_BATCHES &&
+          sampled_compressed_bytes_ >
+              sampled_uncompressed_bytes_ * (1.0 - COMPRESSION_MIN_SAVINGS)) {
+        compress_batches_ = false;
+        VLOG_RPC << "disabling row batch compression for dest_node="
+                 << dest_node_id_ << ": " << sampled_compressed_bytes_ << "/"
+                 << sampled_uncompressed_bytes_
+                 << " compressed/uncompressed bytes sampled";
+      }
+    }
     COUNTER_ADD(bytes_sent_counter_, RowBatch::GetBatchSize(*dest) * num_receivers);
     COUNTER_ADD(uncompressed_bytes_counter_, uncompressed_bytes * num_receivers);
   }
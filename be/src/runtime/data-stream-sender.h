@@ -41,8 +41,22 @@ class TPlanFragmentDestination;
 // partitioning specification.
 // *Not* thread-safe.
 //
-// TODO: capture stats that describe distribution of rows/data volume
-// across channels.
+// Hash-partitioned senders track how many rows each channel received and report the
+// distribution (and a warning) in the runtime profile when one channel got a
+// disproportionate share, so single-key skew shows up in the profile instead of just
+// as a slow fragment.
+// TODO: act on detected skew: splitting a hot partition's rows over multiple
+// receivers is only correct if the planner marks the exchange as splittable (the
+// node above the receiving exchange must merge rows of the same key, e.g. a merge
+// aggregation), so this needs a plan-level flag and a row-level redistribution rule
+// in Send().
+// TODO: high-fanout shuffles make one tiny TransmitData RPC per channel even when
+// many channels target fragment instances on the same impalad. Batching those into a
+// single multiplexed RPC per destination daemon would amortize the thrift envelope
+// and syscall cost and bound concurrent connections per host at one. Requires
+// TTransmitDataParams to carry a list of (dest_fragment_instance_id, dest_node_id,
+// row_batch) entries and the receiving service to dispatch them; connections
+// themselves are already pooled per address by ClientCache.
 class DataStreamSender : public DataSink {
  public:
   // Construct a sender according to the output specification (sink),
@@ -110,6 +124,21 @@ class DataStreamSender : public DataSink {
   TRowBatch thrift_batch2_;
   TRowBatch* current_thrift_batch_;  // the next one to fill in Send()
 
+  // Adaptive row batch compression: the compression ratio of the first few serialized
+  // batches is sampled and, if compression does not save enough tuple data bytes,
+  // compression is disabled for the remainder of the stream (it only burns CPU on an
+  // exchange that is evidently not network-bound). Sampling is per sender rather than
+  // per channel because broadcast and round-robin senders reuse one serialized batch
+  // for all channels.
+  // True while batches are still being compressed.
+  bool compress_batches_;
+
+  // Number of batches sampled so far, and the sampled tuple data byte totals before
+  // and after compression. Only updated while sampling is in progress.
+  int num_compression_samples_;
+  int64_t sampled_uncompressed_bytes_;
+  int64_t sampled_compressed_bytes_;
+
   std::vector<ExprContext*> partition_expr_ctxs_;  // compute per-row partition values
   std::vector<Channel*> channels_;
 
@@ -126,6 +155,12 @@ class DataStreamSender : public DataSink {
   // Throughput per total time spent in sender
   RuntimeProfile::Counter* overall_throughput_;
 
+  // Most/fewest rows sent to any one channel. Only set in Close(), and only for
+  // hash-partitioned senders with more than one channel; used to surface partition
+  // skew in the profile.
+  RuntimeProfile::Counter* max_rows_sent_counter_;
+  RuntimeProfile::Counter* min_rows_sent_counter_;
+
   // Identifier of the destination plan node.
   PlanNodeId dest_node_id_;
 };
@@ -651,6 +651,19 @@ TEST(DecimalArithmetic, DivideLargeScales) {
   VerifyToString(r, t3, "-31939128.06356147605500000000000000000");
   EXPECT_FALSE(is_nan);
   EXPECT_FALSE(is_overflow);
+
+  // A high-scale divisor scales the dividend by 10^48 (result_scale + other_scale -
+  // this_scale = 38 + 10 - 0), past the largest power of 10 that fits in int128_t,
+  // so the multiplier must be widened to int256.
+  ColumnType t4 = ColumnType::CreateDecimalType(38, 0);
+  ColumnType t5 = ColumnType::CreateDecimalType(38, 10);
+  ColumnType t6 = ColumnType::CreateDecimalType(38, 38);
+  x = Decimal16Value(2);
+  y = Decimal16Value(50000000000LL);  // 5.0 at scale 10.
+  r = x.Divide<int128_t>(t4, y, t5, t6.scale, &is_nan, &is_overflow);
+  VerifyToString(r, t6, "0.40000000000000000000000000000000000000");
+  EXPECT_FALSE(is_nan);
+  EXPECT_FALSE(is_overflow);
 }
 
 template<typename T>
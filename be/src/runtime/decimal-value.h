@@ -28,6 +28,23 @@
 
 namespace impala {
 
+// Reads the precomputed int128_t table and widens the entry, avoiding a chain of
+// int256 multiplications per call. Lives here rather than decimal-util.h because
+// int256_t has no conversion from int128_t outside ConvertToInt256().
+template<>
+inline int256_t DecimalUtil::GetScaleMultiplier<int256_t>(int scale) {
+  DCHECK_GE(scale, 0);
+  if (UNLIKELY(scale >= NUM_SCALE_MULTIPLIERS)) {
+    // Divide() scales the dividend by up to result_scale + other_scale, which can
+    // reach 2 * 38. Powers of 10 past 10^38 don't fit in the int128_t table, so widen
+    // the largest entry and multiply out the remainder.
+    int256_t result = ConvertToInt256(SCALE_MULTIPLIERS[NUM_SCALE_MULTIPLIERS - 1]);
+    for (int i = NUM_SCALE_MULTIPLIERS - 1; i < scale; ++i) result *= 10;
+    return result;
+  }
+  return ConvertToInt256(SCALE_MULTIPLIERS[scale]);
+}
+
 // Implementation of decimal types. The type is parametrized on the underlying
 // storage type, which must implement all operators (example of a storage type
 // is int32_t). The decimal does not store its precision and scale since we'd
@@ -413,9 +430,8 @@ inline int Decimal4Value::Compare(const ColumnType& this_type,
   int64_t x, y;
   bool overflow = AdjustToSameScale(*this, this_type, other, other_type, &x, &y);
   DCHECK(!overflow) << "Overflow cannot happen with Decimal4Value";
-  if (x == y) return 0;
-  if (x < y) return -1;
-  return 1;
+  // Branch-free sign of (x - y).
+  return (x > y) - (x < y);
 }
 template <>
 inline int Decimal8Value::Compare(const ColumnType& this_type,
@@ -423,9 +439,8 @@ inline int Decimal8Value::Compare(const ColumnType& this_type,
   int128_t x = 0, y = 0;
   bool overflow = AdjustToSameScale(*this, this_type, other, other_type, &x, &y);
   DCHECK(!overflow) << "Overflow cannot happen with Decimal8Value";
-  if (x == y) return 0;
-  if (x < y) return -1;
-  return 1;
+  // Branch-free sign of (x - y).
+  return (x > y) - (x < y);
 }
 template <>
 inline int Decimal16Value::Compare(const ColumnType& this_type,
@@ -438,9 +453,8 @@ inline int Decimal16Value::Compare(const ColumnType& this_type,
   } else if (delta_scale < 0) {
     x = DecimalUtil::MultiplyByScale<int256_t>(x, -delta_scale);
   }
-  if (x == y) return 0;
-  if (x < y) return -1;
-  return 1;
+  // Branch-free sign of (x - y).
+  return (x > y) - (x < y);
 }
 
 // Returns as string with full 0 padding on the right and single 0 padded on the left
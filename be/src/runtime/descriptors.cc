@@ -15,7 +15,11 @@
 #include "runtime/descriptors.h"
 
 #include <boost/algorithm/string/join.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
 #include <ios>
+#include <map>
 #include <sstream>
 
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
@@ -26,12 +30,17 @@
 #include "gen-cpp/Descriptors_types.h"
 #include "gen-cpp/PlanNodes_types.h"
 #include "exprs/expr.h"
+#include "rpc/thrift-util.h"
 #include "runtime/runtime-state.h"
 
 using namespace llvm;
 using namespace std;
 using namespace boost::algorithm;
 
+DEFINE_int32(max_cached_descriptor_tbls, 0, "(Advanced) Maximum number of distinct "
+    "descriptor tables shared across plan fragments process-wide (see "
+    "DescriptorTbl::CreateShared()). 0 disables sharing.");
+
 namespace impala {
 
 string NullIndicatorOffset::DebugString() const {
@@ -262,6 +271,39 @@ string TupleDescriptor::DebugString() const {
   return out.str();
 }
 
+// Tuple layout diagnostics assume 64 byte cache lines, which all platforms we
+// support use.
+static const int CACHE_LINE_SIZE = 64;
+
+int TupleDescriptor::NumCacheLines() const {
+  return (byte_size_ + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+}
+
+string TupleDescriptor::LayoutDiagnostic(const vector<SlotId>& hot_slot_ids) const {
+  stringstream out;
+  out << "Tuple " << id_ << " layout: " << byte_size_ << " bytes over "
+      << NumCacheLines() << " cache line(s)";
+  int num_hot_past_first = 0;
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    const SlotDescriptor* slot = slots_[i];
+    if (!slot->is_materialized()) continue;
+    if (find(hot_slot_ids.begin(), hot_slot_ids.end(), slot->id()) ==
+        hot_slot_ids.end()) {
+      continue;
+    }
+    int first_line = slot->tuple_offset() / CACHE_LINE_SIZE;
+    int last_line = (slot->tuple_offset() + slot->slot_size() - 1) / CACHE_LINE_SIZE;
+    out << "\n  hot slot " << slot->id() << " at offset " << slot->tuple_offset()
+        << ": cache line(s) " << first_line << "-" << last_line;
+    if (last_line > 0) ++num_hot_past_first;
+  }
+  if (num_hot_past_first > 0) {
+    out << "\n  " << num_hot_past_first << " hot slot(s) fall outside the first cache "
+        << "line; evaluating them touches extra lines per row.";
+  }
+  return out.str();
+}
+
 RowDescriptor::RowDescriptor(const DescriptorTbl& desc_tbl,
                              const vector<TTupleId>& row_tuples,
                              const vector<bool>& nullable_tuples)
@@ -423,6 +465,70 @@ Status DescriptorTbl::Create(ObjectPool* pool, const TDescriptorTable& thrift_tb
   return Status::OK;
 }
 
+namespace {
+
+// Deleter for shared descriptor tables: the table and all its descriptors live in a
+// dedicated pool, so dropping the last reference frees everything at once.
+struct DeleteDescriptorPool {
+  ObjectPool* pool;
+  explicit DeleteDescriptorPool(ObjectPool* pool) : pool(pool) {}
+  void operator()(DescriptorTbl* tbl) { delete pool; }
+};
+
+// Process-wide cache of shared descriptor tables, keyed by the serialized
+// TDescriptorTable bytes. Bounded by --max_cached_descriptor_tbls; evicted entries
+// stay alive until the last fragment referencing them finishes.
+typedef map<string, boost::shared_ptr<DescriptorTbl> > DescriptorTblCache;
+DescriptorTblCache desc_tbl_cache;
+boost::mutex desc_tbl_cache_lock;
+
+}
+
+Status DescriptorTbl::CreateShared(const TDescriptorTable& thrift_tbl,
+    boost::shared_ptr<DescriptorTbl>* tbl) {
+  DCHECK_GT(FLAGS_max_cached_descriptor_tbls, 0);
+  // Key on the exact serialized bytes: a hash alone could silently alias two
+  // different descriptor tables.
+  ThriftSerializer serializer(false);
+  vector<uint8_t> serialized;
+  RETURN_IF_ERROR(serializer.Serialize(
+      const_cast<TDescriptorTable*>(&thrift_tbl), &serialized));
+  string key(serialized.begin(), serialized.end());
+  {
+    boost::lock_guard<boost::mutex> l(desc_tbl_cache_lock);
+    DescriptorTblCache::iterator it = desc_tbl_cache.find(key);
+    if (it != desc_tbl_cache.end()) {
+      *tbl = it->second;
+      return Status::OK;
+    }
+  }
+
+  // Build outside the lock; concurrent misses for the same table may build duplicates
+  // and all but the first inserted copy are simply dropped.
+  ObjectPool* pool = new ObjectPool();
+  DescriptorTbl* raw_tbl = NULL;
+  Status status = Create(pool, thrift_tbl, &raw_tbl);
+  if (!status.ok()) {
+    delete pool;
+    return status;
+  }
+  boost::shared_ptr<DescriptorTbl> created(raw_tbl, DeleteDescriptorPool(pool));
+
+  boost::lock_guard<boost::mutex> l(desc_tbl_cache_lock);
+  pair<DescriptorTblCache::iterator, bool> entry =
+      desc_tbl_cache.insert(make_pair(key, created));
+  if (entry.second &&
+      desc_tbl_cache.size() > static_cast<size_t>(FLAGS_max_cached_descriptor_tbls)) {
+    // Evict an arbitrary other entry. Fragments holding a reference to it are
+    // unaffected; only future lookups miss.
+    DescriptorTblCache::iterator victim = desc_tbl_cache.begin();
+    if (victim == entry.first) ++victim;
+    desc_tbl_cache.erase(victim);
+  }
+  *tbl = entry.first->second;
+  return Status::OK;
+}
+
 TableDescriptor* DescriptorTbl::GetTableDescriptor(TableId id) const {
   // TODO: is there some boost function to do exactly this?
   TableDescriptorMap::const_iterator i = tbl_desc_map_.find(id);
@@ -20,6 +20,7 @@
 #include <tr1/unordered_map>
 #include <vector>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <ostream>
 
 #include "common/status.h"
@@ -306,6 +307,17 @@ class TupleDescriptor {
   TupleId id() const { return id_; }
   std::string DebugString() const;
 
+  // Number of cache lines the tuple layout spans.
+  int NumCacheLines() const;
+
+  // Returns a report of how the slots in 'hot_slot_ids' (e.g. the slots a node's
+  // conjuncts reference) are spread over the tuple's cache lines. Wide tables make a
+  // tuple span many lines and the frontend's size-based slot ordering can push hot
+  // slots onto the last ones; this makes such layouts visible in the logs so they can
+  // be fixed where the layout is decided. See benchmarks/tuple-layout-benchmark.cc
+  // for the cost of a bad layout.
+  std::string LayoutDiagnostic(const std::vector<SlotId>& hot_slot_ids) const;
+
   // Creates a typed struct description for llvm.  The layout of the struct is computed
   // by the FE which includes the order of the fields in the resulting struct.
   // Returns the struct type or NULL if the type could not be created.
@@ -342,6 +354,18 @@ class DescriptorTbl {
   static Status Create(ObjectPool* pool, const TDescriptorTable& thrift_tbl,
                        DescriptorTbl** tbl);
 
+  // Returns a shared descriptor table for 'thrift_tbl' from a process-wide cache,
+  // creating and inserting it on a miss. Entries are keyed by the exact serialized
+  // bytes of 'thrift_tbl', so fragments (of the same or of different queries) whose
+  // plans carry identical descriptor tables share one set of descriptor objects
+  // instead of re-deserializing them. The returned reference keeps the table alive
+  // even after it is evicted from the cache, which holds at most
+  // --max_cached_descriptor_tbls entries.
+  // Shared tables must only be used by fragments running without codegen: the slot
+  // and tuple descriptors cache codegen'd IR, which is per-fragment state.
+  static Status CreateShared(const TDescriptorTable& thrift_tbl,
+      boost::shared_ptr<DescriptorTbl>* tbl);
+
   TableDescriptor* GetTableDescriptor(TableId id) const;
   TupleDescriptor* GetTupleDescriptor(TupleId id) const;
   SlotDescriptor* GetSlotDescriptor(SlotId id) const;
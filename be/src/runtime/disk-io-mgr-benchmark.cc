@@ -0,0 +1,220 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+#include "common/object-pool.h"
+#include "runtime/disk-io-mgr.h"
+#include "runtime/mem-tracker.h"
+#include "util/cpu-info.h"
+#include "util/pretty-printer.h"
+#include "util/stopwatch.h"
+#include "util/thread.h"
+
+using namespace impala;
+using namespace std;
+
+// Performance harness for the DiskIoMgr. disk-io-mgr-stress validates correctness;
+// this tool measures. It creates --num_readers files of --file_size_mb each in
+// --data_dir, reads them through the io mgr with the given disk/thread/buffer
+// configuration and reports issued IOPS, effective bandwidth and the distribution of
+// time readers spend blocked waiting for a buffer. Use it to pick
+// num_threads_per_disk and buffer sizes for new hardware from data, e.g.:
+//
+//   disk-io-mgr-benchmark --data_dir=/data/1/tmp --threads_per_disk=4
+//   disk-io-mgr-benchmark --data_dir=/dev/shm --file_size_mb=64
+//
+// Pointing --data_dir at tmpfs (/dev/shm) takes the device out of the picture and
+// measures the io mgr's own overhead; repeated runs against a real disk measure the
+// cached and uncached device paths. Note that for real device numbers the OS buffer
+// cache must be dropped between runs.
+
+DEFINE_int32(num_disks_for_benchmark, 1, "Number of logical disk queues to use");
+DEFINE_int32(threads_per_disk, 1, "Number of io mgr threads per disk queue");
+DEFINE_int32(num_readers, 4, "Number of concurrent reader contexts");
+DEFINE_int32(file_size_mb, 128, "Size of the file each reader scans, in MB");
+DEFINE_int32(range_size_kb, 8192, "Size of each scan range, in KB");
+DEFINE_int32(min_buffer_size_kb, 1, "Minimum io buffer size, in KB");
+DEFINE_int32(max_buffer_size_kb, 8192, "Maximum io buffer size, in KB");
+DEFINE_int32(cancel_percent, 0, "Percentage of readers that cancel halfway through");
+DEFINE_string(data_dir, "/tmp", "Directory in which the benchmark files are created");
+
+struct ReaderStats {
+  int64_t bytes_read;
+  int64_t num_buffers;
+  int64_t num_ranges;
+
+  // Time spent blocked in GetNextRange()/GetNext(), one entry per call, in ns.
+  vector<int64_t> wait_times;
+
+  ReaderStats() : bytes_read(0), num_buffers(0), num_ranges(0) { }
+};
+
+// Creates 'path' with 'size_bytes' bytes of data.
+static bool CreateBenchmarkFile(const string& path, int64_t size_bytes) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == NULL) return false;
+  vector<char> chunk(1024 * 1024);
+  for (int i = 0; i < chunk.size(); ++i) chunk[i] = 'a' + i % 26;
+  int64_t written = 0;
+  while (written < size_bytes) {
+    int64_t len = min<int64_t>(chunk.size(), size_bytes - written);
+    if (fwrite(&chunk[0], 1, len, file) != len) {
+      fclose(file);
+      return false;
+    }
+    written += len;
+  }
+  return fclose(file) == 0;
+}
+
+// Scans 'filename' once through 'io_mgr', recording throughput and wait times in
+// 'stats'. If 'cancel', cancels the context after half the ranges are done.
+static void ReaderThread(DiskIoMgr* io_mgr, const string& filename, bool cancel,
+    ReaderStats* stats) {
+  DiskIoMgr::RequestContext* reader;
+  Status status = io_mgr->RegisterContext(&reader);
+  CHECK(status.ok());
+
+  const int64_t file_size = FLAGS_file_size_mb * 1024L * 1024L;
+  const int64_t range_size = FLAGS_range_size_kb * 1024L;
+  ObjectPool pool;
+  vector<DiskIoMgr::ScanRange*> ranges;
+  for (int64_t offset = 0; offset < file_size; offset += range_size) {
+    DiskIoMgr::ScanRange* range = pool.Add(new DiskIoMgr::ScanRange());
+    int64_t len = min(range_size, file_size - offset);
+    int disk_id = (offset / range_size) % FLAGS_num_disks_for_benchmark;
+    range->Reset(NULL, filename.c_str(), len, offset, disk_id, false, false);
+    ranges.push_back(range);
+  }
+  status = io_mgr->AddScanRanges(reader, ranges);
+  CHECK(status.ok());
+
+  while (true) {
+    DiskIoMgr::ScanRange* range = NULL;
+    MonotonicStopWatch range_wait;
+    range_wait.Start();
+    status = io_mgr->GetNextRange(reader, &range);
+    range_wait.Stop();
+    stats->wait_times.push_back(range_wait.ElapsedTime());
+    CHECK(status.ok() || status.IsCancelled());
+    if (range == NULL || !status.ok()) break;
+
+    while (true) {
+      DiskIoMgr::BufferDescriptor* buffer = NULL;
+      MonotonicStopWatch buffer_wait;
+      buffer_wait.Start();
+      status = range->GetNext(&buffer);
+      buffer_wait.Stop();
+      stats->wait_times.push_back(buffer_wait.ElapsedTime());
+      CHECK(status.ok() || status.IsCancelled());
+      if (buffer == NULL) break;
+      stats->bytes_read += buffer->len();
+      ++stats->num_buffers;
+      buffer->Return();
+    }
+    ++stats->num_ranges;
+
+    if (cancel && stats->num_ranges == ranges.size() / 2) {
+      io_mgr->CancelContext(reader);
+      break;
+    }
+  }
+  io_mgr->UnregisterContext(reader);
+}
+
+// Returns the 'percentile' (in [0, 100]) entry of sorted 'values'.
+static int64_t Percentile(const vector<int64_t>& values, int percentile) {
+  DCHECK(!values.empty());
+  int idx = (values.size() - 1) * percentile / 100;
+  return values[idx];
+}
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  CpuInfo::Init();
+  impala::InitThreading();
+
+  const int64_t file_size = FLAGS_file_size_mb * 1024L * 1024L;
+  vector<string> filenames;
+  for (int i = 0; i < FLAGS_num_readers; ++i) {
+    stringstream ss;
+    ss << FLAGS_data_dir << "/disk-io-mgr-benchmark-" << i << ".dat";
+    filenames.push_back(ss.str());
+    if (!CreateBenchmarkFile(filenames[i], file_size)) {
+      cerr << "Could not create " << filenames[i] << endl;
+      return 1;
+    }
+  }
+
+  MemTracker mem_tracker;
+  DiskIoMgr io_mgr(FLAGS_num_disks_for_benchmark, FLAGS_threads_per_disk,
+      FLAGS_min_buffer_size_kb * 1024, FLAGS_max_buffer_size_kb * 1024);
+  Status status = io_mgr.Init(&mem_tracker);
+  CHECK(status.ok());
+
+  int num_cancelled_readers = FLAGS_num_readers * FLAGS_cancel_percent / 100;
+  vector<ReaderStats> stats(FLAGS_num_readers);
+  boost::thread_group readers;
+  MonotonicStopWatch total_time;
+  total_time.Start();
+  for (int i = 0; i < FLAGS_num_readers; ++i) {
+    readers.add_thread(new boost::thread(ReaderThread, &io_mgr, filenames[i],
+        i < num_cancelled_readers, &stats[i]));
+  }
+  readers.join_all();
+  total_time.Stop();
+
+  int64_t total_bytes = 0;
+  int64_t total_buffers = 0;
+  int64_t total_ranges = 0;
+  vector<int64_t> wait_times;
+  for (int i = 0; i < FLAGS_num_readers; ++i) {
+    total_bytes += stats[i].bytes_read;
+    total_buffers += stats[i].num_buffers;
+    total_ranges += stats[i].num_ranges;
+    wait_times.insert(wait_times.end(), stats[i].wait_times.begin(),
+        stats[i].wait_times.end());
+  }
+  sort(wait_times.begin(), wait_times.end());
+
+  double elapsed_sec = total_time.ElapsedTime() / 1e9;
+  cout << "Configuration: disks=" << FLAGS_num_disks_for_benchmark
+       << " threads_per_disk=" << FLAGS_threads_per_disk
+       << " readers=" << FLAGS_num_readers
+       << " range_size=" << PrettyPrinter::Print(
+              FLAGS_range_size_kb * 1024L, TUnit::BYTES)
+       << " max_buffer_size=" << PrettyPrinter::Print(
+              FLAGS_max_buffer_size_kb * 1024L, TUnit::BYTES) << endl;
+  cout << "Read " << PrettyPrinter::Print(total_bytes, TUnit::BYTES)
+       << " in " << total_ranges << " ranges / " << total_buffers << " buffers in "
+       << PrettyPrinter::Print(total_time.ElapsedTime(), TUnit::TIME_NS) << endl;
+  cout << "Bandwidth: " << PrettyPrinter::Print(
+      static_cast<int64_t>(total_bytes / elapsed_sec), TUnit::BYTES) << "/sec" << endl;
+  cout << "Issued IOPS: " << static_cast<int64_t>(total_buffers / elapsed_sec) << endl;
+  cout << "Reader wait latency: "
+       << " p50=" << PrettyPrinter::Print(Percentile(wait_times, 50), TUnit::TIME_NS)
+       << " p90=" << PrettyPrinter::Print(Percentile(wait_times, 90), TUnit::TIME_NS)
+       << " p99=" << PrettyPrinter::Print(Percentile(wait_times, 99), TUnit::TIME_NS)
+       << " max=" << PrettyPrinter::Print(wait_times.back(), TUnit::TIME_NS) << endl;
+
+  for (int i = 0; i < filenames.size(); ++i) remove(filenames[i].c_str());
+  return 0;
+}
@@ -28,6 +28,7 @@
 #include "util/debug-util.h"
 #include "util/disk-info.h"
 #include "util/hdfs-util.h"
+#include "util/time.h"
 #include "util/filesystem-util.h"
 #include "util/impalad-metrics.h"
 
@@ -52,6 +53,26 @@ struct DiskIoMgr::DiskQueue {
   // list of all request contexts that have work queued on this disk
   std::list<RequestContext*> request_contexts;
 
+  // Number of io threads currently servicing this queue and the target count set by
+  // the adaptive controller (see DiskIoMgr::DiskThreadControllerLoop()). Threads exit
+  // their work loop when num_threads exceeds target_num_threads. Both are set to the
+  // startup thread count in DiskIoMgr::Init() and only change when
+  // --adaptive_disk_io_threads is enabled.
+  AtomicInt<int32_t> num_threads;
+  AtomicInt<int32_t> target_num_threads;
+
+  // Upper bound for target_num_threads, set in DiskIoMgr::Init().
+  int max_num_threads;
+
+  // Total number of threads ever created for this queue; used to name new threads.
+  AtomicInt<int32_t> num_threads_created;
+
+  // Cumulative count and wall time (nanos) of reads issued from this queue. Only
+  // updated when --adaptive_disk_io_threads is enabled; sampled by the controller to
+  // compute per-interval average read latency.
+  AtomicInt<int64_t> num_reads;
+  AtomicInt<int64_t> read_timer_ns;
+
   // Enqueue the request context to the disk queue.  The DiskQueue lock must not be taken.
   inline void EnqueueContext(RequestContext* worker) {
     {
@@ -64,7 +85,7 @@ struct DiskIoMgr::DiskQueue {
     work_available.notify_all();
   }
 
-  DiskQueue(int id) : disk_id(id) { }
+  DiskQueue(int id) : disk_id(id), max_num_threads(0) { }
 };
 
 // Internal per request-context state. This object maintains a lot of state that is
@@ -138,7 +159,7 @@ class DiskIoMgr::RequestContext {
   RequestContext(DiskIoMgr* parent, int num_disks);
 
   // Resets this object.
-  void Reset(MemTracker* tracker);
+  void Reset(MemTracker* tracker, int read_priority = DiskIoMgr::DEFAULT_READ_PRIORITY);
 
   // Decrements the number of active disks for this reader.  If the disk count
   // goes to 0, the disk complete condition variable is signaled.
@@ -197,6 +218,10 @@ class DiskIoMgr::RequestContext {
   // Memory used for this reader.  This is unowned by this object.
   MemTracker* mem_tracker_;
 
+  // Read priority of this context; higher values are serviced first when a disk
+  // queue has multiple waiting readers. See DiskIoMgr::GetNextRequestRange().
+  int read_priority_;
+
   // Total bytes read for this reader
   RuntimeProfile::Counter* bytes_read_counter_;
 
@@ -223,6 +248,10 @@ class DiskIoMgr::RequestContext {
   // Total number of bytes from remote reads that were expected to be local.
   AtomicInt<int64_t> unexpected_remote_bytes_;
 
+  // Total number of bytes of scan ranges served entirely from the HDFS cache via
+  // ReadFromCache(), updated when the cached read succeeds.
+  AtomicInt<int64_t> cached_range_bytes_;
+
   // The number of buffers that have been returned to the reader (via GetNext) that the
   // reader has not returned. Only included for debugging and diagnostics.
   AtomicInt<int> num_buffers_in_reader_;
@@ -234,6 +263,10 @@ class DiskIoMgr::RequestContext {
   // range scan. Only used for diagnostics.
   AtomicInt<int> num_remote_ranges_;
 
+  // The number of scan ranges served entirely from the HDFS cache, updated when the
+  // cached read succeeds.
+  AtomicInt<int> num_cached_ranges_;
+
   // The total number of scan ranges that have not been started. Only used for
   // diagnostics. This is the sum of all unstarted_scan_ranges across all disks.
   AtomicInt<int> num_unstarted_scan_ranges_;
@@ -347,11 +380,16 @@ class DiskIoMgr::RequestContext {
       Reset();
     }
 
+    // Time (from MonotonicMillis()) this context was last put on the disk queue.
+    // Used for priority aging in DiskIoMgr::GetNextRequestRange().
+    int64_t enqueue_time_ms() const { return enqueue_time_ms_; }
+
     // Schedules the request context on this disk if it's not already on the queue.
     // Context lock must be taken before this.
     void ScheduleContext(RequestContext* context, int disk_id) {
       if (!is_on_queue_ && !done_) {
         is_on_queue_ = true;
+        enqueue_time_ms_ = MonotonicMillis();
         context->parent_->disk_queues_[disk_id]->EnqueueContext(context);
       }
     }
@@ -390,6 +428,7 @@ class DiskIoMgr::RequestContext {
       done_ = true;
       num_remaining_ranges_ = 0;
       is_on_queue_ = false;
+      enqueue_time_ms_ = 0;
       num_threads_in_op_ = 0;
       next_scan_range_to_start_ = NULL;
     }
@@ -415,6 +454,10 @@ class DiskIoMgr::RequestContext {
     // threads.
     bool is_on_queue_;
 
+    // Time this context was last enqueued on this disk's queue, from
+    // MonotonicMillis(). Only meaningful while is_on_queue_ is true.
+    int64_t enqueue_time_ms_;
+
     // For each disks, the number of request ranges that have not been fully read.
     // In the non-cancellation path, this will hit 0, and done will be set to true
     // by the disk thread. This is undefined in the cancellation path (the various
@@ -137,9 +137,10 @@ DiskIoMgr::RequestContext::RequestContext(DiskIoMgr* parent, int num_disks)
 }
 
 // Resets this object.
-void DiskIoMgr::RequestContext::Reset(MemTracker* tracker) {
+void DiskIoMgr::RequestContext::Reset(MemTracker* tracker, int read_priority) {
   DCHECK_EQ(state_, Inactive);
   status_ = Status::OK;
+  read_priority_ = read_priority;
 
   bytes_read_counter_ = NULL;
   read_timer_ = NULL;
@@ -157,6 +158,8 @@ void DiskIoMgr::RequestContext::Reset(MemTracker* tracker) {
   total_range_queue_capacity_ = 0;
   num_finished_ranges_ = 0;
   num_remote_ranges_ = 0;
+  num_cached_ranges_ = 0;
+  cached_range_bytes_ = 0;
   bytes_read_local_ = 0;
   bytes_read_short_circuit_ = 0;
   bytes_read_dn_cache_ = 0;
@@ -181,6 +184,7 @@ string DiskIoMgr::RequestContext::DebugString() const {
   if (state_ == RequestContext::Active) ss << "Active";
   if (state_ != RequestContext::Inactive) {
     ss << " status_=" << (status_.ok() ? "OK" : status_.GetDetail())
+       << " read_priority=" << read_priority_
        << " #ready_buffers=" << num_ready_buffers_
        << " #used_buffers=" << num_used_buffers_
        << " #num_buffers_in_reader=" << num_buffers_in_reader_
@@ -17,6 +17,13 @@
 #include "util/error-util.h"
 #include "util/hdfs-util.h"
 
+#include <fcntl.h>
+
+DECLARE_bool(experimental_zero_copy_local_reads);
+DECLARE_bool(spill_direct_io);
+DECLARE_int32(s3_read_chunk_size);
+DECLARE_int32(s3_scan_range_queue_capacity);
+
 using namespace boost;
 using namespace impala;
 using namespace std;
@@ -140,6 +147,88 @@ Status DiskIoMgr::ScanRange::GetNext(BufferDescriptor** buffer) {
   return Status::OK;
 }
 
+Status DiskIoMgr::ScanRange::GetNextBatch(vector<BufferDescriptor*>* buffers) {
+  DCHECK(buffers->empty());
+
+  {
+    unique_lock<mutex> scan_range_lock(lock_);
+    if (eosr_returned_) return Status::OK;
+    DCHECK(Validate()) << DebugString();
+
+    if (ready_buffers_.empty()) {
+      // The queue is empty indicating this thread could use more
+      // IO. Increase the capacity to allow for more queueing.
+      ++ready_buffers_capacity_;
+      ready_buffers_capacity_ = ::min(ready_buffers_capacity_, MAX_QUEUE_CAPACITY);
+    }
+
+    while (ready_buffers_.empty() && !is_cancelled_) {
+      buffer_ready_cv_.wait(scan_range_lock);
+    }
+
+    if (is_cancelled_) {
+      DCHECK(!status_.ok());
+      return status_;
+    }
+
+    // Take every buffer that is already ready. Nothing can follow the eosr buffer;
+    // an error buffer is only taken if it is the first so the caller never receives
+    // buffers and an error at the same time.
+    DCHECK(!ready_buffers_.empty());
+    while (!ready_buffers_.empty()) {
+      BufferDescriptor* buffer = ready_buffers_.front();
+      if (!buffer->status_.ok() && !buffers->empty()) break;
+      ready_buffers_.pop_front();
+      buffers->push_back(buffer);
+      eosr_returned_ = buffer->eosr();
+      if (buffer->eosr() || !buffer->status_.ok()) break;
+    }
+  }
+
+  // Update tracking counters. The buffers have now moved from the IoMgr to the
+  // caller.
+  int num_buffers = buffers->size();
+  io_mgr_->num_buffers_in_readers_ += num_buffers;
+  reader_->num_buffers_in_reader_ += num_buffers;
+  reader_->num_ready_buffers_ -= num_buffers;
+  reader_->num_used_buffers_ -= num_buffers;
+
+  Status status = buffers->back()->status_;
+  if (!status.ok()) {
+    DCHECK_EQ(num_buffers, 1);
+    buffers->back()->Return();
+    buffers->clear();
+    return status;
+  }
+
+  unique_lock<mutex> reader_lock(reader_->lock_);
+  if (eosr_returned_) {
+    reader_->total_range_queue_capacity_ += ready_buffers_capacity_;
+    ++reader_->num_finished_ranges_;
+    reader_->initial_queue_capacity_ =
+        reader_->total_range_queue_capacity_ / reader_->num_finished_ranges_;
+  }
+
+  DCHECK(reader_->Validate()) << endl << reader_->DebugString();
+  if (reader_->state_ == RequestContext::Cancelled) {
+    reader_->blocked_ranges_.Remove(this);
+    Cancel(reader_->status_);
+    for (int i = 0; i < num_buffers; ++i) (*buffers)[i]->Return();
+    buffers->clear();
+    return status_;
+  }
+
+  bool was_blocked = blocked_on_queue_;
+  blocked_on_queue_ = ready_buffers_.size() >= ready_buffers_capacity_;
+  if (was_blocked && !blocked_on_queue_ && !eosr_queued_) {
+    // This scan range was blocked and is no longer, add it to the reader
+    // queue again.
+    reader_->blocked_ranges_.Remove(this);
+    reader_->ScheduleScanRange(this);
+  }
+  return Status::OK;
+}
+
 void DiskIoMgr::ScanRange::Cancel(const Status& status) {
   // Cancelling a range that was never started, ignore.
   if (io_mgr_ == NULL) return;
@@ -241,8 +330,14 @@ void DiskIoMgr::ScanRange::InitInternal(DiskIoMgr* io_mgr, RequestContext* reade
   eosr_returned_= false;
   blocked_on_queue_ = false;
   if (ready_buffers_capacity_ <= 0) {
-    ready_buffers_capacity_ = reader->initial_scan_range_queue_capacity();
-    DCHECK_GE(ready_buffers_capacity_, MIN_QUEUE_CAPACITY);
+    if (disk_id_ == io_mgr_->RemoteS3DiskId() && FLAGS_s3_scan_range_queue_capacity > 0) {
+      // Object store ranges get their own (deeper) prefetch depth.
+      ready_buffers_capacity_ =
+          ::max(FLAGS_s3_scan_range_queue_capacity, MIN_QUEUE_CAPACITY);
+    } else {
+      ready_buffers_capacity_ = reader->initial_scan_range_queue_capacity();
+      DCHECK_GE(ready_buffers_capacity_, MIN_QUEUE_CAPACITY);
+    }
   }
   DCHECK(Validate()) << DebugString();
 }
@@ -254,17 +349,17 @@ Status DiskIoMgr::ScanRange::Open() {
   if (fs_ != NULL) {
     if (hdfs_file_ != NULL) return Status::OK;
 
-    // TODO: is there much overhead opening hdfs files?  Should we try to preserve
-    // the handle across multiple scan ranges of a file?
-    hdfs_file_ = hdfsOpenFile(fs_, file(), O_RDONLY, 0, 0, 0);
-    VLOG_FILE << "hdfsOpenFile() file=" << file();
+    // The handle comes from the io mgr's file handle cache, so repeated ranges over
+    // the same file don't pay the hdfsOpenFile() cost.
+    hdfs_file_ = io_mgr_->OpenHdfsFile(fs_, file());
     if (hdfs_file_ == NULL) {
       return Status(GetHdfsErrorMsg("Failed to open HDFS file ", file_));
     }
 
-    if (hdfsSeek(fs_, hdfs_file_, offset_) != 0) {
-      hdfsCloseFile(fs_, hdfs_file_);
-      VLOG_FILE << "hdfsCloseFile() (error) file=" << file();
+    if (hdfsSeek(fs_, hdfs_file_->file(), offset_) != 0) {
+      // A handle that failed to seek may be in a bad state; close it rather than
+      // returning it to the cache.
+      io_mgr_->CacheOrCloseFileHandle(file(), hdfs_file_, true);
       hdfs_file_ = NULL;
       string error_msg = GetHdfsErrorMsg("");
       stringstream ss;
@@ -291,7 +386,8 @@ Status DiskIoMgr::ScanRange::Open() {
       return Status(ss.str());
     }
   }
-  if (ImpaladMetrics::IO_MGR_NUM_OPEN_FILES != NULL) {
+  // Open file counts for hdfs files are maintained by HdfsCachedFileHandle.
+  if (fs_ == NULL && ImpaladMetrics::IO_MGR_NUM_OPEN_FILES != NULL) {
     ImpaladMetrics::IO_MGR_NUM_OPEN_FILES->Increment(1L);
   }
   return Status::OK;
@@ -304,7 +400,7 @@ void DiskIoMgr::ScanRange::Close() {
 
     struct hdfsReadStatistics* stats;
     if (IsDfsPath(file())) {
-      int success = hdfsFileGetReadStatistics(hdfs_file_, &stats);
+      int success = hdfsFileGetReadStatistics(hdfs_file_->file(), &stats);
       if (success == 0) {
         reader_->bytes_read_local_ += stats->totalLocalBytesRead;
         reader_->bytes_read_short_circuit_ += stats->totalShortCircuitBytesRead;
@@ -323,32 +419,35 @@ void DiskIoMgr::ScanRange::Close() {
       }
     }
     if (cached_buffer_ != NULL) {
-      hadoopRzBufferFree(hdfs_file_, cached_buffer_);
+      hadoopRzBufferFree(hdfs_file_->file(), cached_buffer_);
       cached_buffer_ = NULL;
     }
-    hdfsCloseFile(fs_, hdfs_file_);
-    VLOG_FILE << "hdfsCloseFile() file=" << file();
+    // Hand the handle back to the io mgr's cache so a later range over this file
+    // can reuse it.
+    io_mgr_->CacheOrCloseFileHandle(file(), hdfs_file_, false);
     hdfs_file_ = NULL;
   } else {
     if (local_file_ == NULL) return;
+    if (FLAGS_spill_direct_io) {
+      // Local (spill) data is unlikely to be re-read; drop this range's pages so
+      // they don't evict hot table data from the page cache.
+      posix_fadvise(fileno(local_file_), offset_, len_, POSIX_FADV_DONTNEED);
+    }
     fclose(local_file_);
     local_file_ = NULL;
   }
-  if (ImpaladMetrics::IO_MGR_NUM_OPEN_FILES != NULL) {
+  // Open file counts for hdfs files are maintained by HdfsCachedFileHandle.
+  if (fs_ == NULL && ImpaladMetrics::IO_MGR_NUM_OPEN_FILES != NULL) {
     ImpaladMetrics::IO_MGR_NUM_OPEN_FILES->Increment(-1L);
   }
 }
 
 int64_t DiskIoMgr::ScanRange::MaxReadChunkSize() const {
-  // S3 InputStreams don't support DIRECT_READ (i.e. java.nio.ByteBuffer read()
-  // interface).  So, hdfsRead() needs to allocate a Java byte[] and copy the data out.
-  // Profiles show that both the JNI array allocation and the memcpy adds much more
-  // overhead for larger buffers, so limit the size of each read request.  128K was
-  // chosen empirically by trying values between 4K and 8M and optimizing for lower CPU
-  // utilization and higher S3 througput.
+  // Limit the size of each read request against S3; see the rationale at the
+  // definition of --s3_read_chunk_size.
   if (disk_id_ == io_mgr_->RemoteS3DiskId()) {
     DCHECK(IsS3APath(file()));
-    return 128 * 1024;
+    return FLAGS_s3_read_chunk_size;
   }
   return numeric_limits<int64_t>::max();
 }
@@ -373,7 +472,7 @@ Status DiskIoMgr::ScanRange::Read(char* buffer, int64_t* bytes_read, bool* eosr)
     int64_t max_chunk_size = MaxReadChunkSize();
     while (*bytes_read < bytes_to_read) {
       int chunk_size = min(bytes_to_read - *bytes_read, max_chunk_size);
-      int last_read = hdfsRead(fs_, hdfs_file_, buffer + *bytes_read, chunk_size);
+      int last_read = hdfsRead(fs_, hdfs_file_->file(), buffer + *bytes_read, chunk_size);
       if (last_read == -1) {
         return Status(GetHdfsErrorMsg("Error reading from HDFS file: ", file_));
       } else if (last_read == 0) {
@@ -401,7 +500,7 @@ Status DiskIoMgr::ScanRange::Read(char* buffer, int64_t* bytes_read, bool* eosr)
 }
 
 Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
-  DCHECK(try_cache_);
+  DCHECK(try_cache_ || FLAGS_experimental_zero_copy_local_reads);
   DCHECK_EQ(bytes_read_, 0);
   *read_succeeded = false;
   Status status = Open();
@@ -416,7 +515,8 @@ Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
 
     DCHECK(hdfs_file_ != NULL);
     DCHECK(cached_buffer_ == NULL);
-    cached_buffer_ = hadoopReadZero(hdfs_file_, io_mgr_->cached_read_options_, len());
+    cached_buffer_ =
+        hadoopReadZero(hdfs_file_->file(), io_mgr_->cached_read_options_, len());
 
     // Data was not cached, caller will fall back to normal read path.
     if (cached_buffer_ == NULL) return Status::OK;
@@ -425,10 +525,25 @@ Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
   // Cached read succeeded.
   void* buffer = const_cast<void*>(hadoopRzBufferGet(cached_buffer_));
   int32_t bytes_read = hadoopRzBufferLength(cached_buffer_);
-  // For now, entire the entire block is cached or none of it.
-  // TODO: if HDFS ever changes this, we'll have to handle the case where half
-  // the block is cached.
-  DCHECK_EQ(bytes_read, len());
+  // For cached blocks, the entire block is cached or none of it. For zero-copy reads
+  // of uncached local blocks, the DN may serve fewer bytes than requested (e.g. if
+  // the range crosses a block boundary); fall back to the normal read path then so
+  // the buffer always covers the whole range.
+  // TODO: if HDFS ever caches partial blocks, we'll have to handle that here too.
+  DCHECK(!try_cache_ || bytes_read == len());
+  if (bytes_read < len()) {
+    unique_lock<mutex> hdfs_lock(hdfs_lock_);
+    hadoopRzBufferFree(hdfs_file_->file(), cached_buffer_);
+    cached_buffer_ = NULL;
+    // hadoopReadZero() advanced the file position; restore it for the fallback read.
+    if (hdfsSeek(fs_, hdfs_file_->file(), offset_) != 0) {
+      stringstream ss;
+      ss << "Error seeking to " << offset_ << " in file: " << file_ << " "
+         << GetHdfsErrorMsg("");
+      return Status(ss.str());
+    }
+    return Status::OK;
+  }
 
   // Create a single buffer desc for the entire scan range and enqueue that.
   BufferDescriptor* desc = io_mgr_->GetBufferDesc(
@@ -443,5 +558,7 @@ Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
   }
   *read_succeeded = true;
   ++reader_->num_used_buffers_;
+  ++reader_->num_cached_ranges_;
+  reader_->cached_range_bytes_ += bytes_read;
   return Status::OK;
 }
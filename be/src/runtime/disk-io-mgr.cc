@@ -15,6 +15,11 @@
 #include "runtime/disk-io-mgr.h"
 #include "runtime/disk-io-mgr-internal.h"
 #include "util/hdfs-util.h"
+#include "util/impalad-metrics.h"
+#include "util/time.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
 
 #include <gutil/strings/substitute.h>
 #include <boost/algorithm/string.hpp>
@@ -37,6 +42,18 @@ DEFINE_int32(num_threads_per_disk, 0, "number of threads per disk");
 // open to S3 and use of multiple CPU cores since S3 reads are relatively compute
 // expensive (SSL and JNI buffer overheads).
 DEFINE_int32(num_s3_io_threads, 16, "number of S3 I/O threads");
+// S3 InputStreams don't support DIRECT_READ (i.e. java.nio.ByteBuffer read()
+// interface), so hdfsRead() allocates a Java byte[] and copies the data out. Profiles
+// show that both the JNI array allocation and the memcpy add much more overhead for
+// larger chunks. The 128K default was chosen empirically by trying values between 4K
+// and 8M and optimizing for lower CPU utilization and higher S3 throughput.
+DEFINE_int32(s3_read_chunk_size, 128 * 1024,
+    "Maximum size of an individual hdfsRead() call against S3 (in bytes)");
+// Object store reads are high-latency but high-throughput, so an S3 scan range
+// benefits from more read-ahead than a local disk range.
+DEFINE_int32(s3_scan_range_queue_capacity, 0, "Initial number of ready buffers "
+    "(prefetch depth) an S3 scan range can queue before its disk queue blocks. "
+    "0 uses the same initial capacity as local scan ranges.");
 // The read size is the size of the reads sent to hdfs/os.
 // There is a trade off of latency and throughout, trying to keep disks busy but
 // not introduce seeks.  The literature seems to agree that with 8 MB reads, random
@@ -44,10 +61,51 @@ DEFINE_int32(num_s3_io_threads, 16, "number of S3 I/O threads");
 DEFINE_int32(read_size, 8 * 1024 * 1024, "Read Size (in bytes)");
 DEFINE_int32(min_buffer_size, 1024, "The minimum read buffer size (in bytes)");
 
+// The adaptive controller samples per-disk queue depth and read latency and
+// grows/shrinks each disk queue's thread count at runtime, so deep queues on
+// low-latency devices (SSDs, remote object stores) get more parallelism while
+// seek-bound spinning disks stay at a thread or two.
+DEFINE_bool(adaptive_disk_io_threads, false, "Adjust the number of I/O threads per "
+    "disk at runtime based on observed queue depth and read latency, instead of fixing "
+    "it at startup. Queues with waiting work grow up to 4x their startup thread count "
+    "as long as read latency holds up; queues whose latency degrades shrink back "
+    "toward a single thread.");
+DEFINE_int32(adaptive_disk_io_interval_ms, 1000,
+    "Sampling interval of the adaptive disk I/O thread controller.");
+
+DEFINE_int32(disk_io_priority_timeout_ms, 1000, "A reader that has waited on a disk "
+    "queue longer than this many milliseconds is serviced ahead of higher-priority "
+    "readers, so low-priority scans cannot be starved. 0 disables the aging check.");
+
+DEFINE_bool(spill_direct_io, false, "If true, spill (local, non-HDFS) I/O bypasses "
+    "the OS page cache: writes that meet O_DIRECT alignment requirements are written "
+    "with O_DIRECT, io buffers are allocated sector-aligned, and pages read from "
+    "local files are dropped from the page cache when the range is closed. Protects "
+    "the page cache for scans of hot tables on spill-heavy workloads.");
+
+// Buffer, offset and length alignment required for O_DIRECT I/O.
+static const int64_t DIRECT_IO_ALIGNMENT = 4096;
+
+// Zero-copy reads of uncached local blocks use the same hadoopReadZero() path as
+// cached reads, serving the scanner directly from the DN's mmap'd block file instead
+// of copying into an io mgr buffer. The mmap path skips HDFS checksum verification,
+// so this is off by default.
+DEFINE_bool(experimental_zero_copy_local_reads, false, "Attempt zero-copy (mmap) reads "
+    "for local HDFS blocks that are not in the HDFS cache. Avoids copying block data "
+    "into I/O buffers but skips HDFS checksum verification for those reads. Blocks that "
+    "cannot be served zero-copy fall back to the normal read path.");
+
 // With 1024B through 8MB buffers, this is up to ~2GB of buffers.
 DEFINE_int32(max_free_io_buffers, 128,
     "For each io buffer size, the maximum number of buffers the IoMgr will hold onto");
 
+// libhdfs opens are milliseconds each, so repeated queries over the same partitions
+// pay a large reopen cost without the cache. Each idle handle pins some libhdfs/JVM
+// state, so the cache is bounded and evicts the oldest idle handle when full.
+DEFINE_int32(max_cached_file_handles, 0, "Maximum number of idle HDFS file handles "
+    "the I/O manager keeps open across scan ranges and queries, so hot files are not "
+    "reopened for every range. 0 disables the file handle cache.");
+
 // Rotational disks should have 1 thread per disk to minimize seeks.  Non-rotational
 // don't have this penalty and benefit from multiple concurrent IO requests.
 static const int THREADS_PER_ROTATIONAL_DISK = 1;
@@ -207,6 +265,27 @@ void DiskIoMgr::WriteRange::SetData(const uint8_t* buffer, int64_t len) {
   len_ = len;
 }
 
+DiskIoMgr::HdfsCachedFileHandle::HdfsCachedFileHandle(const hdfsFS& fs,
+    const char* fname)
+  : fs_(fs), hdfs_file_(hdfsOpenFile(fs, fname, O_RDONLY, 0, 0, 0)) {
+  VLOG_FILE << "hdfsOpenFile() file=" << fname;
+  if (hdfs_file_ != NULL && ImpaladMetrics::IO_MGR_NUM_OPEN_FILES != NULL) {
+    ImpaladMetrics::IO_MGR_NUM_OPEN_FILES->Increment(1L);
+  }
+}
+
+DiskIoMgr::HdfsCachedFileHandle::~HdfsCachedFileHandle() {
+  if (hdfs_file_ != NULL) {
+    VLOG_FILE << "hdfsCloseFile() fid=" << hdfs_file_;
+    hdfsCloseFile(fs_, hdfs_file_);
+    if (ImpaladMetrics::IO_MGR_NUM_OPEN_FILES != NULL) {
+      ImpaladMetrics::IO_MGR_NUM_OPEN_FILES->Increment(-1L);
+    }
+  }
+  fs_ = NULL;
+  hdfs_file_ = NULL;
+}
+
 static void CheckSseSupport() {
   if (!CpuInfo::IsSupported(CpuInfo::SSE4_2)) {
     LOG(WARNING) << "This machine does not support sse4_2.  The default IO system "
@@ -225,7 +304,8 @@ DiskIoMgr::DiskIoMgr() :
     total_bytes_read_counter_(TUnit::BYTES),
     read_timer_(TUnit::TIME_NS) {
   int64_t max_buffer_size_scaled = BitUtil::Ceil(max_buffer_size_, min_buffer_size_);
-  free_buffers_.resize(BitUtil::Log2(max_buffer_size_scaled) + 1);
+  free_buffers_.resize(BitUtil::Log2(max_buffer_size_scaled) + 1,
+      vector<list<char*> >(CpuInfo::num_numa_nodes()));
   int num_local_disks = FLAGS_num_disks == 0 ? DiskInfo::num_disks() : FLAGS_num_disks;
   disk_queues_.resize(num_local_disks + REMOTE_NUM_DISKS);
   CheckSseSupport();
@@ -241,7 +321,8 @@ DiskIoMgr::DiskIoMgr(int num_local_disks, int threads_per_disk, int min_buffer_s
     total_bytes_read_counter_(TUnit::BYTES),
     read_timer_(TUnit::TIME_NS) {
   int64_t max_buffer_size_scaled = BitUtil::Ceil(max_buffer_size_, min_buffer_size_);
-  free_buffers_.resize(BitUtil::Log2(max_buffer_size_scaled) + 1);
+  free_buffers_.resize(BitUtil::Log2(max_buffer_size_scaled) + 1,
+      vector<list<char*> >(CpuInfo::num_numa_nodes()));
   if (num_local_disks == 0) num_local_disks = DiskInfo::num_disks();
   disk_queues_.resize(num_local_disks + REMOTE_NUM_DISKS);
   CheckSseSupport();
@@ -260,6 +341,9 @@ DiskIoMgr::~DiskIoMgr() {
     }
     disk_queues_[i]->work_available.notify_all();
   }
+  // Join the controller before the worker threads: it is the only thing that adds
+  // threads to disk_thread_group_ after Init().
+  if (disk_thread_controller_.get() != NULL) disk_thread_controller_->Join();
   disk_thread_group_.JoinAll();
 
   for (int i = 0; i < disk_queues_.size(); ++i) {
@@ -281,7 +365,9 @@ DiskIoMgr::~DiskIoMgr() {
   // Delete all allocated buffers
   int num_free_buffers = 0;
   for (int idx = 0; idx < free_buffers_.size(); ++idx) {
-    num_free_buffers += free_buffers_[idx].size();
+    for (int node = 0; node < free_buffers_[idx].size(); ++node) {
+      num_free_buffers += free_buffers_[idx][node].size();
+    }
   }
   DCHECK_EQ(num_allocated_buffers_, num_free_buffers);
   GcIoBuffers();
@@ -290,6 +376,14 @@ DiskIoMgr::~DiskIoMgr() {
     delete disk_queues_[i];
   }
 
+  // Close any file handles that are still cached.
+  for (FileHandleCache::iterator it = file_handle_cache_.begin();
+      it != file_handle_cache_.end(); ++it) {
+    delete it->second.first;
+  }
+  file_handle_cache_.clear();
+  file_handle_fifo_.clear();
+
   if (cached_read_options_ != NULL) hadoopRzOptionsFree(cached_read_options_);
 }
 
@@ -298,7 +392,7 @@ Status DiskIoMgr::Init(MemTracker* process_mem_tracker) {
   process_mem_tracker_ = process_mem_tracker;
   // If we hit the process limit, see if we can reclaim some memory by removing
   // previously allocated (but unused) io buffers.
-  process_mem_tracker->AddGcFunction(bind(&DiskIoMgr::GcIoBuffers, this));
+  process_mem_tracker->AddGcFunction(bind(&DiskIoMgr::GcIoBuffers, this, _1));
 
   for (int i = 0; i < disk_queues_.size(); ++i) {
     disk_queues_[i] = new DiskQueue(i);
@@ -312,13 +406,17 @@ Status DiskIoMgr::Init(MemTracker* process_mem_tracker) {
     } else {
       num_threads_per_disk = THREADS_PER_FLASH_DISK;
     }
+    disk_queues_[i]->target_num_threads = num_threads_per_disk;
+    disk_queues_[i]->max_num_threads =
+        ::max(num_threads_per_disk * 4, num_threads_per_disk + 1);
     for (int j = 0; j < num_threads_per_disk; ++j) {
-      stringstream ss;
-      ss << "work-loop(Disk: " << i << ", Thread: " << j << ")";
-      disk_thread_group_.AddThread(new Thread("disk-io-mgr", ss.str(),
-          &DiskIoMgr::WorkLoop, this, disk_queues_[i]));
+      AddDiskThread(disk_queues_[i]);
     }
   }
+  if (FLAGS_adaptive_disk_io_threads) {
+    disk_thread_controller_.reset(new Thread("disk-io-mgr", "disk-thread-controller",
+        &DiskIoMgr::DiskThreadControllerLoop, this));
+  }
   request_context_cache_.reset(new RequestContextCache(this));
 
   cached_read_options_ = hadoopRzOptionsAlloc();
@@ -334,10 +432,11 @@ Status DiskIoMgr::Init(MemTracker* process_mem_tracker) {
 }
 
 Status DiskIoMgr::RegisterContext(RequestContext** request_context,
-    MemTracker* mem_tracker) {
+    MemTracker* mem_tracker, int read_priority) {
   DCHECK(request_context_cache_.get() != NULL) << "Must call Init() first.";
+  DCHECK_GE(read_priority, 1);
   *request_context = request_context_cache_->GetNewContext();
-  (*request_context)->Reset(mem_tracker);
+  (*request_context)->Reset(mem_tracker, read_priority);
   return Status::OK;
 }
 
@@ -436,6 +535,82 @@ int64_t DiskIoMgr::unexpected_remote_bytes(RequestContext* reader) const {
   return reader->unexpected_remote_bytes_;
 }
 
+int DiskIoMgr::num_cached_ranges(RequestContext* reader) const {
+  return reader->num_cached_ranges_;
+}
+
+int64_t DiskIoMgr::cached_range_bytes(RequestContext* reader) const {
+  return reader->cached_range_bytes_;
+}
+
+DiskIoMgr::HdfsCachedFileHandle* DiskIoMgr::OpenHdfsFile(
+    const hdfsFS& fs, const char* fname) {
+  if (FLAGS_max_cached_file_handles > 0) {
+    unique_lock<mutex> lock(file_handle_cache_lock_);
+    pair<FileHandleCache::iterator, FileHandleCache::iterator> matches =
+        file_handle_cache_.equal_range(fname);
+    for (FileHandleCache::iterator it = matches.first; it != matches.second; ++it) {
+      // Handles are bound to the hdfs connection they were opened on.
+      if (it->second.first->fs() != fs) continue;
+      HdfsCachedFileHandle* fid = it->second.first;
+      file_handle_fifo_.erase(it->second.second);
+      file_handle_cache_.erase(it);
+      if (ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES != NULL) {
+        ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
+      }
+      return fid;
+    }
+  }
+  HdfsCachedFileHandle* fid = new HdfsCachedFileHandle(fs, fname);
+  if (!fid->ok()) {
+    delete fid;
+    return NULL;
+  }
+  return fid;
+}
+
+void DiskIoMgr::CacheOrCloseFileHandle(const char* fname, HdfsCachedFileHandle* fid,
+    bool close) {
+  DCHECK(fid != NULL);
+  // Try to unbuffer the handle before caching it; filesystems that do not support
+  // hdfsUnbufferFile() hold on to a read buffer per handle, so close the handle
+  // instead of caching it in that case.
+  if (FLAGS_max_cached_file_handles > 0 && !close &&
+      hdfsUnbufferFile(fid->file()) == 0) {
+    // The caller has already consumed this range's read statistics; clear them so a
+    // reusing scan range does not count them again.
+    hdfsFileClearReadStatistics(fid->file());
+    unique_lock<mutex> lock(file_handle_cache_lock_);
+    // Evict the oldest idle handle(s) to make room.
+    while (file_handle_cache_.size() >= FLAGS_max_cached_file_handles &&
+        !file_handle_fifo_.empty()) {
+      pair<FileHandleCache::iterator, FileHandleCache::iterator> matches =
+          file_handle_cache_.equal_range(file_handle_fifo_.front());
+      FileHandleCache::iterator victim = matches.first;
+      while (victim != matches.second &&
+          victim->second.second != file_handle_fifo_.begin()) {
+        ++victim;
+      }
+      DCHECK(victim != matches.second);
+      delete victim->second.first;
+      file_handle_cache_.erase(victim);
+      file_handle_fifo_.pop_front();
+      if (ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES != NULL) {
+        ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
+      }
+    }
+    file_handle_fifo_.push_back(fname);
+    list<string>::iterator fifo_it = file_handle_fifo_.end();
+    --fifo_it;
+    file_handle_cache_.insert(make_pair(string(fname), make_pair(fid, fifo_it)));
+    if (ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES != NULL) {
+      ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(1L);
+    }
+  } else {
+    delete fid;
+  }
+}
+
 int64_t DiskIoMgr::GetReadThroughput() {
   return RuntimeProfile::UnitsPerSecond(&total_bytes_read_counter_, &read_timer_);
 }
@@ -476,7 +651,13 @@ Status DiskIoMgr::AddScanRanges(RequestContext* reader,
     DCHECK_NE(ranges[i]->len(), 0);
     ScanRange* range = ranges[i];
 
-    if (range->try_cache_) {
+    // Local ranges may also be served zero-copy (from the DN's mmap'd block file)
+    // if --experimental_zero_copy_local_reads is set; they take the same path as
+    // cached ranges and fall back to a normal read if the DN can't serve them.
+    bool try_zero_copy = range->try_cache_ ||
+        (FLAGS_experimental_zero_copy_local_reads && range->expected_local_ &&
+            range->fs_ != NULL);
+    if (try_zero_copy) {
       if (schedule_immediately) {
         bool cached_read_succeeded;
         RETURN_IF_ERROR(range->ReadFromCache(&cached_read_succeeded));
@@ -522,7 +703,7 @@ Status DiskIoMgr::GetNextRange(RequestContext* reader, ScanRange** range) {
     if (!reader->cached_ranges_.empty()) {
       // We have a cached range.
       *range = reader->cached_ranges_.Dequeue();
-      DCHECK((*range)->try_cache_);
+      DCHECK((*range)->try_cache_ || FLAGS_experimental_zero_copy_local_reads);
       bool cached_read_succeeded;
       RETURN_IF_ERROR((*range)->ReadFromCache(&cached_read_succeeded));
       if (cached_read_succeeded) return Status::OK;
@@ -632,9 +813,24 @@ char* DiskIoMgr::GetFreeBuffer(int64_t* buffer_size) {
   // convert to bytes
   *buffer_size = (1 << idx) * min_buffer_size_;
 
+  // Prefer a free buffer whose memory is on this thread's NUMA node; a remote node's
+  // buffer is still better than growing the total number of buffers.
+  int numa_node = CpuInfo::GetCurrentNumaNode();
+
   unique_lock<mutex> lock(free_buffers_lock_);
   char* buffer = NULL;
-  if (free_buffers_[idx].empty()) {
+  int free_node = -1;
+  if (!free_buffers_[idx][numa_node].empty()) {
+    free_node = numa_node;
+  } else {
+    for (int node = 0; node < free_buffers_[idx].size(); ++node) {
+      if (!free_buffers_[idx][node].empty()) {
+        free_node = node;
+        break;
+      }
+    }
+  }
+  if (free_node == -1) {
     ++num_allocated_buffers_;
     if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(1L);
@@ -645,34 +841,58 @@ char* DiskIoMgr::GetFreeBuffer(int64_t* buffer_size) {
     // Update the process mem usage.  This is checked the next time we start
     // a read for the next reader (DiskIoMgr::GetNextScanRange)
     process_mem_tracker_->Consume(*buffer_size);
-    buffer = new char[*buffer_size];
+    if (FLAGS_spill_direct_io) {
+      // O_DIRECT requires sector-aligned buffer memory. All io buffers are allocated
+      // aligned when the flag is set so any of them can be used for a direct write.
+      void* aligned_buffer = NULL;
+      int ret = posix_memalign(&aligned_buffer, DIRECT_IO_ALIGNMENT, *buffer_size);
+      DCHECK_EQ(ret, 0);
+      buffer = reinterpret_cast<char*>(aligned_buffer);
+    } else {
+      buffer = new char[*buffer_size];
+    }
+    // The caller's read is this buffer's first touch, so its pages will end up on the
+    // calling thread's node.
+    buffer_numa_node_[buffer] = numa_node;
   } else {
     if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(-1L);
     }
-    buffer = free_buffers_[idx].front();
-    free_buffers_[idx].pop_front();
+    buffer = free_buffers_[idx][free_node].front();
+    free_buffers_[idx][free_node].pop_front();
   }
   DCHECK(buffer != NULL);
   return buffer;
 }
 
-void DiskIoMgr::GcIoBuffers() {
+void DiskIoMgr::GcIoBuffers(int64_t bytes_to_free) {
   unique_lock<mutex> lock(free_buffers_lock_);
   int buffers_freed = 0;
-  int bytes_freed = 0;
-  for (int idx = 0; idx < free_buffers_.size(); ++idx) {
-    for (list<char*>::iterator iter = free_buffers_[idx].begin();
-         iter != free_buffers_[idx].end(); ++iter) {
-      int64_t buffer_size = (1 << idx) * min_buffer_size_;
-      process_mem_tracker_->Release(buffer_size);
-      --num_allocated_buffers_;
-      delete[] *iter;
-
-      ++buffers_freed;
-      bytes_freed += buffer_size;
+  int64_t bytes_freed = 0;
+  // Free the largest buffers first: they get us to the target fastest and the small
+  // sizes are recycled the most. Within a size, buffers are reused from the front of
+  // the list, so the front is the least recently returned and gets freed first.
+  for (int idx = free_buffers_.size() - 1;
+       idx >= 0 && bytes_freed < bytes_to_free; --idx) {
+    int64_t buffer_size = (1 << idx) * min_buffer_size_;
+    for (int node = 0; node < free_buffers_[idx].size() && bytes_freed < bytes_to_free;
+         ++node) {
+      while (!free_buffers_[idx][node].empty() && bytes_freed < bytes_to_free) {
+        char* buffer = free_buffers_[idx][node].front();
+        free_buffers_[idx][node].pop_front();
+        process_mem_tracker_->Release(buffer_size);
+        --num_allocated_buffers_;
+        buffer_numa_node_.erase(buffer);
+        if (FLAGS_spill_direct_io) {
+          free(buffer);
+        } else {
+          delete[] buffer;
+        }
+
+        ++buffers_freed;
+        bytes_freed += buffer_size;
+      }
     }
-    free_buffers_[idx].clear();
   }
 
   if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
@@ -682,7 +902,7 @@ void DiskIoMgr::GcIoBuffers() {
     ImpaladMetrics::IO_MGR_TOTAL_BYTES->Increment(-bytes_freed);
   }
   if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
-    ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->set_value(0);
+    ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(-buffers_freed);
   }
 }
 
@@ -699,15 +919,31 @@ void DiskIoMgr::ReturnFreeBuffer(char* buffer, int64_t buffer_size) {
       << "buffer_size_ / min_buffer_size_ should be power of 2, got buffer_size = "
       << buffer_size << ", min_buffer_size_ = " << min_buffer_size_;
   unique_lock<mutex> lock(free_buffers_lock_);
-  if (!FLAGS_disable_mem_pools && free_buffers_[idx].size() < FLAGS_max_free_io_buffers) {
-    free_buffers_[idx].push_back(buffer);
+  // The buffer goes back on the free list of the node it was allocated on, which is
+  // where its pages live, not the returning thread's node. The free buffer cap is
+  // across all nodes so the total memory held is the same as before the lists were
+  // split up.
+  boost::unordered_map<char*, int>::iterator node_it = buffer_numa_node_.find(buffer);
+  DCHECK(node_it != buffer_numa_node_.end());
+  int node = node_it == buffer_numa_node_.end() ? 0 : node_it->second;
+  int num_free_buffers = 0;
+  for (int i = 0; i < free_buffers_[idx].size(); ++i) {
+    num_free_buffers += free_buffers_[idx][i].size();
+  }
+  if (!FLAGS_disable_mem_pools && num_free_buffers < FLAGS_max_free_io_buffers) {
+    free_buffers_[idx][node].push_back(buffer);
     if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(1L);
     }
   } else {
     process_mem_tracker_->Release(buffer_size);
     --num_allocated_buffers_;
-    delete[] buffer;
+    buffer_numa_node_.erase(buffer);
+    if (FLAGS_spill_direct_io) {
+      free(buffer);
+    } else {
+      delete[] buffer;
+    }
     if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(-1L);
     }
@@ -750,8 +986,22 @@ bool DiskIoMgr::GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
       // so this is not a big deal (i.e. multiple disk threads can read for the
       // same reader).
       // TODO: revisit.
-      *request_context = disk_queue->request_contexts.front();
-      disk_queue->request_contexts.pop_front();
+      // Readers are serviced in FIFO order except that a reader with a higher read
+      // priority is picked ahead of lower-priority ones. The front of the queue is
+      // the longest-waiting reader; once it has waited --disk_io_priority_timeout_ms
+      // it is serviced regardless of priority so low-priority scans cannot starve.
+      list<RequestContext*>::iterator pick = disk_queue->request_contexts.begin();
+      bool front_expired = FLAGS_disk_io_priority_timeout_ms > 0 &&
+          MonotonicMillis() - (*pick)->disk_states_[disk_id].enqueue_time_ms() >=
+              FLAGS_disk_io_priority_timeout_ms;
+      if (!front_expired) {
+        list<RequestContext*>::iterator it = pick;
+        for (++it; it != disk_queue->request_contexts.end(); ++it) {
+          if ((*it)->read_priority_ > (*pick)->read_priority_) pick = it;
+        }
+      }
+      *request_context = *pick;
+      disk_queue->request_contexts.erase(pick);
       DCHECK(*request_context != NULL);
       request_disk_state = &((*request_context)->disk_states_[disk_id]);
       request_disk_state->IncrementRequestThreadAndDequeue();
@@ -925,6 +1175,13 @@ void DiskIoMgr::WorkLoop(DiskQueue* disk_queue) {
   //   3. Perform the read or write as specified.
   // Cancellation checking needs to happen in both steps 1 and 3.
   while (true) {
+    // If the adaptive controller lowered this queue's target thread count, exit.
+    while (true) {
+      int32_t num_threads = disk_queue->num_threads.Read();
+      if (num_threads <= disk_queue->target_num_threads.Read()) break;
+      if (disk_queue->num_threads.CompareAndSwap(num_threads, num_threads - 1)) return;
+    }
+
     RequestContext* worker_context = NULL;;
     RequestRange* range = NULL;
 
@@ -944,6 +1201,72 @@ void DiskIoMgr::WorkLoop(DiskQueue* disk_queue) {
   DCHECK(shut_down_);
 }
 
+void DiskIoMgr::AddDiskThread(DiskQueue* disk_queue) {
+  ++disk_queue->num_threads;
+  int thread_num = disk_queue->num_threads_created.FetchAndUpdate(1);
+  stringstream ss;
+  ss << "work-loop(Disk: " << disk_queue->disk_id << ", Thread: " << thread_num << ")";
+  disk_thread_group_.AddThread(new Thread("disk-io-mgr", ss.str(),
+      &DiskIoMgr::WorkLoop, this, disk_queue));
+}
+
+void DiskIoMgr::DiskThreadControllerLoop() {
+  // A queue is considered to have degraded when its average per-read latency exceeds
+  // the best interval latency observed for that queue by this factor.
+  const double LATENCY_DEGRADED_FACTOR = 2.0;
+
+  // Per-queue stats at the end of the previous interval.
+  vector<int64_t> last_num_reads(disk_queues_.size(), 0);
+  vector<int64_t> last_read_timer_ns(disk_queues_.size(), 0);
+  // Best (lowest) average read latency observed per queue; 0 until a sample exists.
+  vector<int64_t> best_latency_ns(disk_queues_.size(), 0);
+
+  while (!shut_down_) {
+    SleepForMs(FLAGS_adaptive_disk_io_interval_ms);
+    if (shut_down_) break;
+    for (int i = 0; i < disk_queues_.size(); ++i) {
+      DiskQueue* queue = disk_queues_[i];
+      if (queue == NULL) continue;
+      int64_t num_reads = queue->num_reads.Read();
+      int64_t read_timer_ns = queue->read_timer_ns.Read();
+      int64_t interval_reads = num_reads - last_num_reads[i];
+      int64_t interval_time_ns = read_timer_ns - last_read_timer_ns[i];
+      last_num_reads[i] = num_reads;
+      last_read_timer_ns[i] = read_timer_ns;
+      // An idle queue gives us no signal; leave it alone.
+      if (interval_reads == 0) continue;
+
+      int64_t avg_latency_ns = interval_time_ns / interval_reads;
+      if (best_latency_ns[i] == 0 || avg_latency_ns < best_latency_ns[i]) {
+        best_latency_ns[i] = avg_latency_ns;
+      }
+
+      int queue_depth;
+      {
+        unique_lock<mutex> disk_lock(queue->lock);
+        queue_depth = queue->request_contexts.size();
+      }
+
+      int32_t target = queue->target_num_threads.Read();
+      if (avg_latency_ns > best_latency_ns[i] * LATENCY_DEGRADED_FACTOR && target > 1) {
+        // Latency has degraded well past the best this queue has shown; back off.
+        // The device (e.g. a seek-bound spinning disk) isn't keeping up with this
+        // much concurrency. Wake the threads so one of them notices and exits.
+        queue->target_num_threads = target - 1;
+        queue->work_available.notify_all();
+        VLOG(2) << "Disk " << queue->disk_id << ": shrinking to " << (target - 1)
+                << " io thread(s), avg read latency " << avg_latency_ns << "ns";
+      } else if (queue_depth > 0 && target < queue->max_num_threads) {
+        // Readers are waiting on this queue and latency is holding up; add a thread.
+        queue->target_num_threads = target + 1;
+        AddDiskThread(queue);
+        VLOG(2) << "Disk " << queue->disk_id << ": growing to " << (target + 1)
+                << " io thread(s), queue depth " << queue_depth;
+      }
+    }
+  }
+}
+
 // This function reads the specified scan range associated with the
 // specified reader context and disk queue.
 void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
@@ -1016,8 +1339,14 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
     SCOPED_TIMER(&read_timer_);
     SCOPED_TIMER(reader->read_timer_);
 
+    MonotonicStopWatch queue_read_sw;
+    if (FLAGS_adaptive_disk_io_threads) queue_read_sw.Start();
     buffer_desc->status_ = range->Read(buffer, &buffer_desc->len_, &buffer_desc->eosr_);
     buffer_desc->scan_range_offset_ = range->bytes_read_ - buffer_desc->len_;
+    if (FLAGS_adaptive_disk_io_threads) {
+      disk_queue->read_timer_ns += queue_read_sw.ElapsedTime();
+      ++disk_queue->num_reads;
+    }
 
     if (reader->bytes_read_counter_ != NULL) {
       COUNTER_ADD(reader->bytes_read_counter_, buffer_desc->len_);
@@ -1034,6 +1363,17 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
 }
 
 void DiskIoMgr::Write(RequestContext* writer_context, WriteRange* write_range) {
+  // Spill writes go through O_DIRECT when enabled and the range meets the alignment
+  // requirements; anything unaligned (e.g. a partial last block) falls back to the
+  // buffered path below.
+  if (FLAGS_spill_direct_io &&
+      write_range->len_ % DIRECT_IO_ALIGNMENT == 0 &&
+      write_range->offset() % DIRECT_IO_ALIGNMENT == 0 &&
+      reinterpret_cast<uintptr_t>(write_range->data_) % DIRECT_IO_ALIGNMENT == 0) {
+    HandleWriteFinished(writer_context, write_range, WriteRangeDirect(write_range));
+    return;
+  }
+
   FILE* file_handle = fopen(write_range->file(), "rb+");
   Status ret_status;
   if (file_handle == NULL) {
@@ -1087,6 +1427,45 @@ Status DiskIoMgr::WriteRangeHelper(FILE* file_handle, WriteRange* write_range) {
   return Status::OK;
 }
 
+Status DiskIoMgr::WriteRangeDirect(WriteRange* write_range) {
+  int fd = open(write_range->file(), O_WRONLY | O_DIRECT);
+  if (fd < 0) {
+    return Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("open($0, O_WRONLY | O_DIRECT) failed with errno=$1 description=$2",
+            write_range->file_, errno, GetStrErrMsg())));
+  }
+
+  Status status;
+  int success = 0;
+  if (write_range->len_ > 0) {
+    success = posix_fallocate(fd, write_range->offset(), write_range->len_);
+  }
+  if (success != 0) {
+    status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("posix_fallocate($0, $1, $2) failed for file $3"
+            " with returnval=$4 description=$5", fd, write_range->offset(),
+            write_range->len_, write_range->file_, success, GetStrErrMsg())));
+  } else {
+    ssize_t bytes_written =
+        pwrite(fd, write_range->data_, write_range->len_, write_range->offset());
+    if (bytes_written < write_range->len_) {
+      status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+          Substitute("pwrite($0, buffer, $1, $2) failed with errno=$3 description=$4",
+              write_range->file_, write_range->len_, write_range->offset(), errno,
+              GetStrErrMsg())));
+    } else if (ImpaladMetrics::IO_MGR_BYTES_WRITTEN != NULL) {
+      ImpaladMetrics::IO_MGR_BYTES_WRITTEN->Increment(write_range->len_);
+    }
+  }
+
+  success = close(fd);
+  if (status.ok() && success != 0) {
+    status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("close($0) failed", write_range->file_)));
+  }
+  return status;
+}
+
 int DiskIoMgr::free_buffers_idx(int64_t buffer_size) {
   int64_t buffer_size_scaled = BitUtil::Ceil(buffer_size, min_buffer_size_);
   int idx = BitUtil::Log2(buffer_size_scaled);
@@ -16,9 +16,12 @@
 #ifndef IMPALA_RUNTIME_DISK_IO_MGR_H
 #define IMPALA_RUNTIME_DISK_IO_MGR_H
 
+#include <limits>
 #include <list>
+#include <map>
 #include <vector>
 #include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
@@ -249,6 +252,28 @@ class DiskIoMgr {
     int64_t scan_range_offset_;
   };
 
+  // A file handle to an open hdfs file kept by the IoMgr's file handle cache so that
+  // hot files stay open across scan ranges and queries. The handle owns the underlying
+  // hdfsFile and closes it on destruction.
+  class HdfsCachedFileHandle {
+   public:
+    // Opens 'fname' on 'fs'. Check ok() to see whether the open succeeded.
+    HdfsCachedFileHandle(const hdfsFS& fs, const char* fname);
+
+    // Closes the file handle if it is open.
+    ~HdfsCachedFileHandle();
+
+    hdfsFS fs() const { return fs_; }
+    hdfsFile file() const { return hdfs_file_; }
+
+    // Returns false if the file could not be opened.
+    bool ok() const { return hdfs_file_ != NULL; }
+
+   private:
+    hdfsFS fs_;
+    hdfsFile hdfs_file_;
+  };
+
   // The request type, read or write associated with a request range.
   struct RequestType {
     enum type {
@@ -317,6 +342,14 @@ class DiskIoMgr {
     // Only one thread can be in GetNext() at any time.
     Status GetNext(BufferDescriptor** buffer);
 
+    // Batched version of GetNext(): appends every buffer that is already ready to
+    // 'buffers' in queue order, blocking only if none is ready, so the caller pays
+    // one lock acquisition and at most one condition variable wait per batch instead
+    // of per buffer. Stops after the eosr buffer. If called when all buffers have
+    // been returned, leaves 'buffers' empty and returns Status::OK. On error no
+    // buffers are returned. Obeys the same single-caller contract as GetNext().
+    Status GetNextBatch(std::vector<BufferDescriptor*>* buffers);
+
     // Cancel this scan range. This cleans up all queued buffers and
     // wakes up any threads blocked on GetNext().
     // Status is the reason the range was cancelled. Must not be ok().
@@ -357,9 +390,11 @@ class DiskIoMgr {
     // of bytes read. Updates range to keep track of where in the file we are.
     Status Read(char* buffer, int64_t* bytes_read, bool* eosr);
 
-    // Reads from the DN cache. On success, sets cached_buffer_ to the DN buffer
-    // and *read_succeeded to true.
-    // If the data is not cached, returns ok() and *read_succeeded is set to false.
+    // Reads zero-copy from the DN (either the HDFS cache or, with
+    // --experimental_zero_copy_local_reads, a local block's mmap'd file). On success,
+    // sets cached_buffer_ to the DN buffer and *read_succeeded to true.
+    // If the data cannot be served zero-copy, returns ok() and *read_succeeded is set
+    // to false; the caller falls back to the normal read path.
     // Returns a non-ok status if it ran into a non-continuable error.
     Status ReadFromCache(bool* read_succeeded);
 
@@ -384,10 +419,11 @@ class DiskIoMgr {
     // Reader/owner of the scan range
     RequestContext* reader_;
 
-    // File handle either to hdfs or local fs (FILE*)
+    // File handle either to hdfs or local fs (FILE*). The hdfs handle is borrowed
+    // from the IoMgr's file handle cache and returned in Close().
     union {
       FILE* local_file_;
-      hdfsFile hdfs_file_;
+      HdfsCachedFileHandle* hdfs_file_;
     };
 
     // If non-null, this is DN cached buffer. This means the cached read succeeded
@@ -499,8 +535,13 @@ class DiskIoMgr {
   //    used for this reader will be tracked by this. If the limit is exceeded
   //    the reader will be cancelled and MEM_LIMIT_EXCEEDED will be returned via
   //    GetNext().
+  // read_priority: contexts with a higher priority are picked ahead of
+  //    lower-priority ones when a disk queue has multiple waiting readers. Readers
+  //    that have waited longer than --disk_io_priority_timeout_ms are serviced
+  //    regardless of priority, so low-priority scans cannot starve.
   Status RegisterContext(RequestContext** request_context,
-      MemTracker* reader_mem_tracker = NULL);
+      MemTracker* reader_mem_tracker = NULL,
+      int read_priority = DEFAULT_READ_PRIORITY);
 
   // Unregisters context from the disk IoMgr. This must be called for every
   // RegisterContext() regardless of cancellation and must be called in the
@@ -571,6 +612,19 @@ class DiskIoMgr {
   int64_t bytes_read_dn_cache(RequestContext* reader) const;
   int num_remote_ranges(RequestContext* reader) const;
   int64_t unexpected_remote_bytes(RequestContext* reader) const;
+  int num_cached_ranges(RequestContext* reader) const;
+  int64_t cached_range_bytes(RequestContext* reader) const;
+
+  // Returns a file handle for 'fname' on 'fs', either served from the file handle
+  // cache or freshly opened. Returns NULL if the file could not be opened. The caller
+  // has exclusive use of the handle and must hand it back via CacheOrCloseFileHandle().
+  HdfsCachedFileHandle* OpenHdfsFile(const hdfsFS& fs, const char* fname);
+
+  // Returns a file handle obtained from OpenHdfsFile() to the cache so a later scan
+  // range can reuse it without reopening the file. The handle is closed instead if
+  // 'close' is true, caching is disabled (--max_cached_file_handles=0) or the cache
+  // is full (the oldest idle handle is evicted to make room).
+  void CacheOrCloseFileHandle(const char* fname, HdfsCachedFileHandle* fid, bool close);
 
   // Returns the read throughput across all readers.
   // TODO: should this be a sliding window?  This should report metrics for the
@@ -609,6 +663,10 @@ class DiskIoMgr {
   // since the system dynamically adjusts.
   static const int DEFAULT_QUEUE_CAPACITY;
 
+  // Default read priority for a request context. Higher values are serviced ahead
+  // of lower ones when a disk queue has multiple waiting readers.
+  static const int DEFAULT_READ_PRIORITY = 1;
+
   // "Disk" queue offsets for remote accesses.  Offset 0 corresponds to
   // disk ID (i.e. disk_queue_ index) of num_local_disks().
   enum {
@@ -642,9 +700,29 @@ class DiskIoMgr {
   // Thread group containing all the worker threads.
   ThreadGroup disk_thread_group_;
 
+  // Controller thread that adjusts per-disk thread counts at runtime. NULL unless
+  // --adaptive_disk_io_threads is enabled.
+  boost::scoped_ptr<Thread> disk_thread_controller_;
+
   // Options object for cached hdfs reads. Set on startup and never modified.
   struct hadoopRzOptions* cached_read_options_;
 
+  // Protects file_handle_cache_ and file_handle_fifo_.
+  boost::mutex file_handle_cache_lock_;
+
+  // Idle hdfs file handles kept open for reuse, keyed by file name. Each entry also
+  // stores its position in file_handle_fifo_ so it can be unlinked when handed out.
+  // Handles in use by a scan range are not in the cache. Only populated if
+  // --max_cached_file_handles > 0.
+  typedef std::multimap<std::string,
+      std::pair<HdfsCachedFileHandle*, std::list<std::string>::iterator> >
+      FileHandleCache;
+  FileHandleCache file_handle_cache_;
+
+  // Eviction order for file_handle_cache_; the least recently returned handle is at
+  // the front.
+  std::list<std::string> file_handle_fifo_;
+
   // True if the IoMgr should be torn down. Worker threads watch for this to
   // know to terminate. This variable is read/written to by different threads.
   volatile bool shut_down_;
@@ -664,18 +742,25 @@ class DiskIoMgr {
   // Protects free_buffers_ and free_buffer_descs_
   boost::mutex free_buffers_lock_;
 
-  // Free buffers that can be handed out to clients. There is one list for each buffer
-  // size, indexed by the Log2 of the buffer size in units of min_buffer_size_. The
-  // maximum buffer size is max_buffer_size_, so the maximum index is
-  // Log2(max_buffer_size_ / min_buffer_size_).
+  // Free buffers that can be handed out to clients. There is one list for each
+  // (buffer size, NUMA node) combination. The first index is the Log2 of the buffer
+  // size in units of min_buffer_size_; the maximum buffer size is max_buffer_size_, so
+  // the maximum first index is Log2(max_buffer_size_ / min_buffer_size_). The second
+  // index is the NUMA node the buffer's memory is expected to live on, i.e. the node
+  // of the thread that allocated it (first-touch places the pages there when the
+  // buffer is first read into).
   //
   // E.g. if min_buffer_size_ = 1024 bytes:
-  //  free_buffers_[0]  => list of free buffers with size 1024 B
-  //  free_buffers_[1]  => list of free buffers with size 2048 B
-  //  free_buffers_[10] => list of free buffers with size 1 MB
-  //  free_buffers_[13] => list of free buffers with size 8 MB
-  //  free_buffers_[n]  => list of free buffers with size 2^n * 1024 B
-  std::vector<std::list<char*> > free_buffers_;
+  //  free_buffers_[0][n]  => free buffers with size 1024 B on NUMA node n
+  //  free_buffers_[1][n]  => free buffers with size 2048 B on NUMA node n
+  //  free_buffers_[10][n] => free buffers with size 1 MB on NUMA node n
+  //  free_buffers_[13][n] => free buffers with size 8 MB on NUMA node n
+  std::vector<std::vector<std::list<char*> > > free_buffers_;
+
+  // Map from allocated io buffer to the NUMA node its list in free_buffers_ is picked
+  // from. Entries are added when a buffer is allocated and removed when it is really
+  // freed (GcIoBuffers() or over the free list cap). Protected by free_buffers_lock_.
+  boost::unordered_map<char*, int> buffer_numa_node_;
 
   // List of free buffer desc objects that can be handed out to clients
   std::list<BufferDescriptor*> free_buffer_descs_;
@@ -712,13 +797,18 @@ class DiskIoMgr {
   // and *buffer_size is set to the size of the buffer. If there is an
   // appropriately-sized free buffer in the 'free_buffers_', that is returned, otherwise
   // a new one is allocated. *buffer_size must be between 0 and max_buffer_size_.
+  // Free buffers on the calling thread's NUMA node are preferred, so that disk threads
+  // read into socket-local memory; a remote buffer is only used if the local list is
+  // empty, before growing the total number of buffers.
   char* GetFreeBuffer(int64_t* buffer_size);
 
-  // Garbage collect all unused io buffers. This is currently only triggered when the
-  // process wide limit is hit. This is not good enough. While it is sufficient for
-  // the IoMgr, other components do not trigger this GC.
+  // Garbage collect unused io buffers until at least 'bytes_to_free' bytes are freed
+  // (or all unused buffers are gone). Triggered via the process MemTracker's
+  // GcFunctions when it comes under limit pressure, so idle free list memory is
+  // reclaimed before any query is rejected for memory. Largest buffers are freed
+  // first, least recently returned first within a size.
   // TODO: make this run periodically?
-  void GcIoBuffers();
+  void GcIoBuffers(int64_t bytes_to_free = std::numeric_limits<int64_t>::max());
 
   // Returns a buffer to the free list. buffer_size / min_buffer_size_ should be a power
   // of 2, and buffer_size should be <= max_buffer_size_. These constraints will be met
@@ -734,6 +824,18 @@ class DiskIoMgr {
   // There can be multiple threads per disk running this loop.
   void WorkLoop(DiskQueue* queue);
 
+  // Creates a new WorkLoop() thread for 'disk_queue' and adds it to
+  // disk_thread_group_. Called from Init() and, when --adaptive_disk_io_threads is
+  // enabled, from the controller thread when it grows a queue's thread count.
+  void AddDiskThread(DiskQueue* disk_queue);
+
+  // Main loop of the adaptive disk thread controller. Periodically samples each disk
+  // queue's depth and average read latency and adjusts target_num_threads: queues
+  // with waiting work grow (up to max_num_threads) as long as latency holds up,
+  // while queues whose per-read latency has degraded well past the best observed
+  // (e.g. seek-bound spinning disks) shrink back toward a single thread.
+  void DiskThreadControllerLoop();
+
   // This is called from the disk thread to get the next range to process. It will
   // wait until a scan range and buffer are available, or a write range is available.
   // This functions returns the range to process.
@@ -767,6 +869,11 @@ class DiskIoMgr {
   // Does not open or close the file that is written.
   Status WriteRangeHelper(FILE* file_handle, WriteRange* write_range);
 
+  // Writes a range with O_DIRECT, bypassing the OS page cache. The range's buffer,
+  // offset and length must all be sector aligned. Opens and closes the file.
+  // Used for spill traffic when --spill_direct_io is set.
+  Status WriteRangeDirect(WriteRange* write_range);
+
   // Reads the specified scan range and calls HandleReadFinished when done.
   void ReadRange(DiskQueue* disk_queue, RequestContext* reader,
       ScanRange* range);
@@ -101,6 +101,13 @@ DEFINE_string(cgroup_hierarchy_path, "", "If Resource Management is enabled, thi
     "threads are assigned.");
 DEFINE_string(staging_cgroup, "impala_staging", "Name of the cgroup that a query's "
     "execution threads are moved into once the query completes.");
+DEFINE_string(cgroup_pool_cpu_shares, "", "(Advanced) Comma-separated list of "
+    "<request pool name>:<cpu shares> pairs, e.g. 'root.interactive:800,root.etl:200'. "
+    "For each pair a long-lived cgroup is created under --cgroup_hierarchy_path with "
+    "its cpu.shares set to the given weight, and fragments are executed in the cgroup "
+    "of their request pool, so that relative pool CPU weights are enforced when the "
+    "node is saturated. Pools not listed here run outside of any Impala-managed "
+    "cgroup. Requires --cgroup_hierarchy_path to be set.");
 
 // Use a low default value because the reconnection logic is performed manually
 // for the purpose of faster Llama failover (otherwise we may try to reconnect to the
@@ -287,6 +294,20 @@ Status ExecEnv::StartServices() {
         cgroups_mgr_->Init(FLAGS_cgroup_hierarchy_path, FLAGS_staging_cgroup));
   }
 
+  if (!FLAGS_cgroup_pool_cpu_shares.empty()) {
+    if (FLAGS_cgroup_hierarchy_path.empty()) {
+      return Status("--cgroup_pool_cpu_shares requires --cgroup_hierarchy_path "
+          "to be set");
+    }
+    // Without RM the cgroups mgr has not been created or initialized yet.
+    if (cgroups_mgr_.get() == NULL) {
+      cgroups_mgr_.reset(new CgroupsMgr(metrics_.get()));
+      RETURN_IF_ERROR(
+          cgroups_mgr_->Init(FLAGS_cgroup_hierarchy_path, FLAGS_staging_cgroup));
+    }
+    RETURN_IF_ERROR(cgroups_mgr_->InitPoolCgroups(FLAGS_cgroup_pool_cpu_shares));
+  }
+
   // Initialize global memory limit.
   // Depending on the system configuration, we will have to calculate the process
   // memory limit either based on the available physical memory, or if overcommitting
@@ -337,6 +358,8 @@ Status ExecEnv::StartServices() {
   metrics_->Init(enable_webserver_ ? webserver_.get() : NULL);
   impalad_client_cache_->InitMetrics(metrics_.get(), "impala-server.backends");
   catalogd_client_cache_->InitMetrics(metrics_.get(), "catalog.server");
+  impalad_client_cache_->StartConnectionValidation();
+  catalogd_client_cache_->StartConnectionValidation();
   RETURN_IF_ERROR(RegisterMemoryMetrics(metrics_.get(), true));
 
 #ifndef ADDRESS_SANITIZER
@@ -48,11 +48,27 @@ class FreePool {
     : mem_pool_(mem_pool),
       net_allocations_(0) {
     memset(&lists_, 0, sizeof(lists_));
+#ifdef ALLOC_PROFILING
+    allocation_counters_ = NULL;
+#endif
+  }
+
+#ifdef ALLOC_PROFILING
+  // Attributes subsequent Allocate() calls to 'counters', which must outlive the pool.
+  // May be NULL to detach.
+  void set_allocation_counters(AllocationCounters* counters) {
+    allocation_counters_ = counters;
   }
+#endif
 
   // Allocates a buffer of size.
   uint8_t* Allocate(int size) {
     ++net_allocations_;
+#ifdef ALLOC_PROFILING
+    // Recycled allocations count too: the call count is the signal here. Bytes record
+    // the requested size, not the power-of-2 the pool rounds up to.
+    UpdateAllocationCounters(allocation_counters_, size);
+#endif
     if (FLAGS_disable_mem_pools) return reinterpret_cast<uint8_t*>(malloc(size));
 
     // This is the typical malloc behavior. NULL is reserved for failures.
@@ -179,6 +195,11 @@ class FreePool {
 
   // Diagnostic counter that tracks (# Allocates - # Frees)
   int64_t net_allocations_;
+
+#ifdef ALLOC_PROFILING
+  // Counters Allocate() calls are recorded against; NULL if the pool is unattributed.
+  AllocationCounters* allocation_counters_;
+#endif
 };
 
 }
@@ -283,6 +283,28 @@ TEST(MemPoolTest, Limits) {
   delete p2;
 }
 
+// Tests that a chunk freed on this thread is handed back for an identically sized
+// request instead of going back to malloc.
+TEST(MemPoolTest, ThreadChunkCache) {
+  MemPool::ClearThreadChunkCacheForTesting();
+  MemTracker tracker;
+  MemPool p(&tracker);
+  uint8_t* mem = p.Allocate(4 * 1024);
+  EXPECT_TRUE(mem != NULL);
+  p.FreeAll();
+  EXPECT_EQ(tracker.consumption(), 0);
+
+  // The chunk went to the thread's cache, so the next pool gets the same buffer back
+  // and consumption is counted against the new pool's tracker as usual.
+  MemPool p2(&tracker);
+  uint8_t* mem2 = p2.Allocate(4 * 1024);
+  EXPECT_EQ(mem, mem2);
+  EXPECT_EQ(tracker.consumption(), 4 * 1024);
+  p2.FreeAll();
+
+  MemPool::ClearThreadChunkCacheForTesting();
+}
+
 }
 
 int main(int argc, char **argv) {
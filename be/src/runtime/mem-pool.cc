@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <sstream>
 
+#include <boost/thread/tss.hpp>
+
 DECLARE_bool(disable_mem_pools);
 
 using namespace std;
@@ -29,6 +31,92 @@ const int MemPool::DEFAULT_INITIAL_CHUNK_SIZE;
 
 const char* MemPool::LLVM_CLASS_NAME = "class.impala::MemPool";
 
+// Bounds for the per-thread chunk cache. Chunks bigger than MAX_CACHEABLE_CHUNK_SIZE
+// always go back to malloc; beyond the count/byte limits Put() declines and the caller
+// frees the chunk as before.
+static const int MAX_CACHED_CHUNKS_PER_THREAD = 8;
+static const int64_t MAX_CACHED_BYTES_PER_THREAD = 4 * 1024 * 1024;
+static const int MAX_CACHEABLE_CHUNK_SIZE = 1024 * 1024;
+
+// Per-thread cache of free chunk buffers. FindChunk() draws from it and FreeAll()
+// returns chunks to it without any synchronization, cutting the malloc/free traffic
+// on the allocator's central free list when many scanner threads cycle chunks.
+// MemTrackers only account for chunks owned by pools, so cached buffers are untracked,
+// the same as buffers returned to malloc. ImpaladMetrics::MEM_POOL_TOTAL_BYTES keeps
+// counting cached buffers; it is decremented when the cache frees them (on overflow or
+// at thread exit).
+class MemPool::ThreadChunkCache {
+ public:
+  // Returns a cached chunk of exactly 'size' bytes, or NULL if the cache doesn't have
+  // one. Only exact sizes are returned so chunk size selection (and therefore reserved
+  // bytes) stays identical to going through malloc; since chunk sizes follow the
+  // doubling policy or a pool's fixed size, exact repeats are the common case.
+  static uint8_t* Get(int size) {
+    if (FLAGS_disable_mem_pools) return NULL;
+    ThreadChunkCache* cache = tls_cache_.get();
+    if (cache == NULL) return NULL;
+    for (int i = 0; i < cache->chunks_.size(); ++i) {
+      if (cache->chunks_[i].second != size) continue;
+      uint8_t* data = cache->chunks_[i].first;
+      cache->total_bytes_ -= size;
+      cache->chunks_[i] = cache->chunks_.back();
+      cache->chunks_.pop_back();
+      return data;
+    }
+    return NULL;
+  }
+
+  // Takes ownership of 'data' ('size' bytes) if it is cacheable and the cache has
+  // room. Returns false if the caller should free() the chunk instead.
+  static bool Put(uint8_t* data, int size) {
+    if (FLAGS_disable_mem_pools) return false;
+    if (size > MAX_CACHEABLE_CHUNK_SIZE) return false;
+    ThreadChunkCache* cache = tls_cache_.get();
+    if (cache == NULL) {
+      cache = new ThreadChunkCache;
+      tls_cache_.reset(cache);
+    }
+    if (cache->chunks_.size() >= MAX_CACHED_CHUNKS_PER_THREAD ||
+        cache->total_bytes_ + size > MAX_CACHED_BYTES_PER_THREAD) {
+      return false;
+    }
+    cache->chunks_.push_back(make_pair(data, size));
+    cache->total_bytes_ += size;
+    return true;
+  }
+
+  // Frees the calling thread's cached chunks.
+  static void Clear() { tls_cache_.reset(); }
+
+  ~ThreadChunkCache() {
+    for (int i = 0; i < chunks_.size(); ++i) {
+      free(chunks_[i].first);
+    }
+    if (ImpaladMetrics::MEM_POOL_TOTAL_BYTES != NULL) {
+      ImpaladMetrics::MEM_POOL_TOTAL_BYTES->Increment(-total_bytes_);
+    }
+  }
+
+ private:
+  ThreadChunkCache() : total_bytes_(0) { }
+
+  // Destroyed (freeing any cached chunks) when the thread exits.
+  static boost::thread_specific_ptr<ThreadChunkCache> tls_cache_;
+
+  // (buffer, size) for each cached chunk.
+  std::vector<std::pair<uint8_t*, int> > chunks_;
+
+  // Sum of the cached chunk sizes.
+  int64_t total_bytes_;
+};
+
+boost::thread_specific_ptr<MemPool::ThreadChunkCache>
+    MemPool::ThreadChunkCache::tls_cache_;
+
+void MemPool::ClearThreadChunkCacheForTesting() {
+  ThreadChunkCache::Clear();
+}
+
 MemPool::MemPool(MemTracker* mem_tracker, int chunk_size)
   : current_chunk_idx_(-1),
     last_offset_conversion_chunk_idx_(-1),
@@ -42,39 +130,49 @@ MemPool::MemPool(MemTracker* mem_tracker, int chunk_size)
     mem_tracker_(mem_tracker) {
   DCHECK_GE(chunk_size_, 0);
   DCHECK(mem_tracker != NULL);
+#ifdef ALLOC_PROFILING
+  allocation_counters_ = NULL;
+#endif
 }
 
-MemPool::ChunkInfo::ChunkInfo(int size)
+MemPool::ChunkInfo::ChunkInfo(uint8_t* buf, int size)
   : owns_data(true),
-    data(reinterpret_cast<uint8_t*>(malloc(size))),
+    data(buf != NULL ? buf : reinterpret_cast<uint8_t*>(malloc(size))),
     size(size),
     cumulative_allocated_bytes(0),
     allocated_bytes(0) {
-  if (ImpaladMetrics::MEM_POOL_TOTAL_BYTES != NULL) {
+  // Buffers from the thread chunk cache are already counted in the metric.
+  if (buf == NULL && ImpaladMetrics::MEM_POOL_TOTAL_BYTES != NULL) {
     ImpaladMetrics::MEM_POOL_TOTAL_BYTES->Increment(size);
   }
 }
 
 MemPool::~MemPool() {
-  int64_t total_bytes_released = 0;
+  int64_t total_bytes_freed = 0;
   for (size_t i = 0; i < chunks_.size(); ++i) {
     if (!chunks_[i].owns_data) continue;
-    total_bytes_released += chunks_[i].size;
-    free(chunks_[i].data);
+    if (!ThreadChunkCache::Put(chunks_[i].data, chunks_[i].size)) {
+      total_bytes_freed += chunks_[i].size;
+      free(chunks_[i].data);
+    }
   }
 
   DCHECK(chunks_.empty()) << "Must call FreeAll() or AcquireData() for this pool";
   if (ImpaladMetrics::MEM_POOL_TOTAL_BYTES != NULL) {
-    ImpaladMetrics::MEM_POOL_TOTAL_BYTES->Increment(-total_bytes_released);
+    ImpaladMetrics::MEM_POOL_TOTAL_BYTES->Increment(-total_bytes_freed);
   }
 }
 
 void MemPool::FreeAll() {
   int64_t total_bytes_released = 0;
+  int64_t total_bytes_freed = 0;
   for (size_t i = 0; i < chunks_.size(); ++i) {
     if (!chunks_[i].owns_data) continue;
     total_bytes_released += chunks_[i].size;
-    free(chunks_[i].data);
+    if (!ThreadChunkCache::Put(chunks_[i].data, chunks_[i].size)) {
+      total_bytes_freed += chunks_[i].size;
+      free(chunks_[i].data);
+    }
   }
   chunks_.clear();
   current_chunk_idx_ = -1;
@@ -84,7 +182,7 @@ void MemPool::FreeAll() {
 
   mem_tracker_->Release(total_bytes_released);
   if (ImpaladMetrics::MEM_POOL_TOTAL_BYTES != NULL) {
-    ImpaladMetrics::MEM_POOL_TOTAL_BYTES->Increment(-total_bytes_released);
+    ImpaladMetrics::MEM_POOL_TOTAL_BYTES->Increment(-total_bytes_freed);
   }
 }
 
@@ -123,8 +221,14 @@ bool MemPool::FindChunk(int min_size, bool check_limits) {
 
     if (FLAGS_disable_mem_pools) chunk_size = min_size;
 
+    // Check the thread's chunk cache before going to malloc.
+    uint8_t* buf = ThreadChunkCache::Get(chunk_size);
+
     if (check_limits) {
       if (!mem_tracker_->TryConsume(chunk_size)) {
+        // Hand the unused chunk back before failing. Put() can't refuse it: Get()
+        // just made room for a chunk of exactly this size.
+        if (buf != NULL && !ThreadChunkCache::Put(buf, chunk_size)) free(buf);
         // We couldn't allocate a new chunk so current_chunk_idx_ is now be past the
         // end of chunks_.
         DCHECK_EQ(current_chunk_idx_, static_cast<int>(chunks_.size()));
@@ -137,11 +241,11 @@ bool MemPool::FindChunk(int min_size, bool check_limits) {
 
     // If there are no free chunks put it at the end, otherwise before the first free.
     if (first_free_idx == static_cast<int>(chunks_.size())) {
-      chunks_.push_back(ChunkInfo(chunk_size));
+      chunks_.push_back(ChunkInfo(buf, chunk_size));
     } else {
       current_chunk_idx_ = first_free_idx;
       vector<ChunkInfo>::iterator insert_chunk = chunks_.begin() + current_chunk_idx_;
-      chunks_.insert(insert_chunk, ChunkInfo(chunk_size));
+      chunks_.insert(insert_chunk, ChunkInfo(buf, chunk_size));
     }
     total_reserved_bytes_ += chunk_size;
   }
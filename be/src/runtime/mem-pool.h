@@ -28,6 +28,40 @@ namespace impala {
 
 class MemTracker;
 
+#ifdef ALLOC_PROFILING
+// Per-operator allocation counters, only compiled in ALLOC_PROFILING builds.
+// An exec node creates one set of these in its runtime profile and attaches it to the
+// pools it owns; every Allocate() call then shows up in the profile with its size
+// class, which is what lets malloc load seen in system profiles be attributed back to
+// an operator.
+struct AllocationCounters {
+  RuntimeProfile::Counter* calls;
+  RuntimeProfile::Counter* bytes;
+  // Size-class call counts: small <= 512 bytes, medium <= 32KB, large above. The
+  // boundaries roughly separate per-value allocations, per-batch buffers and chunks.
+  RuntimeProfile::Counter* small_calls;
+  RuntimeProfile::Counter* medium_calls;
+  RuntimeProfile::Counter* large_calls;
+
+  AllocationCounters()
+    : calls(NULL), bytes(NULL), small_calls(NULL), medium_calls(NULL),
+      large_calls(NULL) {}
+};
+
+inline void UpdateAllocationCounters(AllocationCounters* counters, int64_t size) {
+  if (counters == NULL) return;
+  counters->calls->Add(1);
+  counters->bytes->Add(size);
+  if (size <= 512) {
+    counters->small_calls->Add(1);
+  } else if (size <= 32 * 1024) {
+    counters->medium_calls->Add(1);
+  } else {
+    counters->large_calls->Add(1);
+  }
+}
+#endif
+
 // A MemPool maintains a list of memory chunks from which it allocates memory in
 // response to Allocate() calls;
 // Chunks stay around for the lifetime of the mempool or until they are passed on to
@@ -150,6 +184,14 @@ class MemPool {
   int64_t total_reserved_bytes() const { return total_reserved_bytes_; }
   MemTracker* mem_tracker() { return mem_tracker_; }
 
+#ifdef ALLOC_PROFILING
+  // Attributes subsequent Allocate() calls to 'counters', which must outlive the pool.
+  // May be NULL to detach.
+  void set_allocation_counters(AllocationCounters* counters) {
+    allocation_counters_ = counters;
+  }
+#endif
+
   // Return sum of chunk_sizes_.
   int64_t GetTotalChunkSizes() const;
 
@@ -172,6 +214,10 @@ class MemPool {
   // Print allocated bytes from all chunks.
   std::string DebugPrint();
 
+  // Frees all chunks cached by the calling thread. Only used by tests, to make chunk
+  // reuse deterministic.
+  static void ClearThreadChunkCacheForTesting();
+
   // TODO: make a macro for doing this
   // For C++/IR interop, we need to be able to look up types by name.
   static const char* LLVM_CLASS_NAME;
@@ -180,6 +226,11 @@ class MemPool {
   friend class MemPoolTest;
   static const int DEFAULT_INITIAL_CHUNK_SIZE = 4 * 1024;
 
+  // Small per-thread cache of free chunk buffers, so that the frequent
+  // FindChunk()/FreeAll() turnover in scanner and exchange threads doesn't hit the
+  // allocator's central free list from every core. See mem-pool.cc.
+  class ThreadChunkCache;
+
   struct ChunkInfo {
     bool owns_data;  // true if we eventually need to dealloc data
     uint8_t* data;
@@ -193,7 +244,9 @@ class MemPool {
     // bytes allocated via Allocate() in this chunk
     int allocated_bytes;
 
-    explicit ChunkInfo(int size);
+    // Wraps 'buf' (of 'size' bytes) if non-NULL, otherwise mallocs a new buffer of
+    // 'size' bytes.
+    ChunkInfo(uint8_t* buf, int size);
 
     ChunkInfo()
       : owns_data(true),
@@ -231,6 +284,11 @@ class MemPool {
   // total allocated_bytes_ since it includes bytes in chunks that are not used.
   MemTracker* mem_tracker_;
 
+#ifdef ALLOC_PROFILING
+  // Counters Allocate() calls are recorded against; NULL if the pool is unattributed.
+  AllocationCounters* allocation_counters_;
+#endif
+
   // Find or allocated a chunk with at least min_size spare capacity and update
   // current_chunk_idx_. Also updates chunks_, chunk_sizes_ and allocated_bytes_
   // if a new chunk needs to be created.
@@ -275,6 +333,9 @@ class MemPool {
     total_allocated_bytes_ += num_bytes;
     DCHECK_LE(current_chunk_idx_, chunks_.size() - 1);
     peak_allocated_bytes_ = std::max(total_allocated_bytes_, peak_allocated_bytes_);
+#ifdef ALLOC_PROFILING
+    UpdateAllocationCounters(allocation_counters_, num_bytes);
+#endif
     return result;
   }
 };
@@ -130,6 +130,29 @@ TEST(MemTestTest, TrackerHierarchy) {
   EXPECT_FALSE(p.LimitExceeded());
 }
 
+TEST(MemTestTest, ConsumptionBatching) {
+  const int64_t batch = 1024 * 1024;  // CONSUMPTION_BATCH_SIZE
+  MemTracker p;
+  MemTracker c(-1, -1, "", &p);
+
+  // With every limit far away (here: no limits at all), updates are batched in the
+  // consuming tracker and only folded into the parent once a full batch is pending.
+  c.Consume(batch / 2);
+  EXPECT_EQ(c.consumption(), batch / 2);
+  EXPECT_EQ(p.consumption(), 0);
+  c.Consume(batch / 2);
+  EXPECT_EQ(c.consumption(), batch);
+  EXPECT_EQ(p.consumption(), batch);
+
+  // Releases batch symmetrically.
+  c.Release(batch / 2);
+  EXPECT_EQ(c.consumption(), batch / 2);
+  EXPECT_EQ(p.consumption(), batch);
+  c.Release(batch / 2);
+  EXPECT_EQ(c.consumption(), 0);
+  EXPECT_EQ(p.consumption(), 0);
+}
+
 class GcFunctionHelper {
  public:
   static const int NUM_RELEASE_BYTES = 1;
@@ -190,6 +190,9 @@ shared_ptr<MemTracker> MemTracker::GetQueryMemTracker(
 }
 
 MemTracker::~MemTracker() {
+  // Fold any batched consumption into the ancestors so their counters stay consistent
+  // with what was reported through this tracker.
+  if (pending_consumption_ != 0) FlushPendingConsumption();
   lock_guard<mutex> l(static_mem_trackers_lock_);
   if (auto_unregister_) UnregisterFromParent();
   // Erase the weak ptr reference from the map.
@@ -268,9 +271,11 @@ bool MemTracker::GcMemory(int64_t max_consumption) {
   if (pre_gc_consumption < max_consumption) return false;
   if (num_gcs_metric_ != NULL) num_gcs_metric_->Increment(1);
 
-  // Try to free up some memory
+  // Try to free up some memory. Each function is only asked for the remaining
+  // deficit, so it can trim just enough from its free lists instead of dumping
+  // everything, and later functions only run if earlier ones didn't free enough.
   for (int i = 0; i < gc_functions_.size(); ++i) {
-    gc_functions_[i]();
+    gc_functions_[i](consumption() - max_consumption);
     if (consumption_metric_ != NULL) consumption_->Set(consumption_metric_->value());
     if (consumption() <= max_consumption) break;
   }
@@ -115,6 +115,11 @@ class MemTracker {
   }
 
   // Increases consumption of this tracker and its ancestors by 'bytes'.
+  // While every limit in the hierarchy has plenty of spare capacity (see
+  // CanBatchConsumption()), updates are accumulated in this tracker and only folded
+  // into the ancestors once CONSUMPTION_BATCH_SIZE bytes are pending, so that the hot
+  // allocation path doesn't update a contended counter per ancestor on every call.
+  // Near a limit every update is applied exactly, so enforcement is unchanged.
   void Consume(int64_t bytes) {
     if (bytes < 0) {
       Release(-bytes);
@@ -128,6 +133,13 @@ class MemTracker {
     }
     if (bytes == 0) return;
     if (UNLIKELY(enable_logging_)) LogUpdate(true, bytes);
+    if (CanBatchConsumption()) {
+      if (pending_consumption_.UpdateAndFetch(bytes) < CONSUMPTION_BATCH_SIZE) return;
+      FlushPendingConsumption();
+      return;
+    }
+    // Within BATCHING_HEADROOM of a limit: apply everything exactly.
+    if (UNLIKELY(pending_consumption_ != 0)) FlushPendingConsumption();
     for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
          tracker != all_trackers_.end(); ++tracker) {
       (*tracker)->consumption_->Add(bytes);
@@ -164,6 +176,8 @@ class MemTracker {
     if (consumption_metric_ != NULL) consumption_->Set(consumption_metric_->value());
     if (bytes <= 0) return true;
     if (UNLIKELY(enable_logging_)) LogUpdate(true, bytes);
+    // Fold in any batched updates first so the limit checks below see them.
+    if (UNLIKELY(pending_consumption_ != 0)) FlushPendingConsumption();
     int i = 0;
     // Walk the tracker tree top-down, to avoid expanding a limit on a child whose parent
     // won't accommodate the change.
@@ -223,6 +237,12 @@ class MemTracker {
     }
     if (bytes == 0) return;
     if (UNLIKELY(enable_logging_)) LogUpdate(false, bytes);
+    if (CanBatchConsumption()) {
+      if (pending_consumption_.UpdateAndFetch(-bytes) > -CONSUMPTION_BATCH_SIZE) return;
+      FlushPendingConsumption();
+      return;
+    }
+    if (UNLIKELY(pending_consumption_ != 0)) FlushPendingConsumption();
     for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
          tracker != all_trackers_.end(); ++tracker) {
       (*tracker)->consumption_->Add(-bytes);
@@ -294,8 +314,13 @@ class MemTracker {
     return v;
   }
 
-  // Returns the memory consumed in bytes.
-  int64_t consumption() const { return consumption_->current_value(); }
+  // Returns the memory consumed in bytes. Includes bytes batched by this tracker that
+  // haven't been folded into the hierarchy yet; updates batched by descendants only
+  // show up here once they flush, so this can read low by at most
+  // CONSUMPTION_BATCH_SIZE per descendant that consumes directly.
+  int64_t consumption() const {
+    return consumption_->current_value() + pending_consumption_;
+  }
 
   // Note that if consumption_ is based on consumption_metric_, this will the max value
   // we've recorded in consumption(), not necessarily the highest value
@@ -304,8 +329,11 @@ class MemTracker {
 
   MemTracker* parent() const { return parent_; }
 
-  // Signature for function that can be called to free some memory after limit is reached.
-  typedef boost::function<void ()> GcFunction;
+  // Signature for function that can be called to free some memory after limit is
+  // reached. The function should try to free at least 'bytes_to_free' bytes but may
+  // free less (or more). Functions bound with fewer arguments (e.g. tcmalloc's
+  // ReleaseFreeMemory) simply ignore the hint and free what they can.
+  typedef boost::function<void (int64_t bytes_to_free)> GcFunction;
 
   // Add a function 'f' to be called if the limit is reached.
   // 'f' does not need to be thread-safe as long as it is added to only one MemTracker.
@@ -329,6 +357,33 @@ class MemTracker {
  private:
   bool CheckLimitExceeded() const { return limit_ >= 0 && limit_ < consumption(); }
 
+  // Returns true if Consume()/Release() may batch their update locally instead of
+  // applying it to every ancestor: every tracker with a limit must have at least
+  // BATCHING_HEADROOM bytes of spare capacity. Reading the ancestors' counters here is
+  // much cheaper than the atomic updates it replaces since the cache lines can stay
+  // shared between cores.
+  bool CanBatchConsumption() const {
+    for (std::vector<MemTracker*>::const_iterator tracker = limit_trackers_.begin();
+         tracker != limit_trackers_.end(); ++tracker) {
+      if ((*tracker)->consumption() + BATCHING_HEADROOM >= (*tracker)->effective_limit()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Folds any batched bytes into this tracker and all of its ancestors. The DCHECK from
+  // Consume()/Release() is omitted here: concurrent flushes with opposite signs can
+  // reorder and make an ancestor's counter transiently negative.
+  void FlushPendingConsumption() {
+    int64_t bytes = pending_consumption_.Swap(0);
+    if (bytes == 0) return;
+    for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
+         tracker != all_trackers_.end(); ++tracker) {
+      (*tracker)->consumption_->Add(bytes);
+    }
+  }
+
   // If consumption is higher than max_consumption, attempts to free memory by calling any
   // added GC functions.  Returns true if max_consumption is still exceeded. Takes
   // gc_lock. Updates metrics if initialized.
@@ -363,6 +418,15 @@ class MemTracker {
   // more memory than was requested.
   bool ExpandRmReservation(int64_t bytes);
 
+  // Number of batched bytes at which Consume()/Release() fold their pending update
+  // into the tracker hierarchy.
+  static const int64_t CONSUMPTION_BATCH_SIZE = 1024L * 1024L;
+
+  // Minimum spare capacity every limit must have before updates are batched; below
+  // this, every update is applied exactly. Must comfortably exceed the sum of what
+  // concurrent consumers can hold batched (CONSUMPTION_BATCH_SIZE each).
+  static const int64_t BATCHING_HEADROOM = 64 * CONSUMPTION_BATCH_SIZE;
+
   // Size, in bytes, that is considered a large value for Release() (or Consume() with
   // a negative value). If tcmalloc is used, this can trigger it to GC.
   // A higher value will make us call into tcmalloc less often (and therefore more
@@ -414,6 +478,10 @@ class MemTracker {
   // in bytes; not owned
   RuntimeProfile::HighWaterMarkCounter* consumption_;
 
+  // Bytes from Consume()/Release() calls on this tracker that have not been applied
+  // to consumption_ (or any ancestor's) yet. See Consume().
+  AtomicInt<int64_t> pending_consumption_;
+
   // holds consumption_ counter if not tied to a profile
   RuntimeProfile::HighWaterMarkCounter local_counter_;
 
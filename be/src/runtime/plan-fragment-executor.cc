@@ -36,6 +36,8 @@
 #include "runtime/mem-tracker.h"
 #include "util/cgroups-mgr.h"
 #include "util/cpu-info.h"
+#include "util/impalad-metrics.h"
+#include "util/cpu-sampler.h"
 #include "util/debug-util.h"
 #include "util/container-util.h"
 #include "util/parse-util.h"
@@ -46,7 +48,18 @@
 
 DEFINE_bool(serialize_batch, false, "serialize and deserialize each returned row batch");
 DEFINE_int32(status_report_interval, 5, "interval between profile reports; in seconds");
+DEFINE_bool(async_codegen, true, "If true, plan fragments start executing on the "
+    "interpreted expression paths while codegen optimization and jitting run on a "
+    "background thread; jitted functions are picked up at batch boundaries as they "
+    "become ready. Fragments that registered functions without an interpreted "
+    "fallback (e.g. codegen'd UDF wrappers) always compile before executing.");
+DEFINE_int64(codegen_rows_threshold, 50000, "Fragments whose plan root has a limit "
+    "below this many rows run interpreted instead of codegen'd, since compilation time "
+    "would dominate. The default is a conservative bound; recalibrate it against the "
+    "break-even column of expr-codegen-crossover-benchmark after toolchain or codegen "
+    "changes. 0 disables the threshold.");
 DECLARE_bool(enable_rm);
+DECLARE_int32(max_cached_descriptor_tbls);
 
 using namespace std;
 using namespace boost;
@@ -78,6 +91,7 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   fragment_sw_.Start();
   const TPlanFragmentExecParams& params = request.params;
   query_id_ = request.fragment_instance_ctx.query_ctx.query_id;
+  CpuSampler::SetThreadContext(query_id_);
 
   VLOG_QUERY << "Prepare(): query_id=" << PrintId(query_id_) << " instance_id="
              << PrintId(request.fragment_instance_ctx.fragment_instance_id);
@@ -91,6 +105,11 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   string cgroup = "";
   if (FLAGS_enable_rm && request.__isset.reserved_resource) {
     cgroup = exec_env_->cgroups_mgr()->UniqueIdToCgroup(PrintId(query_id_, "_"));
+  } else if (exec_env_->cgroups_mgr() != NULL) {
+    // If per-pool cgroups are configured (--cgroup_pool_cpu_shares), execute this
+    // fragment in the long-lived cgroup of its request pool so that relative pool CPU
+    // weights are enforced. Returns an empty string if the pool has no cgroup.
+    cgroup = exec_env_->cgroups_mgr()->RequestPoolToCgroup(params.request_pool);
   }
 
   runtime_state_.reset(
@@ -184,8 +203,16 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   // set up desc tbl
   DescriptorTbl* desc_tbl = NULL;
   DCHECK(request.__isset.desc_tbl);
-  RETURN_IF_ERROR(
-      DescriptorTbl::Create(obj_pool(), request.desc_tbl, &desc_tbl));
+  if (FLAGS_max_cached_descriptor_tbls > 0 && !runtime_state_->codegen_enabled()) {
+    // Repeated queries against the same tables carry identical descriptor tables, so
+    // share one deserialized copy process-wide. Fragments running with codegen can't
+    // share: the descriptors cache codegen'd IR, which is per-fragment state.
+    RETURN_IF_ERROR(DescriptorTbl::CreateShared(request.desc_tbl, &shared_desc_tbl_));
+    desc_tbl = shared_desc_tbl_.get();
+  } else {
+    RETURN_IF_ERROR(
+        DescriptorTbl::Create(obj_pool(), request.desc_tbl, &desc_tbl));
+  }
   runtime_state_->set_desc_tbl(desc_tbl);
   VLOG_QUERY << "descriptor table for fragment="
              << request.fragment_instance_ctx.fragment_instance_id
@@ -195,8 +222,19 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   DCHECK(request.__isset.fragment);
   RETURN_IF_ERROR(
       ExecNode::CreateTree(obj_pool(), request.fragment.plan, *desc_tbl, &plan_));
+  ExecNode::FuseSelectNodes(&plan_);
   runtime_state_->set_fragment_root_id(plan_->id());
 
+  // The plan root's limit is the only per-fragment output bound available in the
+  // backend. When it guarantees fewer rows than the interpret/codegen break-even
+  // point, compilation could never pay for itself, so run this fragment interpreted.
+  if (FLAGS_codegen_rows_threshold > 0 && runtime_state_->codegen_enabled() &&
+      plan_->limit() >= 0 && plan_->limit() < FLAGS_codegen_rows_threshold) {
+    VLOG_QUERY << "Disabling codegen: plan root limit " << plan_->limit()
+               << " is below codegen_rows_threshold=" << FLAGS_codegen_rows_threshold;
+    runtime_state_->DisableCodegen();
+  }
+
   if (request.params.__isset.debug_node_id) {
     DCHECK(request.params.__isset.debug_action);
     DCHECK(request.params.__isset.debug_phase);
@@ -256,6 +294,10 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
       ADD_COUNTER(profile(), "RowsProduced", TUnit::UNIT);
   per_host_mem_usage_ =
       ADD_COUNTER(profile(), PER_HOST_PEAK_MEM_COUNTER, TUnit::BYTES);
+  get_next_time_distribution_ =
+      profile()->AddHistogramCounter("GetNextTimeDistribution", TUnit::TIME_NS);
+  rows_per_batch_distribution_ =
+      profile()->AddHistogramCounter("RowsPerBatchDistribution", TUnit::UNIT);
 
   row_batch_.reset(new RowBatch(plan_->row_desc(), runtime_state_->batch_size(),
         runtime_state_->instance_mem_tracker()));
@@ -270,7 +312,32 @@ void PlanFragmentExecutor::OptimizeLlvmModule() {
   Status status = runtime_state_->GetCodegen(&codegen, /* initalize */ false);
   DCHECK(status.ok());
   DCHECK_NOTNULL(codegen);
+  if (FLAGS_async_codegen && !codegen->fn_ptrs_required_before_exec()) {
+    // All registered function pointers are NULL-checked wherever they are consumed,
+    // with the interpreted path as the fallback, so execution can start interpreted
+    // and pick up the jitted versions at the next batch boundary once compilation is
+    // done. The thread is joined in Close(), before the codegen object is torn down.
+    async_codegen_thread_.reset(
+        new Thread("plan-fragment-executor", "async-codegen",
+            &PlanFragmentExecutor::FinalizeCodegen, this));
+    return;
+  }
+  FinalizeCodegen();
+}
+
+void PlanFragmentExecutor::FinalizeCodegen() {
+  LlvmCodeGen* codegen;
+  Status status = runtime_state_->GetCodegen(&codegen, /* initalize */ false);
+  DCHECK(status.ok());
+  DCHECK_NOTNULL(codegen);
+  MonotonicStopWatch compile_time;
+  compile_time.Start();
   status = codegen->FinalizeModule();
+  compile_time.Stop();
+  if (ImpaladMetrics::CODEGEN_COMPILE_TIMES != NULL) {
+    ImpaladMetrics::CODEGEN_COMPILE_TIMES->Update(
+        compile_time.ElapsedTime() / (1000.0 * 1000.0));
+  }
   if (!status.ok()) {
     stringstream ss;
     ss << "Error with codegen for this query: " << status.GetDetail();
@@ -278,6 +345,12 @@ void PlanFragmentExecutor::OptimizeLlvmModule() {
   }
 }
 
+void PlanFragmentExecutor::WaitForAsyncCodegen() {
+  if (async_codegen_thread_.get() == NULL) return;
+  async_codegen_thread_->Join();
+  async_codegen_thread_.reset();
+}
+
 void PlanFragmentExecutor::PrintVolumeIds(
     const PerNodeScanRanges& per_node_scan_ranges) {
   if (per_node_scan_ranges.empty()) return;
@@ -299,6 +372,18 @@ void PlanFragmentExecutor::PrintVolumeIds(
 Status PlanFragmentExecutor::Open() {
   VLOG_QUERY << "Open(): instance_id="
       << runtime_state_->fragment_instance_id();
+  // Open() can run on a different thread than Prepare(); re-publish the attribution
+  // for CPU sampling.
+  CpuSampler::SetThreadContext(query_id_);
+  // Assign the fragment execution thread to the fragment's cgroup. Scanner and join
+  // build threads are assigned via their ThreadGroup (see HdfsScanNode::Open()), but
+  // work done on this thread is not covered by those hooks. Threads are re-assigned
+  // every time they pick up a fragment with a cgroup, so recycled threads end up in
+  // the right place.
+  if (!runtime_state_->cgroup().empty()) {
+    RETURN_IF_ERROR(exec_env_->cgroups_mgr()->AssignCurrentThreadToCgroup(
+        runtime_state_->cgroup()));
+  }
   // we need to start the profile-reporting thread before calling Open(), since it
   // may block
   if (!report_status_cb_.empty() && FLAGS_status_report_interval > 0) {
@@ -474,8 +559,12 @@ Status PlanFragmentExecutor::GetNextInternal(RowBatch** batch) {
   while (!done_) {
     row_batch_->Reset();
     SCOPED_TIMER(profile()->total_time_counter());
+    MonotonicStopWatch batch_timer;
+    batch_timer.Start();
     RETURN_IF_ERROR(
         plan_->GetNext(runtime_state_.get(), row_batch_.get(), &done_));
+    get_next_time_distribution_->Record(batch_timer.ElapsedTime());
+    rows_per_batch_distribution_->Record(row_batch_->num_rows());
     *batch = row_batch_.get();
     if (row_batch_->num_rows() > 0) {
       COUNTER_ADD(rows_produced_counter_, row_batch_->num_rows());
@@ -529,7 +618,9 @@ void PlanFragmentExecutor::Cancel() {
   VLOG_QUERY << "Cancel(): instance_id="
       << runtime_state_->fragment_instance_id();
   DCHECK(prepared_);
-  runtime_state_->set_is_cancelled(true);
+  // Sets is_cancelled and wakes threads blocked in registered primitives (block mgr
+  // waits, scan node io waits, etc.).
+  runtime_state_->Cancel();
   runtime_state_->stream_mgr()->Cancel(runtime_state_->fragment_instance_id());
 }
 
@@ -560,6 +651,11 @@ void PlanFragmentExecutor::ReleaseThreadToken() {
 
 void PlanFragmentExecutor::Close() {
   if (closed_) return;
+  // This thread may be recycled for another query; stop charging samples to this one.
+  CpuSampler::ClearThreadContext();
+  // The background compilation thread writes function pointers owned by the plan tree
+  // and uses the codegen object, both of which are torn down below.
+  WaitForAsyncCodegen();
   row_batch_.reset();
   // Prepare may not have been called, which sets runtime_state_
   if (runtime_state_.get() != NULL) {
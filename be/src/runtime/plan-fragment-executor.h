@@ -141,6 +141,10 @@ class PlanFragmentExecutor {
   // profile reporting-related
   ReportStatusCallback report_status_cb_;
   boost::scoped_ptr<Thread> report_thread_;
+
+  // Thread running FinalizeCodegen() while the fragment executes interpreted.
+  // Only set when --async_codegen applies; joined in Close().
+  boost::scoped_ptr<Thread> async_codegen_thread_;
   boost::mutex report_thread_lock_;
 
   // Indicates that profile reporting thread should stop.
@@ -182,6 +186,11 @@ class PlanFragmentExecutor {
   boost::scoped_ptr<RowBatch> row_batch_;
   boost::scoped_ptr<TRowBatch> thrift_batch_;
 
+  // Set in Prepare() if this fragment uses a descriptor table from the process-wide
+  // cache (see DescriptorTbl::CreateShared()) instead of one built in obj_pool();
+  // keeps the shared table alive for the lifetime of the fragment.
+  boost::shared_ptr<DescriptorTbl> shared_desc_tbl_;
+
   // A counter for the per query, per host peak mem usage. Note that this is not the
   // max of the peak memory of all fragments running on a host since it needs to take
   // into account when they are running concurrently. All fragments for a single query
@@ -191,6 +200,13 @@ class PlanFragmentExecutor {
   // Number of rows returned by this fragment
   RuntimeProfile::Counter* rows_produced_counter_;
 
+  // Distribution of the wall time of individual GetNext() calls on the plan root.
+  // The per-batch tail is invisible in the total/mean counters.
+  RuntimeProfile::HistogramCounter* get_next_time_distribution_;
+
+  // Distribution of the number of rows in the batches returned by the plan root.
+  RuntimeProfile::HistogramCounter* rows_per_batch_distribution_;
+
   // Average number of thread tokens for the duration of the plan fragment execution.
   // Fragments that do a lot of cpu work (non-coordinator fragment) will have at
   // least 1 token.  Fragments that contain a hdfs scan node will have 1+ tokens
@@ -244,8 +260,19 @@ class PlanFragmentExecutor {
   // PlanFragmentExecutor()::Prepare() to allow starting plan fragments more
   // quickly and in parallel (in a deep plan tree, the fragments are started
   // in level order).
+  // If --async_codegen is set and every registered function pointer has an
+  // interpreted fallback, compilation runs on async_codegen_thread_ instead and
+  // execution starts on the interpreted paths; the jitted functions are picked up
+  // at batch boundaries once ready.
   void OptimizeLlvmModule();
 
+  // Runs LlvmCodeGen::FinalizeModule() and logs any error to the query log. Called
+  // directly from OptimizeLlvmModule() or on async_codegen_thread_.
+  void FinalizeCodegen();
+
+  // Joins async_codegen_thread_ if it was started. Idempotent; called from Close().
+  void WaitForAsyncCodegen();
+
   // Executes Open() logic and returns resulting status. Does not set status_.
   // If this plan fragment has no sink, OpenInternal() does nothing.
   // If this plan fragment has a sink and OpenInternal() returns without an
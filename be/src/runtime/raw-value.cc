@@ -187,6 +187,93 @@ int RawValue::Compare(const void* v1, const void* v2, const ColumnType& type) {
   };
 }
 
+namespace {
+
+// Type-specialized kernels behind RawValue::GetCompareFn(). Each kernel matches the
+// corresponding case of RawValue::Compare() exactly.
+int CompareNull(const void* v1, const void* v2) {
+  return 0;
+}
+
+// For types narrow enough that the subtraction cannot overflow an int.
+template <typename T>
+int CompareDifference(const void* v1, const void* v2) {
+  return *reinterpret_cast<const T*>(v1) - *reinterpret_cast<const T*>(v2);
+}
+
+template <typename T>
+int CompareOrdered(const void* v1, const void* v2) {
+  const T& t1 = *reinterpret_cast<const T*>(v1);
+  const T& t2 = *reinterpret_cast<const T*>(v2);
+  return t1 > t2 ? 1 : (t1 < t2 ? -1 : 0);
+}
+
+template <typename T>
+int CompareFloating(const void* v1, const void* v2) {
+  T t1 = *reinterpret_cast<const T*>(v1);
+  T t2 = *reinterpret_cast<const T*>(v2);
+  if (isnan(t1) && isnan(t2)) return 0;
+  if (isnan(t1)) return -1;
+  if (isnan(t2)) return 1;
+  return t1 > t2 ? 1 : (t1 < t2 ? -1 : 0);
+}
+
+int CompareStringValue(const void* v1, const void* v2) {
+  return reinterpret_cast<const StringValue*>(v1)->Compare(
+      *reinterpret_cast<const StringValue*>(v2));
+}
+
+template <typename T>
+int CompareDecimal(const void* v1, const void* v2) {
+  return reinterpret_cast<const T*>(v1)->Compare(*reinterpret_cast<const T*>(v2));
+}
+
+}
+
+RawValue::CompareFn RawValue::GetCompareFn(const ColumnType& type) {
+  switch (type.type) {
+    case TYPE_NULL:
+      return CompareNull;
+    case TYPE_BOOLEAN:
+      return CompareDifference<bool>;
+    case TYPE_TINYINT:
+      return CompareDifference<int8_t>;
+    case TYPE_SMALLINT:
+      return CompareDifference<int16_t>;
+    case TYPE_INT:
+      return CompareOrdered<int32_t>;
+    case TYPE_BIGINT:
+      return CompareOrdered<int64_t>;
+    case TYPE_FLOAT:
+      return CompareFloating<float>;
+    case TYPE_DOUBLE:
+      return CompareFloating<double>;
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+      return CompareStringValue;
+    case TYPE_TIMESTAMP:
+      return CompareOrdered<TimestampValue>;
+    case TYPE_CHAR:
+      // Comparing CHAR values requires the type's length.
+      return NULL;
+    case TYPE_DECIMAL:
+      switch (type.GetByteSize()) {
+        case 4:
+          return CompareDecimal<Decimal4Value>;
+        case 8:
+          return CompareDecimal<Decimal8Value>;
+        case 16:
+          return CompareDecimal<Decimal16Value>;
+        default:
+          DCHECK(false) << type;
+          return NULL;
+      }
+    default:
+      DCHECK(false) << "invalid type: " << type.DebugString();
+      return NULL;
+  };
+}
+
 void RawValue::Write(const void* value, void* dst, const ColumnType& type,
     MemPool* pool) {
   DCHECK(value != NULL);
@@ -70,6 +70,15 @@ class RawValue {
   // Return value is < 0  if v1 < v2, 0 if v1 == v2, > 0 if v1 > v2.
   static int Compare(const void* v1, const void* v2, const ColumnType& type);
 
+  // Signature of a type-specialized comparison kernel. Same contract as Compare().
+  typedef int (*CompareFn)(const void* v1, const void* v2);
+
+  // Returns the comparison kernel for 'type', resolving the per-call type switch in
+  // Compare() once, e.g. per sort key at Prepare() time. Returns NULL for types whose
+  // comparison needs more than the two value pointers (TYPE_CHAR needs the type's
+  // length); callers must fall back to Compare() in that case.
+  static CompareFn GetCompareFn(const ColumnType& type);
+
   // Writes the bytes of a given value into the slot of a tuple.
   // For string values, the string data is copied into memory allocated from 'pool'
   // only if pool is non-NULL.
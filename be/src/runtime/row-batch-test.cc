@@ -0,0 +1,134 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include "common/logging.h"
+#include "common/object-pool.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/cpu-info.h"
+
+using namespace std;
+
+DECLARE_int32(target_row_batch_bytes);
+
+namespace impala {
+
+class RowBatchTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    DescriptorTblBuilder builder(&obj_pool_);
+    builder.DeclareTuple() << TYPE_INT << TYPE_BIGINT;
+    desc_tbl_ = builder.Build();
+    tuple_desc_ = desc_tbl_->GetTupleDescriptor(0);
+    vector<bool> nullable_tuples(1, false);
+    vector<TTupleId> tuple_ids(1, (TTupleId) 0);
+    row_desc_.reset(new RowDescriptor(*desc_tbl_, tuple_ids, nullable_tuples));
+  }
+
+  virtual void TearDown() {
+    FLAGS_target_row_batch_bytes = 0;
+  }
+
+  // Appends 'num_rows' rows to 'batch' with the int slot set to the row index and the
+  // bigint slot to 10x the row index.
+  void FillBatch(RowBatch* batch, int num_rows) {
+    const SlotDescriptor* int_slot = tuple_desc_->slots()[0];
+    const SlotDescriptor* bigint_slot = tuple_desc_->slots()[1];
+    for (int i = 0; i < num_rows; ++i) {
+      Tuple* tuple = Tuple::Create(tuple_desc_->byte_size(), batch->tuple_data_pool());
+      *reinterpret_cast<int32_t*>(tuple->GetSlot(int_slot->tuple_offset())) = i;
+      *reinterpret_cast<int64_t*>(tuple->GetSlot(bigint_slot->tuple_offset())) =
+          i * 10L;
+      int idx = batch->AddRow();
+      batch->GetRow(idx)->SetTuple(0, tuple);
+      batch->CommitLastRow();
+    }
+  }
+
+  ObjectPool obj_pool_;
+  DescriptorTbl* desc_tbl_;
+  TupleDescriptor* tuple_desc_;
+  boost::scoped_ptr<RowDescriptor> row_desc_;
+};
+
+TEST_F(RowBatchTest, ComputeCapacity) {
+  const int default_capacity = 1024;
+  FLAGS_target_row_batch_bytes = 0;
+  EXPECT_EQ(default_capacity, RowBatch::ComputeCapacity(*row_desc_, default_capacity));
+
+  int row_size = row_desc_->GetRowSize();
+  ASSERT_GT(row_size, 0);
+  FLAGS_target_row_batch_bytes = row_size * 500;
+  EXPECT_EQ(500, RowBatch::ComputeCapacity(*row_desc_, default_capacity));
+
+  // Degenerate targets clamp to a sane row count.
+  FLAGS_target_row_batch_bytes = 1;
+  EXPECT_EQ(64, RowBatch::ComputeCapacity(*row_desc_, default_capacity));
+  FLAGS_target_row_batch_bytes = 2000000000;
+  EXPECT_EQ(64 * 1024, RowBatch::ComputeCapacity(*row_desc_, default_capacity));
+}
+
+// A scanner sizing its batches with --target_row_batch_bytes hands them to a consumer
+// whose batch was created with the batch_size default, so AcquireState() must cope
+// with differing capacities: the tuple pointer buffer, its capacity and its memory
+// accounting travel with the data.
+TEST_F(RowBatchTest, AcquireStateDifferentCapacity) {
+  MemTracker producer_tracker;
+  MemTracker consumer_tracker;
+  const int src_capacity = 128;
+  const int dest_capacity = 32;
+  const int num_rows = 10;
+  RowBatch* src = new RowBatch(*row_desc_, src_capacity, &producer_tracker);
+  FillBatch(src, num_rows);
+  RowBatch* dest = new RowBatch(*row_desc_, dest_capacity, &consumer_tracker);
+
+  dest->AcquireState(src);
+  EXPECT_EQ(src_capacity, dest->capacity());
+  EXPECT_EQ(dest_capacity, src->capacity());
+  EXPECT_EQ(num_rows, dest->num_rows());
+  const SlotDescriptor* int_slot = tuple_desc_->slots()[0];
+  const SlotDescriptor* bigint_slot = tuple_desc_->slots()[1];
+  for (int i = 0; i < num_rows; ++i) {
+    Tuple* tuple = dest->GetRow(i)->GetTuple(0);
+    EXPECT_EQ(i, *reinterpret_cast<int32_t*>(tuple->GetSlot(int_slot->tuple_offset())));
+    EXPECT_EQ(i * 10L,
+        *reinterpret_cast<int64_t*>(tuple->GetSlot(bigint_slot->tuple_offset())));
+  }
+  // The consumer now accounts the larger buffer it holds plus the acquired tuple data.
+  EXPECT_GE(consumer_tracker.consumption(),
+      src_capacity * static_cast<int64_t>(sizeof(Tuple*)));
+
+  // Each side releases exactly what it still accounts.
+  delete src;
+  EXPECT_EQ(0, producer_tracker.consumption());
+  delete dest;
+  EXPECT_EQ(0, consumer_tracker.consumption());
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
@@ -17,8 +17,11 @@
 #include <stdint.h>  // for intptr_t
 #include <boost/scoped_ptr.hpp>
 
+#include "codegen/llvm-codegen.h"
 #include "runtime/buffered-tuple-stream.h"
 #include "runtime/mem-tracker.h"
+#include "runtime/raw-value.h"
+#include "runtime/runtime-state.h"
 #include "runtime/string-value.h"
 #include "runtime/tuple-row.h"
 #include "util/compress.h"
@@ -26,12 +29,31 @@
 #include "gen-cpp/Results_types.h"
 
 using namespace boost;
+using namespace llvm;
 using namespace std;
 
+DEFINE_int32(target_row_batch_bytes, 0, "(Advanced) If positive, operators that "
+    "materialize row batches derive the batch row capacity from the fixed-length row "
+    "size to target this many bytes of tuple data per batch, instead of always using "
+    "the batch_size query option. 0 keeps the fixed row count.");
+
 namespace impala {
 
 const int RowBatch::AT_CAPACITY_MEM_USAGE = 8 * 1024 * 1024;
 
+// Byte-based capacities are clamped to this range so degenerate row widths can't
+// produce near-empty or multi-million row batches.
+static const int MIN_BYTE_SIZED_CAPACITY = 64;
+static const int MAX_BYTE_SIZED_CAPACITY = 64 * 1024;
+
+int RowBatch::ComputeCapacity(const RowDescriptor& row_desc, int default_capacity) {
+  if (FLAGS_target_row_batch_bytes <= 0) return default_capacity;
+  int row_size = row_desc.GetRowSize();
+  if (row_size <= 0) return default_capacity;
+  int capacity = FLAGS_target_row_batch_bytes / row_size;
+  return min(max(capacity, MIN_BYTE_SIZED_CAPACITY), MAX_BYTE_SIZED_CAPACITY);
+}
+
 RowBatch::RowBatch(const RowDescriptor& row_desc, int capacity,
     MemTracker* mem_tracker)
   : mem_tracker_(mem_tracker),
@@ -42,11 +64,16 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, int capacity,
     row_desc_(row_desc),
     auxiliary_mem_usage_(0),
     need_to_return_(false),
-    tuple_data_pool_(new MemPool(mem_tracker_)) {
+    tuple_data_pool_(new MemPool(mem_tracker_)),
+    selection_vector_(NULL),
+    num_selected_(0),
+    has_selection_(false) {
   DCHECK(mem_tracker_ != NULL);
   DCHECK_GT(capacity, 0);
   tuple_ptrs_size_ = capacity_ * num_tuples_per_row_ * sizeof(Tuple*);
-  tuple_ptrs_ = reinterpret_cast<Tuple**>(tuple_data_pool_->Allocate(tuple_ptrs_size_));
+  mem_tracker_->Consume(tuple_ptrs_size_);
+  tuple_ptrs_ = reinterpret_cast<Tuple**>(malloc(tuple_ptrs_size_));
+  DCHECK(tuple_ptrs_ != NULL);
 }
 
 // TODO: we want our input_batch's tuple_data to come from our (not yet implemented)
@@ -56,7 +83,7 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, int capacity,
 // to allocated string data in special mempool
 // (change via python script that runs over Data_types.cc)
 RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
-    MemTracker* mem_tracker)
+    MemTracker* mem_tracker, DeserializeFixupFn fixup_fn)
   : mem_tracker_(mem_tracker),
     has_in_flight_row_(false),
     num_rows_(input_batch.num_rows),
@@ -64,10 +91,16 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
     num_tuples_per_row_(input_batch.row_tuples.size()),
     row_desc_(row_desc),
     auxiliary_mem_usage_(0),
-    tuple_data_pool_(new MemPool(mem_tracker)) {
+    tuple_data_pool_(new MemPool(mem_tracker)),
+    selection_vector_(NULL),
+    num_selected_(0),
+    has_selection_(false) {
   DCHECK(mem_tracker_ != NULL);
   tuple_ptrs_size_ = num_rows_ * input_batch.row_tuples.size() * sizeof(Tuple*);
-  tuple_ptrs_ = reinterpret_cast<Tuple**>(tuple_data_pool_->Allocate(tuple_ptrs_size_));
+  mem_tracker_->Consume(tuple_ptrs_size_);
+  tuple_ptrs_ = reinterpret_cast<Tuple**>(malloc(tuple_ptrs_size_));
+  DCHECK(tuple_ptrs_ != NULL);
+  uint8_t* data = NULL;
   if (input_batch.compression_type != THdfsCompression::NONE) {
     // Decompress tuple data into data pool
     uint8_t* compressed_data = (uint8_t*)input_batch.tuple_data.c_str();
@@ -80,14 +113,14 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
 
     int64_t uncompressed_size = input_batch.uncompressed_size;
     DCHECK_NE(uncompressed_size, -1) << "RowBatch decompression failed";
-    uint8_t* data = tuple_data_pool_->Allocate(uncompressed_size);
+    data = tuple_data_pool_->Allocate(uncompressed_size);
     status = decompressor->ProcessBlock(true, compressed_size, compressed_data,
         &uncompressed_size, &data);
     DCHECK(status.ok()) << "RowBatch decompression failed.";
     decompressor->Close();
   } else {
     // Tuple data uncompressed, copy directly into data pool
-    uint8_t* data = tuple_data_pool_->Allocate(input_batch.tuple_data.size());
+    data = tuple_data_pool_->Allocate(input_batch.tuple_data.size());
     memcpy(data, input_batch.tuple_data.c_str(), input_batch.tuple_data.size());
   }
 
@@ -98,8 +131,7 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
     if (*offset == -1) {
       tuple_ptrs_[tuple_idx++] = NULL;
     } else {
-      tuple_ptrs_[tuple_idx++] = reinterpret_cast<Tuple*>(
-          tuple_data_pool_->GetDataPtr(*offset + tuple_ptrs_size_));
+      tuple_ptrs_[tuple_idx++] = reinterpret_cast<Tuple*>(data + *offset);
     }
   }
 
@@ -115,6 +147,16 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
   }
   if (!has_string_slots) return;
 
+  if (fixup_fn != NULL) {
+    // The codegen'd function has the tuple layout baked in; each call converts all
+    // string offsets of one row. The string data offsets are relative to the start of
+    // the tuple data, i.e. 'data'.
+    for (int i = 0; i < num_rows_; ++i) {
+      fixup_fn(GetRow(i), data);
+    }
+    return;
+  }
+
   // convert string offsets contained in tuple data into pointers
   for (int i = 0; i < num_rows_; ++i) {
     TupleRow* row = GetRow(i);
@@ -123,16 +165,110 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
       if ((*desc)->string_slots().empty()) continue;
       Tuple* t = row->GetTuple(j);
       if (t == NULL) continue;
+      t->ConvertOffsetsToPointers(**desc, data);
+    }
+  }
+}
 
-      vector<SlotDescriptor*>::const_iterator slot = (*desc)->string_slots().begin();
-      for (; slot != (*desc)->string_slots().end(); ++slot) {
-        DCHECK((*slot)->type().IsVarLen());
-        StringValue* string_val = t->GetStringSlot((*slot)->tuple_offset());
-        int offset = reinterpret_cast<intptr_t>(string_val->ptr) + tuple_ptrs_size_;
-        string_val->ptr = reinterpret_cast<char*>(tuple_data_pool_->GetDataPtr(offset));
-      }
+// Generates a function with this signature:
+// void DeserializeFixup(TupleRow* row, uint8_t* tuple_data)
+// that performs the string fix-up step of the deserializing c'tor for one row, with
+// the layout of row_desc hardcoded: tuples without string slots are skipped entirely
+// and each string slot is patched at its known offset, e.g. for a single tuple with
+// one string slot at offset 16:
+//
+// define void @DeserializeFixup({ i8* }* %row, i8* %tuple_data) {
+// entry:
+//   %cast_row_ptr = bitcast { i8* }* %row to i8**
+//   %tuple_addr = getelementptr i8** %cast_row_ptr, i32 0
+//   %tuple_ptr = load i8** %tuple_addr
+//   %tuple_is_null = icmp eq i8* %tuple_ptr, null
+//   br i1 %tuple_is_null, label %continue, label %fixup
+//
+// fixup:
+//   %slot_addr = getelementptr i8* %tuple_ptr, i32 16
+//   %string_val_ptr = bitcast i8* %slot_addr to %"struct.impala::StringValue"*
+//   %ptr_addr = getelementptr %"struct.impala::StringValue"* %string_val_ptr,
+//       i32 0, i32 0
+//   %offset_as_ptr = load i8** %ptr_addr
+//   %offset = ptrtoint i8* %offset_as_ptr to i64
+//   %string_data = getelementptr i8* %tuple_data, i64 %offset
+//   store i8* %string_data, i8** %ptr_addr
+//   br label %continue
+//
+// continue:
+//   ret void
+// }
+Function* RowBatch::CodegenDeserializeFixup(
+    RuntimeState* state, const RowDescriptor& row_desc) {
+  const vector<TupleDescriptor*>& tuple_descs = row_desc.tuple_descriptors();
+  bool has_string_slots = false;
+  for (int i = 0; i < tuple_descs.size(); ++i) {
+    if (!tuple_descs[i]->string_slots().empty()) {
+      has_string_slots = true;
+      break;
+    }
+  }
+  // Without string slots the deserializing c'tor has no per-row work to specialize.
+  if (!has_string_slots) return NULL;
+
+  LlvmCodeGen* codegen;
+  if (!state->GetCodegen(&codegen).ok()) return NULL;
+  SCOPED_TIMER(codegen->codegen_timer());
+  LLVMContext& context = codegen->context();
+
+  LlvmCodeGen::FnPrototype prototype(codegen, "DeserializeFixup",
+      codegen->void_type());
+  prototype.AddArgument(LlvmCodeGen::NamedVariable("row",
+      codegen->GetPtrType(TupleRow::LLVM_CLASS_NAME)));
+  prototype.AddArgument(LlvmCodeGen::NamedVariable("tuple_data", codegen->ptr_type()));
+
+  LlvmCodeGen::LlvmBuilder builder(context);
+  Value* args[2];
+  Function* fn = prototype.GeneratePrototype(&builder, args);
+  Value* row = args[0];
+  Value* tuple_data = args[1];
+
+  // Treat the row as an array of Tuple*.
+  Value* cast_row_ptr = builder.CreateBitCast(
+      row, PointerType::get(codegen->ptr_type(), 0), "cast_row_ptr");
+
+  for (int i = 0; i < tuple_descs.size(); ++i) {
+    const TupleDescriptor* desc = tuple_descs[i];
+    if (desc->string_slots().empty()) continue;
+
+    Value* tuple_addr = builder.CreateGEP(
+        cast_row_ptr, codegen->GetIntConstant(TYPE_INT, i), "tuple_addr");
+    Value* tuple_ptr = builder.CreateLoad(tuple_addr, "tuple_ptr");
+
+    // Skip NULL tuples (serialized with offset -1; the c'tor left the ptr NULL).
+    BasicBlock* fixup_block = BasicBlock::Create(context, "fixup", fn);
+    BasicBlock* continue_block = BasicBlock::Create(context, "continue", fn);
+    Value* tuple_is_null = builder.CreateIsNull(tuple_ptr, "tuple_is_null");
+    builder.CreateCondBr(tuple_is_null, continue_block, fixup_block);
+
+    builder.SetInsertPoint(fixup_block);
+    for (int j = 0; j < desc->string_slots().size(); ++j) {
+      SlotDescriptor* slot_desc = desc->string_slots()[j];
+      DCHECK(slot_desc->type().IsVarLen());
+      Value* slot_addr = builder.CreateGEP(tuple_ptr,
+          codegen->GetIntConstant(TYPE_INT, slot_desc->tuple_offset()), "slot_addr");
+      Value* string_val_ptr = builder.CreateBitCast(
+          slot_addr, codegen->GetPtrType(slot_desc->type()), "string_val_ptr");
+      Value* ptr_addr = builder.CreateStructGEP(string_val_ptr, 0, "ptr_addr");
+      // The serialized ptr field holds the string data's offset in tuple_data.
+      Value* offset = builder.CreatePtrToInt(
+          builder.CreateLoad(ptr_addr, "offset_as_ptr"), codegen->bigint_type(),
+          "offset");
+      Value* string_data = builder.CreateGEP(tuple_data, offset, "string_data");
+      builder.CreateStore(string_data, ptr_addr);
     }
+    builder.CreateBr(continue_block);
+    builder.SetInsertPoint(continue_block);
   }
+  builder.CreateRetVoid();
+
+  return codegen->FinalizeFunction(fn);
 }
 
 RowBatch::~RowBatch() {
@@ -143,9 +279,17 @@ RowBatch::~RowBatch() {
   for (int i = 0; i < tuple_streams_.size(); ++i) {
     tuple_streams_[i]->Close();
   }
+  free(tuple_ptrs_);
+  mem_tracker_->Release(tuple_ptrs_size_);
+  tuple_ptrs_ = NULL;
+  free(selection_vector_);
+  selection_vector_ = NULL;
 }
 
-int RowBatch::Serialize(TRowBatch* output_batch) {
+int RowBatch::Serialize(TRowBatch* output_batch, bool try_compress) {
+  // Serialization is a materializing boundary; the producer must have compacted any
+  // selection vector before handing the batch off.
+  DCHECK(!has_selection_);
   // why does Thrift not generate a Clear() function?
   output_batch->row_tuples.clear();
   output_batch->tuple_offsets.clear();
@@ -160,28 +304,61 @@ int RowBatch::Serialize(TRowBatch* output_batch) {
   output_batch->uncompressed_size = size;
 
   // Copy tuple data, including strings, into output_batch (converting string
-  // pointers into offsets in the process)
+  // pointers into offsets in the process).
+  // Tuples without var-len slots are serialized unchanged, and batches produced by a
+  // dense materialization (e.g. by the scanners) lay them out contiguously, so runs
+  // of consecutive such tuples are gathered into a single memcpy instead of one copy
+  // per tuple. Tuples with string slots still go through Tuple::DeepCopy() to convert
+  // the string pointers into offsets.
+  // TODO: this still leaves the copy thrift makes from tuple_data into the transport
+  // buffer; removing it requires a gather-write interface in the protocol.
   int offset = 0; // current offset into output_batch->tuple_data
   char* tuple_data = const_cast<char*>(output_batch->tuple_data.c_str());
+  const uint8_t* run_start = NULL; // start of the current run of contiguous tuples
+  int run_len = 0;
+  int run_dest_offset = 0; // offset into tuple_data where the current run is copied
+  const vector<TupleDescriptor*>& tuple_descs = row_desc_.tuple_descriptors();
   for (int i = 0; i < num_rows_; ++i) {
     TupleRow* row = GetRow(i);
-    const vector<TupleDescriptor*>& tuple_descs = row_desc_.tuple_descriptors();
     vector<TupleDescriptor*>::const_iterator desc = tuple_descs.begin();
     for (int j = 0; desc != tuple_descs.end(); ++desc, ++j) {
-      if (row->GetTuple(j) == NULL) {
+      Tuple* t = row->GetTuple(j);
+      if (t == NULL) {
         // NULLs are encoded as -1
         output_batch->tuple_offsets.push_back(-1);
         continue;
       }
-      // Record offset before creating copy (which increments offset and tuple_data)
+      // Record offset before creating copy (which increments offset)
       output_batch->tuple_offsets.push_back(offset);
-      row->GetTuple(j)->DeepCopy(**desc, &tuple_data, &offset, /* convert_ptrs */ true);
+      if ((*desc)->string_slots().empty()) {
+        const uint8_t* t_data = reinterpret_cast<uint8_t*>(t);
+        if (run_start != NULL && t_data == run_start + run_len) {
+          // Extend the current run instead of copying this tuple on its own.
+          run_len += (*desc)->byte_size();
+        } else {
+          if (run_start != NULL) {
+            memcpy(tuple_data + run_dest_offset, run_start, run_len);
+          }
+          run_start = t_data;
+          run_len = (*desc)->byte_size();
+          run_dest_offset = offset;
+        }
+        offset += (*desc)->byte_size();
+      } else {
+        if (run_start != NULL) {
+          memcpy(tuple_data + run_dest_offset, run_start, run_len);
+          run_start = NULL;
+        }
+        char* cursor = tuple_data + offset;
+        t->DeepCopy(**desc, &cursor, &offset, /* convert_ptrs */ true);
+      }
       DCHECK_LE(offset, size);
     }
   }
+  if (run_start != NULL) memcpy(tuple_data + run_dest_offset, run_start, run_len);
   DCHECK_EQ(offset, size);
 
-  if (size > 0) {
+  if (try_compress && size > 0) {
     // Try compressing tuple_data to compression_scratch_, swap if compressed data is
     // smaller
     scoped_ptr<Codec> compressor;
@@ -226,8 +403,13 @@ void RowBatch::Reset() {
   DCHECK(tuple_data_pool_.get() != NULL);
   num_rows_ = 0;
   has_in_flight_row_ = false;
+  has_selection_ = false;
+  num_selected_ = 0;
+  slot_stats_.clear();
+  // The pool object and the tuple pointer array are reused for the next batch; the
+  // chunks released here go back to the thread's chunk cache, so the next round of
+  // Allocate() calls is typically malloc-free.
   tuple_data_pool_->FreeAll();
-  tuple_data_pool_.reset(new MemPool(mem_tracker_));
   for (int i = 0; i < io_buffers_.size(); ++i) {
     io_buffers_[i]->Return();
   }
@@ -237,10 +419,73 @@ void RowBatch::Reset() {
   }
   tuple_streams_.clear();
   auxiliary_mem_usage_ = 0;
-  tuple_ptrs_ = reinterpret_cast<Tuple**>(tuple_data_pool_->Allocate(tuple_ptrs_size_));
   need_to_return_ = false;
 }
 
+void RowBatch::SetSelection(const uint8_t* selected) {
+  DCHECK(selected != NULL);
+  if (selection_vector_ == NULL) {
+    // Like tuple_ptrs_, the vector is sized for capacity_ and reused across Reset()
+    // rounds. It is small (4 bytes per row) so it isn't counted against the tracker.
+    selection_vector_ = reinterpret_cast<int*>(malloc(capacity_ * sizeof(int)));
+    DCHECK(selection_vector_ != NULL);
+  }
+  num_selected_ = 0;
+  for (int i = 0; i < num_rows_; ++i) {
+    if (selected[i] != 0) selection_vector_[num_selected_++] = i;
+  }
+  has_selection_ = true;
+}
+
+void RowBatch::CompactSelection() {
+  if (!has_selection_) return;
+  // Only the tuple pointers move; the tuple data itself stays where it is.
+  for (int i = 0; i < num_selected_; ++i) {
+    int src_idx = selection_vector_[i];
+    DCHECK_GE(src_idx, i);
+    if (src_idx == i) continue;
+    memcpy(tuple_ptrs_ + i * num_tuples_per_row_,
+        tuple_ptrs_ + src_idx * num_tuples_per_row_,
+        num_tuples_per_row_ * sizeof(Tuple*));
+  }
+  num_rows_ = num_selected_;
+  has_selection_ = false;
+}
+
+const RowBatch::SlotStats& RowBatch::ComputeSlotStats(
+    const SlotDescriptor& slot_desc, int tuple_idx) {
+  SlotStats stats;
+  stats.slot_id = slot_desc.id();
+  stats.num_nulls = 0;
+  stats.min_value = NULL;
+  stats.max_value = NULL;
+  const ColumnType& type = slot_desc.type();
+  for (int i = 0; i < num_rows_; ++i) {
+    Tuple* tuple = GetRow(i)->GetTuple(tuple_idx);
+    if (tuple == NULL || tuple->IsNull(slot_desc.null_indicator_offset())) {
+      ++stats.num_nulls;
+      continue;
+    }
+    const void* value = tuple->GetSlot(slot_desc.tuple_offset());
+    if (stats.min_value == NULL) {
+      stats.min_value = stats.max_value = value;
+    } else if (RawValue::Compare(value, stats.min_value, type) < 0) {
+      stats.min_value = value;
+    } else if (RawValue::Compare(value, stats.max_value, type) > 0) {
+      stats.max_value = value;
+    }
+  }
+  slot_stats_.push_back(stats);
+  return slot_stats_.back();
+}
+
+const RowBatch::SlotStats* RowBatch::GetSlotStats(SlotId slot_id) const {
+  for (int i = 0; i < slot_stats_.size(); ++i) {
+    if (slot_stats_[i].slot_id == slot_id) return &slot_stats_[i];
+  }
+  return NULL;
+}
+
 void RowBatch::TransferResourceOwnership(RowBatch* dest) {
   dest->auxiliary_mem_usage_ += tuple_data_pool_->total_allocated_bytes();
   dest->tuple_data_pool_->AcquireData(tuple_data_pool_.get(), false);
@@ -258,7 +503,6 @@ void RowBatch::TransferResourceOwnership(RowBatch* dest) {
   tuple_streams_.clear();
   dest->need_to_return_ |= need_to_return_;
   auxiliary_mem_usage_ = 0;
-  tuple_ptrs_ = NULL;
   Reset();
 }
 
@@ -272,13 +516,12 @@ int RowBatch::GetBatchSize(const TRowBatch& batch) {
 void RowBatch::AcquireState(RowBatch* src) {
   DCHECK(row_desc_.Equals(src->row_desc_));
   DCHECK_EQ(num_tuples_per_row_, src->num_tuples_per_row_);
-  DCHECK_EQ(tuple_ptrs_size_, src->tuple_ptrs_size_);
-  DCHECK_EQ(capacity_, src->capacity_);
   DCHECK_EQ(auxiliary_mem_usage_, 0);
 
   // The destination row batch should be empty.
   DCHECK(!has_in_flight_row_);
   DCHECK_EQ(num_rows_, 0);
+  DCHECK(!src->has_selection_);
 
   for (int i = 0; i < src->io_buffers_.size(); ++i) {
     DiskIoMgr::BufferDescriptor* buffer = src->io_buffers_[i];
@@ -293,8 +536,19 @@ void RowBatch::AcquireState(RowBatch* src) {
 
   has_in_flight_row_ = src->has_in_flight_row_;
   num_rows_ = src->num_rows_;
-  capacity_ = src->capacity_;
   need_to_return_ = src->need_to_return_;
+  // The batches may have been created with different capacities (e.g. the scanners
+  // size theirs with ComputeCapacity() while consumers use the batch_size query
+  // option), so the capacity and allocation size travel with the tuple_ptrs_ buffer
+  // and each buffer's accounting moves to the tracker it now lives under.
+  if (tuple_ptrs_size_ != src->tuple_ptrs_size_) {
+    mem_tracker_->Release(tuple_ptrs_size_);
+    mem_tracker_->Consume(src->tuple_ptrs_size_);
+    src->mem_tracker_->Release(src->tuple_ptrs_size_);
+    src->mem_tracker_->Consume(tuple_ptrs_size_);
+  }
+  std::swap(capacity_, src->capacity_);
+  std::swap(tuple_ptrs_size_, src->tuple_ptrs_size_);
   std::swap(tuple_ptrs_, src->tuple_ptrs_);
   tuple_data_pool_->AcquireData(src->tuple_data_pool_.get(), false);
   auxiliary_mem_usage_ += src->tuple_data_pool_->total_allocated_bytes();
@@ -26,10 +26,15 @@
 #include "runtime/mem-pool.h"
 #include "runtime/mem-tracker.h"
 
+namespace llvm {
+  class Function;
+}
+
 namespace impala {
 
 class BufferedTupleStream;
 class MemTracker;
+class RuntimeState;
 class TRowBatch;
 class Tuple;
 class TupleRow;
@@ -70,22 +75,48 @@ class RowBatch {
   // tracker cannot be NULL.
   RowBatch(const RowDescriptor& row_desc, int capacity, MemTracker* tracker);
 
+  // Signature of the function generated by CodegenDeserializeFixup(): converts the
+  // serialized string-slot offsets of 'row' into pointers into 'tuple_data', the
+  // deserialized tuple data buffer.
+  typedef void (*DeserializeFixupFn)(TupleRow* row, uint8_t* tuple_data);
+
   // Populate a row batch from input_batch by copying input_batch's
   // tuple_data into the row batch's mempool and converting all offsets
   // in the data back into pointers.
+  // If fixup_fn is non-NULL, it is used to convert the string-slot offsets instead of
+  // the interpreted walk over the descriptors; it must have been generated by
+  // CodegenDeserializeFixup() for this row_desc.
   // TODO: figure out how to transfer the data from input_batch to this RowBatch
   // (so that we don't need to make yet another copy)
   RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
-      MemTracker* tracker);
+      MemTracker* tracker, DeserializeFixupFn fixup_fn = NULL);
+
+  // Codegen the per-row fix-up step of deserialization for row_desc: the generated
+  // function converts the string-slot offsets of one row into pointers, with the tuple
+  // layout (which tuples have string slots and at which offsets) baked in instead of
+  // walking the descriptors per tuple. Returns NULL if codegen is not available or
+  // row_desc has no string slots (there is no fix-up work to specialize).
+  static llvm::Function* CodegenDeserializeFixup(RuntimeState* state,
+      const RowDescriptor& row_desc);
 
   // Releases all resources accumulated at this row batch.  This includes
-  //  - tuple_ptrs
+  //  - tuple_ptrs_
   //  - tuple mem pool data
   //  - buffer handles from the io mgr
   ~RowBatch();
 
   static const int INVALID_ROW_INDEX = -1;
 
+  // Returns the row capacity to use for batches with this row layout. If
+  // --target_row_batch_bytes is positive, the capacity is derived from the
+  // fixed-length row size so that a full batch holds roughly that many bytes of
+  // tuple data (clamped so degenerate row widths can't produce tiny or enormous
+  // batches); otherwise 'default_capacity' (normally the batch_size query option)
+  // is returned unchanged. Operators that materialize batches (e.g. the scanners
+  // and the exchange sender) size their batches independently since their row
+  // layouts differ.
+  static int ComputeCapacity(const RowDescriptor& row_desc, int default_capacity);
+
   // Add n rows of tuple pointers after the last committed row and return its index.
   // The rows are uninitialized and each tuple of the row must be set.
   // Returns INVALID_ROW_INDEX if the row batch cannot fit n rows.
@@ -191,6 +222,9 @@ class RowBatch {
   // Acquires state from the 'src' row batch into this row batch. This includes all IO
   // buffers and tuple data.
   // This row batch must be empty and have the same row descriptor as the src batch.
+  // The capacities may differ (scanners size their batches with ComputeCapacity());
+  // the tuple pointer buffer, its capacity and its memory accounting move to this
+  // batch along with the data.
   // This is used for scan nodes which produce RowBatches asynchronously.  Typically,
   // an ExecNode is handed a row batch to populate (pull model) but ScanNodes have
   // multiple threads which push row batches.
@@ -200,14 +234,16 @@ class RowBatch {
   void AcquireState(RowBatch* src);
 
   // Create a serialized version of this row batch in output_batch, attaching all of the
-  // data it references to output_batch.tuple_data. output_batch.tuple_data will be
-  // snappy-compressed unless the compressed data is larger than the uncompressed
-  // data. Use output_batch.is_compressed to determine whether tuple_data is compressed.
+  // data it references to output_batch.tuple_data. If try_compress is true,
+  // output_batch.tuple_data will be LZ4-compressed unless the compressed data is larger
+  // than the uncompressed data. Use output_batch.compression_type to determine whether
+  // tuple_data is compressed. Callers pass try_compress == false when compression has
+  // proven unprofitable for this stream (see DataStreamSender::SerializeBatch()).
   // If an in-flight row is present in this row batch, it is ignored.
   // This function does not Reset().
   // Returns the uncompressed serialized size (this will be the true size of output_batch
   // if tuple_data is actually uncompressed).
-  int Serialize(TRowBatch* output_batch);
+  int Serialize(TRowBatch* output_batch, bool try_compress = true);
 
   // Utility function: returns total size of batch.
   static int GetBatchSize(const TRowBatch& batch);
@@ -215,6 +251,56 @@ class RowBatch {
   int num_rows() const { return num_rows_; }
   int capacity() const { return capacity_; }
 
+  // Sets a selection vector from per-row flags ('selected[i]' non-zero means row i is
+  // live), turning conjunct filtering into a write of indices instead of a copy of
+  // surviving rows. Only consumers that iterate with num_selected()/GetSelectedRow()
+  // honor the selection; everything else must be given a compacted batch, so the
+  // producer calls CompactSelection() before a consumer that only understands plain
+  // batches (materializing boundaries like the exchange and sort always require it).
+  // 'selected' must have num_rows() entries and is not retained.
+  void SetSelection(const uint8_t* selected);
+
+  // Number of live rows; num_rows() when no selection vector is set.
+  int num_selected() const { return has_selection_ ? num_selected_ : num_rows_; }
+
+  // Returns the idx-th live row.
+  TupleRow* GetSelectedRow(int idx) {
+    DCHECK_GE(idx, 0);
+    DCHECK_LT(idx, num_selected());
+    return GetRow(has_selection_ ? selection_vector_[idx] : idx);
+  }
+
+  bool has_selection() const { return has_selection_; }
+
+  // Compacts the batch down to the selected rows and drops the selection vector.
+  // This only moves tuple pointers, never tuple data. No-op without a selection.
+  void CompactSelection();
+
+  // Lightweight zone metadata for one slot over the committed rows of this batch:
+  // the null count and pointers to the extreme slot values. min_value/max_value
+  // point into this batch's tuple data, so they are only valid while the rows are;
+  // they are NULL if the slot (or its tuple) is NULL in every row. Producers attach
+  // stats with AddSlotStats() or ComputeSlotStats() so downstream consumers can
+  // short-circuit whole batches (e.g. a conjunct '<slot> < <constant>' can't match
+  // any row if the batch minimum already fails it); Reset() drops them.
+  struct SlotStats {
+    SlotId slot_id;
+    int num_nulls;
+    const void* min_value;
+    const void* max_value;
+  };
+
+  // Computes the stats of 'slot_desc', whose tuple is at 'tuple_idx' of the row, over
+  // all committed rows in one pass, attaches them to this batch and returns them. The
+  // returned reference is invalidated by further Add/ComputeSlotStats() calls.
+  const SlotStats& ComputeSlotStats(const SlotDescriptor& slot_desc, int tuple_idx);
+
+  // Attaches stats a producer computed on the side (e.g. from file metadata).
+  void AddSlotStats(const SlotStats& stats) { slot_stats_.push_back(stats); }
+
+  // Returns the stats attached for 'slot_id' or NULL if none were.
+  const SlotStats* GetSlotStats(SlotId slot_id) const;
+
   const RowDescriptor& row_desc() const { return row_desc_; }
 
   // Max memory that this row batch can accumulate in tuple_data_pool_ before it
@@ -236,11 +322,23 @@ class RowBatch {
   int num_tuples_per_row_;
   RowDescriptor row_desc_;
 
-  // array of pointers (w/ capacity_ * num_tuples_per_row_ elements)
-  // TODO: replace w/ tr1 array?
+  // Array of pointers (w/ capacity_ * num_tuples_per_row_ elements). Allocated with
+  // malloc, not from tuple_data_pool_, so Reset() can reuse it for the next batch
+  // instead of reallocating it every GetNext() round. Freed in the d'tor.
   Tuple** tuple_ptrs_;
   int tuple_ptrs_size_;
 
+  // Indices of the live rows, ascending, when has_selection_ is true. Like
+  // tuple_ptrs_ this is malloc'd (lazily, on the first SetSelection() call) and
+  // reused across Reset() rounds; freed in the d'tor.
+  int* selection_vector_;
+  int num_selected_;
+  bool has_selection_;
+
+  // Zone metadata attached by the producer, at most one entry per slot. Usually
+  // empty; cleared on Reset().
+  std::vector<SlotStats> slot_stats_;
+
   // Sum of all auxiliary bytes. This includes IoBuffers and memory from
   // TransferResourceOwnership().
   int64_t auxiliary_mem_usage_;
@@ -17,6 +17,7 @@
 
 #include "common/logging.h"
 #include <boost/algorithm/string/join.hpp>
+#include <boost/bind.hpp>
 #include <gutil/strings/substitute.h>
 
 #include "codegen/llvm-codegen.h"
@@ -29,7 +30,7 @@
 #include "runtime/timestamp-value.h"
 #include "runtime/data-stream-mgr.h"
 #include "runtime/data-stream-recvr.h"
-#include "util/bitmap.h"
+#include "util/bloom-filter.h"
 #include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/disk-info.h"
@@ -43,6 +44,14 @@
 
 DECLARE_int32(max_errors);
 
+// All filters in a fragment share this size so that filters from different joins on
+// the same slot can be combined (see RuntimeState::AddBloomFilter()). The default of
+// 1M bits (128KB per filter) keeps the filters selective for build sides of a few
+// hundred thousand distinct keys; see BloomFilter::MIN_BITS_PER_ENTRY.
+DEFINE_int64(slot_filter_bits, 1024 * 1024, "(Advanced) Size in bits of the bloom "
+    "filters used for hash join probe-side filtering. Larger values keep the filters "
+    "selective for larger build sides at the cost of memory.");
+
 using namespace boost;
 using namespace llvm;
 using namespace std;
@@ -96,9 +105,9 @@ RuntimeState::RuntimeState(const TQueryCtx& query_ctx)
 RuntimeState::~RuntimeState() {
   block_mgr_.reset();
 
-  typedef boost::unordered_map<SlotId, Bitmap*>::iterator SlotBitmapIterator;
-  for (SlotBitmapIterator it = slot_bitmap_filters_.begin();
-       it != slot_bitmap_filters_.end(); ++it) {
+  typedef boost::unordered_map<SlotId, BloomFilter*>::iterator SlotFilterIterator;
+  for (SlotFilterIterator it = slot_bloom_filters_.begin();
+       it != slot_bloom_filters_.end(); ++it) {
     if (it->second != NULL) {
       delete it->second;
       it->second = NULL;
@@ -184,9 +193,39 @@ Status RuntimeState::CreateBlockMgr() {
   RETURN_IF_ERROR(BufferedBlockMgr::Create(this, query_mem_tracker(),
       runtime_profile(), block_mgr_limit, io_mgr()->max_read_buffer_size(),
       &block_mgr_));
+  // Wake threads blocked in the block mgr (buffer waits, write completion waits)
+  // as soon as this fragment instance is cancelled. The block mgr is shared by all
+  // of the query's fragment instances on this daemon, but instances are only ever
+  // cancelled as a whole query, so cancelling it for all of them is correct.
+  AddCancellationCallback(boost::bind(&BufferedBlockMgr::Cancel, block_mgr_));
   return Status::OK;
 }
 
+void RuntimeState::AddCancellationCallback(const boost::function<void()>& cb) {
+  {
+    boost::lock_guard<boost::mutex> l(cancellation_lock_);
+    if (!is_cancelled_) {
+      cancellation_cbs_.push_back(cb);
+      return;
+    }
+  }
+  // Already cancelled; invoke outside the lock like Cancel() does.
+  cb();
+}
+
+void RuntimeState::Cancel() {
+  vector<boost::function<void()> > cbs;
+  {
+    boost::lock_guard<boost::mutex> l(cancellation_lock_);
+    if (is_cancelled_) return;
+    is_cancelled_ = true;
+    cbs.swap(cancellation_cbs_);
+  }
+  // Invoke outside the lock so callbacks can't deadlock against concurrent
+  // AddCancellationCallback() callers.
+  for (int i = 0; i < cbs.size(); ++i) cbs[i]();
+}
+
 Status RuntimeState::CreateCodegen() {
   if (codegen_.get() != NULL) return Status::OK;
   // TODO: add the fragment ID to the codegen ID as well
@@ -294,19 +333,23 @@ Status RuntimeState::CheckQueryState() {
   return query_status_;
 }
 
-void RuntimeState::AddBitmapFilter(SlotId slot, Bitmap* bitmap,
+int64_t RuntimeState::slot_filter_num_bits() const {
+  return FLAGS_slot_filter_bits;
+}
+
+void RuntimeState::AddBloomFilter(SlotId slot, BloomFilter* filter,
     bool* acquired_ownership) {
   *acquired_ownership = false;
-  if (bitmap != NULL) {
-    ScopedSpinLock l(&bitmap_lock_);
-    if (slot_bitmap_filters_.find(slot) != slot_bitmap_filters_.end()) {
-      Bitmap* existing_bitmap = slot_bitmap_filters_[slot];
-      DCHECK_NOTNULL(existing_bitmap);
-      existing_bitmap->And(bitmap);
+  if (filter != NULL) {
+    ScopedSpinLock l(&bloom_filter_lock_);
+    if (slot_bloom_filters_.find(slot) != slot_bloom_filters_.end()) {
+      BloomFilter* existing_filter = slot_bloom_filters_[slot];
+      DCHECK_NOTNULL(existing_filter);
+      existing_filter->And(filter);
     } else {
-      // This is the first time we set the slot_bitmap_filters_[slot]. We avoid
-      // allocating a new bitmap by using the passed bitmap.
-      slot_bitmap_filters_[slot] = bitmap;
+      // This is the first time we set the slot_bloom_filters_[slot]. We avoid
+      // allocating a new filter by using the passed filter.
+      slot_bloom_filters_[slot] = filter;
       *acquired_ownership = true;
     }
   }
@@ -19,8 +19,10 @@
 // needed for scoped_ptr to work on ObjectPool
 #include "common/object-pool.h"
 
+#include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <vector>
 #include <string>
 // stringstream is a typedef, so can't forward declare it.
@@ -39,7 +41,7 @@
 
 namespace impala {
 
-class Bitmap;
+class BloomFilter;
 class BufferedBlockMgr;
 class DescriptorTbl;
 class ObjectPool;
@@ -153,25 +155,26 @@ class RuntimeState {
   // See comment on root_node_id_. We add one to prevent having a hash seed of 0.
   uint32_t fragment_hash_seed() const { return root_node_id_ + 1; }
 
-  // Size to use when building bitmap filters. This is a prime number which reduces
-  // collisions and the resulting bitmap is just under 4Kb.
-  // Having all bitmaps be the same size allows us to combine (i.e. AND) bitmaps.
-  uint32_t slot_filter_bitmap_size() const { return 32213; }
+  // Size in bits to use when building bloom filters, taken from --slot_filter_bits.
+  // Having all filters be the same size allows us to combine (i.e. AND) filters from
+  // different joins on the same slot.
+  int64_t slot_filter_num_bits() const;
 
-  // Adds a bitmap filter on slot 'slot'. If hash(slot) % bitmap.Size() is false, this
-  // value can be filtered out. Multiple bitmap filters can be added to a single slot.
-  // If it is the first call to add a bitmap filter for the specific slot, indicated by
-  // 'acquired_ownership', then the passed bitmap should not be deleted by the caller.
+  // Adds a bloom filter on slot 'slot'. If BloomFilter::Find(hash(slot)) is false,
+  // this value can be filtered out. Multiple bloom filters can be added to a single
+  // slot. If it is the first call to add a bloom filter for the specific slot,
+  // indicated by 'acquired_ownership', then the passed filter should not be deleted
+  // by the caller.
   // Thread safe.
-  void AddBitmapFilter(SlotId slot, Bitmap* bitmap, bool* acquired_ownership);
+  void AddBloomFilter(SlotId slot, BloomFilter* filter, bool* acquired_ownership);
 
-  // Returns bitmap filter on 'slot'. Returns NULL if there are no bitmap filters on this
+  // Returns bloom filter on 'slot'. Returns NULL if there are no bloom filters on this
   // slot.
-  // It is not safe to concurrently call AddBitmapFilter() and GetBitmapFilter().
-  // All calls to AddBitmapFilter() should happen before.
-  const Bitmap* GetBitmapFilter(SlotId slot) {
-    if (slot_bitmap_filters_.find(slot) == slot_bitmap_filters_.end()) return NULL;
-    return slot_bitmap_filters_[slot];
+  // It is not safe to concurrently call AddBloomFilter() and GetBloomFilter().
+  // All calls to AddBloomFilter() should happen before.
+  const BloomFilter* GetBloomFilter(SlotId slot) {
+    if (slot_bloom_filters_.find(slot) == slot_bloom_filters_.end()) return NULL;
+    return slot_bloom_filters_[slot];
   }
 
   PartitionStatusMap* per_partition_status() { return &per_partition_status_; }
@@ -182,6 +185,13 @@ class RuntimeState {
   // Returns true if codegen is enabled for this query.
   bool codegen_enabled() const { return !query_options().disable_codegen; }
 
+  // Disables codegen for this fragment instance, e.g. because it is bounded to produce
+  // too few rows to amortize compilation. Must be called before the plan tree's
+  // Prepare() phase, which is where exec nodes and exprs consult codegen_enabled().
+  void DisableCodegen() {
+    fragment_instance_ctx_.query_ctx.request.query_options.disable_codegen = true;
+  }
+
   // Returns true if the codegen object has been created. Note that this may return false
   // even when codegen is enabled if nothing has been codegen'd.
   bool codegen_created() const { return codegen_.get() != NULL; }
@@ -235,6 +245,19 @@ class RuntimeState {
   bool is_cancelled() const { return is_cancelled_; }
   void set_is_cancelled(bool v) { is_cancelled_ = v; }
 
+  // Registers 'cb' to be invoked by Cancel(). Blocking primitives (or the objects
+  // that own them) register a callback that wakes their blocked waiters, so that
+  // cancellation propagates with bounded latency instead of waiting for the next
+  // batch-boundary is_cancelled() poll. Callbacks must not block and must be safe
+  // to invoke regardless of what state their owner is in (e.g. already closed or
+  // already cancelled), since registrations are not removed. If this state is
+  // already cancelled, 'cb' is invoked immediately.
+  void AddCancellationCallback(const boost::function<void()>& cb);
+
+  // Sets is_cancelled() and invokes all registered cancellation callbacks,
+  // immediately waking threads blocked in registered primitives. Idempotent.
+  void Cancel();
+
   RuntimeProfile::Counter* total_cpu_timer() { return total_cpu_timer_; }
   RuntimeProfile::Counter* total_storage_wait_timer() {
     return total_storage_wait_timer_;
@@ -343,6 +366,13 @@ class RuntimeState {
   // if true, execution should stop with a CANCELLED status
   bool is_cancelled_;
 
+  // Protects is_cancelled_ (for Cancel()'s set-once semantics) and
+  // cancellation_cbs_. is_cancelled() reads remain lock-free.
+  boost::mutex cancellation_lock_;
+
+  // Callbacks to invoke on cancellation; see AddCancellationCallback().
+  std::vector<boost::function<void()> > cancellation_cbs_;
+
   // Non-OK if an error has occurred and query execution should abort. Used only for
   // asynchronously reporting such errors (e.g., when a UDF reports an error), so this
   // will not necessarily be set in all error cases.
@@ -364,18 +394,19 @@ class RuntimeState {
   // This is the node id of the root node for this plan fragment. This is used as the
   // hash seed and has two useful properties:
   // 1) It is the same for all exec nodes in a fragment, so the resulting hash values
-  // can be shared (i.e. for slot_bitmap_filters_).
+  // can be shared (i.e. for slot_bloom_filters_).
   // 2) It is different between different fragments, so we do not run into hash
   // collisions after data partitioning (across fragments). See IMPALA-219 for more
   // details.
   PlanNodeId root_node_id_;
 
-  // Lock protecting slot_bitmap_filters_
-  SpinLock bitmap_lock_;
+  // Lock protecting slot_bloom_filters_
+  SpinLock bloom_filter_lock_;
 
-  // Bitmap filter on the hash for 'SlotId'. If bitmap[hash(slot]] is unset, this
-  // value can be filtered out. These filters are generated during the query execution.
-  boost::unordered_map<SlotId, Bitmap*> slot_bitmap_filters_;
+  // Bloom filter on the hash for 'SlotId'. If the filter does not contain the hash of
+  // a slot value, that value can be filtered out. These filters are generated during
+  // the query execution.
+  boost::unordered_map<SlotId, BloomFilter*> slot_bloom_filters_;
 
   // prohibit copies
   RuntimeState(const RuntimeState&);
@@ -18,6 +18,7 @@
 #include "runtime/row-batch.h"
 #include "runtime/sorter.h"
 #include "runtime/tuple-row.h"
+#include "util/key-normalizer.inline.h"
 #include "util/runtime-profile.h"
 
 using namespace boost;
@@ -70,6 +71,12 @@ class SortedRunMerger::BatchedRowSupplier {
       *done = input_row_batch_ == NULL;
       input_row_batch_index_ = 0;
     }
+    if (!*done && parent_->key_normalizer_.get() != NULL) {
+      bool over_budget =
+          parent_->key_normalizer_->NormalizeKey(current_row(), normalized_key_);
+      // KeyNormalizer::KeysFit() guaranteed the key fits in NORMALIZED_KEY_LEN bytes.
+      DCHECK(!over_budget);
+    }
     return Status::OK;
   }
 
@@ -91,68 +98,108 @@ class SortedRunMerger::BatchedRowSupplier {
 
   // The parent merger instance.
   SortedRunMerger* parent_;
+
+  // Normalized key of the current row, recomputed whenever the supplier advances.
+  // Only valid if the parent's key_normalizer_ is non-NULL.
+  uint8_t normalized_key_[NORMALIZED_KEY_LEN];
 };
 
-void SortedRunMerger::Heapify(int parent_index) {
-  int left_index = 2 * parent_index + 1;
-  int right_index = left_index + 1;
-  if (left_index >= min_heap_.size()) return;
-  int least_child;
-  // Find the least child of parent.
-  if (right_index >= min_heap_.size() ||
-      compare_less_than_(min_heap_[left_index]->current_row(),
-          min_heap_[right_index]->current_row())) {
-    least_child = left_index;
-  } else {
-    least_child = right_index;
+inline bool SortedRunMerger::SupplierLess(int lhs, int rhs) const {
+  // Exhausted runs lose against every other run.
+  if (rhs == -1) return true;
+  if (lhs == -1) return false;
+  if (key_normalizer_.get() != NULL) {
+    // The keys are lossless for the types admitted by KeyNormalizer::KeysFit(), so
+    // equal keys mean the rows compare equal and no comparator tie-break is needed.
+    return memcmp(suppliers_[lhs]->normalized_key_, suppliers_[rhs]->normalized_key_,
+        NORMALIZED_KEY_LEN) < 0;
   }
+  return compare_less_than_(suppliers_[lhs]->current_row(),
+      suppliers_[rhs]->current_row());
+}
+
+int SortedRunMerger::InitSubtree(int node) {
+  if (node >= num_leaves_) {
+    int supplier_index = node - num_leaves_;
+    return supplier_index < suppliers_.size() ? supplier_index : -1;
+  }
+  int left_winner = InitSubtree(2 * node);
+  int right_winner = InitSubtree(2 * node + 1);
+  if (SupplierLess(left_winner, right_winner)) {
+    loser_tree_[node] = right_winner;
+    return left_winner;
+  }
+  loser_tree_[node] = left_winner;
+  return right_winner;
+}
 
-  // If the parent is out of place, swap it with the least child and invoke
-  // Heapify recursively.
-  if (compare_less_than_(min_heap_[least_child]->current_row(),
-      min_heap_[parent_index]->current_row())) {
-    iter_swap(min_heap_.begin() + least_child, min_heap_.begin() + parent_index);
-    Heapify(least_child);
+void SortedRunMerger::ReplayGames(bool exhausted) {
+  int winner = exhausted ? -1 : winner_;
+  // Play the games on the path from the winner's leaf to the root: at each node the
+  // new winner meets the loser stored there, and the loser of that game stays behind.
+  for (int node = (num_leaves_ + winner_) / 2; node >= 1; node /= 2) {
+    if (!SupplierLess(winner, loser_tree_[node])) swap(winner, loser_tree_[node]);
   }
+  winner_ = winner;
 }
 
 SortedRunMerger::SortedRunMerger(const TupleRowComparator& compare_less_than,
     RowDescriptor* row_desc, RuntimeProfile* profile, bool deep_copy_input)
   : compare_less_than_(compare_less_than),
     input_row_desc_(row_desc),
-    deep_copy_input_(deep_copy_input) {
+    deep_copy_input_(deep_copy_input),
+    limit_(-1),
+    num_rows_returned_(0),
+    num_leaves_(0),
+    winner_(-1) {
   get_next_timer_ = ADD_TIMER(profile, "MergeGetNext");
   get_next_batch_timer_ = ADD_TIMER(profile, "MergeGetNextBatch");
+  const vector<ExprContext*>& key_ctxs = compare_less_than_.key_expr_ctxs_lhs();
+  if (KeyNormalizer::KeysFit(key_ctxs, NORMALIZED_KEY_LEN)) {
+    vector<bool> nulls_first;
+    nulls_first.reserve(key_ctxs.size());
+    for (int i = 0; i < key_ctxs.size(); ++i) {
+      nulls_first.push_back(compare_less_than_.nulls_first(i));
+    }
+    key_normalizer_.reset(new KeyNormalizer(key_ctxs, NORMALIZED_KEY_LEN,
+        compare_less_than_.is_asc(), nulls_first));
+  }
+}
+
+SortedRunMerger::~SortedRunMerger() {
 }
 
 Status SortedRunMerger::Prepare(const vector<RunBatchSupplier>& input_runs) {
-  DCHECK_EQ(min_heap_.size(), 0);
-  min_heap_.reserve(input_runs.size());
+  DCHECK_EQ(suppliers_.size(), 0);
+  suppliers_.reserve(input_runs.size());
   BOOST_FOREACH(const RunBatchSupplier& input_run, input_runs) {
     BatchedRowSupplier* new_elem = pool_.Add(new BatchedRowSupplier(this, input_run));
     bool empty;
     RETURN_IF_ERROR(new_elem->Init(&empty));
-    if (!empty) min_heap_.push_back(new_elem);
+    if (!empty) suppliers_.push_back(new_elem);
   }
+  if (suppliers_.empty()) return Status::OK;
 
-  // Construct the min heap from the sorted runs.
-  int last_parent = (min_heap_.size() / 2) - 1;
-  for (int i = last_parent; i >= 0; --i) {
-    Heapify(i);
-  }
+  // Construct the loser tree over the sorted runs, rounding the number of leaves up
+  // to a power of two so the tree is complete.
+  num_leaves_ = 1;
+  while (num_leaves_ < suppliers_.size()) num_leaves_ *= 2;
+  loser_tree_.resize(num_leaves_);
+  winner_ = InitSubtree(1);
+  DCHECK_NE(winner_, -1);
 
   return Status::OK;
 }
 
 Status SortedRunMerger::GetNext(RowBatch* output_batch, bool* eos) {
   ScopedTimer<MonotonicStopWatch> timer(get_next_timer_);
-  if (min_heap_.empty()) {
+  if (winner_ == -1 || ReachedLimit()) {
     *eos = true;
     return Status::OK;
   }
 
   while (!output_batch->AtCapacity()) {
-    BatchedRowSupplier* min = min_heap_[0];
+    BatchedRowSupplier* min = suppliers_[winner_];
     int output_row_index = output_batch->AddRow();
     TupleRow* output_row = output_batch->GetRow(output_row_index);
     if (deep_copy_input_) {
@@ -165,23 +212,19 @@ Status SortedRunMerger::GetNext(RowBatch* output_batch, bool* eos) {
     }
 
     output_batch->CommitLastRow();
+    ++num_rows_returned_;
+    if (ReachedLimit()) break;
 
     bool min_run_complete;
     // Advance to the next element in min. output_batch is supplied to transfer
     // resource ownership if the input batch in min is exhausted.
     RETURN_IF_ERROR(min->Next(deep_copy_input_ ? NULL : output_batch,
         &min_run_complete));
-    if (min_run_complete) {
-      // Remove the element from the heap.
-      iter_swap(min_heap_.begin(), min_heap_.end() - 1);
-      min_heap_.pop_back();
-      if (min_heap_.empty()) break;
-    }
-
-    Heapify(0);
+    ReplayGames(min_run_complete);
+    if (winner_ == -1) break;
   }
 
-  *eos = min_heap_.empty();
+  *eos = winner_ == -1 || ReachedLimit();
   return Status::OK;
 }
 
@@ -24,14 +24,23 @@
 
 namespace impala {
 
+class KeyNormalizer;
 class RowBatch;
 class RowDescriptor;
 class RuntimeProfile;
 
 // SortedRunMerger is used to merge multiple sorted runs of tuples. A run is a sorted
 // sequence of row batches, which are fetched from a RunBatchSupplier function object.
-// Merging is implemented using a binary min-heap that maintains the run with the next
-// tuple in sorted order at the top of the heap.
+// Merging is implemented using a tree of losers (tournament tree): each internal node
+// stores the loser of the game between its two subtrees and the overall winner is the
+// run with the next tuple in sorted order. Advancing the winner replays only the games
+// on its leaf-to-root path, which costs one comparison per tree level, half the
+// comparisons of the equivalent binary min-heap.
+//
+// When every merge key normalizes losslessly into a small memcmp-able key (see
+// util/key-normalizer.h), each run's current row key is computed once as the row is
+// reached and the games compare keys with a single memcmp instead of evaluating the
+// key exprs per comparison.
 //
 // Merged batches of rows are retrieved from SortedRunMerger via calls to GetNext().
 // The merger is constructed with a boolean flag deep_copy_input.
@@ -39,6 +48,11 @@ class RuntimeProfile;
 // If false, GetNext() only copies tuple pointers (TupleRows) into the output batch,
 // and transfers resource ownership from the input batches to the output batch when
 // an input batch is processed.
+//
+// TODO: parallelize wide merges: merge groups of runs into intermediate runs on
+// threads acquired from ThreadResourceMgr and merge the intermediate runs here.
+// Sorter::MergeIntermediateRuns() already splits oversized merges into serial
+// intermediate passes that could run concurrently.
 class SortedRunMerger {
  public:
   // Function that returns the next batch of rows from an input sorted run. The batch
@@ -49,14 +63,23 @@ class SortedRunMerger {
   SortedRunMerger(const TupleRowComparator& compare_less_than, RowDescriptor* row_desc,
       RuntimeProfile* profile, bool deep_copy_input);
 
+  // Defined in the .cc file so that key_normalizer_ can be destroyed there.
+  ~SortedRunMerger();
+
   // Prepare this merger to merge and return rows from the sorted runs in 'input_runs'
-  // Retrieves the first batch from each run and sets up the binary heap implementing
-  // the priority queue.
+  // Retrieves the first batch from each run and builds the loser tree over the
+  // non-empty runs.
   Status Prepare(const std::vector<RunBatchSupplier>& input_runs);
 
   // Return the next batch of sorted rows from this merger.
   Status GetNext(RowBatch* output_batch, bool* eos);
 
+  // Caps the total number of rows returned over all GetNext() calls: once 'limit'
+  // rows have been copied out, GetNext() reports eos without touching the remaining
+  // input. -1 (the default) means no limit. Must be set before the first GetNext()
+  // call.
+  void set_limit(int64_t limit) { limit_ = limit; }
+
   // Called to finalize a merge when deep_copy is false. Transfers resources from
   // all input batches to the specified output batch.
   void TransferAllResources(RowBatch* transfer_resource_batch);
@@ -64,22 +87,54 @@ class SortedRunMerger {
  private:
   class BatchedRowSupplier;
 
-  // Assuming the element at parent_index is the only out of place element in the heap,
-  // restore the heap property (i.e. swap elements so parent <= children).
-  void Heapify(int parent_index);
+  // Size in bytes of the normalized key kept for each run's current row. Matches the
+  // per-tuple key budget used by Sorter::TupleSorter.
+  static const int NORMALIZED_KEY_LEN = 16;
+
+  // True if a limit is set and that many rows have been returned.
+  bool ReachedLimit() const { return limit_ != -1 && num_rows_returned_ >= limit_; }
+
+  // Returns true if the current row of supplier 'lhs' sorts before that of supplier
+  // 'rhs' according to compare_less_than_. Either argument may be -1, denoting an
+  // exhausted (or absent) run that loses against every other run.
+  bool SupplierLess(int lhs, int rhs) const;
+
+  // Recursively plays the games of the subtree rooted at 'node', filling
+  // loser_tree_[node] of every internal node with the loser, and returns the winner.
+  // Called on the root by Prepare() to build the tree.
+  int InitSubtree(int node);
 
-  // The binary min-heap used to merge rows from the sorted input runs. Since the heap is
-  // stored in a 0-indexed array, the 0-th element is the minimum element in the heap,
-  // and the children of the element at index i are 2*i+1 and 2*i+2. The heap property is
-  // that row of the parent element is <= the rows of the child elements according to the
-  // comparator compare_less_than_.
-  // The BatchedRowSupplier objects used in the min_heap_ are owned by this
-  // SortedRunMerger instance.
-  std::vector<BatchedRowSupplier*> min_heap_;
+  // Replays the games on the path from the winner's leaf to the root after the
+  // winner's supplier was advanced ('exhausted' is true if it ran out of rows), and
+  // updates winner_. One comparison per tree level.
+  void ReplayGames(bool exhausted);
 
-  // Row comparator. Returns true if lhs < rhs.
+  // The suppliers of the non-empty input runs, i.e. the leaves of the loser tree.
+  // Owned by this SortedRunMerger instance (via pool_).
+  std::vector<BatchedRowSupplier*> suppliers_;
+
+  // Tree of losers over the suppliers. The leaf for supplier i is the implicit node
+  // 'num_leaves_ + i'; the internal nodes [1, num_leaves_) store the supplier index
+  // of the loser of the game between their subtrees (or -1 for an exhausted run),
+  // with the children of node i at 2*i and 2*i+1. Entry 0 is unused.
+  std::vector<int> loser_tree_;
+
+  // Number of leaves of the loser tree: suppliers_.size() rounded up to a power of
+  // two, with the leaves beyond suppliers_.size() treated as exhausted runs.
+  int num_leaves_;
+
+  // Supplier index of the overall winner, i.e. the run with the next row in sorted
+  // order, or -1 if all runs are exhausted.
+  int winner_;
+
+  // Row comparator. Returns true if lhs < rhs. Only consulted when normalized keys
+  // are not in use.
   TupleRowComparator compare_less_than_;
 
+  // Produces the normalized key of each run's current row. NULL if the merge keys
+  // cannot be normalized losslessly into NORMALIZED_KEY_LEN bytes.
+  boost::scoped_ptr<KeyNormalizer> key_normalizer_;
+
   // Descriptor for the rows provided by the input runs. Owned by the exec-node through
   // which this merger was created.
   RowDescriptor* input_row_desc_;
@@ -87,6 +142,12 @@ class SortedRunMerger {
   // True if rows must be deep copied into the output batch.
   bool deep_copy_input_;
 
+  // Maximum number of rows to return over all GetNext() calls, or -1 for no limit.
+  int64_t limit_;
+
+  // Number of rows returned so far; only compared against limit_ if one is set.
+  int64_t num_rows_returned_;
+
   // Pool of BatchedRowSupplier instances.
   ObjectPool pool_;
 
@@ -19,6 +19,7 @@
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/sorted-run-merger.h"
+#include "util/key-normalizer.inline.h"
 #include "util/runtime-profile.h"
 
 using namespace boost;
@@ -199,6 +200,18 @@ class Sorter::Run {
 // Quick sort is used for sequences of tuples larger that 16 elements, and insertion sort
 // is used for smaller sequences. The TupleSorter is initialized with a RuntimeState
 // instance to check for cancellation during an in-memory sort.
+//
+// If a prefix of the sort exprs consists of fixed-width types that KeyNormalizer can
+// encode losslessly, a NORMALIZED_KEY_LEN byte memcmp-able key is computed once per
+// tuple before the sort and the sort runs over a compact array of (key, tuple index)
+// entries instead of the tuples themselves: a three-way quicksort partitions the
+// entries on the keys, rows with equal keys are ordered by the row comparator (only
+// needed when the keys don't cover every sort expr, e.g. trailing string keys), and
+// the tuples are permuted into the sorted order in a single pass at the end. This
+// keeps the data moved per swap at sizeof(SortEntry) bytes, independent of the tuple
+// size, and replaces an expr evaluation per key column per comparison with a memcmp.
+// When not even the first sort expr normalizes, the tuples are quicksorted in place
+// as before.
 class Sorter::TupleSorter {
  public:
   TupleSorter(const TupleRowComparator& less_than_comp, int64_t block_size,
@@ -215,6 +228,11 @@ class Sorter::TupleSorter {
  private:
   static const int INSERTION_THRESHOLD = 16;
 
+  // Size in bytes of the normalized key kept per tuple while a run is sorted. Each
+  // key column needs one null byte plus its value bytes, so this covers e.g. one
+  // BIGINT key (9 bytes) or three INT keys (15 bytes).
+  static const int NORMALIZED_KEY_LEN = 16;
+
   // Helper class used to iterate over tuples in a run during quick sort and insertion
   // sort.
   class TupleIterator {
@@ -312,6 +330,92 @@ class Sorter::TupleSorter {
   uint8_t* temp_tuple_buffer_;
   uint8_t* swap_buffer_;
 
+  // Entry sorted in place of the tuples when normalized keys are in use: the key of a
+  // tuple plus the index the tuple occupies in the run. Quicksorting these keeps each
+  // swap at sizeof(SortEntry) bytes regardless of the tuple size and keeps the sort
+  // working set contiguous; the tuples themselves only move once, in PermuteTuples().
+  struct SortEntry {
+    uint8_t key[NORMALIZED_KEY_LEN];
+    int64_t index;
+  };
+
+  // Comparator-only ordering of sort entries, used for runs of entries whose key
+  // prefixes compare equal (see SortEqualKeyEntries()).
+  struct EqualKeyEntryLess {
+    TupleSorter* parent;
+    bool operator()(const SortEntry& lhs, const SortEntry& rhs) const {
+      return parent->ComparatorLess(lhs.index, rhs.index);
+    }
+  };
+
+  // True if comparisons are done on normalized keys (see class comment).
+  // Determined from the comparator's key exprs in the constructor.
+  bool use_normalized_keys_;
+
+  // True if the normalized keys cover every sort expr, so equal keys imply the rows
+  // compare equal and no comparator tie-break is needed. Only meaningful when
+  // use_normalized_keys_ is true.
+  bool keys_lossless_;
+
+  // Produces the normalized keys, over the leading
+  // KeyNormalizer::NumNormalizableKeys() sort exprs. NULL if use_normalized_keys_ is
+  // false.
+  boost::scoped_ptr<KeyNormalizer> key_normalizer_;
+
+  // The (key, index) entry of every tuple in the run being sorted. Resized and filled
+  // in ComputeNormalizedKeys(), then sorted. Only used when normalized keys are in
+  // use.
+  // TODO: account for this memory (sizeof(SortEntry) bytes per tuple) in the
+  // sorter's memory tracker.
+  std::vector<SortEntry> entries_;
+
+  // Scratch for PermuteTuples(): the sorted position of the tuple at each index.
+  std::vector<int64_t> tuple_dest_;
+
+  // Sign of the comparison of each tuple against the pivot of the current
+  // Partition() call: entry i corresponds to the tuple at index i. Only used when
+  // normalized keys are not in use; filled in one sequential pass per block at the
+  // start of Partition() and swapped along with the tuples. Resized in Sort().
+  // TODO: account for this memory (1 byte per tuple), like entries_.
+  std::vector<int8_t> pivot_cmp_;
+
+  // Returns a pointer to the tuple at 'index' in run_.
+  uint8_t* TupleAt(int64_t index) {
+    return run_->fixed_len_blocks_[index / block_capacity_]->buffer() +
+        (index % block_capacity_) * tuple_size_;
+  }
+
+  // Computes the (normalized key, index) entry of every tuple in run_ into entries_.
+  void ComputeNormalizedKeys();
+
+  // Returns true if the tuple at lhs_index sorts before the one at rhs_index
+  // according to the row comparator.
+  bool ComparatorLess(int64_t lhs_index, int64_t rhs_index) const;
+
+  // Returns true if lhs sorts before rhs: differing keys decide via memcmp, equal
+  // keys tie-break on the rows unless the keys are lossless.
+  bool EntryLess(const SortEntry& lhs, const SortEntry& rhs) const;
+
+  // Sorts entries_ in the range [first, last) with a three-way quicksort on the keys,
+  // falling back to InsertionSortEntries() for small ranges. Entries with keys equal
+  // to the pivot's are placed in their final position by the partitioning step and,
+  // if the keys are lossy, ordered among themselves by SortEqualKeyEntries().
+  // Checks state_->is_cancelled() and returns early if true.
+  void SortEntriesHelper(int64_t first, int64_t last);
+
+  // Insertion sort of entries_ in the range [first, last) using EntryLess().
+  void InsertionSortEntries(int64_t first, int64_t last);
+
+  // Sorts entries_ in the range [first, last), whose keys all compare equal, using
+  // only the row comparator.
+  void SortEqualKeyEntries(int64_t first, int64_t last);
+
+  // Rearranges the tuples in run_ into the order given by the sorted entries_
+  // (entries_[i].index is the position the tuple that belongs at position i currently
+  // occupies), walking each permutation cycle once so every tuple is moved at most
+  // twice.
+  void PermuteTuples();
+
   // Perform an insertion sort for rows in the range [first, last) in a run.
   void InsertionSort(const TupleIterator& first, const TupleIterator& last);
 
@@ -320,7 +424,8 @@ class Sorter::TupleSorter {
   // tuples in the second group are >= pivot. Tuples are swapped in place to create the
   // groups and the index to the first element in the second group is returned.
   // Checks state_->is_cancelled() and returns early with an invalid result if true.
-  TupleIterator Partition(TupleIterator first, TupleIterator last, Tuple* pivot);
+  TupleIterator Partition(TupleIterator first, TupleIterator last,
+      const TupleIterator& pivot);
 
   // Performs a quicksort of rows in the range [first, last).
   // followed by insertion sort for smaller groups of elements.
@@ -764,6 +869,26 @@ Sorter::TupleSorter::TupleSorter(const TupleRowComparator& comp, int64_t block_s
   temp_tuple_buffer_ = new uint8_t[tuple_size];
   temp_tuple_row_ = reinterpret_cast<TupleRow*>(&temp_tuple_buffer_);
   swap_buffer_ = new uint8_t[tuple_size];
+  const vector<ExprContext*>& key_ctxs = comp.key_expr_ctxs_lhs();
+  int num_normalizable =
+      KeyNormalizer::NumNormalizableKeys(key_ctxs, NORMALIZED_KEY_LEN);
+  use_normalized_keys_ = num_normalizable > 0;
+  keys_lossless_ = num_normalizable == key_ctxs.size();
+  if (use_normalized_keys_) {
+    // Normalize only the leading keys that fit; any remaining sort exprs are covered
+    // by the comparator tie-break in EntryLess().
+    vector<ExprContext*> prefix_ctxs(
+        key_ctxs.begin(), key_ctxs.begin() + num_normalizable);
+    vector<bool> is_asc(
+        comp.is_asc().begin(), comp.is_asc().begin() + num_normalizable);
+    vector<bool> nulls_first;
+    nulls_first.reserve(num_normalizable);
+    for (int i = 0; i < num_normalizable; ++i) {
+      nulls_first.push_back(comp.nulls_first(i));
+    }
+    key_normalizer_.reset(
+        new KeyNormalizer(prefix_ctxs, NORMALIZED_KEY_LEN, is_asc, nulls_first));
+  }
 }
 
 Sorter::TupleSorter::~TupleSorter() {
@@ -773,10 +898,116 @@ Sorter::TupleSorter::~TupleSorter() {
 
 void Sorter::TupleSorter::Sort(Run* run) {
   run_ = run;
-  SortHelper(TupleIterator(this, 0), TupleIterator(this, run_->num_tuples_));
+  if (use_normalized_keys_) {
+    ComputeNormalizedKeys();
+    SortEntriesHelper(0, run_->num_tuples_);
+    // The entries are only partially sorted if the sort was cancelled; the caller
+    // checks for cancellation, so don't bother moving the tuples.
+    if (LIKELY(!state_->is_cancelled())) PermuteTuples();
+  } else {
+    pivot_cmp_.resize(run_->num_tuples_);
+    SortHelper(TupleIterator(this, 0), TupleIterator(this, run_->num_tuples_));
+  }
   run->is_sorted_ = true;
 }
 
+void Sorter::TupleSorter::ComputeNormalizedKeys() {
+  entries_.resize(run_->num_tuples_);
+  TupleIterator iter(this, 0);
+  for (int64_t i = 0; i < run_->num_tuples_; ++i, iter.Next()) {
+    bool over_budget = key_normalizer_->NormalizeKey(
+        reinterpret_cast<TupleRow*>(&iter.current_tuple_), entries_[i].key);
+    // The normalizer only covers the leading keys that NumNormalizableKeys()
+    // determined fit in NORMALIZED_KEY_LEN bytes.
+    DCHECK(!over_budget);
+    entries_[i].index = i;
+  }
+}
+
+inline bool Sorter::TupleSorter::ComparatorLess(int64_t lhs_index,
+    int64_t rhs_index) const {
+  TupleSorter* non_const_this = const_cast<TupleSorter*>(this);
+  uint8_t* lhs_tuple = non_const_this->TupleAt(lhs_index);
+  uint8_t* rhs_tuple = non_const_this->TupleAt(rhs_index);
+  return less_than_comp_(reinterpret_cast<TupleRow*>(&lhs_tuple),
+      reinterpret_cast<TupleRow*>(&rhs_tuple));
+}
+
+inline bool Sorter::TupleSorter::EntryLess(const SortEntry& lhs,
+    const SortEntry& rhs) const {
+  int cmp = memcmp(lhs.key, rhs.key, NORMALIZED_KEY_LEN);
+  if (cmp != 0) return cmp < 0;
+  // Lossless keys fully determine the order, so equal keys mean the rows compare
+  // equal on every sort expr.
+  if (keys_lossless_) return false;
+  return ComparatorLess(lhs.index, rhs.index);
+}
+
+void Sorter::TupleSorter::SortEntriesHelper(int64_t first, int64_t last) {
+  if (UNLIKELY(state_->is_cancelled())) return;
+  while (last - first > INSERTION_THRESHOLD) {
+    // Dutch national flag partition around the key of the middle entry: everything
+    // in [lt, gt) ends up with a key equal to the pivot's and is in its final
+    // position once any comparator tie-break has been applied.
+    SortEntry pivot = entries_[first + (last - first) / 2];
+    int64_t lt = first;
+    int64_t gt = last;
+    int64_t i = first;
+    while (i < gt) {
+      int cmp = memcmp(entries_[i].key, pivot.key, NORMALIZED_KEY_LEN);
+      if (cmp < 0) {
+        swap(entries_[lt], entries_[i]);
+        ++lt;
+        ++i;
+      } else if (cmp > 0) {
+        --gt;
+        swap(entries_[i], entries_[gt]);
+      } else {
+        ++i;
+      }
+    }
+    if (!keys_lossless_ && gt - lt > 1) SortEqualKeyEntries(lt, gt);
+    SortEntriesHelper(gt, last);
+    last = lt;
+    if (UNLIKELY(state_->is_cancelled())) return;
+  }
+  InsertionSortEntries(first, last);
+}
+
+void Sorter::TupleSorter::InsertionSortEntries(int64_t first, int64_t last) {
+  for (int64_t i = first + 1; i < last; ++i) {
+    SortEntry entry = entries_[i];
+    int64_t j = i;
+    while (j > first && EntryLess(entry, entries_[j - 1])) {
+      entries_[j] = entries_[j - 1];
+      --j;
+    }
+    entries_[j] = entry;
+  }
+}
+
+void Sorter::TupleSorter::SortEqualKeyEntries(int64_t first, int64_t last) {
+  EqualKeyEntryLess less;
+  less.parent = this;
+  sort(entries_.begin() + first, entries_.begin() + last, less);
+}
+
+void Sorter::TupleSorter::PermuteTuples() {
+  // Invert the sorted entries into the destination of each tuple: the tuple at
+  // position entries_[i].index belongs at position i.
+  tuple_dest_.resize(run_->num_tuples_);
+  for (int64_t i = 0; i < run_->num_tuples_; ++i) {
+    tuple_dest_[entries_[i].index] = i;
+  }
+  for (int64_t i = 0; i < run_->num_tuples_; ++i) {
+    while (tuple_dest_[i] != i) {
+      int64_t dest = tuple_dest_[i];
+      Swap(TupleAt(i), TupleAt(dest));
+      swap(tuple_dest_[i], tuple_dest_[dest]);
+    }
+  }
+}
+
 // Sort the sequence of tuples from [first, last).
 // Begin with a sorted sequence of size 1 [first, first+1).
 // During each pass of the outermost loop, add the next tuple (at position 'i') to
@@ -814,25 +1045,34 @@ void Sorter::TupleSorter::InsertionSort(const TupleIterator& first,
 }
 
 Sorter::TupleSorter::TupleIterator Sorter::TupleSorter::Partition(TupleIterator first,
-    TupleIterator last, Tuple* pivot) {
+    TupleIterator last, const TupleIterator& pivot) {
   // Copy pivot into temp_tuple since it points to a tuple within [first, last).
-  memcpy(temp_tuple_buffer_, pivot, tuple_size_);
+  memcpy(temp_tuple_buffer_, pivot.current_tuple_, tuple_size_);
+
+  // Compare the tuples in [first, last) against the pivot up front, one sequential
+  // batch per block, so the search loops below index pivot_cmp_ instead of invoking
+  // the comparator at random positions. The entries move with their tuples in the
+  // swaps, and the pivot copy in temp_tuple_buffer_ never moves, so they stay valid
+  // for the whole partition pass.
+  TupleIterator iter = first;
+  while (iter.index_ < last.index_) {
+    int64_t block_end = min(last.index_,
+        (iter.index_ / block_capacity_ + 1) * static_cast<int64_t>(block_capacity_));
+    less_than_comp_.CompareAgainstPivot(iter.current_tuple_, tuple_size_,
+        block_end - iter.index_, temp_tuple_row_, &pivot_cmp_[iter.index_]);
+    iter = TupleIterator(this, block_end);
+  }
 
   last.Prev();
   while (true) {
     // Search for the first and last out-of-place elements, and swap them.
-    while (less_than_comp_(reinterpret_cast<TupleRow*>(&first.current_tuple_),
-        temp_tuple_row_)) {
-      first.Next();
-    }
-    while (less_than_comp_(temp_tuple_row_,
-        reinterpret_cast<TupleRow*>(&last.current_tuple_))) {
-      last.Prev();
-    }
+    while (pivot_cmp_[first.index_] < 0) first.Next();
+    while (pivot_cmp_[last.index_] > 0) last.Prev();
 
     if (first.index_ >= last.index_) break;
-    // Swap first and last tuples.
+    // Swap first and last tuples along with their cached pivot comparisons.
     Swap(first.current_tuple_, last.current_tuple_);
+    swap(pivot_cmp_[first.index_], pivot_cmp_[last.index_]);
 
     first.Next();
     last.Prev();
@@ -848,8 +1088,7 @@ void Sorter::TupleSorter::SortHelper(TupleIterator first, TupleIterator last) {
     TupleIterator iter(this, first.index_ + (last.index_ - first.index_)/2);
     // Parititon() splits the tuples in [first, last) into two groups (<= pivot
     // and >= pivot) in-place. 'cut' is the index of the first tuple in the second group.
-    TupleIterator cut = Partition(first, last,
-        reinterpret_cast<Tuple*>(iter.current_tuple_));
+    TupleIterator cut = Partition(first, last, iter);
     SortHelper(cut, last);
     last = cut;
     if (UNLIKELY(state_->is_cancelled())) return;
@@ -876,6 +1115,7 @@ Sorter::Sorter(const TupleRowComparator& compare_less_than,
     output_row_desc_(output_row_desc),
     sort_tuple_slot_expr_ctxs_(slot_materialize_expr_ctxs),
     mem_tracker_(mem_tracker),
+    limit_(-1),
     profile_(profile) {
 }
 
@@ -1128,6 +1368,9 @@ Status Sorter::CreateMerger(int num_runs) {
   merging_runs_.clear();
   merger_.reset(
       new SortedRunMerger(compare_less_than_, output_row_desc_, profile_, true));
+  // A merged run never needs to supply more than the first limit_ rows in its order,
+  // so intermediate merges are capped just like the final one.
+  if (limit_ != -1) merger_->set_limit(limit_);
 
   vector<function<Status (RowBatch**)> > merge_runs;
   merge_runs.reserve(num_runs);
@@ -98,6 +98,14 @@ class Sorter {
   // of the unsorted_run_, both of these may fail.
   Status Init();
 
+  // Caps the number of output rows that will ever be consumed from GetNext(), e.g.
+  // the limit (plus offset) of the sort node above. The limit is pushed into the
+  // mergers: the final merge stops exactly at 'limit' rows, and intermediate merges
+  // also stop there since a merged run can never need to supply more than the first
+  // 'limit' rows in its order. -1 (the default) means no limit. Must be set before
+  // InputDone().
+  void set_limit(int64_t limit) { limit_ = limit; }
+
   // Adds a batch of input rows to the current unsorted run.
   Status AddBatch(RowBatch* batch);
 
@@ -179,6 +187,10 @@ class Sorter {
   // Mem tracker for batches created during merge. Not owned by Sorter.
   MemTracker* mem_tracker_;
 
+  // Maximum number of output rows that will be consumed, or -1 for no limit.
+  // Pushed into every merger created (see set_limit()).
+  int64_t limit_;
+
   // Merger object (intermediate or final) currently used to produce sorted runs.
   // Only one merge is performed at a time. Will never be used if the input fits in
   // memory.
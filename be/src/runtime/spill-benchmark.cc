@@ -0,0 +1,328 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
+#include "common/object-pool.h"
+#include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
+#include "runtime/buffered-block-mgr.h"
+#include "runtime/buffered-tuple-stream.h"
+#include "runtime/descriptors.h"
+#include "runtime/disk-io-mgr.h"
+#include "runtime/exec-env.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
+#include "runtime/sorter.h"
+#include "runtime/string-value.h"
+#include "runtime/tmp-file-mgr.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/cpu-info.h"
+#include "util/pretty-printer.h"
+#include "util/stopwatch.h"
+#include "util/thread.h"
+#include "util/tuple-row-compare.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+// Spill-to-disk stress benchmark for the BufferedBlockMgr stack. Drives the two
+// writers of the spill path through workloads much larger than the block mgr
+// limit, against the real scratch disks configured with --scratch_dirs:
+//
+//  - Sorter: adds --input_mb of rows with a block mgr capped at
+//    --block_mgr_limit_mb, forcing intermediate runs to spill, then drains the
+//    merge. Reports add/merge-setup/drain phase times, time to the first output
+//    batch, and effective write/read bandwidth (input volume over phase time) to
+//    compare against what the scratch device can do.
+//
+//  - BufferedTupleStream: writes the same volume to an unpinned stream (each
+//    full block goes to disk) and reads it back, which is the closest stand-in
+//    for the write-coalescing and read-ahead behavior during a spilling
+//    partitioned hash join -- the join spills its partitions through this same
+//    stream API, so regressions here show up in joins too.
+//
+// The block mgr's profile (TotalReadBlockTime, TotalBufferWaitTime,
+// BlockWritesOutstanding, ...) is printed at the end; diff it across runs when
+// evaluating write-coalescing or read-ahead changes, and keep a known-good
+// output around as a spill regression gate.
+
+DEFINE_int32(input_mb, 1024, "volume of input rows to push through each phase");
+DEFINE_int32(block_mgr_limit_mb, 256, "block mgr memory limit; input_mb should be "
+    "several times larger to force spilling");
+DEFINE_int32(spill_string_len, 32, "bytes of string data per row; 0 for fixed-len "
+    "only rows");
+DEFINE_int32(spill_rows_per_batch, 1024, "rows per input batch");
+DEFINE_bool(run_sorter, true, "run the spilling sort phase");
+DEFINE_bool(run_stream, true, "run the unpinned tuple stream phase");
+DECLARE_string(scratch_dirs);
+
+static const int NUM_INPUT_BATCHES = 8;  // pre-generated and cycled
+
+// Fills 'batch' with rows of one bigint slot (random, so the sort has work to do)
+// and an optional string slot of FLAGS_spill_string_len random bytes.
+static RowBatch* CreateBatch(const RowDescriptor& row_desc,
+    const TupleDescriptor* tuple_desc, MemTracker* tracker, ObjectPool* pool) {
+  RowBatch* batch =
+      pool->Add(new RowBatch(row_desc, FLAGS_spill_rows_per_batch, tracker));
+  for (int i = 0; i < FLAGS_spill_rows_per_batch; ++i) {
+    int idx = batch->AddRow();
+    TupleRow* row = batch->GetRow(idx);
+    Tuple* tuple = Tuple::Create(tuple_desc->byte_size(), batch->tuple_data_pool());
+    for (int j = 0; j < tuple_desc->slots().size(); ++j) {
+      const SlotDescriptor* slot_desc = tuple_desc->slots()[j];
+      void* slot = tuple->GetSlot(slot_desc->tuple_offset());
+      if (slot_desc->type().type == TYPE_STRING) {
+        char* data = reinterpret_cast<char*>(
+            batch->tuple_data_pool()->Allocate(FLAGS_spill_string_len));
+        for (int k = 0; k < FLAGS_spill_string_len; ++k) data[k] = 'a' + rand() % 26;
+        StringValue* sv = reinterpret_cast<StringValue*>(slot);
+        sv->ptr = data;
+        sv->len = FLAGS_spill_string_len;
+      } else {
+        *reinterpret_cast<int64_t*>(slot) =
+            (static_cast<int64_t>(rand()) << 32) | rand();
+      }
+    }
+    row->SetTuple(0, tuple);
+    batch->CommitLastRow();
+  }
+  return batch;
+}
+
+static double ToSecs(int64_t ns) { return ns / (1000.0 * 1000.0 * 1000.0); }
+
+static void PrintBandwidth(const string& label, int64_t bytes, int64_t ns) {
+  cout << "  " << label << ": " << ToSecs(ns) << "s  ("
+       << PrettyPrinter::Print(
+              static_cast<int64_t>(bytes / max(ToSecs(ns), 1e-9)),
+              TUnit::BYTES_PER_SECOND) << ")" << endl;
+}
+
+// Spilling sort: add all input, then drain the merge.
+static void RunSorter(RuntimeState* state, RowDescriptor* row_desc,
+    const TupleDescriptor* tuple_desc, const vector<RowBatch*>& batches,
+    int64_t num_batches, int64_t bytes_per_batch, MemTracker* tracker,
+    ObjectPool* pool) {
+  // Materialization exprs (one slot ref per slot) and the bigint sort comparator.
+  MemTracker expr_tracker;
+  vector<ExprContext*> sort_tuple_exprs;
+  for (int i = 0; i < tuple_desc->slots().size(); ++i) {
+    const SlotDescriptor* slot_desc = tuple_desc->slots()[i];
+    sort_tuple_exprs.push_back(pool->Add(new ExprContext(
+        pool->Add(new SlotRef(slot_desc->type(), slot_desc->tuple_offset())))));
+  }
+  vector<ExprContext*> lhs_ctxs(1, pool->Add(new ExprContext(
+      pool->Add(new SlotRef(TYPE_BIGINT, tuple_desc->slots()[0]->tuple_offset())))));
+  vector<ExprContext*> rhs_ctxs(1, pool->Add(new ExprContext(
+      pool->Add(new SlotRef(TYPE_BIGINT, tuple_desc->slots()[0]->tuple_offset())))));
+  Status status = Expr::Prepare(sort_tuple_exprs, NULL, *row_desc, &expr_tracker);
+  if (status.ok()) status = Expr::Prepare(lhs_ctxs, NULL, *row_desc, &expr_tracker);
+  if (status.ok()) status = Expr::Prepare(rhs_ctxs, NULL, *row_desc, &expr_tracker);
+  if (status.ok()) status = Expr::Open(sort_tuple_exprs, NULL);
+  if (status.ok()) status = Expr::Open(lhs_ctxs, NULL);
+  if (status.ok()) status = Expr::Open(rhs_ctxs, NULL);
+  if (!status.ok()) {
+    cout << "Sorter expr setup failed: " << status.GetDetail() << endl;
+    return;
+  }
+  TupleRowComparator less_than(
+      lhs_ctxs, rhs_ctxs, vector<bool>(1, true), vector<bool>(1, false));
+
+  RuntimeProfile* profile = pool->Add(new RuntimeProfile(pool, "SpillSorter"));
+  Sorter sorter(less_than, sort_tuple_exprs, row_desc, tracker, profile, state);
+  status = sorter.Init();
+  if (!status.ok()) {
+    cout << "Sorter init failed: " << status.GetDetail() << endl;
+    return;
+  }
+
+  MonotonicStopWatch add_time;
+  add_time.Start();
+  for (int64_t i = 0; i < num_batches && status.ok(); ++i) {
+    status = sorter.AddBatch(batches[i % NUM_INPUT_BATCHES]);
+  }
+  add_time.Stop();
+  if (status.ok()) {
+    MonotonicStopWatch input_done_time;
+    input_done_time.Start();
+    status = sorter.InputDone();
+    input_done_time.Stop();
+
+    RowBatch out_batch(*row_desc, FLAGS_spill_rows_per_batch, tracker);
+    MonotonicStopWatch drain_time;
+    int64_t first_output_ns = 0;
+    int64_t rows_out = 0;
+    bool eos = false;
+    drain_time.Start();
+    while (status.ok() && !eos) {
+      out_batch.Reset();
+      status = sorter.GetNext(&out_batch, &eos);
+      if (first_output_ns == 0 && out_batch.num_rows() > 0) {
+        first_output_ns = drain_time.ElapsedTime();
+      }
+      rows_out += out_batch.num_rows();
+    }
+    drain_time.Stop();
+
+    int64_t total_bytes = num_batches * bytes_per_batch;
+    cout << "Sorter (" << rows_out << " rows out):" << endl;
+    PrintBandwidth("add input (incl. run spill writes)", total_bytes,
+        add_time.ElapsedTime());
+    PrintBandwidth("input done (final run sort + merge setup)", total_bytes,
+        input_done_time.ElapsedTime());
+    PrintBandwidth("drain merge (incl. spill reads)", total_bytes,
+        drain_time.ElapsedTime());
+    cout << "  time to first output batch after input: "
+         << ToSecs(input_done_time.ElapsedTime() + first_output_ns) << "s" << endl;
+  } else {
+    cout << "Sorter failed: " << status.GetDetail() << endl;
+  }
+
+  Expr::Close(sort_tuple_exprs, NULL);
+  Expr::Close(lhs_ctxs, NULL);
+  Expr::Close(rhs_ctxs, NULL);
+}
+
+// Unpinned tuple stream: every filled block is written to scratch, then read back.
+static void RunTupleStream(RuntimeState* state, const RowDescriptor& row_desc,
+    const vector<RowBatch*>& batches, int64_t num_batches, int64_t bytes_per_batch,
+    MemTracker* tracker) {
+  BufferedBlockMgr::Client* client;
+  Status status = state->block_mgr()->RegisterClient(0, tracker, state, &client);
+  if (!status.ok()) {
+    cout << "Could not register block mgr client: " << status.GetDetail() << endl;
+    return;
+  }
+  BufferedTupleStream stream(state, row_desc, state->block_mgr(), client,
+      false /* use_initial_small_buffers */);
+  status = stream.Init(NULL, false /* pinned */);
+  if (!status.ok()) {
+    cout << "Stream init failed: " << status.GetDetail() << endl;
+    return;
+  }
+
+  MonotonicStopWatch write_time;
+  write_time.Start();
+  for (int64_t i = 0; i < num_batches && status.ok(); ++i) {
+    RowBatch* batch = batches[i % NUM_INPUT_BATCHES];
+    for (int j = 0; j < batch->num_rows(); ++j) {
+      if (!stream.AddRow(batch->GetRow(j))) {
+        status = stream.status();
+        break;
+      }
+    }
+  }
+  write_time.Stop();
+
+  int64_t rows_read = 0;
+  MonotonicStopWatch read_time;
+  if (status.ok()) {
+    bool got_buffer;
+    status = stream.PrepareForRead(&got_buffer);
+    RowBatch out_batch(row_desc, FLAGS_spill_rows_per_batch, tracker);
+    bool eos = false;
+    read_time.Start();
+    while (status.ok() && !eos) {
+      out_batch.Reset();
+      status = stream.GetNext(&out_batch, &eos);
+      rows_read += out_batch.num_rows();
+    }
+    read_time.Stop();
+  }
+
+  if (status.ok()) {
+    cout << "BufferedTupleStream (" << rows_read << " rows, "
+         << PrettyPrinter::Print(stream.byte_size(), TUnit::BYTES)
+         << " in stream):" << endl;
+    PrintBandwidth("write unpinned (spill writes)", stream.byte_size(),
+        write_time.ElapsedTime());
+    PrintBandwidth("read back (spill reads)", stream.byte_size(),
+        read_time.ElapsedTime());
+  } else {
+    cout << "Stream failed: " << status.GetDetail() << endl;
+  }
+  stream.Close();
+}
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  CpuInfo::Init();
+  impala::InitThreading();
+  impala::TmpFileMgr::Init();
+
+  ObjectPool pool;
+  MemTracker tracker;
+  ExecEnv exec_env;
+  exec_env.disk_io_mgr()->Init(&tracker);
+
+  // Cap the block mgr via the query option so spilling starts at the flag value.
+  TPlanFragmentInstanceCtx fragment_ctx;
+  fragment_ctx.query_ctx.request.query_options.__set_max_block_mgr_memory(
+      FLAGS_block_mgr_limit_mb * 1024L * 1024L);
+  RuntimeState state(fragment_ctx, "", &exec_env);
+  state.InitMemTrackers(TUniqueId(), NULL, -1);
+  Status status = state.CreateBlockMgr();
+  if (!status.ok()) {
+    cout << "Could not create block mgr: " << status.GetDetail() << endl;
+    return 1;
+  }
+
+  DescriptorTblBuilder builder(&pool);
+  TupleDescBuilder& tuple_builder = builder.DeclareTuple();
+  tuple_builder << TYPE_BIGINT;
+  if (FLAGS_spill_string_len > 0) tuple_builder << TYPE_STRING;
+  DescriptorTbl* desc_tbl = builder.Build();
+  state.set_desc_tbl(desc_tbl);
+  const TupleDescriptor* tuple_desc = desc_tbl->GetTupleDescriptor(0);
+  RowDescriptor row_desc(*desc_tbl, vector<TTupleId>(1, (TTupleId)0),
+      vector<bool>(1, false));
+
+  srand(1234);
+  vector<RowBatch*> batches;
+  for (int i = 0; i < NUM_INPUT_BATCHES; ++i) {
+    batches.push_back(CreateBatch(row_desc, tuple_desc, &tracker, &pool));
+  }
+  int64_t bytes_per_batch = static_cast<int64_t>(FLAGS_spill_rows_per_batch) *
+      (tuple_desc->byte_size() + FLAGS_spill_string_len);
+  int64_t num_batches = FLAGS_input_mb * 1024L * 1024L / bytes_per_batch;
+
+  cout << "Input: " << FLAGS_input_mb << " MB (" << num_batches << " batches of "
+       << FLAGS_spill_rows_per_batch << " rows)"
+       << "  Block mgr limit: " << FLAGS_block_mgr_limit_mb << " MB"
+       << "  Scratch: " << FLAGS_scratch_dirs << endl << endl;
+
+  if (FLAGS_run_sorter) {
+    RunSorter(&state, &row_desc, tuple_desc, batches, num_batches, bytes_per_batch,
+        &tracker, &pool);
+    cout << endl;
+  }
+  if (FLAGS_run_stream) {
+    RunTupleStream(&state, row_desc, batches, num_batches, bytes_per_batch, &tracker);
+    cout << endl;
+  }
+
+  // The block mgr attached its counters to the runtime state's profile.
+  cout << "Block mgr / state profile:" << endl;
+  state.runtime_profile()->PrettyPrint(&cout);
+  return 0;
+}
@@ -47,6 +47,7 @@ ThreadResourceMgr::ResourcePool::ResourcePool(ThreadResourceMgr* parent)
 
 void ThreadResourceMgr::ResourcePool::Reset() {
   num_threads_ = 0;
+  num_blocked_threads_ = 0;
   num_reserved_optional_threads_ = 0;
   thread_available_fn_ = NULL;
   max_quota_ = INT_MAX;
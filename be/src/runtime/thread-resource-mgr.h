@@ -114,6 +114,22 @@ class ThreadResourceMgr {
     // Must not be called from from ThreadAvailableCb.
     void ReleaseThreadToken(bool required);
 
+    // Marks one of this pool's threads as blocked (e.g. waiting for io) so that it
+    // does not count against the quota while it waits, and notifies the thread
+    // available callback so that a replacement thread can run in the meantime. Each
+    // call must be matched by MarkThreadUnblocked() from the same thread before it
+    // does any more work. The pool will transiently exceed its quota when blocked
+    // threads wake up; surplus optional threads are expected to notice via
+    // optional_exceeded() and exit at their next check, as scanner threads already
+    // do between scan ranges.
+    void MarkThreadBlocked();
+
+    // Marks a thread previously passed to MarkThreadBlocked() as runnable again.
+    void MarkThreadUnblocked();
+
+    // Returns the number of threads currently marked blocked.
+    int num_blocked_threads() const { return num_blocked_threads_; }
+
     // Add a callback to be notified when a thread is available.
     // 'arg' is opaque and passed directly to the callback.
     // The previous callback is no longer notified.
@@ -138,18 +154,22 @@ class ThreadResourceMgr {
     int num_reserved_optional_threads() { return num_reserved_optional_threads_; }
 
     // Returns true if the number of optional threads has now exceeded the quota.
+    // Blocked threads widen the quota: they don't consume cpu, so they shouldn't
+    // force runnable threads out.
     bool optional_exceeded() {
       // Cache this so optional/required are computed based on the same value.
       volatile int64_t num_threads = num_threads_;
       int64_t optional_threads = num_threads >> 32;
       int64_t required_threads = num_threads & 0xFFFFFFFF;
       return optional_threads > num_reserved_optional_threads_ &&
-             optional_threads + required_threads > quota();
+             optional_threads + required_threads > quota() + num_blocked_threads();
     }
 
-    // Returns the number of optional threads that can still be used.
+    // Returns the number of optional threads that can still be used. Threads marked
+    // blocked free up their share of the quota while they wait.
     int num_available_threads() const {
-      int value = std::max(quota() - static_cast<int>(num_threads()),
+      int value = std::max(
+          quota() + num_blocked_threads() - static_cast<int>(num_threads()),
           num_reserved_optional_threads_ - num_optional_threads());
       return std::max(0, value);
     }
@@ -181,6 +201,11 @@ class ThreadResourceMgr {
     // 32 bits and the number of optional threads is the upper 32 bits.
     int64_t num_threads_;
 
+    // Number of threads in this pool currently blocked (e.g. on io), updated
+    // atomically. These threads hold tokens (they are included in num_threads_) but
+    // are discounted from the quota checks while they wait.
+    int64_t num_blocked_threads_;
+
     // Lock for the fields below.  This lock is taken when the callback
     // function is called.
     // TODO: reconsider this.
@@ -238,7 +263,7 @@ inline bool ThreadResourceMgr::ResourcePool::TryAcquireThreadToken(bool* is_rese
     int64_t new_optional_threads = (previous_num_threads >> 32) + 1;
     int64_t new_required_threads = previous_num_threads & 0xFFFFFFFF;
     if (new_optional_threads > num_reserved_optional_threads_ &&
-        new_optional_threads + new_required_threads > quota()) {
+        new_optional_threads + new_required_threads > quota() + num_blocked_threads()) {
       return false;
     }
     bool thread_is_reserved = new_optional_threads <= num_reserved_optional_threads_;
@@ -283,6 +308,23 @@ inline void ThreadResourceMgr::ResourcePool::ReleaseThreadToken(bool required) {
   }
 }
 
+inline void ThreadResourceMgr::ResourcePool::MarkThreadBlocked() {
+  __sync_fetch_and_add(&num_blocked_threads_, 1);
+  // A replacement thread can now run without exceeding the effective quota; same
+  // callback pattern as ReleaseThreadToken().
+  if (num_available_threads() > 0 && thread_available_fn_ != NULL) {
+    boost::unique_lock<boost::mutex> l(lock_);
+    if (num_available_threads() > 0 && thread_available_fn_ != NULL) {
+      thread_available_fn_(this);
+    }
+  }
+}
+
+inline void ThreadResourceMgr::ResourcePool::MarkThreadUnblocked() {
+  DCHECK_GT(num_blocked_threads(), 0);
+  __sync_fetch_and_add(&num_blocked_threads_, -1);
+}
+
 } // namespace impala
 
 #endif
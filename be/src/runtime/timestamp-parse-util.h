@@ -218,6 +218,28 @@ class TimestampParser {
     while (len > 0 && isspace(str[len - 1])) --len;
     // Only process what we have to.
     if (len > DEFAULT_DATE_TIME_FMT_LEN) len = DEFAULT_DATE_TIME_FMT_LEN;
+    // Fast path for the dominant formats yyyy-MM-dd HH:mm:ss[.SSSSSSSSS] and the ISO
+    // variant with a 'T' date/time separator: all separators are checked up front,
+    // after which every digit position is fixed and the generic token loop can be
+    // skipped entirely. Any mismatch falls through to the context dispatch below.
+    if (len >= DEFAULT_SHORT_DATE_TIME_FMT_LEN && str[4] == '-' && str[7] == '-' &&
+        (str[10] == ' ' || str[10] == 'T') && str[13] == ':' && str[16] == ':') {
+      DateTimeParseResult dt_result;
+      if (LIKELY(ParseDefaultDateTime(str, len, &dt_result))) {
+        try {
+          *d = boost::gregorian::date(dt_result.year, dt_result.month, dt_result.day);
+          *t = boost::posix_time::time_duration(dt_result.hour, dt_result.minute,
+              dt_result.second, dt_result.fraction);
+          return true;
+        } catch (boost::exception& e) {
+          VLOG_ROW << "Invalid date: " << dt_result.year << "-" << dt_result.month
+                   << "-" << dt_result.day;
+          *d = boost::gregorian::date();
+          *t = boost::posix_time::time_duration(boost::posix_time::not_a_date_time);
+          return false;
+        }
+      }
+    }
     // Determine the default formatting context that's required for parsing.
     DateTimeFormatContext* dt_ctx = NULL;
     if (LIKELY(len >= DEFAULT_TIME_FMT_LEN)) {
@@ -387,6 +409,58 @@ class TimestampParser {
   }
 
  private:
+  // Parses 'len' ASCII digits at 'str' into '*val'. Returns false on any non-digit
+  // character. Used by the fixed-offset fast path where the digit positions are known,
+  // making StringParser's sign and overflow handling unnecessary.
+  static inline bool ParseFixedDigits(const char* str, int len, int* val) {
+    int result = 0;
+    for (int i = 0; i < len; ++i) {
+      int digit = str[i] - '0';
+      if (UNLIKELY(digit < 0 || digit > 9)) return false;
+      result = result * 10 + digit;
+    }
+    *val = result;
+    return true;
+  }
+
+  // Fixed-offset parse of the default date/time formats. The caller must have already
+  // verified the separators at positions 4, 7, 10, 13 and 16 and capped 'len' at
+  // DEFAULT_DATE_TIME_FMT_LEN, so every remaining position is a digit (or the '.'
+  // introducing the fraction). Returns false on any malformed component, in which case
+  // the caller falls back to the token-based path.
+  static inline bool ParseDefaultDateTime(const char* str, int len,
+      DateTimeParseResult* dt_result) {
+    DCHECK_GE(len, DEFAULT_SHORT_DATE_TIME_FMT_LEN);
+    DCHECK_LE(len, DEFAULT_DATE_TIME_FMT_LEN);
+    if (UNLIKELY(!ParseFixedDigits(str, 4, &dt_result->year) ||
+        !ParseFixedDigits(str + 5, 2, &dt_result->month) ||
+        !ParseFixedDigits(str + 8, 2, &dt_result->day) ||
+        !ParseFixedDigits(str + 11, 2, &dt_result->hour) ||
+        !ParseFixedDigits(str + 14, 2, &dt_result->minute) ||
+        !ParseFixedDigits(str + 17, 2, &dt_result->second))) {
+      return false;
+    }
+    if (UNLIKELY(dt_result->year < 1 || dt_result->month < 1 || dt_result->month > 12 ||
+        dt_result->day < 1 || dt_result->day > 31 || dt_result->hour > 23 ||
+        dt_result->minute > 59 || dt_result->second > 59)) {
+      return false;
+    }
+    if (len > DEFAULT_SHORT_DATE_TIME_FMT_LEN) {
+      int frac_len = len - DEFAULT_SHORT_DATE_TIME_FMT_LEN - 1;
+      int fraction;
+      if (UNLIKELY(frac_len < 1 || str[DEFAULT_SHORT_DATE_TIME_FMT_LEN] != '.' ||
+          !ParseFixedDigits(str + DEFAULT_SHORT_DATE_TIME_FMT_LEN + 1, frac_len,
+              &fraction))) {
+        return false;
+      }
+      // Scale up the fraction to nanoseconds, e.g. ".1238" parses as 1238 but
+      // represents 123800000.
+      for (int i = frac_len; i < 9; ++i) fraction *= 10;
+      dt_result->fraction = fraction;
+    }
+    return true;
+  }
+
   static inline bool ParseDateTime(const char* str, int str_len,
       const DateTimeFormatContext& dt_ctx, DateTimeParseResult* dt_result) {
     DCHECK(dt_ctx.fmt_len > 0);
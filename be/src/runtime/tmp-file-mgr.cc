@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdio>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
@@ -28,6 +30,16 @@
 
 DEFINE_string(scratch_dirs, "/tmp", "Writable scratch directories");
 
+DEFINE_int32(max_pooled_scratch_files, 0, "The maximum number of scratch files per "
+    "scratch directory that are kept on disk after the owning query finishes and "
+    "reused by later queries. Reusing a scratch file skips file creation and extent "
+    "allocation on the spill path. 0 disables pooling and scratch files are deleted "
+    "when the query finishes.");
+
+DEFINE_int64(scratch_prealloc_bytes, 0, "If positive, scratch files are extended in "
+    "increments of at least this many bytes rather than one block at a time, reducing "
+    "filesystem metadata updates for spill-heavy queries. 0 extends files on demand.");
+
 using namespace boost;
 using namespace boost::filesystem;
 using namespace boost::uuids;
@@ -40,6 +52,8 @@ const string TMP_SUB_DIR_NAME = "impala-scratch";
 const uint64_t AVAILABLE_SPACE_THRESHOLD_MB = 1024;
 bool TmpFileMgr::initialized_;
 vector<string> TmpFileMgr::tmp_dirs_;
+mutex TmpFileMgr::file_pool_lock_;
+vector<list<TmpFileMgr::PooledFile> > TmpFileMgr::file_pool_;
 
 Status TmpFileMgr::Init() {
   DCHECK(!initialized_);
@@ -71,6 +85,7 @@ Status TmpFileMgr::Init() {
       tmp_dirs_.push_back(create_dir_path.string());
     }
   }
+  file_pool_.resize(tmp_dirs_.size());
   initialized_ = true;
   Status status = FileSystemUtil::CreateDirectories(tmp_dirs_);
   if (status.ok()) {
@@ -95,11 +110,51 @@ Status TmpFileMgr::GetFile(int tmp_device_id, const TUniqueId& query_id,
   new_file_path /= file_name.str();
 
   *new_file = new File(new_file_path.string());
+  (*new_file)->device_id_ = tmp_device_id;
+
+  if (FLAGS_max_pooled_scratch_files > 0) {
+    PooledFile pooled;
+    bool have_pooled = false;
+    {
+      lock_guard<mutex> l(file_pool_lock_);
+      if (!file_pool_[tmp_device_id].empty()) {
+        pooled = file_pool_[tmp_device_id].front();
+        file_pool_[tmp_device_id].pop_front();
+        have_pooled = true;
+      }
+    }
+    if (have_pooled) {
+      // Renaming keeps the file's inode and already-allocated space but gives it the
+      // new query's name for debuggability. If the rename fails (e.g. the pooled file
+      // was removed externally), fall back to creating a fresh file.
+      if (::rename(pooled.path.c_str(), new_file_path.c_str()) == 0) {
+        (*new_file)->current_size_ = pooled.size;
+        (*new_file)->disk_id_ = DiskInfo::disk_id(new_file_path.c_str());
+      } else {
+        LOG(WARNING) << "Could not reuse pooled scratch file " << pooled.path
+                     << ", creating a new scratch file instead.";
+      }
+    }
+  }
   return Status::OK;
 }
 
+bool TmpFileMgr::ReturnFileToPool(File* file) {
+  if (FLAGS_max_pooled_scratch_files <= 0) return false;
+  if (file->device_id_ < 0 || file->device_id_ >= file_pool_.size()) return false;
+  lock_guard<mutex> l(file_pool_lock_);
+  list<PooledFile>* pool = &file_pool_[file->device_id_];
+  if (pool->size() >= FLAGS_max_pooled_scratch_files) return false;
+  PooledFile pooled;
+  pooled.path = file->path_;
+  pooled.size = file->current_size_;
+  pool->push_back(pooled);
+  return true;
+}
+
 TmpFileMgr::File::File(const string& path)
   : path_(path),
+    device_id_(-1),
     current_offset_(0),
     current_size_(0) {
 }
@@ -118,6 +173,9 @@ Status TmpFileMgr::File::AllocateSpace(int64_t write_size, int64_t* offset) {
   current_offset_ += write_size;
   if (current_offset_ > current_size_) {
     int64_t trunc_len = current_offset_ + write_size;
+    if (FLAGS_scratch_prealloc_bytes > 0) {
+      trunc_len = ::max(trunc_len, current_size_ + FLAGS_scratch_prealloc_bytes);
+    }
     RETURN_IF_ERROR(FileSystemUtil::ResizeFile(path_, trunc_len));
     current_size_ = trunc_len;
   }
@@ -127,7 +185,13 @@ Status TmpFileMgr::File::AllocateSpace(int64_t write_size, int64_t* offset) {
 }
 
 Status TmpFileMgr::File::Remove() {
-  if (current_size_ > 0) FileSystemUtil::RemovePaths(vector<string>(1, path_));
+  if (current_size_ > 0) {
+    // Hand the file back to the daemon-wide pool if there is room, so a later query
+    // can reuse the already-allocated space. Otherwise delete it.
+    if (!TmpFileMgr::ReturnFileToPool(this)) {
+      FileSystemUtil::RemovePaths(vector<string>(1, path_));
+    }
+  }
   return Status::OK;
 }
 
@@ -15,6 +15,10 @@
 #ifndef IMPALA_RUNTIME_TMP_FILE_MGR_H
 #define IMPALA_RUNTIME_TMP_FILE_MGR_H
 
+#include <list>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
 #include <common/status.h>
 #include "gen-cpp/Types_types.h"  // for TUniqueId
 
@@ -37,7 +41,10 @@ class TmpFileMgr {
     // The physical file is created on the first call to AllocateSpace().
     Status AllocateSpace(int64_t write_size, int64_t* offset);
 
-    // Delete the physical file on disk, if one was created.
+    // Release the physical file on disk, if one was created. When scratch file
+    // pooling is enabled (--max_pooled_scratch_files > 0) the file is handed back
+    // to the daemon-wide pool for reuse by a later query instead of being unlinked,
+    // so the next spill skips file creation and extent allocation.
     // It is not valid to read or write to a file after calling Remove().
     Status Remove();
 
@@ -63,6 +70,9 @@ class TmpFileMgr {
     // The id of the disk on which the physical file lies.
     int disk_id_;
 
+    // The tmp device this file was created on; index into tmp_dirs_ and file_pool_.
+    int device_id_;
+
     // Offset to which the next block will be written.
     int64_t current_offset_;
 
@@ -87,10 +97,32 @@ class TmpFileMgr {
   static int num_tmp_devices() { return tmp_dirs_.size(); }
 
  private:
+  // A scratch file retained after a query finished, available for reuse.
+  struct PooledFile {
+    // Path of the physical file on disk.
+    std::string path;
+
+    // Size the file had been grown to when it was returned to the pool. A reusing
+    // query inherits this size and does not need to extend the file below it.
+    int64_t size;
+  };
+
+  // Returns 'file' to the daemon-wide pool for its device. Returns false if pooling
+  // is disabled or the pool for the device is full, in which case the caller should
+  // delete the physical file.
+  static bool ReturnFileToPool(File* file);
+
   static bool initialized_;
 
   // The created tmp directories, atmost one per device.
   static std::vector<std::string> tmp_dirs_;
+
+  // Protects file_pool_.
+  static boost::mutex file_pool_lock_;
+
+  // Per-device pools of scratch files kept for reuse across queries. Only used if
+  // --max_pooled_scratch_files > 0. Indexed by tmp device id.
+  static std::vector<std::list<PooledFile> > file_pool_;
 };
 
 }
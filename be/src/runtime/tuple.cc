@@ -14,6 +14,7 @@
 
 #include "runtime/tuple.h"
 
+#include <stdint.h>  // for intptr_t
 #include <vector>
 
 #include "exprs/expr.h"
@@ -73,6 +74,29 @@ void Tuple::DeepCopy(const TupleDescriptor& desc, char** data, int* offset,
   }
 }
 
+void Tuple::ConvertStringsToOffsets(const TupleDescriptor& desc, const uint8_t* data) {
+  for (vector<SlotDescriptor*>::const_iterator i = desc.string_slots().begin();
+       i != desc.string_slots().end(); ++i) {
+    DCHECK((*i)->type().IsVarLen());
+    if (IsNull((*i)->null_indicator_offset())) continue;
+    StringValue* string_v = GetStringSlot((*i)->tuple_offset());
+    DCHECK_GE(reinterpret_cast<const uint8_t*>(string_v->ptr), data);
+    string_v->ptr = reinterpret_cast<char*>(
+        string_v->ptr - reinterpret_cast<const char*>(data));
+  }
+}
+
+void Tuple::ConvertOffsetsToPointers(const TupleDescriptor& desc, uint8_t* data) {
+  for (vector<SlotDescriptor*>::const_iterator i = desc.string_slots().begin();
+       i != desc.string_slots().end(); ++i) {
+    DCHECK((*i)->type().IsVarLen());
+    if (IsNull((*i)->null_indicator_offset())) continue;
+    StringValue* string_v = GetStringSlot((*i)->tuple_offset());
+    int offset = reinterpret_cast<intptr_t>(string_v->ptr);
+    string_v->ptr = reinterpret_cast<char*>(data) + offset;
+  }
+}
+
 template <bool collect_string_vals>
 void Tuple::MaterializeExprs(
     TupleRow* row, const TupleDescriptor& desc,
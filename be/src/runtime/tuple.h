@@ -83,6 +83,19 @@ class Tuple {
   void DeepCopy(const TupleDescriptor& desc, char** data, int* offset,
                 bool convert_ptrs = false);
 
+  // Converts the non-NULL string slot pointers of this tuple into offsets relative
+  // to 'data'. All referenced string data must live in the buffer starting at 'data'.
+  // This is the same representation the serialization path writes (DeepCopy with
+  // convert_ptrs), promoted to an in-place operation: a tuple in offset form has no
+  // raw pointers, so the buffer holding it and its string data can be moved,
+  // compacted or handed to another batch wholesale and rebased afterwards with
+  // ConvertOffsetsToPointers().
+  void ConvertStringsToOffsets(const TupleDescriptor& desc, const uint8_t* data);
+
+  // Inverse of ConvertStringsToOffsets(): converts the non-NULL string slot offsets
+  // of this tuple into pointers into the buffer starting at 'data'.
+  void ConvertOffsetsToPointers(const TupleDescriptor& desc, uint8_t* data);
+
   // Materialize this by evaluating the expressions in materialize_exprs
   // over the specified 'row'. 'pool' is used to allocate var-length data.
   // (Memory for this tuple itself must already be allocated.)
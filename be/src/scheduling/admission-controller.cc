@@ -14,6 +14,8 @@
 
 #include "scheduling/admission-controller.h"
 
+#include <limits>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
@@ -25,6 +27,7 @@
 #include "runtime/exec-env.h"
 #include "runtime/mem-tracker.h"
 #include "util/debug-util.h"
+#include "util/hash-util.h"
 #include "util/time.h"
 #include "util/runtime-profile.h"
 
@@ -35,6 +38,49 @@ using namespace strings;
 DEFINE_int64(queue_wait_timeout_ms, 60 * 1000, "Maximum amount of time (in "
     "milliseconds) that a request will wait to be admitted before timing out.");
 
+DEFINE_int64(admission_fast_pass_mem_threshold, 0, "(Advanced) If positive, queries "
+    "with a cluster-wide memory estimate below this many bytes may be admitted via a "
+    "per-pool token budget with a single atomic operation, without acquiring the "
+    "admission controller lock. 0 disables the fast pass.");
+
+DEFINE_int64(admission_fast_pass_max_scan_ranges, -1, "(Advanced) Maximum number of "
+    "scan ranges a query may have and still qualify for the admission fast pass. A "
+    "negative value means the number of scan ranges is not considered.");
+
+DEFINE_int64(admission_queue_aging_time_ms, 0, "(Advanced) If positive, queued "
+    "queries are dequeued smallest-memory-estimate first instead of FIFO. The "
+    "effective estimate of a queued query is halved for every this many milliseconds "
+    "it has waited, so a large query ages toward the front and cannot starve. 0 "
+    "preserves FIFO ordering.");
+
+DEFINE_int64(admission_large_query_mem_threshold, 0, "(Advanced) If positive, "
+    "queries with a cluster memory estimate of at least this many bytes form a "
+    "'large' size class of which at most --admission_max_large_queries are admitted "
+    "concurrently per pool by this impalad. 0 disables size-class shaping.");
+
+DEFINE_int64(admission_max_large_queries, -1, "(Advanced) Maximum number of 'large' "
+    "queries (see --admission_large_query_mem_threshold) running concurrently per "
+    "pool on this impalad. A negative value means no limit.");
+
+DEFINE_bool(admission_use_mem_estimate_feedback, false, "(Advanced) If true, the "
+    "admission controller records the peak per-host memory consumption of queries "
+    "that complete successfully and uses it in place of the planner's per-host "
+    "memory estimate when admitting later executions of the same statement, if the "
+    "recorded peak (scaled by --admission_mem_estimate_feedback_headroom) is lower. "
+    "Explicit memory limits set via query options are never overridden.");
+
+DEFINE_int64(admission_mem_estimate_feedback_min_samples, 3, "(Advanced) Minimum "
+    "number of completed executions of a statement before its recorded peak memory "
+    "consumption is used to refine admission estimates.");
+
+DEFINE_double(admission_mem_estimate_feedback_headroom, 1.5, "(Advanced) Factor "
+    "applied to the largest recorded peak memory consumption of a statement when "
+    "refining its admission estimate, to absorb run-to-run variation.");
+
+DEFINE_int64(admission_mem_estimate_feedback_max_entries, 10000, "(Advanced) Maximum "
+    "number of distinct statements for which peak memory consumption is recorded. "
+    "Once the limit is reached, new statements are not recorded.");
+
 namespace impala {
 
 const string AdmissionController::IMPALA_REQUEST_QUEUE_TOPIC("impala-request-queue");
@@ -85,10 +131,17 @@ const string QUERY_EVENT_COMPLETED_ADMISSION = "Completed admission";
 // Profile info string for admission result
 const string PROFILE_INFO_KEY_ADMISSION_RESULT = "Admission result";
 const string PROFILE_INFO_VAL_ADMIT_IMMEDIATELY = "Admitted immediately";
+const string PROFILE_INFO_VAL_ADMIT_FAST_PASS = "Admitted immediately (fast pass)";
 const string PROFILE_INFO_VAL_ADMIT_QUEUED = "Admitted (queued)";
 const string PROFILE_INFO_VAL_REJECTED = "Rejected";
 const string PROFILE_INFO_VAL_TIME_OUT = "Timed out (queued)";
 
+// Profile info string added when the memory estimate was refined from the recorded
+// peak consumption of past executions (see --admission_use_mem_estimate_feedback).
+// $0 = refined per-host estimate, $1 = original per-host estimate
+const string PROFILE_INFO_KEY_REFINED_MEM_ESTIMATE = "Admission mem estimate refined";
+const string PROFILE_INFO_VAL_REFINED_MEM_ESTIMATE = "$0 (was $1)";
+
 // Error status string formats
 // $0 = pool, $1 = rejection reason (see REASON_XXX below)
 const string STATUS_REJECTED = "Rejected query from pool $0 : $1";
@@ -112,6 +165,9 @@ const string QUEUED_NUM_RUNNING = "number of running queries $0 is over limit $1
 // $0 = query estimate, $1 = current pool memory estimate, $2 = pool memory limit
 const string QUEUED_MEM_LIMIT = "query memory estimate $0 plus current pool "
     "memory estimate $1 is over pool memory limit $2";
+// $0 = num running large queries, $1 = large query limit
+const string QUEUED_LARGE_QUERY_LIMIT = "number of running large queries $0 is at the "
+    "limit $1 set by --admission_max_large_queries";
 // $0 = queue size
 const string QUEUED_QUEUE_NOT_EMPTY = "queue is not empty (size $0); queued queries are "
     "executed first";
@@ -225,7 +281,8 @@ Status AdmissionController::CanAdmitRequest(const string& pool_name,
   // Can't admit if:
   //  (a) Already over the maximum number of requests
   //  (b) Request will go over the mem limit
-  //  (c) This is not admitting from the queue and there are already queued requests
+  //  (c) The query is large and the large size class is at its concurrency limit
+  //  (d) This is not admitting from the queue and there are already queued requests
   if (max_requests >= 0 && total_stats.num_running >= max_requests) {
     return Status::Expected(Substitute(QUEUED_NUM_RUNNING, total_stats.num_running,
         max_requests));
@@ -234,12 +291,56 @@ Status AdmissionController::CanAdmitRequest(const string& pool_name,
         PrettyPrinter::Print(query_total_estimated_mem, TUnit::BYTES),
         PrettyPrinter::Print(current_cluster_estimate_mem, TUnit::BYTES),
         PrettyPrinter::Print(mem_limit, TUnit::BYTES)));
+  } else if (IsLargeQuery(schedule) && FLAGS_admission_max_large_queries >= 0 &&
+      local_large_queries_[pool_name] >= FLAGS_admission_max_large_queries) {
+    return Status::Expected(Substitute(QUEUED_LARGE_QUERY_LIMIT,
+        local_large_queries_[pool_name], FLAGS_admission_max_large_queries));
   } else if (!admit_from_queue && total_stats.num_queued > 0) {
     return Status::Expected(Substitute(QUEUED_QUEUE_NOT_EMPTY, total_stats.num_queued));
   }
   return Status::OK;
 }
 
+bool AdmissionController::IsLargeQuery(const QuerySchedule& schedule) {
+  if (FLAGS_admission_large_query_mem_threshold <= 0) return false;
+  return schedule.GetClusterMemoryEstimate() >=
+      FLAGS_admission_large_query_mem_threshold;
+}
+
+AdmissionController::QueueNode* AdmissionController::PickQueueCandidate(
+    const string& pool_name, RequestQueue* queue) {
+  QueueNode* head = queue->head();
+  if (head == NULL) return NULL;
+  const bool large_class_full = FLAGS_admission_max_large_queries >= 0 &&
+      FLAGS_admission_large_query_mem_threshold > 0 &&
+      local_large_queries_[pool_name] >= FLAGS_admission_max_large_queries;
+  if (FLAGS_admission_queue_aging_time_ms <= 0 && !large_class_full) return head;
+
+  QueueNode* best = NULL;
+  int64_t best_estimate = 0;
+  const int64_t now_ms = MonotonicMillis();
+  for (QueueNode* node = head; node != NULL; node = node->Next()) {
+    // Skip large queries while their size class is at its limit so that they do
+    // not hold back the smaller queries queued behind them.
+    if (large_class_full && IsLargeQuery(node->schedule)) continue;
+    if (FLAGS_admission_queue_aging_time_ms <= 0) return node; // FIFO among the rest
+    // Halve the effective estimate for every aging period waited so that an old
+    // large query eventually reaches the front. Ties go to arrival order.
+    int64_t estimate = node->schedule.GetClusterMemoryEstimate();
+    int64_t age_periods =
+        (now_ms - node->queue_time_ms) / FLAGS_admission_queue_aging_time_ms;
+    estimate >>= min<int64_t>(age_periods, 63);
+    if (best == NULL || estimate < best_estimate) {
+      best = node;
+      best_estimate = estimate;
+    }
+  }
+  // Only blocked large queries are queued; return the head so that the caller
+  // observes the reason it cannot be admitted and stops dequeuing.
+  if (best == NULL) return head;
+  return best;
+}
+
 Status AdmissionController::RejectRequest(const string& pool_name,
     const int64_t max_requests, const int64_t mem_limit, const int64_t max_queued,
     const QuerySchedule& schedule) {
@@ -262,8 +363,190 @@ Status AdmissionController::RejectRequest(const string& pool_name,
   return Status(Substitute(STATUS_REJECTED, pool_name, reject_reason));
 }
 
+bool AdmissionController::AdmitFastPass(QuerySchedule* schedule) {
+  if (FLAGS_admission_fast_pass_mem_threshold <= 0) return false;
+  const int64_t mem_estimate = schedule->GetClusterMemoryEstimate();
+  if (mem_estimate >= FLAGS_admission_fast_pass_mem_threshold) return false;
+  // Large queries (however the thresholds are configured) must go through the
+  // regular path so that their size class is accounted for.
+  if (IsLargeQuery(*schedule)) return false;
+  if (FLAGS_admission_fast_pass_max_scan_ranges >= 0 &&
+      schedule->num_scan_ranges() > FLAGS_admission_fast_pass_max_scan_ranges) {
+    return false;
+  }
+
+  shared_ptr<FastPassTokens> bucket;
+  {
+    lock_guard<mutex> l(fast_pass_lock_);
+    FastPassMap::iterator it = fast_pass_map_.find(schedule->request_pool());
+    // No budget has been published for this pool yet, e.g. because this is the first
+    // request to it. RefillFastPassTokens() creates the bucket on the regular path.
+    if (it == fast_pass_map_.end()) return false;
+    bucket = it->second;
+  }
+
+  // Take a token with a single compare-and-swap. The budget was computed from the
+  // statestore-synced aggregates, which are soft limits already (see class comment),
+  // so racing with a concurrent refill is acceptable: the refill overwrites the
+  // count with a fresh budget that accounts for all flushed admissions.
+  while (true) {
+    int64_t tokens = bucket->tokens.Read();
+    if (tokens <= 0) return false;
+    if (bucket->tokens.CompareAndSwap(tokens, tokens - 1)) break;
+  }
+
+  // Record the admission so that the pool stats can be updated the next time
+  // admission_ctrl_lock_ is taken for this pool.
+  bucket->admitted_num += 1;
+  bucket->admitted_mem += mem_estimate;
+  schedule->set_is_admitted(true);
+  schedule->summary_profile()->AddInfoString(PROFILE_INFO_KEY_ADMISSION_RESULT,
+      PROFILE_INFO_VAL_ADMIT_FAST_PASS);
+  VLOG_QUERY << "Fast pass admitted query id=" << schedule->query_id()
+             << " pool=" << schedule->request_pool() << " mem_estimate="
+             << PrettyPrinter::Print(mem_estimate, TUnit::BYTES);
+  return true;
+}
+
+void AdmissionController::FlushFastPassAdmissions(const string& pool_name) {
+  shared_ptr<FastPassTokens> bucket;
+  {
+    lock_guard<mutex> l(fast_pass_lock_);
+    FastPassMap::iterator it = fast_pass_map_.find(pool_name);
+    if (it == fast_pass_map_.end()) return;
+    bucket = it->second;
+  }
+  // The two counters are swapped independently, so an admission racing with this
+  // flush may have its count and memory estimate applied by different flushes. That
+  // only skews the soft estimates momentarily.
+  const int64_t num_admitted = bucket->admitted_num.Swap(0);
+  if (num_admitted == 0) return;
+  const int64_t mem_admitted = bucket->admitted_mem.Swap(0);
+  TPoolStats* total_stats = &cluster_pool_stats_[pool_name];
+  TPoolStats* local_stats = &local_pool_stats_[pool_name];
+  local_stats->num_running += num_admitted;
+  total_stats->num_running += num_admitted;
+  local_stats->mem_estimate += mem_admitted;
+  total_stats->mem_estimate += mem_admitted;
+  pools_for_updates_.insert(pool_name);
+  PoolMetrics* pool_metrics = GetPoolMetrics(pool_name);
+  if (pool_metrics != NULL) {
+    pool_metrics->local_admitted->Increment(num_admitted);
+    pool_metrics->local_mem_estimate->Increment(mem_admitted);
+    pool_metrics->cluster_mem_estimate->Increment(mem_admitted);
+  }
+  VLOG_RPC << "Applied " << num_admitted << " fast pass admissions: "
+           << DebugPoolStats(pool_name, total_stats, local_stats);
+}
+
+void AdmissionController::RefillFastPassTokens(const string& pool_name) {
+  if (FLAGS_admission_fast_pass_mem_threshold <= 0) return;
+  PoolConfigMap::iterator it = pool_config_cache_.find(pool_name);
+  if (it == pool_config_cache_.end()) return; // No local requests in this pool yet
+  const TPoolConfigResult& pool_config = it->second;
+  const int64_t max_requests = pool_config.max_requests;
+  const int64_t mem_limit = pool_config.mem_limit;
+  const TPoolStats& total_stats = cluster_pool_stats_[pool_name];
+
+  int64_t budget = numeric_limits<int64_t>::max();
+  // Disabled pools and pools with queued requests get no tokens: requests to
+  // disabled pools must go through RejectRequest() and queued requests are admitted
+  // FCFS from the queue.
+  if (max_requests == 0 || mem_limit == 0 || total_stats.num_queued > 0) {
+    budget = 0;
+  } else {
+    if (max_requests > 0) {
+      budget = min(budget, max_requests - total_stats.num_running);
+    }
+    if (mem_limit > 0) {
+      const int64_t mem_headroom = mem_limit -
+          max(total_stats.mem_usage, total_stats.mem_estimate);
+      budget = min(budget, mem_headroom / FLAGS_admission_fast_pass_mem_threshold);
+    }
+    // Every impalad computes its budget from the same aggregates, so only hand out
+    // half of the headroom to bound the cluster-wide overshoot between statestore
+    // updates.
+    budget = max(0L, budget / 2);
+  }
+
+  shared_ptr<FastPassTokens> bucket;
+  {
+    lock_guard<mutex> l(fast_pass_lock_);
+    shared_ptr<FastPassTokens>* entry = &fast_pass_map_[pool_name];
+    if (entry->get() == NULL) entry->reset(new FastPassTokens());
+    bucket = *entry;
+  }
+  bucket->tokens.Swap(budget);
+  VLOG_ROW << "Fast pass budget for pool=" << pool_name << ": " << budget << " tokens";
+}
+
+uint64_t AdmissionController::MemFeedbackFingerprint(const QuerySchedule& schedule) {
+  const string& pool_name = schedule.request_pool();
+  const string& stmt = schedule.request().query_ctx.request.stmt;
+  uint64_t hash =
+      HashUtil::FnvHash64(pool_name.data(), pool_name.size(), HashUtil::FNV64_SEED);
+  return HashUtil::FnvHash64(stmt.data(), stmt.size(), hash);
+}
+
+void AdmissionController::RefineMemEstimate(QuerySchedule* schedule) {
+  const uint64_t fingerprint = MemFeedbackFingerprint(*schedule);
+  int64_t refined = -1;
+  {
+    lock_guard<mutex> lock(admission_ctrl_lock_);
+    MemFeedbackMap::const_iterator it = mem_feedback_map_.find(fingerprint);
+    if (it == mem_feedback_map_.end()) return;
+    if (it->second.num_completed < FLAGS_admission_mem_estimate_feedback_min_samples) {
+      return;
+    }
+    refined = static_cast<int64_t>(
+        it->second.max_peak_mem * FLAGS_admission_mem_estimate_feedback_headroom);
+  }
+  // Only ever lower the estimate: a recorded peak above the planner's estimate means
+  // the estimate was optimistic, and raising it would reduce utilization further.
+  const int64_t original_estimate = schedule->GetPerHostMemoryEstimate();
+  if (refined <= 0 || refined >= original_estimate) return;
+  schedule->set_refined_per_host_mem_estimate(refined);
+  schedule->summary_profile()->AddInfoString(PROFILE_INFO_KEY_REFINED_MEM_ESTIMATE,
+      Substitute(PROFILE_INFO_VAL_REFINED_MEM_ESTIMATE,
+          PrettyPrinter::Print(schedule->GetPerHostMemoryEstimate(), TUnit::BYTES),
+          PrettyPrinter::Print(original_estimate, TUnit::BYTES)));
+  VLOG_QUERY << "Refined mem estimate for query id=" << schedule->query_id()
+             << " from recorded peak consumption: per-host estimate="
+             << PrettyPrinter::Print(schedule->GetPerHostMemoryEstimate(), TUnit::BYTES)
+             << " (was " << PrettyPrinter::Print(original_estimate, TUnit::BYTES)
+             << ")";
+}
+
+void AdmissionController::RecordMemFeedback(const QuerySchedule& schedule) {
+  const int64_t peak_mem = schedule.per_host_peak_mem_usage();
+  if (peak_mem <= 0) return;
+  const uint64_t fingerprint = MemFeedbackFingerprint(schedule);
+  MemFeedbackMap::iterator it = mem_feedback_map_.find(fingerprint);
+  if (it == mem_feedback_map_.end()) {
+    if (mem_feedback_map_.size() >=
+        static_cast<size_t>(FLAGS_admission_mem_estimate_feedback_max_entries)) {
+      return;
+    }
+    it = mem_feedback_map_.insert(make_pair(fingerprint, MemFeedbackEntry())).first;
+  }
+  ++it->second.num_completed;
+  it->second.max_peak_mem = max(it->second.max_peak_mem, peak_mem);
+}
+
 Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
   const string& pool_name = schedule->request_pool();
+
+  schedule->query_events()->MarkEvent(QUERY_EVENT_SUBMIT_FOR_ADMISSION);
+  ScopedEvent completedEvent(schedule->query_events(), QUERY_EVENT_COMPLETED_ADMISSION);
+
+  // Refine the memory estimate from recorded peak consumption before it is consulted
+  // by the fast pass or any of the admission checks below.
+  if (FLAGS_admission_use_mem_estimate_feedback) RefineMemEstimate(schedule);
+
+  // Small queries may be admitted with a single atomic operation, without fetching
+  // the pool config or taking admission_ctrl_lock_.
+  if (AdmitFastPass(schedule)) return Status::OK;
+
   TPoolConfigResult pool_config;
   RETURN_IF_ERROR(request_pool_service_->GetPoolConfig(pool_name, &pool_config));
   const int64_t max_requests = pool_config.max_requests;
@@ -274,12 +557,11 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
   QueueNode queue_node(*schedule);
   Status admitStatus; // An error status specifies why query is not admitted
 
-  schedule->query_events()->MarkEvent(QUERY_EVENT_SUBMIT_FOR_ADMISSION);
-  ScopedEvent completedEvent(schedule->query_events(), QUERY_EVENT_COMPLETED_ADMISSION);
   {
     lock_guard<mutex> lock(admission_ctrl_lock_);
     RequestQueue* queue = &request_queue_map_[pool_name];
     pool_config_cache_[pool_name] = pool_config;
+    FlushFastPassAdmissions(pool_name);
     PoolMetrics* pool_metrics = GetPoolMetrics(pool_name);
     TPoolStats* total_stats = &cluster_pool_stats_[pool_name];
     TPoolStats* local_stats = &local_pool_stats_[pool_name];
@@ -304,6 +586,7 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
           PROFILE_INFO_VAL_ADMIT_IMMEDIATELY);
       ++total_stats->num_running;
       ++local_stats->num_running;
+      if (IsLargeQuery(*schedule)) ++local_large_queries_[pool_name];
       int64_t mem_estimate = schedule->GetClusterMemoryEstimate();
       local_stats->mem_estimate += mem_estimate;
       total_stats->mem_estimate += mem_estimate;
@@ -312,6 +595,7 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
         pool_metrics->local_mem_estimate->Increment(mem_estimate);
         pool_metrics->cluster_mem_estimate->Increment(mem_estimate);
       }
+      RefillFastPassTokens(pool_name);
       VLOG_QUERY << "Admitted query id=" << schedule->query_id();
       VLOG_RPC << "Final: " << DebugPoolStats(pool_name, total_stats, local_stats);
       return Status::OK;
@@ -334,7 +618,9 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
     pools_for_updates_.insert(pool_name);
     ++local_stats->num_queued;
     ++total_stats->num_queued;
+    queue_node.queue_time_ms = MonotonicMillis();
     queue->Enqueue(&queue_node);
+    RefillFastPassTokens(pool_name); // Queued requests zero out the fast pass budget
     if (pool_metrics != NULL) pool_metrics->local_queued->Increment(1L);
   }
 
@@ -374,6 +660,7 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
           PROFILE_INFO_VAL_TIME_OUT);
       --local_stats->num_queued;
       --total_stats->num_queued;
+      RefillFastPassTokens(pool_name);
       if (pool_metrics != NULL) pool_metrics->local_timed_out->Increment(1L);
       return Status(Substitute(STATUS_TIME_OUT, queue_wait_timeout_ms,
             admitStatus.GetDetail()));
@@ -397,12 +684,18 @@ Status AdmissionController::ReleaseQuery(QuerySchedule* schedule) {
   const string& pool_name = schedule->request_pool();
   {
     lock_guard<mutex> lock(admission_ctrl_lock_);
+    FlushFastPassAdmissions(pool_name);
     TPoolStats* total_stats = &cluster_pool_stats_[pool_name];
     TPoolStats* local_stats = &local_pool_stats_[pool_name];
     DCHECK_GT(total_stats->num_running, 0);
     DCHECK_GT(local_stats->num_running, 0);
     --total_stats->num_running;
     --local_stats->num_running;
+    if (IsLargeQuery(*schedule)) {
+      int64_t* num_large = &local_large_queries_[pool_name];
+      DCHECK_GT(*num_large, 0);
+      --(*num_large);
+    }
 
     int64_t mem_estimate = schedule->GetClusterMemoryEstimate();
     local_stats->mem_estimate -= mem_estimate;
@@ -413,7 +706,9 @@ Status AdmissionController::ReleaseQuery(QuerySchedule* schedule) {
       pool_metrics->local_mem_estimate->Increment(-1 * mem_estimate);
       pool_metrics->cluster_mem_estimate->Increment(-1 * mem_estimate);
     }
+    if (FLAGS_admission_use_mem_estimate_feedback) RecordMemFeedback(*schedule);
     pools_for_updates_.insert(pool_name);
+    RefillFastPassTokens(pool_name);
     VLOG_RPC << "Released query id=" << schedule->query_id() << " "
              << DebugPoolStats(pool_name, total_stats, local_stats);
   }
@@ -431,6 +726,7 @@ void AdmissionController::UpdatePoolStats(
   {
     lock_guard<mutex> lock(admission_ctrl_lock_);
     BOOST_FOREACH(PoolStatsMap::value_type& entry, local_pool_stats_) {
+      FlushFastPassAdmissions(entry.first);
       UpdateLocalMemUsage(entry.first);
     }
     AddPoolUpdates(subscriber_topic_updates);
@@ -451,6 +747,7 @@ void AdmissionController::UpdatePoolStats(
     }
     BOOST_FOREACH(PoolStatsMap::value_type& entry, local_pool_stats_) {
       UpdateClusterAggregates(entry.first);
+      RefillFastPassTokens(entry.first);
     }
   }
   dequeue_cv_.notify_one(); // Dequeue and admit queries on the dequeue thread
@@ -600,6 +897,7 @@ void AdmissionController::DequeueLoop() {
     BOOST_FOREACH(PoolStatsMap::value_type& entry, local_pool_stats_) {
       const string& pool_name = entry.first;
       TPoolStats* local_stats = &entry.second;
+      FlushFastPassAdmissions(pool_name);
 
       PoolConfigMap::iterator it = pool_config_cache_.find(pool_name);
       if (it == pool_config_cache_.end()) continue; // No local requests in this pool
@@ -649,7 +947,7 @@ void AdmissionController::DequeueLoop() {
 
       PoolMetrics* pool_metrics = GetPoolMetrics(pool_name);
       while (max_to_dequeue > 0 && !queue.empty()) {
-        QueueNode* queue_node = queue.head();
+        QueueNode* queue_node = PickQueueCandidate(pool_name, &queue);
         DCHECK(queue_node != NULL);
         DCHECK(!queue_node->is_admitted.IsSet());
         const QuerySchedule& schedule = queue_node->schedule;
@@ -660,11 +958,12 @@ void AdmissionController::DequeueLoop() {
                    << " reason: " << admitStatus.GetDetail();
           break;
         }
-        queue.Dequeue();
+        queue.Remove(queue_node);
         --local_stats->num_queued;
         --total_stats->num_queued;
         ++local_stats->num_running;
         ++total_stats->num_running;
+        if (IsLargeQuery(schedule)) ++local_large_queries_[pool_name];
         int64_t mem_estimate = schedule.GetClusterMemoryEstimate();
         local_stats->mem_estimate += mem_estimate;
         total_stats->mem_estimate += mem_estimate;
@@ -678,6 +977,7 @@ void AdmissionController::DequeueLoop() {
         --max_to_dequeue;
       }
       pools_for_updates_.insert(pool_name);
+      RefillFastPassTokens(pool_name);
     }
   }
 }
@@ -20,10 +20,12 @@
 #include <string>
 #include <list>
 
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include "common/atomic.h"
 #include "common/status.h"
 #include "scheduling/request-pool-service.h"
 #include "statestore/statestore-subscriber.h"
@@ -78,6 +80,24 @@ class ExecEnv;
 // this is not completely unavoidable unless we can produce better estimates.
 // TODO: We can reduce the effect of very high estimates by using a weighted
 //       combination of the estimate and the actual consumption as a function of time.
+//
+// Queries with a small memory estimate (below
+// FLAGS_admission_fast_pass_mem_threshold) may be admitted on a 'fast pass': each
+// pool publishes a token budget derived from the synced cluster aggregates, and a
+// small query takes a token with a single atomic operation instead of acquiring
+// admission_ctrl_lock_. This keeps high rates of cheap queries from contending with
+// heavyweight admission decisions. Admissions taken on the fast pass are folded back
+// into the pool statistics the next time the lock is taken for that pool.
+//
+// With --admission_use_mem_estimate_feedback the controller also keeps a feedback
+// store of the peak per-host memory consumption of completed queries, keyed by a
+// fingerprint of (pool, statement text). When the same statement is submitted again
+// and enough executions have been recorded, the planner's memory estimate is replaced
+// by the largest observed peak scaled by a configurable headroom factor, if that is
+// lower. This reclaims the capacity that chronically pessimistic estimates (e.g. for
+// UDF-heavy statements) would otherwise reserve. Explicit user-provided limits (the
+// MEM_LIMIT and RM query options) always take precedence, and failed or cancelled
+// executions are not recorded since their peak is not representative.
 class AdmissionController {
  public:
   AdmissionController(RequestPoolService* request_pool_service, MetricGroup* metrics,
@@ -107,7 +127,8 @@ class AdmissionController {
   // Structure stored in a QueryQueue representing a request. This struct lives only
   // during the call to AdmitQuery().
   struct QueueNode : public InternalQueue<QueueNode>::Node {
-    QueueNode(const QuerySchedule& query_schedule) : schedule(query_schedule) { }
+    QueueNode(const QuerySchedule& query_schedule)
+      : queue_time_ms(0), schedule(query_schedule) { }
 
     // Set when the request is admitted or rejected by the dequeuing thread. Used
     // by AdmitQuery() to wait for admission or until the timeout is reached.
@@ -116,6 +137,11 @@ class AdmissionController {
     // thread holds it to Set().
     Promise<bool> is_admitted;
 
+    // Time (from MonotonicMillis()) at which the request was added to the queue.
+    // Used to age the effective memory estimate when dequeuing smallest-first
+    // (see --admission_queue_aging_time_ms).
+    int64_t queue_time_ms;
+
     // The query schedule of the queued request. The schedule lives longer than the
     // duration of the the QueueNode, which only lives the duration of the call to
     // AdmitQuery.
@@ -167,6 +193,25 @@ class AdmissionController {
     IntGauge* local_mem_estimate;
   };
 
+  // Per-pool state for the admission fast pass. A small query takes a token from
+  // 'tokens' with a single compare-and-swap and records its admission in
+  // 'admitted_num' and 'admitted_mem'; the pending admissions are applied to
+  // local_pool_stats_ and cluster_pool_stats_ by FlushFastPassAdmissions() the next
+  // time admission_ctrl_lock_ is taken for the pool. The budget in 'tokens' is
+  // recomputed from the cluster aggregates by RefillFastPassTokens().
+  struct FastPassTokens {
+    FastPassTokens() : tokens(0), admitted_num(0), admitted_mem(0) { }
+
+    // The number of queries that may currently be admitted without taking
+    // admission_ctrl_lock_.
+    AtomicInt<int64_t> tokens;
+
+    // The number of admissions taken on the fast pass that have not yet been applied
+    // to the pool stats, and the sum of their cluster memory estimates.
+    AtomicInt<int64_t> admitted_num;
+    AtomicInt<int64_t> admitted_mem;
+  };
+
   // Used for user-to-pool resolution and looking up pool configurations. Not owned by
   // the AdmissionController.
   RequestPoolService* request_pool_service_;
@@ -232,12 +277,52 @@ class AdmissionController {
   typedef boost::unordered_map<std::string, PoolMetrics> PoolMetricsMap;
   PoolMetricsMap pool_metrics_map_;
 
+  // Number of currently running 'large' queries (see
+  // --admission_large_query_mem_threshold) that were admitted by this impalad, per
+  // pool. Used to shape the concurrency of the large size class
+  // (--admission_max_large_queries). Protected by admission_ctrl_lock_.
+  typedef boost::unordered_map<std::string, int64_t> PoolLargeQueryMap;
+  PoolLargeQueryMap local_large_queries_;
+
+  // Observed peak per-host memory consumption of past executions of one statement.
+  struct MemFeedbackEntry {
+    MemFeedbackEntry() : num_completed(0), max_peak_mem(0) { }
+
+    // Number of successful executions that have been recorded.
+    int64_t num_completed;
+
+    // The largest per-host peak memory consumption (in bytes) seen across those
+    // executions.
+    int64_t max_peak_mem;
+  };
+
+  // The feedback store used to refine admission memory estimates, keyed by the
+  // fingerprint of (pool name, statement text) computed by MemFeedbackFingerprint().
+  // Only populated when --admission_use_mem_estimate_feedback is true; bounded by
+  // --admission_mem_estimate_feedback_max_entries. Protected by admission_ctrl_lock_.
+  typedef boost::unordered_map<uint64_t, MemFeedbackEntry> MemFeedbackMap;
+  MemFeedbackMap mem_feedback_map_;
+
   // Map of pool names to the most recent pool configs returned by request_pool_service_.
   // Stored so that the dequeue thread does not need to access the configs via the
   // request pool service again (which involves a JNI call and error checking).
   typedef boost::unordered_map<std::string, TPoolConfigResult> PoolConfigMap;
   PoolConfigMap pool_config_cache_;
 
+  // Protects fast_pass_map_ itself. The FastPassTokens instances are updated with
+  // atomic operations and are not protected by any lock. This lock is held only for
+  // map lookups and insertions, never while making admission decisions, so it does
+  // not see the contention that admission_ctrl_lock_ does. Must be taken after
+  // admission_ctrl_lock_ if both are held.
+  boost::mutex fast_pass_lock_;
+
+  // Pool names -> fast pass token buckets. Entries are created by
+  // RefillFastPassTokens() and never removed; the shared_ptr allows fast-pass
+  // callers to drop fast_pass_lock_ before operating on the bucket.
+  typedef boost::unordered_map<std::string, boost::shared_ptr<FastPassTokens> >
+      FastPassMap;
+  FastPassMap fast_pass_map_;
+
   // Notifies the dequeuing thread that pool stats have changed and it may be
   // possible to dequeue and admit queries.
   boost::condition_variable dequeue_cv_;
@@ -276,6 +361,19 @@ class AdmissionController {
   // Dequeues and admits queued queries when notified by dequeue_cv_.
   void DequeueLoop();
 
+  // Returns true if the query belongs to the 'large' size class, i.e.
+  // --admission_large_query_mem_threshold is positive and the query's cluster
+  // memory estimate is at or above it.
+  static bool IsLargeQuery(const QuerySchedule& schedule);
+
+  // Returns the next queued request to attempt to admit from 'queue', or NULL if the
+  // queue is empty. This is the head in FIFO mode; with
+  // --admission_queue_aging_time_ms set it is the request with the smallest aged
+  // memory estimate. Large queries are skipped while their size class is at its
+  // concurrency limit, unless the queue contains nothing else. Must hold
+  // admission_ctrl_lock_.
+  QueueNode* PickQueueCandidate(const std::string& pool_name, RequestQueue* queue);
+
   // Returns OK if the request can be admitted, i.e. admitting would not go over the
   // limits for this pool. Otherwise, the error message specifies the reason the
   // request can not be admitted immediately.
@@ -287,6 +385,40 @@ class AdmissionController {
   Status RejectRequest(const std::string& pool, const int64_t max_requests,
       const int64_t mem_limit, const int64_t max_queued, const QuerySchedule& schedule);
 
+  // Attempts to admit the query on the fast pass. If the query qualifies (see
+  // FLAGS_admission_fast_pass_mem_threshold) and the pool has a token available,
+  // takes a token with a single atomic operation, records the admission in the
+  // pool's FastPassTokens and returns true. Returns false if the query must go
+  // through the regular admission path. Does not take admission_ctrl_lock_.
+  bool AdmitFastPass(QuerySchedule* schedule);
+
+  // Applies any admissions taken on the fast pass since the last call to
+  // local_pool_stats_ and cluster_pool_stats_ and updates the pool metrics.
+  // Must be called before reading or modifying the stats for the pool.
+  // Must hold admission_ctrl_lock_.
+  void FlushFastPassAdmissions(const std::string& pool_name);
+
+  // Recomputes the fast pass token budget for the pool from the current cluster
+  // aggregates and the cached pool config, creating the pool's FastPassTokens if
+  // necessary. Callers must flush pending fast pass admissions first. Must hold
+  // admission_ctrl_lock_.
+  void RefillFastPassTokens(const std::string& pool_name);
+
+  // Returns the mem_feedback_map_ key for the schedule's pool and statement text.
+  static uint64_t MemFeedbackFingerprint(const QuerySchedule& schedule);
+
+  // Replaces the schedule's planner memory estimate with one derived from the
+  // recorded peak consumption of past executions of the same statement, if at least
+  // --admission_mem_estimate_feedback_min_samples executions have been recorded and
+  // the derived estimate is lower. Called at the start of AdmitQuery(), before the
+  // estimate is consulted by any admission check. Takes admission_ctrl_lock_.
+  void RefineMemEstimate(QuerySchedule* schedule);
+
+  // Records the peak per-host memory consumption of a completed query in
+  // mem_feedback_map_. A no-op if the coordinator did not report a peak (e.g. the
+  // query failed or was cancelled). Must hold admission_ctrl_lock_.
+  void RecordMemFeedback(const QuerySchedule& schedule);
+
   // Gets the metrics for a pool. The metrics are initialized if they don't already
   // exist. Returns NULL if there is no metrics system available.  Must hold
   // admission_ctrl_lock_.
@@ -67,7 +67,9 @@ Status FragmentMgr::ExecPlanFragment(const TExecPlanFragmentParams& exec_params)
 
 void FragmentMgr::FragmentExecThread(FragmentExecState* exec_state) {
   ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS->Increment(1L);
+  ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT->Increment(1L);
   exec_state->Exec();
+  ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT->Increment(-1L);
   // we're done with this plan fragment
 
   // The last reference to the FragmentExecState is in the map. We don't
@@ -16,14 +16,18 @@
 
 #include <list>
 #include <string>
+#include <boost/bind.hpp>
 
 #include "common/logging.h"
 #include "rpc/jni-thrift-util.h"
 #include "util/jni-util.h"
 #include "util/logging-support.h"
+#include <gutil/strings/substitute.h>
 
 using namespace std;
+using namespace boost;
 using namespace impala;
+using namespace strings;
 
 DECLARE_string(sentry_config);
 DECLARE_int32(non_impala_java_vlog);
@@ -42,6 +46,15 @@ DEFINE_string(authorization_policy_file, "", "HDFS path to the authorization pol
 DEFINE_string(authorization_policy_provider_class,
     "org.apache.sentry.provider.common.HadoopGroupResourceAuthorizationProvider",
     "Advanced: The authorization policy provider class name.");
+DEFINE_int32(frontend_jni_deadline_ms, 0, "(Advanced) Deadline in milliseconds for "
+    "Java frontend metadata and planning calls. When > 0, these calls run on a "
+    "dedicated thread pool and fail with an error if they do not complete within the "
+    "deadline (e.g. because the JVM is stuck in a full garbage collection) instead of "
+    "blocking the calling thread indefinitely. 0 disables the deadline and runs the "
+    "calls on the caller's thread.");
+DEFINE_int32(frontend_jni_threads, 8, "(Advanced) Number of threads used for Java "
+    "frontend metadata and planning calls when --frontend_jni_deadline_ms is > 0.");
+
 DEFINE_string(authorized_proxy_user_config, "",
     "Specifies the set of authorized proxy users (users who can delegate to other "
     "users during authorization) and whom they are allowed to delegate. "
@@ -99,6 +112,44 @@ Frontend::Frontend() {
       FlagToTLogLevel(FLAGS_non_impala_java_vlog));
   EXIT_IF_EXC(jni_env);
   EXIT_IF_ERROR(JniUtil::LocalToGlobalRef(jni_env, fe, &fe_));
+
+  if (FLAGS_frontend_jni_deadline_ms > 0) {
+    // The queue is deliberately deep: when the JVM is paused all pool threads are
+    // stuck in Java, and queued calls should wait for their own deadlines rather than
+    // block in Offer().
+    jni_call_pool_.reset(new ThreadPool<shared_ptr<JniCall> >("frontend", "jni-call",
+        FLAGS_frontend_jni_threads, 1024, &Frontend::RunJniCall));
+  }
+}
+
+void Frontend::RunJniCall(int thread_id, const shared_ptr<JniCall>& call) {
+  call->done.Set(call->fn());
+}
+
+template <class T, class R>
+Status Frontend::CallJniMethodWithDeadline(
+    const jmethodID& method, const T& arg, R* response) {
+  if (jni_call_pool_.get() == NULL) {
+    return JniUtil::CallJniMethod(fe_, method, arg, response);
+  }
+  shared_ptr<TypedJniCall<R> > call(new TypedJniCall<R>());
+  // 'arg' is copied into the bound function so the worker never references caller
+  // memory.
+  call->fn = bind(&Frontend::InvokeJniMethod<T, R>, this, method, arg, &call->response);
+  if (!jni_call_pool_->Offer(shared_ptr<JniCall>(call))) {
+    return Status("Frontend JNI call pool has been shut down");
+  }
+  bool timed_out = false;
+  const Status& status = call->done.Get(FLAGS_frontend_jni_deadline_ms, &timed_out);
+  if (timed_out) {
+    return Status(Substitute("Java frontend call did not complete within $0ms. The JVM "
+        "may be paused (e.g. in a full garbage collection); the call cannot be "
+        "interrupted and its thread remains occupied until it returns.",
+        FLAGS_frontend_jni_deadline_ms));
+  }
+  RETURN_IF_ERROR(status);
+  *response = call->response;
+  return Status::OK;
 }
 
 Status Frontend::UpdateCatalogCache(const TUpdateCatalogCacheRequest& req,
@@ -108,11 +159,11 @@ Status Frontend::UpdateCatalogCache(const TUpdateCatalogCacheRequest& req,
 
 Status Frontend::DescribeTable(const TDescribeTableParams& params,
     TDescribeTableResult* response) {
-  return JniUtil::CallJniMethod(fe_, describe_table_id_, params, response);
+  return CallJniMethodWithDeadline(describe_table_id_, params, response);
 }
 
 Status Frontend::ShowCreateTable(const TTableName& table_name, string* response) {
-  return JniUtil::CallJniMethod(fe_, show_create_table_id_, table_name, response);
+  return CallJniMethodWithDeadline(show_create_table_id_, table_name, response);
 }
 
 Status Frontend::GetTableNames(const string& db, const string* pattern,
@@ -121,7 +172,7 @@ Status Frontend::GetTableNames(const string& db, const string* pattern,
   params.__set_db(db);
   if (pattern != NULL) params.__set_pattern(*pattern);
   if (session != NULL) params.__set_session(*session);
-  return JniUtil::CallJniMethod(fe_, get_table_names_id_, params, table_names);
+  return CallJniMethodWithDeadline(get_table_names_id_, params, table_names);
 }
 
 Status Frontend::GetDbNames(const string* pattern, const TSessionState* session,
@@ -129,24 +180,24 @@ Status Frontend::GetDbNames(const string* pattern, const TSessionState* session,
   TGetDbsParams params;
   if (pattern != NULL) params.__set_pattern(*pattern);
   if (session != NULL) params.__set_session(*session);
-  return JniUtil::CallJniMethod(fe_, get_db_names_id_, params, db_names);
+  return CallJniMethodWithDeadline(get_db_names_id_, params, db_names);
 }
 
 Status Frontend::GetDataSrcMetadata(const string* pattern,
     TGetDataSrcsResult* result) {
   TGetDataSrcsParams params;
   if (pattern != NULL) params.__set_pattern(*pattern);
-  return JniUtil::CallJniMethod(fe_, get_data_src_metadata_id_, params, result);
+  return CallJniMethodWithDeadline(get_data_src_metadata_id_, params, result);
 }
 
 Status Frontend::GetStats(const TShowStatsParams& params,
     TResultSet* result) {
-  return JniUtil::CallJniMethod(fe_, get_stats_id_, params, result);
+  return CallJniMethodWithDeadline(get_stats_id_, params, result);
 }
 
 Status Frontend::GetRolePrivileges(const TShowGrantRoleParams& params,
     TResultSet* result) {
-  return JniUtil::CallJniMethod(fe_, get_role_privileges_id_, params, result);
+  return CallJniMethodWithDeadline(get_role_privileges_id_, params, result);
 }
 
 Status Frontend::GetFunctions(TFunctionCategory::type fn_category, const string& db,
@@ -157,26 +208,26 @@ Status Frontend::GetFunctions(TFunctionCategory::type fn_category, const string&
   params.__set_db(db);
   if (pattern != NULL) params.__set_pattern(*pattern);
   if (session != NULL) params.__set_session(*session);
-  return JniUtil::CallJniMethod(fe_, get_functions_id_, params, functions);
+  return CallJniMethodWithDeadline(get_functions_id_, params, functions);
 }
 
 Status Frontend::ShowRoles(const TShowRolesParams& params, TShowRolesResult* result) {
-  return JniUtil::CallJniMethod(fe_, show_roles_id_, params, result);
+  return CallJniMethodWithDeadline(show_roles_id_, params, result);
 }
 
 Status Frontend::GetCatalogObject(const TCatalogObject& req,
     TCatalogObject* resp) {
-  return JniUtil::CallJniMethod(fe_, get_catalog_object_id_, req, resp);
+  return CallJniMethodWithDeadline(get_catalog_object_id_, req, resp);
 }
 
 Status Frontend::GetExecRequest(
     const TQueryCtx& query_ctx, TExecRequest* result) {
-  return JniUtil::CallJniMethod(fe_, create_exec_request_id_, query_ctx, result);
+  return CallJniMethodWithDeadline(create_exec_request_id_, query_ctx, result);
 }
 
 Status Frontend::GetExplainPlan(
     const TQueryCtx& query_ctx, string* explain_string) {
-  return JniUtil::CallJniMethod(fe_, get_explain_plan_id_, query_ctx, explain_string);
+  return CallJniMethodWithDeadline(get_explain_plan_id_, query_ctx, explain_string);
 }
 
 Status Frontend::ValidateSettings() {
@@ -204,7 +255,7 @@ Status Frontend::ValidateSettings() {
 
 Status Frontend::ExecHiveServer2MetadataOp(const TMetadataOpRequest& request,
     TResultSet* result) {
-  return JniUtil::CallJniMethod(fe_, exec_hs2_metadata_op_id_, request, result);
+  return CallJniMethodWithDeadline(exec_hs2_metadata_op_id_, request, result);
 }
 
 Status Frontend::GetAllHadoopConfigs(TGetAllHadoopConfigsResponse* result) {
@@ -234,5 +285,5 @@ Status Frontend::SetCatalogInitialized() {
 }
 
 Status Frontend::GetTableFiles(const TShowFilesParams& params, TResultSet* result) {
-  return JniUtil::CallJniMethod(fe_, get_table_files_id_, params, result);
+  return CallJniMethodWithDeadline(get_table_files_id_, params, result);
 }
@@ -17,11 +17,18 @@
 
 #include <jni.h>
 
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include "gen-cpp/ImpalaService.h"
 #include "gen-cpp/ImpalaHiveServer2Service.h"
 #include "gen-cpp/ImpalaInternalService.h"
 #include "gen-cpp/Frontend_types.h"
 #include "common/status.h"
+#include "util/jni-util.h"
+#include "util/promise.h"
+#include "util/thread-pool.h"
 
 namespace impala {
 
@@ -153,6 +160,46 @@ class Frontend {
   Status GetTableFiles(const TShowFilesParams& params, TResultSet* result);
 
  private:
+  // A single JNI invocation handed to jni_call_pool_. The bound function writes only
+  // into memory owned by this struct (see TypedJniCall), so a caller that gives up
+  // waiting at its deadline can return without the worker thread later touching freed
+  // memory. 'done' carries the call's status back to the caller.
+  struct JniCall {
+    boost::function<Status ()> fn;
+    Promise<Status> done;
+    virtual ~JniCall() { }
+  };
+
+  // JniCall owning a response object of the call's result type. The caller copies the
+  // response out only after 'done' is set with an OK status.
+  template <class R>
+  struct TypedJniCall : public JniCall {
+    R response;
+  };
+
+  // Executes 'call->fn' and publishes its status. Work function of jni_call_pool_.
+  static void RunJniCall(int thread_id, const boost::shared_ptr<JniCall>& call);
+
+  // Calls JniUtil::CallJniMethod(fe_, method, arg, response). Exists so that
+  // CallJniMethodWithDeadline() can bind one name and still get the right
+  // CallJniMethod() overload for string responses.
+  template <class T, class R>
+  Status InvokeJniMethod(jmethodID method, const T& arg, R* response) {
+    return JniUtil::CallJniMethod(fe_, method, arg, response);
+  }
+
+  // Runs a metadata or planning JNI method either directly on the caller's thread
+  // (when no deadline is configured) or on jni_call_pool_ with a deadline of
+  // --frontend_jni_deadline_ms. On timeout an error is returned; JNI provides no way
+  // to interrupt a call in progress, so the worker thread remains occupied until the
+  // Java call completes and its result is discarded.
+  template <class T, class R>
+  Status CallJniMethodWithDeadline(const jmethodID& method, const T& arg, R* response);
+
+  // Dedicated pool for metadata and planning JNI calls, isolating caller threads from
+  // JVM pauses. NULL when --frontend_jni_deadline_ms is 0.
+  boost::scoped_ptr<ThreadPool<boost::shared_ptr<JniCall> > > jni_call_pool_;
+
   // Descriptor of Java Frontend class itself, used to create a new instance.
   jclass fe_class_;
 
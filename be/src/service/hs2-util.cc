@@ -15,7 +15,9 @@
 #include "service/hs2-util.h"
 
 #include "common/logging.h"
+#include "exprs/expr-context.h"
 #include "runtime/raw-value.h"
+#include "runtime/row-batch.h"
 #include "runtime/types.h"
 
 #include <gutil/strings/substitute.h>
@@ -215,6 +217,81 @@ void impala::ExprValueToHS2TColumn(const void* value, const TColumnType& type,
   SetNullBit(row_idx, (value == NULL), nulls);
 }
 
+// Appends the values of 'ctx' for rows [start_idx, start_idx + num_rows) of 'batch' to
+// 'column', with NATIVE_T the native type of the expr result. Used for the fixed-width
+// types so the type dispatch in ExprValuesToHS2TColumn() stays out of the loop.
+template <typename HS2_COL, typename NATIVE_T>
+inline void AppendFixedWidthVals(ExprContext* ctx, RowBatch* batch, int start_idx,
+    int num_rows, uint32_t output_row_idx, HS2_COL* column) {
+  column->values.reserve(column->values.size() + num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    const void* value = ctx->GetValue(batch->GetRow(start_idx + i));
+    column->values.push_back(
+        value == NULL ? NATIVE_T() : *reinterpret_cast<const NATIVE_T*>(value));
+    SetNullBit(output_row_idx + i, value == NULL, &column->nulls);
+  }
+}
+
+// For V6 and above
+void impala::ExprValuesToHS2TColumn(ExprContext* ctx, const TColumnType& type,
+    RowBatch* batch, int start_idx, int num_rows, uint32_t output_row_idx,
+    thrift::TColumn* column) {
+  switch (type.types[0].scalar_type.type) {
+    case TPrimitiveType::NULL_TYPE:
+    case TPrimitiveType::BOOLEAN:
+      AppendFixedWidthVals<thrift::TBoolColumn, bool>(
+          ctx, batch, start_idx, num_rows, output_row_idx, &column->boolVal);
+      return;
+    case TPrimitiveType::TINYINT:
+      AppendFixedWidthVals<thrift::TByteColumn, int8_t>(
+          ctx, batch, start_idx, num_rows, output_row_idx, &column->byteVal);
+      return;
+    case TPrimitiveType::SMALLINT:
+      AppendFixedWidthVals<thrift::TI16Column, int16_t>(
+          ctx, batch, start_idx, num_rows, output_row_idx, &column->i16Val);
+      return;
+    case TPrimitiveType::INT:
+      AppendFixedWidthVals<thrift::TI32Column, int32_t>(
+          ctx, batch, start_idx, num_rows, output_row_idx, &column->i32Val);
+      return;
+    case TPrimitiveType::BIGINT:
+      AppendFixedWidthVals<thrift::TI64Column, int64_t>(
+          ctx, batch, start_idx, num_rows, output_row_idx, &column->i64Val);
+      return;
+    case TPrimitiveType::FLOAT:
+      AppendFixedWidthVals<thrift::TDoubleColumn, float>(
+          ctx, batch, start_idx, num_rows, output_row_idx, &column->doubleVal);
+      return;
+    case TPrimitiveType::DOUBLE:
+      AppendFixedWidthVals<thrift::TDoubleColumn, double>(
+          ctx, batch, start_idx, num_rows, output_row_idx, &column->doubleVal);
+      return;
+    case TPrimitiveType::STRING:
+    case TPrimitiveType::VARCHAR: {
+      thrift::TStringColumn* str_col = &column->stringVal;
+      str_col->values.reserve(str_col->values.size() + num_rows);
+      for (int i = 0; i < num_rows; ++i) {
+        const void* value = ctx->GetValue(batch->GetRow(start_idx + i));
+        str_col->values.push_back(string());
+        if (value != NULL) {
+          const StringValue* str_val = reinterpret_cast<const StringValue*>(value);
+          str_col->values.back().assign(static_cast<char*>(str_val->ptr), str_val->len);
+        }
+        SetNullBit(output_row_idx + i, value == NULL, &str_col->nulls);
+      }
+      return;
+    }
+    default:
+      // The remaining types (TIMESTAMP, CHAR, DECIMAL) require per-value string
+      // rendering; keep the per-value conversion for them.
+      for (int i = 0; i < num_rows; ++i) {
+        ExprValueToHS2TColumn(ctx->GetValue(batch->GetRow(start_idx + i)), type,
+            output_row_idx + i, column);
+      }
+      return;
+  }
+}
+
 // For V1 -> V5
 void impala::TColumnValueToHS2TColumnValue(const TColumnValue& col_val,
     const TColumnType& type, thrift::TColumnValue* hs2_col_val) {
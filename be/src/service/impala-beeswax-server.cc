@@ -359,9 +359,10 @@ QueryState::type ImpalaServer::get_state(const QueryHandle& handle) {
   QueryHandleToTUniqueId(handle, &query_id);
   VLOG_ROW << "get_state(): query_id=" << PrintId(query_id);
 
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-  if (entry != query_exec_state_map_.end()) {
+  QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+  lock_guard<mutex> l(shard->lock);
+  QueryExecStateMap::iterator entry = shard->map.find(query_id);
+  if (entry != shard->map.end()) {
     return entry->second->query_state();
   } else {
     VLOG_QUERY << "ImpalaServer::get_state invalid handle";
@@ -156,6 +156,19 @@ class ImpalaServer::HS2ColumnarResultSet : public ImpalaServer::QueryResultSet {
     return Status::OK;
   }
 
+  // Add a run of rows column by column, hoisting the per-value type dispatch out of the
+  // inner loops (see ExprValuesToHS2TColumn()).
+  virtual bool AddRowBatch(const vector<ExprContext*>& ctxs, RowBatch* batch,
+      int start_idx, int num_rows) {
+    DCHECK_EQ(ctxs.size(), metadata_.columns.size());
+    for (int i = 0; i < ctxs.size(); ++i) {
+      ExprValuesToHS2TColumn(ctxs[i], metadata_.columns[i].columnType, batch, start_idx,
+          num_rows, num_rows_, &(result_set_->columns[i]));
+    }
+    num_rows_ += num_rows;
+    return true;
+  }
+
   // Copy all columns starting at 'start_idx' and proceeding for a maximum of 'num_rows'
   // from 'other' into this result set
   virtual int AddRows(const QueryResultSet* other, int start_idx, int num_rows) {
@@ -618,10 +631,11 @@ void ImpalaServer::OpenSession(TOpenSessionResp& return_val,
   }
   TQueryOptionsToMap(state->default_query_options, &return_val.configuration);
 
-  // Put the session state in session_state_map_
+  // Put the session state in the session state map
   {
-    lock_guard<mutex> l(session_state_map_lock_);
-    session_state_map_.insert(make_pair(session_id, state));
+    SessionStateMapShard* shard = GetSessionStateMapShard(session_id);
+    lock_guard<mutex> l(shard->lock);
+    shard->map.insert(make_pair(session_id, state));
   }
 
   {
@@ -898,9 +912,10 @@ void ImpalaServer::GetOperationStatus(TGetOperationStatusResp& return_val,
       request.operationHandle.operationId, &query_id, &secret), SQLSTATE_GENERAL_ERROR);
   VLOG_ROW << "GetOperationStatus(): query_id=" << PrintId(query_id);
 
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-  if (entry != query_exec_state_map_.end()) {
+  QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+  lock_guard<mutex> l(shard->lock);
+  QueryExecStateMap::iterator entry = shard->map.find(query_id);
+  if (entry != shard->map.end()) {
     QueryState::type query_state = entry->second->query_state();
     TOperationState::type operation_state = QueryStateToTOperationState(query_state);
     return_val.__set_operationState(operation_state);
@@ -965,7 +980,7 @@ void ImpalaServer::GetResultSetMetadata(TGetResultSetMetadataResp& return_val,
       request.operationHandle.operationId, &query_id, &secret), SQLSTATE_GENERAL_ERROR);
   VLOG_QUERY << "GetResultSetMetadata(): query_id=" << PrintId(query_id);
 
-  // Look up the session ID (which takes session_state_map_lock_) before taking the query
+  // Look up the session ID (which takes a state map shard lock) before taking the query
   // exec state lock.
   TUniqueId session_id;
   if (!GetSessionIdForQuery(query_id, &session_id)) {
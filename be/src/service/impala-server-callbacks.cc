@@ -14,12 +14,15 @@
 
 #include "service/impala-server.h"
 
+#include <iomanip>
 #include <sstream>
 #include <boost/thread/mutex.hpp>
+#include <google/malloc_extension.h>
 #include <gutil/strings/substitute.h>
 
 #include "catalog/catalog-util.h"
 #include "service/query-exec-state.h"
+#include "util/cpu-sampler.h"
 #include "util/webserver.h"
 
 #include "gen-cpp/beeswax_types.h"
@@ -86,6 +89,16 @@ void ImpalaServer::RegisterWebserverCallbacks(Webserver* webserver) {
   webserver->RegisterUrlCallback("/inflight_query_ids", "raw_text.tmpl",
       inflight_query_ids_callback, false);
 
+  Webserver::UrlCallback query_cpu_callback =
+      bind<void>(mem_fn(&ImpalaServer::QueryCpuSamplesUrlCallback), this, _1, _2);
+  webserver->RegisterUrlCallback("/query_cpu", "raw_text.tmpl",
+      query_cpu_callback, false);
+
+  Webserver::UrlCallback query_allocs_callback =
+      bind<void>(mem_fn(&ImpalaServer::QueryAllocsUrlCallback), this, _1, _2);
+  webserver->RegisterUrlCallback("/query_allocs", "raw_text.tmpl",
+      query_allocs_callback, false);
+
   Webserver::UrlCallback query_summary_callback =
       bind<void>(mem_fn(&ImpalaServer::QuerySummaryCallback), this, false, true, _1, _2);
   webserver->RegisterUrlCallback("/query_summary", "query_summary.tmpl",
@@ -200,14 +213,119 @@ void ImpalaServer::QueryProfileEncodedUrlCallback(const Webserver::ArgumentMap&
 
 void ImpalaServer::InflightQueryIdsUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
-  lock_guard<mutex> l(query_exec_state_map_lock_);
+  // Collect the ids under the shard locks and format them afterwards, to keep the
+  // locks' hold times off the query path to a minimum.
+  vector<TUniqueId> query_ids;
+  for (int i = 0; i < NUM_STATE_MAP_SHARDS; ++i) {
+    QueryExecStateMapShard* shard = &query_exec_state_map_shards_[i];
+    lock_guard<mutex> l(shard->lock);
+    BOOST_FOREACH(const QueryExecStateMap::value_type& exec_state, shard->map) {
+      query_ids.push_back(exec_state.second->query_id());
+    }
+  }
+
+  stringstream ss;
+  BOOST_FOREACH(const TUniqueId& query_id, query_ids) {
+    ss << query_id << "\n";
+  }
+  document->AddMember(Webserver::ENABLE_RAW_JSON_KEY, true, document->GetAllocator());
+  Value query_ids_json(ss.str().c_str(), document->GetAllocator());
+  document->AddMember("contents", query_ids_json, document->GetAllocator());
+}
+
+void ImpalaServer::QueryCpuSamplesUrlCallback(const Webserver::ArgumentMap& args,
+    Document* document) {
+  stringstream ss;
+  TUniqueId unique_id;
+  Status status = ParseQueryId(args, &unique_id);
+  if (!status.ok()) {
+    ss << status.GetDetail();
+  } else {
+    CpuSampler* sampler = CpuSampler::GetInstance();
+    if (!sampler->is_running()) {
+      ss << "CPU sampler is not running. Start impalad with "
+         << "--enable_query_cpu_sampler to collect per-query CPU samples.";
+    } else {
+      map<int, int64_t> node_samples;
+      int64_t query_samples;
+      sampler->GetQuerySamples(unique_id, &node_samples, &query_samples);
+      int64_t total_samples = sampler->total_samples();
+      ss << "CPU samples for query " << PrintId(unique_id) << "\n"
+         << "Process samples since start: " << total_samples
+         << " (dropped: " << sampler->dropped_samples() << ")\n"
+         << "Query samples: " << query_samples;
+      if (total_samples > 0) {
+        ss << " (" << setprecision(4) << (100.0 * query_samples / total_samples)
+           << "% of process)";
+      }
+      ss << "\n";
+      for (map<int, int64_t>::const_iterator it = node_samples.begin();
+          it != node_samples.end(); ++it) {
+        if (it->first == CpuSampler::NO_NODE) {
+          ss << "  (not attributed to a plan node): ";
+        } else {
+          ss << "  plan node " << it->first << ": ";
+        }
+        ss << it->second;
+        if (query_samples > 0) {
+          ss << " (" << setprecision(4) << (100.0 * it->second / query_samples)
+             << "% of query)";
+        }
+        ss << "\n";
+      }
+    }
+  }
+
+  document->AddMember(Webserver::ENABLE_RAW_JSON_KEY, true, document->GetAllocator());
+  Value samples(ss.str().c_str(), document->GetAllocator());
+  document->AddMember("contents", samples, document->GetAllocator());
+}
+
+void ImpalaServer::QueryAllocsUrlCallback(const Webserver::ArgumentMap& args,
+    Document* document) {
   stringstream ss;
-  BOOST_FOREACH(const QueryExecStateMap::value_type& exec_state, query_exec_state_map_) {
-    ss << exec_state.second->query_id() << "\n";
+  TUniqueId unique_id;
+  Status status = ParseQueryId(args, &unique_id);
+  if (!status.ok()) {
+    ss << status.GetDetail();
+  } else {
+    ss << "Allocation breakdown for query " << PrintId(unique_id) << "\n\n";
+#ifndef ALLOC_PROFILING
+    ss << "Per-operator allocation counters require an ALLOC_PROFILING build "
+       << "(cmake -DCMAKE_BUILD_TYPE=ALLOC_PROFILING).\n";
+#else
+    // The profile already carries the per-operator Allocation* counters; strip it down
+    // to the tree structure plus those counters so the hot operators stand out.
+    stringstream profile_ss;
+    status = GetRuntimeProfileStr(unique_id, false, &profile_ss);
+    if (!status.ok()) {
+      ss << "Could not obtain runtime profile: " << status.GetDetail() << "\n";
+    } else {
+      string line;
+      while (getline(profile_ss, line)) {
+        size_t pos = line.find_first_not_of(' ');
+        bool is_counter = pos != string::npos && line.compare(pos, 2, "- ") == 0;
+        if (!is_counter || line.find("Allocation", pos) != string::npos) {
+          ss << line << "\n";
+        }
+      }
+    }
+#endif
+    // The growth stacks are process-wide (tcmalloc cannot scope them to a query), so
+    // they are most useful when the query of interest is the dominant load.
+    ss << "\nHeap growth stacks (process-wide, pprof format):\n";
+#ifdef ADDRESS_SANITIZER
+    ss << "Growth profiling is not available with address sanitizer builds.\n";
+#else
+    string heap_growth_stack;
+    MallocExtension::instance()->GetHeapGrowthStacks(&heap_growth_stack);
+    ss << heap_growth_stack;
+#endif
   }
+
   document->AddMember(Webserver::ENABLE_RAW_JSON_KEY, true, document->GetAllocator());
-  Value query_ids(ss.str().c_str(), document->GetAllocator());
-  document->AddMember("contents", query_ids, document->GetAllocator());
+  Value allocs(ss.str().c_str(), document->GetAllocator());
+  document->AddMember("contents", allocs, document->GetAllocator());
 }
 
 void ImpalaServer::QueryStateToJson(const ImpalaServer::QueryStateRecord& record,
@@ -266,16 +384,25 @@ void ImpalaServer::QueryStateToJson(const ImpalaServer::QueryStateRecord& record
 
 void ImpalaServer::QueryStateUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
-  set<QueryStateRecord, QueryStateRecord> sorted_query_records;
-  {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    BOOST_FOREACH(
-        const QueryExecStateMap::value_type& exec_state, query_exec_state_map_) {
-      // TODO: Do this in the browser so that sorts on other keys are possible.
-      sorted_query_records.insert(QueryStateRecord(*exec_state.second));
+  // Take references to the in-flight queries under the shard locks, but build the
+  // (comparatively expensive) QueryStateRecord snapshots only after releasing them,
+  // so that rendering this page doesn't stall query registration and lookup on the
+  // query path.
+  vector<shared_ptr<QueryExecState> > exec_states;
+  for (int i = 0; i < NUM_STATE_MAP_SHARDS; ++i) {
+    QueryExecStateMapShard* shard = &query_exec_state_map_shards_[i];
+    lock_guard<mutex> l(shard->lock);
+    BOOST_FOREACH(const QueryExecStateMap::value_type& exec_state, shard->map) {
+      exec_states.push_back(exec_state.second);
     }
   }
 
+  set<QueryStateRecord, QueryStateRecord> sorted_query_records;
+  BOOST_FOREACH(const shared_ptr<QueryExecState>& exec_state, exec_states) {
+    // TODO: Do this in the browser so that sorts on other keys are possible.
+    sorted_query_records.insert(QueryStateRecord(*exec_state));
+  }
+
   Value in_flight_queries(kArrayType);
   BOOST_FOREACH(const QueryStateRecord& record, sorted_query_records) {
     Value record_json(kObjectType);
@@ -318,9 +445,18 @@ void ImpalaServer::QueryStateUrlCallback(const Webserver::ArgumentMap& args,
 
 void ImpalaServer::SessionsUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
-  lock_guard<mutex> l(session_state_map_lock_);
+  // Copy the session map entries under the shard locks and render them afterwards;
+  // session lookup on the query path contends on the same locks.
+  vector<SessionStateMap::value_type> session_entries;
+  for (int i = 0; i < NUM_STATE_MAP_SHARDS; ++i) {
+    SessionStateMapShard* shard = &session_state_map_shards_[i];
+    lock_guard<mutex> l(shard->lock);
+    session_entries.insert(session_entries.end(), shard->map.begin(), shard->map.end());
+  }
+
   Value sessions(kArrayType);
-  BOOST_FOREACH(const SessionStateMap::value_type& session, session_state_map_) {
+  int64_t num_sessions = session_entries.size();
+  BOOST_FOREACH(const SessionStateMap::value_type& session, session_entries) {
     shared_ptr<SessionState> state = session.second;
     Value session_json(kObjectType);
     Value type(PrintTSessionType(state->session_type).c_str(),
@@ -341,12 +477,14 @@ void ImpalaServer::SessionsUrlCallback(const Webserver::ArgumentMap& args,
 
     Value network_address(lexical_cast<string>(state->network_address).c_str(),
         document->GetAllocator());
-    session_json.AddMember("network_address", network_address, document->GetAllocator());
+    session_json.AddMember("network_address", network_address,
+        document->GetAllocator());
 
     Value default_db(state->database.c_str(), document->GetAllocator());
     session_json.AddMember("default_database", default_db, document->GetAllocator());
 
-    Value start_time(state->start_time.DebugString().c_str(), document->GetAllocator());
+    Value start_time(state->start_time.DebugString().c_str(),
+        document->GetAllocator());
     session_json.AddMember("start_time", start_time, document->GetAllocator());
 
     Value last_accessed(
@@ -361,7 +499,7 @@ void ImpalaServer::SessionsUrlCallback(const Webserver::ArgumentMap& args,
   }
 
   document->AddMember("sessions", sessions, document->GetAllocator());
-  document->AddMember("num_sessions", session_state_map_.size(), document->GetAllocator());
+  document->AddMember("num_sessions", num_sessions, document->GetAllocator());
 }
 
 void ImpalaServer::CatalogUrlCallback(const Webserver::ArgumentMap& args,
@@ -94,6 +94,12 @@ DEFINE_int32(hs2_port, 21050, "port on which HiveServer2 client requests are ser
 
 DEFINE_int32(fe_service_threads, 64,
     "number of threads available to serve client requests");
+DEFINE_bool(use_nonblocking_fe_servers, false, "(Experimental) If true, the Beeswax and "
+    "HiveServer2 services use nonblocking (epoll-based) thrift servers that keep idle "
+    "sessions on an IO loop instead of a dedicated thread each, with "
+    "--fe_service_threads worker threads processing active requests. All clients must "
+    "use framed transport; the standard ODBC/JDBC drivers and Hue do not, and SSL, "
+    "Kerberos and LDAP are not supported.");
 DEFINE_int32(be_service_threads, 64,
     "(Advanced) number of threads available to serve backend execution requests");
 DEFINE_string(default_query_options, "", "key=value pair of default query options for"
@@ -126,10 +132,46 @@ DEFINE_string(profile_log_dir, "", "The directory in which profile log files are
     " written. If blank, defaults to <log_file_dir>/profiles");
 DEFINE_int32(max_profile_log_file_size, 5000, "The maximum size (in queries) of the "
     "profile log file before a new one is created");
+DEFINE_bool(binary_profile_log, false, "(Advanced) If true, query profiles are archived "
+    "as gzip-compressed binary log files (written with a .gz suffix) instead of one "
+    "base64-encoded line per query. Binary logs are considerably smaller; use the "
+    "profile-log-reader utility to convert them to the text format.");
 
 DEFINE_int32(cancellation_thread_pool_size, 5,
     "(Advanced) Size of the thread-pool processing cancellations due to node failure");
 
+DEFINE_int32(query_wait_thread_pool_size, 8,
+    "(Advanced) Size of the thread-pool that finishes queries whose completion is "
+    "driven by fragment status reports (e.g. distributed INSERTs) instead of a "
+    "dedicated per-query wait thread");
+
+DEFINE_bool(async_catalog_update, false, "(Advanced) If true, catalog updates received "
+    "from the statestore are applied on a dedicated thread instead of the statestore "
+    "heartbeat thread, so that large metadata updates do not delay processing of other "
+    "topics (e.g. cluster membership) or heartbeat responses.");
+
+DEFINE_int32(max_query_retries, 0, "(Advanced) The maximum number of times a read-only "
+    "query is transparently re-executed after one of its executing backends is lost from "
+    "the cluster membership. Only queries that have not yet returned any rows to the "
+    "client are eligible. If 0, queries running on a failed backend are cancelled.");
+
+DEFINE_int64(query_result_cache_max_bytes, 0, "(Advanced) If positive, this coordinator "
+    "caches the materialized results of completed read-only queries and serves repeated "
+    "identical statements from the cache until the catalog version changes. This bounds "
+    "the total size of the cache, in bytes. 0 disables the cache.");
+DEFINE_int64(query_result_cache_max_result_bytes, 64 * 1024, "(Advanced) Maximum size, "
+    "in bytes, of a single query result that may be added to the query result cache. "
+    "Only used if --query_result_cache_max_bytes is positive.");
+
+DEFINE_int32(plan_cache_max_entries, 0, "(Advanced) If positive, this coordinator "
+    "caches the plans of read-only queries and reuses them for repeated identical "
+    "statements until the catalog version changes, skipping the frontend planning "
+    "round trip. This bounds the number of cached plans. 0 disables the cache.");
+
+DEFINE_bool(preconnect_to_backends, true, "(Advanced) If true, open backend connections "
+    "in the background as soon as cluster members are learned from the statestore, so "
+    "the first queries after a backend joins (or restarts) don't pay connection setup.");
+
 DEFINE_string(ssl_server_certificate, "", "The full path to the SSL certificate file used"
     " to authenticate Impala to clients. If set, both Beeswax and HiveServer2 ports will "
     "only accept SSL connections");
@@ -184,8 +226,10 @@ const int MAX_NM_MISSED_HEARTBEATS = 5;
 // Work item for ImpalaServer::cancellation_thread_pool_.
 class CancellationWork {
  public:
-  CancellationWork(const TUniqueId& query_id, const Status& cause, bool unregister)
-      : query_id_(query_id), cause_(cause), unregister_(unregister) {
+  CancellationWork(const TUniqueId& query_id, const Status& cause, bool unregister,
+      bool retriable)
+      : query_id_(query_id), cause_(cause), unregister_(unregister),
+        retriable_(retriable) {
   }
 
   CancellationWork() {
@@ -194,6 +238,7 @@ class CancellationWork {
   const TUniqueId& query_id() const { return query_id_; }
   const Status& cause() const { return cause_; }
   const bool unregister() const { return unregister_; }
+  const bool retriable() const { return retriable_; }
 
   bool operator<(const CancellationWork& other) const {
     return query_id_ < other.query_id_;
@@ -214,10 +259,16 @@ class CancellationWork {
   // does call CancelInternal eventually, but also ensures that the query is torn down and
   // archived.
   bool unregister_;
+
+  // If true, the query may be transparently re-executed instead of failing, i.e. the
+  // cancellation was caused by a failed backend rather than by the client or an
+  // expiration.
+  bool retriable_;
 };
 
 ImpalaServer::ImpalaServer(ExecEnv* exec_env)
-    : exec_env_(exec_env) {
+    : exec_env_(exec_env),
+      query_result_cache_bytes_(0) {
   // Initialize default config
   InitializeConfigVariables();
 
@@ -291,6 +342,12 @@ ImpalaServer::ImpalaServer(ExecEnv* exec_env)
   ImpaladMetrics::IMPALA_SERVER_START_TIME->set_value(
       TimestampValue::LocalTime().DebugString());
 
+  request_full_catalog_update_ = false;
+  if (FLAGS_async_catalog_update) {
+    catalog_update_thread_.reset(new Thread("impala-server", "catalog-update-worker",
+        bind<void>(&ImpalaServer::CatalogUpdateThread, this)));
+  }
+
   // Register the membership callback if required
   if (exec_env->subscriber() != NULL) {
     StatestoreSubscriber::UpdateCallback cb =
@@ -313,6 +370,22 @@ ImpalaServer::ImpalaServer(ExecEnv* exec_env)
       FLAGS_cancellation_thread_pool_size, MAX_CANCELLATION_QUEUE_SIZE,
       bind<void>(&ImpalaServer::CancelFromThreadPool, this, _1, _2)));
 
+  // Pool threads run only after a query's backends have completed, so the finalization
+  // work they perform (HDFS file moves, catalog updates) is bounded; the queue size is
+  // set so high that it should never fill.
+  query_wait_thread_pool_.reset(new ThreadPool<TUniqueId>(
+      "impala-server", "query-wait-worker",
+      FLAGS_query_wait_thread_pool_size, MAX_CANCELLATION_QUEUE_SIZE,
+      bind<void>(&ImpalaServer::WaitFromThreadPool, this, _1, _2)));
+
+  if (FLAGS_preconnect_to_backends) {
+    // A single thread paces the connection attempts so that a full membership update
+    // doesn't open connections to the whole cluster at once.
+    preconnect_thread_pool_.reset(new ThreadPool<TNetworkAddress>(
+        "impala-server", "preconnect-worker", 1, MAX_CANCELLATION_QUEUE_SIZE,
+        bind<void>(&ImpalaServer::PreconnectFromThreadPool, this, _1, _2)));
+  }
+
   if (FLAGS_idle_session_timeout > 0) {
     session_timeout_thread_.reset(new Thread("impala-server", "session-expirer",
             bind<void>(&ImpalaServer::ExpireSessions, this)));
@@ -461,9 +534,15 @@ Status ImpalaServer::InitProfileLogging() {
     ss << FLAGS_log_dir << "/profiles/";
     FLAGS_profile_log_dir = ss.str();
   }
-  profile_logger_.reset(new SimpleLogger(FLAGS_profile_log_dir,
-      PROFILE_LOG_FILE_PREFIX, FLAGS_max_profile_log_file_size));
-  RETURN_IF_ERROR(profile_logger_->Init());
+  if (FLAGS_binary_profile_log) {
+    binary_profile_logger_.reset(new GzipLogger(FLAGS_profile_log_dir,
+        PROFILE_LOG_FILE_PREFIX, FLAGS_max_profile_log_file_size));
+    RETURN_IF_ERROR(binary_profile_logger_->Init());
+  } else {
+    profile_logger_.reset(new SimpleLogger(FLAGS_profile_log_dir,
+        PROFILE_LOG_FILE_PREFIX, FLAGS_max_profile_log_file_size));
+    RETURN_IF_ERROR(profile_logger_->Init());
+  }
   profile_log_file_flush_thread_.reset(new Thread("impala-server", "log-flush-thread",
       &ImpalaServer::LogFileFlushThread, this));
 
@@ -475,9 +554,10 @@ Status ImpalaServer::GetRuntimeProfileStr(const TUniqueId& query_id,
   DCHECK(output != NULL);
   // Search for the query id in the active query map
   {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    QueryExecStateMap::const_iterator exec_state = query_exec_state_map_.find(query_id);
-    if (exec_state != query_exec_state_map_.end()) {
+    QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+    lock_guard<mutex> l(shard->lock);
+    QueryExecStateMap::const_iterator exec_state = shard->map.find(query_id);
+    if (exec_state != shard->map.end()) {
       if (base64_encoded) {
         exec_state->second->profile().SerializeToArchiveString(output);
       } else {
@@ -536,7 +616,8 @@ Status ImpalaServer::GetExecSummary(const TUniqueId& query_id, TExecSummary* res
 void ImpalaServer::LogFileFlushThread() {
   while (true) {
     sleep(5);
-    profile_logger_->Flush();
+    if (profile_logger_.get() != NULL) profile_logger_->Flush();
+    if (binary_profile_logger_.get() != NULL) binary_profile_logger_->Flush();
   }
 }
 
@@ -570,15 +651,38 @@ void ImpalaServer::LineageLoggerFlushThread() {
   }
 }
 
+// Builds the record appended to the binary profile log for a completed query: an
+// 8-byte ms-since-epoch timestamp, the query id as two 8-byte integers (all host byte
+// order) and the profile as uncompressed thrift. The GzipLogger length-prefixes the
+// record and compresses the whole stream; leaving the thrift uncompressed here lets
+// the stream compressor share the counter and node names that repeat across the
+// queries in a log file.
+static string EncodeBinaryProfileRecord(const TUniqueId& query_id,
+    const RuntimeProfile& profile) {
+  string record;
+  int64_t timestamp = UnixMillis();
+  record.append(reinterpret_cast<const char*>(&timestamp), sizeof(timestamp));
+  record.append(reinterpret_cast<const char*>(&query_id.hi), sizeof(query_id.hi));
+  record.append(reinterpret_cast<const char*>(&query_id.lo), sizeof(query_id.lo));
+  profile.SerializeToThrift(&record);
+  return record;
+}
+
 void ImpalaServer::ArchiveQuery(const QueryExecState& query) {
   const string& encoded_profile_str = query.profile().SerializeToArchiveString();
 
   // If there was an error initialising archival (e.g. directory is not writeable),
   // FLAGS_log_query_to_file will have been set to false
   if (FLAGS_log_query_to_file) {
-    stringstream ss;
-    ss << UnixMillis() << " " << query.query_id() << " " << encoded_profile_str;
-    Status status = profile_logger_->AppendEntry(ss.str());
+    Status status;
+    if (binary_profile_logger_.get() != NULL) {
+      status = binary_profile_logger_->AppendEntry(
+          EncodeBinaryProfileRecord(query.query_id(), query.profile()));
+    } else {
+      stringstream ss;
+      ss << UnixMillis() << " " << query.query_id() << " " << encoded_profile_str;
+      status = profile_logger_->AppendEntry(ss.str());
+    }
     if (!status.ok()) {
       LOG_EVERY_N(WARNING, 1000) << "Could not write to profile log file file ("
                                  << google::COUNTER << " attempts failed): "
@@ -645,12 +749,25 @@ Status ImpalaServer::ExecuteInternal(
   (*exec_state)->query_events()->MarkEvent("Start execution");
 
   TExecRequest result;
+  // Plans are cached per user, database, statement and query options; a hit skips the
+  // frontend planning round trip entirely.
+  string plan_cache_key;
+  int64_t plan_catalog_version = 0;
+  bool plan_from_cache = false;
+  if (FLAGS_plan_cache_max_entries > 0) {
+    const string& effective_user = session_state->do_as_user.empty() ?
+        query_ctx.session.connected_user : session_state->do_as_user;
+    plan_cache_key = Substitute("$0\n$1\n$2\n$3", effective_user,
+        query_ctx.session.database, query_ctx.request.stmt,
+        ThriftDebugString(query_ctx.request.query_options));
+    plan_from_cache = LookupPlanCache(plan_cache_key, &result, &plan_catalog_version);
+  }
   {
     // Keep a lock on exec_state so that registration and setting
     // result_metadata are atomic.
     //
     // Note: this acquires the exec_state lock *before* the
-    // query_exec_state_map_ lock. This is the opposite of
+    // query exec state map shard lock. This is the opposite of
     // GetQueryExecState(..., true), and therefore looks like a
     // candidate for deadlock. The reason this works here is that
     // GetQueryExecState cannot find exec_state (under the exec state
@@ -665,11 +782,23 @@ Status ImpalaServer::ExecuteInternal(
     RETURN_IF_ERROR(RegisterQuery(session_state, *exec_state));
     *registered_exec_state = true;
 
-    RETURN_IF_ERROR((*exec_state)->UpdateQueryStatus(
-        exec_env_->frontend()->GetExecRequest(query_ctx, &result)));
-    (*exec_state)->query_events()->MarkEvent("Planning finished");
-    (*exec_state)->summary_profile()->AddEventSequence(
-        result.timeline.name, result.timeline);
+    if (plan_from_cache) {
+      // The cached plan embeds the query context of the query it was created for;
+      // replace it so the coordinator and fragments see this query's id and session.
+      result.query_exec_request.query_ctx = query_ctx;
+      (*exec_state)->query_events()->MarkEvent("Planning served from plan cache");
+    } else {
+      RETURN_IF_ERROR((*exec_state)->UpdateQueryStatus(
+          exec_env_->frontend()->GetExecRequest(query_ctx, &result)));
+      (*exec_state)->query_events()->MarkEvent("Planning finished");
+      (*exec_state)->summary_profile()->AddEventSequence(
+          result.timeline.name, result.timeline);
+      // Only cache plans of read-only queries: DDL and DML have side effects, and
+      // their requests carry per-query state that cannot be reused.
+      if (!plan_cache_key.empty() && result.stmt_type == TStmtType::QUERY) {
+        AddToPlanCache(plan_cache_key, plan_catalog_version, result);
+      }
+    }
     if (result.__isset.result_set_metadata) {
       (*exec_state)->set_result_metadata(result.result_set_metadata);
     }
@@ -730,16 +859,17 @@ Status ImpalaServer::RegisterQuery(shared_ptr<SessionState> session_state,
   if (session_state->closed) return Status("Session has been closed, ignoring query.");
   const TUniqueId& query_id = exec_state->query_id();
   {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-    if (entry != query_exec_state_map_.end()) {
+    QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+    lock_guard<mutex> l(shard->lock);
+    QueryExecStateMap::iterator entry = shard->map.find(query_id);
+    if (entry != shard->map.end()) {
       // There shouldn't be an active query with that same id.
       // (query_id is globally unique)
       stringstream ss;
       ss << "query id " << PrintId(query_id) << " already exists";
       return Status(ErrorMsg(TErrorCode::INTERNAL_ERROR, ss.str()));
     }
-    query_exec_state_map_.insert(make_pair(query_id, exec_state));
+    shard->map.insert(make_pair(query_id, exec_state));
   }
   return Status::OK;
 }
@@ -783,14 +913,15 @@ Status ImpalaServer::UnregisterQuery(const TUniqueId& query_id, bool check_infli
 
   shared_ptr<QueryExecState> exec_state;
   {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-    if (entry == query_exec_state_map_.end()) {
+    QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+    lock_guard<mutex> l(shard->lock);
+    QueryExecStateMap::iterator entry = shard->map.find(query_id);
+    if (entry == shard->map.end()) {
       return Status("Invalid or unknown query handle");
     } else {
       exec_state = entry->second;
     }
-    query_exec_state_map_.erase(entry);
+    shard->map.erase(entry);
   }
 
   // Ignore all audit events except for those due to an AuthorizationException.
@@ -871,9 +1002,10 @@ Status ImpalaServer::CloseSessionInternal(const TUniqueId& session_id,
   // Find the session_state and remove it from the map.
   shared_ptr<SessionState> session_state;
   {
-    lock_guard<mutex> l(session_state_map_lock_);
-    SessionStateMap::iterator entry = session_state_map_.find(session_id);
-    if (entry == session_state_map_.end()) {
+    SessionStateMapShard* shard = GetSessionStateMapShard(session_id);
+    lock_guard<mutex> l(shard->lock);
+    SessionStateMap::iterator entry = shard->map.find(session_id);
+    if (entry == shard->map.end()) {
       if (ignore_if_absent) {
         return Status::OK;
       } else {
@@ -881,7 +1013,7 @@ Status ImpalaServer::CloseSessionInternal(const TUniqueId& session_id,
       }
     }
     session_state = entry->second;
-    session_state_map_.erase(session_id);
+    shard->map.erase(session_id);
   }
   DCHECK(session_state != NULL);
   if (session_state->session_type == TSessionType::BEESWAX) {
@@ -908,9 +1040,10 @@ Status ImpalaServer::CloseSessionInternal(const TUniqueId& session_id,
 
 Status ImpalaServer::GetSessionState(const TUniqueId& session_id,
     shared_ptr<SessionState>* session_state, bool mark_active) {
-  lock_guard<mutex> l(session_state_map_lock_);
-  SessionStateMap::iterator i = session_state_map_.find(session_id);
-  if (i == session_state_map_.end()) {
+  SessionStateMapShard* shard = GetSessionStateMapShard(session_id);
+  lock_guard<mutex> l(shard->lock);
+  SessionStateMap::iterator i = shard->map.find(session_id);
+  if (i == shard->map.end()) {
     *session_state = boost::shared_ptr<SessionState>();
     return Status("Invalid session id");
   } else {
@@ -1034,6 +1167,14 @@ void ImpalaServer::CancelFromThreadPool(uint32_t thread_id,
                  << ") failed";
     }
   } else {
+    if (cancellation_work.retriable() && FLAGS_max_query_retries > 0) {
+      // The query lost one of its executing backends. If it is eligible, mark it for
+      // transparent re-execution before issuing the cancel: the cancellation unblocks
+      // the query's waiting thread, which then picks up the retry.
+      shared_ptr<QueryExecState> exec_state =
+          GetQueryExecState(cancellation_work.query_id(), false);
+      if (exec_state.get() != NULL) exec_state->MarkRetryableFailure();
+    }
     Status status = CancelInternal(cancellation_work.query_id(), true,
         &cancellation_work.cause());
     if (!status.ok()) {
@@ -1043,6 +1184,27 @@ void ImpalaServer::CancelFromThreadPool(uint32_t thread_id,
   }
 }
 
+void ImpalaServer::PreconnectFromThreadPool(uint32_t thread_id,
+    const TNetworkAddress& address) {
+  Status status = exec_env_->impalad_client_cache()->PreconnectToHost(address);
+  if (!status.ok()) {
+    VLOG(1) << "Failed to pre-connect to backend " << address << ": "
+            << status.GetDetail();
+  }
+}
+
+void ImpalaServer::EnqueueWaitCompletion(const TUniqueId& query_id) {
+  query_wait_thread_pool_->Offer(query_id);
+}
+
+void ImpalaServer::WaitFromThreadPool(uint32_t thread_id, const TUniqueId& query_id) {
+  shared_ptr<QueryExecState> exec_state = GetQueryExecState(query_id, false);
+  // If the query was unregistered before we got here, UnregisterQuery runs the wait
+  // work itself via BlockOnWait().
+  if (exec_state.get() == NULL) return;
+  exec_state->CompleteWait();
+}
+
 Status ImpalaServer::AuthorizeProxyUser(const string& user, const string& do_as_user) {
   if (user.empty()) {
     return Status("Unable to delegate using empty proxy username.");
@@ -1086,121 +1248,255 @@ void ImpalaServer::CatalogUpdateCallback(
   if (topic == incoming_topic_deltas.end()) return;
   const TTopicDelta& delta = topic->second;
 
+  if (FLAGS_async_catalog_update) {
+    lock_guard<mutex> l(catalog_update_queue_lock_);
+    if (request_full_catalog_update_) {
+      subscriber_topic_updates->push_back(TTopicDelta());
+      TTopicDelta& update = subscriber_topic_updates->back();
+      update.topic_name = CatalogServer::IMPALA_CATALOG_TOPIC;
+      update.__set_from_version(0L);
+      request_full_catalog_update_ = false;
+    }
+    if (delta.topic_entries.size() != 0 || delta.topic_deletions.size() != 0) {
+      pending_catalog_updates_.push_back(delta);
+      catalog_update_queue_cv_.notify_one();
+    }
+  } else if (delta.topic_entries.size() != 0 || delta.topic_deletions.size() != 0) {
+    ApplyCatalogUpdate(delta, subscriber_topic_updates);
+  }
 
-  // Process any updates
-  if (delta.topic_entries.size() != 0 || delta.topic_deletions.size() != 0)  {
-    TUpdateCatalogCacheRequest update_req;
-    update_req.__set_is_delta(delta.is_delta);
-    // Process all Catalog updates (new and modified objects) and determine what the
-    // new catalog version will be.
-    int64_t new_catalog_version = catalog_update_info_.catalog_version;
-    BOOST_FOREACH(const TTopicItem& item, delta.topic_entries) {
-      uint32_t len = item.value.size();
-      TCatalogObject catalog_object;
-      Status status = DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(
-          item.value.data()), &len, FLAGS_compact_catalog_topic, &catalog_object);
-      if (!status.ok()) {
-        LOG(ERROR) << "Error deserializing item: " << status.GetDetail();
-        continue;
-      }
-      if (catalog_object.type == TCatalogObjectType::CATALOG) {
-        update_req.__set_catalog_service_id(catalog_object.catalog.catalog_service_id);
-        new_catalog_version = catalog_object.catalog_version;
-      }
+  // Always update the minimum subscriber version for the catalog topic.
+  {
+    unique_lock<mutex> unique_lock(catalog_version_lock_);
+    min_subscriber_catalog_topic_version_ = delta.min_subscriber_topic_version;
+  }
+  catalog_version_update_cv_.notify_all();
+}
 
-      // Refresh the lib cache entries of any added functions and data sources
-      if (catalog_object.type == TCatalogObjectType::FUNCTION) {
-        DCHECK(catalog_object.__isset.fn);
-        LibCache::instance()->SetNeedsRefresh(catalog_object.fn.hdfs_location);
-      }
-      if (catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
-        DCHECK(catalog_object.__isset.data_source);
-        LibCache::instance()->SetNeedsRefresh(catalog_object.data_source.hdfs_location);
+void ImpalaServer::CatalogUpdateThread() {
+  while (true) {
+    TTopicDelta delta;
+    {
+      unique_lock<mutex> l(catalog_update_queue_lock_);
+      while (pending_catalog_updates_.empty()) {
+        catalog_update_queue_cv_.wait(l);
       }
+      swap(delta, pending_catalog_updates_.front());
+      pending_catalog_updates_.pop_front();
+    }
+    ApplyCatalogUpdate(delta, NULL);
+    // Wake threads waiting on the catalog version, e.g. DDL responses.
+    catalog_version_update_cv_.notify_all();
+  }
+}
 
-      update_req.updated_objects.push_back(catalog_object);
+void ImpalaServer::ApplyCatalogUpdate(const TTopicDelta& delta,
+    vector<TTopicDelta>* subscriber_topic_updates) {
+  TUpdateCatalogCacheRequest update_req;
+  update_req.__set_is_delta(delta.is_delta);
+  // Process all Catalog updates (new and modified objects) and determine what the
+  // new catalog version will be.
+  int64_t new_catalog_version = catalog_update_info_.catalog_version;
+  BOOST_FOREACH(const TTopicItem& item, delta.topic_entries) {
+    uint32_t len = item.value.size();
+    TCatalogObject catalog_object;
+    Status status = DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(
+        item.value.data()), &len, FLAGS_compact_catalog_topic, &catalog_object);
+    if (!status.ok()) {
+      LOG(ERROR) << "Error deserializing item: " << status.GetDetail();
+      continue;
+    }
+    if (catalog_object.type == TCatalogObjectType::CATALOG) {
+      update_req.__set_catalog_service_id(catalog_object.catalog.catalog_service_id);
+      new_catalog_version = catalog_object.catalog_version;
     }
 
-    // We need to look up the dropped functions and data sources and remove them
-    // from the library cache. The data sent from the catalog service does not
-    // contain all the function metadata so we'll ask our local frontend for it. We
-    // need to do this before updating the catalog.
-    vector<TCatalogObject> dropped_objects;
+    // Refresh the lib cache entries of any added functions and data sources
+    if (catalog_object.type == TCatalogObjectType::FUNCTION) {
+      DCHECK(catalog_object.__isset.fn);
+      LibCache::instance()->SetNeedsRefresh(catalog_object.fn.hdfs_location);
+    }
+    if (catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
+      DCHECK(catalog_object.__isset.data_source);
+      LibCache::instance()->SetNeedsRefresh(catalog_object.data_source.hdfs_location);
+    }
 
-    // Process all Catalog deletions (dropped objects). We only know the keys (object
-    // names) so must parse each key to determine the TCatalogObject.
-    BOOST_FOREACH(const string& key, delta.topic_deletions) {
-      LOG(INFO) << "Catalog topic entry deletion: " << key;
-      TCatalogObject catalog_object;
-      Status status = TCatalogObjectFromEntryKey(key, &catalog_object);
-      if (!status.ok()) {
-        LOG(ERROR) << "Error parsing catalog topic entry deletion key: " << key << " "
-                   << "Error: " << status.GetDetail();
-        continue;
-      }
-      update_req.removed_objects.push_back(catalog_object);
-      if (catalog_object.type == TCatalogObjectType::FUNCTION ||
-          catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
-        TCatalogObject dropped_object;
-        if (exec_env_->frontend()->GetCatalogObject(
-                catalog_object, &dropped_object).ok()) {
-          // This object may have been dropped and re-created. To avoid removing the
-          // re-created object's entry from the cache verify the existing object has a
-          // catalog version <= the catalog version included in this statestore heartbeat.
-          if (dropped_object.catalog_version <= new_catalog_version) {
-            if (catalog_object.type == TCatalogObjectType::FUNCTION ||
-                catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
-              dropped_objects.push_back(dropped_object);
-            }
+    update_req.updated_objects.push_back(catalog_object);
+  }
+
+  // We need to look up the dropped functions and data sources and remove them
+  // from the library cache. The data sent from the catalog service does not
+  // contain all the function metadata so we'll ask our local frontend for it. We
+  // need to do this before updating the catalog.
+  vector<TCatalogObject> dropped_objects;
+
+  // Process all Catalog deletions (dropped objects). We only know the keys (object
+  // names) so must parse each key to determine the TCatalogObject.
+  BOOST_FOREACH(const string& key, delta.topic_deletions) {
+    LOG(INFO) << "Catalog topic entry deletion: " << key;
+    TCatalogObject catalog_object;
+    Status status = TCatalogObjectFromEntryKey(key, &catalog_object);
+    if (!status.ok()) {
+      LOG(ERROR) << "Error parsing catalog topic entry deletion key: " << key << " "
+                 << "Error: " << status.GetDetail();
+      continue;
+    }
+    update_req.removed_objects.push_back(catalog_object);
+    if (catalog_object.type == TCatalogObjectType::FUNCTION ||
+        catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
+      TCatalogObject dropped_object;
+      if (exec_env_->frontend()->GetCatalogObject(
+              catalog_object, &dropped_object).ok()) {
+        // This object may have been dropped and re-created. To avoid removing the
+        // re-created object's entry from the cache verify the existing object has a
+        // catalog version <= the catalog version included in this statestore heartbeat.
+        if (dropped_object.catalog_version <= new_catalog_version) {
+          if (catalog_object.type == TCatalogObjectType::FUNCTION ||
+              catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
+            dropped_objects.push_back(dropped_object);
           }
         }
-        // Nothing to do in error case.
       }
+      // Nothing to do in error case.
     }
+  }
 
-    // Call the FE to apply the changes to the Impalad Catalog.
-    TUpdateCatalogCacheResponse resp;
-    Status s = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
-    if (!s.ok()) {
-      LOG(ERROR) << "There was an error processing the impalad catalog update. Requesting"
-                 << " a full topic update to recover: " << s.GetDetail();
+  // Call the FE to apply the changes to the Impalad Catalog.
+  TUpdateCatalogCacheResponse resp;
+  Status s = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
+  if (!s.ok()) {
+    LOG(ERROR) << "There was an error processing the impalad catalog update. Requesting"
+               << " a full topic update to recover: " << s.GetDetail();
+    if (subscriber_topic_updates != NULL) {
       subscriber_topic_updates->push_back(TTopicDelta());
       TTopicDelta& update = subscriber_topic_updates->back();
       update.topic_name = CatalogServer::IMPALA_CATALOG_TOPIC;
       update.__set_from_version(0L);
-      ImpaladMetrics::CATALOG_READY->set_value(false);
-      // Dropped all cached lib files (this behaves as if all functions and data
-      // sources are dropped).
-      LibCache::instance()->DropCache();
     } else {
-      {
-        unique_lock<mutex> unique_lock(catalog_version_lock_);
-        catalog_update_info_.catalog_version = new_catalog_version;
-        catalog_update_info_.catalog_topic_version = delta.to_version;
-        catalog_update_info_.catalog_service_id = resp.catalog_service_id;
-      }
-      ImpaladMetrics::CATALOG_READY->set_value(new_catalog_version > 0);
-      UpdateCatalogMetrics();
-      // Remove all dropped objects from the library cache.
-      // TODO: is this expensive? We'd like to process heartbeats promptly.
-      BOOST_FOREACH(TCatalogObject& object, dropped_objects) {
-        if (object.type == TCatalogObjectType::FUNCTION) {
-          LibCache::instance()->RemoveEntry(object.fn.hdfs_location);
-        } else if (object.type == TCatalogObjectType::DATA_SOURCE) {
-          LibCache::instance()->RemoveEntry(object.data_source.hdfs_location);
-        } else {
-          DCHECK(false);
-        }
+      // Request the full update on the next heartbeat and drop any queued deltas;
+      // they would be applied against the same broken state.
+      lock_guard<mutex> l(catalog_update_queue_lock_);
+      pending_catalog_updates_.clear();
+      request_full_catalog_update_ = true;
+    }
+    ImpaladMetrics::CATALOG_READY->set_value(false);
+    // Dropped all cached lib files (this behaves as if all functions and data
+    // sources are dropped).
+    LibCache::instance()->DropCache();
+  } else {
+    {
+      unique_lock<mutex> unique_lock(catalog_version_lock_);
+      catalog_update_info_.catalog_version = new_catalog_version;
+      catalog_update_info_.catalog_topic_version = delta.to_version;
+      catalog_update_info_.catalog_service_id = resp.catalog_service_id;
+    }
+    {
+      // The catalog changed, so any cached query results may be stale.
+      lock_guard<mutex> l(query_result_cache_lock_);
+      query_result_cache_.clear();
+      query_result_cache_bytes_ = 0;
+    }
+    {
+      // Likewise, cached plans may reference dropped or changed catalog objects.
+      lock_guard<mutex> l(plan_cache_lock_);
+      plan_cache_.clear();
+    }
+    ImpaladMetrics::CATALOG_READY->set_value(new_catalog_version > 0);
+    UpdateCatalogMetrics();
+    // Remove all dropped objects from the library cache.
+    // TODO: is this expensive? We'd like to process heartbeats promptly.
+    BOOST_FOREACH(TCatalogObject& object, dropped_objects) {
+      if (object.type == TCatalogObjectType::FUNCTION) {
+        LibCache::instance()->RemoveEntry(object.fn.hdfs_location);
+      } else if (object.type == TCatalogObjectType::DATA_SOURCE) {
+        LibCache::instance()->RemoveEntry(object.data_source.hdfs_location);
+      } else {
+        DCHECK(false);
       }
     }
   }
+}
 
-  // Always update the minimum subscriber version for the catalog topic.
+bool ImpalaServer::LookupQueryResultCache(const string& key, vector<TResultRow>* rows,
+    int64_t* catalog_version) {
   {
-    unique_lock<mutex> unique_lock(catalog_version_lock_);
-    min_subscriber_catalog_topic_version_ = delta.min_subscriber_topic_version;
-  }
-  catalog_version_update_cv_.notify_all();
+    unique_lock<mutex> l(catalog_version_lock_);
+    *catalog_version = catalog_update_info_.catalog_version;
+  }
+  lock_guard<mutex> l(query_result_cache_lock_);
+  QueryResultCache::const_iterator entry = query_result_cache_.find(key);
+  if (entry == query_result_cache_.end()) return false;
+  if (entry->second->catalog_version != *catalog_version) return false;
+  *rows = entry->second->rows;
+  return true;
+}
+
+void ImpalaServer::AddToQueryResultCache(const string& key, int64_t catalog_version,
+    const vector<TResultRow>& rows, int64_t byte_size) {
+  if (byte_size > FLAGS_query_result_cache_max_result_bytes) return;
+  {
+    // Discard results computed against an older catalog; they may already be stale.
+    unique_lock<mutex> l(catalog_version_lock_);
+    if (catalog_update_info_.catalog_version != catalog_version) return;
+  }
+  shared_ptr<CachedQueryResult> entry(new CachedQueryResult());
+  entry->rows = rows;
+  entry->byte_size = byte_size;
+  entry->catalog_version = catalog_version;
+
+  lock_guard<mutex> l(query_result_cache_lock_);
+  QueryResultCache::iterator it = query_result_cache_.find(key);
+  if (it != query_result_cache_.end()) {
+    query_result_cache_bytes_ -= it->second->byte_size;
+    query_result_cache_.erase(it);
+  }
+  // Evict entries until the new result fits. The map has no access ordering, so
+  // victims are picked in iteration order; with invalidation clearing the cache on
+  // every catalog change, entries are all of similar age.
+  for (it = query_result_cache_.begin(); it != query_result_cache_.end() &&
+      query_result_cache_bytes_ + byte_size > FLAGS_query_result_cache_max_bytes;) {
+    query_result_cache_bytes_ -= it->second->byte_size;
+    query_result_cache_.erase(it++);
+  }
+  query_result_cache_bytes_ += byte_size;
+  query_result_cache_[key] = entry;
+}
+
+bool ImpalaServer::LookupPlanCache(const string& key, TExecRequest* exec_request,
+    int64_t* catalog_version) {
+  {
+    unique_lock<mutex> l(catalog_version_lock_);
+    *catalog_version = catalog_update_info_.catalog_version;
+  }
+  lock_guard<mutex> l(plan_cache_lock_);
+  PlanCache::const_iterator entry = plan_cache_.find(key);
+  if (entry == plan_cache_.end()) return false;
+  if (entry->second->catalog_version != *catalog_version) return false;
+  *exec_request = entry->second->exec_request;
+  return true;
+}
+
+void ImpalaServer::AddToPlanCache(const string& key, int64_t catalog_version,
+    const TExecRequest& exec_request) {
+  {
+    // Discard plans created against an older catalog; they may already be stale.
+    unique_lock<mutex> l(catalog_version_lock_);
+    if (catalog_update_info_.catalog_version != catalog_version) return;
+  }
+  shared_ptr<CachedPlan> entry(new CachedPlan());
+  entry->exec_request = exec_request;
+  entry->catalog_version = catalog_version;
+
+  lock_guard<mutex> l(plan_cache_lock_);
+  PlanCache::iterator it = plan_cache_.find(key);
+  if (it != plan_cache_.end()) plan_cache_.erase(it);
+  // Evict entries until the new plan fits, picking victims in iteration order as in
+  // AddToQueryResultCache().
+  for (it = plan_cache_.begin(); it != plan_cache_.end() &&
+      plan_cache_.size() + 1 > static_cast<size_t>(FLAGS_plan_cache_max_entries);) {
+    plan_cache_.erase(it++);
+  }
+  plan_cache_[key] = entry;
 }
 
 Status ImpalaServer::ProcessCatalogUpdateResult(
@@ -1282,8 +1578,14 @@ void ImpalaServer::MembershipCallback(
         VLOG(2) << "Error deserializing topic item with key: " << item.key;
         continue;
       }
-      // This is a new item - add it to the map of known backends.
-      known_backends_.insert(make_pair(item.key, backend_descriptor.address));
+      // This is a new item - add it to the map of known backends and warm up a
+      // connection to it off the statestore callback path.
+      bool is_new =
+          known_backends_.insert(make_pair(item.key, backend_descriptor.address)).second;
+      if (is_new && preconnect_thread_pool_.get() != NULL &&
+          backend_descriptor.address != exec_env_->backend_address()) {
+        preconnect_thread_pool_->Offer(backend_descriptor.address);
+      }
     }
     // Process membership deletions.
     BOOST_FOREACH(const string& backend_id, delta.topic_deletions) {
@@ -1347,7 +1649,8 @@ void ImpalaServer::MembershipCallback(
           if (i + 1 != cancellation_entry->second.size()) cause_msg << ", ";
         }
         cancellation_thread_pool_->Offer(
-            CancellationWork(cancellation_entry->first, Status(cause_msg.str()), false));
+            CancellationWork(cancellation_entry->first, Status(cause_msg.str()), false,
+                true));
       }
     }
   }
@@ -1422,9 +1725,9 @@ void ImpalaServer::ConnectionStart(
     }
 
     {
-      lock_guard<mutex> l(session_state_map_lock_);
-      bool success =
-          session_state_map_.insert(make_pair(session_id, session_state)).second;
+      SessionStateMapShard* shard = GetSessionStateMapShard(session_id);
+      lock_guard<mutex> l(shard->lock);
+      bool success = shard->map.insert(make_pair(session_id, session_state)).second;
       // The session should not have already existed.
       DCHECK(success);
     }
@@ -1463,34 +1766,38 @@ void ImpalaServer::ExpireSessions() {
     // Sleep for half the session timeout; the maximum delay between a session expiring
     // and this method picking it up is equal to the size of this sleep.
     SleepForMs(FLAGS_idle_session_timeout * 500);
-    lock_guard<mutex> l(session_state_map_lock_);
     int64_t now = UnixMillis();
     VLOG(3) << "Session expiration thread waking up";
-    // TODO: If holding session_state_map_lock_ for the duration of this loop is too
-    // expensive, consider a priority queue.
-    BOOST_FOREACH(SessionStateMap::value_type& session_state, session_state_map_) {
-      unordered_set<TUniqueId> inflight_queries;
-      {
-        lock_guard<mutex> l(session_state.second->lock);
-        if (session_state.second->ref_count > 0) continue;
-        // A session closed by other means is in the process of being removed, and it's
-        // best not to interfere.
-        if (session_state.second->closed || session_state.second->expired) continue;
-        int64_t last_accessed_ms = session_state.second->last_accessed_ms;
-        if (now - last_accessed_ms <= (FLAGS_idle_session_timeout * 1000)) continue;
-        LOG(INFO) << "Expiring session: " << session_state.first << ", user:"
-                  << session_state.second->connected_user << ", last active: "
-                  << TimestampValue(last_accessed_ms / 1000).DebugString();
-        session_state.second->expired = true;
-        ImpaladMetrics::NUM_SESSIONS_EXPIRED->Increment(1L);
-        // Since expired is true, no more queries will be added to the inflight list.
-        inflight_queries.insert(session_state.second->inflight_queries.begin(),
-            session_state.second->inflight_queries.end());
-      }
-      // Unregister all open queries from this session.
-      Status status("Session expired due to inactivity");
-      BOOST_FOREACH(const TUniqueId& query_id, inflight_queries) {
-        cancellation_thread_pool_->Offer(CancellationWork(query_id, status, true));
+    // Walk the map one shard at a time so the sweep never blocks session lookup and
+    // registration for longer than a single shard's scan.
+    for (int shard_idx = 0; shard_idx < NUM_STATE_MAP_SHARDS; ++shard_idx) {
+      SessionStateMapShard* shard = &session_state_map_shards_[shard_idx];
+      lock_guard<mutex> l(shard->lock);
+      BOOST_FOREACH(SessionStateMap::value_type& session_state, shard->map) {
+        unordered_set<TUniqueId> inflight_queries;
+        {
+          lock_guard<mutex> l(session_state.second->lock);
+          if (session_state.second->ref_count > 0) continue;
+          // A session closed by other means is in the process of being removed, and it's
+          // best not to interfere.
+          if (session_state.second->closed || session_state.second->expired) continue;
+          int64_t last_accessed_ms = session_state.second->last_accessed_ms;
+          if (now - last_accessed_ms <= (FLAGS_idle_session_timeout * 1000)) continue;
+          LOG(INFO) << "Expiring session: " << session_state.first << ", user:"
+                    << session_state.second->connected_user << ", last active: "
+                    << TimestampValue(last_accessed_ms / 1000).DebugString();
+          session_state.second->expired = true;
+          ImpaladMetrics::NUM_SESSIONS_EXPIRED->Increment(1L);
+          // Since expired is true, no more queries will be added to the inflight list.
+          inflight_queries.insert(session_state.second->inflight_queries.begin(),
+              session_state.second->inflight_queries.end());
+        }
+        // Unregister all open queries from this session.
+        Status status("Session expired due to inactivity");
+        BOOST_FOREACH(const TUniqueId& query_id, inflight_queries) {
+          cancellation_thread_pool_->Offer(
+              CancellationWork(query_id, status, true, false));
+        }
       }
     }
   }
@@ -1565,7 +1872,7 @@ void ImpalaServer::ExpireQueries() {
               PrettyPrinter::Print(timeout_s * 1000000000L, TUnit::TIME_NS));
 
           cancellation_thread_pool_->Offer(
-              CancellationWork(expiration_event->second, Status(err_msg), false));
+              CancellationWork(expiration_event->second, Status(err_msg), false, false));
           queries_by_timestamp_.erase(expiration_event++);
           ImpaladMetrics::NUM_QUERIES_EXPIRED->Increment(1L);
         } else {
@@ -1591,8 +1898,13 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
 
   shared_ptr<ImpalaServer> handler(new ImpalaServer(exec_env));
 
+  // Nonblocking servers keep the (potentially many, mostly idle) client sessions on an
+  // IO loop instead of a thread per connection, but require framed-transport clients.
+  ThriftServer::ServerType fe_server_type = FLAGS_use_nonblocking_fe_servers ?
+      ThriftServer::Nonblocking : ThriftServer::ThreadPool;
+
   if (beeswax_port != 0 && beeswax_server != NULL) {
-    // Beeswax FE must be a TThreadPoolServer because ODBC and Hue only support
+    // Beeswax FE defaults to a TThreadPoolServer because ODBC and Hue only support
     // TThreadPoolServer.
     shared_ptr<TProcessor> beeswax_processor(new ImpalaServiceProcessor(handler));
     shared_ptr<TProcessorEventHandler> event_handler(
@@ -1600,7 +1912,7 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
     beeswax_processor->setEventHandler(event_handler);
     *beeswax_server = new ThriftServer(BEESWAX_SERVER_NAME, beeswax_processor,
         beeswax_port, AuthManager::GetInstance()->GetExternalAuthProvider(),
-        exec_env->metrics(), FLAGS_fe_service_threads, ThriftServer::ThreadPool);
+        exec_env->metrics(), FLAGS_fe_service_threads, fe_server_type);
 
     (*beeswax_server)->SetConnectionHandler(handler.get());
     if (!FLAGS_ssl_server_certificate.empty()) {
@@ -1613,7 +1925,8 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
   }
 
   if (hs2_port != 0 && hs2_server != NULL) {
-    // HiveServer2 JDBC driver does not support non-blocking server.
+    // The HiveServer2 JDBC driver does not support the non-blocking server (it uses
+    // unframed transport), so it defaults to a TThreadPoolServer.
     shared_ptr<TProcessor> hs2_fe_processor(
         new ImpalaHiveServer2ServiceProcessor(handler));
     shared_ptr<TProcessorEventHandler> event_handler(
@@ -1622,7 +1935,7 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
 
     *hs2_server = new ThriftServer(HS2_SERVER_NAME, hs2_fe_processor, hs2_port,
         AuthManager::GetInstance()->GetExternalAuthProvider(), exec_env->metrics(),
-        FLAGS_fe_service_threads, ThriftServer::ThreadPool);
+        FLAGS_fe_service_threads, fe_server_type);
 
     (*hs2_server)->SetConnectionHandler(handler.get());
     if (!FLAGS_ssl_server_certificate.empty()) {
@@ -1656,9 +1969,10 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
 bool ImpalaServer::GetSessionIdForQuery(const TUniqueId& query_id,
     TUniqueId* session_id) {
   DCHECK(session_id != NULL);
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator i = query_exec_state_map_.find(query_id);
-  if (i == query_exec_state_map_.end()) {
+  QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+  lock_guard<mutex> l(shard->lock);
+  QueryExecStateMap::iterator i = shard->map.find(query_id);
+  if (i == shard->map.end()) {
     return false;
   } else {
     *session_id = i->second->session_id();
@@ -1668,9 +1982,10 @@ bool ImpalaServer::GetSessionIdForQuery(const TUniqueId& query_id,
 
 shared_ptr<ImpalaServer::QueryExecState> ImpalaServer::GetQueryExecState(
     const TUniqueId& query_id, bool lock) {
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator i = query_exec_state_map_.find(query_id);
-  if (i == query_exec_state_map_.end()) {
+  QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+  lock_guard<mutex> l(shard->lock);
+  QueryExecStateMap::iterator i = shard->map.find(query_id);
+  if (i == shard->map.end()) {
     return shared_ptr<QueryExecState>();
   } else {
     if (lock) i->second->lock()->lock();
@@ -15,6 +15,7 @@
 #ifndef IMPALA_SERVICE_IMPALA_SERVER_H
 #define IMPALA_SERVICE_IMPALA_SERVER_H
 
+#include <list>
 #include <boost/thread/mutex.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -32,6 +33,7 @@
 #include "common/status.h"
 #include "service/frontend.h"
 #include "util/metrics.h"
+#include "util/gzip-logger.h"
 #include "util/runtime-profile.h"
 #include "util/simple-logger.h"
 #include "util/thread-pool.h"
@@ -49,6 +51,8 @@ class ExecEnv;
 class DataSink;
 class CancellationWork;
 class Coordinator;
+class ExprContext;
+class RowBatch;
 class RowDescriptor;
 class TCatalogUpdate;
 class TPlanExecRequest;
@@ -266,6 +270,15 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
     // operation, the row in the form of TResultRow.
     virtual Status AddOneRow(const TResultRow& row) = 0;
 
+    // Adds rows [start_idx, start_idx + num_rows) of 'batch' to this result set by
+    // evaluating 'ctxs' column by column, which keeps the per-value type dispatch out
+    // of the inner loop. Returns false if this result set only supports row-at-a-time
+    // conversion; callers must then fall back to AddOneRow().
+    virtual bool AddRowBatch(const std::vector<ExprContext*>& ctxs, RowBatch* batch,
+        int start_idx, int num_rows) {
+      return false;
+    }
+
     // Copies rows in the range [start_idx, start_idx + num_rows) from the other result
     // set into this result set. Returns the number of rows added to this result set.
     // Returns 0 if the given range is out of bounds of the other result set.
@@ -307,7 +320,7 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
 
   // Return exec state for given query_id, or NULL if not found.
   // If 'lock' is true, the returned exec state's lock() will be acquired before
-  // the query_exec_state_map_lock_ is released.
+  // the query exec state map shard lock is released.
   boost::shared_ptr<QueryExecState> GetQueryExecState(
       const TUniqueId& query_id, bool lock);
 
@@ -321,7 +334,7 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // Starts asynchronous execution of query. Creates QueryExecState (returned
   // in exec_state), registers it and calls Coordinator::Execute().
   // If it returns with an error status, exec_state will be NULL and nothing
-  // will have been registered in query_exec_state_map_.
+  // will have been registered in the query exec state map.
   // session_state is a ptr to the session running this query and must have
   // been checked out.
   // query_session_state is a snapshot of session state that changes when the
@@ -336,7 +349,7 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
                          bool* registered_exec_state,
                          boost::shared_ptr<QueryExecState>* exec_state);
 
-  // Registers the query exec state with query_exec_state_map_ using the globally
+  // Registers the query exec state with the query exec state map using the globally
   // unique query_id and add the query id to session state's open query list.
   // The caller must have checked out the session state.
   Status RegisterQuery(boost::shared_ptr<SessionState> session_state,
@@ -355,7 +368,7 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
       const boost::shared_ptr<QueryExecState>& exec_state);
 
   // Unregister the query by cancelling it, removing exec_state from
-  // query_exec_state_map_, and removing the query id from session state's in-flight
+  // the query exec state map, and removing the query id from session state's in-flight
   // query list.  If check_inflight is true, then return an error if the query is not
   // yet in-flight.  Otherwise, proceed even if the query isn't yet in-flight (for
   // cleaning up after an error on the query issuing path).
@@ -457,6 +470,18 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   void InflightQueryIdsUrlCallback(const Webserver::ArgumentMap& args,
       rapidjson::Document* document);
 
+  // Webserver callback. Upon return, 'document' will contain a text breakdown in
+  // 'contents' of the CPU samples collected for the query by the built-in sampling
+  // profiler, per plan node (see util/cpu-sampler.h).
+  void QueryCpuSamplesUrlCallback(const Webserver::ArgumentMap& args,
+      rapidjson::Document* document);
+
+  // Webserver callback. Upon return, 'contents' holds the query's runtime profile
+  // reduced to its per-operator allocation counters (populated in ALLOC_PROFILING
+  // builds), followed by the process-wide tcmalloc heap growth stacks in pprof format.
+  void QueryAllocsUrlCallback(const Webserver::ArgumentMap& args,
+      rapidjson::Document* document);
+
   // Json callback for /sessions, which prints a table of active client sessions.
   // "sessions": [
   // {
@@ -534,7 +559,7 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
 
   // Copies a query's state into the query log. Called immediately prior to a
   // QueryExecState's deletion. Also writes the query profile to the profile log on disk.
-  // Must be called with query_exec_state_map_lock_ held
+  // Must be called with the query's exec state map shard lock held
   void ArchiveQuery(const QueryExecState& query);
 
   // Checks whether the given user is allowed to delegate as the specified do_as_user.
@@ -642,7 +667,7 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
 
   // Starts the synchronous execution of a HiverServer2 metadata operation.
   // If the execution succeeds, an QueryExecState will be created and registered in
-  // query_exec_state_map_. Otherwise, nothing will be registered in query_exec_state_map_
+  // the query exec state map. Otherwise, nothing will be registered in the map
   // and an error status will be returned. As part of this call, the TMetadataOpRequest
   // struct will be populated with the requesting user's session state.
   // Returns a TOperationHandle and TStatus.
@@ -678,6 +703,22 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   void CancelFromThreadPool(uint32_t thread_id,
       const CancellationWork& cancellation_work);
 
+  // Opens and caches a backend connection to 'address' via the impalad client cache,
+  // called from the preconnect thread pool for backends newly seen in the statestore
+  // membership topic. Keeps connection setup off the query path after a node restart.
+  void PreconnectFromThreadPool(uint32_t thread_id, const TNetworkAddress& address);
+
+  // Offers 'query_id' to query_wait_thread_pool_. Registered as the coordinator
+  // completion callback for queries whose wait work is driven by fragment status
+  // reports instead of a dedicated wait thread (see QueryExecState::WaitAsync()). Must
+  // not block for long: it may be invoked while coordinator locks are held.
+  void EnqueueWaitCompletion(const TUniqueId& query_id);
+
+  // Runs the wait work (query finalization, catalog update) for a completed query,
+  // called from query_wait_thread_pool_. If the query has already been unregistered,
+  // does nothing; UnregisterQuery performs the wait work itself in that case.
+  void WaitFromThreadPool(uint32_t thread_id, const TUniqueId& query_id);
+
   // Processes a CatalogUpdateResult returned from the CatalogServer and ensures
   // the update has been applied to the local impalad's catalog cache. If
   // wait_for_all_subscribers is true, this function will also wait until all
@@ -729,6 +770,13 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // <ms-since-epoch> <query-id> <thrift query profile URL encoded and gzipped>
   boost::scoped_ptr<SimpleLogger> profile_logger_;
 
+  // Logger used instead of profile_logger_ when --binary_profile_log is set. Writes
+  // length-prefixed binary records (8-byte ms-since-epoch timestamp, query id as two
+  // 8-byte integers, then the uncompressed thrift query profile) through a shared gzip
+  // stream; see GzipLogger. Convert to the text format with the profile-log-reader
+  // utility.
+  boost::scoped_ptr<GzipLogger> binary_profile_logger_;
+
   // Logger for writing audit events, one per line with the format:
   // "<current timestamp>" : { JSON object }
   boost::scoped_ptr<SimpleLogger> audit_event_logger_;
@@ -753,15 +801,42 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // avoid blocking the statestore callback.
   boost::scoped_ptr<ThreadPool<CancellationWork> > cancellation_thread_pool_;
 
+  // Thread pool that pre-connects to backends newly seen in the statestore membership
+  // topic, so that the membership callback doesn't block on connection setup.
+  boost::scoped_ptr<ThreadPool<TNetworkAddress> > preconnect_thread_pool_;
+
+  // Thread pool that runs the wait work of queries whose completion is driven by
+  // fragment status reports rather than a dedicated wait thread (see
+  // QueryExecState::WaitAsync()). Its threads only run after a query's backends have
+  // completed, so they never park for the duration of a statement.
+  boost::scoped_ptr<ThreadPool<TUniqueId> > query_wait_thread_pool_;
+
   // Thread that runs ExpireSessions if FLAGS_idle_session_timeout > 0
   boost::scoped_ptr<Thread> session_timeout_thread_;
 
+  // Number of shards the query exec state and session state maps are split into.
+  // Striping the locks keeps unrelated bookkeeping (expiration sweeps, web UI walks)
+  // from serializing against query registration and lookup.
+  static const int NUM_STATE_MAP_SHARDS = 16;
+
   // map from query id to exec state; QueryExecState is owned by us and referenced
   // as a shared_ptr to allow asynchronous deletion
   typedef boost::unordered_map<TUniqueId, boost::shared_ptr<QueryExecState> >
       QueryExecStateMap;
-  QueryExecStateMap query_exec_state_map_;
-  boost::mutex query_exec_state_map_lock_;  // protects query_exec_state_map_
+
+  // One shard of the query exec state map: the slice of the query id space that hashes
+  // to it, together with the lock that protects it.
+  struct QueryExecStateMapShard {
+    boost::mutex lock;  // protects map
+    QueryExecStateMap map;
+  };
+  QueryExecStateMapShard query_exec_state_map_shards_[NUM_STATE_MAP_SHARDS];
+
+  // Returns the query exec state map shard holding 'query_id'.
+  QueryExecStateMapShard* GetQueryExecStateMapShard(const TUniqueId& query_id) {
+    return &query_exec_state_map_shards_[
+        static_cast<uint64_t>(query_id.lo) % NUM_STATE_MAP_SHARDS];
+  }
 
   // Default query options in the form of TQueryOptions and beeswax::ConfigVariable
   TQueryOptions default_query_options_;
@@ -794,7 +869,8 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
     TNetworkAddress network_address;
 
     // Protects all fields below
-    // If this lock has to be taken with query_exec_state_map_lock, take this lock first.
+    // If this lock has to be taken with a query exec state map shard lock, take this
+    // lock first.
     boost::mutex lock;
 
     // If true, the session has been closed.
@@ -869,17 +945,27 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // For access to GetSessionState() / MarkSessionInactive()
   friend class ScopedSessionState;
 
-  // Protects session_state_map_. Should be taken before any query exec-state locks,
-  // including query_exec_state_map_lock_. Should be taken before individual session-state
-  // locks.
-  boost::mutex session_state_map_lock_;
-
   // A map from session identifier to a structure containing per-session information
   typedef boost::unordered_map<TUniqueId, boost::shared_ptr<SessionState> >
     SessionStateMap;
-  SessionStateMap session_state_map_;
 
-  // Protects connection_to_sessions_map_. May be taken before session_state_map_lock_.
+  // One shard of the session state map. The shard lock should be taken before any
+  // query exec-state locks, including the query exec state map shard locks, and before
+  // individual session-state locks.
+  struct SessionStateMapShard {
+    boost::mutex lock;  // protects map
+    SessionStateMap map;
+  };
+  SessionStateMapShard session_state_map_shards_[NUM_STATE_MAP_SHARDS];
+
+  // Returns the session state map shard holding 'session_id'.
+  SessionStateMapShard* GetSessionStateMapShard(const TUniqueId& session_id) {
+    return &session_state_map_shards_[
+        static_cast<uint64_t>(session_id.lo) % NUM_STATE_MAP_SHARDS];
+  }
+
+  // Protects connection_to_sessions_map_. May be taken before a session state map shard
+  // lock.
   boost::mutex connection_to_sessions_map_lock_;
 
   // Map from a connection ID to the associated list of sessions so that all can be closed
@@ -906,8 +992,8 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
     session->last_accessed_ms = UnixMillis();
   }
 
-  // protects query_locations_. Must always be taken after
-  // query_exec_state_map_lock_ if both are required.
+  // protects query_locations_. Must always be taken after a query exec state map shard
+  // lock if both are required.
   boost::mutex query_locations_lock_;
 
   // A map from backend to the list of queries currently running there.
@@ -963,6 +1049,114 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // update. Updated with each catalog topic heartbeat from the statestore.
   int64_t min_subscriber_catalog_topic_version_;
 
+  // Applies one catalog topic delta to the catalog cache via the frontend. On failure,
+  // requests a full catalog topic update to recover: directly through
+  // 'subscriber_topic_updates' when non-NULL (synchronous path), otherwise by setting
+  // request_full_catalog_update_ to be picked up by the next heartbeat (asynchronous
+  // path).
+  void ApplyCatalogUpdate(const TTopicDelta& delta,
+      std::vector<TTopicDelta>* subscriber_topic_updates);
+
+  // Run by catalog_update_thread_: applies queued catalog topic deltas in arrival
+  // order, off the statestore heartbeat thread.
+  void CatalogUpdateThread();
+
+  // Catalog topic deltas queued for asynchronous application, in arrival order.
+  // Protected by catalog_update_queue_lock_. Only used with --async_catalog_update.
+  std::list<TTopicDelta> pending_catalog_updates_;
+
+  // Protects pending_catalog_updates_ and request_full_catalog_update_.
+  boost::mutex catalog_update_queue_lock_;
+
+  // Signalled when a delta is added to pending_catalog_updates_.
+  boost::condition_variable catalog_update_queue_cv_;
+
+  // Set when an asynchronously applied catalog update failed; the next catalog topic
+  // heartbeat requests a full topic update to recover.
+  bool request_full_catalog_update_;
+
+  // Thread applying queued catalog updates when --async_catalog_update is set.
+  boost::scoped_ptr<Thread> catalog_update_thread_;
+
+  // The materialized result of a completed read-only query, kept to serve repeated
+  // identical statements without re-executing them.
+  struct CachedQueryResult {
+    // Result rows in the form QueryExecState::FetchRowsInternal() can serve to both
+    // Beeswax and HS2 clients.
+    std::vector<TResultRow> rows;
+
+    // Estimated memory footprint of 'rows'.
+    int64_t byte_size;
+
+    // The catalog version the result was computed at. The entry is only served while
+    // this matches the current catalog version.
+    int64_t catalog_version;
+  };
+
+  // Protects query_result_cache_ and query_result_cache_bytes_. Must not be held while
+  // acquiring any other lock.
+  boost::mutex query_result_cache_lock_;
+
+  // Maps from "<user>\n<database>\n<statement>" to the cached result of that statement.
+  // Bounded by --query_result_cache_max_bytes and cleared whenever the catalog version
+  // changes.
+  typedef boost::unordered_map<std::string, boost::shared_ptr<CachedQueryResult> >
+      QueryResultCache;
+  QueryResultCache query_result_cache_;
+
+  // Total estimated bytes of all entries in query_result_cache_.
+  int64_t query_result_cache_bytes_;
+
+  // Returns true and populates 'rows' if the result cache holds a result for 'key' that
+  // was computed at the current catalog version. Always sets 'catalog_version' to the
+  // current catalog version so that a result computed after a miss can be published
+  // with the version it was planned against.
+  bool LookupQueryResultCache(const std::string& key, std::vector<TResultRow>* rows,
+      int64_t* catalog_version);
+
+  // Adds the result 'rows' of a completed query to the result cache under 'key'.
+  // 'catalog_version' must be the version current when the query was planned; stale
+  // results are discarded. Evicts other entries as needed to stay within
+  // --query_result_cache_max_bytes; results larger than
+  // --query_result_cache_max_result_bytes are never added.
+  void AddToQueryResultCache(const std::string& key, int64_t catalog_version,
+      const std::vector<TResultRow>& rows, int64_t byte_size);
+
+  // The plan of a previously executed read-only query, kept to serve repeated
+  // identical statements without a frontend planning round trip.
+  struct CachedPlan {
+    // The exec request produced by the frontend. The embedded query context belongs
+    // to the query that was planned and must be replaced before reuse.
+    TExecRequest exec_request;
+
+    // The catalog version the plan was created at. The entry is only served while
+    // this matches the current catalog version.
+    int64_t catalog_version;
+  };
+
+  // Protects plan_cache_. Must not be held while acquiring any other lock.
+  boost::mutex plan_cache_lock_;
+
+  // Maps from "<user>\n<database>\n<statement>\n<query options>" to the cached plan
+  // of that statement. Bounded by --plan_cache_max_entries and cleared whenever the
+  // catalog version changes.
+  typedef boost::unordered_map<std::string, boost::shared_ptr<CachedPlan> > PlanCache;
+  PlanCache plan_cache_;
+
+  // Returns true and populates 'exec_request' if the plan cache holds a plan for 'key'
+  // that was created at the current catalog version. Always sets 'catalog_version' to
+  // the current catalog version so that a plan created after a miss can be published
+  // with the version it was planned against.
+  bool LookupPlanCache(const std::string& key, TExecRequest* exec_request,
+      int64_t* catalog_version);
+
+  // Adds the plan of a successfully planned query to the plan cache under 'key'.
+  // 'catalog_version' must be the version current when planning started; stale plans
+  // are discarded. Evicts other entries as needed to stay within
+  // --plan_cache_max_entries.
+  void AddToPlanCache(const std::string& key, int64_t catalog_version,
+      const TExecRequest& exec_request);
+
   // Map of short usernames of authorized proxy users to the set of user(s) they are
   // allowed to delegate to. Populated by parsing the --authorized_proxy_users_config
   // flag.
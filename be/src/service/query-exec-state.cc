@@ -14,6 +14,7 @@
 
 #include "service/query-exec-state.h"
 
+#include <algorithm>
 #include <limits>
 #include <gutil/strings/substitute.h>
 
@@ -32,6 +33,7 @@
 #include "gen-cpp/CatalogService_types.h"
 
 #include <thrift/Thrift.h>
+#include <thrift/protocol/TDebugProtocol.h>
 
 using namespace std;
 using namespace boost;
@@ -45,6 +47,15 @@ DECLARE_int32(catalog_service_port);
 DECLARE_string(catalog_service_host);
 DECLARE_bool(enable_rm);
 DECLARE_int64(max_result_cache_size);
+DECLARE_int32(max_query_retries);
+DECLARE_int64(query_result_cache_max_bytes);
+DECLARE_int64(query_result_cache_max_result_bytes);
+
+DEFINE_int64(results_spool_max_bytes, 0, "(Advanced) If positive, query results are "
+    "spooled server-side: a dedicated thread drains the coordinator into a bounded "
+    "buffer of this many bytes so the fragment pipeline is not throttled by the "
+    "client's fetch cadence, and fetches are served from the buffer. 0 disables "
+    "result spooling.");
 
 namespace impala {
 
@@ -60,6 +71,9 @@ ImpalaServer::QueryExecState::QueryExecState(
   : query_ctx_(query_ctx),
     last_active_time_(numeric_limits<int64_t>::max()),
     ref_count_(0L),
+    coord_drives_wait_(false),
+    wait_started_(false),
+    wait_complete_(false),
     exec_env_(exec_env),
     session_(session),
     schedule_(NULL),
@@ -73,6 +87,14 @@ ImpalaServer::QueryExecState::QueryExecState(
     current_batch_(NULL),
     current_batch_row_(0),
     num_rows_fetched_(0),
+    retry_pending_(false),
+    num_retries_(0),
+    server_result_cache_catalog_version_(0),
+    server_result_cache_bytes_(0),
+    spooled_bytes_(0),
+    spool_eos_(false),
+    spool_cancelled_(false),
+    spool_active_(false),
     frontend_(frontend),
     parent_server_(server),
     start_time_(TimestampValue::LocalTime()) {
@@ -108,6 +130,9 @@ ImpalaServer::QueryExecState::QueryExecState(
 
 ImpalaServer::QueryExecState::~QueryExecState() {
   DCHECK(wait_thread_.get() == NULL) << "BlockOnWait() needs to be called!";
+  DCHECK(spool_thread_.get() == NULL) << "StopResultSpool() needs to be called!";
+  BOOST_FOREACH(Coordinator* coord, retired_coords_) delete coord;
+  BOOST_FOREACH(QuerySchedule* schedule, retired_schedules_) delete schedule;
 }
 
 Status ImpalaServer::QueryExecState::SetResultCache(QueryResultSet* cache,
@@ -136,6 +161,10 @@ Status ImpalaServer::QueryExecState::Exec(TExecRequest* exec_request) {
     case TStmtType::QUERY:
     case TStmtType::DML:
       DCHECK(exec_request_.__isset.query_exec_request);
+      if (exec_request_.stmt_type == TStmtType::QUERY && InitServerResultCache()) {
+        // The result was served from the query result cache; nothing to execute.
+        return Status::OK;
+      }
       return ExecQueryOrDmlRequest(exec_request_.query_exec_request);
     case TStmtType::EXPLAIN: {
       request_result_set_.reset(new vector<TResultRow>(
@@ -202,6 +231,82 @@ Status ImpalaServer::QueryExecState::Exec(TExecRequest* exec_request) {
   }
 }
 
+// Conservatively determines whether a statement's result may be reused by later
+// executions of the same statement text. Statements referencing builtins whose value
+// changes between executions must not be served from the cache. This is a textual
+// check; it errs on the side of not caching.
+static bool IsResultCacheableStmt(const string& stmt) {
+  static const char* NON_DETERMINISTIC_FNS[] = { "now(", "rand(", "random(", "uuid(",
+      "unix_timestamp(", "current_timestamp(", "utc_timestamp(", "sleep(", "pid(" };
+  string stmt_lower(stmt);
+  transform(stmt_lower.begin(), stmt_lower.end(), stmt_lower.begin(), ::tolower);
+  for (int i = 0; i < sizeof(NON_DETERMINISTIC_FNS) / sizeof(char*); ++i) {
+    if (stmt_lower.find(NON_DETERMINISTIC_FNS[i]) != string::npos) return false;
+  }
+  return true;
+}
+
+bool ImpalaServer::QueryExecState::InitServerResultCache() {
+  if (FLAGS_query_result_cache_max_bytes <= 0) return false;
+  if (!IsResultCacheableStmt(sql_stmt())) return false;
+  // Query options such as DEFAULT_ORDER_BY_LIMIT change the rows an identical
+  // statement returns, so they are part of the key, as in the plan cache.
+  server_result_cache_key_ = Substitute("$0\n$1\n$2\n$3", effective_user(),
+      default_db(), sql_stmt(), ThriftDebugString(query_ctx_.request.query_options));
+  vector<TResultRow> rows;
+  if (parent_server_->LookupQueryResultCache(server_result_cache_key_, &rows,
+      &server_result_cache_catalog_version_)) {
+    request_result_set_.reset(new vector<TResultRow>());
+    request_result_set_->swap(rows);
+    summary_profile_.AddInfoString("Served From Result Cache", "true");
+    query_events_->MarkEvent("Result served from cache");
+    // Don't publish the result again.
+    server_result_cache_key_.clear();
+    return true;
+  }
+  server_result_cache_rows_.reset(new vector<TResultRow>());
+  return false;
+}
+
+// Estimated memory footprint of 'row', used for spool and result cache accounting.
+static int64_t ResultRowByteSize(const TResultRow& row) {
+  int64_t byte_size = 0;
+  for (int i = 0; i < row.colVals.size(); ++i) {
+    byte_size += sizeof(TColumnValue) + row.colVals[i].string_val.size();
+  }
+  return byte_size;
+}
+
+void ImpalaServer::QueryExecState::ConvertRowToResult(TupleRow* row,
+    TResultRow* result) {
+  result->__isset.colVals = true;
+  result->colVals.resize(output_expr_ctxs_.size());
+  for (int i = 0; i < output_expr_ctxs_.size(); ++i) {
+    output_expr_ctxs_[i]->GetValue(row, false, &result->colVals[i]);
+  }
+}
+
+void ImpalaServer::QueryExecState::CaptureServerResultCacheRow(TupleRow* row) {
+  server_result_cache_rows_->push_back(TResultRow());
+  TResultRow& t_row = server_result_cache_rows_->back();
+  ConvertRowToResult(row, &t_row);
+  server_result_cache_bytes_ += ResultRowByteSize(t_row);
+  if (server_result_cache_bytes_ > FLAGS_query_result_cache_max_result_bytes) {
+    // The result is too large to cache; abandon the capture.
+    server_result_cache_rows_.reset();
+  }
+}
+
+void ImpalaServer::QueryExecState::PublishServerResultCache() {
+  if (server_result_cache_rows_.get() == NULL) return;
+  DCHECK(eos_);
+  DCHECK(!server_result_cache_key_.empty());
+  parent_server_->AddToQueryResultCache(server_result_cache_key_,
+      server_result_cache_catalog_version_, *server_result_cache_rows_,
+      server_result_cache_bytes_);
+  server_result_cache_rows_.reset();
+}
+
 Status ImpalaServer::QueryExecState::ExecLocalCatalogOp(
     const TCatalogOpRequest& catalog_op) {
   switch (catalog_op.op_type) {
@@ -340,6 +445,12 @@ Status ImpalaServer::QueryExecState::ExecQueryOrDmlRequest(
     const TQueryExecRequest& query_exec_request) {
   // we always need at least one plan fragment
   DCHECK_GT(query_exec_request.fragments.size(), 0);
+  // TODO: Queries that are fully answerable from catalog metadata (e.g.
+  // count(*) from table stats, or min/max over partition key values) could be served
+  // here via request_result_set_ without creating a coordinator or scheduling
+  // fragments. That requires the planner to mark such requests and attach the stats,
+  // since table and partition statistics are not part of the exec request; the backend
+  // cannot soundly re-derive them from the plan shape alone.
 
   if (query_exec_request.__isset.query_plan) {
     stringstream plan_ss;
@@ -490,6 +601,9 @@ void ImpalaServer::QueryExecState::Done() {
   // Make sure we join on wait_thread_ before we finish (and especially before this object
   // is destroyed).
   BlockOnWait();
+  // The spool thread uses the coordinator and the output exprs; stop it before they are
+  // torn down below.
+  StopResultSpool();
   unique_lock<mutex> l(lock_);
   end_time_ = TimestampValue::LocalTime();
   summary_profile_.AddInfoString("End Time", end_time().DebugString());
@@ -498,6 +612,13 @@ void ImpalaServer::QueryExecState::Done() {
 
   if (coord_.get() != NULL) {
     Expr::Close(output_expr_ctxs_, coord_->runtime_state());
+    // Make the observed peak memory consumption available to the admission
+    // controller so it can refine the estimates of future executions of this
+    // statement. Failed and cancelled queries are skipped; their peak is not
+    // representative of a complete execution.
+    if (query_status_.ok()) {
+      schedule_->set_per_host_peak_mem_usage(coord_->GetMaxPerHostPeakMemUsage());
+    }
     // Release any reserved resources.
     Status status = exec_env_->scheduler()->Release(schedule_.get());
     if (!status.ok()) {
@@ -523,20 +644,63 @@ Status ImpalaServer::QueryExecState::Exec(const TMetadataOpRequest& exec_request
 }
 
 void ImpalaServer::QueryExecState::WaitAsync() {
+  // Queries without a coordinator fragment spend their entire runtime parked in
+  // Coordinator::WaitForAllBackends(), which is woken by the final fragment status
+  // report. Let that report drive completion through the server's shared wait thread
+  // pool instead of dedicating a thread per query. Queries with child queries are
+  // excluded because WaitForChildQueries() also blocks.
+  if (coord_.get() != NULL && !coord_->has_coordinator_fragment() &&
+      child_queries_.empty()) {
+    coord_drives_wait_ = true;
+    coord_->SetCompletionCallback(
+        bind(&ImpalaServer::EnqueueWaitCompletion, parent_server_, query_id()));
+    return;
+  }
   wait_thread_.reset(new Thread(
       "query-exec-state", "wait-thread", &ImpalaServer::QueryExecState::Wait, this));
 }
 
+void ImpalaServer::QueryExecState::CompleteWait() {
+  DCHECK(coord_drives_wait_);
+  {
+    lock_guard<mutex> l(wait_state_lock_);
+    if (wait_started_) return;
+    wait_started_ = true;
+  }
+  Wait();
+}
+
 void ImpalaServer::QueryExecState::BlockOnWait() {
   if (wait_thread_.get() != NULL) {
     wait_thread_->Join();
     wait_thread_.reset();
+    return;
+  }
+  if (!coord_drives_wait_) return;
+  unique_lock<mutex> l(wait_state_lock_);
+  if (!wait_started_) {
+    // The completion callback hasn't run Wait() yet; this can happen if the query was
+    // unregistered before the thread pool got to it, or if a client blocks before the
+    // query completes. Run the wait work on this thread, exactly as if we had joined a
+    // dedicated wait thread.
+    wait_started_ = true;
+    l.unlock();
+    Wait();
+    return;
   }
+  while (!wait_complete_) wait_complete_cv_.wait(l);
 }
 
 void ImpalaServer::QueryExecState::Wait() {
   // block until results are ready
   Status status = WaitInternal();
+  // If an executing backend was lost from the cluster, transparently re-execute the
+  // query and block on the new attempt. Clients blocked in BlockOnWait() do not observe
+  // the failed attempt.
+  while (!status.ok() && ShouldRetry()) {
+    status = Retry(status);
+    if (status.ok()) status = WaitInternal();
+  }
   {
     lock_guard<mutex> l(lock_);
     if (returns_result_set()) {
@@ -548,6 +712,14 @@ void ImpalaServer::QueryExecState::Wait() {
   }
   if (status.ok()) {
     UpdateQueryState(QueryState::FINISHED);
+    // Rows are available; start draining them into the spool (if enabled) so the
+    // fragment pipeline does not wait on the client's fetch cadence.
+    StartResultSpool();
+  }
+  {
+    lock_guard<mutex> l(wait_state_lock_);
+    wait_complete_ = true;
+    wait_complete_cv_.notify_all();
   }
 }
 
@@ -585,6 +757,139 @@ Status ImpalaServer::QueryExecState::WaitInternal() {
   return Status::OK;
 }
 
+void ImpalaServer::QueryExecState::MarkRetryableFailure() {
+  lock_guard<mutex> l(lock_);
+  // Only plain read-only queries qualify: DML and DDL side effects cannot be redone
+  // safely, and a query that has already returned rows to the client cannot restart its
+  // result stream.
+  if (stmt_type() != TStmtType::QUERY) return;
+  if (coord_.get() == NULL || eos_ || num_rows_fetched_ > 0) return;
+  if (num_retries_ >= FLAGS_max_query_retries) return;
+  retry_pending_ = true;
+}
+
+bool ImpalaServer::QueryExecState::ShouldRetry() {
+  lock_guard<mutex> l(lock_);
+  return retry_pending_;
+}
+
+Status ImpalaServer::QueryExecState::Retry(const Status& cause) {
+  DCHECK(coord_.get() != NULL);
+  {
+    lock_guard<mutex> l(lock_);
+    DCHECK(retry_pending_);
+    retry_pending_ = false;
+    ++num_retries_;
+    // Clear the failed attempt's error so the new attempt starts from a clean slate.
+    // Clients polling for the query state keep seeing a running query.
+    query_status_ = Status::OK;
+    if (query_state_ == QueryState::EXCEPTION) query_state_ = QueryState::RUNNING;
+    summary_profile_.AddInfoString("Query Status", "OK");
+    summary_profile_.AddInfoString("Retry Cause", cause.GetDetail());
+  }
+  query_events_->MarkEvent(Substitute("Retry $0 started", num_retries_));
+  VLOG_QUERY << "Re-executing query " << PrintId(query_id())
+             << " after: " << cause.GetDetail();
+
+  // Tear down the failed attempt. The old schedule and coordinator are retired rather
+  // than destroyed because profile_ references the coordinator's profile tree.
+  Expr::Close(output_expr_ctxs_, coord_->runtime_state());
+  output_expr_ctxs_.clear();
+  Status release_status = exec_env_->scheduler()->Release(schedule_.get());
+  if (!release_status.ok()) {
+    LOG(WARNING) << "Failed to release resources of query " << schedule_->query_id()
+                 << " because of error: " << release_status.GetDetail();
+  }
+  retired_schedules_.push_back(schedule_.release());
+  retired_coords_.push_back(coord_.release());
+
+  // Re-run scheduling and fragment startup. The scheduler's membership view no longer
+  // contains the failed backend, so the new attempt avoids it.
+  return ExecQueryOrDmlRequest(exec_request_.query_exec_request);
+}
+
+void ImpalaServer::QueryExecState::StartResultSpool() {
+  if (FLAGS_results_spool_max_bytes <= 0) return;
+  if (stmt_type() != TStmtType::QUERY) return;
+  // Queries without a coordinator (e.g. LIMIT 0) and queries whose result was already
+  // materialized have nothing to spool.
+  if (coord_.get() == NULL || request_result_set_ != NULL) return;
+  // Restartable fetches (FETCH_FIRST) re-serve rows from result_cache_; keep them on
+  // the non-spooled fetch path so the cache sees every fetched row.
+  if (result_cache_max_size_ > 0) return;
+  spool_active_ = true;
+  spool_thread_.reset(new Thread("query-exec-state", "result-spool",
+      &ImpalaServer::QueryExecState::SpoolThread, this));
+}
+
+void ImpalaServer::QueryExecState::StopResultSpool() {
+  if (spool_thread_.get() == NULL) return;
+  {
+    lock_guard<mutex> l(spool_lock_);
+    spool_cancelled_ = true;
+    spool_cv_.notify_all();
+  }
+  // If the spool thread is blocked in Coordinator::GetNext(), cancelling the
+  // coordinator unblocks it. Cancel() has already been called on the teardown path,
+  // but be defensive.
+  if (coord_.get() != NULL) coord_->Cancel();
+  spool_thread_->Join();
+  spool_thread_.reset();
+}
+
+void ImpalaServer::QueryExecState::SpoolThread() {
+  Status status;
+  while (true) {
+    RowBatch* batch = NULL;
+    status = coord_->GetNext(&batch, coord_->runtime_state());
+    if (!status.ok() || batch == NULL) break;
+
+    // Convert the batch before taking spool_lock_ so fetches are never blocked on row
+    // materialization.
+    vector<TResultRow> rows(batch->num_rows());
+    int64_t batch_bytes = 0;
+    {
+      SCOPED_TIMER(row_materialization_timer_);
+      for (int i = 0; i < batch->num_rows(); ++i) {
+        ConvertRowToResult(batch->GetRow(i), &rows[i]);
+        batch_bytes += ResultRowByteSize(rows[i]);
+      }
+    }
+    ExprContext::FreeLocalAllocations(output_expr_ctxs_);
+
+    // Capture the rows for the server-wide result cache here; the capture hook in
+    // FetchRowsInternal() is bypassed for spooled queries. Publishing happens on the
+    // fetch path once the client has drained the stream.
+    if (server_result_cache_rows_.get() != NULL) {
+      server_result_cache_rows_->insert(server_result_cache_rows_->end(), rows.begin(),
+          rows.end());
+      server_result_cache_bytes_ += batch_bytes;
+      if (server_result_cache_bytes_ > FLAGS_query_result_cache_max_result_bytes) {
+        // The result is too large to cache; abandon the capture.
+        server_result_cache_rows_.reset();
+      }
+    }
+
+    unique_lock<mutex> l(spool_lock_);
+    // Block until the client has drained enough rows. A batch larger than the entire
+    // bound is admitted once the spool is empty so the query always makes progress.
+    while (spooled_bytes_ + batch_bytes > FLAGS_results_spool_max_bytes &&
+        !spooled_rows_.empty() && !spool_cancelled_) {
+      spool_cv_.wait(l);
+    }
+    if (spool_cancelled_) break;
+    spooled_rows_.insert(spooled_rows_.end(), rows.begin(), rows.end());
+    spooled_bytes_ += batch_bytes;
+    spool_cv_.notify_all();
+  }
+  {
+    lock_guard<mutex> l(spool_lock_);
+    spool_status_ = status;
+    spool_eos_ = true;
+    spool_cv_.notify_all();
+  }
+}
+
 Status ImpalaServer::QueryExecState::FetchRows(const int32_t max_rows,
     QueryResultSet* fetched_rows) {
   // Pause the wait timer, since the client has instructed us to do work on its behalf.
@@ -613,6 +918,8 @@ Status ImpalaServer::QueryExecState::RestartFetch() {
   // Reset fetch state to start over.
   eos_ = false;
   num_rows_fetched_ = 0;
+  // A restarted fetch would capture rows twice; abandon the capture.
+  server_result_cache_rows_.reset();
   return Status::OK;
 }
 
@@ -653,6 +960,10 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
     return Status::OK;
   }
 
+  // Spooled queries are served from the spool; the coordinator is drained by the spool
+  // thread. Spooling is never enabled together with the fetch-restart result cache.
+  if (spool_active_) return FetchRowsFromSpool(max_rows, fetched_rows);
+
   int32_t num_rows_fetched_from_cache = 0;
   if (result_cache_max_size_ > 0 && result_cache_ != NULL) {
     // Satisfy the fetch from the result cache if possible.
@@ -683,7 +994,11 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
   if (current_batch_ == NULL || current_batch_row_ >= current_batch_->num_rows()) {
     RETURN_IF_ERROR(FetchNextBatch());
   }
-  if (current_batch_ == NULL) return Status::OK;
+  if (current_batch_ == NULL) {
+    // All rows have been returned; the complete result can now be cached.
+    if (eos_ && query_status_.ok()) PublishServerResultCache();
+    return Status::OK;
+  }
 
   // Maximum number of rows to be fetched from the coord.
   int32_t max_coord_rows = max_rows;
@@ -698,12 +1013,23 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
     int fetched_count = available;
     // max_coord_rows <= 0 means no limit
     if (max_coord_rows > 0 && max_coord_rows < available) fetched_count = max_coord_rows;
-    for (int i = 0; i < fetched_count; ++i) {
-      TupleRow* row = current_batch_->GetRow(current_batch_row_);
-      RETURN_IF_ERROR(GetRowValue(row, &result_row, &scales));
-      RETURN_IF_ERROR(fetched_rows->AddOneRow(result_row, scales));
-      ++num_rows_fetched_;
-      ++current_batch_row_;
+    // Columnar result sets convert whole column runs at a time, keeping the per-value
+    // type dispatch out of the inner loop. The row-at-a-time path remains for
+    // row-oriented result sets and while capturing rows for the server result cache.
+    if (server_result_cache_rows_.get() == NULL &&
+        fetched_rows->AddRowBatch(output_expr_ctxs_, current_batch_, current_batch_row_,
+            fetched_count)) {
+      num_rows_fetched_ += fetched_count;
+      current_batch_row_ += fetched_count;
+    } else {
+      for (int i = 0; i < fetched_count; ++i) {
+        TupleRow* row = current_batch_->GetRow(current_batch_row_);
+        RETURN_IF_ERROR(GetRowValue(row, &result_row, &scales));
+        RETURN_IF_ERROR(fetched_rows->AddOneRow(result_row, scales));
+        if (server_result_cache_rows_.get() != NULL) CaptureServerResultCacheRow(row);
+        ++num_rows_fetched_;
+        ++current_batch_row_;
+      }
     }
   }
   ExprContext::FreeLocalAllocations(output_expr_ctxs_);
@@ -780,6 +1106,14 @@ void ImpalaServer::QueryExecState::Cancel(const Status* cause) {
     child_query.Cancel();
   }
 
+  {
+    // Wake a spool thread blocked waiting for the client to drain rows, and any fetch
+    // blocked waiting for spooled rows.
+    lock_guard<mutex> l(spool_lock_);
+    spool_cancelled_ = true;
+    spool_cv_.notify_all();
+  }
+
   // If the query is completed or cancelled, no need to cancel.
   if (eos_ || query_state_ == QueryState::EXCEPTION) return;
 
@@ -869,6 +1203,53 @@ Status ImpalaServer::QueryExecState::FetchNextBatch() {
   return Status::OK;
 }
 
+Status ImpalaServer::QueryExecState::FetchRowsFromSpool(const int32_t max_rows,
+    QueryResultSet* fetched_rows) {
+  query_state_ = QueryState::FINISHED;  // results will be ready after this call
+  vector<TResultRow> rows;
+  bool end_of_stream = false;
+  Status spool_status;
+
+  // Temporarily release lock so calls to Cancel() are not blocked while we wait for the
+  // spool thread to produce rows. fetch_rows_lock_ ensures single-threaded consumption.
+  lock_.unlock();
+  {
+    unique_lock<mutex> l(spool_lock_);
+    while (spooled_rows_.empty() && !spool_eos_ && !spool_cancelled_) {
+      spool_cv_.wait(l);
+    }
+    spool_status = spool_status_;
+    if (spool_status.ok()) {
+      // max_rows <= 0 means no limit
+      while ((max_rows <= 0 || static_cast<int32_t>(rows.size()) < max_rows) &&
+          !spooled_rows_.empty()) {
+        rows.push_back(spooled_rows_.front());
+        spooled_rows_.pop_front();
+        spooled_bytes_ -= ResultRowByteSize(rows.back());
+      }
+      // Wake the spool thread if it is blocked on a full spool.
+      spool_cv_.notify_all();
+    }
+    end_of_stream = spooled_rows_.empty() && spool_eos_;
+  }
+  lock_.lock();
+
+  // Check if the query was cancelled or failed while we were blocked.
+  if (!query_status_.ok()) return query_status_;
+  RETURN_IF_ERROR(spool_status);
+
+  BOOST_FOREACH(const TResultRow& row, rows) {
+    RETURN_IF_ERROR(fetched_rows->AddOneRow(row));
+    ++num_rows_fetched_;
+  }
+  if (end_of_stream) {
+    eos_ = true;
+    // All rows have been returned; the complete result can now be cached.
+    PublishServerResultCache();
+  }
+  return Status::OK;
+}
+
 void ImpalaServer::QueryExecState::SetResultSet(const vector<string>& results) {
   request_result_set_.reset(new vector<TResultRow>);
   request_result_set_->resize(results.size());
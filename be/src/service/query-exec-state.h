@@ -27,6 +27,7 @@
 
 #include <boost/thread.hpp>
 #include <boost/unordered_set.hpp>
+#include <deque>
 #include <vector>
 
 namespace impala {
@@ -46,7 +47,7 @@ class QueryExecStateCleaner;
 // servicing query-related requests from the client.
 // Thread safety: this class is generally not thread-safe, callers need to
 // synchronize access explicitly via lock().
-// To avoid deadlocks, the caller must *not* acquire query_exec_state_map_lock_
+// To avoid deadlocks, the caller must *not* acquire a query exec state map shard lock
 // while holding the exec state's lock.
 // TODO: Consider renaming to RequestExecState for consistency.
 // TODO: Compute stats is the only stmt that requires child queries. Once the
@@ -74,12 +75,26 @@ class ImpalaServer::QueryExecState {
   // by call to Exec(). Waits for all child queries to complete. Takes lock_.
   void Wait();
 
-  // Calls Wait() asynchronously in a thread and returns immediately.
+  // Arranges for Wait() to be run asynchronously and returns immediately. For queries
+  // without a coordinator fragment (e.g. a distributed INSERT), the entire wait
+  // consists of blocking until the final fragment status report arrives, so instead of
+  // parking a dedicated thread for the duration of the statement, the coordinator's
+  // completion callback hands the remaining work (finalization, catalog update) to the
+  // server's shared query wait thread pool. All other statements spawn a wait thread
+  // as before, since Coordinator::Wait() runs the coordinator fragment's Open() and
+  // genuinely needs a thread.
   void WaitAsync();
 
+  // Runs Wait() if no other thread has done so yet, otherwise returns immediately.
+  // Called from the server's query wait thread pool when the coordinator reports
+  // completion. Only valid if WaitAsync() chose the callback-driven path.
+  void CompleteWait();
+
   // BlockOnWait() may be called after WaitAsync() has been called in order to wait for
-  // the asynchronous thread to complete. It is safe to call this multiple times (only the
-  // first call will block). Do not call while holding lock_.
+  // the asynchronous wait work to complete. It is safe to call this multiple times
+  // (only the first call will block). Do not call while holding lock_. If the
+  // completion callback has not run Wait() yet (e.g. the query was unregistered before
+  // it fired), the wait work is performed on this thread instead.
   void BlockOnWait();
 
   // Return at most max_rows from the current batch. If the entire current batch has
@@ -120,6 +135,13 @@ class ImpalaServer::QueryExecState {
   // Does nothing if the query has reached EOS or already cancelled.
   void Cancel(const Status* cause = NULL);
 
+  // Called when a backend executing this query was lost from the cluster membership,
+  // just before the query is cancelled with the corresponding cause. If the query is
+  // eligible for transparent re-execution (a read-only query that has not returned any
+  // rows to the client, with retry attempts left), marks it to be retried by the waiting
+  // thread once the cancellation has unblocked it. Takes lock_.
+  void MarkRetryableFailure();
+
   // This is called when the query is done (finished, cancelled, or failed).
   // Takes lock_: callers must not hold lock() before calling.
   void Done();
@@ -211,9 +233,31 @@ class ImpalaServer::QueryExecState {
   // increased, and decreased once that work is completed.
   uint32_t ref_count_;
 
-  // Thread for asynchronously running Wait().
+  // Thread for asynchronously running Wait(). NULL if WaitAsync() chose the
+  // callback-driven path (see coord_drives_wait_).
   boost::scoped_ptr<Thread> wait_thread_;
 
+  // Protects coord_drives_wait_, wait_started_ and wait_complete_. A leaf lock: no
+  // other locks may be acquired while holding it.
+  boost::mutex wait_state_lock_;
+
+  // Signalled when Wait() finishes; BlockOnWait() waits on this in the callback-driven
+  // case. Tied to wait_state_lock_.
+  boost::condition_variable wait_complete_cv_;
+
+  // True if completion of the wait work is driven by the coordinator's completion
+  // callback rather than by a dedicated wait thread. Set at most once, in WaitAsync(),
+  // before clients can call BlockOnWait().
+  bool coord_drives_wait_;
+
+  // True once a thread has claimed the right to run Wait(). Ensures Wait() runs
+  // exactly once whether it is triggered by the completion callback, by BlockOnWait(),
+  // or by both racing.
+  bool wait_started_;
+
+  // True once Wait() has finished.
+  bool wait_complete_;
+
   boost::mutex lock_;  // protects all following fields
   ExecEnv* exec_env_;
 
@@ -281,6 +325,69 @@ class ImpalaServer::QueryExecState {
   int current_batch_row_; // number of rows fetched within the current batch
   int num_rows_fetched_; // number of rows fetched by client for the entire query
 
+  // True if a backend failure was flagged by MarkRetryableFailure() and the waiting
+  // thread has not picked up the retry yet.
+  bool retry_pending_;
+
+  // Number of times this query was transparently re-executed after a backend failure.
+  int num_retries_;
+
+  // Key of this query in the server-wide query result cache, or empty if the query does
+  // not participate in that cache (see --query_result_cache_max_bytes).
+  std::string server_result_cache_key_;
+
+  // The catalog version current when this query was submitted. Results published to the
+  // server-wide result cache are tagged with it so stale results are never served.
+  int64_t server_result_cache_catalog_version_;
+
+  // Rows captured for the server-wide result cache while the client fetches them. NULL
+  // if the query does not participate in the cache or the capture was abandoned (result
+  // exceeded --query_result_cache_max_result_bytes or the fetch was restarted).
+  boost::scoped_ptr<std::vector<TResultRow> > server_result_cache_rows_;
+
+  // Estimated bytes of server_result_cache_rows_.
+  int64_t server_result_cache_bytes_;
+
+  // Schedules and coordinators of failed attempts that were transparently retried.
+  // Their resources are released when the attempt is retired, but the objects are kept
+  // alive until destruction because profile_ references the coordinators' profile trees.
+  std::vector<QuerySchedule*> retired_schedules_;
+  std::vector<Coordinator*> retired_coords_;
+
+  // Server-side result spooling (see --results_spool_max_bytes). spool_thread_ drains
+  // the coordinator into spooled_rows_ as fast as the byte bound allows, so the
+  // fragment pipeline is not throttled by the client's fetch cadence.
+  boost::scoped_ptr<Thread> spool_thread_;
+
+  // Protects the spool fields below. This is a leaf lock: it must not be held while
+  // acquiring any other lock, and lock_ must be released before blocking on spool_cv_.
+  boost::mutex spool_lock_;
+
+  // Signalled when rows are added to or removed from spooled_rows_, when the spool
+  // thread finishes, and on cancellation.
+  boost::condition_variable spool_cv_;
+
+  // Converted result rows produced by the spool thread and not yet fetched.
+  std::deque<TResultRow> spooled_rows_;
+
+  // Estimated bytes of spooled_rows_. The spool thread blocks once this exceeds
+  // --results_spool_max_bytes until the client drains rows.
+  int64_t spooled_bytes_;
+
+  // True once the spool thread has produced its last row (end of stream, error or
+  // cancellation). spool_status_ holds the first error it encountered, if any.
+  bool spool_eos_;
+  Status spool_status_;
+
+  // Set by Cancel() and StopResultSpool() to unblock a spool thread that is waiting
+  // for the client to drain rows.
+  bool spool_cancelled_;
+
+  // True once StartResultSpool() has launched the spool thread. Set by the waiting
+  // thread before clients can fetch and never reset, so the fetch path may read it
+  // without spool_lock_.
+  bool spool_active_;
+
   // To get access to UpdateCatalog, LOAD, and DDL methods. Not owned.
   Frontend* frontend_;
 
@@ -313,6 +420,27 @@ class ImpalaServer::QueryExecState {
   // actively processed. Takes expiration_data_lock_.
   void MarkActive();
 
+  // Checks the server-wide query result cache for this query's statement. On a hit,
+  // populates request_result_set_ with the cached rows so subsequent fetches are served
+  // without executing the query, and returns true. On a miss, starts capturing result
+  // rows so that the completed result can be published to the cache, and returns false.
+  // Returns false without side effects if the cache is disabled or the statement is not
+  // cacheable (e.g. it references non-deterministic builtins).
+  bool InitServerResultCache();
+
+  // Evaluates 'output_expr_ctxs_' against 'row' and stores the typed column values in
+  // 'result'.
+  void ConvertRowToResult(TupleRow* row, TResultRow* result);
+
+  // Converts 'row' to a TResultRow and appends it to server_result_cache_rows_.
+  // Abandons the capture if the accumulated result grows beyond
+  // --query_result_cache_max_result_bytes.
+  void CaptureServerResultCacheRow(TupleRow* row);
+
+  // Publishes the captured result rows to the server-wide result cache. Called once all
+  // rows have been returned to the client. No-op if the capture was abandoned.
+  void PublishServerResultCache();
+
   // Core logic of initiating a query or dml execution request.
   // Initiates execution of plan fragments, if there are any, and sets
   // up the output exprs for subsequent calls to FetchRows().
@@ -330,6 +458,38 @@ class ImpalaServer::QueryExecState {
   // Core logic of Wait(). Does not update query_state_/status_.
   Status WaitInternal();
 
+  // Returns true if a transparent re-execution of this query is pending. Takes lock_.
+  bool ShouldRetry();
+
+  // Transparently re-executes this query after a backend failure, re-running scheduling
+  // and fragment startup against the current cluster membership (which no longer
+  // contains the failed backend). 'cause' is the error the failed attempt finished
+  // with. Resets query_status_/query_state_ so clients never observe the failure, and
+  // retires the failed attempt's schedule and coordinator. Only called by the waiting
+  // thread, before any rows have been fetched. Returns an error (and updates
+  // query_status_) if starting the new attempt fails.
+  Status Retry(const Status& cause);
+
+  // Launches spool_thread_ if this query is eligible for result spooling (see
+  // --results_spool_max_bytes). Called by the waiting thread once rows are available,
+  // before clients can fetch.
+  void StartResultSpool();
+
+  // Unblocks and joins spool_thread_, if any. Called during Done() so the coordinator
+  // and the output exprs can be torn down safely. Must not be called with lock_ held.
+  void StopResultSpool();
+
+  // Run by spool_thread_: fetches batches from the coordinator, converts them to
+  // TResultRows and appends them to spooled_rows_, blocking while the spool holds more
+  // than --results_spool_max_bytes. Consuming batches eagerly lets the fragment
+  // pipeline release resources without waiting for the client to fetch.
+  void SpoolThread();
+
+  // Serves a fetch from spooled_rows_, blocking until rows are available or the spool
+  // thread reaches end of stream. Caller needs to hold fetch_rows_lock_ and lock_;
+  // lock_ is released while blocking, like in FetchNextBatch().
+  Status FetchRowsFromSpool(const int32_t max_rows, QueryResultSet* fetched_rows);
+
   // Core logic of FetchRows(). Does not update query_state_/status_.
   // Caller needs to hold fetch_rows_lock_ and lock_.
   Status FetchRowsInternal(const int32_t max_rows, QueryResultSet* fetched_rows);
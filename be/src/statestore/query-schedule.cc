@@ -69,6 +69,8 @@ QuerySchedule::QuerySchedule(const TUniqueId& query_id,
     num_backends_(0),
     num_hosts_(0),
     num_scan_ranges_(0),
+    refined_per_host_mem_estimate_(-1),
+    per_host_peak_mem_usage_(-1),
     is_admitted_(false) {
   fragment_exec_params_.resize(request.fragments.size());
   // map from plan node id to fragment index in exec_request.fragments
@@ -111,6 +113,15 @@ int64_t QuerySchedule::GetPerHostMemoryEstimate() const {
     has_estimate = true;
   }
 
+  // A refined estimate derived by the admission controller from the observed peak
+  // consumption of past executions replaces the planner's estimate. It never
+  // overrides the explicit user-provided limits considered first below.
+  if (refined_per_host_mem_estimate_ > 0 &&
+      refined_per_host_mem_estimate_ < estimate_limit) {
+    estimate_limit = refined_per_host_mem_estimate_;
+    has_estimate = true;
+  }
+
   int64_t per_host_mem = 0L;
   if (query_options_.__isset.rm_initial_mem && query_options_.rm_initial_mem > 0) {
     per_host_mem = query_options_.rm_initial_mem;
@@ -96,6 +96,20 @@ class QuerySchedule {
   int64_t GetClusterMemoryEstimate() const;
   void GetResourceHostport(const TNetworkAddress& src, TNetworkAddress* dst);
 
+  // Sets a refined per-host memory estimate (bytes) derived by the admission
+  // controller from the observed peak consumption of past executions of the same
+  // statement. Only consulted by GetPerHostMemoryEstimate() where the planner's
+  // estimate would be used; explicit user-provided limits take precedence.
+  void set_refined_per_host_mem_estimate(int64_t bytes) {
+    refined_per_host_mem_estimate_ = bytes;
+  }
+
+  // The highest peak memory consumption (bytes) reported by any single backend while
+  // executing this schedule, or -1 if unknown. Set by the coordinator before the
+  // schedule is released so the admission controller can record it as feedback.
+  int64_t per_host_peak_mem_usage() const { return per_host_peak_mem_usage_; }
+  void set_per_host_peak_mem_usage(int64_t bytes) { per_host_peak_mem_usage_ = bytes; }
+
   // Helper methods used by scheduler to populate this QuerySchedule.
   void AddScanRanges(int64_t delta) { num_scan_ranges_ += delta; }
   void set_num_backends(int64_t num_backends) { num_backends_ = num_backends; }
@@ -157,6 +171,13 @@ class QuerySchedule {
   // Total number of scan ranges of this query.
   int64_t num_scan_ranges_;
 
+  // Refined estimate set by the admission controller, <= 0 if not set.
+  // See set_refined_per_host_mem_estimate().
+  int64_t refined_per_host_mem_estimate_;
+
+  // See per_host_peak_mem_usage().
+  int64_t per_host_peak_mem_usage_;
+
   // Request pool to which the request was submitted for admission.
   std::string request_pool_;
 
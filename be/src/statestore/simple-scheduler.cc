@@ -38,9 +38,13 @@
 #include "util/container-util.h"
 #include "util/debug-util.h"
 #include "util/error-util.h"
+#include "util/impalad-metrics.h"
 #include "util/llama-util.h"
 #include "util/mem-info.h"
 #include "util/parse-util.h"
+#include "util/runtime-profile.h"
+#include "util/string-parser.h"
+#include "util/time.h"
 #include "gen-cpp/ResourceBrokerService_types.h"
 
 using namespace std;
@@ -63,6 +67,21 @@ DEFINE_bool(require_username, false, "Requires that a user be provided in order
     "rejected, otherwise requests without a username will be submitted with the "
     "username 'default'.");
 
+DEFINE_int64(cache_affinity_timeout_ms, 0, "(Advanced) If positive, the scheduler "
+    "remembers which data node each scan range was last assigned to and prefers that "
+    "replica again while the previous assignment is at most this many milliseconds "
+    "old, on the assumption that the node still holds the data in the OS page cache. "
+    "0 disables cache-affinity placement.");
+
+DEFINE_int64(cache_affinity_max_entries, 100 * 1024, "(Advanced) Maximum number of "
+    "scan ranges for which the scheduler tracks cache-affinity assignments. Only used "
+    "if --cache_affinity_timeout_ms is positive.");
+
+DEFINE_int64(scheduler_load_penalty_bytes, 0, "(Advanced) If positive, replica "
+    "selection is biased away from busy backends: every in-flight plan fragment a "
+    "backend last published via the statestore load topic adds this many bytes to its "
+    "apparent scan load. 0 disables load-aware scheduling.");
+
 namespace impala {
 
 static const string LOCAL_ASSIGNMENTS_KEY("simple-scheduler.local-assignments.total");
@@ -75,6 +94,7 @@ static const string BACKENDS_WEB_PAGE = "/backends";
 static const string BACKENDS_TEMPLATE = "backends.tmpl";
 
 const string SimpleScheduler::IMPALA_MEMBERSHIP_TOPIC("impala-membership");
+const string SimpleScheduler::IMPALA_LOAD_TOPIC("impala-backend-load");
 
 static const string ERROR_USER_TO_POOL_MAPPING_NOT_FOUND(
     "No mapping found for request from user '$0' with requested pool '$1'");
@@ -87,7 +107,8 @@ SimpleScheduler::SimpleScheduler(StatestoreSubscriber* subscriber,
     const string& backend_id, const TNetworkAddress& backend_address,
     MetricGroup* metrics, Webserver* webserver, ResourceBroker* resource_broker,
     RequestPoolService* request_pool_service)
-  : metrics_(metrics->GetChildGroup("scheduler")),
+  : last_published_load_(-1),
+    metrics_(metrics->GetChildGroup("scheduler")),
     webserver_(webserver),
     statestore_subscriber_(subscriber),
     backend_id_(backend_id),
@@ -130,7 +151,8 @@ SimpleScheduler::SimpleScheduler(StatestoreSubscriber* subscriber,
 SimpleScheduler::SimpleScheduler(const vector<TNetworkAddress>& backends,
     MetricGroup* metrics, Webserver* webserver, ResourceBroker* resource_broker,
     RequestPoolService* request_pool_service)
-  : metrics_(metrics),
+  : last_published_load_(-1),
+    metrics_(metrics),
     webserver_(webserver),
     statestore_subscriber_(NULL),
     thrift_serializer_(false),
@@ -196,6 +218,15 @@ Status SimpleScheduler::Init() {
       status.AddDetail("SimpleScheduler failed to register membership topic");
       return status;
     }
+    if (FLAGS_scheduler_load_penalty_bytes > 0) {
+      StatestoreSubscriber::UpdateCallback load_cb =
+          bind<void>(mem_fn(&SimpleScheduler::UpdateBackendLoad), this, _1, _2);
+      status = statestore_subscriber_->AddTopic(IMPALA_LOAD_TOPIC, true, load_cb);
+      if (!status.ok()) {
+        status.AddDetail("SimpleScheduler failed to register load topic");
+        return status;
+      }
+    }
     if (!FLAGS_disable_admission_control) {
       RETURN_IF_ERROR(admission_controller_->Init(statestore_subscriber_));
     }
@@ -361,6 +392,60 @@ void SimpleScheduler::UpdateMembership(
   }
 }
 
+void SimpleScheduler::UpdateBackendLoad(
+    const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
+    vector<TTopicDelta>* subscriber_topic_updates) {
+  StatestoreSubscriber::TopicDeltaMap::const_iterator topic =
+      incoming_topic_deltas.find(IMPALA_LOAD_TOPIC);
+  if (topic != incoming_topic_deltas.end()) {
+    const TTopicDelta& delta = topic->second;
+    lock_guard<mutex> lock(backend_load_lock_);
+    if (!delta.is_delta) backend_load_map_.clear();
+    BOOST_FOREACH(const TTopicItem& item, delta.topic_entries) {
+      // Load is published as a plain decimal string, keyed by the backend's IP address.
+      StringParser::ParseResult result;
+      int64_t load = StringParser::StringToInt<int64_t>(
+          item.value.data(), item.value.size(), &result);
+      if (result != StringParser::PARSE_SUCCESS || load < 0) {
+        VLOG(2) << "Ignoring invalid load topic item with key: " << item.key;
+        continue;
+      }
+      backend_load_map_[item.key] = load;
+    }
+    BOOST_FOREACH(const string& backend_ip, delta.topic_deletions) {
+      backend_load_map_.erase(backend_ip);
+    }
+  }
+
+  // Publish this backend's current load if it changed since the last heartbeat.
+  if (ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT == NULL) return;
+  int64_t load = ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT->value();
+  if (load == last_published_load_ || backend_descriptor_.ip_address.empty()) return;
+  subscriber_topic_updates->push_back(TTopicDelta());
+  TTopicDelta& update = subscriber_topic_updates->back();
+  update.topic_name = IMPALA_LOAD_TOPIC;
+  update.topic_entries.push_back(TTopicItem());
+  TTopicItem& item = update.topic_entries.back();
+  item.key = backend_descriptor_.ip_address;
+  item.value = Substitute("$0", load);
+  last_published_load_ = load;
+}
+
+uint64_t SimpleScheduler::GetBackendLoadPenalty(const TNetworkAddress& data_host) {
+  if (FLAGS_scheduler_load_penalty_bytes <= 0) return 0;
+  // Resolve the datanode's hostname to the IP address the load topic is keyed by.
+  string backend_ip;
+  {
+    lock_guard<mutex> lock(backend_map_lock_);
+    BackendIpAddressMap::const_iterator it = backend_ip_map_.find(data_host.hostname);
+    backend_ip = (it != backend_ip_map_.end()) ? it->second : data_host.hostname;
+  }
+  lock_guard<mutex> lock(backend_load_lock_);
+  BackendLoadMap::const_iterator entry = backend_load_map_.find(backend_ip);
+  if (entry == backend_load_map_.end()) return 0;
+  return entry->second * FLAGS_scheduler_load_penalty_bytes;
+}
+
 Status SimpleScheduler::GetBackends(
     const vector<TNetworkAddress>& data_locations, BackendList* backendports) {
   backendports->clear();
@@ -437,6 +522,7 @@ void SimpleScheduler::GetAllKnownBackends(BackendList* backends) {
 
 Status SimpleScheduler::ComputeScanRangeAssignment(const TQueryExecRequest& exec_request,
     QuerySchedule* schedule) {
+  int64_t cache_affinity_bytes = 0L;
   map<TPlanNodeId, vector<TScanRangeLocations> >::const_iterator entry;
   for (entry = exec_request.per_node_scan_ranges.begin();
       entry != exec_request.per_node_scan_ranges.end(); ++entry) {
@@ -448,16 +534,24 @@ Status SimpleScheduler::ComputeScanRangeAssignment(const TQueryExecRequest& exec
         &(*schedule->exec_params())[fragment_idx].scan_range_assignment;
     RETURN_IF_ERROR(ComputeScanRangeAssignment(
         entry->first, entry->second, exec_request.host_list, exec_at_coord,
-        schedule->query_options(), assignment));
+        schedule->query_options(), assignment, &cache_affinity_bytes));
     schedule->AddScanRanges(entry->second.size());
   }
+  if (FLAGS_cache_affinity_timeout_ms > 0) {
+    // Report the volume assigned to replicas that are expected to serve the data from
+    // their page cache because they scanned it recently.
+    RuntimeProfile::Counter* counter = ADD_COUNTER(schedule->summary_profile(),
+        "CacheAffinityScheduledBytes", TUnit::BYTES);
+    COUNTER_SET(counter, cache_affinity_bytes);
+  }
   return Status::OK;
 }
 
 Status SimpleScheduler::ComputeScanRangeAssignment(
     PlanNodeId node_id, const vector<TScanRangeLocations>& locations,
     const vector<TNetworkAddress>& host_list, bool exec_at_coord,
-    const TQueryOptions& query_options, FragmentScanRangeAssignment* assignment) {
+    const TQueryOptions& query_options, FragmentScanRangeAssignment* assignment,
+    int64_t* cache_affinity_bytes) {
   // If cached reads are enabled, we will always prefer cached replicas over non-cached
   // replicas. Since it is likely that only one replica is cached, this could generate
   // hotspots which is why this is controllable by a query option.
@@ -475,6 +569,7 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
   int64_t remote_bytes = 0L;
   int64_t local_bytes = 0L;
   int64_t cached_bytes = 0L;
+  int64_t affinity_bytes = 0L;
 
   BOOST_FOREACH(const TScanRangeLocations& scan_range_locations, locations) {
     // assign this scan range to the host w/ the fewest assigned bytes
@@ -498,23 +593,51 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
       }
     }
     // If no replicas are cached find the ones based on assigned bytes
+    bool is_affinity = false;
     if (cached_locations.size() == 0) {
+      // A collocated replica that scanned this range recently likely still holds the
+      // data in the OS page cache, which is worth more than disk locality on a less
+      // busy replica. Prefer it while the previous assignment is fresh.
+      string affinity_key;
+      TNetworkAddress affinity_host;
+      bool has_affinity_host = false;
+      if (FLAGS_cache_affinity_timeout_ms > 0 &&
+          scan_range_locations.scan_range.__isset.hdfs_file_split) {
+        const THdfsFileSplit& split = scan_range_locations.scan_range.hdfs_file_split;
+        affinity_key = Substitute("$0:$1", split.file_name, split.offset);
+        has_affinity_host = GetCacheAffinityHost(affinity_key, &affinity_host);
+      }
       BOOST_FOREACH(const TScanRangeLocation& location, scan_range_locations.locations) {
         DCHECK_LT(location.host_idx, host_list.size());
         const TNetworkAddress& replica_host = host_list[location.host_idx];
+        if (has_affinity_host && replica_host == affinity_host &&
+            HasLocalBackend(replica_host)) {
+          min_assigned_bytes = *FindOrInsert(&assigned_bytes_per_host, replica_host, 0UL);
+          data_host = &replica_host;
+          volume_id = location.volume_id;
+          is_cached = false;
+          is_affinity = true;
+          break;
+        }
         // Deprioritize non-collocated datanodes by assigning a very high initial bytes
         uint64_t initial_bytes =
             HasLocalBackend(replica_host) ? 0L : numeric_limits<int64_t>::max();
         uint64_t* assigned_bytes =
             FindOrInsert(&assigned_bytes_per_host, replica_host, initial_bytes);
+        // Load published by the collocated impalad raises the host's apparent scan
+        // load so that concurrent queries spread away from busy nodes.
+        uint64_t candidate_bytes = *assigned_bytes + GetBackendLoadPenalty(replica_host);
         // Update the assignment if this is a less busy host.
-        if (*assigned_bytes < min_assigned_bytes) {
-          min_assigned_bytes = *assigned_bytes;
+        if (candidate_bytes < min_assigned_bytes) {
+          min_assigned_bytes = candidate_bytes;
           data_host = &replica_host;
           volume_id = location.volume_id;
           is_cached = false;
         }
       }
+      if (!affinity_key.empty() && data_host != NULL) {
+        RecordCacheAffinity(affinity_key, *data_host);
+      }
     } else {
       // Randomly pick a cached host based on the extracted list of cached local hosts
       size_t rand_host = rand() % cached_locations.size();
@@ -537,6 +660,7 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
     } else {
       local_bytes += scan_range_length;
       if (is_cached) cached_bytes += scan_range_length;
+      if (is_affinity) affinity_bytes += scan_range_length;
     }
     assigned_bytes_per_host[*data_host] += scan_range_length;
 
@@ -573,6 +697,8 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
         PrettyPrinter::Print(local_bytes, TUnit::BYTES);
     VLOG_FILE << "Total cached scan volume = " <<
         PrettyPrinter::Print(cached_bytes, TUnit::BYTES);
+    VLOG_FILE << "Total cache affinity scan volume = " <<
+        PrettyPrinter::Print(affinity_bytes, TUnit::BYTES);
     if (remote_hosts.size() > 0) {
       stringstream remote_node_log;
       remote_node_log << "Remote data node list: ";
@@ -593,9 +719,50 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
     }
   }
 
+  *cache_affinity_bytes += affinity_bytes;
   return Status::OK;
 }
 
+bool SimpleScheduler::GetCacheAffinityHost(const string& file_key,
+    TNetworkAddress* host) {
+  lock_guard<mutex> lock(cache_affinity_lock_);
+  CacheAffinityMap::const_iterator it = cache_affinity_map_.find(file_key);
+  if (it == cache_affinity_map_.end()) return false;
+  if (MonotonicMillis() - it->second.assigned_time_ms > FLAGS_cache_affinity_timeout_ms) {
+    return false;
+  }
+  *host = it->second.host;
+  return true;
+}
+
+void SimpleScheduler::RecordCacheAffinity(const string& file_key,
+    const TNetworkAddress& host) {
+  const int64_t now_ms = MonotonicMillis();
+  lock_guard<mutex> lock(cache_affinity_lock_);
+  CacheAffinityMap::iterator it = cache_affinity_map_.find(file_key);
+  if (it != cache_affinity_map_.end()) {
+    it->second.host = host;
+    it->second.assigned_time_ms = now_ms;
+    return;
+  }
+  if (cache_affinity_map_.size() >= static_cast<size_t>(FLAGS_cache_affinity_max_entries)) {
+    // The map is full: evict expired entries. This is O(n) but only runs once the
+    // map has filled, at which point most entries are likely stale.
+    for (it = cache_affinity_map_.begin(); it != cache_affinity_map_.end();) {
+      if (now_ms - it->second.assigned_time_ms > FLAGS_cache_affinity_timeout_ms) {
+        cache_affinity_map_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    // All entries are still fresh; drop the new entry rather than grow the map.
+    if (cache_affinity_map_.size() >= static_cast<size_t>(FLAGS_cache_affinity_max_entries)) return;
+  }
+  CacheAffinityEntry& entry = cache_affinity_map_[file_key];
+  entry.host = host;
+  entry.assigned_time_ms = now_ms;
+}
+
 void SimpleScheduler::ComputeFragmentExecParams(const TQueryExecRequest& exec_request,
     QuerySchedule* schedule) {
   vector<FragmentExecParams>* fragment_exec_params = schedule->exec_params();
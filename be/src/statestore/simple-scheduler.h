@@ -46,6 +46,7 @@ class Coordinator;
 class SimpleScheduler : public Scheduler {
  public:
   static const std::string IMPALA_MEMBERSHIP_TOPIC;
+  static const std::string IMPALA_LOAD_TOPIC;
 
   // Initialize with a subscription manager that we can register with for updates to the
   // set of available backends.
@@ -108,6 +109,34 @@ class SimpleScheduler : public Scheduler {
   typedef boost::unordered_map<std::string, std::string> BackendIpAddressMap;
   BackendIpAddressMap backend_ip_map_;
 
+  // Protects cache_affinity_map_.
+  boost::mutex cache_affinity_lock_;
+
+  // Records which data node a scan range was last assigned to and when. Used to
+  // prefer the replica that likely still holds the data in the OS page cache when the
+  // same range is scanned again (see --cache_affinity_timeout_ms).
+  struct CacheAffinityEntry {
+    TNetworkAddress host;
+    int64_t assigned_time_ms;
+  };
+
+  // Map from "<file name>:<offset>" of a scan range to its most recent assignment.
+  typedef boost::unordered_map<std::string, CacheAffinityEntry> CacheAffinityMap;
+  CacheAffinityMap cache_affinity_map_;
+
+  // Protects backend_load_map_.
+  boost::mutex backend_load_lock_;
+
+  // Map from a backend's IP address to the number of in-flight plan fragments it last
+  // published via the load topic. Used to bias replica selection away from busy
+  // backends (see --scheduler_load_penalty_bytes).
+  typedef boost::unordered_map<std::string, int64_t> BackendLoadMap;
+  BackendLoadMap backend_load_map_;
+
+  // The in-flight fragment count this backend last published to the load topic. Only
+  // accessed from UpdateBackendLoad().
+  int64_t last_published_load_;
+
   // Map from unique backend id to TBackendDescriptor. Used to track the known backends
   // from the statestore. It's important to track both the backend ID as well as the
   // TBackendDescriptor so we know what is being removed in a given update.
@@ -192,6 +221,18 @@ class SimpleScheduler : public Scheduler {
   void UpdateMembership(const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
       std::vector<TTopicDelta>* subscriber_topic_updates);
 
+  // Called asynchronously when an update to the load topic is received. Applies the
+  // in-flight fragment counts published by other backends to backend_load_map_, and
+  // publishes this backend's own count when it has changed since the last heartbeat.
+  void UpdateBackendLoad(const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
+      std::vector<TTopicDelta>* subscriber_topic_updates);
+
+  // Returns the penalty, in bytes of apparent scan load, for assigning a scan range to
+  // the backend collocated with 'data_host', based on the in-flight fragment count that
+  // backend last published. Returns 0 if load-aware scheduling is disabled or no load
+  // has been published for the host.
+  uint64_t GetBackendLoadPenalty(const TNetworkAddress& data_host);
+
   // Webserver callback that produces a list of known backends.
   // Example output:
   // "backends": [
@@ -213,10 +254,24 @@ class SimpleScheduler : public Scheduler {
   // Does a scan range assignment (returned in 'assignment') based on a list of scan
   // range locations for a particular scan node.
   // If exec_at_coord is true, all scan ranges will be assigned to the coord node.
+  // The number of bytes assigned to the replica that last scanned them (and is
+  // therefore expected to serve them from the OS page cache) is added to
+  // 'cache_affinity_bytes'.
   Status ComputeScanRangeAssignment(PlanNodeId node_id,
       const std::vector<TScanRangeLocations>& locations,
       const std::vector<TNetworkAddress>& host_list, bool exec_at_coord,
-      const TQueryOptions& query_options, FragmentScanRangeAssignment* assignment);
+      const TQueryOptions& query_options, FragmentScanRangeAssignment* assignment,
+      int64_t* cache_affinity_bytes);
+
+  // Returns true and sets *host if the scan range identified by 'file_key' was
+  // assigned to a replica within the last --cache_affinity_timeout_ms milliseconds.
+  // 'file_key' is of the form "<file name>:<offset>".
+  bool GetCacheAffinityHost(const std::string& file_key, TNetworkAddress* host);
+
+  // Records that the scan range identified by 'file_key' was assigned to 'host'.
+  // The map is bounded by --cache_affinity_max_entries; when full, expired entries
+  // are evicted and new entries are dropped if no space could be reclaimed.
+  void RecordCacheAffinity(const std::string& file_key, const TNetworkAddress& host);
 
   // Populates fragment_exec_params_ in schedule.
   void ComputeFragmentExecParams(const TQueryExecRequest& exec_request,
@@ -124,7 +124,8 @@ StatestoreSubscriber::StatestoreSubscriber(const std::string& subscriber_id,
 }
 
 Status StatestoreSubscriber::AddTopic(const Statestore::TopicId& topic_id,
-    bool is_transient, const UpdateCallback& callback) {
+    bool is_transient, const UpdateCallback& callback,
+    const vector<string>& filter_prefixes) {
   lock_guard<mutex> l(lock_);
   if (is_registered_) return Status("Subscriber already started, can't add new topic");
   Callbacks* cb = &(update_callbacks_[topic_id]);
@@ -134,7 +135,19 @@ Status StatestoreSubscriber::AddTopic(const Statestore::TopicId& topic_id,
     cb->processing_time_metric = metrics_->RegisterMetric(
         new StatsMetric<double>(metric_name, TUnit::TIME_S));
   }
-  topic_registrations_[topic_id] = is_transient;
+  TopicRegistration& registration = topic_registrations_[topic_id];
+  registration.is_transient = is_transient;
+  // Repeat registrations of the same topic receive the union of their filters, and an
+  // empty prefix list means all entries, so any registration asking for everything
+  // clears the filters.
+  if (cb->callbacks.size() == 1) {
+    registration.filter_prefixes = filter_prefixes;
+  } else if (filter_prefixes.empty() || registration.filter_prefixes.empty()) {
+    registration.filter_prefixes.clear();
+  } else {
+    registration.filter_prefixes.insert(registration.filter_prefixes.end(),
+        filter_prefixes.begin(), filter_prefixes.end());
+  }
   return Status::OK;
 }
 
@@ -146,9 +159,13 @@ Status StatestoreSubscriber::Register() {
   TRegisterSubscriberRequest request;
   request.topic_registrations.reserve(update_callbacks_.size());
   BOOST_FOREACH(const UpdateCallbacks::value_type& topic, update_callbacks_) {
+    const TopicRegistration& registration = topic_registrations_[topic.first];
     TTopicRegistration thrift_topic;
     thrift_topic.topic_name = topic.first;
-    thrift_topic.is_transient = topic_registrations_[topic.first];
+    thrift_topic.is_transient = registration.is_transient;
+    if (!registration.filter_prefixes.empty()) {
+      thrift_topic.__set_filter_prefixes(registration.filter_prefixes);
+    }
     request.topic_registrations.push_back(thrift_topic);
   }
 
@@ -107,8 +107,16 @@ class StatestoreSubscriber {
   //
   // Must be called before Start(), in which case it will return
   // Status::OK. Otherwise an error will be returned.
+  //
+  // 'filter_prefixes' optionally restricts the entries this subscriber receives for
+  // the topic: if non-empty, the statestore only sends entries whose keys start with
+  // one of the prefixes, instead of every change to the topic. An empty list (the
+  // default) means all entries. If the same topic is registered several times, the
+  // union of the filters applies, so any registration with an empty list receives
+  // everything.
   Status AddTopic(const Statestore::TopicId& topic_id, bool is_transient,
-      const UpdateCallback& callback);
+      const UpdateCallback& callback,
+      const std::vector<std::string>& filter_prefixes = std::vector<std::string>());
 
   // Registers this subscriber with the statestore, and starts the
   // heartbeat service, as well as a thread to check for failure and
@@ -180,10 +188,18 @@ class StatestoreSubscriber {
   // SubscriptionId), and associated lock.
   UpdateCallbacks update_callbacks_;
 
-  // One entry for every topic subscribed to. The value is whether this subscriber
-  // considers this topic to be 'transient', that is any updates it makes will be deleted
-  // upon failure or disconnection.
-  std::map<Statestore::TopicId, bool> topic_registrations_;
+  struct TopicRegistration {
+    // True if updates made by this subscriber to the topic should be deleted upon
+    // failure or disconnection.
+    bool is_transient;
+
+    // Union of the filter prefixes passed to AddTopic() for this topic. Empty means
+    // the statestore should send every entry. See AddTopic().
+    std::vector<std::string> filter_prefixes;
+  };
+
+  // One entry for every topic subscribed to, sent to the statestore in Register().
+  std::map<Statestore::TopicId, TopicRegistration> topic_registrations_;
 
   // Mapping of TopicId to the last version of the topic this subscriber successfully
   // processed.
@@ -51,6 +51,12 @@ DEFINE_int32(statestore_heartbeat_frequency_ms, 1000, "(Advanced) Frequency (in
 
 DEFINE_int32(state_store_port, 24000, "port where StatestoreService is running");
 
+DEFINE_int64(statestore_max_update_size_bytes, 32L * 1024 * 1024, "(Advanced) Maximum "
+    "approximate size, in bytes, of the topic entries sent in a single update message "
+    "to a subscriber. Larger deltas are split across several messages, sent "
+    "back-to-back, so that updates to other subscribers are not blocked behind one "
+    "large payload. 0 means no limit.");
+
 // Metric keys
 // TODO: Replace 'backend' with 'subscriber' when we can coordinate a change with CM
 const string STATESTORE_LIVE_SUBSCRIBERS = "statestore.live-backends";
@@ -163,10 +169,25 @@ Statestore::Subscriber::Subscriber(const SubscriberId& subscriber_id,
     TopicState topic_state;
     topic_state.is_transient = topic.is_transient;
     topic_state.last_version = TOPIC_INITIAL_VERSION;
+    if (topic.__isset.filter_prefixes) {
+      topic_state.filter_prefixes = topic.filter_prefixes;
+    }
     subscribed_topics_[topic.topic_name] = topic_state;
   }
 }
 
+bool Statestore::Subscriber::AcceptsKey(const TopicId& topic_id,
+    const TopicEntryKey& key) const {
+  const Topics::const_iterator topic_it = subscribed_topics_.find(topic_id);
+  if (topic_it == subscribed_topics_.end()) return true;
+  const vector<string>& prefixes = topic_it->second.filter_prefixes;
+  if (prefixes.empty()) return true;
+  BOOST_FOREACH(const string& prefix, prefixes) {
+    if (key.compare(0, prefix.size(), prefix) == 0) return true;
+  }
+  return false;
+}
+
 void Statestore::Subscriber::AddTransientUpdate(const TopicId& topic_id,
     const TopicEntryKey& topic_key, TopicEntry::Version version) {
   // Only record the update if the topic is transient
@@ -371,7 +392,9 @@ Status Statestore::RegisterSubscriber(const SubscriberId& subscriber_id,
   return Status::OK;
 }
 
-Status Statestore::SendTopicUpdate(Subscriber* subscriber, bool* update_skipped) {
+Status Statestore::SendTopicUpdate(Subscriber* subscriber, bool* update_skipped,
+    bool* more_pending) {
+  *more_pending = false;
   // Time any successful RPCs (i.e. those for which UpdateState() completed, even though
   // it may have returned an error.)
   MonotonicStopWatch sw;
@@ -379,7 +402,7 @@ Status Statestore::SendTopicUpdate(Subscriber* subscriber, bool* update_skipped)
 
   // First thing: make a list of updates to send
   TUpdateStateRequest update_state_request;
-  GatherTopicUpdates(*subscriber, &update_state_request);
+  GatherTopicUpdates(*subscriber, &update_state_request, more_pending);
 
   // Set the expected registration ID, so that the subscriber can reject this update if
   // they have moved on to a new registration instance.
@@ -468,7 +491,8 @@ Status Statestore::SendTopicUpdate(Subscriber* subscriber, bool* update_skipped)
 }
 
 void Statestore::GatherTopicUpdates(const Subscriber& subscriber,
-    TUpdateStateRequest* update_state_request) {
+    TUpdateStateRequest* update_state_request, bool* update_truncated) {
+  *update_truncated = false;
   {
     lock_guard<mutex> l(topic_lock_);
     BOOST_FOREACH(const Subscriber::Topics::value_type& subscribed_topic,
@@ -502,10 +526,32 @@ void Statestore::GatherTopicUpdates(const Subscriber& subscriber,
       TopicUpdateLog::const_iterator next_update =
           topic.topic_update_log().upper_bound(last_processed_version);
 
+      // Bound the size of a single update message. When the pending entries exceed
+      // --statestore_max_update_size_bytes, the delta is truncated at a version
+      // boundary and the remainder is sent in follow-up messages, scheduled
+      // immediately by the caller. Non-delta updates are never truncated since
+      // subscribers interpret them as the entire state of the topic.
+      int64_t pending_bytes = 0;
+      bool truncated = false;
+      TopicEntry::Version last_examined_version = last_processed_version;
       for (; next_update != topic.topic_update_log().end(); ++next_update) {
         TopicEntryMap::const_iterator itr = topic.entries().find(next_update->second);
         DCHECK(itr != topic.entries().end());
         const TopicEntry& topic_entry = itr->second;
+        // Skip entries the subscriber has filtered out. to_version still advances past
+        // them below, so they are never revisited for this subscriber.
+        if (!subscriber.AcceptsKey(topic_it->first, itr->first)) {
+          last_examined_version = next_update->first;
+          continue;
+        }
+        int64_t entry_bytes = itr->first.size() + topic_entry.value().size();
+        if (topic_delta.is_delta && FLAGS_statestore_max_update_size_bytes > 0 &&
+            pending_bytes > 0 &&
+            pending_bytes + entry_bytes > FLAGS_statestore_max_update_size_bytes) {
+          truncated = true;
+          break;
+        }
+        pending_bytes += entry_bytes;
         if (topic_entry.value() == Statestore::TopicEntry::NULL_VALUE) {
           topic_delta.topic_deletions.push_back(itr->first);
         } else {
@@ -515,9 +561,15 @@ void Statestore::GatherTopicUpdates(const Subscriber& subscriber,
           // TODO: Does this do a needless copy?
           topic_item.value = topic_entry.value();
         }
+        last_examined_version = next_update->first;
       }
 
-      if (topic.topic_update_log().size() > 0) {
+      if (truncated) {
+        // The subscriber's last processed version advances only to the last entry
+        // included in this message; the next update resumes from there.
+        topic_delta.__set_to_version(last_examined_version);
+        *update_truncated = true;
+      } else if (topic.topic_update_log().size() > 0) {
         // The largest version for this topic will be the last item in the version history
         // map.
         topic_delta.__set_to_version(topic.topic_update_log().rbegin()->first);
@@ -647,13 +699,20 @@ void Statestore::DoSubscriberUpdate(bool is_heartbeat, int thread_id,
     status = SendHeartbeat(subscriber.get());
     deadline_ms = UnixMillis() + FLAGS_statestore_heartbeat_frequency_ms;
   } else {
-    bool update_skipped;
-    status = SendTopicUpdate(subscriber.get(), &update_skipped);
+    bool update_skipped, more_pending;
+    status = SendTopicUpdate(subscriber.get(), &update_skipped, &more_pending);
     // If the subscriber responded that it skipped the last update sent, we assume that
     // it was busy doing something else, and back off slightly before sending another.
-    int64_t update_interval = update_skipped ?
-        (2 * FLAGS_statestore_update_frequency_ms) :
-        FLAGS_statestore_update_frequency_ms;
+    int64_t update_interval;
+    if (update_skipped) {
+      update_interval = 2 * FLAGS_statestore_update_frequency_ms;
+    } else if (status.ok() && more_pending) {
+      // Part of the update was held back to bound the message size; send the rest
+      // without waiting a full update interval.
+      update_interval = 0;
+    } else {
+      update_interval = FLAGS_statestore_update_frequency_ms;
+    }
     deadline_ms = UnixMillis() + update_interval;
   }
 
@@ -274,6 +274,12 @@ class Statestore {
     struct TopicState {
       bool is_transient;
       TopicEntry::Version last_version;
+
+      // Key prefixes this subscriber is interested in, from
+      // TTopicRegistration.filter_prefixes. If empty, the subscriber receives every
+      // entry in the topic; otherwise only entries whose key starts with one of the
+      // prefixes are sent to it.
+      std::vector<std::string> filter_prefixes;
     };
 
     // The set of topics subscribed to, and current state (as seen by this subscriber) of
@@ -303,6 +309,11 @@ class Statestore {
 
     const TransientEntryMap& transient_entries() const { return transient_entries_; }
 
+    // Returns true if this subscriber should be sent the entry with the given key in
+    // the given topic, i.e. the subscriber registered no filter prefixes for the topic
+    // or the key starts with one of them.
+    bool AcceptsKey(const TopicId& topic_id, const TopicEntryKey& key) const;
+
     // Returns the last version of the topic which this subscriber has successfully
     // processed. Will never decrease.
     const TopicEntry::Version LastTopicVersionProcessed(const TopicId& topic_id) const;
@@ -445,7 +456,13 @@ class Statestore {
   // will return OK (since there was no error) and the output parameter update_skipped is
   // set to true. Otherwise, any updates returned by the subscriber are applied to their
   // target topics.
-  Status SendTopicUpdate(Subscriber* subscriber, bool* update_skipped);
+  //
+  // 'more_pending' is set to true if the update sent was truncated to stay under
+  // --statestore_max_update_size_bytes, in which case the caller should schedule the
+  // next update for this subscriber immediately rather than waiting a full update
+  // interval.
+  Status SendTopicUpdate(Subscriber* subscriber, bool* update_skipped,
+      bool* more_pending);
 
   // Sends a heartbeat message to subscriber. Returns false if there was some error
   // performing the RPC.
@@ -458,8 +475,13 @@ class Statestore {
   // Populates a TUpdateStateRequest with the update state for this subscriber. Iterates
   // over all updates in all subscribed topics, populating the given TUpdateStateRequest
   // object. Takes the topic_lock_ and subscribers_lock_.
+  //
+  // Delta updates larger than --statestore_max_update_size_bytes are truncated at a
+  // version boundary, with each topic's to_version set to the last entry included, and
+  // 'update_truncated' is set to true so the caller can send the remainder promptly in
+  // follow-up messages.
   void GatherTopicUpdates(const Subscriber& subscriber,
-      TUpdateStateRequest* update_state_request);
+      TUpdateStateRequest* update_state_request, bool* update_truncated);
 
   // Returns the minimum last processed topic version across all subscribers for the given
   // topic ID. Calculated by enumerating all subscribers and looking at their
@@ -20,6 +20,7 @@
 #include <map>
 #include <string>
 #include <string.h>
+#include <utility>
 #include <vector>
 
 // Be very careful when adding Impala includes in this file. We don't want to pull
@@ -64,18 +65,38 @@ class FunctionContextImpl {
   impala_udf::FunctionContext* Clone(MemPool* pool);
 
   // Allocates a buffer of 'byte_size' with "local" memory management. These
-  // allocations are not freed one by one but freed as a pool by FreeLocalAllocations()
-  // This is used where the lifetime of the allocation is clear.
-  // For UDFs, the allocations can be freed at the row level.
+  // allocations are not freed one by one but freed as a group by
+  // FreeLocalAllocations(). This is used where the lifetime of the allocation is
+  // clear. For UDFs, the allocations can be freed at the row level.
+  // Served by bumping a cursor through arena chunks carved from pool_, so the common
+  // case is a pointer bump with no free-list traffic. Also backs the public
+  // FunctionContext::AllocateScratch() API for UDF authors.
   // TODO: free them at the batch level and save some copies?
   uint8_t* AllocateLocal(int byte_size);
 
-  // Frees all allocations returned by AllocateLocal().
+  // Frees all allocations returned by AllocateLocal() by rewinding the arena cursor.
+  // The arena chunks are kept for reuse until Close().
   void FreeLocalAllocations();
 
   // Sets constant_args_. The AnyVal* values are owned by the caller.
   void SetConstantArgs(const std::vector<impala_udf::AnyVal*>& constant_args);
 
+  // Attributes of the function call that are fixed at plan time. When the call is
+  // codegen'd, calls to GetConstFnAttr() are replaced with the attribute's value
+  // (see ScalarFnCall::InlineConstFnAttrs()), so runtime dispatch on these values,
+  // e.g. the decimal byte-width switches in DecimalOperators, constant-folds away.
+  enum ConstFnAttr {
+    RETURN_TYPE_SIZE,  // int, in bytes
+    RETURN_TYPE_PRECISION,
+    RETURN_TYPE_SCALE,
+    // TODO: ARG_TYPE_* variants once an operator needs the argument widths folded too
+  };
+
+  // Returns the value of the constant attribute 't' for this function call. Only
+  // valid for decimal return types. Must be kept in sync with the values
+  // ScalarFnCall::InlineConstFnAttrs() substitutes on the codegen path.
+  int GetConstFnAttr(ConstFnAttr t) const;
+
   uint8_t* varargs_buffer() { return varargs_buffer_; }
 
   std::vector<impala_udf::AnyVal*>* staging_input_vals() { return &staging_input_vals_; }
@@ -83,6 +104,11 @@ class FunctionContextImpl {
   bool debug() { return debug_; }
   bool closed() { return closed_; }
 
+  // Type descriptor for the intermediate type of a UDA. INVALID_TYPE for UDFs.
+  const impala_udf::FunctionContext::TypeDesc& intermediate_type() const {
+    return intermediate_type_;
+  }
+
   int64_t num_updates() const { return num_updates_; }
   int64_t num_removes() const { return num_removes_; }
   void set_num_updates(int64_t n) { num_updates_ = n; }
@@ -133,8 +159,16 @@ class FunctionContextImpl {
   // Allocations made and still owned by the user function. Only used if debug_ is true
   // because it is very expensive to maintain.
   std::map<uint8_t*, int> allocations_;
-  // Allocations owned by Impala.
-  std::vector<uint8_t*> local_allocations_;
+
+  // Chunks backing AllocateLocal()'s bump allocator: (buffer, usable size) pairs,
+  // with the buffers owned by pool_. FreeLocalAllocations() only rewinds the cursor
+  // below, so the chunks are reused until Close() returns them to pool_.
+  std::vector<std::pair<uint8_t*, int> > local_arena_chunks_;
+
+  // Index of the chunk AllocateLocal() is currently filling and the offset of the
+  // free space within it.
+  int local_arena_idx_;
+  int local_arena_offset_;
 
   // The function state accessed via FunctionContext::Get/SetFunctionState()
   void* thread_local_fn_state_;
@@ -17,6 +17,26 @@
 using namespace impala;
 using namespace impala_udf;
 
+int FunctionContextImpl::GetConstFnAttr(ConstFnAttr t) const {
+  switch (t) {
+    case RETURN_TYPE_SIZE:
+      assert(return_type_.type == FunctionContext::TYPE_DECIMAL);
+      // Must match ColumnType::GetDecimalByteSize().
+      if (return_type_.precision <= 9) return 4;
+      if (return_type_.precision <= 18) return 8;
+      return 16;
+    case RETURN_TYPE_PRECISION:
+      assert(return_type_.type == FunctionContext::TYPE_DECIMAL);
+      return return_type_.precision;
+    case RETURN_TYPE_SCALE:
+      assert(return_type_.type == FunctionContext::TYPE_DECIMAL);
+      return return_type_.scale;
+    default:
+      assert(false);
+      return -1;
+  }
+}
+
 bool FunctionContext::IsArgConstant(int i) const {
   if (i < 0 || i >= impl_->constant_args_.size()) return false;
   return impl_->constant_args_[i] != NULL;
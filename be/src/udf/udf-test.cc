@@ -124,6 +124,12 @@ IntVal ValidateMem(FunctionContext* context) {
   EXPECT_TRUE(buffer != NULL);
   memset(buffer, 0, 10);
   context->Free(buffer);
+  // Scratch allocations are arena-backed and are freed wholesale by the engine, so
+  // there is no matching Free().
+  EXPECT_TRUE(context->AllocateScratch(0) == NULL);
+  uint8_t* scratch = context->AllocateScratch(10);
+  EXPECT_TRUE(scratch != NULL);
+  memset(scratch, 0, 10);
   return IntVal::null();
 }
 
@@ -109,6 +109,10 @@ const char* FunctionContextImpl::LLVM_FUNCTIONCONTEXT_NAME =
 
 static const int MAX_WARNINGS = 1000;
 
+// Default size of the chunks backing AllocateLocal()'s arena. Allocations bigger than
+// this get a dedicated chunk.
+static const int LOCAL_ARENA_CHUNK_SIZE = 4 * 1024;
+
 FunctionContext* FunctionContextImpl::CreateContext(RuntimeState* state, MemPool* pool,
     const FunctionContext::TypeDesc& return_type,
     const vector<FunctionContext::TypeDesc>& arg_types,
@@ -172,6 +176,8 @@ FunctionContextImpl::FunctionContextImpl(FunctionContext* parent)
     num_warnings_(0),
     num_updates_(0),
     num_removes_(0),
+    local_arena_idx_(0),
+    local_arena_offset_(0),
     thread_local_fn_state_(NULL),
     fragment_local_fn_state_(NULL),
     external_bytes_tracked_(0),
@@ -181,9 +187,13 @@ FunctionContextImpl::FunctionContextImpl(FunctionContext* parent)
 void FunctionContextImpl::Close() {
   if (closed_) return;
 
-  // Free local allocations first so we can detect leaks through any remaining allocations
-  // (local allocations cannot be leaked, at least not by the UDF)
+  // Return the local allocation arena to pool_ first so we can detect leaks through any
+  // remaining allocations (local allocations cannot be leaked, at least not by the UDF)
   FreeLocalAllocations();
+  for (int i = 0; i < local_arena_chunks_.size(); ++i) {
+    pool_->Free(local_arena_chunks_[i].first);
+  }
+  local_arena_chunks_.clear();
 
   stringstream error_ss;
   if (!debug_) {
@@ -308,6 +318,10 @@ void FunctionContext::Free(uint8_t* buffer) {
   }
 }
 
+uint8_t* FunctionContext::AllocateScratch(int byte_size) {
+  return impl_->AllocateLocal(byte_size);
+}
+
 void FunctionContext::TrackAllocation(int64_t bytes) {
   assert(!impl_->closed_);
   impl_->external_bytes_tracked_ += bytes;
@@ -385,8 +399,24 @@ void FunctionContext::SetFunctionState(FunctionStateScope scope, void* ptr) {
 uint8_t* FunctionContextImpl::AllocateLocal(int byte_size) {
   assert(!closed_);
   if (byte_size == 0) return NULL;
-  uint8_t* buffer = pool_->Allocate(byte_size);
-  local_allocations_.push_back(buffer);
+  // Round up to 8 bytes so consecutive results stay aligned.
+  int num_bytes = (byte_size + 7) / 8 * 8;
+  // Advance the cursor to a chunk with enough free space, appending a new chunk from
+  // pool_ if none of the existing ones fit.
+  while (local_arena_idx_ < local_arena_chunks_.size() &&
+      local_arena_offset_ + num_bytes > local_arena_chunks_[local_arena_idx_].second) {
+    ++local_arena_idx_;
+    local_arena_offset_ = 0;
+  }
+  if (local_arena_idx_ == local_arena_chunks_.size()) {
+    int chunk_size = LOCAL_ARENA_CHUNK_SIZE;
+    if (num_bytes > chunk_size) chunk_size = num_bytes;
+    local_arena_chunks_.push_back(
+        make_pair(pool_->Allocate(chunk_size), chunk_size));
+    local_arena_offset_ = 0;
+  }
+  uint8_t* buffer = local_arena_chunks_[local_arena_idx_].first + local_arena_offset_;
+  local_arena_offset_ += num_bytes;
   VLOG_ROW << "Allocate Local: FunctionContext=" << this->context_
            << " size=" << byte_size
            << " result=" << reinterpret_cast<void*>(buffer);
@@ -395,19 +425,12 @@ uint8_t* FunctionContextImpl::AllocateLocal(int byte_size) {
 
 void FunctionContextImpl::FreeLocalAllocations() {
   assert(!closed_);
-  if (VLOG_ROW_IS_ON) {
-    stringstream ss;
-    ss << "Free local allocations: FunctionContext=" << context_
-       << " pool=" << pool_ << endl;
-    for (int i = 0; i < local_allocations_.size(); ++i) {
-      ss << "  " << reinterpret_cast<void*>(local_allocations_[i]) << endl;
-    }
-    VLOG_ROW << ss.str();
-  }
-  for (int i = 0; i < local_allocations_.size(); ++i) {
-    pool_->Free(local_allocations_[i]);
-  }
-  local_allocations_.clear();
+  VLOG_ROW << "Free local allocations: FunctionContext=" << context_
+           << " pool=" << pool_;
+  // Rewinding the cursor invalidates all local allocations at once; the chunks are
+  // kept and reused until Close().
+  local_arena_idx_ = 0;
+  local_arena_offset_ = 0;
 }
 
 void FunctionContextImpl::SetConstantArgs(const vector<AnyVal*>& constant_args) {
@@ -148,6 +148,15 @@ class FunctionContext {
   // Frees a buffer returned from Allocate() or Reallocate()
   void Free(uint8_t* buffer);
 
+  // Allocates batch-scoped scratch memory. The returned buffer stays valid until the
+  // engine has consumed the current row batch, after which all scratch allocations are
+  // freed wholesale - do not call Free() on them. Allocation is a cheap arena bump
+  // with no matching free, so UDFs that need per-row temporary buffers (or produce
+  // var-len results, see the StringVal(FunctionContext*, int) ctor which uses the same
+  // arena) can avoid per-call Allocate()/Free() pairs entirely. Memory allocated here
+  // must not be cached across calls via SetFunctionState() or similar.
+  uint8_t* AllocateScratch(int byte_size);
+
   // For allocations that cannot use the Allocate() API provided by this
   // object, TrackAllocation()/Free() can be used to just keep count of the
   // byte sizes. For each call to TrackAllocation(), the UDF/UDA must call
@@ -108,6 +108,14 @@ class BitReader {
   template<typename T>
   bool GetValue(int num_bits, T* v);
 
+  // Gets the next 'num_values' values from the buffer, each 'num_bits' wide. Returns
+  // the number of values read, which is only less than 'num_values' if the stream does
+  // not contain that many. Performs a single bounds check for the whole batch and then
+  // unpacks 32 values per iteration of the inner loop, which is considerably faster
+  // than calling GetValue() per value. num_bits must be <= 32.
+  template<typename T>
+  int GetValues(int num_bits, int num_values, T* v);
+
   // Reads a 'num_bytes'-sized value from the buffer and stores it in 'v'. T needs to be a
   // little-endian native type and big enough to store 'num_bytes'. The value is assumed
   // to be byte-aligned so the stream will be advanced to the start of the next byte
@@ -127,6 +135,12 @@ class BitReader {
   static const int MAX_VLQ_BYTE_LEN = 5;
 
  private:
+  // Reads a value like GetValue() but without the bounds check; the caller must have
+  // established that 'num_bits' more bits are available. Used by GetValues() to hoist
+  // the bounds check out of the unpack loop.
+  template<typename T>
+  void GetValueUnchecked(int num_bits, T* v);
+
   uint8_t* buffer_;
   int max_bytes_;
 
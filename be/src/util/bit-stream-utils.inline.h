@@ -82,13 +82,7 @@ inline bool BitWriter::PutVlqInt(int32_t v) {
 }
 
 template<typename T>
-inline bool BitReader::GetValue(int num_bits, T* v) {
-  // TODO: revisit this limit if necessary
-  DCHECK_LE(num_bits, 32);
-  DCHECK_LE(num_bits, sizeof(T) * 8);
-
-  if (UNLIKELY(byte_offset_ * 8 + bit_offset_ + num_bits > max_bytes_ * 8)) return false;
-
+inline void BitReader::GetValueUnchecked(int num_bits, T* v) {
   *v = BitUtil::TrailingBits(buffered_values_, bit_offset_ + num_bits) >> bit_offset_;
 
   bit_offset_ += num_bits;
@@ -108,9 +102,51 @@ inline bool BitReader::GetValue(int num_bits, T* v) {
           << (num_bits - bit_offset_);
   }
   DCHECK_LE(bit_offset_, 64);
+}
+
+template<typename T>
+inline bool BitReader::GetValue(int num_bits, T* v) {
+  // TODO: revisit this limit if necessary
+  DCHECK_LE(num_bits, 32);
+  DCHECK_LE(num_bits, sizeof(T) * 8);
+
+  if (UNLIKELY(byte_offset_ * 8 + bit_offset_ + num_bits > max_bytes_ * 8)) return false;
+
+  GetValueUnchecked(num_bits, v);
   return true;
 }
 
+template<typename T>
+inline int BitReader::GetValues(int num_bits, int num_values, T* v) {
+  // TODO: revisit this limit if necessary
+  DCHECK_LE(num_bits, 32);
+  DCHECK_LE(num_bits, sizeof(T) * 8);
+  DCHECK_GE(num_values, 0);
+
+  if (num_bits > 0) {
+    // One bounds check for the whole batch: clamp 'num_values' to what the stream
+    // still contains instead of checking per value.
+    int64_t bits_left =
+        static_cast<int64_t>(max_bytes_) * 8 - (byte_offset_ * 8 + bit_offset_);
+    if (UNLIKELY(static_cast<int64_t>(num_values) * num_bits > bits_left)) {
+      num_values = bits_left / num_bits;
+    }
+  }
+
+  // Unpack in chunks of 32 values; the fixed-count inner loop has no data-dependent
+  // branches so the compiler can unroll and pipeline it.
+  int i = 0;
+  for (; i + 32 <= num_values; i += 32) {
+    for (int j = 0; j < 32; ++j) {
+      GetValueUnchecked(num_bits, &v[i + j]);
+    }
+  }
+  for (; i < num_values; ++i) {
+    GetValueUnchecked(num_bits, &v[i]);
+  }
+  return num_values;
+}
+
 template<typename T>
 inline bool BitReader::GetAligned(int num_bytes, T* v) {
   DCHECK_LE(num_bytes, sizeof(T));
@@ -51,6 +51,34 @@ TEST(BlockingQueueTest, TestGetFromShutdownQueue) {
   ASSERT_FALSE(test_queue.BlockingGet(&i));
 }
 
+TEST(LockFreeBlockingQueueTest, TestBasic) {
+  int32_t i;
+  LockFreeBlockingQueue<int32_t> test_queue(5);
+  ASSERT_TRUE(test_queue.BlockingPut(1));
+  ASSERT_TRUE(test_queue.BlockingPut(2));
+  ASSERT_TRUE(test_queue.BlockingPut(3));
+  ASSERT_EQ(3, test_queue.GetSize());
+  ASSERT_TRUE(test_queue.BlockingGet(&i));
+  ASSERT_EQ(1, i);
+  ASSERT_TRUE(test_queue.BlockingGet(&i));
+  ASSERT_EQ(2, i);
+  ASSERT_TRUE(test_queue.BlockingGet(&i));
+  ASSERT_EQ(3, i);
+  ASSERT_EQ(0, test_queue.GetSize());
+}
+
+TEST(LockFreeBlockingQueueTest, TestGetFromShutdownQueue) {
+  int64_t i;
+  LockFreeBlockingQueue<int64_t> test_queue(2);
+  ASSERT_TRUE(test_queue.BlockingPut(123));
+  test_queue.Shutdown();
+  ASSERT_FALSE(test_queue.BlockingPut(456));
+  ASSERT_TRUE(test_queue.BlockingGet(&i));
+  ASSERT_EQ(123, i);
+  ASSERT_FALSE(test_queue.BlockingGet(&i));
+}
+
+template <typename QueueType>
 class MultiThreadTest {
  public:
   MultiThreadTest()
@@ -118,7 +146,7 @@ class MultiThreadTest {
 
   int iterations_;
   int nthreads_;
-  BlockingQueue<int32_t> queue_;
+  QueueType queue_;
   // Lock for gotten_ and num_inserters_.
   mutex lock_;
   // Map from inserter thread id to number of consumed elements from that id.
@@ -132,7 +160,12 @@ class MultiThreadTest {
 };
 
 TEST(BlockingQueueTest, TestMultipleThreads) {
-  MultiThreadTest test;
+  MultiThreadTest<BlockingQueue<int32_t> > test;
+  test.Run();
+}
+
+TEST(LockFreeBlockingQueueTest, TestMultipleThreads) {
+  MultiThreadTest<LockFreeBlockingQueue<int32_t> > test;
   test.Run();
 }
 
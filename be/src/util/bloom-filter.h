@@ -0,0 +1,79 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_BLOOM_FILTER_H
+#define IMPALA_UTIL_BLOOM_FILTER_H
+
+#include "util/bitmap.h"
+
+namespace impala {
+
+// Basic bloom filter over 32-bit hash values, used for the probe-side slot filters
+// generated by the hash joins (see RuntimeState::AddBloomFilter()). The caller hashes
+// each value once; the filter derives NUM_HASHES bit positions from that hash by
+// double hashing. Unlike a plain bitmap, the false positive rate degrades gracefully
+// as the number of inserted keys approaches the number of bits.
+// TODO: investigate a cache-line blocked layout to bound a lookup to one cache miss.
+class BloomFilter {
+ public:
+  // Number of bit positions set per inserted key and tested per lookup.
+  static const int NUM_HASHES = 3;
+
+  // Minimum number of bits per distinct inserted key for the filter to stay
+  // selective. Below this the false positive rate makes probing the filter pure
+  // overhead.
+  static const int64_t MIN_BITS_PER_ENTRY = 4;
+
+  BloomFilter(int64_t num_bits) : bitmap_(num_bits) { }
+
+  // Adds a key with hash value 'hash' to the filter.
+  void Insert(uint32_t hash) {
+    uint32_t h = hash;
+    const uint32_t delta = Rehash(hash);
+    for (int i = 0; i < NUM_HASHES; ++i) {
+      bitmap_.Set<true>(h, true);
+      h += delta;
+    }
+  }
+
+  // Returns false if a key with hash value 'hash' was definitely never inserted.
+  bool Find(uint32_t hash) const {
+    uint32_t h = hash;
+    const uint32_t delta = Rehash(hash);
+    for (int i = 0; i < NUM_HASHES; ++i) {
+      if (!bitmap_.Get<true>(h)) return false;
+      h += delta;
+    }
+    return true;
+  }
+
+  // Intersects 'other' into this filter. Both filters must have the same number of
+  // bits. The result has no false negatives for keys inserted into both filters.
+  void And(const BloomFilter* other) { bitmap_.And(&other->bitmap_); }
+
+  int64_t num_bits() const { return bitmap_.size(); }
+
+ private:
+  // Second hash stream derived from the input hash, used as the stride between the
+  // NUM_HASHES probed bit positions (Knuth multiplicative hashing). Forced odd so
+  // the stride is never 0.
+  static uint32_t Rehash(uint32_t hash) { return (hash * 0x9E3779B1U) | 1U; }
+
+  Bitmap bitmap_;
+};
+
+}
+
+#endif
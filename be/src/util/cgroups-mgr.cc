@@ -16,8 +16,13 @@
 
 #include <fstream>
 #include <sstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 #include "util/debug-util.h"
+#include "util/string-parser.h"
 #include <gutil/strings/substitute.h>
 
 using namespace impala;
@@ -31,6 +36,9 @@ namespace impala {
 // Suffix appended to Yarn resource ids to form an Impala-internal cgroups.
 const std::string IMPALA_CGROUP_SUFFIX = "_impala";
 
+// Prefix of the long-lived per-request-pool cgroups created by InitPoolCgroups().
+const std::string IMPALA_POOL_CGROUP_PREFIX = "impala_pool_";
+
 // Yarn's default multiplier for translating virtual CPU cores into cgroup CPU shares.
 // See Yarn's CgroupsLCEResourcesHandler.java for more details.
 const int32_t CPU_DEFAULT_WEIGHT = 1024;
@@ -49,11 +57,46 @@ Status CgroupsMgr::Init(const string& cgroups_hierarchy_path,
   return Status::OK;
 }
 
+Status CgroupsMgr::InitPoolCgroups(const string& pool_shares_config) {
+  DCHECK(!cgroups_hierarchy_path_.empty());
+  vector<string> pool_shares;
+  split(pool_shares, pool_shares_config, is_any_of(","), token_compress_on);
+  BOOST_FOREACH(const string& pool_share, pool_shares) {
+    // Pool names may themselves contain ':' (although they typically do not), so split
+    // on the last one.
+    size_t sep = pool_share.rfind(':');
+    if (sep == string::npos || sep == 0) {
+      return Status(Substitute("Invalid pool CPU shares entry: '$0'. "
+          "Expected <pool name>:<cpu shares>.", pool_share));
+    }
+    const string& pool_name = pool_share.substr(0, sep);
+    const string& shares_str = pool_share.substr(sep + 1);
+    StringParser::ParseResult result;
+    int32_t num_shares = StringParser::StringToInt<int32_t>(
+        shares_str.c_str(), shares_str.size(), &result);
+    if (result != StringParser::PARSE_SUCCESS || num_shares <= 0) {
+      return Status(Substitute("Invalid CPU shares for pool '$0': '$1'. "
+          "Expected a positive integer.", pool_name, shares_str));
+    }
+    const string& cgroup = IMPALA_POOL_CGROUP_PREFIX + pool_name;
+    RETURN_IF_ERROR(CreateCgroup(cgroup, true));
+    RETURN_IF_ERROR(SetCpuShares(cgroup, num_shares));
+    pool_cgroups_[pool_name] = cgroup;
+  }
+  return Status::OK;
+}
+
 string CgroupsMgr::UniqueIdToCgroup(const string& unique_id) const {
   if (unique_id.empty()) return "";
   return unique_id + IMPALA_CGROUP_SUFFIX;
 }
 
+string CgroupsMgr::RequestPoolToCgroup(const string& pool_name) const {
+  unordered_map<string, string>::const_iterator it = pool_cgroups_.find(pool_name);
+  if (it == pool_cgroups_.end()) return "";
+  return it->second;
+}
+
 int32_t CgroupsMgr::VirtualCoresToCpuShares(int16_t v_cpu_cores) {
   if (v_cpu_cores <= 0) return -1;
   return CPU_DEFAULT_WEIGHT * v_cpu_cores;
@@ -102,7 +145,7 @@ Status CgroupsMgr::SetCpuShares(const string& cgroup, int32_t num_shares) {
   RETURN_IF_ERROR(GetCgroupPaths(cgroup, &cgroup_path, &tasks_path));
 
   const string& cpu_shares_path = Substitute("$0/$1", cgroup_path, "cpu.shares");
-  ofstream cpu_shares(tasks_path.c_str(), ios::out | ios::trunc);
+  ofstream cpu_shares(cpu_shares_path.c_str(), ios::out | ios::trunc);
   if (!cpu_shares.is_open()) {
     stringstream err_msg;
     err_msg << "CGroup CPU shares file: " << cpu_shares_path
@@ -137,8 +180,7 @@ Status CgroupsMgr::GetCgroupPaths(const std::string& cgroup,
   return Status::OK;
 }
 
-Status CgroupsMgr::AssignThreadToCgroup(const Thread& thread,
-    const string& cgroup) const {
+Status CgroupsMgr::AssignTidToCgroup(int64_t tid, const string& cgroup) const {
   string cgroup_path;
   string tasks_path;
   RETURN_IF_ERROR(GetCgroupPaths(cgroup, &cgroup_path, &tasks_path));
@@ -149,13 +191,24 @@ Status CgroupsMgr::AssignThreadToCgroup(const Thread& thread,
     err_msg << "CGroup tasks file: " << tasks_path << " is not writable by Impala";
     return Status(err_msg.str());
   }
-  tasks << thread.tid() << endl;
+  tasks << tid << endl;
 
-  VLOG_ROW << "Thread " << thread.tid() << " moved to CGroup " << cgroup_path;
+  VLOG_ROW << "Thread " << tid << " moved to CGroup " << cgroup_path;
   tasks.close();
   return Status::OK;
 }
 
+Status CgroupsMgr::AssignThreadToCgroup(const Thread& thread,
+    const string& cgroup) const {
+  return AssignTidToCgroup(thread.tid(), cgroup);
+}
+
+Status CgroupsMgr::AssignCurrentThreadToCgroup(const string& cgroup) const {
+  int64_t tid = syscall(SYS_gettid);
+  if (tid == -1) return Status("Could not determine thread id of current thread");
+  return AssignTidToCgroup(tid, cgroup);
+}
+
 Status CgroupsMgr::RelocateThreads(const string& src_cgroup,
     const string& dst_cgroup) const {
   string src_cgroup_path;
@@ -86,11 +86,24 @@ class CgroupsMgr {
   Status Init(const std::string& cgroups_hierarchy_path,
       const std::string& staging_cgroup);
 
+  // Creates one long-lived cgroup per request pool from pool_shares_config, a
+  // comma-separated list of <pool name>:<cpu shares> pairs (see the
+  // --cgroup_pool_cpu_shares flag), and sets each cgroup's cpu.shares accordingly.
+  // Fragments are later mapped into these cgroups via RequestPoolToCgroup(). Unlike
+  // per-query cgroups, pool cgroups are never reference counted or dropped.
+  // Init() must have been called first. Returns a non-OK status if the config cannot
+  // be parsed or a cgroup could not be created.
+  Status InitPoolCgroups(const std::string& pool_shares_config);
+
   // Returns the cgroup Impala should create and use for enforcing granted resources
   // identified by the given unique ID (which usually corresponds to a query ID). Returns
   // an empty string if unique_id is empty.
   std::string UniqueIdToCgroup(const std::string& unique_id) const;
 
+  // Returns the cgroup created by InitPoolCgroups() for the given request pool, or an
+  // empty string if no CPU shares were configured for the pool.
+  std::string RequestPoolToCgroup(const std::string& pool_name) const;
+
   // Returns the cgroup CPU shares corresponding to the given number of virtual cores.
   // Returns -1 if v_cpu_cores is <= 0 (which is invalid).
   int32_t VirtualCoresToCpuShares(int16_t v_cpu_cores);
@@ -134,6 +147,11 @@ class CgroupsMgr {
   // cgroup information from the filesystem.
   Status AssignThreadToCgroup(const Thread& thread, const std::string& cgroup) const;
 
+  // Assigns the calling thread to a cgroup, like AssignThreadToCgroup(). Used for
+  // threads that are not wrapped in a Thread object, e.g. the fragment execution
+  // thread assigning itself in PlanFragmentExecutor::Open().
+  Status AssignCurrentThreadToCgroup(const std::string& cgroup) const;
+
   // Reads the <cgroups_hierarchy_path_>/<src_cgroup>/tasks file and writing all the
   // contained thread ids to <cgroups_hierarchy_path_>/<dst_cgroup>/tasks.
   // Assumes that the destination cgroup has already been created. Returns a non-OK
@@ -148,6 +166,10 @@ class CgroupsMgr {
   Status GetCgroupPaths(const std::string& cgroup,
       std::string* cgroup_path, std::string* tasks_path) const;
 
+  // Writes the given thread id to <cgroups_hierarchy_path_>/<cgroup>/tasks.
+  // Shared implementation of the AssignThreadToCgroup() variants.
+  Status AssignTidToCgroup(int64_t tid, const std::string& cgroup) const;
+
   // Number of currently active Impala-managed cgroups.
   IntCounter* active_cgroups_metric_;
 
@@ -165,6 +187,10 @@ class CgroupsMgr {
   // A cgroup can be safely dropped once the number of fragments in the cgroup,
   // according to this map, reaches zero.
   boost::unordered_map<std::string, int32_t> active_cgroups_;
+
+  // Map from request pool name to the pool's long-lived cgroup. Populated by
+  // InitPoolCgroups() during startup and read-only afterwards, so no lock is needed.
+  boost::unordered_map<std::string, std::string> pool_cgroups_;
 };
 
 }
@@ -14,12 +14,17 @@
 
 #include "util/codec.h"
 
+#include <string.h>
+#include <boost/algorithm/string.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/foreach.hpp>
 #include <limits> // for std::numeric_limits
 #include <gutil/strings/substitute.h>
 
+#include "common/version.h"
 #include "util/compress.h"
 #include "util/decompress.h"
+#include "util/dynamic-util.h"
 
 #include "gen-cpp/CatalogObjects_types.h"
 #include "gen-cpp/CatalogObjects_constants.h"
@@ -30,6 +35,13 @@ using namespace boost::assign;
 using namespace impala;
 using namespace strings;
 
+DEFINE_string(codec_plugins, "", "(Experimental) Comma-separated list of shared "
+    "objects implementing compression codecs outside the built-in set. Each library "
+    "is loaded at startup and registered under the codec name it reports. See "
+    "util/codec.h for the symbols a codec plugin must export.");
+DEFINE_bool(skip_codec_plugin_version_check, false, "Disables checking codec plugin "
+    "library versions against the running Impala version.");
+
 const char* const Codec::DEFAULT_COMPRESSION =
     "org.apache.hadoop.io.compress.DefaultCodec";
 const char* const Codec::GZIP_COMPRESSION = "org.apache.hadoop.io.compress.GzipCodec";
@@ -47,6 +59,75 @@ const Codec::CodecMap Codec::CODEC_MAP = map_list_of
   (BZIP2_COMPRESSION, THdfsCompression::BZIP2)
   (SNAPPY_COMPRESSION, THdfsCompression::SNAPPY_BLOCKED);
 
+namespace {
+
+// Factories exported by a codec plugin shared object.
+struct CodecPlugin {
+  Codec::CodecPluginFactoryFn create_compressor;
+  Codec::CodecPluginFactoryFn create_decompressor;
+};
+
+// Plugin codecs keyed by the codec name they implement. Populated by
+// Codec::InitPlugins() at startup and read-only afterwards, so lookups are unlocked.
+map<string, CodecPlugin> codec_plugins;
+
+}
+
+Status Codec::InitPlugins() {
+  if (FLAGS_codec_plugins.empty()) return Status::OK;
+  vector<string> libraries;
+  split(libraries, FLAGS_codec_plugins, is_any_of(","), token_compress_on);
+  BOOST_FOREACH(const string& library, libraries) {
+    RETURN_IF_ERROR(RegisterPlugin(library));
+  }
+  return Status::OK;
+}
+
+Status Codec::RegisterPlugin(const string& library) {
+  void* handle;
+  RETURN_IF_ERROR(DynamicOpen(library.c_str(), &handle));
+
+  const char* (*get_build_version)();
+  RETURN_IF_ERROR(DynamicLookup(handle, "GetImpalaBuildVersion",
+      reinterpret_cast<void**>(&get_build_version)));
+  if (strcmp((*get_build_version)(), IMPALA_BUILD_VERSION) != 0) {
+    stringstream ss;
+    ss << "Codec plugin " << library << " was built against Impala version "
+       << (*get_build_version)() << ", but the running Impala version is "
+       << IMPALA_BUILD_VERSION;
+    if (FLAGS_skip_codec_plugin_version_check) {
+      LOG(ERROR) << ss.str();
+    } else {
+      return Status(ss.str());
+    }
+  }
+
+  const char* (*get_codec_name)();
+  RETURN_IF_ERROR(DynamicLookup(handle, "ImpalaCodecPluginName",
+      reinterpret_cast<void**>(&get_codec_name)));
+  CodecPlugin plugin;
+  RETURN_IF_ERROR(DynamicLookup(handle, "ImpalaCreateCompressor",
+      reinterpret_cast<void**>(&plugin.create_compressor)));
+  RETURN_IF_ERROR(DynamicLookup(handle, "ImpalaCreateDecompressor",
+      reinterpret_cast<void**>(&plugin.create_decompressor)));
+
+  const string codec_name((*get_codec_name)());
+  if (CODEC_MAP.find(codec_name) != CODEC_MAP.end() ||
+      codec_plugins.find(codec_name) != codec_plugins.end()) {
+    return Status(Substitute("Codec plugin $0 implements codec '$1', which is already "
+        "registered.", library, codec_name));
+  }
+  codec_plugins[codec_name] = plugin;
+  // The library handle is intentionally never closed: plugin codecs may be created at
+  // any point during the process lifetime.
+  LOG(INFO) << "Loaded codec plugin " << library << " implementing codec " << codec_name;
+  return Status::OK;
+}
+
+bool Codec::IsPluginCodec(const string& codec) {
+  return codec_plugins.find(codec) != codec_plugins.end();
+}
+
 string Codec::GetCodecName(THdfsCompression::type type) {
   BOOST_FOREACH(const CodecMap::value_type& codec,
       g_CatalogObjects_constants.COMPRESSION_MAP) {
@@ -71,7 +152,16 @@ Status Codec::CreateCompressor(MemPool* mem_pool, bool reuse, const string& code
     scoped_ptr<Codec>* compressor) {
   CodecMap::const_iterator type = CODEC_MAP.find(codec);
   if (type == CODEC_MAP.end()) {
-    return Status(Substitute("$0$1", UNKNOWN_CODEC_ERROR, codec));
+    map<string, CodecPlugin>::const_iterator plugin = codec_plugins.find(codec);
+    if (plugin == codec_plugins.end()) {
+      return Status(Substitute("$0$1", UNKNOWN_CODEC_ERROR, codec));
+    }
+    Codec* created = (*plugin->second.create_compressor)(mem_pool, reuse);
+    if (created == NULL) {
+      return Status(Substitute("Codec plugin failed to create compressor '$0'", codec));
+    }
+    compressor->reset(created);
+    return Status::OK;
   }
 
   RETURN_IF_ERROR(
@@ -119,7 +209,17 @@ Status Codec::CreateDecompressor(MemPool* mem_pool, bool reuse, const string& co
     scoped_ptr<Codec>* decompressor) {
   CodecMap::const_iterator type = CODEC_MAP.find(codec);
   if (type == CODEC_MAP.end()) {
-    return Status(Substitute("$0$1", UNKNOWN_CODEC_ERROR, codec));
+    map<string, CodecPlugin>::const_iterator plugin = codec_plugins.find(codec);
+    if (plugin == codec_plugins.end()) {
+      return Status(Substitute("$0$1", UNKNOWN_CODEC_ERROR, codec));
+    }
+    Codec* created = (*plugin->second.create_decompressor)(mem_pool, reuse);
+    if (created == NULL) {
+      return Status(
+          Substitute("Codec plugin failed to create decompressor '$0'", codec));
+    }
+    decompressor->reset(created);
+    return Status::OK;
   }
 
   RETURN_IF_ERROR(
@@ -86,6 +86,40 @@ class Codec {
   // Returns the java class name for the given compression type
   static Status GetHadoopCodecClassName(THdfsCompression::type, std::string* out_name);
 
+  // Factory function implemented by codec plugin shared objects. Returns a newly
+  // allocated, initialized codec, or NULL on failure. The returned codec follows the
+  // same mem_pool/reuse_buffer contract as the Create*() factories above.
+  typedef Codec* (*CodecPluginFactoryFn)(MemPool* mem_pool, bool reuse_buffer);
+
+  // A codec plugin is a shared object implementing a compression codec outside the
+  // built-in set (e.g. ZSTD), loaded via DynamicOpen(). Plugin codecs have no
+  // THdfsCompression enum value; they are registered under the Hadoop codec class name
+  // they implement and dispatched through the string-keyed factory methods above. That
+  // is the path taken by the SequenceFile and RCFile scanners (which read the codec
+  // class name from the file header) and by writers that accept a codec string.
+  // A plugin library must export the following symbols with C linkage:
+  //   const char* GetImpalaBuildVersion();
+  //       Build version the plugin was compiled against. Must match the running
+  //       impalad unless --skip_codec_plugin_version_check is set.
+  //   const char* ImpalaCodecPluginName();
+  //       The Hadoop codec class name this plugin implements.
+  //   impala::Codec* ImpalaCreateCompressor(impala::MemPool*, bool reuse_buffer);
+  //   impala::Codec* ImpalaCreateDecompressor(impala::MemPool*, bool reuse_buffer);
+
+  // Loads and registers all plugin libraries named in --codec_plugins. Called once at
+  // process startup, before any queries run; the plugin registry is read-only
+  // afterwards so lookups do not need to lock.
+  static Status InitPlugins();
+
+  // Loads a single codec plugin shared object and registers its factories under the
+  // codec name it reports. Fails if the library cannot be loaded, is missing one of
+  // the symbols above, fails the version check, or duplicates an already registered
+  // codec name.
+  static Status RegisterPlugin(const std::string& library);
+
+  // Returns true if 'codec' names a codec provided by a registered plugin.
+  static bool IsPluginCodec(const std::string& codec);
+
   virtual ~Codec() {}
 
   // Process a block of data, either compressing or decompressing it.
@@ -18,6 +18,7 @@
 #include <iostream>
 #include <fstream>
 #include <mmintrin.h>
+#include <sched.h>
 #include <sstream>
 #include <stdlib.h>
 #include <string.h>
@@ -42,6 +43,8 @@ long CpuInfo::cache_sizes_[L3_CACHE + 1];
 int64_t CpuInfo::cycles_per_ms_;
 int CpuInfo::num_cores_ = 1;
 string CpuInfo::model_name_ = "unknown";
+int CpuInfo::num_numa_nodes_ = 1;
+vector<int> CpuInfo::core_to_numa_node_;
 
 static struct {
   string name;
@@ -128,9 +131,54 @@ void CpuInfo::Init() {
 
   if (FLAGS_num_cores > 0) num_cores_ = FLAGS_num_cores;
 
+  InitNumaInfo();
+
   initialized_ = true;
 }
 
+void CpuInfo::InitNumaInfo() {
+  // Each NUMA node is a directory /sys/devices/system/node/node<N> containing a
+  // 'cpulist' file with the cores on that node as comma-separated ranges,
+  // e.g. "0-7,16-23".
+  for (int node = 0; ; ++node) {
+    stringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+    ifstream cpulist(path.str().c_str(), ios::in);
+    if (!cpulist) break;
+    string line;
+    getline(cpulist, line);
+    trim(line);
+    vector<string> ranges;
+    split(ranges, line, is_any_of(","));
+    for (int i = 0; i < ranges.size(); ++i) {
+      if (ranges[i].empty()) continue;
+      int first_core, last_core;
+      size_t dash = ranges[i].find('-');
+      if (dash == string::npos) {
+        first_core = last_core = atoi(ranges[i].c_str());
+      } else {
+        first_core = atoi(ranges[i].substr(0, dash).c_str());
+        last_core = atoi(ranges[i].substr(dash + 1).c_str());
+      }
+      if (first_core < 0 || last_core < first_core) continue;
+      if (last_core >= core_to_numa_node_.size()) {
+        core_to_numa_node_.resize(last_core + 1, 0);
+      }
+      for (int core = first_core; core <= last_core; ++core) {
+        core_to_numa_node_[core] = node;
+      }
+    }
+    num_numa_nodes_ = node + 1;
+  }
+}
+
+int CpuInfo::GetCurrentNumaNode() {
+  DCHECK(initialized_);
+  int core = sched_getcpu();
+  if (core < 0 || core >= core_to_numa_node_.size()) return 0;
+  return core_to_numa_node_[core];
+}
+
 void CpuInfo::VerifyCpuRequirements() {
   if (!CpuInfo::IsSupported(CpuInfo::SSSE3)) {
     LOG(ERROR) << "CPU does not support the Supplemental SSE3 (SSSE3) instruction set, "
@@ -158,6 +206,7 @@ string CpuInfo::DebugString() {
   stream << "Cpu Info:" << endl
          << "  Model: " << model_name_ << endl
          << "  Cores: " << num_cores_ << endl
+         << "  NUMA Nodes: " << num_numa_nodes_ << endl
          << "  L1 Cache: " << PrettyPrinter::Print(L1, TUnit::BYTES) << endl
          << "  L2 Cache: " << PrettyPrinter::Print(L2, TUnit::BYTES) << endl
          << "  L3 Cache: " << PrettyPrinter::Print(L3, TUnit::BYTES) << endl
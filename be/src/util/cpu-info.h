@@ -17,6 +17,7 @@
 #define IMPALA_UTIL_CPU_INFO_H
 
 #include <string>
+#include <vector>
 #include <boost/cstdint.hpp>
 
 #include "common/logging.h"
@@ -82,6 +83,18 @@ class CpuInfo {
     return num_cores_; 
   }
 
+  // Returns the number of NUMA nodes (i.e. sockets) on this machine, or 1 if the
+  // topology could not be determined.
+  static int num_numa_nodes() {
+    DCHECK(initialized_);
+    return num_numa_nodes_;
+  }
+
+  // Returns the NUMA node of the core this thread is currently running on. The thread
+  // can migrate at any time so this is only useful as a hint, e.g. for memory
+  // placement. Returns 0 if the topology could not be determined.
+  static int GetCurrentNumaNode();
+
   // Returns the model name of the cpu (e.g. Intel i7-2600)
   static std::string model_name() { 
     DCHECK(initialized_);
@@ -91,6 +104,10 @@ class CpuInfo {
   static std::string DebugString();
 
  private:
+  // Reads the NUMA topology from /sys/devices/system/node and populates
+  // num_numa_nodes_ and core_to_numa_node_. Called from Init().
+  static void InitNumaInfo();
+
   static bool initialized_;
   static int64_t hardware_flags_;
   static int64_t original_hardware_flags_;
@@ -98,6 +115,11 @@ class CpuInfo {
   static int64_t cycles_per_ms_;
   static int num_cores_;
   static std::string model_name_;
+  static int num_numa_nodes_;
+
+  // Mapping from core id to the NUMA node it belongs to. Empty if the topology could
+  // not be determined.
+  static std::vector<int> core_to_numa_node_;
 };
 
 }
@@ -0,0 +1,181 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/cpu-sampler.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include <boost/thread/mutex.hpp>
+#include <gflags/gflags.h>
+#include <gutil/strings/substitute.h>
+
+#include "common/atomic.h"
+#include "common/logging.h"
+
+using namespace impala;
+using namespace std;
+using namespace strings;
+
+DEFINE_bool(enable_query_cpu_sampler, false, "(Advanced) If true, enable the built-in "
+    "sampling CPU profiler. Samples are attributed to the running query and plan node "
+    "and exposed at /query_cpu on the debug webserver.");
+DEFINE_int32(query_cpu_sampler_freq_hz, 100, "(Advanced) Sampling frequency of the "
+    "built-in CPU profiler, in samples per second of consumed CPU time.");
+
+CpuSampler* CpuSampler::instance_ = NULL;
+__thread CpuSampler::ThreadContext CpuSampler::thread_context_;
+
+namespace {
+// Protects creation of the singleton.
+boost::mutex instance_lock_;
+}
+
+CpuSampler::CpuSampler()
+  : total_samples_(0),
+    dropped_samples_(0),
+    running_(false) {
+  memset(table_, 0, sizeof(table_));
+}
+
+CpuSampler* CpuSampler::GetInstance() {
+  boost::lock_guard<boost::mutex> l(instance_lock_);
+  if (instance_ == NULL) {
+    CpuSampler* sampler = new CpuSampler();
+    // Publish only after construction so the signal handler never sees a
+    // half-constructed sampler.
+    AtomicUtil::MemoryBarrier();
+    instance_ = sampler;
+  }
+  return instance_;
+}
+
+Status CpuSampler::Start() {
+  DCHECK(!running_);
+  if (FLAGS_query_cpu_sampler_freq_hz <= 0) {
+    return Status(Substitute("Invalid --query_cpu_sampler_freq_hz: $0",
+        FLAGS_query_cpu_sampler_freq_hz));
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &CpuSampler::SignalHandler;
+  action.sa_flags = SA_RESTART;
+  if (sigaction(SIGPROF, &action, NULL) != 0) {
+    return Status(Substitute("Could not install SIGPROF handler: errno=$0", errno));
+  }
+
+  int64_t interval_us = 1000000L / FLAGS_query_cpu_sampler_freq_hz;
+  struct itimerval timer;
+  timer.it_interval.tv_sec = interval_us / 1000000L;
+  timer.it_interval.tv_usec = interval_us % 1000000L;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+    return Status(Substitute("Could not start profiling timer: errno=$0", errno));
+  }
+
+  running_ = true;
+  LOG(INFO) << "CPU sampler started at " << FLAGS_query_cpu_sampler_freq_hz << "Hz";
+  return Status::OK;
+}
+
+void CpuSampler::Stop() {
+  if (!running_) return;
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  // Disarming the timer stops new SIGPROFs; the handler stays installed, which is
+  // harmless.
+  setitimer(ITIMER_PROF, &timer, NULL);
+  running_ = false;
+}
+
+void CpuSampler::SetThreadContext(const TUniqueId& query_id, int node_id) {
+  // Written in an order that keeps the slot consistent if a sample fires mid-update:
+  // invalidate, update, revalidate. The handler runs on this same thread, so these
+  // stores are observed in program order.
+  thread_context_.valid = false;
+  thread_context_.query_hi = query_id.hi;
+  thread_context_.query_lo = query_id.lo;
+  thread_context_.node_id = node_id;
+  thread_context_.valid = true;
+}
+
+void CpuSampler::ClearThreadContext() {
+  thread_context_.valid = false;
+}
+
+void CpuSampler::SignalHandler(int signum) {
+  CpuSampler* sampler = instance_;
+  if (sampler == NULL) return;
+  sampler->RecordSample(thread_context_);
+}
+
+void CpuSampler::RecordSample(const ThreadContext& context) {
+  __sync_fetch_and_add(&total_samples_, 1);
+  if (!context.valid) return;
+
+  // Cheap 64-bit mix of the key; everything below must stay async-signal-safe.
+  uint64_t hash = static_cast<uint64_t>(context.query_hi);
+  hash = hash * 0x9e3779b97f4a7c15ULL + static_cast<uint64_t>(context.query_lo);
+  hash = hash * 0x9e3779b97f4a7c15ULL + static_cast<uint32_t>(context.node_id);
+  hash ^= hash >> 29;
+
+  for (int probe = 0; probe < MAX_PROBES; ++probe) {
+    SampleBucket* bucket = &table_[(hash + probe) & TABLE_MASK];
+    int32_t state = bucket->state;
+    if (state == BUCKET_READY) {
+      if (bucket->query_hi == context.query_hi && bucket->query_lo == context.query_lo
+          && bucket->node_id == context.node_id) {
+        __sync_fetch_and_add(&bucket->count, 1);
+        return;
+      }
+      continue;  // Ready but belongs to another key: keep probing.
+    }
+    if (state == BUCKET_FREE && __sync_bool_compare_and_swap(
+            &bucket->state, BUCKET_FREE, BUCKET_INITIALIZING)) {
+      bucket->query_hi = context.query_hi;
+      bucket->query_lo = context.query_lo;
+      bucket->node_id = context.node_id;
+      bucket->count = 1;
+      __sync_synchronize();
+      bucket->state = BUCKET_READY;
+      return;
+    }
+    // Bucket is initializing, or we lost the race to claim it: keep probing.
+  }
+  __sync_fetch_and_add(&dropped_samples_, 1);
+}
+
+void CpuSampler::GetQuerySamples(const TUniqueId& query_id,
+    std::map<int, int64_t>* node_samples, int64_t* query_samples) {
+  node_samples->clear();
+  *query_samples = 0;
+  for (int i = 0; i < TABLE_SIZE; ++i) {
+    SampleBucket* bucket = &table_[i];
+    if (bucket->state != BUCKET_READY) continue;
+    if (bucket->query_hi != query_id.hi || bucket->query_lo != query_id.lo) continue;
+    int64_t count = __sync_fetch_and_add(&bucket->count, 0);
+    (*node_samples)[bucket->node_id] += count;
+    *query_samples += count;
+  }
+}
+
+int64_t CpuSampler::total_samples() const {
+  return __sync_fetch_and_add(const_cast<int64_t*>(&total_samples_), 0);
+}
+
+int64_t CpuSampler::dropped_samples() const {
+  return __sync_fetch_and_add(const_cast<int64_t*>(&dropped_samples_), 0);
+}
@@ -0,0 +1,156 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_UTIL_CPU_SAMPLER_H
+#define IMPALA_UTIL_CPU_SAMPLER_H
+
+#include <map>
+
+#include "common/status.h"
+#include "gen-cpp/Types_types.h"  // for TUniqueId
+
+namespace impala {
+
+// Always-available sampling CPU profiler with per-query attribution.
+//
+// When started (see --enable_query_cpu_sampler), a SIGPROF handler driven by
+// setitimer(ITIMER_PROF) fires on whichever thread is consuming CPU. The handler
+// charges the sample to the interrupted thread's attribution, which execution
+// threads publish in a thread-local slot via SetThreadContext(): the query id plus
+// optionally the plan node the thread works for. Samples land in a fixed-size
+// open-addressed table keyed by (query id, plan node id) that the handler updates
+// with only atomic instructions, so taking a sample is async-signal-safe and does
+// not block query execution.
+//
+// The table is never compacted: it holds the most recent TABLE_SIZE distinct
+// (query, node) pairs and once it fills up new pairs are counted as dropped (see
+// dropped_samples()). This bounds the sampler's memory at a few hundred KB for the
+// lifetime of the process.
+//
+// Aggregated counts for one query are exposed through the webserver (/query_cpu)
+// next to the query's runtime profile.
+class CpuSampler {
+ public:
+  // Returns the process-wide sampler, creating it on the first call.
+  static CpuSampler* GetInstance();
+
+  // Installs the SIGPROF handler and starts the profiling timer at
+  // --query_cpu_sampler_freq_hz. Returns an error if the timer could not be set up.
+  Status Start();
+
+  // Stops the profiling timer. Samples collected so far remain available.
+  void Stop();
+
+  bool is_running() const { return running_; }
+
+  // Publishes this thread's attribution: subsequent samples on this thread are
+  // charged to 'query_id' and 'node_id'. Pass node_id = NO_NODE for work that is
+  // not specific to a plan node (e.g. the fragment's main execution thread).
+  // Cheap (two thread-local stores); safe to call unconditionally.
+  static void SetThreadContext(const TUniqueId& query_id, int node_id = NO_NODE);
+
+  // Clears this thread's attribution. Must be called before a thread that called
+  // SetThreadContext() is returned to a thread pool, so a recycled thread does not
+  // charge its samples to a finished query.
+  static void ClearThreadContext();
+
+  // Aggregates the samples collected for 'query_id': *node_samples maps plan node id
+  // (NO_NODE for unattributed work) to its sample count and *query_samples is their
+  // sum. Not async-signal-safe; called from webserver threads.
+  void GetQuerySamples(const TUniqueId& query_id,
+      std::map<int, int64_t>* node_samples, int64_t* query_samples);
+
+  // Total number of samples taken (resp. dropped because the table was full) since
+  // the process started.
+  int64_t total_samples() const;
+  int64_t dropped_samples() const;
+
+  // node id used for samples attributed to a query but not to a plan node.
+  static const int NO_NODE = -1;
+
+ private:
+  CpuSampler();
+
+  // Attribution slot published by SetThreadContext(). Only ever written by the
+  // owning thread and read by the signal handler running on that same thread, so
+  // no synchronization is needed.
+  struct ThreadContext {
+    int64_t query_hi;
+    int64_t query_lo;
+    int32_t node_id;
+    // True once SetThreadContext() has been called (query ids can legally be 0:0).
+    bool valid;
+  };
+
+  enum BucketState {
+    BUCKET_FREE = 0,
+    // A handler won the bucket and is writing the key; other handlers skip it and
+    // readers ignore it.
+    BUCKET_INITIALIZING = 1,
+    BUCKET_READY = 2
+  };
+
+  struct SampleBucket {
+    int64_t query_hi;
+    int64_t query_lo;
+    int32_t node_id;
+    int32_t state;  // BucketState, modified with atomic ops.
+    int64_t count;
+  };
+
+  // 16K buckets * 32 bytes = 512KB. Needs to cover the distinct (query, node)
+  // pairs we care to look at before the process restarts; dropped_samples() shows
+  // when this is exceeded.
+  static const int TABLE_SIZE = 1 << 14;
+  static const int TABLE_MASK = TABLE_SIZE - 1;
+  // Bound on linear probing in the signal handler; a sample that cannot find its
+  // bucket within this many slots is dropped rather than delaying the thread.
+  static const int MAX_PROBES = 32;
+
+  // SIGPROF handler; forwards to RecordSample() on the singleton.
+  static void SignalHandler(int signum);
+
+  // Charges one sample to this thread's current attribution. Only uses atomic
+  // instructions; async-signal-safe.
+  void RecordSample(const ThreadContext& context);
+
+  static CpuSampler* instance_;
+  static __thread ThreadContext thread_context_;
+
+  SampleBucket table_[TABLE_SIZE];
+  int64_t total_samples_;
+  int64_t dropped_samples_;
+  bool running_;
+};
+
+// Publishes a CPU sample attribution for the lifetime of a scope and clears it on
+// exit. Use in thread bodies with multiple return paths (e.g. scanner threads).
+class ScopedThreadCpuSampleContext {
+ public:
+  ScopedThreadCpuSampleContext(const TUniqueId& query_id,
+      int node_id = CpuSampler::NO_NODE) {
+    CpuSampler::SetThreadContext(query_id, node_id);
+  }
+
+  ~ScopedThreadCpuSampleContext() { CpuSampler::ClearThreadContext(); }
+
+ private:
+  // Disable copy constructor and assignment
+  ScopedThreadCpuSampleContext(const ScopedThreadCpuSampleContext&);
+  ScopedThreadCpuSampleContext& operator=(const ScopedThreadCpuSampleContext&);
+};
+
+}
+
+#endif
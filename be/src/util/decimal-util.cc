@@ -18,6 +18,7 @@
 namespace impala {
 
 int128_t DecimalUtil::MAX_UNSCALED_DECIMAL;
+int128_t DecimalUtil::SCALE_MULTIPLIERS[DecimalUtil::NUM_SCALE_MULTIPLIERS];
 
 void DecimalUtil::InitMaxUnscaledDecimal() {
   // TODO: is there a better way to do this?
@@ -26,6 +27,10 @@ void DecimalUtil::InitMaxUnscaledDecimal() {
     MAX_UNSCALED_DECIMAL *= 10;
     MAX_UNSCALED_DECIMAL += 9;
   }
+  SCALE_MULTIPLIERS[0] = 1;
+  for (int i = 1; i < NUM_SCALE_MULTIPLIERS; ++i) {
+    SCALE_MULTIPLIERS[i] = SCALE_MULTIPLIERS[i - 1] * 10;
+  }
 }
 
 }
@@ -31,7 +31,19 @@ class DecimalUtil {
   // Maximum absolute value of int128_t that we use. This is 38 digits of 9's.
   static int128_t MAX_UNSCALED_DECIMAL;
 
-  // Initializes MAX_UNSCALED_DECIMAL. Must be called once before using it.
+  // Number of entries in SCALE_MULTIPLIERS: the maximum decimal precision is 38, so
+  // scales 0 through 38 cover every stored value. Intermediates can scale further
+  // (division scales by up to 2 * 38); the int256_t specialization falls back to
+  // multiplying past the end of the table.
+  static const int NUM_SCALE_MULTIPLIERS = 39;
+
+  // Lookup table of powers of 10: SCALE_MULTIPLIERS[i] = 10^i. Used by the
+  // GetScaleMultiplier() specializations below so rescaling values (e.g. to compare
+  // decimals of different scales) doesn't multiply in a loop per call.
+  static int128_t SCALE_MULTIPLIERS[NUM_SCALE_MULTIPLIERS];
+
+  // Initializes MAX_UNSCALED_DECIMAL and SCALE_MULTIPLIERS. Must be called once before
+  // using them.
   static void InitMaxUnscaledDecimal();
 
   // TODO: do we need to handle overflow here or at a higher abstraction.
@@ -46,10 +58,13 @@ class DecimalUtil {
     return v * GetScaleMultiplier<T>(scale);
   }
 
+  // Specialized for the machine integral types below and for int256_t in
+  // decimal-value.h to read SCALE_MULTIPLIERS instead of multiplying in a loop. This
+  // generic version remains for double, where the loop and a truncated table read can
+  // round differently above 10^22.
   template<typename T>
   static T GetScaleMultiplier(int scale) {
     DCHECK_GE(scale, 0);
-    // TODO: this should be a lookup table.
     T result = 1;
     for (int i = 0; i < scale; ++i) {
       result *= 10;
@@ -106,6 +121,31 @@ class DecimalUtil {
   }
 };
 
+// Truncating the 128-bit table entry to a narrower integral type wraps identically to
+// computing 10^scale with repeated multiplication in that type, so these are exact
+// drop-in replacements for the generic loop even for scales whose multiplier
+// overflows T.
+template<>
+inline int32_t DecimalUtil::GetScaleMultiplier<int32_t>(int scale) {
+  DCHECK_GE(scale, 0);
+  DCHECK_LT(scale, NUM_SCALE_MULTIPLIERS);
+  return static_cast<int32_t>(SCALE_MULTIPLIERS[scale]);
+}
+
+template<>
+inline int64_t DecimalUtil::GetScaleMultiplier<int64_t>(int scale) {
+  DCHECK_GE(scale, 0);
+  DCHECK_LT(scale, NUM_SCALE_MULTIPLIERS);
+  return static_cast<int64_t>(SCALE_MULTIPLIERS[scale]);
+}
+
+template<>
+inline int128_t DecimalUtil::GetScaleMultiplier<int128_t>(int scale) {
+  DCHECK_GE(scale, 0);
+  DCHECK_LT(scale, NUM_SCALE_MULTIPLIERS);
+  return SCALE_MULTIPLIERS[scale];
+}
+
 }
 
 #endif
@@ -226,6 +226,7 @@ TEST_F(DecompressorTest, Deflate) {
 
 TEST_F(DecompressorTest, Bzip) {
   RunTest(THdfsCompression::BZIP2);
+  RunTestStreaming(THdfsCompression::BZIP2);
 }
 
 TEST_F(DecompressorTest, SnappyBlocked) {
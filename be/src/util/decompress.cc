@@ -29,8 +29,8 @@ using namespace std;
 using namespace boost;
 using namespace impala;
 
-// Output buffer size for streaming gzip
-const int64_t STREAM_GZIP_OUT_BUF_SIZE = 16 * 1024 * 1024;
+// Output buffer size for streaming decompression (gzip and bzip2)
+const int64_t STREAM_OUT_BUF_SIZE = 16 * 1024 * 1024;
 
 GzipDecompressor::GzipDecompressor(MemPool* mem_pool, bool reuse_buffer, bool is_deflate)
   : Codec(mem_pool, reuse_buffer),
@@ -71,7 +71,7 @@ string GzipDecompressor::DebugStreamState() const {
 Status GzipDecompressor::ProcessBlockStreaming(int64_t input_length, const uint8_t* input,
     int64_t* input_bytes_read, int64_t* output_length, uint8_t** output, bool* eos) {
   if (!reuse_buffer_ || out_buffer_ == NULL) {
-    buffer_length_ = STREAM_GZIP_OUT_BUF_SIZE;
+    buffer_length_ = STREAM_OUT_BUF_SIZE;
     out_buffer_ = memory_pool_->Allocate(buffer_length_);
   }
   *output = out_buffer_;
@@ -208,12 +208,65 @@ Status GzipDecompressor::ProcessBlock(bool output_preallocated, int64_t input_le
 
 BzipDecompressor::BzipDecompressor(MemPool* mem_pool, bool reuse_buffer)
   : Codec(mem_pool, reuse_buffer) {
+  bzero(&stream_, sizeof(stream_));
+}
+
+BzipDecompressor::~BzipDecompressor() {
+  (void)BZ2_bzDecompressEnd(&stream_);
+}
+
+Status BzipDecompressor::Init() {
+  int ret = BZ2_bzDecompressInit(&stream_, 0, 0);
+  if (ret != BZ_OK) {
+    stringstream ss;
+    ss << "bzlib BZ2_bzDecompressInit failed: " << ret;
+    return Status(ss.str());
+  }
+  return Status::OK;
 }
 
 int64_t BzipDecompressor::MaxOutputLen(int64_t input_len, const uint8_t* input) {
   return -1;
 }
 
+Status BzipDecompressor::ProcessBlockStreaming(int64_t input_length, const uint8_t* input,
+    int64_t* input_bytes_read, int64_t* output_length, uint8_t** output, bool* eos) {
+  if (!reuse_buffer_ || out_buffer_ == NULL) {
+    buffer_length_ = STREAM_OUT_BUF_SIZE;
+    out_buffer_ = memory_pool_->Allocate(buffer_length_);
+  }
+  *output = out_buffer_;
+  *output_length = buffer_length_;
+  *input_bytes_read = 0;
+  *eos = false;
+
+  stream_.next_in = const_cast<char*>(reinterpret_cast<const char*>(input));
+  stream_.avail_in = input_length;
+  stream_.next_out = reinterpret_cast<char*>(*output);
+  stream_.avail_out = *output_length;
+
+  int ret = BZ2_bzDecompress(&stream_);
+  if (ret != BZ_OK && ret != BZ_STREAM_END) {
+    stringstream ss;
+    ss << "bzlib BZ2_bzDecompress failed: " << ret;
+    return Status(ss.str());
+  }
+
+  // stream_.avail_out is the number of bytes *left* in the out buffer, but
+  // we're interested in the number of bytes used.
+  *output_length = *output_length - stream_.avail_out;
+  *input_bytes_read = input_length - stream_.avail_in;
+
+  if (ret == BZ_STREAM_END) {
+    *eos = true;
+    // Unlike zlib there is no reset, so tear the stream down and re-initialize it in
+    // case the caller continues with another stream (e.g. a concatenated bzip2 file).
+    (void)BZ2_bzDecompressEnd(&stream_);
+    RETURN_IF_ERROR(Init());
+  }
+  return Status::OK;
+}
+
 Status BzipDecompressor::ProcessBlock(bool output_preallocated, int64_t input_length,
     const uint8_t* input, int64_t* output_length, uint8_t** output) {
   if (output_preallocated && *output_length == 0) {
@@ -16,8 +16,9 @@
 #ifndef IMPALA_UTIL_DECOMPRESS_H
 #define IMPALA_UTIL_DECOMPRESS_H
 
-// We need zlib.h here to declare stream_ below.
+// We need zlib.h and bzlib.h here to declare the stream members below.
 #include <zlib.h>
+#include <bzlib.h>
 
 #include "util/codec.h"
 #include "exec/hdfs-scanner.h"
@@ -54,17 +55,23 @@ class GzipDecompressor : public Codec {
 
 class BzipDecompressor : public Codec {
  public:
-  virtual ~BzipDecompressor() { }
+  virtual ~BzipDecompressor();
   virtual int64_t MaxOutputLen(int64_t input_len, const uint8_t* input = NULL);
   virtual Status ProcessBlock(bool output_preallocated,
                               int64_t input_length, const uint8_t* input,
                               int64_t* output_length, uint8_t** output);
+  virtual Status ProcessBlockStreaming(int64_t input_length, const uint8_t* input,
+      int64_t* input_bytes_read, int64_t* output_length, uint8_t** output, bool* eos);
   virtual std::string file_extension() const { return "bz2"; }
  private:
   friend class Codec;
   BzipDecompressor(MemPool* mem_pool, bool reuse_buffer);
 
-  virtual Status Init() { return Status::OK; }
+  virtual Status Init();
+
+  // Used by ProcessBlockStreaming() only; ProcessBlock() uses the one-shot
+  // BZ2_bzBuffToBuffDecompress() API.
+  bz_stream stream_;
 };
 
 class SnappyDecompressor : public Codec {
@@ -201,6 +201,23 @@ class DictDecoder : public DictDecoderBase {
   // the string data is from the dictionary buffer passed into the c'tor.
   bool GetValue(T* value);
 
+  // Decodes the index (i.e. the dictionary code) of the next value without
+  // materializing it. Returns false if the data is invalid. The corresponding value
+  // can be fetched with value(*index).
+  bool GetNextIndex(int* index) {
+    DCHECK(data_decoder_.get() != NULL);
+    if (!data_decoder_->Get(index)) return false;
+    return *index < static_cast<int>(dict_.size());
+  }
+
+  // Returns the dictionary value encoded as 'index'.
+  // Valid to call for 0 <= index < num_entries().
+  const T& value(int index) const {
+    DCHECK_GE(index, 0);
+    DCHECK_LT(index, dict_.size());
+    return dict_[index];
+  }
+
  private:
   std::vector<T> dict_;
 };
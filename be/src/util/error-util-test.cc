@@ -35,6 +35,16 @@ TEST(ErrorMsg, GenericFormatting) {
       "all your impalads are the same version.", msg.msg());
 }
 
+TEST(ErrorMsg, DeferredFormatting) {
+  // Messages built from only an error code defer formatting until first access.
+  ErrorMsg msg(TErrorCode::CANCELLED);
+  ASSERT_EQ(TErrorCode::CANCELLED, msg.error());
+  const std::string formatted = msg.msg();
+  ASSERT_EQ("Cancelled", formatted);
+  msg.AddDetail("Detail.");
+  ASSERT_EQ(formatted + "\nDetail.\n", msg.GetFullMessageDetails());
+}
+
 TEST(ErrorMsg, MergeMap) {
   ErrorLogMap left, right;
   left[TErrorCode::GENERAL].messages.push_back("1");
@@ -51,8 +51,14 @@ string GetTablesMissingStatsWarning(const vector<TTableName>& tables_missing_sta
 }
 
 ErrorMsg::ErrorMsg(TErrorCode::type error)
-    : error_(error),
-      message_(strings::Substitute(g_ErrorCodes_constants.TErrorMessage[error_])) {}
+    : error_(error) {
+  // message_ is deliberately left empty. Messages built from only an error code have
+  // no arguments to capture, so formatting can be deferred until msg() is called.
+}
+
+void ErrorMsg::InitMessage() const {
+  message_ = strings::Substitute(g_ErrorCodes_constants.TErrorMessage[error_]);
+}
 
 ErrorMsg::ErrorMsg(TErrorCode::type error, const ArgType& arg0)
     : error_(error),
@@ -114,8 +114,11 @@ class ErrorMsg {
     error_ = e;
   }
 
-  // Returns the formatted error string
+  // Returns the formatted error string. For messages constructed from only an error
+  // code, formatting is deferred to the first call of this method, so hot paths that
+  // create and consume a Status without ever reporting it don't pay for Substitute().
   const std::string& msg() const {
+    if (message_.empty() && error_ != TErrorCode::OK) InitMessage();
     return message_;
   }
 
@@ -127,7 +130,7 @@ class ErrorMsg {
   // message of the original error and the attached detail strings.
   std::string GetFullMessageDetails() const {
     std::stringstream ss;
-    ss << message_ << "\n";
+    ss << msg() << "\n";
     for(size_t i=0, end=details_.size(); i < end; ++i) {
       ss << details_[i] << "\n";
     }
@@ -135,8 +138,15 @@ class ErrorMsg {
   }
 
 private:
+  // Formats message_ from the error code's message template. Factored out of msg() so
+  // the deferred-formatting check inlines without the Substitute() call.
+  void InitMessage() const;
+
   TErrorCode::type error_;
-  std::string message_;
+
+  // Mutable so msg() can format lazily for code-only messages; logically const.
+  mutable std::string message_;
+
   std::vector<std::string> details_;
 };
 
@@ -0,0 +1,105 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/gzip-logger.h"
+
+#include <sstream>
+#include <zlib.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "util/simple-logger.h"
+
+using namespace std;
+using namespace boost;
+using namespace boost::posix_time;
+using namespace impala;
+
+const ptime EPOCH = time_from_string("1970-01-01 00:00:00.000");
+
+void GzipLogger::GenerateLogFileName() {
+  stringstream ss;
+  int64_t ms_since_epoch =
+      (microsec_clock::universal_time() - EPOCH).total_milliseconds();
+  ss << log_dir_ << "/" << log_file_name_prefix_ << ms_since_epoch << ".gz";
+  log_file_name_ = ss.str();
+}
+
+GzipLogger::GzipLogger(const string& log_dir, const string& log_file_name_prefix,
+    uint64_t max_entries_per_file)
+    : log_dir_(log_dir),
+      log_file_name_prefix_(log_file_name_prefix),
+      num_log_file_entries_(0),
+      max_entries_per_file_(max_entries_per_file),
+      gz_file_(NULL) {
+}
+
+GzipLogger::~GzipLogger() {
+  lock_guard<mutex> l(log_file_lock_);
+  if (gz_file_ != NULL) {
+    gzclose(reinterpret_cast<gzFile>(gz_file_));
+    gz_file_ = NULL;
+  }
+}
+
+Status GzipLogger::Init() {
+  // Check that Init hasn't already been called by verifying the log_file_name_ is still
+  // empty.
+  DCHECK(log_file_name_.empty());
+  RETURN_IF_ERROR(InitLoggingDir(log_dir_));
+  GenerateLogFileName();
+  RETURN_IF_ERROR(FlushInternal());
+  LOG(INFO) << "Logging to: " << log_file_name_;
+  return Status::OK;
+}
+
+Status GzipLogger::AppendEntry(const string& entry) {
+  lock_guard<mutex> l(log_file_lock_);
+  if (num_log_file_entries_ > max_entries_per_file_) {
+    num_log_file_entries_ = 0;
+    GenerateLogFileName();
+    RETURN_IF_ERROR(FlushInternal());
+  }
+  if (gz_file_ == NULL) return Status("Log file is not open: " + log_file_name_);
+  gzFile file = reinterpret_cast<gzFile>(gz_file_);
+  uint32_t len = entry.size();
+  if (gzwrite(file, &len, sizeof(len)) != sizeof(len)) {
+    return Status("Could not write to log file: " + log_file_name_);
+  }
+  if (len > 0 && gzwrite(file, entry.data(), len) != static_cast<int>(len)) {
+    return Status("Could not write to log file: " + log_file_name_);
+  }
+  ++num_log_file_entries_;
+  return Status::OK;
+}
+
+Status GzipLogger::Flush() {
+  lock_guard<mutex> l(log_file_lock_);
+  return FlushInternal();
+}
+
+Status GzipLogger::FlushInternal() {
+  if (gz_file_ != NULL) {
+    // gzflush() can only sync the stream at a compression block boundary; closing the
+    // file finishes the gzip member and makes the results visible, mirroring
+    // SimpleLogger's close / reopen. Re-opening in append mode starts a new member,
+    // which gzip readers transparently concatenate with the previous ones.
+    gzclose(reinterpret_cast<gzFile>(gz_file_));
+    gz_file_ = NULL;
+  }
+  gzFile file = gzopen(log_file_name_.c_str(), "ab");
+  if (file == NULL) return Status("Could not open log file: " + log_file_name_);
+  gz_file_ = file;
+  return Status::OK;
+}
@@ -0,0 +1,98 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_UTIL_GZIP_LOGGER_H
+#define IMPALA_UTIL_GZIP_LOGGER_H
+
+#include <boost/thread/thread.hpp>
+#include <string>
+
+#include "common/status.h"
+
+namespace impala {
+
+// A SimpleLogger-style thread-safe logger that writes length-prefixed binary records
+// through a gzip stream. Each entry is framed as a 4-byte length (host byte order)
+// followed by the entry bytes, so readers can split records without interpreting
+// their contents.
+//
+// Compressing the stream as a whole, rather than each entry individually, lets the
+// compressor share its window across entries. That is what makes the format compact
+// for query profiles: the counter and node names that repeat in every profile are
+// encoded once per compression window rather than once per query.
+//
+// Like SimpleLogger, the log file is rolled after a specified number of entries and
+// Flush() makes buffered entries durable by closing and re-opening the file.
+// Re-opening appends a new gzip member to the file; gzip readers (zcat, gzread())
+// transparently concatenate members, so a log is always readable up to its last flush.
+class GzipLogger {
+ public:
+  GzipLogger(const std::string& log_dir, const std::string& log_file_name_prefix,
+      uint64_t max_entries_per_file);
+
+  // Closes the current log file, if any.
+  ~GzipLogger();
+
+  // Initializes the logging directory and creates the initial log file. If the log dir
+  // does not already exist, it will be created. This function is not thread safe and
+  // should only be called once.
+  Status Init();
+
+  // Appends the given entry to the log file as a length-prefixed record. If the log
+  // file already contains the specified entry limit, a new log file will be created.
+  // This function is thread safe and blocks while a Flush() is in progress.
+  Status AppendEntry(const std::string& entry);
+
+  // Finishes the current gzip member and re-opens the file in append mode so that all
+  // records written so far become visible. This function is thread safe and blocks
+  // while an AppendEntry() is in progress.
+  Status Flush();
+
+ private:
+  // Protects all members below.
+  boost::mutex log_file_lock_;
+
+  // Directory to log to.
+  std::string log_dir_;
+
+  // Prefix for all log files. Generated file names carry a ".gz" suffix.
+  std::string log_file_name_prefix_;
+
+  // Counts the number of entries written to the current log file; used to decide when
+  // to roll the log file.
+  uint64_t num_log_file_entries_;
+
+  // The maximum number of entries for each log file. If this number is reached the log
+  // file will be rolled.
+  uint64_t max_entries_per_file_;
+
+  // Handle to the open gzip stream (a zlib gzFile; typed as void* to keep zlib.h out
+  // of this header), or NULL if no file is open.
+  void* gz_file_;
+
+  // Current log file name.
+  std::string log_file_name_;
+
+  // Generates and sets a new log file name that is based off the log file name prefix
+  // and the current system time. The format will be: PREFIX<UTC timestamp>.gz
+  void GenerateLogFileName();
+
+  // Finishes the current gzip member (if a file is open) and re-opens the log file in
+  // append mode. Must be called with the log_file_lock_ held.
+  Status FlushInternal();
+};
+
+}
+
+#endif
@@ -57,6 +57,42 @@ class HashUtil {
     return hash;
   }
 
+  // Compute a 64-bit hash for data using the SSE4 crc32q instruction. Two independent
+  // 32-bit CRC lanes are run over the input (the second lane over the complemented
+  // words) and combined with a Murmur-style finalization so that all 64 output bits
+  // are usable for bucket selection. A single 32-bit CRC clusters badly once hash
+  // tables grow towards 2^32 buckets; see Hash64() for when to prefer this.
+  // This should only be called if SSE is supported.
+  static uint64_t CrcHash64(const void* data, int32_t bytes, uint64_t hash) {
+    DCHECK(CpuInfo::IsSupported(CpuInfo::SSE4_2));
+    uint32_t words = bytes / sizeof(uint64_t);
+    bytes = bytes % sizeof(uint64_t);
+
+    uint64_t h1 = hash & 0xFFFFFFFF;
+    uint64_t h2 = hash >> 32;
+
+    const uint64_t* p = reinterpret_cast<const uint64_t*>(data);
+    while (words--) {
+      h1 = SSE4_crc32_u64(h1, *p);
+      h2 = SSE4_crc32_u64(h2, ~(*p));
+      ++p;
+    }
+
+    const uint8_t* s = reinterpret_cast<const uint8_t*>(p);
+    while (bytes--) {
+      h1 = SSE4_crc32_u8(h1, *s);
+      h2 = SSE4_crc32_u8(h2, static_cast<uint8_t>(~(*s)));
+      ++s;
+    }
+
+    uint64_t h = (h2 << 32) | h1;
+    // Finalization step from Murmur2 to diffuse the CRC bits through the whole result.
+    h ^= h >> MURMUR_R;
+    h *= MURMUR_PRIME;
+    h ^= h >> MURMUR_R;
+    return h;
+  }
+
   static const uint64_t MURMUR_PRIME = 0xc6a4a7935bd1e995;
   static const int MURMUR_R = 47;
 
@@ -140,6 +176,18 @@ class HashUtil {
     }
   }
 
+  // Computes a 64-bit hash value for data. Will call either CrcHash64 or MurmurHash
+  // depending on hardware capabilities. Prefer this over Hash() whenever the consumer
+  // uses more than the low 32 bits of the result, e.g. bucket selection in very large
+  // hash tables, where folding a 32-bit hash causes clustering.
+  static uint64_t Hash64(const void* data, int32_t bytes, uint64_t seed) {
+    if (LIKELY(CpuInfo::IsSupported(CpuInfo::SSE4_2))) {
+      return CrcHash64(data, bytes, seed);
+    } else {
+      return MurmurHash2_64(data, bytes, seed);
+    }
+  }
+
 };
 
 }
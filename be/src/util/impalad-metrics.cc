@@ -32,6 +32,8 @@ const char* ImpaladMetricKeys::IMPALA_SERVER_NUM_QUERIES =
     "impala-server.num-queries";
 const char* ImpaladMetricKeys::IMPALA_SERVER_NUM_FRAGMENTS =
     "impala-server.num-fragments";
+const char* ImpaladMetricKeys::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT =
+    "impala-server.num-fragments-in-flight";
 const char* ImpaladMetricKeys::TOTAL_SCAN_RANGES_PROCESSED =
     "impala-server.scan-ranges.total";
 const char* ImpaladMetricKeys::NUM_SCAN_RANGES_MISSING_VOLUME_ID =
@@ -40,8 +42,12 @@ const char* ImpaladMetricKeys::MEM_POOL_TOTAL_BYTES =
     "impala-server.mem-pool.total-bytes";
 const char* ImpaladMetricKeys::HASH_TABLE_TOTAL_BYTES =
     "impala-server.hash-table.total-bytes";
+const char* ImpaladMetricKeys::CODEGEN_COMPILE_TIMES =
+    "impala-server.codegen.compile-times";
 const char* ImpaladMetricKeys::IO_MGR_NUM_OPEN_FILES =
     "impala-server.io-mgr.num-open-files";
+const char* ImpaladMetricKeys::IO_MGR_NUM_CACHED_FILE_HANDLES =
+    "impala-server.io-mgr.num-cached-file-handles";
 const char* ImpaladMetricKeys::IO_MGR_NUM_BUFFERS =
     "impala-server.io-mgr.num-buffers";
 const char* ImpaladMetricKeys::IO_MGR_TOTAL_BYTES =
@@ -89,24 +95,26 @@ IntCounter* ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS = NULL;
 IntCounter* ImpaladMetrics::IMPALA_SERVER_NUM_QUERIES = NULL;
 IntCounter* ImpaladMetrics::NUM_QUERIES_EXPIRED = NULL;
 IntCounter* ImpaladMetrics::NUM_QUERIES_SPILLED = NULL;
-IntCounter* ImpaladMetrics::NUM_RANGES_MISSING_VOLUME_ID = NULL;
-IntCounter* ImpaladMetrics::NUM_RANGES_PROCESSED = NULL;
+AtomicIntCounter* ImpaladMetrics::NUM_RANGES_MISSING_VOLUME_ID = NULL;
+AtomicIntCounter* ImpaladMetrics::NUM_RANGES_PROCESSED = NULL;
 IntCounter* ImpaladMetrics::NUM_SESSIONS_EXPIRED = NULL;
 
 // Gauges
 IntGauge* ImpaladMetrics::CATALOG_NUM_DBS = NULL;
 IntGauge* ImpaladMetrics::CATALOG_NUM_TABLES = NULL;
+IntGauge* ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT = NULL;
 IntGauge* ImpaladMetrics::IMPALA_SERVER_NUM_OPEN_BEESWAX_SESSIONS = NULL;
 IntGauge* ImpaladMetrics::IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS = NULL;
-IntGauge* ImpaladMetrics::IO_MGR_NUM_BUFFERS = NULL;
 IntGauge* ImpaladMetrics::IO_MGR_NUM_OPEN_FILES = NULL;
-IntGauge* ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS = NULL;
-IntGauge* ImpaladMetrics::IO_MGR_TOTAL_BYTES = NULL;
-IntGauge* ImpaladMetrics::IO_MGR_BYTES_READ = NULL;
-IntGauge* ImpaladMetrics::IO_MGR_LOCAL_BYTES_READ = NULL;
-IntGauge* ImpaladMetrics::IO_MGR_SHORT_CIRCUIT_BYTES_READ = NULL;
-IntGauge* ImpaladMetrics::IO_MGR_CACHED_BYTES_READ = NULL;
-IntGauge* ImpaladMetrics::IO_MGR_BYTES_WRITTEN = NULL;
+IntGauge* ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES = NULL;
+AtomicIntGauge* ImpaladMetrics::IO_MGR_NUM_BUFFERS = NULL;
+AtomicIntGauge* ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS = NULL;
+AtomicIntGauge* ImpaladMetrics::IO_MGR_TOTAL_BYTES = NULL;
+AtomicIntGauge* ImpaladMetrics::IO_MGR_BYTES_READ = NULL;
+AtomicIntGauge* ImpaladMetrics::IO_MGR_LOCAL_BYTES_READ = NULL;
+AtomicIntGauge* ImpaladMetrics::IO_MGR_SHORT_CIRCUIT_BYTES_READ = NULL;
+AtomicIntGauge* ImpaladMetrics::IO_MGR_CACHED_BYTES_READ = NULL;
+AtomicIntGauge* ImpaladMetrics::IO_MGR_BYTES_WRITTEN = NULL;
 IntGauge* ImpaladMetrics::MEM_POOL_TOTAL_BYTES = NULL;
 IntGauge* ImpaladMetrics::NUM_FILES_OPEN_FOR_INSERT = NULL;
 IntGauge* ImpaladMetrics::RESULTSET_CACHE_TOTAL_NUM_ROWS = NULL;
@@ -118,6 +126,9 @@ BooleanProperty* ImpaladMetrics::IMPALA_SERVER_READY = NULL;
 StringProperty* ImpaladMetrics::IMPALA_SERVER_START_TIME = NULL;
 StringProperty* ImpaladMetrics::IMPALA_SERVER_VERSION = NULL;
 
+// Statistics
+StatsMetric<double>* ImpaladMetrics::CODEGEN_COMPILE_TIMES = NULL;
+
 void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
   // Initialize impalad metrics
   IMPALA_SERVER_START_TIME = m->AddProperty<string>(
@@ -135,6 +146,8 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
       ImpaladMetricKeys::NUM_QUERIES_SPILLED, 0L);
   IMPALA_SERVER_NUM_FRAGMENTS = m->AddCounter(
       ImpaladMetricKeys::IMPALA_SERVER_NUM_FRAGMENTS, 0L);
+  IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT, 0L);
   IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS = m->AddGauge<int64_t>(
       ImpaladMetricKeys::IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS, 0L);
   IMPALA_SERVER_NUM_OPEN_BEESWAX_SESSIONS = m->AddGauge<int64_t>(
@@ -147,9 +160,9 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
       ImpaladMetricKeys::RESULTSET_CACHE_TOTAL_BYTES, 0L);
 
   // Initialize scan node metrics
-  NUM_RANGES_PROCESSED = m->AddCounter(
+  NUM_RANGES_PROCESSED = m->AddAtomicCounter(
       ImpaladMetricKeys::TOTAL_SCAN_RANGES_PROCESSED, 0L);
-  NUM_RANGES_MISSING_VOLUME_ID = m->AddCounter(
+  NUM_RANGES_MISSING_VOLUME_ID = m->AddAtomicCounter(
       ImpaladMetricKeys::NUM_SCAN_RANGES_MISSING_VOLUME_ID, 0L);
 
   // Initialize memory usage metrics
@@ -158,6 +171,10 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
   HASH_TABLE_TOTAL_BYTES = m->AddGauge(
       ImpaladMetricKeys::HASH_TABLE_TOTAL_BYTES, 0L, TUnit::BYTES);
 
+  // Initialize codegen metrics
+  CODEGEN_COMPILE_TIMES = m->RegisterMetric(new StatsMetric<double>(
+      ImpaladMetricKeys::CODEGEN_COMPILE_TIMES, TUnit::TIME_MS));
+
   // Initialize insert metrics
   NUM_FILES_OPEN_FOR_INSERT = m->AddGauge<int64_t>(
       ImpaladMetricKeys::NUM_FILES_OPEN_FOR_INSERT, 0L);
@@ -165,22 +182,24 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
   // Initialize IO mgr metrics
   IO_MGR_NUM_OPEN_FILES = m->AddGauge<int64_t>(
       ImpaladMetricKeys::IO_MGR_NUM_OPEN_FILES, 0L);
-  IO_MGR_NUM_BUFFERS = m->AddGauge<int64_t>(
+  IO_MGR_NUM_CACHED_FILE_HANDLES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::IO_MGR_NUM_CACHED_FILE_HANDLES, 0L);
+  IO_MGR_NUM_BUFFERS = m->AddAtomicGauge(
       ImpaladMetricKeys::IO_MGR_NUM_BUFFERS, 0L);
-  IO_MGR_TOTAL_BYTES = m->AddGauge<int64_t>(
+  IO_MGR_TOTAL_BYTES = m->AddAtomicGauge(
       ImpaladMetricKeys::IO_MGR_TOTAL_BYTES, 0L, TUnit::BYTES);
-  IO_MGR_NUM_UNUSED_BUFFERS = m->AddGauge<int64_t>(
+  IO_MGR_NUM_UNUSED_BUFFERS = m->AddAtomicGauge(
       ImpaladMetricKeys::IO_MGR_NUM_UNUSED_BUFFERS, 0L);
 
-  IO_MGR_BYTES_READ = m->AddGauge(
+  IO_MGR_BYTES_READ = m->AddAtomicGauge(
       ImpaladMetricKeys::IO_MGR_BYTES_READ, 0L, TUnit::BYTES);
-  IO_MGR_LOCAL_BYTES_READ = m->AddGauge(
+  IO_MGR_LOCAL_BYTES_READ = m->AddAtomicGauge(
       ImpaladMetricKeys::IO_MGR_LOCAL_BYTES_READ, 0L, TUnit::BYTES);
-  IO_MGR_CACHED_BYTES_READ = m->AddGauge<int64_t>(
+  IO_MGR_CACHED_BYTES_READ = m->AddAtomicGauge(
       ImpaladMetricKeys::IO_MGR_CACHED_BYTES_READ, 0L, TUnit::BYTES);
-  IO_MGR_SHORT_CIRCUIT_BYTES_READ = m->AddGauge<int64_t>(
+  IO_MGR_SHORT_CIRCUIT_BYTES_READ = m->AddAtomicGauge(
       ImpaladMetricKeys::IO_MGR_SHORT_CIRCUIT_BYTES_READ, 0L, TUnit::BYTES);
-  IO_MGR_BYTES_WRITTEN = m->AddGauge<int64_t>(
+  IO_MGR_BYTES_WRITTEN = m->AddAtomicGauge(
       ImpaladMetricKeys::IO_MGR_BYTES_WRITTEN, 0L, TUnit::BYTES);
 
   // Initialize catalog metrics
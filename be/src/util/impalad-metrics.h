@@ -16,6 +16,7 @@
 #ifndef IMPALA_UTIL_IMPALAD_METRICS_H
 #define IMPALA_UTIL_IMPALAD_METRICS_H
 
+#include "util/collection-metrics.h"
 #include "util/metrics.h"
 
 namespace impala {
@@ -40,6 +41,9 @@ class ImpaladMetricKeys {
   // queries
   static const char* IMPALA_SERVER_NUM_FRAGMENTS;
 
+  // Number of fragments currently executing on this server
+  static const char* IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT;
+
   // Number of open HiveServer2 sessions
   static const char* IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS;
 
@@ -58,9 +62,15 @@ class ImpaladMetricKeys {
   // Number of bytes currently in use across all hash tables
   static const char* HASH_TABLE_TOTAL_BYTES;
 
+  // Distribution of per-fragment codegen compilation times
+  static const char* CODEGEN_COMPILE_TIMES;
+
   // Number of files currently opened by the io mgr
   static const char* IO_MGR_NUM_OPEN_FILES;
 
+  // Number of idle hdfs file handles cached by the io mgr
+  static const char* IO_MGR_NUM_CACHED_FILE_HANDLES;
+
   // Number of IO buffers allocated by the io mgr
   static const char* IO_MGR_NUM_BUFFERS;
 
@@ -128,23 +138,29 @@ class ImpaladMetrics {
   static IntCounter* IMPALA_SERVER_NUM_QUERIES;
   static IntCounter* NUM_QUERIES_EXPIRED;
   static IntCounter* NUM_QUERIES_SPILLED;
-  static IntCounter* NUM_RANGES_MISSING_VOLUME_ID;
-  static IntCounter* NUM_RANGES_PROCESSED;
+  // Scan-range counters are bumped once per range from scanner threads, so they use
+  // the lock-free metric type.
+  static AtomicIntCounter* NUM_RANGES_MISSING_VOLUME_ID;
+  static AtomicIntCounter* NUM_RANGES_PROCESSED;
   static IntCounter* NUM_SESSIONS_EXPIRED;
   // Gauges
   static IntGauge* CATALOG_NUM_DBS;
   static IntGauge* CATALOG_NUM_TABLES;
+  static IntGauge* IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT;
   static IntGauge* IMPALA_SERVER_NUM_OPEN_BEESWAX_SESSIONS;
   static IntGauge* IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS;
-  static IntGauge* IO_MGR_NUM_BUFFERS;
+  static IntGauge* IO_MGR_NUM_CACHED_FILE_HANDLES;
   static IntGauge* IO_MGR_NUM_OPEN_FILES;
-  static IntGauge* IO_MGR_NUM_UNUSED_BUFFERS;
-  static IntGauge* IO_MGR_TOTAL_BYTES;
-  static IntGauge* IO_MGR_BYTES_READ;
-  static IntGauge* IO_MGR_LOCAL_BYTES_READ;
-  static IntGauge* IO_MGR_CACHED_BYTES_READ;
-  static IntGauge* IO_MGR_SHORT_CIRCUIT_BYTES_READ;
-  static IntGauge* IO_MGR_BYTES_WRITTEN;
+  // The IO manager updates these from the disk threads once per buffer, so they use
+  // the lock-free metric type.
+  static AtomicIntGauge* IO_MGR_NUM_BUFFERS;
+  static AtomicIntGauge* IO_MGR_NUM_UNUSED_BUFFERS;
+  static AtomicIntGauge* IO_MGR_TOTAL_BYTES;
+  static AtomicIntGauge* IO_MGR_BYTES_READ;
+  static AtomicIntGauge* IO_MGR_LOCAL_BYTES_READ;
+  static AtomicIntGauge* IO_MGR_CACHED_BYTES_READ;
+  static AtomicIntGauge* IO_MGR_SHORT_CIRCUIT_BYTES_READ;
+  static AtomicIntGauge* IO_MGR_BYTES_WRITTEN;
   static IntGauge* MEM_POOL_TOTAL_BYTES;
   static IntGauge* NUM_FILES_OPEN_FOR_INSERT;
   static IntGauge* RESULTSET_CACHE_TOTAL_NUM_ROWS;
@@ -154,6 +170,10 @@ class ImpaladMetrics {
   static BooleanProperty* IMPALA_SERVER_READY;
   static StringProperty* IMPALA_SERVER_START_TIME;
   static StringProperty* IMPALA_SERVER_VERSION;
+  // Statistics
+  // Per-fragment codegen compilation times in ms; exposes count/min/max/mean/stddev
+  // of the codegen latency floor at /metrics.
+  static StatsMetric<double>* CODEGEN_COMPILE_TIMES;
 
   // Creates and initializes all metrics above in 'm'.
   static void CreateMetrics(MetricGroup* m);
@@ -53,7 +53,7 @@ class KeyNormalizer {
  public:
   // Initializes the normalizer with the key exprs and length alloted to each normalized
   // key.
-  KeyNormalizer(const std::vector<ExprContext*>& key_exprs_ctxs, int key_len,
+  KeyNormalizer(const std::vector<ExprContext*>& key_expr_ctxs, int key_len,
       const std::vector<bool>& is_asc, const std::vector<bool>& nulls_first)
       : key_expr_ctxs_(key_expr_ctxs), key_len_(key_len), is_asc_(is_asc),
         nulls_first_(nulls_first) {
@@ -66,6 +66,21 @@ class KeyNormalizer {
   // TODO: Handle non-nullable columns
   bool NormalizeKey(TupleRow* tuple_row, uint8_t* dst, int* key_idx_over_budget = NULL);
 
+  // Returns true if every expr in 'key_expr_ctxs' is a fixed-width type that
+  // normalizes losslessly and the combined normalized size (one null byte plus the
+  // value bytes per key) fits in 'key_len' bytes, i.e. keys produced for these exprs
+  // fully determine their sort order via memcmp. Strings are excluded as lossy and
+  // floats because the normalized order of NaNs differs from RawValue::Compare().
+  static bool KeysFit(const std::vector<ExprContext*>& key_expr_ctxs, int key_len);
+
+  // Returns the number of leading exprs in 'key_expr_ctxs' that normalize losslessly
+  // (per the same type restrictions as KeysFit()) and whose combined normalized size
+  // fits in 'key_len' bytes. Keys built over just those exprs are a correct sort key
+  // prefix: rows whose keys differ are ordered correctly by memcmp, while rows whose
+  // keys are equal may still differ on the remaining exprs and need a tie-break.
+  static int NumNormalizableKeys(const std::vector<ExprContext*>& key_expr_ctxs,
+      int key_len);
+
  private:
   // Returns true if we went over the max key size while writing the null bit.
   static bool WriteNullBit(uint8_t null_bit, uint8_t* value, uint8_t* dst,
@@ -180,6 +180,34 @@ inline bool KeyNormalizer::NormalizeKey(TupleRow* row, uint8_t* dst,
   return false;
 }
 
+inline int KeyNormalizer::NumNormalizableKeys(
+    const std::vector<ExprContext*>& key_expr_ctxs, int key_len) {
+  int bytes_required = 0;
+  for (int i = 0; i < key_expr_ctxs.size(); ++i) {
+    const ColumnType& type = key_expr_ctxs[i]->root()->type();
+    switch (type.type) {
+      case TYPE_BOOLEAN:
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT:
+        break;
+      default:
+        return i;
+    }
+    // Each key column is preceded by a null byte.
+    bytes_required += 1 + type.GetByteSize();
+    if (bytes_required > key_len) return i;
+  }
+  return key_expr_ctxs.size();
+}
+
+inline bool KeyNormalizer::KeysFit(const std::vector<ExprContext*>& key_expr_ctxs,
+    int key_len) {
+  if (key_expr_ctxs.empty()) return false;
+  return NumNormalizableKeys(key_expr_ctxs, key_len) == key_expr_ctxs.size();
+}
+
 }
 
 #endif
@@ -23,6 +23,7 @@
 #include <sstream>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "util/pretty-printer.h"
@@ -30,12 +31,20 @@
 using namespace boost;
 using namespace std;
 
+DEFINE_bool(madvise_huge_pages, false, "(Advanced) If true, advise the kernel to back "
+    "large hash table and block mgr buffers with transparent huge pages to reduce TLB "
+    "misses. Requires transparent hugepages enabled in 'always' or 'madvise' mode.");
+
 namespace impala {
 
+// Transparent hugepages are 2MB on all platforms we support.
+static const int64_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
 bool MemInfo::initialized_ = false;
 int64_t MemInfo::physical_mem_ = -1;
 int32_t MemInfo::vm_overcommit_ = -1;
 int64_t MemInfo::commit_limit_ = -1;
+bool MemInfo::thp_madvise_supported_ = false;
 
 // Lines in meminfo have the form key colon whitespace value for example:
 // MemTotal: 16129508 kB
@@ -52,6 +61,9 @@ void MemInfo::Init() {
   // Read overcommit settings
   ParseOvercommit();
 
+  // Read transparent hugepage settings
+  ParseThp();
+
   // Read from /proc/meminfo
   ifstream meminfo("/proc/meminfo", ios::in);
   string line;
@@ -90,12 +102,47 @@ void MemInfo::ParseOvercommit() {
   overcommit_s >> vm_overcommit_;
 }
 
+void MemInfo::ParseThp() {
+  // The file contains the possible modes with the active one in brackets, e.g.
+  // 'always [madvise] never'. MADV_HUGEPAGE is honoured unless the mode is 'never'.
+  ifstream thp_s("/sys/kernel/mm/transparent_hugepage/enabled", ios::in);
+  string line;
+  getline(thp_s, line);
+  thp_madvise_supported_ =
+      line.find("[always]") != string::npos || line.find("[madvise]") != string::npos;
+}
+
+int64_t MemInfo::AdviseHugePages(void* ptr, int64_t len) {
+  // Checked first so callers in tests that don't call Init() take the early out.
+  if (!FLAGS_madvise_huge_pages) return 0;
+  DCHECK(initialized_);
+  if (!thp_madvise_supported_) return 0;
+#ifdef MADV_HUGEPAGE
+  // madvise() requires page alignment and huge pages are only used for fully covered
+  // 2MB regions, so only advise the hugepage-aligned interior of the buffer.
+  uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+  uintptr_t aligned_start = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+  uintptr_t aligned_end = (start + len) & ~(HUGE_PAGE_SIZE - 1);
+  if (aligned_start >= aligned_end) return 0;
+  if (madvise(reinterpret_cast<void*>(aligned_start), aligned_end - aligned_start,
+          MADV_HUGEPAGE) != 0) {
+    return 0;
+  }
+  return aligned_end - aligned_start;
+#else
+  return 0;
+#endif
+}
+
 string MemInfo::DebugString() {
   DCHECK(initialized_);
   stringstream stream;
   stream << "Physical Memory: "
          << PrettyPrinter::Print(physical_mem_, TUnit::BYTES)
          << endl;
+  stream << "Transparent Hugepages (madvise): "
+         << (thp_madvise_supported_ ? "supported" : "unsupported")
+         << endl;
   return stream.str();
 }
 
@@ -51,12 +51,28 @@ class MemInfo {
     return commit_limit_;
   }
 
+  // True if transparent hugepages are enabled in 'always' or 'madvise' mode, i.e.
+  // MADV_HUGEPAGE advice will be honoured by the kernel.
+  static bool thp_madvise_supported() {
+    DCHECK(initialized_);
+    return thp_madvise_supported_;
+  }
+
+  // Advises the kernel to back the hugepage-aligned interior of [ptr, ptr + len) with
+  // transparent huge pages. Intended for large, long-lived buffers (hash table bucket
+  // arrays, block mgr IO buffers) where TLB misses are measurable. Returns the number
+  // of bytes advised, which is 0 if --madvise_huge_pages is disabled, the kernel does
+  // not support madvise-mode THP, or the range does not span a full huge page.
+  static int64_t AdviseHugePages(void* ptr, int64_t len);
+
   static std::string DebugString();
 
  private:
 
   static void ParseOvercommit();
 
+  static void ParseThp();
+
   static bool initialized_;
   static int64_t physical_mem_;
 
@@ -71,6 +87,10 @@ class MemInfo {
 
   // If overcommit is turned off the maximum allocatable memory
   static int64_t commit_limit_;
+
+  // Whether the kernel honours MADV_HUGEPAGE, parsed from
+  // /sys/kernel/mm/transparent_hugepage/enabled.
+  static bool thp_madvise_supported_;
 };
 
 }
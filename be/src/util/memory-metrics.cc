@@ -19,6 +19,7 @@
 #include <gutil/strings/substitute.h>
 
 #include "util/jni-util.h"
+#include "util/thread.h"
 #include "util/time.h"
 
 using namespace boost;
@@ -26,6 +27,11 @@ using namespace boost::algorithm;
 using namespace impala;
 using namespace strings;
 
+DEFINE_int64(jvm_pause_monitor_interval_ms, 500, "(Advanced) Interval at which the JVM "
+    "pause monitor makes its probe call into the JVM. Set to 0 to disable the monitor.");
+DEFINE_int64(jvm_pause_warn_threshold_ms, 1000, "(Advanced) JVM probe round-trip times "
+    "above this threshold are counted and logged as JVM pauses.");
+
 TcmallocMetric* TcmallocMetric::BYTES_IN_USE = NULL;
 TcmallocMetric* TcmallocMetric::PAGEHEAP_FREE_BYTES = NULL;
 TcmallocMetric* TcmallocMetric::TOTAL_BYTES_RESERVED = NULL;
@@ -51,11 +57,57 @@ Status impala::RegisterMemoryMetrics(MetricGroup* metrics, bool register_jvm_met
 #endif
 
   if (register_jvm_metrics) {
-    RETURN_IF_ERROR(JvmMetric::InitMetrics(metrics->GetChildGroup("jvm")));
+    MetricGroup* jvm_metrics = metrics->GetChildGroup("jvm");
+    RETURN_IF_ERROR(JvmMetric::InitMetrics(jvm_metrics));
+    if (FLAGS_jvm_pause_monitor_interval_ms > 0) {
+      RETURN_IF_ERROR(JvmPauseMonitor::Start(jvm_metrics));
+    }
   }
   return Status::OK;
 }
 
+IntGauge* JvmPauseMonitor::last_round_trip_time_ms_ = NULL;
+IntCounter* JvmPauseMonitor::num_pauses_ = NULL;
+IntCounter* JvmPauseMonitor::total_pause_time_ms_ = NULL;
+scoped_ptr<Thread> JvmPauseMonitor::monitor_thread_;
+
+Status JvmPauseMonitor::Start(MetricGroup* metrics) {
+  DCHECK(monitor_thread_.get() == NULL);
+  last_round_trip_time_ms_ = metrics->AddGauge<int64_t>(
+      "jvm.pause-monitor.last-round-trip-time-ms", 0, TUnit::TIME_MS);
+  num_pauses_ = metrics->AddCounter<int64_t>("jvm.pause-monitor.num-pauses", 0);
+  total_pause_time_ms_ = metrics->AddCounter<int64_t>(
+      "jvm.pause-monitor.total-pause-time-ms", 0, TUnit::TIME_MS);
+  monitor_thread_.reset(new Thread("common", "jvm-pause-monitor", &Run));
+  return Status::OK;
+}
+
+void JvmPauseMonitor::Run() {
+  while (true) {
+    SleepForMs(FLAGS_jvm_pause_monitor_interval_ms);
+    // Probe with the cheapest available JNI entry point: a metrics request for a
+    // non-existent memory pool does no work on the Java side.
+    TGetJvmMetricsRequest request;
+    request.get_all = false;
+    request.__set_memory_pool("");
+    TGetJvmMetricsResponse response;
+    int64_t start = MonotonicMillis();
+    Status status = JniUtil::GetJvmMetrics(request, &response);
+    int64_t elapsed_ms = MonotonicMillis() - start;
+    if (!status.ok()) {
+      LOG(WARNING) << "JVM pause monitor probe failed: " << status.GetDetail();
+      continue;
+    }
+    last_round_trip_time_ms_->set_value(elapsed_ms);
+    if (elapsed_ms > FLAGS_jvm_pause_warn_threshold_ms) {
+      num_pauses_->Increment(1);
+      total_pause_time_ms_->Increment(elapsed_ms);
+      LOG(WARNING) << "JNI probe round trip took " << elapsed_ms << "ms. The JVM was "
+                   << "likely paused, e.g. by a full garbage collection.";
+    }
+  }
+}
+
 JvmMetric::JvmMetric(const string& key, const string& mempool_name, JvmMetricType type)
     : IntGauge(key, TUnit::BYTES) {
   mempool_name_ = mempool_name;
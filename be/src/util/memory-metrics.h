@@ -19,6 +19,7 @@
 
 #include <boost/thread/mutex.hpp>
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <google/malloc_extension.h>
 
 #include "util/debug-util.h"
@@ -116,6 +117,33 @@ class JvmMetric : public IntGauge {
   JvmMetricType metric_type_;
 };
 
+// Monitors JVM responsiveness from native code. A dedicated thread periodically makes a
+// trivial JNI call and measures its round-trip time. A native thread calling into Java
+// blocks until any stop-the-world pause (e.g. a full GC) completes, so long round trips
+// are a reliable proxy for JVM pauses, which purely native threads never observe
+// directly. Exposes:
+//  jvm.pause-monitor.last-round-trip-time-ms: the most recent observed round-trip time.
+//  jvm.pause-monitor.num-pauses: number of round trips that exceeded
+//      --jvm_pause_warn_threshold_ms.
+//  jvm.pause-monitor.total-pause-time-ms: total time spent in such round trips.
+class JvmPauseMonitor {
+ public:
+  // Registers the metrics in 'metrics' and starts the monitoring thread. Called at most
+  // once, from RegisterMemoryMetrics().
+  static Status Start(MetricGroup* metrics);
+
+ private:
+  // Loop run by monitor_thread_. Never returns.
+  static void Run();
+
+  static IntGauge* last_round_trip_time_ms_;
+  static IntCounter* num_pauses_;
+  static IntCounter* total_pause_time_ms_;
+
+  // The monitoring thread. Runs for the lifetime of the process.
+  static boost::scoped_ptr<Thread> monitor_thread_;
+};
+
 // Registers common tcmalloc memory metrics. If register_jvm_metrics is true, the JVM
 // memory metrics are also registered.
 Status RegisterMemoryMetrics(MetricGroup* metrics, bool register_jvm_metrics);
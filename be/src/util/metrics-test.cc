@@ -70,6 +70,37 @@ TEST(MetricsTest, GaugeMetrics) {
   AssertValue(int_gauge_with_units, 10, "10s000ms");
 }
 
+TEST(MetricsTest, AtomicMetrics) {
+  MetricGroup metrics("AtomicMetrics");
+  AtomicIntGauge* gauge = metrics.AddAtomicGauge("atomic_gauge", 0L);
+  AssertValue(gauge, 0, "0");
+  gauge->Increment(-1);
+  AssertValue(gauge, -1, "-1");
+  gauge->Increment(10);
+  AssertValue(gauge, 9, "9");
+  gauge->set_value(42);
+  AssertValue(gauge, 42, "42");
+
+  AtomicIntCounter* counter =
+      metrics.AddAtomicCounter("atomic_counter", 0L, TUnit::BYTES);
+  counter->Increment(2048);
+  AssertValue(counter, 2048, "2.00 KB");
+
+  // Metrics appear in the raw-text output in key order, one tab-separated line per
+  // value.
+  stringstream out;
+  metrics.ToRawText(&out);
+  EXPECT_EQ("atomic_counter\t2048\natomic_gauge\t42\n", out.str());
+
+  // Once a full sample period (500ms by default) has elapsed, the sampled metric's
+  // time series appears as well.
+  gauge->Sample(600);
+  stringstream sampled_out;
+  metrics.ToRawText(&sampled_out);
+  EXPECT_EQ("atomic_counter\t2048\natomic_gauge\t42\natomic_gauge.samples\t500\t42\n",
+      sampled_out.str());
+}
+
 TEST(MetricsTest, PropertyMetrics) {
   MetricGroup metrics("PropertyMetrics");
   BooleanProperty* bool_property = metrics.AddProperty("bool_property", false);
@@ -25,6 +25,12 @@
 
 #include "common/logging.h"
 #include "util/impalad-metrics.h"
+#include "util/thread.h"
+#include "util/time.h"
+
+DEFINE_int32(metrics_sample_period_ms, 0, "(Advanced) If positive, the period in "
+    "milliseconds at which the value of every metric is sampled into its time series, "
+    "published at /metrics_raw. <= 0 disables time-series collection.");
 
 using namespace impala;
 using namespace std;
@@ -56,6 +62,18 @@ void Metric::AddStandardFields(Document* document, Value* val) {
 MetricGroup::MetricGroup(const std::string& name)
     : obj_pool_(new ObjectPool()), name_(name) { }
 
+// Thread that periodically samples every metric reachable from 'group' into its time
+// series. Only the root MetricGroup starts this (from Init()), and it runs for the
+// lifetime of the process.
+static void MetricsSamplerThread(MetricGroup* group) {
+  while (true) {
+    SleepForMs(FLAGS_metrics_sample_period_ms);
+    group->SampleMetrics(FLAGS_metrics_sample_period_ms);
+  }
+}
+
+static scoped_ptr<Thread> metrics_sampler_thread;
+
 Status MetricGroup::Init(Webserver* webserver) {
   if (webserver != NULL) {
     Webserver::UrlCallback default_callback =
@@ -66,6 +84,15 @@ Status MetricGroup::Init(Webserver* webserver) {
     Webserver::UrlCallback json_callback =
         bind<void>(mem_fn(&MetricGroup::TemplateCallback), this, _1, _2);
     webserver->RegisterUrlCallback("/metrics", "metrics.tmpl", json_callback);
+
+    Webserver::UrlCallback raw_callback =
+        bind<void>(mem_fn(&MetricGroup::RawTextCallback), this, _1, _2);
+    webserver->RegisterUrlCallback("/metrics_raw", "raw_text.tmpl", raw_callback, false);
+  }
+
+  if (FLAGS_metrics_sample_period_ms > 0 && metrics_sampler_thread.get() == NULL) {
+    metrics_sampler_thread.reset(
+        new Thread("common", "metrics-sampler", &MetricsSamplerThread, this));
   }
 
   return Status::OK;
@@ -167,6 +194,47 @@ void MetricGroup::ToJson(bool include_children, Document* document, Value* out_v
   *out_val = container;
 }
 
+void MetricGroup::SampleMetrics(int ms) {
+  lock_guard<mutex> l(lock_);
+  stack<MetricGroup*> groups;
+  groups.push(this);
+  while (!groups.empty()) {
+    MetricGroup* group = groups.top();
+    groups.pop();
+    BOOST_FOREACH(const ChildGroupMap::value_type& child, group->children_) {
+      groups.push(child.second);
+    }
+    BOOST_FOREACH(const MetricMap::value_type& m, group->metric_map_) {
+      m.second->Sample(ms);
+    }
+  }
+}
+
+void MetricGroup::ToRawText(stringstream* out) {
+  lock_guard<mutex> l(lock_);
+  stack<MetricGroup*> groups;
+  groups.push(this);
+  while (!groups.empty()) {
+    MetricGroup* group = groups.top();
+    groups.pop();
+    BOOST_FOREACH(const ChildGroupMap::value_type& child, group->children_) {
+      groups.push(child.second);
+    }
+    BOOST_FOREACH(const MetricMap::value_type& m, group->metric_map_) {
+      m.second->ToRawText(out);
+    }
+  }
+}
+
+void MetricGroup::RawTextCallback(const Webserver::ArgumentMap& args,
+    Document* document) {
+  stringstream out;
+  ToRawText(&out);
+  Value contents(out.str().c_str(), document->GetAllocator());
+  document->AddMember("contents", contents, document->GetAllocator());
+  document->AddMember(Webserver::ENABLE_RAW_JSON_KEY, true, document->GetAllocator());
+}
+
 MetricGroup* MetricGroup::GetChildGroup(const std::string& name) {
   lock_guard<mutex> l(lock_);
   ChildGroupMap::iterator it = children_.find(name);
@@ -24,12 +24,14 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include "common/atomic.h"
 #include "common/logging.h"
 #include "common/status.h"
 #include "common/object-pool.h"
 #include "util/debug-util.h"
 #include "util/json-util.h"
 #include "util/pretty-printer.h"
+#include "util/streaming-sampler.h"
 #include "util/webserver.h"
 
 namespace impala {
@@ -67,6 +69,18 @@ class Metric {
   // representation that is often displayed in webpages etc.
   virtual std::string ToHumanReadable() = 0;
 
+  // Appends a compact, line-oriented representation of this metric to 'out', for
+  // consumption by external scrapers via /metrics_raw. Each value is one
+  // tab-separated line; metrics without a natural scalar representation may append
+  // nothing. This must be cheap: it is intended to be polled far more frequently
+  // than the JSON endpoints.
+  virtual void ToRawText(std::stringstream* out) { }
+
+  // Called periodically by MetricGroup::SampleMetrics() with the number of
+  // milliseconds elapsed since the last call. Metrics that keep a time series of
+  // their value record a sample here; the default implementation does nothing.
+  virtual void Sample(int ms) { }
+
   const std::string& key() const { return key_; }
   const std::string& description() const { return description_; }
 
@@ -162,6 +176,10 @@ class SimpleMetric : public Metric {
     document->AddMember(key_.c_str(), val, document->GetAllocator());
   }
 
+  virtual void ToRawText(std::stringstream* out) {
+    (*out) << key_ << "\t" << value() << "\n";
+  }
+
   const TUnit::type unit() const { return unit_; }
   const TMetricKind::type kind() const { return metric_kind; }
 
@@ -183,6 +201,98 @@ class SimpleMetric : public Metric {
   T value_;
 };
 
+// An AtomicMetric is an integer-valued metric whose value is read and updated with
+// single atomic instructions; neither operation takes a lock or allocates. Use it in
+// preference to IntGauge / IntCounter for metrics that are updated on hot execution
+// paths (e.g. once per IO buffer), where contending on SimpleMetric's mutex from many
+// threads is measurable.
+//
+// An AtomicMetric also keeps a fixed-size ring buffer of its recent values, filled in
+// by MetricGroup::SampleMetrics() when --metrics_sample_period_ms is set. This lets an
+// external scraper recover a time series of the metric (via /metrics_raw) without
+// itself polling at high frequency; when the buffer fills up, the oldest samples are
+// collapsed and the sample period doubles.
+template<TMetricKind::type metric_kind = TMetricKind::GAUGE>
+class AtomicMetric : public Metric {
+ public:
+  AtomicMetric(const std::string& key, const TUnit::type unit, int64_t initial_value,
+      const std::string& description = "")
+      : Metric(key, description), unit_(unit), value_(initial_value) { }
+
+  virtual ~AtomicMetric() { }
+
+  // Returns the current value. Thread-safe.
+  int64_t value() { return value_.Read(); }
+
+  // Sets the current value. Thread-safe.
+  void set_value(int64_t value) { value_.Swap(value); }
+
+  // Adds 'delta' to the current value atomically.
+  void Increment(int64_t delta) {
+    DCHECK(kind() != TMetricKind::COUNTER || delta >= 0)
+        << "Can't decrement value of COUNTER metric: " << key();
+    value_.UpdateAndFetch(delta);
+  }
+
+  virtual void ToJson(rapidjson::Document* document, rapidjson::Value* val) {
+    rapidjson::Value container(rapidjson::kObjectType);
+    AddStandardFields(document, &container);
+
+    rapidjson::Value metric_value;
+    ToJsonValue(value(), TUnit::NONE, document, &metric_value);
+    container.AddMember("value", metric_value, document->GetAllocator());
+
+    rapidjson::Value type_value(PrintTMetricKind(kind()).c_str(),
+        document->GetAllocator());
+    container.AddMember("kind", type_value, document->GetAllocator());
+    rapidjson::Value units(PrintTUnit(unit()).c_str(), document->GetAllocator());
+    container.AddMember("units", units, document->GetAllocator());
+    *val = container;
+  }
+
+  virtual std::string ToHumanReadable() {
+    return PrettyPrinter::Print(value(), unit());
+  }
+
+  virtual void ToLegacyJson(rapidjson::Document* document) {
+    rapidjson::Value val;
+    ToJsonValue(value(), TUnit::NONE, document, &val);
+    document->AddMember(key_.c_str(), val, document->GetAllocator());
+  }
+
+  // Appends one line with the current value and, if any time-series samples have been
+  // collected, a second '<key>.samples' line with the sample period in ms followed by
+  // the samples themselves, oldest first.
+  virtual void ToRawText(std::stringstream* out) {
+    (*out) << key_ << "\t" << value() << "\n";
+    int num_samples;
+    int period;
+    SpinLock* lock;
+    const int64_t* samples = samples_.GetSamples(&num_samples, &period, &lock);
+    if (num_samples > 0) {
+      (*out) << key_ << ".samples\t" << period;
+      for (int i = 0; i < num_samples; ++i) (*out) << "\t" << samples[i];
+      (*out) << "\n";
+    }
+    lock->Unlock();
+  }
+
+  virtual void Sample(int ms) { samples_.AddSample(value(), ms); }
+
+  const TUnit::type unit() const { return unit_; }
+  const TMetricKind::type kind() const { return metric_kind; }
+
+ private:
+  // Units of this metric
+  const TUnit::type unit_;
+
+  // The current value of the metric
+  AtomicInt<int64_t> value_;
+
+  // Ring buffer of recent values, fed by Sample().
+  StreamingSampler<int64_t, 64> samples_;
+};
+
 // Container for a set of metrics. A MetricGroup owns the memory for every metric
 // contained within it (see Add*() to create commonly used metric
 // types). Metrics are 'registered' with a MetricGroup, once registered they cannot be
@@ -242,6 +352,23 @@ class MetricGroup {
         new SimpleMetric<T, TMetricKind::COUNTER>(key, unit, value, description));
   }
 
+  // Create a lock-free gauge metric object (owned by this object). Prefer this to
+  // AddGauge() for metrics updated on hot execution paths.
+  AtomicMetric<TMetricKind::GAUGE>* AddAtomicGauge(const std::string& key,
+      int64_t value, const TUnit::type unit = TUnit::NONE,
+      const std::string& description = "") {
+    return RegisterMetric(
+        new AtomicMetric<TMetricKind::GAUGE>(key, unit, value, description));
+  }
+
+  // As AddCounter(), but lock-free. See AtomicMetric.
+  AtomicMetric<TMetricKind::COUNTER>* AddAtomicCounter(const std::string& key,
+      int64_t value, const TUnit::type unit = TUnit::UNIT,
+      const std::string& description = "") {
+    return RegisterMetric(
+        new AtomicMetric<TMetricKind::COUNTER>(key, unit, value, description));
+  }
+
   // Returns a metric by key. All MetricGroups reachable from this group are searched in
   // depth-first order, starting with the root group.  Returns NULL if there is no metric
   // with that key. This is not a very cheap operation; the result should be cached where
@@ -273,6 +400,14 @@ class MetricGroup {
   void ToJson(bool include_children, rapidjson::Document* document,
       rapidjson::Value* out_val);
 
+  // Records a time-series sample for every metric in this group and, recursively, in
+  // all of its children. 'ms' is the time elapsed since the last call. Called
+  // periodically by the metrics sampler thread when --metrics_sample_period_ms is set.
+  void SampleMetrics(int ms);
+
+  // Appends the raw-text representation of every metric in this hierarchy to 'out'.
+  void ToRawText(std::stringstream* out);
+
   // Creates or returns an already existing child metric group.
   MetricGroup* GetChildGroup(const std::string& name);
 
@@ -310,6 +445,12 @@ class MetricGroup {
   // If args contains a paramater 'metric', only the json for that metric is returned.
   void CMCompatibleCallback(const Webserver::ArgumentMap& args,
       rapidjson::Document* document);
+
+  // Webserver callback for /metrics_raw. Produces one tab-separated line per metric
+  // value, which is much cheaper for an external scraper to poll and parse than the
+  // JSON endpoints.
+  void RawTextCallback(const Webserver::ArgumentMap& args,
+      rapidjson::Document* document);
 };
 
 // We write 'Int' as a placeholder for all integer types.
@@ -318,6 +459,9 @@ typedef class SimpleMetric<uint64_t, TMetricKind::GAUGE> UIntGauge;
 typedef class SimpleMetric<double, TMetricKind::GAUGE> DoubleGauge;
 typedef class SimpleMetric<int64_t, TMetricKind::COUNTER> IntCounter;
 
+typedef class AtomicMetric<TMetricKind::GAUGE> AtomicIntGauge;
+typedef class AtomicMetric<TMetricKind::COUNTER> AtomicIntCounter;
+
 typedef class SimpleMetric<bool, TMetricKind::PROPERTY> BooleanProperty;
 typedef class SimpleMetric<std::string, TMetricKind::PROPERTY> StringProperty;
 
@@ -0,0 +1,97 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/parallel-compress.h"
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "runtime/mem-pool.h"
+#include "util/codec.h"
+#include "util/thread.h"
+
+using namespace boost;
+using namespace std;
+
+namespace impala {
+
+void ParallelCompressor::CompressWorker(THdfsCompression::type format, MemPool* pool,
+    vector<Block>* blocks, int worker_id, int num_workers, Status* status) {
+  // Codecs are stateful, so every worker creates its own. 'reuse' must be false:
+  // with a reused output buffer, compressing one block would clobber the output of
+  // the previous one.
+  scoped_ptr<Codec> compressor;
+  *status = Codec::CreateCompressor(pool, false, format, &compressor);
+  if (!status->ok()) return;
+  for (int i = worker_id; i < blocks->size(); i += num_workers) {
+    Block* block = &(*blocks)[i];
+    *status = compressor->ProcessBlock(false, block->input_len, block->input,
+        &block->output_len, &block->output);
+    if (!status->ok()) return;
+  }
+}
+
+Status ParallelCompressor::CompressBlocks(
+    ThreadResourceMgr::ResourcePool* resource_pool, THdfsCompression::type format,
+    MemPool* mem_pool, vector<Block>* blocks) {
+  if (blocks->empty()) return Status::OK;
+
+  // The calling thread is always one worker. Add one extra thread per remaining block
+  // for as long as the resource pool has tokens to spare.
+  int num_workers = 1;
+  if (resource_pool != NULL) {
+    while (num_workers < blocks->size() && resource_pool->TryAcquireThreadToken()) {
+      ++num_workers;
+    }
+  }
+
+  // MemPools are not thread-safe, so every worker compresses into its own pool. The
+  // output is handed over to 'mem_pool' once the workers are done.
+  ptr_vector<MemPool> worker_pools;
+  for (int i = 0; i < num_workers; ++i) {
+    worker_pools.push_back(new MemPool(mem_pool->mem_tracker()));
+  }
+
+  vector<Status> worker_statuses(num_workers);
+  ptr_vector<Thread> workers;
+  for (int i = 1; i < num_workers; ++i) {
+    workers.push_back(new Thread("parallel-compress", "compression-worker",
+        bind(&ParallelCompressor::CompressWorker, format, &worker_pools[i], blocks, i,
+            num_workers, &worker_statuses[i])));
+  }
+  CompressWorker(format, &worker_pools[0], blocks, 0, num_workers,
+      &worker_statuses[0]);
+  for (int i = 0; i < workers.size(); ++i) workers[i].Join();
+  for (int i = 1; i < num_workers; ++i) resource_pool->ReleaseThreadToken(false);
+
+  for (int i = 0; i < num_workers; ++i) {
+    mem_pool->AcquireData(&worker_pools[i], false);
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    RETURN_IF_ERROR(worker_statuses[i]);
+  }
+  return Status::OK;
+}
+
+bool ParallelCompressor::SupportsStreamConcatenation(THdfsCompression::type format) {
+  // A gzip or bzip2 file may contain multiple compressed members back to back, and
+  // the hadoop-snappy block format is a sequence of self-contained blocks, so streams
+  // in these formats can simply be concatenated. Notably absent: DEFLATE (bare zlib
+  // streams are not concatenable) and raw SNAPPY (no framing at all).
+  return format == THdfsCompression::GZIP || format == THdfsCompression::BZIP2 ||
+      format == THdfsCompression::SNAPPY_BLOCKED;
+}
+
+}
@@ -0,0 +1,75 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_UTIL_PARALLEL_COMPRESS_H
+#define IMPALA_UTIL_PARALLEL_COMPRESS_H
+
+#include <vector>
+
+#include "common/status.h"
+#include "runtime/thread-resource-mgr.h"
+#include "gen-cpp/Descriptors_types.h"  // for THdfsCompression
+
+namespace impala {
+
+class MemPool;
+
+// Compresses a set of independent blocks of data in parallel. Table writers that
+// bottleneck on single-threaded compression (e.g. gzip CTAS) hand their filled
+// uncompressed blocks to CompressBlocks(), which fans the work out over extra worker
+// threads and returns the compressed output for every block, in order, so that the
+// caller can write the results out sequentially.
+//
+// The number of extra threads is bounded by the thread tokens that can be acquired
+// from the fragment's ThreadResourceMgr pool, so that compression parallelism matches
+// the cores the fragment owns. If no tokens are available, all blocks are compressed
+// on the calling thread, which is no slower than compressing inline.
+class ParallelCompressor {
+ public:
+  // One unit of compression work. The caller fills in input/input_len; on success
+  // output/output_len point at the compressed data, which is allocated from the
+  // MemPool passed to CompressBlocks().
+  struct Block {
+    const uint8_t* input;
+    int64_t input_len;
+    uint8_t* output;
+    int64_t output_len;
+
+    Block() : input(NULL), input_len(0), output(NULL), output_len(0) { }
+  };
+
+  // Compresses every block in 'blocks' with 'format'. On return, all output buffers
+  // (including those of blocks compressed before an error was hit) are owned by
+  // 'mem_pool'. 'resource_pool' may be NULL, in which case all blocks are compressed
+  // on the calling thread.
+  static Status CompressBlocks(ThreadResourceMgr::ResourcePool* resource_pool,
+      THdfsCompression::type format, MemPool* mem_pool, std::vector<Block>* blocks);
+
+  // Returns true if a file consisting of multiple concatenated 'format' streams
+  // decompresses to the concatenation of the streams. Callers can use this to split
+  // one large buffer into independently-compressed chunks and write the compressed
+  // chunks back to back.
+  static bool SupportsStreamConcatenation(THdfsCompression::type format);
+
+ private:
+  // Compresses blocks[i] for every i where i % num_workers == worker_id, allocating
+  // output from 'pool' and recording the first error in 'status'. Runs in a worker
+  // thread, or on the calling thread for worker 0.
+  static void CompressWorker(THdfsCompression::type format, MemPool* pool,
+      std::vector<Block>* blocks, int worker_id, int num_workers, Status* status);
+};
+
+}
+
+#endif
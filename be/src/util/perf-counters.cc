@@ -16,6 +16,8 @@
 //       This file will not compile under RHEL 5 or any of it's derivitives.
 
 #include "util/perf-counters.h"
+
+#include "common/object-pool.h"
 #include "util/debug-util.h"
 
 #include <stdio.h>
@@ -168,7 +170,8 @@ bool PerfCounters::InitSysCounter(Counter counter) {
   if (!InitEventAttr(&attr, counter)) {
     return false;
   }
-  int fd = sys_perf_event_open(&attr, getpid(), -1, group_fd_, 0);
+  // A pid of 0 restricts the event to the calling thread.
+  int fd = sys_perf_event_open(&attr, thread_scoped_ ? 0 : getpid(), -1, group_fd_, 0);
   if (fd < 0) {
     return false;
   }
@@ -306,7 +309,9 @@ bool PerfCounters::GetProcSelfStatusCounters(vector<int64_t>& buffer) {
   return true;
 }
 
-PerfCounters::PerfCounters() : group_fd_(-1) {
+PerfCounters::PerfCounters(bool thread_scoped)
+  : group_fd_(-1),
+    thread_scoped_(thread_scoped) {
 }
 
 // Close all fds for the counters
@@ -400,6 +405,22 @@ void PerfCounters::Snapshot(const string& name) {
   snapshot_names_.push_back(fixed_name);
 }
 
+bool PerfCounters::ReadCounters(vector<int64_t>* buffer) {
+  if (buffer->size() != counters_.size()) buffer->resize(counters_.size());
+  // Skip the /proc file parses unless a counter actually needs them; they are
+  // far more expensive than the perf event reads.
+  bool have_proc_io = false;
+  bool have_proc_status = false;
+  for (int i = 0; i < counters_.size(); ++i) {
+    if (counters_[i].source == PROC_SELF_IO) have_proc_io = true;
+    if (counters_[i].source == PROC_SELF_STATUS) have_proc_status = true;
+  }
+  bool result = GetSysCounters(*buffer);
+  if (have_proc_io) result &= GetProcSelfIOCounters(*buffer);
+  if (have_proc_status) result &= GetProcSelfStatusCounters(*buffer);
+  return result;
+}
+
 const vector<int64_t>* PerfCounters::counters(int snapshot) const {
   if (snapshot < 0 || snapshot >= snapshots_.size()) return NULL;
   return &snapshots_[snapshot];
@@ -424,5 +445,38 @@ void PerfCounters::PrettyPrint(ostream* s) const {
   stream << endl;
 }
 
+HwCounterProfile* HwCounterProfile::Create(ObjectPool* pool, RuntimeProfile* profile) {
+  HwCounterProfile* result = pool->Add(new HwCounterProfile());
+  bool available = true;
+  available &= result->perf_counters_.AddCounter(PerfCounters::PERF_COUNTER_HW_CPU_CYCLES);
+  available &=
+      result->perf_counters_.AddCounter(PerfCounters::PERF_COUNTER_HW_INSTRUCTIONS);
+  available &=
+      result->perf_counters_.AddCounter(PerfCounters::PERF_COUNTER_HW_CACHE_MISSES);
+  available &=
+      result->perf_counters_.AddCounter(PerfCounters::PERF_COUNTER_HW_BRANCH_MISSES);
+  if (!available) return NULL;
+  result->profile_counters_.push_back(profile->AddCounter("HWCpuCycles", TUnit::UNIT));
+  result->profile_counters_.push_back(
+      profile->AddCounter("HWInstructions", TUnit::UNIT));
+  result->profile_counters_.push_back(profile->AddCounter("HWCacheMisses", TUnit::UNIT));
+  result->profile_counters_.push_back(
+      profile->AddCounter("HWBranchMisses", TUnit::UNIT));
+  return result;
+}
+
+void HwCounterProfile::Start() {
+  started_ = perf_counters_.ReadCounters(&start_values_);
+}
+
+void HwCounterProfile::Stop() {
+  if (!started_) return;
+  started_ = false;
+  if (!perf_counters_.ReadCounters(&stop_values_)) return;
+  for (int i = 0; i < profile_counters_.size(); ++i) {
+    profile_counters_[i]->Add(stop_values_[i] - start_values_[i]);
+  }
+}
+
 }
 
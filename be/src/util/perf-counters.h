@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "util/debug-util.h"
+#include "util/runtime-profile.h"
 
 // This is a utility class that aggregates counters from the kernel.  These counters
 // come from different sources.
@@ -79,6 +80,11 @@ class PerfCounters {
   // for the snapshot.
   void Snapshot(const std::string& name = "");
 
+  // Reads the current values of all added counters into 'buffer' (resized to fit)
+  // without recording a snapshot.  Cheaper than Snapshot() and suitable for
+  // high-frequency sampling.  Returns false if any counter could not be read.
+  bool ReadCounters(std::vector<int64_t>* buffer);
+
   // Returns the results of that snapshot
   const std::vector<int64_t>* counters(int snapshot) const;
 
@@ -88,7 +94,10 @@ class PerfCounters {
   // Prints out the names and results for all snapshots to 'out'
   void PrettyPrint(std::ostream* out) const;
 
-  PerfCounters();
+  // If 'thread_scoped' is true, system perf counters count only the calling
+  // thread rather than the whole process.  Use this when the counters bracket
+  // code regions that are known to execute in the constructing thread.
+  PerfCounters(bool thread_scoped = false);
   ~PerfCounters();
 
  private:
@@ -133,8 +142,62 @@ class PerfCounters {
   // System perf counters can be grouped together.  The OS will update all grouped counters
   // at the same time.  This is useful to better correlate counter values.
   int group_fd_;
+  // If true, system perf counters are opened for the calling thread only.
+  bool thread_scoped_;
+};
+
+// Publishes deltas of a fixed set of hardware counters - cpu cycles, instructions,
+// last-level cache misses and branch misses - as counters in a RuntimeProfile.
+// Start()/Stop() bracket a code region; the deltas across the region are accumulated
+// into the profile counters.  Like TotalTime, the values are inclusive of any work
+// (e.g. child exec nodes) executed within the region, so readers should subtract
+// child values to get per-operator numbers.  The underlying perf events count the
+// constructing thread only; work handed off to other threads is not included.
+class HwCounterProfile {
+ public:
+  // Opens the hardware perf events and registers the HWCpuCycles, HWInstructions,
+  // HWCacheMisses and HWBranchMisses counters in 'profile'.  Returns a pool-owned
+  // object, or NULL if hardware counters are not available (e.g. in a VM), in which
+  // case no profile counters are added.
+  static HwCounterProfile* Create(ObjectPool* pool, RuntimeProfile* profile);
+
+  // Reads the counters at the start of a region.
+  void Start();
+
+  // Reads the counters at the end of a region and adds the deltas since Start()
+  // to the profile counters.
+  void Stop();
+
+ private:
+  HwCounterProfile() : perf_counters_(true), started_(false) {}
+
+  PerfCounters perf_counters_;
+  std::vector<RuntimeProfile::Counter*> profile_counters_;
+  std::vector<int64_t> start_values_;
+  std::vector<int64_t> stop_values_;
+  bool started_;
+};
+
+// Utility to bracket a scope with HwCounterProfile::Start()/Stop().  A NULL
+// 'profile' makes this a no-op, so callers don't need to check whether hardware
+// counter capture is enabled.
+class ScopedHwCounters {
+ public:
+  ScopedHwCounters(HwCounterProfile* profile) : profile_(profile) {
+    if (profile_ != NULL) profile_->Start();
+  }
+
+  ~ScopedHwCounters() {
+    if (profile_ != NULL) profile_->Stop();
+  }
+
+ private:
+  HwCounterProfile* profile_;
 };
 
+#define SCOPED_HW_COUNTERS(profile) \
+    ScopedHwCounters MACRO_CONCAT(SCOPED_HW_COUNTERS, __COUNTER__)(profile)
+
 }
 
 #endif
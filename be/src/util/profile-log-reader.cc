@@ -0,0 +1,121 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gflags/gflags.h>
+#include <zlib.h>
+#include <boost/scoped_ptr.hpp>
+
+#include "gen-cpp/Types_types.h"
+#include "common/status.h"
+#include "util/codec.h"
+#include "util/debug-util.h"
+#include "util/url-coding.h"
+
+DEFINE_string(file, "", "Binary profile log file to read");
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+// Utility to convert a binary profile log (written by ImpalaServer when
+// --binary_profile_log is set) back to the text profile log format, i.e. one
+// "<ms-since-epoch> <query-id> <base64 of gzipped thrift profile>" line per query on
+// stdout. The output lines are compatible with existing profile tooling.
+//
+// A binary log is a gzip stream of length-prefixed records; each record is an 8-byte
+// ms-since-epoch timestamp, the query id as two 8-byte integers (all host byte order)
+// followed by the thrift compact binary encoding of the query profile.
+// Diagnostics are written to cerr.
+
+// Reads one length-prefixed record from 'file' into 'record'. Returns false on EOF or
+// a truncated record; a truncated trailing record is expected if the writer died
+// between flushes.
+static bool ReadRecord(gzFile file, string* record) {
+  uint32_t len;
+  if (gzread(file, &len, sizeof(len)) != sizeof(len)) return false;
+  record->resize(len);
+  if (len == 0) return true;
+  return gzread(file, &(*record)[0], len) == static_cast<int>(len);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_file.empty()) {
+    cerr << "Must specify input file." << endl;
+    return -1;
+  }
+
+  gzFile file = gzopen(FLAGS_file.c_str(), "rb");
+  if (file == NULL) {
+    cerr << "Could not open file: " << FLAGS_file << endl;
+    return -1;
+  }
+
+  // Compressor used to re-encode each profile the way the text profile log stores
+  // them: gzipped, then base64 encoded.
+  scoped_ptr<Codec> compressor;
+  Status status =
+      Codec::CreateCompressor(NULL, false, THdfsCompression::DEFAULT, &compressor);
+  if (!status.ok()) {
+    cerr << "Could not create compressor: " << status.GetDetail() << endl;
+    return -1;
+  }
+
+  const size_t RECORD_HEADER_SIZE = 3 * sizeof(int64_t);
+  int num_records = 0;
+  string record;
+  while (ReadRecord(file, &record)) {
+    if (record.size() < RECORD_HEADER_SIZE) {
+      cerr << "Skipping malformed record of size " << record.size() << endl;
+      continue;
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(record.data());
+    int64_t timestamp;
+    TUniqueId query_id;
+    memcpy(&timestamp, data, sizeof(timestamp));
+    memcpy(&query_id.hi, data + sizeof(int64_t), sizeof(query_id.hi));
+    memcpy(&query_id.lo, data + 2 * sizeof(int64_t), sizeof(query_id.lo));
+
+    const uint8_t* profile = data + RECORD_HEADER_SIZE;
+    int64_t profile_len = record.size() - RECORD_HEADER_SIZE;
+    vector<uint8_t> compressed;
+    compressed.resize(compressor->MaxOutputLen(profile_len));
+    int64_t result_len = compressed.size();
+    uint8_t* compressed_ptr = &compressed[0];
+    status = compressor->ProcessBlock(true, profile_len, profile, &result_len,
+        &compressed_ptr);
+    if (!status.ok()) {
+      cerr << "Could not compress profile for query " << PrintId(query_id) << ": "
+           << status.GetDetail() << endl;
+      continue;
+    }
+    compressed.resize(result_len);
+
+    stringstream encoded;
+    Base64Encode(compressed, &encoded);
+    cout << timestamp << " " << PrintId(query_id) << " " << encoded.str() << "\n";
+    ++num_records;
+  }
+  compressor->Close();
+  gzclose(file);
+
+  cerr << "Read " << num_records << " profile(s)." << endl;
+  return 0;
+}
@@ -17,6 +17,8 @@
 
 #include <math.h>
 
+#include <algorithm>
+
 #include "common/compiler-util.h"
 #include "util/bit-stream-utils.inline.h"
 #include "util/bit-util.h"
@@ -94,6 +96,14 @@ class RleDecoder {
   template<typename T>
   bool Get(T* val);
 
+  // Gets the next 'num_values' values into 'values'. Returns the number of values
+  // decoded, which is only less than 'num_values' if the data is exhausted. Repeated
+  // runs are expanded with a fill loop and literal runs are unpacked with
+  // BitReader::GetValues() instead of re-entering the per-value decode, which is much
+  // faster for long runs (e.g. the definition levels of a mostly non-null column).
+  template<typename T>
+  int GetValues(int num_values, T* values);
+
  private:
   BitReader bit_reader_;
   int bit_width_;
@@ -259,6 +269,47 @@ inline bool RleDecoder::Get(T* val) {
   return true;
 }
 
+template<typename T>
+inline int RleDecoder::GetValues(int num_values, T* values) {
+  int num_decoded = 0;
+  while (num_decoded < num_values) {
+    if (UNLIKELY(literal_count_ == 0 && repeat_count_ == 0)) {
+      // Read the next run's indicator int, it could be a literal or repeated run
+      // The int is encoded as a vlq-encoded value.
+      int32_t indicator_value = 0;
+      if (!bit_reader_.GetVlqInt(&indicator_value)) break;
+
+      // lsb indicates if it is a literal run or repeated run
+      bool is_literal = indicator_value & 1;
+      if (is_literal) {
+        literal_count_ = (indicator_value >> 1) * 8;
+      } else {
+        repeat_count_ = indicator_value >> 1;
+        bool result = bit_reader_.GetAligned<T>(
+            BitUtil::Ceil(bit_width_, 8), reinterpret_cast<T*>(&current_value_));
+        DCHECK(result);
+      }
+    }
+
+    if (LIKELY(repeat_count_ > 0)) {
+      int run_len = std::min<int>(num_values - num_decoded, repeat_count_);
+      T val = current_value_;
+      for (int i = 0; i < run_len; ++i) values[num_decoded + i] = val;
+      repeat_count_ -= run_len;
+      num_decoded += run_len;
+    } else {
+      DCHECK_GT(literal_count_, 0);
+      int run_len = std::min<int>(num_values - num_decoded, literal_count_);
+      int num_unpacked = bit_reader_.GetValues(bit_width_, run_len,
+          &values[num_decoded]);
+      DCHECK_EQ(num_unpacked, run_len);
+      literal_count_ -= run_len;
+      num_decoded += run_len;
+    }
+  }
+  return num_decoded;
+}
+
 // This function buffers input values 8 at a time.  After seeing all 8 values,
 // it decides whether they should be encoded as a literal or repeated run.
 inline bool RleEncoder::Put(uint64_t value) {
@@ -115,6 +115,14 @@ void TestBitArrayValues(int bit_width, int num_vals) {
     EXPECT_EQ(val, i % mod);
   }
   EXPECT_EQ(reader.bytes_left(), 0);
+
+  // Read the same values back with a single batched call.
+  vector<int64_t> batch_vals(num_vals);
+  BitReader batch_reader(buffer, len);
+  EXPECT_EQ(batch_reader.GetValues(bit_width, num_vals, &batch_vals[0]), num_vals);
+  for (int i = 0; i < num_vals; ++i) {
+    EXPECT_EQ(batch_vals[i], i % mod);
+  }
 }
 
 TEST(BitArray, TestValues) {
@@ -223,6 +223,64 @@ TEST(CountersTest, MergeAndUpdate) {
   profile2.PrettyPrint(&dummy);
 }
 
+TEST(CountersTest, RepeatedUpdate) {
+  // Repeated Update() calls hit the cached counter/child destinations; growing the
+  // source profile between updates must invalidate the caches.
+  ObjectPool pool;
+  RuntimeProfile src(&pool, "Src");
+  RuntimeProfile src_child(&pool, "Child1");
+  src.AddChild(&src_child);
+  RuntimeProfile::Counter* a = src.AddCounter("A", TUnit::UNIT);
+  a->Set(1L);
+
+  TRuntimeProfileTree tprofile;
+  src.ToThrift(&tprofile.nodes);
+  RuntimeProfile dst(&pool, "Src");
+  dst.Update(tprofile);
+  ValidateCounter(&dst, "A", 1);
+
+  // Update again with the same structure but a new counter value.
+  a->Set(2L);
+  tprofile.nodes.clear();
+  src.ToThrift(&tprofile.nodes);
+  dst.Update(tprofile);
+  ValidateCounter(&dst, "A", 2);
+
+  // Add a counter, a child counter and a new child between updates.
+  RuntimeProfile::Counter* b = src.AddCounter("B", TUnit::BYTES);
+  b->Set(3L);
+  RuntimeProfile::Counter* c = src_child.AddCounter("C", TUnit::UNIT);
+  c->Set(4L);
+  RuntimeProfile src_child2(&pool, "Child2");
+  src.AddChild(&src_child2);
+  tprofile.nodes.clear();
+  src.ToThrift(&tprofile.nodes);
+  dst.Update(tprofile);
+  ValidateCounter(&dst, "A", 2);
+  ValidateCounter(&dst, "B", 3);
+
+  vector<RuntimeProfile*> children;
+  dst.GetChildren(&children);
+  EXPECT_EQ(children.size(), 2);
+  for (int i = 0; i < children.size(); ++i) {
+    if (children[i]->name().compare("Child1") == 0) {
+      ValidateCounter(children[i], "C", 4);
+    }
+  }
+
+  // One more update with the now-stable structure.
+  c->Set(5L);
+  tprofile.nodes.clear();
+  src.ToThrift(&tprofile.nodes);
+  dst.Update(tprofile);
+  dst.GetChildren(&children);
+  for (int i = 0; i < children.size(); ++i) {
+    if (children[i]->name().compare("Child1") == 0) {
+      ValidateCounter(children[i], "C", 5);
+    }
+  }
+}
+
 TEST(CountersTest, DerivedCounters) {
   ObjectPool pool;
   RuntimeProfile profile(&pool, "Profile");
@@ -408,6 +466,51 @@ TEST(CountersTest, BucketCounters) {
   EXPECT_EQ(val1, buckets[1]->double_value());
 }
 
+TEST(CountersTest, HistogramCounters) {
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "Profile");
+
+  RuntimeProfile::HistogramCounter* histogram =
+      profile.AddHistogramCounter("Latencies", TUnit::TIME_NS);
+  EXPECT_EQ(0, histogram->num_samples());
+  EXPECT_EQ(0, histogram->GetQuantile(0.5));
+
+  // Adding a counter with the same name returns the same counter.
+  EXPECT_EQ(histogram, profile.AddHistogramCounter("Latencies", TUnit::TIME_NS));
+
+  // Record 1..1000; quantiles should be within the histogram's 12.5% relative error.
+  for (int i = 1; i <= 1000; ++i) {
+    histogram->Record(i);
+  }
+  EXPECT_EQ(1000, histogram->num_samples());
+  EXPECT_NEAR(histogram->GetQuantile(0.5), 500, 500 * 0.125);
+  EXPECT_NEAR(histogram->GetQuantile(0.9), 900, 900 * 0.125);
+  EXPECT_NEAR(histogram->GetQuantile(0.99), 990, 990 * 0.125);
+
+  // Quantiles are clamped to the observed range.
+  EXPECT_EQ(1, histogram->GetQuantile(0.0));
+  EXPECT_EQ(1000, histogram->GetQuantile(1.0));
+
+  // Values below the sub-bucket count are recorded exactly.
+  RuntimeProfile::HistogramCounter* small =
+      profile.AddHistogramCounter("Small", TUnit::UNIT);
+  for (int i = 0; i < 100; ++i) {
+    small->Record(4);
+  }
+  EXPECT_EQ(4, small->GetQuantile(0.5));
+  EXPECT_EQ(4, small->GetQuantile(0.99));
+
+  // An outlier shows up in the p99 but not the p50.
+  RuntimeProfile::HistogramCounter* skewed =
+      profile.AddHistogramCounter("Skewed", TUnit::UNIT);
+  for (int i = 0; i < 99; ++i) {
+    skewed->Record(10);
+  }
+  skewed->Record(1000000);
+  EXPECT_EQ(10, skewed->GetQuantile(0.5));
+  EXPECT_EQ(1000000, skewed->GetQuantile(1.0));
+}
+
 TEST(CountersTest, EventSequences) {
   ObjectPool pool;
   RuntimeProfile profile(&pool, "Profile");
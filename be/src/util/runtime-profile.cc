@@ -14,6 +14,8 @@
 
 #include "util/runtime-profile.h"
 
+#include <math.h>
+
 #include <iomanip>
 #include <iostream>
 
@@ -229,31 +231,54 @@ void RuntimeProfile::Update(const vector<TRuntimeProfileNode>& nodes, int* idx)
   {
     lock_guard<mutex> l(counter_map_lock_);
     // update this level
-    map<string, Counter*>::iterator dst_iter;
-    for (int i = 0; i < node.counters.size(); ++i) {
-      const TCounter& tcounter = node.counters[i];
-      CounterMap::iterator j = counter_map_.find(tcounter.name);
-      if (j == counter_map_.end()) {
-        counter_map_[tcounter.name] =
-          pool_->Add(new Counter(tcounter.unit, tcounter.value));
-      } else {
-        if (j->second->unit() != tcounter.unit) {
+    bool cache_valid = update_counter_cache_.size() == node.counters.size();
+    if (cache_valid) {
+      for (int i = 0; i < node.counters.size(); ++i) {
+        if (update_counter_cache_[i].first != node.counters[i].name) {
+          cache_valid = false;
+          break;
+        }
+      }
+    }
+    if (cache_valid) {
+      // Fast path: the counter list matches the last applied report, so the
+      // destination counters are known without any counter_map_ lookups.
+      for (int i = 0; i < node.counters.size(); ++i) {
+        Counter* counter = update_counter_cache_[i].second;
+        if (counter == NULL) continue; // Unit mismatch, logged when cache was built
+        counter->Set(node.counters[i].value);
+      }
+    } else {
+      update_counter_cache_.clear();
+      update_counter_cache_.reserve(node.counters.size());
+      for (int i = 0; i < node.counters.size(); ++i) {
+        const TCounter& tcounter = node.counters[i];
+        Counter* counter = NULL;
+        CounterMap::iterator j = counter_map_.find(tcounter.name);
+        if (j == counter_map_.end()) {
+          counter = pool_->Add(new Counter(tcounter.unit, tcounter.value));
+          counter_map_[tcounter.name] = counter;
+        } else if (j->second->unit() != tcounter.unit) {
           LOG(ERROR) << "Cannot update counters with the same name ("
                      << j->first << ") but different units.";
         } else {
-          j->second->Set(tcounter.value);
+          counter = j->second;
+          counter->Set(tcounter.value);
         }
+        update_counter_cache_.push_back(make_pair(tcounter.name, counter));
       }
-    }
 
-    ChildCounterMap::const_iterator child_counter_src_itr;
-    for (child_counter_src_itr = node.child_counters_map.begin();
-         child_counter_src_itr != node.child_counters_map.end();
-         ++child_counter_src_itr) {
-      set<string>* child_counters = FindOrInsert(&child_counter_map_,
-          child_counter_src_itr->first, set<string>());
-      child_counters->insert(child_counter_src_itr->second.begin(),
-          child_counter_src_itr->second.end());
+      // The child-counter hierarchy only changes when the counter set does, so it
+      // only needs to be merged when the cache is rebuilt.
+      ChildCounterMap::const_iterator child_counter_src_itr;
+      for (child_counter_src_itr = node.child_counters_map.begin();
+           child_counter_src_itr != node.child_counters_map.end();
+           ++child_counter_src_itr) {
+        set<string>* child_counters = FindOrInsert(&child_counter_map_,
+            child_counter_src_itr->first, set<string>());
+        child_counters->insert(child_counter_src_itr->second.begin(),
+            child_counter_src_itr->second.end());
+      }
     }
   }
 
@@ -298,15 +323,24 @@ void RuntimeProfile::Update(const vector<TRuntimeProfileNode>& nodes, int* idx)
     // update children with matching names; create new ones if they don't match
     for (int i = 0; i < node.num_children; ++i) {
       const TRuntimeProfileNode& tchild = nodes[*idx];
-      ChildMap::iterator j = child_map_.find(tchild.name);
       RuntimeProfile* child = NULL;
-      if (j != child_map_.end()) {
-        child = j->second;
+      if (i < static_cast<int>(update_child_cache_.size()) &&
+          update_child_cache_[i].first == tchild.name) {
+        child = update_child_cache_[i].second;
       } else {
-        child = pool_->Add(new RuntimeProfile(pool_, tchild.name));
-        child->metadata_ = tchild.metadata;
-        child_map_[tchild.name] = child;
-        children_.push_back(make_pair(child, tchild.indent));
+        // Invalidate this and all later cached positions; they are revalidated (and
+        // re-appended) as the remaining children are processed.
+        update_child_cache_.resize(i);
+        ChildMap::iterator j = child_map_.find(tchild.name);
+        if (j != child_map_.end()) {
+          child = j->second;
+        } else {
+          child = pool_->Add(new RuntimeProfile(pool_, tchild.name));
+          child->metadata_ = tchild.metadata;
+          child_map_[tchild.name] = child;
+          children_.push_back(make_pair(child, tchild.indent));
+        }
+        update_child_cache_.push_back(make_pair(tchild.name, child));
       }
       child->Update(nodes, idx);
     }
@@ -599,6 +633,16 @@ void RuntimeProfile::PrettyPrint(ostream* s, const string& prefix) const {
     }
   }
 
+  {
+    // Print all histogram counters as the following:
+    // <Name>: Count: <n>, min / p50 / p90 / p99 / max: ..., mean: ...
+    lock_guard<mutex> l(histogram_counter_map_lock_);
+    BOOST_FOREACH(const HistogramCounterMap::value_type& v, histogram_counter_map_) {
+      if (v.second->num_samples() == 0) continue;
+      stream << prefix << "  " << v.first << ": " << v.second->DebugString() << endl;
+    }
+  }
+
   RuntimeProfile::PrintChildCounters(
       prefix, ROOT_COUNTER, counter_map, child_counter_map, s);
 
@@ -616,6 +660,16 @@ void RuntimeProfile::PrettyPrint(ostream* s, const string& prefix) const {
   }
 }
 
+void RuntimeProfile::SerializeToThrift(string* out) const {
+  TRuntimeProfileTree thrift_object;
+  const_cast<RuntimeProfile*>(this)->ToThrift(&thrift_object);
+  ThriftSerializer serializer(true);
+  vector<uint8_t> serialized_buffer;
+  Status status = serializer.Serialize(&thrift_object, &serialized_buffer);
+  if (!status.ok()) return;
+  out->append(reinterpret_cast<char*>(&serialized_buffer[0]), serialized_buffer.size());
+}
+
 string RuntimeProfile::SerializeToArchiveString() const {
   stringstream ss;
   SerializeToArchiveString(&ss);
@@ -866,6 +920,74 @@ RuntimeProfile::TimeSeriesCounter* RuntimeProfile::AddTimeSeriesCounter(
       bind(&Counter::value, src_counter));
 }
 
+RuntimeProfile::HistogramCounter* RuntimeProfile::AddHistogramCounter(
+    const string& name, TUnit::type unit) {
+  lock_guard<mutex> l(histogram_counter_map_lock_);
+  HistogramCounterMap::iterator it = histogram_counter_map_.find(name);
+  if (it != histogram_counter_map_.end()) return it->second;
+  HistogramCounter* counter = pool_->Add(new HistogramCounter(unit));
+  histogram_counter_map_[name] = counter;
+  return counter;
+}
+
+int RuntimeProfile::HistogramCounter::BucketIndex(int64_t v) {
+  DCHECK_GE(v, 0);
+  // Values below NUM_SUB_BUCKETS get their own bucket (exact).
+  if (v < NUM_SUB_BUCKETS) return v;
+  int highest_bit = 63 - __builtin_clzll(static_cast<uint64_t>(v));
+  int sub_bucket = (v >> (highest_bit - SUB_BUCKET_BITS)) & (NUM_SUB_BUCKETS - 1);
+  return (highest_bit - SUB_BUCKET_BITS + 1) * NUM_SUB_BUCKETS + sub_bucket;
+}
+
+int64_t RuntimeProfile::HistogramCounter::BucketValue(int index) {
+  DCHECK_GE(index, 0);
+  DCHECK_LT(index, NUM_BUCKETS);
+  if (index < NUM_SUB_BUCKETS) return index;
+  int highest_bit = index / NUM_SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+  int sub_bucket = index % NUM_SUB_BUCKETS;
+  int64_t low = (1LL << highest_bit) +
+      (static_cast<int64_t>(sub_bucket) << (highest_bit - SUB_BUCKET_BITS));
+  // Midpoint of the bucket's range.
+  return low + (1LL << (highest_bit - SUB_BUCKET_BITS)) / 2;
+}
+
+int64_t RuntimeProfile::HistogramCounter::GetQuantile(double q) {
+  DCHECK_GE(q, 0.0);
+  DCHECK_LE(q, 1.0);
+  int64_t total = num_samples_.Read();
+  if (total == 0) return 0;
+  // The bucket containing the sample with this (1-based) rank holds the quantile.
+  int64_t target_rank = static_cast<int64_t>(ceil(q * total));
+  if (target_rank < 1) target_rank = 1;
+  if (target_rank >= total) return max_.Read();
+  int64_t cumulative = 0;
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    cumulative += buckets_[i].Read();
+    if (cumulative >= target_rank) {
+      // Clamp to the observed range so e.g. the p99 of a constant stream reports
+      // that constant rather than a bucket midpoint.
+      return min(max(BucketValue(i), min_.Read()), max_.Read());
+    }
+  }
+  return max_.Read();
+}
+
+string RuntimeProfile::HistogramCounter::DebugString() {
+  int64_t count = num_samples_.Read();
+  stringstream ss;
+  ss << "Count: " << count;
+  if (count > 0) {
+    ss << ", min / p50 / p90 / p99 / max: "
+       << PrettyPrinter::Print(min_.Read(), unit_) << " / "
+       << PrettyPrinter::Print(GetQuantile(0.5), unit_) << " / "
+       << PrettyPrinter::Print(GetQuantile(0.9), unit_) << " / "
+       << PrettyPrinter::Print(GetQuantile(0.99), unit_) << " / "
+       << PrettyPrinter::Print(max_.Read(), unit_)
+       << ", mean: " << PrettyPrinter::Print(sum_.Read() / count, unit_);
+  }
+  return ss.str();
+}
+
 void RuntimeProfile::TimeSeriesCounter::ToThrift(TTimeSeriesCounter* counter) {
   counter->name = name_;
   counter->unit = unit_;
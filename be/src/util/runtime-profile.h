@@ -350,6 +350,68 @@ class RuntimeProfile {
     StreamingCounterSampler samples_;
   };
 
+  // Records the distribution of a stream of int64 values, HDR-histogram style:
+  // values map to log-scale buckets with NUM_SUB_BUCKETS linear sub-buckets per
+  // power of two, bounding the relative error of reported quantiles at
+  // 1/NUM_SUB_BUCKETS. Record() is a few atomic adds with no locks, so concurrent
+  // execution threads can record into the same counter; quantiles are merged from
+  // the buckets on read. Use this where a mean hides the problem, e.g. per-batch
+  // GetNext() times.
+  // These counters are included in PrettyPrint() output but are not serialized to
+  // thrift, so they are only visible in the profile of the recording backend.
+  class HistogramCounter {
+   public:
+    HistogramCounter(TUnit::type unit)
+      : unit_(unit), min_(MAX_INT64), max_(0) {
+    }
+
+    // Records one sample. Lock-free; safe to call from any thread.
+    void Record(int64_t val) {
+      if (UNLIKELY(val < 0)) val = 0;
+      buckets_[BucketIndex(val)].UpdateAndFetch(1);
+      num_samples_.UpdateAndFetch(1);
+      sum_.UpdateAndFetch(val);
+      min_.UpdateMin(val);
+      max_.UpdateMax(val);
+    }
+
+    // Returns an approximation of the quantile 'q' in [0, 1] of the recorded
+    // values, e.g. GetQuantile(0.5) is the median. Returns 0 if nothing was
+    // recorded.
+    int64_t GetQuantile(double q);
+
+    int64_t num_samples() { return num_samples_.Read(); }
+
+    TUnit::type unit() const { return unit_; }
+
+    // Returns "Count: <n>, min / p50 / p90 / p99 / max: ..., mean: ..." with the
+    // values pretty-printed in this counter's unit.
+    std::string DebugString();
+
+   private:
+    friend class RuntimeProfile;
+
+    static const int64_t MAX_INT64 = 0x7fffffffffffffffLL;
+
+    // 8 sub-buckets per power of two bounds the quantile error at 12.5%.
+    static const int SUB_BUCKET_BITS = 3;
+    static const int NUM_SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int NUM_BUCKETS = 64 * NUM_SUB_BUCKETS;
+
+    // Maps a non-negative value to its bucket.
+    static int BucketIndex(int64_t v);
+
+    // Returns a representative value (the midpoint) for a bucket.
+    static int64_t BucketValue(int index);
+
+    TUnit::type unit_;
+    AtomicInt<int64_t> buckets_[NUM_BUCKETS];
+    AtomicInt<int64_t> num_samples_;
+    AtomicInt<int64_t> sum_;
+    AtomicInt<int64_t> min_;
+    AtomicInt<int64_t> max_;
+  };
+
   // Create a runtime profile object with 'name'.  Counters and merged profile are
   // allocated from pool.
   // If is_averaged_profile is true, the counters in this profile will be derived averages
@@ -472,6 +534,11 @@ class RuntimeProfile {
   std::string SerializeToArchiveString() const;
   void SerializeToArchiveString(std::stringstream* out) const;
 
+  // Appends the thrift compact binary encoding of the profile to 'out', without
+  // compression or base64 encoding. Used by the binary profile log, which compresses
+  // whole log segments rather than individual profiles.
+  void SerializeToThrift(std::string* out) const;
+
   // Divides all counters by n
   void Divide(int n);
 
@@ -539,6 +606,11 @@ class RuntimeProfile {
   // Note: these counters don't get merged (to make average profiles)
   TimeSeriesCounter* AddTimeSeriesCounter(const std::string& name, Counter* src_counter);
 
+  // Create a histogram counter, or return the existing one with this name.
+  // Note: these counters don't get merged (to make average profiles) and are not
+  // serialized to thrift.
+  HistogramCounter* AddHistogramCounter(const std::string& name, TUnit::type unit);
+
   // Recursively compute the fraction of the 'total_time' spent in this profile and
   // its children.
   // This function updates local_time_percent_ for each profile.
@@ -575,6 +647,18 @@ class RuntimeProfile {
   // A set of bucket counters registered in this runtime profile.
   std::set<std::vector<Counter*>* > bucketing_counters_;
 
+  // Cache used by Update(). Reports from a fragment instance have a stable tree
+  // shape, so the destination counter for each position of the incoming node's
+  // counter list is remembered and reused while the names at those positions are
+  // unchanged, avoiding a counter_map_ lookup per counter per report. A NULL
+  // counter marks a unit mismatch that has already been logged. Protected by
+  // counter_map_lock_.
+  std::vector<std::pair<std::string, Counter*> > update_counter_cache_;
+
+  // Same as update_counter_cache_ but for the incoming node's children, avoiding
+  // a child_map_ lookup per child per report. Protected by children_lock_.
+  std::vector<std::pair<std::string, RuntimeProfile*> > update_child_cache_;
+
   // protects counter_map_, counter_child_map_ and bucketing_counters_
   mutable boost::mutex counter_map_lock_;
 
@@ -606,6 +690,10 @@ class RuntimeProfile {
   TimeSeriesCounterMap time_series_counter_map_;
   mutable boost::mutex time_series_counter_map_lock_;
 
+  typedef std::map<std::string, HistogramCounter*> HistogramCounterMap;
+  HistogramCounterMap histogram_counter_map_;
+  mutable boost::mutex histogram_counter_map_lock_;
+
   Counter counter_total_time_;
 
   // Total time that child profiles spent in an asychronous thread. This is used
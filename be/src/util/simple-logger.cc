@@ -26,7 +26,7 @@ using namespace impala;
 
 const ptime EPOCH = time_from_string("1970-01-01 00:00:00.000");
 
-Status InitLoggingDir(const string& log_dir) {
+Status impala::InitLoggingDir(const string& log_dir) {
   if (!exists(log_dir)) {
     LOG(INFO) << "Log directory does not exist, creating: " << log_dir;
     try {
@@ -22,6 +22,10 @@
 
 namespace impala {
 
+// Creates 'log_dir' if it does not already exist and confirms it is a directory.
+// Shared by the file-backed loggers (SimpleLogger, GzipLogger).
+Status InitLoggingDir(const std::string& log_dir);
+
 // A class that provides basic thread-safe support for logging to a file. Supports
 // creation of the log file and log directories as well as rolling the log file when
 // it has reached a specified number of entries.
@@ -16,53 +16,93 @@
 #ifndef IMPALA_UTIL_SPINLOCK_H
 #define IMPALA_UTIL_SPINLOCK_H
 
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include "common/atomic.h"
 #include "common/logging.h"
 
 namespace impala {
 
-// Lightweight spinlock.
+// Lightweight adaptive lock. The uncontended paths are a single compare-and-swap
+// (Lock) and a single exchange (Unlock). Under contention a waiter first spins with
+// exponential backoff, then parks in the kernel with futex(). Parking matters
+// because we routinely run more fragment threads than cores: a waiter that keeps
+// spinning occupies the very core the lock holder needs to run on, while a parked
+// waiter gives that core up and is woken directly by Unlock().
 class SpinLock {
  public:
-  SpinLock() : locked_(false) {}
+  SpinLock() : state_(UNLOCKED) {}
 
   void Lock() {
-    while (true) {
-      if(__sync_bool_compare_and_swap(&locked_, false, true)) return;
-      for (int i = 0; i < NUM_SPIN_CYCLES; ++i) {
-        AtomicUtil::CpuWait();
-      }
-      if(__sync_bool_compare_and_swap(&locked_, false, true)) return;
-      sched_yield();
-    }
+    if (LIKELY(TryLock())) return;
+    SlowLock();
   }
 
   void Unlock() {
-    // Memory barrier here. All updates before the unlock need to be made visible.
-    __sync_synchronize();
-    DCHECK(locked_);
-    locked_ = false;
+    // The exchange is a full memory barrier: all updates before the unlock are made
+    // visible before the lock is released.
+    int32_t prev_state = __sync_lock_test_and_set(&state_, UNLOCKED);
+    DCHECK(prev_state != UNLOCKED);
+    if (UNLIKELY(prev_state == LOCKED_WITH_WAITERS)) {
+      syscall(SYS_futex, &state_, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
   }
 
-  void DCheckLocked() { DCHECK(locked_); }
+  void DCheckLocked() { DCHECK(state_ != UNLOCKED); }
 
  private:
-  // In typical spin lock implements, we want to spin (and keep the core fully busy),
-  // for some number of cycles before yielding. Consider these three cases:
+  // Consider these three cases for a contended lock:
   //  1) lock is un-contended - spinning doesn't kick in and has no effect.
   //  2) lock is taken by another thread and that thread finishes quickly.
   //  3) lock is taken by another thread and that thread is slow (e.g. scheduled away).
   //
-  // In case 3), we'd want to yield so another thread can do work. This thread
-  // won't be able to do anything useful until the thread with the lock runs again.
-  // In case 2), we don't want to yield (and give up our scheduling time slice)
-  // since we will get to run soon after.
-  // To try to get the best of everything, we will busy spin for a while before
-  // yielding to another thread.
-  // TODO: how do we set this.
-  static const int NUM_SPIN_CYCLES = 70;
+  // In case 2) we want to keep spinning - we will get the lock soon and parking
+  // would cost two context switches. In case 3) spinning is pure waste; worse, if
+  // the machine is oversubscribed the spinner may be burning the core the holder
+  // needs. The backoff spin handles 2) with increasing politeness, and the futex
+  // park handles 3) without the blind sched_yield() retry loop we used to have.
+  static const int MIN_SPIN_CYCLES = 4;
+  static const int MAX_SPIN_CYCLES = 1024;
+
+  // Lock states. A contended waiter moves the lock to LOCKED_WITH_WAITERS before
+  // parking so that Unlock() knows a futex wake is needed.
+  static const int32_t UNLOCKED = 0;
+  static const int32_t LOCKED = 1;
+  static const int32_t LOCKED_WITH_WAITERS = 2;
+
+  bool TryLock() {
+    return __sync_bool_compare_and_swap(&state_, UNLOCKED, LOCKED);
+  }
+
+  // Out-of-line-ish slow path: backoff spin, then park.
+  void SlowLock() {
+    int num_spin_cycles = MIN_SPIN_CYCLES;
+    while (true) {
+      for (int i = 0; i < num_spin_cycles; ++i) {
+        AtomicUtil::CpuWait();
+      }
+      // Test before the compare-and-swap to avoid hammering the cache line with
+      // failed atomic operations while the lock is held.
+      if (state_ == UNLOCKED && TryLock()) return;
+      if (num_spin_cycles >= MAX_SPIN_CYCLES) break;
+      num_spin_cycles <<= 1;
+    }
+
+    // Park until the lock is handed to us. We conservatively install
+    // LOCKED_WITH_WAITERS: if the exchange returns UNLOCKED we now hold the lock
+    // (and the next Unlock() will issue a wake that may find no waiters, which is
+    // harmless); otherwise the holder is guaranteed to see the waiter state and
+    // wake us.
+    while (__sync_lock_test_and_set(&state_, LOCKED_WITH_WAITERS) != UNLOCKED) {
+      syscall(SYS_futex, &state_, FUTEX_WAIT_PRIVATE, LOCKED_WITH_WAITERS, NULL,
+          NULL, 0);
+    }
+  }
+
   // TODO: pad this to be a cache line?
-  bool locked_;
+  int32_t state_;
 };
 
 class ScopedSpinLock {
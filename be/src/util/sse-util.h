@@ -114,6 +114,11 @@ static inline uint32_t SSE4_crc32_u32(uint32_t crc, uint32_t v) {
   return crc;
 }
 
+static inline uint64_t SSE4_crc32_u64(uint64_t crc, uint64_t v) {
+  __asm__("crc32q %1, %0" : "+r"(crc) : "rm"(v));
+  return crc;
+}
+
 static inline int64_t POPCNT_popcnt_u64(uint64_t a) {
   int64_t result;
   __asm__("popcntq %1, %0" : "=r"(result) : "mr"(a) : "cc");
@@ -134,6 +139,7 @@ static inline int64_t POPCNT_popcnt_u64(uint64_t a) {
 #define SSE4_cmpestri _mm_cmpestri
 #define SSE4_crc32_u8 _mm_crc32_u8
 #define SSE4_crc32_u32 _mm_crc32_u32
+#define SSE4_crc32_u64 _mm_crc32_u64
 #define POPCNT_popcnt_u64 _mm_popcnt_u64
 
 #else  // IR_COMPILE without SSE 4.2.
@@ -164,6 +170,11 @@ static inline uint32_t SSE4_crc32_u32(uint32_t crc, uint32_t v) {
   return 0;
 }
 
+static inline uint64_t SSE4_crc32_u64(uint64_t crc, uint64_t v) {
+  DCHECK(false) << "CPU doesn't support SSE 4.2";
+  return 0;
+}
+
 static inline int64_t POPCNT_popcnt_u64(uint64_t a) {
   DCHECK(false) << "CPU doesn't support SSE 4.2";
   return 0;
@@ -14,6 +14,7 @@
 
 #include "util/thread.h"
 
+#include <list>
 #include <set>
 #include <map>
 #include <boost/foreach.hpp>
@@ -33,6 +34,13 @@ using namespace boost;
 using namespace rapidjson;
 using namespace std;
 
+DEFINE_int32(thread_cache_size, 512, "(Advanced) Maximum number of finished worker "
+    "threads the daemon keeps parked for reuse by later Thread instances. Reusing "
+    "workers eliminates per-query thread creation and teardown and keeps their cpu "
+    "caches and allocator free lists warm. Threads are created on demand and parked "
+    "when their work finishes, so at steady state no threads are created or destroyed. "
+    "0 disables reuse and restores one operating system thread per Thread instance.");
+
 namespace impala {
 
 static const string THREADS_WEB_PAGE = "/threadz";
@@ -150,6 +158,121 @@ class ThreadMgr {
   void ThreadOverviewUrlCallback(const Webserver::ArgumentMap& args, Document* document);
 };
 
+// A daemon-wide cache of parked operating system threads that Thread draws its
+// workers from. Offer() hands a task to a parked worker if one is available and
+// otherwise starts a new worker; when a task finishes, its worker parks itself for
+// reuse instead of exiting, up to --thread_cache_size parked workers. Because a
+// worker is dedicated to one task for the task's entire lifetime, this changes
+// nothing about Thread's semantics - it only eliminates the clone/exit churn (and
+// cold cpu caches) of creating a fresh operating system thread per Thread instance.
+// Used only by Thread.
+class ThreadCache {
+ public:
+  // A unit of work for a worker thread: the Thread functor plus everything needed to
+  // register with the ThreadMgr and to report startup and completion back to the
+  // Thread object. All members are copies or shared, so the task stays valid even if
+  // the originating Thread object is destroyed (see Thread::StartThread()).
+  struct Task {
+    Thread::ThreadFunctor functor;
+    string name;
+    string category;
+    // Set to the worker's system TID once the task is registered. Not owned; only
+    // valid until it is set, since Thread::StartThread() blocks on it.
+    Promise<int64_t>* thread_started;
+    // Set to true when the functor has finished and the task is unregistered.
+    shared_ptr<Promise<bool> > task_done;
+
+    Task() : thread_started(NULL) {}
+  };
+
+  ThreadCache(int max_parked) : max_parked_(max_parked), num_parked_(0) {}
+
+  // Runs 'task' on a parked worker if one is available, otherwise on a newly created
+  // (detached) worker thread. Returns without waiting for the task to start.
+  void Offer(const Task& task) {
+    {
+      lock_guard<mutex> l(lock_);
+      if (num_parked_ > 0) {
+        // Reserve the worker we are about to wake so that concurrent Offer()s don't
+        // hand more tasks to the queue than there are parked workers.
+        --num_parked_;
+        queue_.push_back(task);
+        task_available_.notify_one();
+        return;
+      }
+    }
+    thread worker(bind(&ThreadCache::WorkerLoop, this, task));
+    worker.detach();
+  }
+
+ private:
+  // Main loop of a worker thread: runs 'task', then parks and waits for further tasks
+  // until the cache is full, at which point the worker exits.
+  void WorkerLoop(Task task);
+
+  // Parks the calling worker until a task is available. Returns false without parking
+  // if the cache already holds max_parked_ workers, in which case the caller exits.
+  bool GetNextTask(Task* task) {
+    unique_lock<mutex> l(lock_);
+    if (num_parked_ >= max_parked_) return false;
+    ++num_parked_;
+    while (queue_.empty()) task_available_.wait(l);
+    *task = queue_.front();
+    queue_.pop_front();
+    return true;
+  }
+
+  // Maximum number of parked workers; from --thread_cache_size.
+  const int max_parked_;
+
+  // Protects all fields below.
+  mutex lock_;
+  condition_variable task_available_;
+
+  // Number of workers parked in GetNextTask(), minus workers already reserved for
+  // tasks sitting in queue_.
+  int num_parked_;
+
+  // Tasks handed to reserved parked workers, normally empty or size 1.
+  list<Task> queue_;
+};
+
+// Singleton instance of ThreadCache, created by InitThreading(). Worker threads are
+// detached and reference the cache until process exit, so it is never destroyed.
+static ThreadCache* thread_cache;
+
+void ThreadCache::WorkerLoop(Task task) {
+  int64_t system_tid = syscall(SYS_gettid);
+  if (system_tid == -1) {
+    string error_msg = GetStrErrMsg();
+    LOG_EVERY_N(INFO, 100) << "Could not determine thread ID: " << error_msg;
+  }
+  // Hold a reference to the ThreadMgr for the worker's whole lifetime so that
+  // unregistering can't race with the destruction of the manager at process exit.
+  shared_ptr<ThreadMgr> thread_mgr_ref = thread_manager;
+  while (true) {
+    stringstream ss;
+    ss << (task.name.empty() ? "thread" : task.name) << "-" << system_tid;
+    string category = task.category.empty() ? "no-category" : task.category;
+
+    // Use boost's get_id rather than the system thread ID as the unique key for this
+    // thread since the latter is more prone to being recycled.
+    thread_mgr_ref->AddThread(this_thread::get_id(), ss.str(), category, system_tid);
+    task.thread_started->Set(system_tid);
+    // The Thread object that created this task may be destroyed any time after the
+    // promise above is set; only the task's own copies may be referenced below.
+
+    task.functor();
+
+    thread_mgr_ref->RemoveThread(this_thread::get_id(), category);
+    task.task_done->Set(true);
+    // Drop the references held by the finished task (in particular the functor's
+    // bound arguments) before parking, so they don't outlive their Thread.
+    task = Task();
+    if (!GetNextTask(&task)) break;
+  }
+}
+
 Status ThreadMgr::StartInstrumentation(MetricGroup* metrics, Webserver* webserver) {
   DCHECK(metrics != NULL);
   DCHECK(webserver != NULL);
@@ -259,6 +382,8 @@ void ThreadMgr::ThreadGroupUrlCallback(const Webserver::ArgumentMap& args,
 void InitThreading() {
   DCHECK(thread_manager.get() == NULL);
   thread_manager.reset(new ThreadMgr());
+  DCHECK(thread_cache == NULL);
+  thread_cache = new ThreadCache(FLAGS_thread_cache_size);
 }
 
 Status StartThreadInstrumentation(MetricGroup* metrics, Webserver* webserver) {
@@ -271,47 +396,25 @@ void Thread::StartThread(const ThreadFunctor& functor) {
   DCHECK(tid_ == UNINITIALISED_THREAD_ID) << "StartThread called twice";
 
   Promise<int64_t> thread_started;
-  thread_.reset(
-      new thread(&Thread::SuperviseThread, name_, category_, functor, &thread_started));
+  task_done_.reset(new Promise<bool>());
+
+  ThreadCache::Task task;
+  task.functor = functor;
+  task.name = name_;
+  task.category = category_;
+  task.thread_started = &thread_started;
+  task.task_done = task_done_;
+  thread_cache->Offer(task);
 
   // TODO: This slows down thread creation although not enormously. To make this faster,
   // consider delaying thread_started.Get() until the first call to tid(), but bear in
-  // mind that some coordination is required between SuperviseThread() and this to make
-  // sure that the thread is still available to have its tid set.
+  // mind that some coordination is required between the worker and this to make sure
+  // that the thread is still available to have its tid set.
   tid_ = thread_started.Get();
 
   VLOG(2) << "Started thread " << tid_ << " - " << category_ << ":" << name_;
 }
 
-void Thread::SuperviseThread(const string& name, const string& category,
-    Thread::ThreadFunctor functor, Promise<int64_t>* thread_started) {
-  int64_t system_tid = syscall(SYS_gettid);
-  if (system_tid == -1) {
-    string error_msg = GetStrErrMsg();
-    LOG_EVERY_N(INFO, 100) << "Could not determine thread ID: " << error_msg;
-  }
-  // Make a copy, since we want to refer to these variables after the unsafe point below.
-  string category_copy = category;
-  shared_ptr<ThreadMgr> thread_mgr_ref = thread_manager;
-  stringstream ss;
-  ss << (name.empty() ? "thread" : name) << "-" << system_tid;
-  string name_copy = ss.str();
-
-  if (category_copy.empty()) category_copy = "no-category";
-
-  // Use boost's get_id rather than the system thread ID as the unique key for this thread
-  // since the latter is more prone to being recycled.
-  thread_mgr_ref->AddThread(this_thread::get_id(), name_copy, category_copy, system_tid);
-  thread_started->Set(system_tid);
-
-  // Any reference to any parameter not copied in by value may no longer be valid after
-  // this point, since the caller that is waiting on *tid != 0 may wake, take the lock and
-  // destroy the enclosing Thread object.
-
-  functor();
-  thread_mgr_ref->RemoveThread(this_thread::get_id(), category_copy);
-}
-
 Status ThreadGroup::AddThread(Thread* thread) {
   threads_.push_back(thread);
   if (!cgroup_path_.empty()) {
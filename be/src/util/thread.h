@@ -18,6 +18,7 @@
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
@@ -41,6 +42,12 @@ class CgroupsMgr;
 // attach debuggers to specific threads, to retrieve resource-usage statistics from the
 // operating system, and to assign threads to resource control groups.
 //
+// To avoid per-query thread creation and teardown costs, the operating system threads
+// backing Thread objects are drawn from a daemon-wide cache of parked workers (see
+// ThreadCache in thread.cc and --thread_cache_size). This is transparent to clients:
+// every Thread still gets a dedicated operating system thread for the lifetime of its
+// functor, with its own tid and ThreadMgr registration.
+//
 // TODO: Consider allowing fragment IDs as category parameters.
 class Thread {
  public:
@@ -99,7 +106,10 @@ class Thread {
 
   // Blocks until this thread finishes execution. Once this method returns, the thread
   // will be unregistered with the ThreadMgr and will not appear in the debug UI.
-  void Join() const { thread_->join(); }
+  // Note that the underlying operating system thread may live on: finished threads
+  // are parked in a daemon-wide cache and reused for later Thread instances (see
+  // --thread_cache_size), which avoids per-query thread creation and teardown.
+  void Join() const { task_done_->Get(); }
 
   // The thread ID assigned to this thread by the operating system. If the OS does not
   // support retrieving the tid, returns Thread::INVALID_THREAD_ID.
@@ -113,11 +123,17 @@ class Thread {
   // clients of this class.
   static const int64_t UNINITIALISED_THREAD_ID = -2;
 
+  // ThreadCache hands the functor and completion promise to a worker thread.
+  friend class ThreadCache;
+
   // Function object that wraps the user-supplied function to run in a separate thread.
   typedef boost::function<void ()> ThreadFunctor;
 
-  // The actual thread object that runs the user's method via SuperviseThread().
-  boost::scoped_ptr<boost::thread> thread_;
+  // Set to true by the worker thread once the user's method has finished and the
+  // thread has been unregistered from the ThreadMgr. Shared with the worker so that
+  // the Thread object can be destroyed while the method is still running, mirroring
+  // boost::thread's detach-on-destruction semantics.
+  boost::shared_ptr<Promise<bool> > task_done_;
 
   // Name and category for this thread
   const std::string category_;
@@ -128,32 +144,14 @@ class Thread {
   // non-negative integer, or INVALID_THREAD_ID.
   int64_t tid_;
 
-  // Starts the thread running SuperviseThread(), and returns once that thread has
-  // initialised and its TID read. Waits for notification from the started thread that
-  // initialisation is complete before returning.
+  // Hands the functor to the daemon-wide ThreadCache, which runs it either on a
+  // parked worker thread or, if none is available, on a newly created one. Returns
+  // once the worker has registered the task with the ThreadMgr and its TID has been
+  // read. The worker only receives copies of the name, category and functor plus the
+  // shared task_done_ promise, so the Thread object may be destroyed while the
+  // functor is still running - the same detach-on-destruction semantics as
+  // boost::thread, which this class emulates.
   void StartThread(const ThreadFunctor& functor);
-
-  // Wrapper for the user-supplied function. Always invoked from thread_. Executes the
-  // method in functor_, but before doing so registers with the global ThreadMgr and reads
-  // the thread's system TID. After the method terminates, it is unregistered.
-  //
-  // SuperviseThread() notifies StartThread() when thread initialisation is completed via
-  // the promise parameter, which is set to the new thread's system ID. After this point,
-  // it is no longer safe for SuperviseThread() to refer to parameters passed by reference
-  // or pointer to this method, because of a wrinkle in the lifecycle of boost threads: if
-  // the thread object representing a thread should be destroyed, the actual
-  // operating-system thread continues to run (the thread is detached, not
-  // terminated). Therefore it's not safe to make reference to the Thread object or any of
-  // its members in SuperviseThread() after it notifies the caller via thread_started that
-  // initialisation is completed.  An alternative is to join() in the destructor of
-  // Thread, but that's not the same semantics as boost::thread, which we are trying to
-  // emulate here.
-  //
-  // As a result, the 'functor' parameter is deliberately copied into this method, since
-  // it is used after the notification completes.h The tid parameter is written to exactly
-  // once before SuperviseThread() notifies the caller.
-  static void SuperviseThread(const std::string& name, const std::string& category,
-      ThreadFunctor functor, Promise<int64_t>* thread_started);
 };
 
 // Utility class to group together a set of threads. A replacement for
@@ -18,6 +18,7 @@
 
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "runtime/raw-value.h"
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
 #include "runtime/descriptors.h"
@@ -46,6 +47,7 @@ class TupleRowComparator {
     for (int i = 0; i < key_expr_ctxs_lhs.size(); ++i) {
       nulls_first_.push_back(nulls_first[i] ? -1 : 1);
     }
+    InitCompareFns();
   }
 
   TupleRowComparator(
@@ -57,6 +59,7 @@ class TupleRowComparator {
         is_asc_(key_expr_ctxs_lhs.size(), is_asc),
         nulls_first_(key_expr_ctxs_lhs.size(), nulls_first ? -1 : 1) {
     DCHECK_EQ(key_expr_ctxs_lhs.size(), key_expr_ctxs_rhs.size());
+    InitCompareFns();
   }
 
   // Returns a negative value if lhs is less than rhs, a positive value if lhs is greater
@@ -72,8 +75,9 @@ class TupleRowComparator {
       if (lhs_value == NULL && rhs_value != NULL) return nulls_first_[i];
       if (lhs_value != NULL && rhs_value == NULL) return -nulls_first_[i];
 
-      int result = RawValue::Compare(lhs_value, rhs_value, 
-                                     key_expr_ctxs_lhs_[i]->root()->type());
+      int result = compare_fns_[i] != NULL ?
+          compare_fns_[i](lhs_value, rhs_value) :
+          RawValue::Compare(lhs_value, rhs_value, key_expr_ctxs_lhs_[i]->root()->type());
       if (!is_asc_[i]) result = -result;
       if (result != 0) return result;
       // Otherwise, try the next Expr
@@ -96,11 +100,47 @@ class TupleRowComparator {
     return (*this)(lhs_row, rhs_row);
   }
 
+  // Batch variant of Compare() for partition-style loops: compares each of 'num_rows'
+  // single-tuple rows, laid out contiguously every 'tuple_size' bytes starting at
+  // 'tuples', against 'pivot', and writes the sign of Compare(row, pivot) to the
+  // corresponding entry of 'results'. Evaluating a sequential run of rows in one call
+  // keeps the key expr evaluation out of the caller's random-access swap loops (see
+  // Sorter::TupleSorter::Partition()).
+  void CompareAgainstPivot(uint8_t* tuples, int tuple_size, int64_t num_rows,
+      TupleRow* pivot, int8_t* results) const {
+    for (int64_t i = 0; i < num_rows; ++i) {
+      uint8_t* tuple = tuples + i * tuple_size;
+      int result = Compare(reinterpret_cast<TupleRow*>(&tuple), pivot);
+      results[i] = result < 0 ? -1 : (result > 0 ? 1 : 0);
+    }
+  }
+
+  // Accessors used by callers that derive a normalized (memcmp-able) representation
+  // of this comparator's sort order, e.g. Sorter. See util/key-normalizer.h.
+  const std::vector<ExprContext*>& key_expr_ctxs_lhs() const {
+    return key_expr_ctxs_lhs_;
+  }
+  const std::vector<bool>& is_asc() const { return is_asc_; }
+  // Returns true if NULLs sort before non-NULL values for key expr 'i'.
+  bool nulls_first(int i) const { return nulls_first_[i] < 0; }
+
  private:
+  // Resolves the comparison kernel for each key's type once (see
+  // RawValue::GetCompareFn()) so Compare() does not re-dispatch on the type per call.
+  // NULL entries (e.g. CHAR keys) fall back to RawValue::Compare().
+  void InitCompareFns() {
+    compare_fns_.reserve(key_expr_ctxs_lhs_.size());
+    for (int i = 0; i < key_expr_ctxs_lhs_.size(); ++i) {
+      compare_fns_.push_back(
+          RawValue::GetCompareFn(key_expr_ctxs_lhs_[i]->root()->type()));
+    }
+  }
+
   std::vector<ExprContext*> key_expr_ctxs_lhs_;
   std::vector<ExprContext*> key_expr_ctxs_rhs_;
   std::vector<bool> is_asc_;
   std::vector<int8_t> nulls_first_;
+  std::vector<RawValue::CompareFn> compare_fns_;
 };
 
 // Compares the equality of two Tuples, going slot by slot.